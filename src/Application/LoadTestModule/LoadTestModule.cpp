@@ -0,0 +1,280 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "DebugOperatorNew.h"
+
+#include "LoadTestModule.h"
+
+#include "SimulatedUser.h"
+
+#include "Framework.h"
+#include "CoreDefines.h"
+#include "LoggingFunctions.h"
+#include "ConsoleAPI.h"
+#include "Application.h"
+#include "TundraLogicModule.h"
+#include "KristalliProtocolModule.h"
+#include "Server.h"
+#include "SyncState.h"
+#include "UserConnection.h"
+#include "Math/MathFunc.h"
+#include "Time/Clock.h"
+
+#include <algorithm>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    /// Returns the value below which the given fraction of the samples fall.
+    float Percentile(std::vector<float> &sortedSamples, float fraction)
+    {
+        if (sortedSamples.empty())
+            return 0.f;
+        const size_t index = (size_t)(fraction * (sortedSamples.size() - 1) + 0.5f);
+        return sortedSamples[Min(index, sortedSamples.size() - 1)];
+    }
+
+    QString PercentileReport(std::vector<float> samples, const QString &unit)
+    {
+        if (samples.empty())
+            return "no samples";
+        std::sort(samples.begin(), samples.end());
+        return QString("p50 %1 %5, p90 %2 %5, p99 %3 %5, max %4 %5 (%6 samples)")
+            .arg(Percentile(samples, 0.5f), 0, 'f', 2).arg(Percentile(samples, 0.9f), 0, 'f', 2)
+            .arg(Percentile(samples, 0.99f), 0, 'f', 2).arg(samples.back(), 0, 'f', 2).arg(unit).arg(samples.size());
+    }
+}
+
+LoadTestSettings::LoadTestSettings() :
+    numUsers(100),
+    address("127.0.0.1"),
+    port(2345),
+    transport(kNet::SocketOverUDP),
+    duration(0.f),
+    moveInterval(0.1f),
+    actionInterval(2.f),
+    connectsPerFrame(10),
+    reportInterval(10.f)
+{
+}
+
+LoadTestModule::LoadTestModule() :
+    IModule("LoadTestModule"),
+    numConnectStarted_(0),
+    sessionId_(0),
+    time_(0.0),
+    nextReportTime_(0.0),
+    exitWhenDone_(false),
+    serverInProcess_(false),
+    lastUsersTime_(0.f)
+{
+}
+
+LoadTestModule::~LoadTestModule()
+{
+    Stop();
+}
+
+void LoadTestModule::Initialize()
+{
+    framework_->Console()->RegisterCommand("loadTestStart", "Starts a load test against the server. Usage: loadTestStart(numUsers)",
+        this, SLOT(Start(int)), SLOT(Start()));
+    framework_->Console()->RegisterCommand("loadTestStop", "Stops the load test and prints the final report.", this, SLOT(Stop()));
+    framework_->Console()->RegisterCommand("loadTestReport", "Prints a report of the running load test.", this, SLOT(PrintReport()));
+
+    ReadStartupParameters();
+}
+
+void LoadTestModule::Uninitialize()
+{
+    Stop();
+}
+
+void LoadTestModule::ReadStartupParameters()
+{
+    QStringList params = framework_->CommandLineParameters("--loadTestAddress");
+    if (!params.isEmpty())
+    {
+        QStringList parts = params.first().split(':');
+        settings_.address = parts[0].toStdString();
+        if (parts.size() > 1)
+            settings_.port = (unsigned short)parts[1].toUInt();
+    }
+    else if (!framework_->CommandLineParameters("--port").isEmpty())
+        settings_.port = (unsigned short)framework_->CommandLineParameters("--port").first().toUInt();
+
+    params = framework_->CommandLineParameters("--loadTestProtocol");
+    if (params.isEmpty())
+        params = framework_->CommandLineParameters("--protocol");
+    if (!params.isEmpty())
+    {
+        kNet::SocketTransportLayer transport = kNet::StringToSocketTransportLayer(params.first().trimmed().toStdString().c_str());
+        if (transport != kNet::InvalidTransportLayer)
+            settings_.transport = transport;
+        else
+            LogWarning("LoadTestModule: Unknown protocol " + params.first() + ", using " + kNet::SocketTransportLayerToString(settings_.transport).c_str());
+    }
+
+    params = framework_->CommandLineParameters("--loadTestDuration");
+    if (!params.isEmpty())
+        settings_.duration = params.first().toFloat();
+
+    params = framework_->CommandLineParameters("--loadTest");
+    if (!params.isEmpty())
+    {
+        settings_.numUsers = Max(1, params.first().toInt());
+        exitWhenDone_ = settings_.duration > 0.f;
+    }
+}
+
+void LoadTestModule::Start(int numUsers)
+{
+    settings_.numUsers = Max(1, numUsers);
+    Start();
+}
+
+void LoadTestModule::Start()
+{
+    Stop();
+
+    TundraLogic::TundraLogicModule *tundraLogic = framework_->GetModule<TundraLogic::TundraLogicModule>();
+    serverInProcess_ = tundraLogic && tundraLogic->IsServer();
+    if (serverInProcess_ && framework_->App()->TargetFpsLimit() > 0.0)
+        LogWarning("LoadTestModule: The FPS limit is on, the server tick times include the time spent waiting. Run with --fpsLimit 0 for accurate tick times.");
+
+    sessionId_ = (u32)Clock::Tick() ^ (u32)(Clock::Tick() >> 32);
+    for(int i = 0; i < settings_.numUsers; ++i)
+        users_.push_back(new SimulatedUser(framework_, i, sessionId_));
+    numConnectStarted_ = 0;
+    time_ = 0.0;
+    nextReportTime_ = settings_.reportInterval;
+    lastUsersTime_ = 0.f;
+    tickTimes_.clear();
+    latencies_.clear();
+    backlogs_.clear();
+
+    LogInfo(QString("LoadTestModule: Starting %1 users against %2:%3 over %4.").arg(settings_.numUsers).arg(settings_.address.c_str())
+        .arg(settings_.port).arg(kNet::SocketTransportLayerToString(settings_.transport).c_str()));
+}
+
+void LoadTestModule::Stop()
+{
+    if (users_.empty())
+        return;
+    PrintReport();
+    for(size_t i = 0; i < users_.size(); ++i)
+        delete users_[i];
+    users_.clear();
+}
+
+void LoadTestModule::Update(f64 frametime)
+{
+    // A load test given on the command line starts once the server of this process, if any, is up.
+    if (users_.empty() && numConnectStarted_ == 0 && framework_->HasCommandLineParameter("--loadTest"))
+    {
+        TundraLogic::TundraLogicModule *tundraLogic = framework_->GetModule<TundraLogic::TundraLogicModule>();
+        if (!framework_->HasCommandLineParameter("--server") || (tundraLogic && tundraLogic->IsServer()))
+            Start();
+        else
+            return;
+    }
+    if (users_.empty())
+        return;
+
+    const tick_t start = Clock::Tick();
+    time_ += frametime;
+
+    // The frame time minus the time spent in the simulated users on the previous frame is the server tick time.
+    if (serverInProcess_)
+        tickTimes_.push_back(Max(0.f, (float)(frametime * 1000.0) - lastUsersTime_));
+
+    KristalliProtocolModule *kristalli = framework_->GetModule<KristalliProtocolModule>();
+    for(int i = 0; i < settings_.connectsPerFrame && numConnectStarted_ < (int)users_.size() && kristalli; ++i, ++numConnectStarted_)
+        users_[numConnectStarted_]->Connect(kristalli->Network(), settings_.address.c_str(), settings_.port, settings_.transport);
+
+    for(size_t i = 0; i < users_.size(); ++i)
+    {
+        users_[i]->Update((float)time_, settings_.moveInterval, settings_.actionInterval);
+        users_[i]->TakeLatencies(latencies_);
+    }
+
+    const int backlog = SyncBacklog();
+    if (backlog >= 0)
+        backlogs_.push_back((float)backlog);
+
+    lastUsersTime_ = (float)Clock::TicksToMillisecondsD(Clock::TicksInBetween(Clock::Tick(), start));
+
+    if (settings_.duration > 0.f && time_ >= settings_.duration)
+    {
+        Stop();
+        if (exitWhenDone_)
+            framework_->Exit();
+    }
+    else if (time_ >= nextReportTime_)
+    {
+        PrintReport();
+        nextReportTime_ += settings_.reportInterval;
+    }
+}
+
+int LoadTestModule::SyncBacklog() const
+{
+    if (!serverInProcess_)
+        return -1;
+    TundraLogic::TundraLogicModule *tundraLogic = framework_->GetModule<TundraLogic::TundraLogicModule>();
+    if (!tundraLogic || !tundraLogic->GetServer())
+        return -1;
+
+    int backlog = 0;
+    const UserConnectionList &connections = tundraLogic->GetServer()->UserConnections();
+    for(UserConnectionList::const_iterator i = connections.begin(); i != connections.end(); ++i)
+        if ((*i)->syncState)
+            backlog += (*i)->syncState->dirtyQueue.size() + (int)(*i)->syncState->queuedActions.size();
+    return backlog;
+}
+
+void LoadTestModule::PrintReport()
+{
+    if (users_.empty())
+    {
+        LogInfo("LoadTestModule: No load test running.");
+        return;
+    }
+
+    int numRunning = 0;
+    int numFailed = 0;
+    std::vector<float> bytesIn;
+    std::vector<float> bytesOut;
+    const float seconds = Max((float)time_, 1e-3f);
+    for(size_t i = 0; i < users_.size(); ++i)
+    {
+        if (users_[i]->GetState() == SimulatedUser::Running)
+            ++numRunning;
+        else if (users_[i]->GetState() == SimulatedUser::Failed)
+            ++numFailed;
+        bytesIn.push_back(users_[i]->Stats().bytesIn / 1024.f / seconds);
+        bytesOut.push_back(users_[i]->Stats().bytesOut / 1024.f / seconds);
+    }
+
+    LogInfo(QString("Load test after %1 s: %2/%3 users running, %4 failed").arg(time_, 0, 'f', 1).arg(numRunning).arg(users_.size()).arg(numFailed));
+    if (serverInProcess_)
+    {
+        LogInfo("  Server tick time:   " + PercentileReport(tickTimes_, "ms"));
+        LogInfo("  Sync backlog:       " + PercentileReport(backlogs_, "items"));
+    }
+    else
+        LogInfo("  Server tick time and sync backlog are only measured when the server runs in this process.");
+    LogInfo("  Bandwidth in/user:  " + PercentileReport(bytesIn, "KB/s"));
+    LogInfo("  Bandwidth out/user: " + PercentileReport(bytesOut, "KB/s"));
+    LogInfo("  Message latency:    " + PercentileReport(latencies_, "ms"));
+}
+
+extern "C"
+{
+    DLLEXPORT void TundraPluginMain(Framework *fw)
+    {
+        Framework::SetInstance(fw); // Inside this DLL, remember the pointer to the global framework object.
+        IModule *module = new LoadTestModule();
+        fw->RegisterModule(module);
+    }
+}
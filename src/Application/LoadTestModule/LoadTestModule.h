@@ -0,0 +1,92 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "IModule.h"
+#include "CoreTypes.h"
+
+#include <kNet/Types.h>
+#include <kNet/Socket.h>
+
+#include <QString>
+
+#include <vector>
+#include <string>
+
+class SimulatedUser;
+
+/// Settings of a load test.
+struct LoadTestSettings
+{
+    LoadTestSettings();
+
+    int numUsers; ///< Number of simulated users. Default 100.
+    std::string address; ///< Server address. Default 127.0.0.1.
+    unsigned short port; ///< Server port. Default 2345.
+    kNet::SocketTransportLayer transport; ///< Default UDP.
+    float duration; ///< Length of the test in seconds, 0 to run until stopped. Default 0.
+    float moveInterval; ///< Seconds between the avatar movement updates of each user. Default 0.1.
+    float actionInterval; ///< Seconds between the entity actions of each user, 0 to disable. Default 2.
+    int connectsPerFrame; ///< Number of users that start connecting per frame, to avoid a burst of logins. Default 10.
+    float reportInterval; ///< Seconds between the intermediate reports. Default 10.
+};
+
+/// Headless load generator for Tundra servers.
+/** Spawns a swarm of SimulatedUser clients in one process, which log in to a server, move their avatars along scripted paths by
+    editing attributes and send entity actions to each other. Reports the server tick time, the bandwidth per user, the message
+    latency percentiles and the sync backlog.
+
+    Start with "--loadTest <numUsers>", optionally with "--loadTestAddress <host[:port]>", "--loadTestProtocol <udp|tcp>" and
+    "--loadTestDuration <seconds>", or with the loadTestStart, loadTestStop and loadTestReport console commands. When the duration is
+    given, Tundra exits after printing the final report.
+
+    The server tick time and the sync backlog are only available when the users are run in the server process, on loopback. The tick
+    time is then the duration of the frame with the time spent in the simulated users subtracted, so run the server with "--fpsLimit 0".
+    A typical pre-deployment benchmark: Tundra --server --headless --fpsLimit 0 --file scene.txml --plugin LoadTestModule
+    --loadTest 200 --loadTestDuration 60 */
+class LoadTestModule : public IModule
+{
+    Q_OBJECT
+
+public:
+    LoadTestModule();
+    ~LoadTestModule();
+
+    void Initialize();
+    void Uninitialize();
+    void Update(f64 frametime);
+
+    /// Returns the settings used by the next load test.
+    LoadTestSettings &Settings() { return settings_; }
+
+    bool IsRunning() const { return !users_.empty(); }
+
+public slots:
+    /// Starts a load test with the current settings.
+    void Start();
+    /// Starts a load test with the given number of users.
+    void Start(int numUsers);
+    /// Stops the load test, and prints the final report.
+    void Stop();
+    /// Prints a report of the running load test.
+    void PrintReport();
+
+private:
+    void ReadStartupParameters();
+    /// Returns the number of entities and entity actions waiting to be sent to all users of the server, or -1 if the server is not in this process.
+    int SyncBacklog() const;
+
+    LoadTestSettings settings_;
+    std::vector<SimulatedUser *> users_;
+    int numConnectStarted_;
+    u32 sessionId_;
+    f64 time_;
+    f64 nextReportTime_;
+    bool exitWhenDone_;
+    bool serverInProcess_;
+    float lastUsersTime_; ///< Milliseconds spent in the simulated users on the previous frame.
+
+    std::vector<float> tickTimes_; ///< Server tick times in milliseconds.
+    std::vector<float> latencies_; ///< Message latencies in milliseconds.
+    std::vector<float> backlogs_; ///< Sync backlog, sampled once per frame.
+};
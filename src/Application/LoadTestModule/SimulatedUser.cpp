@@ -0,0 +1,375 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "DebugOperatorNew.h"
+
+#include "SimulatedUser.h"
+
+#include "Framework.h"
+#include "CoreDefines.h"
+#include "CoreStringUtils.h"
+#include "LoggingFunctions.h"
+#include "SceneAPI.h"
+#include "IComponent.h"
+#include "IAttribute.h"
+#include "EC_Name.h"
+#include "EntityAction.h"
+#include "Transform.h"
+#include "UniqueIdGenerator.h"
+#include "TundraMessages.h"
+#include "MsgLogin.h"
+#include "MsgLoginReply.h"
+#include "MsgEntityAction.h"
+#include "Math/MathFunc.h"
+#include "Time/Clock.h"
+
+#include <kNet/DataSerializer.h>
+#include <kNet/DataDeserializer.h>
+#include <kNet/UDPMessageConnection.h>
+
+#include "MemoryLeakCheck.h"
+
+using namespace TundraLogic;
+
+namespace
+{
+    const char * const cPingAction = "LoadTestPing";
+
+    /// ID the simulated users use for their avatar entities before the server has assigned them one.
+    const entity_id_t cAvatarSenderId = 1;
+    /// IDs the simulated users use for the components of their avatar entities.
+    const component_id_t cNameSenderId = 1;
+    const component_id_t cPlaceableSenderId = 2;
+
+    /// Radius of the area in which the paths are placed, in meters.
+    const float cAreaRadius = 100.f;
+    /// Walking speed of the avatars, in meters per second.
+    const float cWalkSpeed = 2.f;
+}
+
+SimulatedUser::SimulatedUser(Framework *framework, int index, u32 sessionId) :
+    framework_(framework),
+    index_(index),
+    sessionId_(sessionId),
+    state_(Disconnected),
+    protocolVersion_(ProtocolOriginal),
+    connectionId_(0),
+    avatarId_(0),
+    placeableId_(0),
+    nextMoveTime_(0.f),
+    nextActionTime_(0.f)
+{
+    name_ = framework_->Scene()->CreateComponentById(0, EC_Name::TypeIdStatic());
+    placeable_ = framework_->Scene()->CreateComponentByName(0, "EC_Placeable");
+    if (name_)
+        static_cast<EC_Name *>(name_.get())->name.Set(QString("LoadTestUser%1").arg(index_), AttributeChange::Disconnected);
+
+    // Spread the pings of the users evenly.
+    nextActionTime_ = (index_ % 16) / 16.f;
+}
+
+SimulatedUser::~SimulatedUser()
+{
+    Disconnect();
+}
+
+bool SimulatedUser::Connect(kNet::Network *network, const char *address, unsigned short port, kNet::SocketTransportLayer transport)
+{
+    if (!placeable_)
+    {
+        LogError("SimulatedUser: Cannot simulate users without EC_Placeable, OgreRenderingModule is not loaded.");
+        state_ = Failed;
+        return false;
+    }
+
+    connection_ = network->Connect(address, port, transport, this);
+    if (!connection_)
+    {
+        state_ = Failed;
+        return false;
+    }
+
+    if (transport == kNet::SocketOverUDP)
+        static_cast<kNet::UDPMessageConnection*>(connection_.ptr())->SetDatagramSendRate(500);
+    if (connection_->GetSocket() && connection_->GetSocket()->TransportLayer() == kNet::SocketOverTCP)
+        connection_->GetSocket()->SetNaglesAlgorithmEnabled(false);
+
+    state_ = Connecting;
+    return true;
+}
+
+void SimulatedUser::Disconnect()
+{
+    if (connection_)
+    {
+        connection_->Disconnect(0);
+        connection_->Close(0);
+        connection_ = 0;
+    }
+    if (state_ != Failed)
+        state_ = Disconnected;
+}
+
+void SimulatedUser::Update(float time, float moveInterval, float actionInterval)
+{
+    if (!connection_)
+        return;
+
+    connection_->Process();
+    // Processing may have closed the connection.
+    if (!connection_ || connection_->GetConnectionState() == kNet::ConnectionClosed)
+    {
+        if (state_ != Disconnected)
+            LogWarning(QString("SimulatedUser: User %1 lost its connection.").arg(index_));
+        state_ = Failed;
+        connection_ = 0;
+        return;
+    }
+
+    if (state_ == Connecting && connection_->GetConnectionState() == kNet::ConnectionOK)
+        SendLogin();
+
+    if (state_ != Running)
+        return;
+
+    if (time >= nextMoveTime_)
+    {
+        SendMove(time);
+        nextMoveTime_ = Max(nextMoveTime_ + moveInterval, time);
+    }
+    if (actionInterval > 0.f && time >= nextActionTime_)
+    {
+        SendPing();
+        nextActionTime_ = Max(nextActionTime_ + actionInterval, time);
+    }
+}
+
+void SimulatedUser::TakeLatencies(std::vector<float> &latencies)
+{
+    latencies.insert(latencies.end(), latencies_.begin(), latencies_.end());
+    latencies_.clear();
+}
+
+float3 SimulatedUser::PathPosition(float time) const
+{
+    // Place the paths on a spiral, so that the users are spread evenly over the area regardless of their number.
+    const float angle = index_ * 2.39996f; // Golden angle.
+    const float distance = cAreaRadius * Sqrt((index_ % 256) / 256.f);
+    const float3 center(distance * Cos(angle), 0.f, distance * Sin(angle));
+    const float size = 5.f + (index_ % 7);
+    const float phase = cWalkSpeed * time / size;
+    switch((Path)(index_ % NumPaths))
+    {
+    case PathCircle:
+        return center + float3(Cos(phase), 0.f, Sin(phase)) * size;
+    case PathLine:
+        return center + float3(Sin(phase), 0.f, 0.f) * size;
+    case PathFigureEight:
+    default:
+        return center + float3(Sin(phase), 0.f, Sin(phase) * Cos(phase)) * size;
+    }
+}
+
+void SimulatedUser::Send(kNet::message_id_t id, bool reliable, bool inOrder, const kNet::DataSerializer &ds)
+{
+    connection_->SendMessage(id, reliable, inOrder, 100, 0, ds.GetData(), ds.BytesFilled());
+    stats_.bytesOut += ds.BytesFilled();
+    ++stats_.messagesOut;
+}
+
+void SimulatedUser::SendLogin()
+{
+    MsgLogin msg;
+    msg.loginData = StringToBuffer(QString("<login><username value=\"LoadTestUser%1\"/></login>").arg(index_).toStdString());
+    kNet::DataSerializer ds(msg.Size() + 4);
+    msg.SerializeTo(ds);
+    ds.AddVLE<kNet::VLE8_16_32>(cHighestSupportedProtocolVersion);
+    Send(msg.messageID, msg.reliable, msg.inOrder, ds);
+    state_ = LoggingIn;
+}
+
+void SimulatedUser::SendCreateAvatar()
+{
+    char buffer[8 * 1024];
+    kNet::DataSerializer ds(buffer, NUMELEMS(buffer));
+    ds.AddVLE<kNet::VLE8_16_32>(0); // Scene ID
+    ds.AddVLE<kNet::VLE8_16_32>(cAvatarSenderId);
+    ds.Add<u8>(1); // Temporary, the avatars are not saved with the scene.
+    if (protocolVersion_ >= ProtocolHierarchicScene)
+        ds.Add<u32>(0); // No parent
+    ds.AddVLE<kNet::VLE8_16_32>(2); // Number of components
+    WriteComponent(ds, cNameSenderId, name_);
+    WriteComponent(ds, cPlaceableSenderId, placeable_);
+    Send(cCreateEntityMessage, true, true, ds);
+    state_ = CreatingAvatar;
+}
+
+void SimulatedUser::SendMove(float time)
+{
+    Attribute<Transform> *transform = placeable_->AttributeById<Transform>("transform");
+    if (!transform)
+        return;
+    Transform t = transform->Get();
+    const float3 pos = PathPosition(time);
+    const float3 heading = PathPosition(time + 0.1f) - pos;
+    t.pos = pos;
+    if (!heading.IsZero(1e-6f))
+        t.rot = float3(0.f, RadToDeg(atan2(heading.x, heading.z)), 0.f);
+    transform->Set(t, AttributeChange::Disconnected);
+
+    // Same layout as the EditAttributes messages of SyncManager, with the changed attributes listed by index.
+    char attrBuffer[1024];
+    kNet::DataSerializer attrDs(attrBuffer, NUMELEMS(attrBuffer));
+    if (protocolVersion_ >= ProtocolQuantizedAttributes)
+        attrDs.Add<kNet::bit>(1); // Quantized with the metadata
+    attrDs.Add<kNet::bit>(0);
+    attrDs.Add<u8>(1);
+    attrDs.Add<u8>(transform->Index());
+    if (protocolVersion_ >= ProtocolQuantizedAttributes)
+        transform->ToQuantizedBinary(attrDs);
+    else
+        transform->ToBinary(attrDs);
+
+    char buffer[1024];
+    kNet::DataSerializer ds(buffer, NUMELEMS(buffer));
+    ds.AddVLE<kNet::VLE8_16_32>(0); // Scene ID
+    ds.AddVLE<kNet::VLE8_16_32>(avatarId_);
+    ds.AddVLE<kNet::VLE8_16_32>(placeableId_);
+    ds.AddVLE<kNet::VLE8_16_32>((u32)attrDs.BytesFilled());
+    ds.AddArray<u8>((const u8 *)attrBuffer, (u32)attrDs.BytesFilled());
+    Send(cEditAttributesMessage, true, true, ds);
+}
+
+void SimulatedUser::SendPing()
+{
+    MsgEntityAction msg;
+    msg.entityId = avatarId_;
+    msg.name = StringToBuffer(cPingAction);
+    msg.executionType = (u8)EntityAction::Peers;
+    MsgEntityAction::S_parameters session = { StringToBuffer(QString::number(sessionId_).toStdString()) };
+    MsgEntityAction::S_parameters sendTime = { StringToBuffer(QString::number(Clock::Tick()).toStdString()) };
+    msg.parameters.push_back(session);
+    msg.parameters.push_back(sendTime);
+
+    kNet::DataSerializer ds(msg.Size());
+    msg.SerializeTo(ds);
+    Send(msg.messageID, msg.reliable, msg.inOrder, ds);
+}
+
+void SimulatedUser::WriteComponent(kNet::DataSerializer &ds, component_id_t id, const ComponentPtr &comp)
+{
+    ds.AddVLE<kNet::VLE8_16_32>(id);
+    ds.AddVLE<kNet::VLE8_16_32>(comp->TypeId());
+    ds.AddString(comp->Name().toStdString());
+
+    char attrBuffer[4 * 1024];
+    kNet::DataSerializer attrDs(attrBuffer, NUMELEMS(attrBuffer));
+    const AttributeVector &attrs = comp->Attributes();
+    if (protocolVersion_ >= ProtocolQuantizedAttributes)
+    {
+        attrDs.Add<kNet::bit>(1); // Quantized with the metadata
+        attrDs.AddVLE<kNet::VLE8_16_32>(comp->NumStaticAttributes());
+    }
+    for(uint i = 0; i < comp->NumStaticAttributes(); ++i)
+    {
+        if (protocolVersion_ >= ProtocolQuantizedAttributes)
+            attrs[i]->ToQuantizedBinary(attrDs);
+        else
+            attrs[i]->ToBinary(attrDs);
+    }
+    ds.AddVLE<kNet::VLE8_16_32>((u32)attrDs.BytesFilled());
+    ds.AddArray<u8>((const u8 *)attrBuffer, (u32)attrDs.BytesFilled());
+}
+
+void SimulatedUser::HandleMessage(kNet::MessageConnection * /*source*/, kNet::packet_id_t /*packetId*/, kNet::message_id_t id, const char *data, size_t numBytes)
+{
+    stats_.bytesIn += numBytes;
+    ++stats_.messagesIn;
+
+    try
+    {
+        switch(id)
+        {
+        case MsgLoginReply::messageID:
+            HandleLoginReply(data, numBytes);
+            break;
+        case cCreateEntityReplyMessage:
+            HandleCreateEntityReply(data, numBytes);
+            break;
+        case MsgEntityAction::messageID:
+            HandleEntityAction(data, numBytes);
+            break;
+        case cSnapshotMessage:
+            HandleSnapshot(data, numBytes);
+            break;
+        default:
+            // The rest of the scene data is only counted.
+            break;
+        }
+    }
+    catch(const kNet::NetException &e)
+    {
+        LogError(QString("SimulatedUser: User %1 failed to read message %2: %3").arg(index_).arg(id).arg(e.what()));
+    }
+}
+
+void SimulatedUser::HandleLoginReply(const char *data, size_t numBytes)
+{
+    kNet::DataDeserializer dd(data, numBytes);
+    MsgLoginReply msg;
+    msg.DeserializeFrom(dd);
+    protocolVersion_ = ProtocolOriginal;
+    if (dd.BytesLeft())
+        protocolVersion_ = (NetworkProtocolVersion)dd.ReadVLE<kNet::VLE8_16_32>();
+
+    if (!msg.success)
+    {
+        LogError(QString("SimulatedUser: User %1 failed to log in.").arg(index_));
+        state_ = Failed;
+        return;
+    }
+    connectionId_ = msg.userID;
+    SendCreateAvatar();
+}
+
+void SimulatedUser::HandleCreateEntityReply(const char *data, size_t numBytes)
+{
+    kNet::DataDeserializer dd(data, numBytes);
+    dd.ReadVLE<kNet::VLE8_16_32>(); // Scene ID
+    const entity_id_t senderId = dd.ReadVLE<kNet::VLE8_16_32>();
+    const entity_id_t entityId = dd.ReadVLE<kNet::VLE8_16_32>();
+    if (senderId != cAvatarSenderId)
+        return;
+    const u32 numComponents = dd.ReadVLE<kNet::VLE8_16_32>();
+    for(u32 i = 0; i < numComponents; ++i)
+    {
+        const component_id_t senderCompId = dd.ReadVLE<kNet::VLE8_16_32>();
+        const component_id_t compId = dd.ReadVLE<kNet::VLE8_16_32>();
+        if (senderCompId == cPlaceableSenderId)
+            placeableId_ = compId;
+    }
+    avatarId_ = entityId;
+    state_ = Running;
+}
+
+void SimulatedUser::HandleEntityAction(const char *data, size_t numBytes)
+{
+    MsgEntityAction msg(data, numBytes);
+    if (BufferToString(msg.name) != cPingAction || msg.parameters.size() < 2)
+        return;
+    if (QString(BufferToString(msg.parameters[0].parameter).c_str()).toUInt() != sessionId_)
+        return; // From another load test.
+    const tick_t sendTime = QString(BufferToString(msg.parameters[1].parameter).c_str()).toULongLong();
+    latencies_.push_back((float)Clock::TicksToMillisecondsD(Clock::TicksInBetween(Clock::Tick(), sendTime)));
+}
+
+void SimulatedUser::HandleSnapshot(const char *data, size_t numBytes)
+{
+    // Acknowledge all the entities of the snapshots like a real client, so that the server sends deltas against the acknowledged baselines.
+    kNet::DataDeserializer dd(data, numBytes);
+    const u32 sequence = dd.Read<u32>();
+    kNet::DataSerializer ds(16);
+    ds.AddVLE<kNet::VLE8_16_32>(1);
+    ds.Add<u32>(sequence);
+    ds.AddVLE<kNet::VLE8_16_32>(0); // No entities listed, i.e. all of them.
+    Send(cSnapshotAckMessage, false, true, ds);
+}
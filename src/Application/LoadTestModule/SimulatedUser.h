@@ -0,0 +1,119 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "SceneFwd.h"
+#include "UserConnection.h"
+#include "Math/float3.h"
+
+#include <kNet/IMessageHandler.h>
+#include <kNet/MessageConnection.h>
+#include <kNet/Network.h>
+
+#include <QString>
+
+#include <vector>
+
+class Framework;
+
+/// Traffic counters of a simulated user.
+struct SimulatedUserStats
+{
+    SimulatedUserStats() : bytesIn(0), bytesOut(0), messagesIn(0), messagesOut(0) {}
+
+    u64 bytesIn; ///< Payload bytes of the received messages.
+    u64 bytesOut; ///< Payload bytes of the sent messages.
+    u32 messagesIn; ///< Number of received messages.
+    u32 messagesOut; ///< Number of sent messages.
+};
+
+/// Lightweight headless Tundra client used by LoadTestModule.
+/** Speaks the Tundra protocol directly on its own kNet connection, without a client scene: logs in, creates an avatar entity,
+    moves it along a scripted path with EditAttributes messages and sends entity actions to the other users. The scene
+    data the server sends is only counted, except for the snapshots, which are acknowledged like a real client does.
+
+    The entity actions are "LoadTestPing" actions executed on the peers. Each carries the session ID of the load test and the
+    time it was sent, so the users of the same load test can measure the latency of the messages relayed by the server. */
+class SimulatedUser : public kNet::IMessageHandler
+{
+public:
+    enum State
+    {
+        Disconnected,
+        Connecting,
+        LoggingIn,
+        CreatingAvatar,
+        Running,
+        Failed
+    };
+
+    /// Paths along which the users move their avatars.
+    enum Path
+    {
+        PathCircle,
+        PathLine,
+        PathFigureEight,
+        NumPaths
+    };
+
+    /// @param index Index of the user in the load test. Used for the username and to pick the path.
+    /// @param sessionId ID of the load test, carried in the pings.
+    SimulatedUser(Framework *framework, int index, u32 sessionId);
+    ~SimulatedUser();
+
+    /// Starts connecting to a server.
+    bool Connect(kNet::Network *network, const char *address, unsigned short port, kNet::SocketTransportLayer transport);
+
+    /// Disconnects from the server.
+    void Disconnect();
+
+    /// Processes the received messages, and sends the avatar movement and the pings when they are due.
+    /** @param time Seconds since the start of the load test.
+        @param moveInterval Seconds between the avatar movement updates.
+        @param actionInterval Seconds between the pings. */
+    void Update(float time, float moveInterval, float actionInterval);
+
+    /// kNet::IMessageHandler override.
+    void HandleMessage(kNet::MessageConnection *source, kNet::packet_id_t packetId, kNet::message_id_t id, const char *data, size_t numBytes);
+
+    State GetState() const { return state_; }
+    const SimulatedUserStats &Stats() const { return stats_; }
+
+    /// Appends the latencies of the pings received since the previous call, in milliseconds, and clears them.
+    void TakeLatencies(std::vector<float> &latencies);
+
+    /// Returns the position of the avatar on the path of the user at the given time.
+    float3 PathPosition(float time) const;
+
+private:
+    void Send(kNet::message_id_t id, bool reliable, bool inOrder, const kNet::DataSerializer &ds);
+    void SendLogin();
+    void SendCreateAvatar();
+    void SendMove(float time);
+    void SendPing();
+
+    void HandleLoginReply(const char *data, size_t numBytes);
+    void HandleCreateEntityReply(const char *data, size_t numBytes);
+    void HandleEntityAction(const char *data, size_t numBytes);
+    void HandleSnapshot(const char *data, size_t numBytes);
+
+    /// Writes a component in the format of SyncManager's component full update.
+    void WriteComponent(kNet::DataSerializer &ds, component_id_t id, const ComponentPtr &comp);
+
+    Framework *framework_;
+    int index_;
+    u32 sessionId_;
+    State state_;
+    Ptr(kNet::MessageConnection) connection_;
+    NetworkProtocolVersion protocolVersion_;
+    u32 connectionId_;
+    entity_id_t avatarId_; ///< Server-side ID of the avatar entity, 0 until the server has acknowledged it.
+    component_id_t placeableId_; ///< Server-side ID of the EC_Placeable of the avatar.
+    ComponentPtr name_; ///< Detached EC_Name of the avatar, used for serialization.
+    ComponentPtr placeable_; ///< Detached EC_Placeable of the avatar, used for serialization.
+    float nextMoveTime_;
+    float nextActionTime_;
+    SimulatedUserStats stats_;
+    std::vector<float> latencies_;
+};
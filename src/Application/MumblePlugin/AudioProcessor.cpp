@@ -15,6 +15,8 @@
 
 #include <QMutexLocker>
 
+#include <algorithm>
+
 #ifndef TUNDRA_NO_AUDIO
 #ifndef Q_WS_MAC
 #include <AL/al.h>
@@ -27,6 +29,26 @@
 
 namespace MumbleAudio
 {
+    namespace
+    {
+        /// Received packets that can wait for the audio thread.
+        const int cReceivedPacketCapacity = 127;
+        /// Mixed frames produced ahead of the clock, to cover the main thread frame time and the timer granularity.
+        const int cMixLeadFrames = 4;
+        /// Mixed frames waiting for the main thread beyond this are dropped, oldest first.
+        const int cMaxPendingMixedFrames = 20;
+        /// Audio assets kept for refilling with mixed frames. More frames than this queued for playback get assets that are not reused.
+        const size_t cMaxPlaybackAssets = 2 * cMaxPendingMixedFrames;
+        /// Playback state snapshots and mix states waiting for the other thread. Only the latest of them is used.
+        const int cMixStateCapacity = 7;
+        /// Played frames kept for echo cancellation.
+        const int cMaxEchoReferenceFrames = 50;
+        /// Encoded frames waiting to be sent. SendOutputAudio keeps the queue at most ten packets long.
+        const int cEncodedFrameCapacity = 127;
+        /// Encoded frames kept from before voice activity is detected, so that the start of a sentence gets sent.
+        const int cVADPreBufferFrames = 5;
+    }
+
     AudioRecorder::AudioRecorder() :
         captureDevice_(0),
         captureSampleSize_(0)
@@ -141,12 +163,29 @@ namespace MumbleAudio
         resetFramesPerPacket(0),
         outputPreProcessed(false),
         preProcessorReset(true),
+        levelPeakMic(0.0f),
+        levelMic(0.0f),
         isSpeech(false),
         wasPreviousSpeech(false),
         holdFrames(0),
         bufferFullFrames(0),
         qualityFramesPerPacket(MUMBLE_AUDIO_FRAMES_PER_PACKET_ULTRA),
-        ownAudioState(UserOutputAudioState())
+        ownAudioState(UserOutputAudioState()),
+        publishedPeakMic(0),
+        publishedSpeech(0),
+        receivedPackets(cReceivedPacketCapacity),
+        mixer(MUMBLE_AUDIO_SAMPLES_IN_FRAME),
+        mixing(false),
+        mixStartTime(0),
+        mixedFrameCount(0),
+        mixedFrames(2 * cMaxPendingMixedFrames),
+        playbackStateSnapshots(cMixStateCapacity),
+        inputMixStates(cMixStateCapacity),
+        echoReferenceFrames(cMaxEchoReferenceFrames),
+        pendingEncodedFrames(cEncodedFrameCapacity),
+        pendingVADPreBuffer(cVADPreBufferFrames),
+        clearOutputPending(0),
+        clearInputPending(false)
     {
         ApplySettings(settings);
     }
@@ -255,6 +294,7 @@ namespace MumbleAudio
         mutexRecorder.unlock();
 
         ClearInputAudio();
+        DeleteInputAudioStates();
         framework = 0;
         networkHandler_ = 0;
 
@@ -275,12 +315,20 @@ namespace MumbleAudio
         if (event->timerId() != qobjTimerId)
             return;
 
-        // This function processed queued PCM frames with speexdsp and celt at ~60fps and adds them to
-        // a pending encoded frames list to be sent out to the network from the main thread.
-        // Mutex mutexOutputPCM and mutexOutputEncoded are the main locks for queuing the frames back and forth.
+        // This function reads the microphone and processes the PCM frames with speexdsp and celt at ~60fps.
+        // The encoded frames are queued and sent out to the network from this thread in SendOutputAudio.
+        // The frame buffers are allocated up front and only used in this thread, so the main thread requests
+        // clearing them with clearOutputPending. Mutex mutexOutputPCM guards the speex state from being reset meanwhile.
         if (!codec)
             return;
 
+        if (clearOutputPending.fetchAndStoreAcquire(0))
+        {
+            pendingEncodedFrames.Clear();
+            pendingVADPreBuffer.Clear();
+            echoReferenceFrames.Clear();
+        }
+
         int localGain = 0;
 
         mutexAudioSettings.lockForRead();
@@ -292,142 +340,111 @@ namespace MumbleAudio
         float VADmax = audioSettings.VADmax;
         mutexAudioSettings.unlock();
 
-        // Read OpenAL microphone to pendingPCMFrames
-        ReadMicrophoneAudio();
-
         mutexOutputPCM.lock();
-        if (pendingPCMFrames.size() > 0)
+
+        // Read OpenAL microphone one frame at a time to the reused capture buffer.
+        SoundBuffer &pcmFrame = capturedFrame;
+        while(ReadMicrophoneFrame(pcmFrame))
         {
-            QList<QByteArray> encodedFrames;
-            for (std::vector<SoundBuffer>::iterator pcmIter = pendingPCMFrames.begin(); pcmIter != pendingPCMFrames.end(); ++pcmIter)
-            {
-                SoundBuffer &pcmFrame = (*pcmIter);
-                if (pcmFrame.data.size() == 0)
-                    continue;
+            tick_t captureTime = Clock::Tick();
 
-                isSpeech = true;
-                DoEchoCancellation(pcmFrame);
+            isSpeech = true;
+            DoEchoCancellation(pcmFrame);
 
-                if (localPreProcess)
+            if (localPreProcess)
+            {
+                speex_preprocess_ctl(speexPreProcessor, SPEEX_PREPROCESS_GET_AGC_GAIN, &localGain);
+                int suppression = localSuppress - localGain;
+                if (suppression > 0)
+                    suppression = 0;
+                speex_preprocess_ctl(speexPreProcessor, SPEEX_PREPROCESS_SET_NOISE_SUPPRESS, &suppression);
+                speex_preprocess_run(speexPreProcessor, (spx_int16_t*)&pcmFrame.data[0]);
+
+                if (detectVAD)
                 {
-                    speex_preprocess_ctl(speexPreProcessor, SPEEX_PREPROCESS_GET_AGC_GAIN, &localGain);
-                    int suppression = localSuppress - localGain;
-                    if (suppression > 0)
-                        suppression = 0;
-                    speex_preprocess_ctl(speexPreProcessor, SPEEX_PREPROCESS_SET_NOISE_SUPPRESS, &suppression);
-                    speex_preprocess_run(speexPreProcessor, (spx_int16_t*)&pcmFrame.data[0]);
+                    float sum = 1.0f;
+                    short *data = (short*)&pcmFrame.data[0];
+                    for (int index=0; index<MUMBLE_AUDIO_SAMPLES_IN_FRAME; index++)
+                    {
+                        int value = data[index];
+                        sum += static_cast<float>(value * value);
+                    }
 
-                    if (detectVAD)
+                    levelPeakMic = qMax(20.0f * log10f(sqrtf(sum / static_cast<float>(MUMBLE_AUDIO_SAMPLES_IN_FRAME)) / 32768.0f), -96.0f);
+                    levelPeakMic = qMax(levelPeakMic - localGain, -96.0f);
+                    levelMic = (1.0f + levelPeakMic / 96.0f);
+
+                    // Detect mic level if speaking
+                    if (levelMic > VADmax)
+                        isSpeech = true;
+                    else if (levelMic > VADmin && wasPreviousSpeech)
+                        isSpeech = true;
+                    else
+                        isSpeech = false;
+
+                    if (isSpeech)
+                        holdFrames = 0;
+                    else
                     {
-                        float sum = 1.0f;
-                        short *data = (short*)&pcmFrame.data[0];
-                        for (int index=0; index<MUMBLE_AUDIO_SAMPLES_IN_FRAME; index++)
-                        {
-                            int value = data[index];
-                            sum += static_cast<float>(value * value);
-                        }
-
-                        levelPeakMic = qMax(20.0f * log10f(sqrtf(sum / static_cast<float>(MUMBLE_AUDIO_SAMPLES_IN_FRAME)) / 32768.0f), -96.0f);
-                        levelPeakMic = qMax(levelPeakMic - localGain, -96.0f);
-                        levelMic = (1.0f + levelPeakMic / 96.0f);
-
-                        // Detect mic level if speaking
-                        if (levelMic > VADmax)
-                            isSpeech = true;
-                        else if (levelMic > VADmin && wasPreviousSpeech)
+                        // Hold certain amount of frames even if not speaking.
+                        // This allows end of sentences to get to the outgoing buffer safely.
+                        holdFrames++;
+                        if (holdFrames < 20)
                             isSpeech = true;
-                        else
-                            isSpeech = false;
-
-                        if (isSpeech)
-                            holdFrames = 0;
-                        else
-                        {
-                            // Hold certain amount of frames even if not speaking.
-                            // This allows end of sentences to get to the outgoing buffer safely.
-                            holdFrames++;
-                            if (holdFrames < 20)
-                                isSpeech = true;
-                        }
                     }
                 }
+            }
 
-                // Encode
-                unsigned char compressedBuffer[512];
-                int bytesWritten = codec->Encode(pcmFrame, compressedBuffer, localQualityBitrate);
-                if (bytesWritten > 0)
-                {
-                    QByteArray encodedFrame(reinterpret_cast<const char*>(compressedBuffer), bytesWritten);
+            // Encode straight to the frame that is queued. Celt never writes more than MaxEncodedFrameSize bytes.
+            MumbleNetwork::EncodedFrame encodedFrame;
+            int bytesWritten = codec->Encode(pcmFrame, encodedFrame.data, localQualityBitrate);
+            if (bytesWritten > 0)
+            {
+                encodedFrame.size = qMin(bytesWritten, MumbleNetwork::MaxEncodedFrameSize);
+                encodedFrame.time = captureTime;
 
-                    // If speech, add to encoded frames. But first
-                    // append any 'prediction' buffered frames so start of sentences
-                    // can get to the outgoing buffer safely.
-                    if (isSpeech || wasPreviousSpeech)
-                    {
-                        if (detectVAD && pendingVADPreBuffer.size() > 0)
-                        {
-                            encodedFrames.append(pendingVADPreBuffer);
-                            pendingVADPreBuffer.clear();
-                        }
-                        encodedFrames.push_back(encodedFrame);
-                    }
-                    // If voice activity detection is enabled but this is
-                    // not speech, add the frame to the VAD 'prediction' buffer.
-                    else if (detectVAD && !isSpeech && !wasPreviousSpeech)
+                // If speech, add to encoded frames. But first
+                // append any 'prediction' buffered frames so start of sentences
+                // can get to the outgoing buffer safely.
+                if (isSpeech || wasPreviousSpeech)
+                {
+                    if (detectVAD)
                     {
-                        while(pendingVADPreBuffer.size() >= 5)
-                        {
-                            if (!pendingVADPreBuffer.isEmpty())
-                                pendingVADPreBuffer.removeFirst();
-                            else
-                                break;
-                        }
-                        pendingVADPreBuffer.push_back(encodedFrame);
+                        MumbleNetwork::EncodedFrame preBufferedFrame;
+                        while(pendingVADPreBuffer.Pop(preBufferedFrame))
+                            QueueEncodedFrame(preBufferedFrame);
                     }
+                    QueueEncodedFrame(encodedFrame);
+                }
+                // If voice activity detection is enabled but this is
+                // not speech, add the frame to the VAD 'prediction' buffer.
+                else if (detectVAD && !isSpeech && !wasPreviousSpeech)
+                {
+                    while(pendingVADPreBuffer.Size() >= cVADPreBufferFrames)
+                        pendingVADPreBuffer.CommitPop();
+                    pendingVADPreBuffer.Push(encodedFrame);
                 }
-                wasPreviousSpeech = isSpeech;
             }
-            pendingPCMFrames.clear();
-            
-            // Push encoded frames to be sent out to network in next invocation of SendOutputAudio.
-            mutexOutputEncoded.lock();
-            for(int i=0; i<encodedFrames.size(); ++i)
-                pendingEncodedFrames.append(QByteArray(encodedFrames.at(i)));
-            mutexOutputEncoded.unlock();
+            wasPreviousSpeech = isSpeech;
         }
+
+        publishedPeakMic.fetchAndStoreRelease(static_cast<int>(levelPeakMic * 100.f));
+        publishedSpeech.fetchAndStoreRelease(isSpeech ? 1 : 0);
+
         mutexOutputPCM.unlock();
 
         // Send encoded frames to network.
         SendOutputAudio();
 
-        // Update sound channels that have been filled with pending PCM frames in the main thread.
-        // This will push the frames to OpenAL.
-        if (mutexInput.tryLock(15))
-        {
-            for (AudioStateMap::iterator i = inputAudioStates.begin(); i != inputAudioStates.end(); ++i)
-            {
-                if (i->second->soundChannel.get())
-                    i->second->soundChannel->Update(i->second->soundChannel->Position());
-            }
-            mutexInput.unlock();
-        }
+        // Mix received audio for PlayInputAudio.
+        ProcessInputAudio();
     }
 
     void AudioProcessor::GetLevels(float &peakMic, bool &speaking)
     {
-        // The peak mic level and is speaking are written in a mutexOutputPCM lock.
-        // So use the same lock to read the data out for main thread usage.
-        if (mutexOutputPCM.tryLock(15))
-        {
-            peakMic = levelPeakMic;
-            speaking = isSpeech;
-            mutexOutputPCM.unlock();
-        }
-        else
-        {
-            peakMic = 0.f;
-            speaking = false;
-        }
+        // The peak mic level and is speaking are published by the audio thread after processing the microphone frames.
+        peakMic = publishedPeakMic / 100.f;
+        speaking = publishedSpeech != 0;
     }
 
     void AudioProcessor::DoEchoCancellation(SoundBuffer &pcmFrame)
@@ -436,35 +453,13 @@ namespace MumbleAudio
         if (!speexEcho)
             return;
 
-        SoundBuffer outBuf;
-        SoundBuffer playedFrame;
-        u16 *playedFrameData;
-
-        playedFrame.data.resize(MUMBLE_AUDIO_SAMPLES_IN_FRAME * MUMBLE_AUDIO_SAMPLE_WIDTH / 8, 0);
-        playedFrameData = reinterpret_cast<u16*>(&playedFrame.data[0]);
-
-        if (mutexInput.tryLock(15))
-        {
-            for (AudioStateMap::iterator iter = inputAudioStates.begin(); iter != inputAudioStates.end(); ++iter)
-            {
-                UserAudioState *userAudioState = iter->second;
-                if (!userAudioState || userAudioState->playedFrames.empty())
-                    continue;
-
-                const SoundBuffer &buf = userAudioState->playedFrames.front();
-                if (buf.data.size() == playedFrame.data.size())
-                {
-                    const u16 *bufData = reinterpret_cast<const u16*>(&buf.data[0]);
-                    for (size_t i = 0; i < buf.data.size() / 2; i++)
-                        playedFrameData[i] += bufData[i];
-                }
-                userAudioState->playedFrames.pop_front();
-            }
-            mutexInput.unlock();
-        }
-        else
-            return;
+        // The speaker output is the mix of all users, silence if nothing has been played.
+        // The buffers are swapped in and out of the ring, so they keep their size and are not reallocated.
+        SoundBuffer &playedFrame = echoPlayedFrame;
+        if (!echoReferenceFrames.Pop(playedFrame) || playedFrame.data.size() != pcmFrame.data.size())
+            playedFrame.data.assign(pcmFrame.data.size(), 0);
 
+        SoundBuffer &outBuf = echoOutputFrame;
         outBuf.data.resize(pcmFrame.data.size());
 
         // Input (mic) data is from pcmFrame. Output (speaker) data mixed from 
@@ -515,15 +510,6 @@ namespace MumbleAudio
             if (recorder_)
                 recorder_->StopRecording();
             mutexRecorder.unlock();
-
-            // Clear obsolete playback history for echo cancellation.
-            if (mutexInput.tryLock(15))
-            {
-                for (AudioStateMap::iterator iter = inputAudioStates.begin(); iter != inputAudioStates.end(); ++iter)
-                    if (iter->second)
-                        iter->second->playedFrames.clear();
-                mutexInput.unlock();
-            }
         }
 
         ClearOutputAudio();
@@ -544,22 +530,39 @@ namespace MumbleAudio
 
     SoundChannelPtr AudioProcessor::CreateVoiceChannel(const SoundBuffer &buffer)
     {
-        SoundChannelPtr channel = MAKE_SHARED(SoundChannel, 0, SoundChannel::Voice);
-        AudioAssetPtr audioAsset = CreateAudioAssetFromSoundBuffer(buffer);
-        channel->AddBuffer(audioAsset);
-        return channel;
+        // This function is called in the main thread. The channel is owned and updated by AudioAPI,
+        // which is the only user of the shared sound source pool.
+        AudioAPI *audio = framework ? framework->Audio() : 0;
+        if (!audio || !audio->IsInitialized())
+            return SoundChannelPtr();
+        return audio->PlaySoundBuffer(buffer, SoundChannel::Voice);
     }
 
     AudioAssetPtr AudioProcessor::CreateAudioAssetFromSoundBuffer(const SoundBuffer &buffer)
     {
-        // Construct a sound from the buffer
-        AudioAssetPtr newSound = MAKE_SHARED(AudioAsset, framework->Asset(), "Audio", "buffer");
-        newSound->LoadFromSoundBuffer(buffer);
+        // This function is called in the main thread. Refill an asset that the voice channel has finished playing, so that
+        // a new asset and OpenAL buffer are not created for every frame. The channel releases an asset once its buffer
+        // has been unqueued from the source, after which only the pool refers to it.
+        AudioAssetPtr sound;
+        for(size_t i = 0; i < playbackAssets.size(); ++i)
+        {
+            if (playbackAssets[i].use_count() == 1)
+            {
+                sound = playbackAssets[i];
+                break;
+            }
+        }
+        if (!sound)
+        {
+            sound = MAKE_SHARED(AudioAsset, framework->Asset(), "Audio", "buffer");
+            if (playbackAssets.size() < cMaxPlaybackAssets)
+                playbackAssets.push_back(sound);
+        }
 
-        if (!newSound->GetHandle())
+        if (!sound->LoadFromSoundBuffer(buffer))
             return AudioAssetPtr();
 
-        return newSound;
+        return sound;
     }
 
     void AudioProcessor::ApplyFramesPerPacket(int framesPerPacket)
@@ -581,10 +584,7 @@ namespace MumbleAudio
 
     void AudioProcessor::ApplySettings(AudioSettings settings)
     {
-        bool positionalRangesChanged = false;
         bool recondingDeviceChanged = false;
-        int changedInnerRange = 0;
-        int changedOuterRange = 0;
 
         // This function is called in the main thread
         mutexAudioSettings.lockForWrite();
@@ -593,14 +593,6 @@ namespace MumbleAudio
         if (audioSettings.recordingDevice != settings.recordingDevice)
             recondingDeviceChanged = true;
 
-        // Detect if positional playback ranges changed.
-        if (audioSettings.innerRange != settings.innerRange || audioSettings.outerRange != settings.outerRange)
-        {
-            positionalRangesChanged = true;
-            changedInnerRange = settings.innerRange;
-            changedOuterRange = settings.outerRange;
-        }
-
         audioSettings = settings;
         if (audioSettings.suppression > 0)
             audioSettings.suppression = 0;
@@ -630,20 +622,7 @@ namespace MumbleAudio
 
         mutexAudioSettings.unlock();
 
-        // Apply new positional ranges to existing positional sound channels.
-        if (positionalRangesChanged)
-        {
-            if (mutexInput.tryLock(15))
-            {
-                for (AudioStateMap::iterator iter = inputAudioStates.begin(); iter != inputAudioStates.end(); ++iter)
-                {
-                    UserAudioState *userAudioState = iter->second;
-                    if (userAudioState->soundChannel.get() && userAudioState->soundChannel->IsPositional())
-                        userAudioState->soundChannel->SetRange(static_cast<float>(changedInnerRange), static_cast<float>(changedOuterRange), 1.0f);
-                }
-                mutexInput.unlock();
-            }
-        }
+        // New positional ranges are picked up by the mixer in the audio thread on its next update.
 
         preProcessorReset = true;
         ResetSpeexProcessor();
@@ -704,45 +683,34 @@ namespace MumbleAudio
         return out;
     }
     
-    void AudioProcessor::ReadMicrophoneAudio()
+    bool AudioProcessor::ReadMicrophoneFrame(SoundBuffer &pcmFrame)
     {
-        // Get recorded PCM frames from AudioAPI.
-        std::vector<SoundBuffer> pcmFrames;
+        // Get a recorded PCM frame from AudioAPI. The frame buffer keeps its size, so this does not allocate.
         uint celtFrameSize = MUMBLE_AUDIO_SAMPLES_IN_FRAME * MUMBLE_AUDIO_SAMPLE_WIDTH / 8;
-        {
-            QMutexLocker mutexLockerRecorder(&mutexRecorder);
-            if (recorder_)
-            {
-                while (recorder_->RecordedSoundSize() >= celtFrameSize)
-                {
-                    SoundBuffer outputPCM;
-                    outputPCM.data.resize(celtFrameSize);
-                    uint bytesOut = recorder_->RecordedSoundData(&outputPCM.data[0], celtFrameSize);
-                    if (bytesOut == celtFrameSize)
-                        pcmFrames.push_back(outputPCM);
-                }
-            }
-        }
 
-        if (pcmFrames.size() > 0)
+        QMutexLocker mutexLockerRecorder(&mutexRecorder);
+        if (!recorder_ || recorder_->RecordedSoundSize() < celtFrameSize)
+            return false;
+
+        pcmFrame.data.resize(celtFrameSize);
+        return recorder_->RecordedSoundData(&pcmFrame.data[0], celtFrameSize) == celtFrameSize;
+    }
+
+    void AudioProcessor::QueueEncodedFrame(MumbleNetwork::EncodedFrame &frame)
+    {
+        if (!pendingEncodedFrames.Push(frame))
         {
-            // We want to fail here if something is about to give on the mutexes.
-            if (mutexOutputPCM.tryLock(15))
-            {
-                pendingPCMFrames.insert(pendingPCMFrames.end(), pcmFrames.begin(), pcmFrames.end());
-                mutexOutputPCM.unlock();
-            }
-            else
-                LogDebug(LC + QString("Failed to acquire pending PCM frames mutex for %1 frames").arg(pcmFrames.size()));
+            pendingEncodedFrames.CommitPop();
+            pendingEncodedFrames.Push(frame);
         }
     }
 
     void AudioProcessor::SendOutputAudio()
     {
-        QMutexLocker lockEncoded(&mutexOutputEncoded);
+        // This function is called in the audio thread, which is the only user of the encoded frames.
 
         // No queued encoded frames for network.
-        if (pendingEncodedFrames.size() == 0)
+        if (pendingEncodedFrames.IsEmpty())
         {
             mutexUserOutputAudioState.lockForWrite();
             ownAudioState.numberOfFrames = 0;
@@ -769,26 +737,21 @@ namespace MumbleAudio
             @todo Remove OpenAL usage for input microphone and 3D positional playback. Thread microphone by using WASAPI on windows and something on linux/mac.
             Research our options for threaded recording/playback without using Framework or AudioAPI pointers in this audio processing thread.
         */
-        if (pendingEncodedFrames.size() > framesPerPacket * 10)
+        if (pendingEncodedFrames.Size() > framesPerPacket * 10)
         {
             // Do some helpful info logs if we are auto increasing frames per packet count.
             if (framesPerPacket > 8)
-                LogInfo(LC + QString("Output buffer full with %1/%2 frames, frames/packet is %3").arg(pendingEncodedFrames.size()).arg(framesPerPacket*10).arg(framesPerPacket));
+                LogInfo(LC + QString("Output buffer full with %1/%2 frames, frames/packet is %3").arg(pendingEncodedFrames.Size()).arg(framesPerPacket*10).arg(framesPerPacket));
 
             // Remove oldest frames to get the buffer to a acceptable size.
-            while(pendingEncodedFrames.size() > framesPerPacket * 10)
-            {
-                if (!pendingEncodedFrames.isEmpty())
-                    pendingEncodedFrames.removeFirst();
-                else
-                    break;
-            }
+            while(pendingEncodedFrames.Size() > framesPerPacket * 10)
+                pendingEncodedFrames.CommitPop();
 
             mutexAudioSettings.lockForWrite();
             bufferFullFrames++;
             if (bufferFullFrames >= 5 && qualityFramesPerPacket <= 8)
             {
-                LogInfo(LC + QString("Output buffer full with %1/%2 frames, auto increasing frames/packet to %3 due to potential main thread blockage.").arg(pendingEncodedFrames.size()).arg(framesPerPacket*10).arg(framesPerPacket+2));
+                LogInfo(LC + QString("Output buffer full with %1/%2 frames, auto increasing frames/packet to %3 due to potential main thread blockage.").arg(pendingEncodedFrames.Size()).arg(framesPerPacket*10).arg(framesPerPacket+2));
 
                 bufferFullFrames = 0;
                 qualityFramesPerPacket += 2;
@@ -801,22 +764,17 @@ namespace MumbleAudio
         }
 
         // If we are speaking send out full 'framesPerPacket' frames. If we are not speaking send whatever is left in the buffer but max is still 'framesPerPacket'.
-        int framesToPacket = (isSpeech || wasPreviousSpeech) ? framesPerPacket : qMin(framesPerPacket, pendingEncodedFrames.size());
+        int framesToPacket = (isSpeech || wasPreviousSpeech) ? framesPerPacket : qMin(framesPerPacket, pendingEncodedFrames.Size());
+        framesToPacket = qMin(framesToPacket, MumbleNetwork::MaxFramesInVoicePacket);
 
         // Enough encoded frames in the ready queue
-        if (pendingEncodedFrames.size() >= framesToPacket)
+        if (pendingEncodedFrames.Size() >= framesToPacket)
         {
-            ByteArrayVector sendOutNow;
-
-            for (int i=0; i<framesToPacket; ++i)
-            {
-                if (!pendingEncodedFrames.isEmpty())
-                    sendOutNow.push_back(pendingEncodedFrames.takeFirst());
-                else
-                    break;
-            }
-
-            MumbleNetwork::VoicePacketInfo voicePacket(sendOutNow);
+            // The packet is reused, its frames are swapped with the ones in the queue.
+            MumbleNetwork::VoicePacketInfo &voicePacket = outgoingVoicePacket;
+            voicePacket.numFrames = 0;
+            while(voicePacket.numFrames < framesToPacket && pendingEncodedFrames.Pop(voicePacket.encodedFrames[voicePacket.numFrames]))
+                ++voicePacket.numFrames;
 
             mutexUserOutputAudioState.lockForRead();
             voicePacket.isPositional = ownAudioState.isPositional;
@@ -826,8 +784,12 @@ namespace MumbleAudio
 
             networkHandler_->SendVoicePacket(voicePacket);
 
+            // The oldest frame of the packet has waited the longest.
+            if (voicePacket.numFrames > 0)
+                captureToSendLatency.Add(Clock::TimespanToMillisecondsF(voicePacket.encodedFrames[0].time, Clock::Tick()));
+
             mutexUserOutputAudioState.lockForWrite();
-            ownAudioState.numberOfFrames = voicePacket.encodedFrames.size();
+            ownAudioState.numberOfFrames = voicePacket.numFrames;
             mutexUserOutputAudioState.unlock();
         }
     }
@@ -841,233 +803,321 @@ namespace MumbleAudio
         // Read playback settings
         mutexAudioSettings.lockForRead();
         int allowReceivingPositional = audioSettings.allowReceivingPositional;
-        int positionalInnerRange = allowReceivingPositional ? audioSettings.innerRange : 0;
-        int positionalOuterRange = allowReceivingPositional ? audioSettings.outerRange : 0;
         mutexAudioSettings.unlock();
 
-        mutexAudioMute.lockForRead();
-        bool localOutputAudioMuted = outputAudioMuted;
-        mutexAudioMute.unlock();
+        // Everything is exchanged with the audio thread through lock-free rings, so the frames are never left waiting for a lock.
+        // Only the latest playback state is of interest.
+        while(playbackStateSnapshots.Pop(playbackStates)) {}
 
-        // Lock user audio states. This is the place we want to fail on a tryLock as we can play the frames later as well.
-        // If this fails too many times we just remove the oldest frames.
-        if (!mutexInput.tryLock(15))
+        // The mixer pans and attenuates positional users relative to the listener, and skips the muted users.
+        // If the audio thread has not picked up the earlier states, it gets this one on the next round.
+        InputMixState *mixState = inputMixStates.PushSlot();
+        if (mixState)
         {
-            LogDebug(LC + "PlayInputAudio tryLock(15) failed to acquire lock!");
-            return;
+            AudioAPI *audio = framework->Audio();
+            if (audio)
+            {
+                mixState->listenerPosition = audio->ListenerPosition();
+                mixState->listenerOrientation = audio->ListenerOrientation();
+            }
+            mixState->mutedUsers.clear();
+            for (PlaybackStateMap::const_iterator iter = playbackStates.begin(); iter != playbackStates.end(); ++iter)
+            {
+                MumbleUser *user = mumble->User(iter->first);
+                if (user && user->isMuted)
+                    mixState->mutedUsers.insert(iter->first);
+            }
+            inputMixStates.CommitPush();
         }
-        if (inputAudioStates.empty())
+
+        // Mixed frames that were not picked up in time are dropped, so that the latency does not build up.
+        while(mixedFrames.Size() > cMaxPendingMixedFrames)
+            mixedFrames.CommitPop();
+
+        // All speaking users are mixed to one stereo channel, so the number of OpenAL sources does not grow with the number of users.
+        // The frames are read in place from the ring, the audio thread reuses the buffers once they are popped.
+        MixedVoiceFrame *mixedFrame = 0;
+        while((mixedFrame = mixedFrames.Front()) != 0)
         {
-            mutexInput.unlock();
-            return;
+            const SoundBuffer &frame = mixedFrame->pcm;
+            if (mixChannel.get())
+            {
+                // Refill a pooled AudioAsset to be added to the sound channels playback buffer.
+                AudioAssetPtr audioAsset = CreateAudioAssetFromSoundBuffer(frame);
+                if (audioAsset.get())
+                    mixChannel->AddBuffer(audioAsset);
+                else
+                {
+                    LogWarning(LC + "Failed to create new sound buffer for the voice mix, clearing pending frames");
+
+                    // Something went wrong, eg. out of memory, release "broken" SoundChannel and its data.
+                    // Bail out as otherwise the next buffer creation will most likely fail the same way.
+                    mixChannel->Stop();
+                    mixChannel.reset();
+                    mixedFrames.Clear();
+                    break;
+                }
+            }
+            else
+            {
+                // Create sound channel with initial audio frame. Not positional, the mix is already panned.
+                // AudioAPI pushes the frames added to the channel to OpenAL in its update.
+                mixChannel = CreateVoiceChannel(frame);
+                if (!mixChannel.get())
+                {
+                    if (framework->Audio() && framework->Audio()->IsInitialized())
+                        LogError(LC + "Failed to create sound channel for the voice mix");
+                    mixedFrames.Clear();
+                    break;
+                }
+            }
+
+            if (mixedFrame->receiveTime != 0)
+                receiveToQueueLatency.Add(Clock::TimespanToMillisecondsF(mixedFrame->receiveTime, Clock::Tick()));
+            mixedFrames.CommitPop();
         }
 
-        AudioStateMap::iterator end = inputAudioStates.end();
-        for (AudioStateMap::iterator iter = inputAudioStates.begin(); iter != end; ++iter)
+        // Update speaking and positional state of the users.
+        for (PlaybackStateMap::const_iterator iter = playbackStates.begin(); iter != playbackStates.end(); ++iter)
         {
-            uint userId = iter->first;
-            UserAudioState *userAudioState = iter->second;
-            if (userAudioState == 0)
-                continue;
-
             // We must have the user if we are receiving audio from him.
-            MumbleUser *user = mumble->User(userId);
+            MumbleUser *user = mumble->User(iter->first);
             if (!user)
                 continue;
 
-            // When muted don't play any pending frames, just delete them.
-            if (user->isMuted)
+            const UserPlaybackState &state = iter->second;
+
+            // Only emits on change.
+            user->SetAndEmitSpeaking(state.isSpeaking && !user->isMuted);
+            if (user->isMe)
+                continue;
+
+            if (allowReceivingPositional && state.isPositional)
             {
-                userAudioState->frames.clear();
-                userAudioState->playedFrames.clear();
+                user->pos = state.pos;
+                user->SetAndEmitPositional(true);
             }
-
-            // Check speaking state, not speaking if pending frames is empty and SoundChannel is not playing.
-            if (user->isMuted || userAudioState->frames.empty())
+            else if (user->isPositional)
             {
-                bool playing = false;
-                if (userAudioState->soundChannel.get())
-                {
-                    // Continue showing "playing" state until all queued buffers have been played.
-                    // Remove the sound channel once we are done with it 1) muted 2) no pending frames, user is silent.
-                    if (userAudioState->soundChannel->State() == SoundChannel::Playing)
-                        playing = true;
-                }
-                if (!playing)
-                    user->SetAndEmitSpeaking(false);
-                continue;
+                // Reset users positional state.
+                user->pos = float3::zero;
+                user->SetAndEmitPositional(false);
             }
+        }
+    }
+
+    void AudioProcessor::ClearInputAudio()
+    {
+        // This function should be called in the main thread. The user states are deleted in the audio thread.
+        {
+            QMutexLocker lock(&mutexInput);
+            clearInputPending = true;
+            clearInputUsers.clear();
+        }
+        mixedFrames.Clear();
+        playbackStateSnapshots.Clear();
+        playbackStates.clear();
+        if (mixChannel.get())
+        {
+            mixChannel->Stop();
+            mixChannel.reset();
+        }
+    }
+
+    void AudioProcessor::ClearInputAudio(uint userId)
+    {
+        // This function should be called in the main thread. The user state is deleted in the audio thread.
+        {
+            QMutexLocker lock(&mutexInput);
+            clearInputUsers.insert(userId);
+        }
+        playbackStates.erase(userId);
+    }
+
+    void AudioProcessor::DeleteInputAudioStates()
+    {
+        // This function is called in the audio thread
+        for(AudioStateMap::iterator iter = inputAudioStates.begin(); iter != inputAudioStates.end(); ++iter)
+            SAFE_DELETE(iter->second);
+        inputAudioStates.clear();
+        mixing = false;
+    }
+
+    void AudioProcessor::ProcessInputAudio()
+    {
+        // This function is called in the audio thread. It moves the received packets to the jitter buffers of the users,
+        // mixes the frames that are due and hands the mix to PlayInputAudio in the main thread.
+        if (!codec)
+            return;
+
+        mutexAudioSettings.lockForRead();
+        bool allowReceivingPositional = audioSettings.allowReceivingPositional;
+        float positionalInnerRange = static_cast<float>(audioSettings.innerRange);
+        float positionalOuterRange = static_cast<float>(audioSettings.outerRange);
+        mutexAudioSettings.unlock();
+
+        mutexAudioMute.lockForRead();
+        bool localInputAudioMuted = inputAudioMuted;
+        bool localOutputAudioMuted = outputAudioMuted;
+        mutexAudioMute.unlock();
 
-            // Report if we are getting too much buffers from a single user. We don't want to feed OpenAL too many
-            // buffers as it can crash and also there is not sense in playing very old audio.
-            if (userAudioState->frames.size() > 150)
+        // Pick up the requests and the latest listener and muted users from the main thread.
+        bool clearAll = false;
+        std::set<uint> clearUsers;
+        {
+            QMutexLocker lock(&mutexInput);
+            clearAll = clearInputPending;
+            clearInputPending = false;
+            clearUsers.swap(clearInputUsers);
+        }
+        while(inputMixStates.Pop(inputMixState)) {}
+        const std::set<uint> &mutedUsers = inputMixState.mutedUsers;
+        const float3 &localListenerPosition = inputMixState.listenerPosition;
+        const Quat &localListenerOrientation = inputMixState.listenerOrientation;
+
+        if (clearAll)
+            DeleteInputAudioStates();
+        for (std::set<uint>::const_iterator iter = clearUsers.begin(); iter != clearUsers.end(); ++iter)
+        {
+            AudioStateMap::iterator userStateIter = inputAudioStates.find(*iter);
+            if (userStateIter != inputAudioStates.end())
             {
-                LogWarning(LC + QString("Input frame buffer size too high (%1) for user id %2, removing oldest.").arg(userAudioState->frames.size()).arg(userId));
-                while (userAudioState->frames.size() > 150)
-                    userAudioState->frames.pop_front();
+                SAFE_DELETE(userStateIter->second);
+                inputAudioStates.erase(userStateIter);
             }
+        }
 
-            // Setup existing audio channels and users positional state.
-            if (userAudioState->soundChannel.get() && allowReceivingPositional)
+        // Move the received packets to the jitter buffers. The packets are read in place from the ring.
+        ReceivedVoicePacket *packet = 0;
+        while((packet = receivedPackets.Front()) != 0)
+        {
+            if (!localInputAudioMuted)
             {
-                // Update positional and position info.
-                if (userAudioState->soundChannel->IsPositional() != userAudioState->isPositional)
-                    userAudioState->soundChannel->SetPositional(userAudioState->isPositional);
-                if (userAudioState->isPositional)
-                {
-                    // Only update positional data to the channel if it has changed as it does multiple calls to OpenAL.
-                    userAudioState->soundChannel->SetRange(static_cast<float>(positionalInnerRange), static_cast<float>(positionalOuterRange), 1.0f);
-                    if (!userAudioState->soundChannel->Position().Equals(userAudioState->pos))
-                        userAudioState->soundChannel->SetPosition(userAudioState->pos);
-                    if (!user->isMe)
-                        user->pos = userAudioState->pos;
-                }
+                UserAudioState *&userAudioState = inputAudioStates[packet->userId];
+                if (!userAudioState)
+                    userAudioState = new UserAudioState();
 
-                // Only emits on change.
-                if (!user->isMe)
-                    user->SetAndEmitPositional(userAudioState->isPositional);
+                userAudioState->isPositional = packet->isPositional;
+                if (userAudioState->isPositional)
+                    userAudioState->pos = packet->pos;
+                userAudioState->jitterBuffer.Put(packet->seq, packet->frames, packet->numFrames, packet->arrivalTime);
             }
-            else if (userAudioState->soundChannel.get() && !allowReceivingPositional)
-            {
-                // Reset positional info from the channel
-                if (userAudioState->soundChannel->IsPositional())
-                    userAudioState->soundChannel->SetPositional(false);
+            receivedPackets.CommitPop();
+        }
 
-                // Reset users positional state.
-                if (!user->isMe && user->isPositional)
-                {
-                    user->pos = float3::zero;
-                    user->SetAndEmitPositional(false);
-                }
-            }
+        for (AudioStateMap::iterator iter = inputAudioStates.begin(); iter != inputAudioStates.end(); ++iter)
+        {
+            UserAudioState *userAudioState = iter->second;
+            if (mutedUsers.find(iter->first) != mutedUsers.end())
+                userAudioState->jitterBuffer.Reset();
 
-            // Iterate and play audio frames for this user
-            AudioFrameDeque::iterator frameEnd = userAudioState->frames.end();
-            for (AudioFrameDeque::iterator frameIter = userAudioState->frames.begin(); frameIter != frameEnd; ++frameIter)
+            if (allowReceivingPositional && userAudioState->isPositional)
+                VoiceMixer::PositionalGains(localListenerPosition, localListenerOrientation, userAudioState->pos,
+                    positionalInnerRange, positionalOuterRange, userAudioState->gainLeft, userAudioState->gainRight);
+            else
             {
-                const SoundBuffer &frame = (*frameIter);
-                if (userAudioState->soundChannel.get())
-                {
-                    // Create new AudioAsset to be added to the sound channels playback buffer.
-                    AudioAssetPtr audioAsset = CreateAudioAssetFromSoundBuffer(frame);
-                    if (audioAsset.get())
-                    {
-                        // Update user speaking state and add buffer to the sound channel.
-                        user->SetAndEmitSpeaking(true); // Only emits on change.
-                        userAudioState->soundChannel->AddBuffer(audioAsset);
-                    }
-                    else
-                    {
-                        LogWarning(LC + QString("Failed to create new sound buffer for user id %1, clearing all his input frames").arg(userId));
-
-                        // Something went wrong, eg. out of memory, release "broken" SoundChannel and its data.
-                        // Bail out as otherwise the next buffer creation will most likely fail the same way.
-                        user->SetAndEmitSpeaking(false); // Only emits on change.
-                        userAudioState->soundChannel->Stop();
-                        userAudioState->soundChannel.reset();
-                        break;
-                    }
-                }
-                else
-                {
-                    // Create sound channel with initial audio frame. We should get here only once per this for loop.
-                    userAudioState->soundChannel = CreateVoiceChannel(frame);
-                    if (userAudioState->soundChannel.get())
-                    {
-                        // Set positional if available and our local settings allows it
-                        if (allowReceivingPositional && userAudioState->isPositional)
-                        {
-                            userAudioState->soundChannel->SetPositional(true);
-                            userAudioState->soundChannel->SetRange(static_cast<float>(positionalInnerRange), static_cast<float>(positionalOuterRange), 1.0f);
-                            userAudioState->soundChannel->SetPosition(userAudioState->pos);
-                            if (!user->isMe)
-                            {
-                                user->pos = userAudioState->pos;
-                                user->SetAndEmitPositional(true);
-                            }
-                        }
-                        else
-                        {
-                            userAudioState->soundChannel->SetPositional(false);
-                            if (!user->isMe && user->isPositional)
-                            {
-                                user->pos = float3::zero;
-                                user->SetAndEmitPositional(false);
-                            }
-                        }
-
-                        // Update user speaking state. Only emits on change.
-                        user->SetAndEmitSpeaking(true);
-                    }
-                    else
-                        LogError("Failed to create sound channel for " + QString::number(userId));
-                }
+                userAudioState->gainLeft = 1.f;
+                userAudioState->gainRight = 1.f;
             }
+        }
 
-            // Store playback frames for echo cancellation
-            if (speexEcho && !localOutputAudioMuted && userAudioState->soundChannel.get())
-                userAudioState->playedFrames.insert(userAudioState->playedFrames.end(), userAudioState->frames.begin(), userAudioState->frames.end());
-            else
-                userAudioState->playedFrames.clear();
-
-            // Clear users input frames
-            userAudioState->frames.clear();
+        // Mix the frames that are due by the clock. A new mix starts with a lead of a few frames,
+        // which covers for the main thread picking the frames up at its own pace.
+        if (!mixing)
+        {
+            mixStartTime = Clock::Tick();
+            mixedFrameCount = 0;
         }
+        float frameMsecs = 1000.f * MUMBLE_AUDIO_SAMPLES_IN_FRAME / MUMBLE_AUDIO_SAMPLE_RATE;
+        int dueFrames = cMixLeadFrames + static_cast<int>(Clock::MillisecondsSinceF(mixStartTime) / frameMsecs) - mixedFrameCount;
 
-        mutexInput.unlock();
-    }
+        // Echo cancellation needs the mono mix of what is played.
+        bool keepEchoReference = false;
+        {
+            QMutexLocker lock(&mutexOutputPCM);
+            keepEchoReference = speexEcho && !localOutputAudioMuted;
+        }
+        if (!keepEchoReference)
+            echoReferenceFrames.Clear();
 
-    void AudioProcessor::ClearInputAudio()
-    {
-        // This function should be called in the main thread
-        QMutexLocker lock(&mutexInput);
-        if (!inputAudioStates.empty())
+        // The frames are decoded to and mixed in buffers that are reused, so mixing does not allocate memory.
+        MumbleNetwork::EncodedFrame encodedFrame;
+        for (int i = 0; i < dueFrames; ++i)
         {
-            for(AudioStateMap::iterator iter = inputAudioStates.begin(); iter != inputAudioStates.end(); ++iter)
+            tick_t receiveTime = 0;
+            mixer.Begin();
+            for (AudioStateMap::iterator iter = inputAudioStates.begin(); iter != inputAudioStates.end(); ++iter)
             {
                 UserAudioState *userAudioState = iter->second;
-                if (userAudioState)
-                    SAFE_DELETE(userAudioState);
+                VoiceJitterBuffer::FrameResult result = userAudioState->jitterBuffer.GetFrame(encodedFrame);
+                if (result == VoiceJitterBuffer::FrameNone)
+                    continue;
+                if (result == VoiceJitterBuffer::FrameData && (receiveTime == 0 || encodedFrame.time < receiveTime))
+                    receiveTime = encodedFrame.time;
+
+                // Decoding without data makes celt conceal the missing frame.
+                int celtResult = (result == VoiceJitterBuffer::FrameData ?
+                    userAudioState->codec->Decode(reinterpret_cast<const char*>(encodedFrame.data), encodedFrame.size, decodedFrame) :
+                    userAudioState->codec->Decode(0, 0, decodedFrame));
+                if (celtResult != CELT_OK)
+                {
+                    PrintCeltError(celtResult, true);
+                    userAudioState->jitterBuffer.Reset();
+                    continue;
+                }
+                mixer.Add(decodedFrame, userAudioState->gainLeft, userAudioState->gainRight);
             }
-            inputAudioStates.clear();
-        }
-    }
 
-    void AudioProcessor::ClearInputAudio(uint userId)
-    {
-        // This function should be called in the main thread
-        QMutexLocker lock(&mutexInput);
+            // Everyone has stopped talking. The next mix starts from the clock again.
+            mixing = !mixer.IsEmpty();
+            if (!mixing)
+                break;
 
-        AudioStateMap::iterator userStateIter = inputAudioStates.find(userId);
-        if (userStateIter != inputAudioStates.end())
+            // Mix straight to the ring slots. If the main thread has not kept up and the ring is full,
+            // the frame is mixed to a spare buffer and dropped.
+            SoundBuffer *monoFrame = 0;
+            if (keepEchoReference)
+            {
+                while(echoReferenceFrames.Size() >= cMaxEchoReferenceFrames)
+                    echoReferenceFrames.CommitPop();
+                monoFrame = echoReferenceFrames.PushSlot();
+            }
+            MixedVoiceFrame *mixedFrame = mixedFrames.PushSlot();
+            MixedVoiceFrame &outFrame = mixedFrame ? *mixedFrame : droppedMixedFrame;
+            mixer.End(outFrame.pcm, monoFrame);
+            outFrame.receiveTime = receiveTime;
+            if (monoFrame)
+                echoReferenceFrames.CommitPush();
+            if (mixedFrame)
+                mixedFrames.CommitPush();
+            ++mixedFrameCount;
+        }
+
+        // Publish the playback states. If the main thread has not picked up the earlier snapshots, it gets this one on its next round.
+        PlaybackStateMap *playbackStateSnapshot = playbackStateSnapshots.PushSlot();
+        if (playbackStateSnapshot)
         {
-            UserAudioState *userState = userStateIter->second;
-            userState->frames.clear();
-            if (userState->soundChannel.get())
-                userState->soundChannel->Stop();
-            userState->soundChannel.reset();
-            SAFE_DELETE(userState);
-            inputAudioStates.erase(userStateIter);
+            playbackStateSnapshot->clear();
+            for (AudioStateMap::const_iterator iter = inputAudioStates.begin(); iter != inputAudioStates.end(); ++iter)
+            {
+                UserPlaybackState &state = (*playbackStateSnapshot)[iter->first];
+                state.isSpeaking = iter->second->jitterBuffer.IsPlaying();
+                state.isPositional = iter->second->isPositional;
+                state.pos = iter->second->pos;
+            }
+            playbackStateSnapshots.CommitPush();
         }
     }
 
     void AudioProcessor::ClearOutputAudio()
     {
-        // This function should be called in the main thread
-        {
-            QMutexLocker lockEncoded(&mutexOutputEncoded);
-            pendingEncodedFrames.clear();
-            pendingVADPreBuffer.clear();
-        }
+        // This function should be called in the main thread. The queued frames are dropped in the audio thread.
+        clearOutputPending.fetchAndStoreRelease(1);
         {
             mutexUserOutputAudioState.lockForWrite();
             ownAudioState = UserOutputAudioState();
             mutexUserOutputAudioState.unlock();
         }
-        {
-            QMutexLocker lockOutput(&mutexOutputPCM);
-            pendingPCMFrames.clear();
-        }
     }
 
     int AudioProcessor::CodecBitStreamVersion()
@@ -1121,13 +1171,11 @@ namespace MumbleAudio
         }
     }
 
-    void AudioProcessor::OnAudioReceived(uint userId, uint seq, ByteArrayVector frames, bool isPositional, float3 pos)
+    void AudioProcessor::OnAudioReceived(uint userId, uint seq, const MumbleNetwork::VoicePacketInfo &voicePacket)
     {
-        if (!codec)
-            return;
-
-        // This function is called in the audio thread
-        if (frames.size() == 0)
+        // This function is called in the network thread, see MumblePlugin::Connect. The packet is
+        // only handed over to the audio thread here, decoding and playback is done in ProcessInputAudio.
+        if (voicePacket.numFrames <= 0)
             return;
 
         // This will never* hit if the server was properly informed that we don't want to receive audio,
@@ -1142,54 +1190,20 @@ namespace MumbleAudio
         }
         mutexAudioMute.unlock();
 
-        QMutexLocker lockBuffers(&mutexInput);
-
-        UserAudioState *userAudioState = 0;
-        if (inputAudioStates.find(userId) == inputAudioStates.end())
-        {
-            userAudioState = new UserAudioState();
-            inputAudioStates[userId] = userAudioState;
-        }
-        else
-            userAudioState = inputAudioStates[userId]; // Creates a new one if does not exist already.
-
-        if (userAudioState == 0)
-        {
-            LogWarning(LC + "User state is null, erasing " + QString::number(userId));
-            inputAudioStates.erase(inputAudioStates.find(userId));
+        // If the audio thread has fallen this far behind, the packet is dropped and the jitter buffer conceals it.
+        ReceivedVoicePacket *packet = receivedPackets.PushSlot();
+        if (!packet)
             return;
-        }
-
-        // If you change audio output settings in Mumble or various other things, sequence will reset to 0.
-        // If this is received we need to reset our tracking sequence number as well.
-        if (seq == 0)
-            userAudioState->lastSeq = 0;
-
-        // If this sequence is older than what has been previously received, ignore the frames
-        if (userAudioState->lastSeq > seq)
-            return;
-
-        // Update the users audio state struct
-        userAudioState->lastSeq = seq;
-        userAudioState->isPositional = isPositional;
-        if (userAudioState->isPositional)
-            userAudioState->pos = pos;
 
-        for (ByteArrayVector::const_iterator frameIter = frames.begin(); frameIter != frames.end(); ++frameIter)
-        {
-            const QByteArray &inputFrame = (*frameIter);
-            SoundBuffer soundFrame;
-
-            int celtResult = userAudioState->codec->Decode(inputFrame.data(), inputFrame.size(), soundFrame);
-            if (celtResult == CELT_OK)
-                userAudioState->frames.push_back(soundFrame);
-            else
-            {
-                PrintCeltError(celtResult, true);
-                userAudioState->frames.clear();
-                return;
-            }
-        }
+        packet->userId = userId;
+        packet->seq = seq;
+        packet->numFrames = qMin(voicePacket.numFrames, MumbleNetwork::MaxFramesInVoicePacket);
+        for(int i = 0; i < packet->numFrames; ++i)
+            packet->frames[i] = voicePacket.encodedFrames[i];
+        packet->isPositional = voicePacket.isPositional;
+        packet->pos = voicePacket.pos;
+        packet->arrivalTime = Clock::Tick();
+        receivedPackets.CommitPush();
     }
 
     void AudioProcessor::OnResetFramesPerPacket()
@@ -1200,22 +1214,52 @@ namespace MumbleAudio
         mutexAudioSettings.unlock();
     }
 
+    /// ReceivedVoicePacket
+
+    ReceivedVoicePacket::ReceivedVoicePacket() :
+        userId(0),
+        seq(0),
+        numFrames(0),
+        isPositional(false),
+        pos(float3::zero),
+        arrivalTime(0)
+    {
+    }
+
+    /// MixedVoiceFrame
+
+    MixedVoiceFrame::MixedVoiceFrame() :
+        receiveTime(0)
+    {
+    }
+
     /// UserAudioState
 
     UserAudioState::UserAudioState() :
         codec(new CeltCodec()),
-        lastSeq(0),
         isPositional(false),
-        pos(float3::zero)
+        pos(float3::zero),
+        gainLeft(1.f),
+        gainRight(1.f)
     {
     }
 
     UserAudioState::~UserAudioState()
     {
         SAFE_DELETE(codec);
-        frames.clear();
-        playedFrames.clear();
-        soundChannel.reset();
+    }
+
+    UserPlaybackState::UserPlaybackState() :
+        isSpeaking(false),
+        isPositional(false),
+        pos(float3::zero)
+    {
+    }
+
+    InputMixState::InputMixState() :
+        listenerPosition(float3::zero),
+        listenerOrientation(Quat::identity)
+    {
     }
 
     UserOutputAudioState::UserOutputAudioState() :
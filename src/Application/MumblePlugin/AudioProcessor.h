@@ -9,6 +9,10 @@
 
 #include "SoundBuffer.h"
 #include "SoundChannel.h"
+#include "SpscRing.h"
+#include "VoiceJitterBuffer.h"
+#include "VoiceLatencyMeter.h"
+#include "VoiceMixer.h"
 
 #include <speex/speex_preprocess.h>
 #include <speex/speex_echo.h>
@@ -16,26 +20,51 @@
 #include <QThread>
 #include <QMutex>
 #include <QReadWriteLock>
+#include <QAtomicInt>
 #include <QTimer>
 
+#include <set>
+#include <vector>
+
 /// @cond PRIVATE
 namespace MumbleAudio
 {
     //////////////////////////////////////////////////////
 
-    typedef std::deque<SoundBuffer> AudioFrameDeque;
+    /// Encoded voice packet handed from the network thread to the audio thread.
+    struct ReceivedVoicePacket
+    {
+        ReceivedVoicePacket();
+
+        uint userId;
+        uint seq;
+        MumbleNetwork::EncodedFrame frames[MumbleNetwork::MaxFramesInVoicePacket];
+        int numFrames;
+        bool isPositional;
+        float3 pos;
+        tick_t arrivalTime;
+    };
 
+    /// Mixed stereo frame handed from the audio thread to the main thread.
+    struct MixedVoiceFrame
+    {
+        MixedVoiceFrame();
+
+        SoundBuffer pcm;
+        tick_t receiveTime; ///< When the oldest of the mixed frames was received, zero if all were concealed.
+    };
+
+    /// Receiving state of a user, used only in the audio thread.
     struct UserAudioState
     {
         UserAudioState();
         ~UserAudioState();
 
-        uint lastSeq;
         bool isPositional;
         float3 pos;
-        AudioFrameDeque frames;
-        AudioFrameDeque playedFrames;
-        SoundChannelPtr soundChannel;
+        float gainLeft;
+        float gainRight;
+        VoiceJitterBuffer jitterBuffer;
         CeltCodec *codec;
 
     private:
@@ -45,6 +74,28 @@ namespace MumbleAudio
 
     typedef std::map<uint, UserAudioState* > AudioStateMap;
 
+    /// Playback state of a user, published by the audio thread for the main thread.
+    struct UserPlaybackState
+    {
+        UserPlaybackState();
+
+        bool isSpeaking;
+        bool isPositional;
+        float3 pos;
+    };
+
+    typedef std::map<uint, UserPlaybackState> PlaybackStateMap;
+
+    /// Listener and muted users handed from the main thread to the audio thread for mixing.
+    struct InputMixState
+    {
+        InputMixState();
+
+        float3 listenerPosition;
+        Quat listenerOrientation;
+        std::set<uint> mutedUsers;
+    };
+
     struct UserOutputAudioState
     {
         UserOutputAudioState();
@@ -82,6 +133,13 @@ namespace MumbleAudio
 
         void GetLevels(float &peakMic, bool &speaking);
 
+        /// Time from reading a frame from the microphone to sending it to the network.
+        const VoiceLatencyMeter &CaptureToSendLatency() const { return captureToSendLatency; }
+
+        /// Time from receiving a frame from the network to queuing it to the voice channel.
+        /** Stops when the mixed frame is added to the SoundChannel. The OpenAL buffers queued ahead of it are not included. */
+        const VoiceLatencyMeter &ReceiveToQueueLatency() const { return receiveToQueueLatency; }
+
     protected:
         // QThread override.
         void run();
@@ -90,7 +148,6 @@ namespace MumbleAudio
         void timerEvent(QTimerEvent *event);
 
     public slots:
-        void ReadMicrophoneAudio();
         void SendOutputAudio();
 
         void SetOutputAudioMuted(bool outputAudioMuted_);
@@ -98,7 +155,7 @@ namespace MumbleAudio
         void SetUserOutputState(UserOutputAudioState state);
         UserOutputAudioState UserOutputState();
 
-        /// Plays all input audio frames from other users.
+        /// Plays the input audio mixed from other users in the audio thread.
         /// Updates MumbleUser::isPositional and emits MumbleUser::PositionalChanged
         /// and MumblePlugin::UserPositionalChanged
         void PlayInputAudio(MumblePlugin *mumble);
@@ -120,24 +177,39 @@ namespace MumbleAudio
         int CodecBitStreamVersion();
 
     private slots:
-        void OnAudioReceived(uint userId, uint seq, ByteArrayVector frames, bool isPositional, float3 pos);
+        // Called directly in the network thread.
+        void OnAudioReceived(uint userId, uint seq, const MumbleNetwork::VoicePacketInfo &voicePacket);
         void OnResetFramesPerPacket();
 
     private:
         void ResetSpeexProcessor();
         void ClearPendingChannels();
 
+        // Reads one frame of recorded PCM to pcmFrame. Returns false if a full frame has not been recorded yet.
+        bool ReadMicrophoneFrame(SoundBuffer &pcmFrame);
+
+        // Queues an encoded frame to be sent, dropping the oldest one if the queue is full. Called in the audio thread.
+        void QueueEncodedFrame(MumbleNetwork::EncodedFrame &frame);
+
+        // Jitter buffers and mixes the received audio. Called in the audio thread.
+        void ProcessInputAudio();
+        void DeleteInputAudioStates();
+
         // Caller must hold mutexOutputPCM lock
         void DoEchoCancellation(SoundBuffer &frame);
 
         void PrintCeltError(int celtError, bool decoding);
 
-        // Below floats and booleans need mutexOutputPCM lock for reading. Use the GetLevels function.
+        // Used in audio thread without locks. Published for GetLevels in publishedPeakMic and publishedSpeech.
         float levelPeakMic;
         float levelMic;
         bool isSpeech;
         bool wasPreviousSpeech;
 
+        // Written in audio thread, read in main thread. Peak mic level in hundredths of decibels.
+        QAtomicInt publishedPeakMic;
+        QAtomicInt publishedSpeech;
+
         MumbleNetworkHandler *networkHandler_;
         AudioRecorder *recorder_;
 
@@ -156,20 +228,63 @@ namespace MumbleAudio
         // Used in both main and audio thread with mutexAudioSettings.
         AudioSettings audioSettings;
 
-        // Used in both main and audio thread with mutexInput.
+        // Used in audio thread without locks.
         AudioStateMap inputAudioStates;
 
+        // Pushed in the network thread, popped in the audio thread.
+        SpscRing<ReceivedVoicePacket> receivedPackets;
+
+        // Used in audio thread without locks.
+        VoiceMixer mixer;
+        bool mixing;
+        tick_t mixStartTime;
+        int mixedFrameCount;
+        SoundBuffer decodedFrame;
+        MixedVoiceFrame droppedMixedFrame;
+
+        // Pushed in the audio thread, popped in the main thread.
+        SpscRing<MixedVoiceFrame> mixedFrames;
+        SpscRing<PlaybackStateMap> playbackStateSnapshots;
+
+        // Pushed in the main thread, popped in the audio thread.
+        SpscRing<InputMixState> inputMixStates;
+
+        // Used in audio thread without locks. The latest state from inputMixStates.
+        InputMixState inputMixState;
+
+        // Used only in the main thread. The latest snapshot from playbackStateSnapshots.
+        PlaybackStateMap playbackStates;
+
+        // Used in both main and audio thread with mutexInput.
+        std::set<uint> clearInputUsers;
+        bool clearInputPending;
+
+        // Used only in the main thread. Created and updated by AudioAPI.
+        SoundChannelPtr mixChannel;
+
+        // Used only in the main thread. Assets that are refilled with the mixed frames, see CreateAudioAssetFromSoundBuffer.
+        std::vector<AudioAssetPtr> playbackAssets;
+
+        // Mixed mono frames for echo cancellation and the buffers used in it. Used in audio thread without locks.
+        SpscRing<SoundBuffer> echoReferenceFrames;
+        SoundBuffer echoPlayedFrame;
+        SoundBuffer echoOutputFrame;
+
         // This user's output state
         UserOutputAudioState ownAudioState;
 
-        // Used in both main and audio thread with mutexOutputEncoded.
-        QList<QByteArray> pendingEncodedFrames;
+        // Used in audio thread without locks. The rings are only used as fixed size queues.
+        SoundBuffer capturedFrame;
+        SpscRing<MumbleNetwork::EncodedFrame> pendingEncodedFrames;
+        SpscRing<MumbleNetwork::EncodedFrame> pendingVADPreBuffer;
+        MumbleNetwork::VoicePacketInfo outgoingVoicePacket;
 
-        // Used in both main and audio thread with mutexOutputPCM.
-        std::vector<SoundBuffer> pendingPCMFrames;
+        // Set in main thread to have the audio thread drop the queued output frames.
+        QAtomicInt clearOutputPending;
 
-        // Used in audio thread without locks.
-        QList<QByteArray> pendingVADPreBuffer;
+        // Added in audio thread and main thread respectively.
+        VoiceLatencyMeter captureToSendLatency;
+        VoiceLatencyMeter receiveToQueueLatency;
 
         // Used in both main and audio thread with mutexAudioMute.
         bool outputAudioMuted;
@@ -186,7 +301,6 @@ namespace MumbleAudio
         // Various mutexes for sharing data between audio and main thread.
         QMutex mutexInput;
         QMutex mutexOutputPCM;
-        QMutex mutexOutputEncoded;
         QMutex mutexRecorder;
 
         QReadWriteLock mutexAudioMute;
@@ -6,6 +6,7 @@
 #include "MumbleDefines.h"
 #include "CoreTypes.h"
 #include "Math/float3.h"
+#include "Time/Clock.h"
 
 #include "google/protobuf/message.h"
 
@@ -15,6 +16,8 @@
 #include <QDataStream>
 #include <QHostAddress>
 
+#include <cstring>
+
 /// @cond PRIVATE
 namespace MumbleNetwork
 {
@@ -279,13 +282,38 @@ namespace MumbleNetwork
         bool selfMuted, selfDeaf, isMe;
     };
 
+    /// Largest encoded audio frame. The frame length is 7 bits in the voice packet header.
+    static const int MaxEncodedFrameSize = 127;
+
+    /// Largest number of audio frames in a voice packet that is sent or received.
+    static const int MaxFramesInVoicePacket = 10;
+
+    /// Encoded audio frame with a preallocated payload, so that frames are passed between
+    /// the audio and network threads without heap allocations.
+    struct EncodedFrame
+    {
+        EncodedFrame() : size(0), time(0) {}
+
+        /// Sets the payload, truncated to MaxEncodedFrameSize.
+        void Set(const void *data_, int size_)
+        {
+            size = qBound(0, size_, MaxEncodedFrameSize);
+            memcpy(data, data_, size);
+        }
+
+        int size;
+        unsigned char data[MaxEncodedFrameSize];
+        /// Time the frame was captured when sending, or received when receiving. Used for latency statistics.
+        tick_t time;
+    };
+
     struct VoicePacketInfo
     {
-        VoicePacketInfo(const std::vector<QByteArray> &encodedFrames_) :
+        VoicePacketInfo() :
             isLoopBack(false),
             isPositional(false),
-            encodedFrames(encodedFrames_),
-            pos(float3::zero)
+            pos(float3::zero),
+            numFrames(0)
         {
         }
 
@@ -293,7 +321,8 @@ namespace MumbleNetwork
         bool isPositional;
         float3 pos;
 
-        std::vector<QByteArray> encodedFrames;
+        EncodedFrame encodedFrames[MaxFramesInVoicePacket];
+        int numFrames;
     };
 
     struct TCPInfo
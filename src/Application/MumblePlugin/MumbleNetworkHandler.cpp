@@ -83,6 +83,7 @@ MumbleNetworkHandler::MumbleNetworkHandler(QString address, ushort port, QString
     requestedExit_(false),
     codecBitStreamVersion(0),
     frameOutSequenceNumber(0),
+    sentLoopBackPackets(64),
     networkMode(MumbleNetwork::MumbleUDPMode)
 {
     connectionInfo.address = address;
@@ -578,7 +579,7 @@ void MumbleNetworkHandler::SendVoicePacket(VoicePacketInfo &packetInfo)
     data[0] = static_cast<unsigned char>(messageFlags);
 
     Mumble::PacketDataStream stream(data + 1, 1023);
-    PrepareVoicePacket(packetInfo.encodedFrames, stream);
+    PrepareVoicePacket(packetInfo, stream);
 
     if (packetInfo.isPositional)
     {
@@ -596,23 +597,32 @@ void MumbleNetworkHandler::SendVoicePacket(VoicePacketInfo &packetInfo)
         SendUDP(data, stream.size() + 1);
     else
         SendTCP(UDPTunnel, data, stream.size() + 1);
+
+    // The server sends loopback packets back to us with the same sequence number.
+    if (packetInfo.isLoopBack)
+    {
+        SentVoicePacket sent;
+        sent.seq = frameOutSequenceNumber - 1;
+        sent.time = Clock::Tick();
+        sentLoopBackPackets.Push(sent);
+    }
 }
 
-void MumbleNetworkHandler::PrepareVoicePacket(ByteArrayVector &encodedFrames, Mumble::PacketDataStream &stream)
+void MumbleNetworkHandler::PrepareVoicePacket(const VoicePacketInfo &packetInfo, Mumble::PacketDataStream &stream)
 {
     // Sequence number
     stream << frameOutSequenceNumber;
     frameOutSequenceNumber++;
 
-    size_t frameCount = encodedFrames.size();
-    for(size_t i = 0; i < frameCount; ++i)
+    int frameCount = qMin(packetInfo.numFrames, MaxFramesInVoicePacket);
+    for(int i = 0; i < frameCount; ++i)
     {
-        const QByteArray &qba = encodedFrames.at(i);
-        unsigned char head = static_cast<unsigned char>(qba.size());
+        const EncodedFrame &frame = packetInfo.encodedFrames[i];
+        unsigned char head = static_cast<unsigned char>(frame.size);
         if (i < frameCount - 1)
             head |= 0x80;
         stream.append(head);
-        stream.append(qba.constData(), qba.size());
+        stream.append(reinterpret_cast<const char*>(frame.data), frame.size);
     }
 }
 
@@ -837,8 +847,10 @@ void MumbleNetworkHandler::HandleMessage(const TCPMessageType id, QByteArray &bu
 
 void MumbleNetworkHandler::HandleVoicePacket(uint userId, uint seq, Mumble::PacketDataStream &stream)
 {
-    // Read audio frames
-    ByteArrayVector frames;
+    // Read audio frames to the preallocated packet, the receiver copies what it needs.
+    VoicePacketInfo &packet = receivedVoicePacket;
+    packet.numFrames = 0;
+    tick_t arrivalTime = Clock::Tick();
     bool lastFrame = false;
     while(!lastFrame && stream.isValid())
     {
@@ -846,24 +858,44 @@ void MumbleNetworkHandler::HandleVoicePacket(uint userId, uint seq, Mumble::Pack
         uint frameSize = header & 0x7f;
         lastFrame = !(header & 0x80);
 
-        if (frameSize > 0)
-            frames.push_back(QByteArray(stream.charPtr(), frameSize));
+        if (frameSize > 0 && frameSize <= stream.left() && packet.numFrames < MaxFramesInVoicePacket)
+        {
+            EncodedFrame &frame = packet.encodedFrames[packet.numFrames++];
+            frame.Set(stream.charPtr(), frameSize);
+            frame.time = arrivalTime;
+        }
         stream.skip(frameSize);
     }
 
     // Check and read positional data
-    bool isPositional = false;
-    float3 pos = float3::zero;
+    packet.isPositional = false;
+    packet.pos = float3::zero;
     if (stream.left() > 0)
     {
-        isPositional = true;
-        stream >> pos.x;
-        stream >> pos.y;
-        stream >> pos.z;
+        packet.isPositional = true;
+        stream >> packet.pos.x;
+        stream >> packet.pos.y;
+        stream >> packet.pos.z;
+    }
+
+    // Own packet in loopback mode, match it to the sent one. Packets that were lost are skipped.
+    if (userId == connectionInfo.sessionId)
+    {
+        SentVoicePacket sent;
+        while(sentLoopBackPackets.Pop(sent))
+        {
+            if (sent.seq == static_cast<int>(seq))
+            {
+                loopBackLatency.Add(Clock::TimespanToMillisecondsF(sent.time, arrivalTime));
+                break;
+            }
+            if (sent.seq > static_cast<int>(seq))
+                break;
+        }
     }
 
-    if (frames.size() > 0)
-        emit AudioReceived(userId, seq, frames, isPositional, pos);
+    if (packet.numFrames > 0)
+        emit AudioReceived(userId, seq, packet);
 }
 
 bool MumbleNetworkHandler::TCPAlive()
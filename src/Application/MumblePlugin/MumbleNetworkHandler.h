@@ -5,6 +5,8 @@
 #include "IModule.h"
 #include "MumbleDefines.h"
 #include "MumbleNetwork.h"
+#include "SpscRing.h"
+#include "VoiceLatencyMeter.h"
 #include "mumble/CryptState.h"
 #include "mumble/Timer.h"
 #include "mumble/PacketDataStream.h"
@@ -31,6 +33,9 @@ public:
     MumbleNetwork::ConnectionInfo connectionInfo;
     int codecBitStreamVersion;
 
+    // Round trip time of the own voice packets to the server and back in loopback mode.
+    const MumbleAudio::VoiceLatencyMeter &LoopBackLatency() const { return loopBackLatency; }
+
 protected:
     // QThread override.
     void run();
@@ -48,7 +53,7 @@ public slots:
     // Send UDP message with data and length. Encrypts the input data before sending.
     void SendUDP(const char *data, int length);
 
-    // Sends UDP voice packets after processing audio frames and position.
+    // Sends UDP voice packets after processing audio frames and position. Called in the audio thread.
     void SendVoicePacket(MumbleNetwork::VoicePacketInfo &packetInfo);
 
     // Send TCP and UDP ping.
@@ -75,7 +80,9 @@ signals:
     void UserUpdate(MumbleNetwork::MumbleUserState userState);
     void UserLeft(uint id, uint actorId, bool banned, bool kicked, QString reason);
     
-    void AudioReceived(uint userId, uint seq, ByteArrayVector frames, bool isPositional, float3 pos);
+    // Emitted in the network thread for each received voice packet. Connect with Qt::DirectConnection only,
+    // packet is reused for the next voice packet once the slot returns.
+    void AudioReceived(uint userId, uint seq, const MumbleNetwork::VoicePacketInfo &packet);
 
 private slots:
     void OnConnected();
@@ -99,7 +106,7 @@ private:
     void HandleVoicePacket(uint userId, uint seq, Mumble::PacketDataStream &stream);
 
     // Prepares encoded packets into a PacketDataStream.
-    void PrepareVoicePacket(ByteArrayVector &encodedFrames, Mumble::PacketDataStream &stream);
+    void PrepareVoicePacket(const MumbleNetwork::VoicePacketInfo &packetInfo, Mumble::PacketDataStream &stream);
 
     QSslSocket *tcp;
     QUdpSocket *udp;
@@ -125,6 +132,19 @@ private:
 
     int frameOutSequenceNumber;
 
+    // Used in the network thread without locks.
+    MumbleNetwork::VoicePacketInfo receivedVoicePacket;
+
+    struct SentVoicePacket
+    {
+        int seq;
+        tick_t time;
+    };
+
+    // Sent loopback packets, pushed in the audio thread and popped in the network thread when they return.
+    MumbleAudio::SpscRing<SentVoicePacket> sentLoopBackPackets;
+    MumbleAudio::VoiceLatencyMeter loopBackLatency;
+
     QString LC;
     
 #ifdef Q_WS_WIN
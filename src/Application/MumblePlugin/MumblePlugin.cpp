@@ -82,6 +82,8 @@ void MumblePlugin::Initialize()
 
     framework_->Console()->RegisterCommand("mumblePackets", "Set MumbleVoip amount of frames per network packet, eg. mumblepackets(6).", 
         this, SLOT(OnFramesPerPacketChanged(const QStringList&)));
+    framework_->Console()->RegisterCommand("mumbleLatency", "Prints the MumbleVoip voice latencies. Enable loopback to measure your own voice end to end.",
+        this, SLOT(OnPrintLatency()));
 
     // Audio processing with ~60 fps. This is not tied to FrameAPI::Updated or IModule::Update
     // because we want to process audio at a steady and fast rate even if mainloop max fps is capped to eg. 30 fps.
@@ -229,8 +231,9 @@ void MumblePlugin::Connect(QString address, int port, QString username, QString
     connect(network_, SIGNAL(UserLeft(uint, uint, bool, bool, QString)), SLOT(OnUserLeft(uint, uint, bool, bool, QString)), Qt::QueuedConnection);
     connect(network_, SIGNAL(UserUpdate(MumbleNetwork::MumbleUserState)), SLOT(OnUserUpdate(MumbleNetwork::MumbleUserState)), Qt::QueuedConnection);
 
-    // Handle audio signals from network thread to audio thread.
-    connect(network_, SIGNAL(AudioReceived(uint, uint, ByteArrayVector, bool, float3)), audio_, SLOT(OnAudioReceived(uint, uint, ByteArrayVector, bool, float3)), Qt::QueuedConnection);
+    // Handle audio signals from network thread to audio thread. The slot is invoked directly in the network thread
+    // and passes the packet on to the audio thread through a lock-free queue, without going through an event loop.
+    connect(network_, SIGNAL(AudioReceived(uint, uint, const MumbleNetwork::VoicePacketInfo&)), audio_, SLOT(OnAudioReceived(uint, uint, const MumbleNetwork::VoicePacketInfo&)), Qt::DirectConnection);
     
     audio_->start(QThread::HighPriority);
     network_->start(QThread::HighPriority);
@@ -248,12 +251,12 @@ void MumblePlugin::Disconnect(QString reason)
     if (audioWizard)
         delete audioWizard;
 
+    // Stop both threads before deleting either: the network thread hands received audio directly to the audio processor.
     if (audio_ && audio_->isRunning())
     {
         audio_->exit();
         audio_->wait(5000);
     }
-    SAFE_DELETE(audio_);
 
     state.serverSynced = false;
     if (network_ && network_->isRunning())
@@ -261,6 +264,7 @@ void MumblePlugin::Disconnect(QString reason)
         network_->exit();
         network_->wait(5000);
     }
+    SAFE_DELETE(audio_);
     SAFE_DELETE(network_);
 
     if (state.connectionState != MumbleNetwork::MumbleDisconnected)
@@ -1218,6 +1222,28 @@ void MumblePlugin::OnFramesPerPacketChanged(const QStringList &params)
         LogError(LC + "Cannot set frames per packet, given parameter list is empty, needs single integer.");   
 }
 
+void MumblePlugin::OnPrintLatency()
+{
+    if (!audio_ || !network_)
+    {
+        LogError(LC + "Cannot print latencies, no active VOIP connection.");
+        return;
+    }
+
+    const MumbleAudio::VoiceLatencyMeter &captureToSend = audio_->CaptureToSendLatency();
+    const MumbleAudio::VoiceLatencyMeter &loopBack = network_->LoopBackLatency();
+    const MumbleAudio::VoiceLatencyMeter &receiveToQueue = audio_->ReceiveToQueueLatency();
+
+    LogInfo(LC + "Voice latencies:");
+    LogInfo(LC + "- Capture, encode and send: " + captureToSend.ToString());
+    LogInfo(LC + "- Loopback round trip to server: " + loopBack.ToString());
+    LogInfo(LC + "- Receive, decode and queue for playback: " + receiveToQueue.ToString());
+    if (loopBack.Count() > 0)
+        LogInfo(LC + QString("- Loopback end to end, without the playback queue: %1 ms").arg(captureToSend.AverageMsecs() + loopBack.AverageMsecs() + receiveToQueue.AverageMsecs(), 0, 'f', 2));
+    else
+        LogInfo(LC + "- Loopback end to end: enable loopback with SetOutputAudioLoopBack(true) to measure.");
+}
+
 MumbleAudio::AudioSettings MumblePlugin::LoadSettings()
 {
     ConfigAPI *config = framework_->Config();
@@ -323,6 +323,9 @@ private slots:
     // Handler for console command to set frames per packet.
     void OnFramesPerPacketChanged(const QStringList &params);
 
+    // Handler for console command to print the voice latencies.
+    void OnPrintLatency();
+
     // When server send synced message we have all server channels and users.
     void OnServerSynced(uint sessionId);
 
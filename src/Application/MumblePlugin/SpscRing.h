@@ -0,0 +1,113 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include <QAtomicInt>
+
+#include <vector>
+#include <algorithm>
+
+/// @cond PRIVATE
+namespace MumbleAudio
+{
+    /// Fixed capacity lock-free queue between exactly one producer thread and one consumer thread.
+    /** The slots are allocated up front and reused. Push and Pop swap the values in and out of the slots,
+        so a slot keeps the buffers of the value last popped from it and e.g. a std::vector member
+        does not reallocate once the ring has gone around. */
+    template <typename T>
+    class SpscRing
+    {
+    public:
+        /// @param capacity Number of values the ring can hold, rounded up to a power of two.
+        explicit SpscRing(int capacity) :
+            head(0),
+            tail(0)
+        {
+            int size = 2;
+            while(size <= capacity)
+                size <<= 1;
+            ring.resize(size);
+            mask = size - 1;
+        }
+
+        /// Moves value to the ring. Call only in the producer thread.
+        /** @return False if the ring is full, in which case value is left untouched. */
+        bool Push(T &value)
+        {
+            int t = tail;
+            int next = (t + 1) & mask;
+            if (next == head.fetchAndAddAcquire(0))
+                return false;
+            std::swap(ring[t], value);
+            tail.fetchAndStoreRelease(next);
+            return true;
+        }
+
+        /// Moves the oldest value out of the ring. Call only in the consumer thread.
+        /** @return False if the ring is empty. */
+        bool Pop(T &value)
+        {
+            int h = head;
+            if (h == tail.fetchAndAddAcquire(0))
+                return false;
+            std::swap(ring[h], value);
+            head.fetchAndStoreRelease((h + 1) & mask);
+            return true;
+        }
+
+        /// Returns the slot the next value is written to, or null if the ring is full. Call only in the producer thread.
+        /** Use this instead of Push for large values that are filled in place, and publish the value with CommitPush.
+            The slot holds whatever value was last popped from it. */
+        T *PushSlot()
+        {
+            int t = tail;
+            if (((t + 1) & mask) == head.fetchAndAddAcquire(0))
+                return 0;
+            return &ring[t];
+        }
+
+        /// Publishes the value written to PushSlot to the consumer.
+        void CommitPush()
+        {
+            tail.fetchAndStoreRelease((tail + 1) & mask);
+        }
+
+        /// Returns the oldest value in place, or null if the ring is empty. Call only in the consumer thread.
+        /** The value stays valid until it is released with CommitPop. */
+        T *Front()
+        {
+            int h = head;
+            if (h == tail.fetchAndAddAcquire(0))
+                return 0;
+            return &ring[h];
+        }
+
+        /// Releases the value returned by Front back to the producer.
+        void CommitPop()
+        {
+            head.fetchAndStoreRelease((head + 1) & mask);
+        }
+
+        /// Drops all values. Call only in the consumer thread.
+        void Clear()
+        {
+            head.fetchAndStoreRelease(tail.fetchAndAddAcquire(0));
+        }
+
+        /// Returns the number of values in the ring. Exact only in the consumer thread.
+        int Size() const { return (tail - head) & mask; }
+
+        /// Returns true if the ring has no values. Exact only in the consumer thread.
+        bool IsEmpty() const { return head == tail; }
+
+    private:
+        SpscRing(const SpscRing &); // N/A
+        SpscRing &operator =(const SpscRing &); // N/A
+
+        std::vector<T> ring; ///< The slots of the values.
+        int mask;
+        QAtomicInt head; ///< Next slot to pop, written by the consumer.
+        QAtomicInt tail; ///< Next slot to push, written by the producer.
+    };
+}
+/// @endcond
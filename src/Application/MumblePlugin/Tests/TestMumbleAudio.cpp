@@ -0,0 +1,472 @@
+
+#include "TestMumbleAudio.h"
+
+#include "VoiceJitterBuffer.h"
+#include "VoiceMixer.h"
+#include "VoiceLatencyMeter.h"
+#include "SpscRing.h"
+#include "CeltCodec.h"
+#include "mumble/PacketDataStream.h"
+#include "SoundBuffer.h"
+#include "Algorithm/Random/LCG.h"
+
+#include <QtTest/QtTest>
+
+#include <vector>
+#include <algorithm>
+
+using MumbleAudio::VoiceJitterBuffer;
+using MumbleAudio::VoiceMixer;
+using MumbleAudio::SpscRing;
+using MumbleAudio::CeltCodec;
+using MumbleAudio::VoiceLatencyMeter;
+
+namespace
+{
+    /// Returns a frame whose payload is its number, to tell the frames apart after the jitter buffer.
+    MumbleNetwork::EncodedFrame NumberedFrame(int number)
+    {
+        const unsigned char payload = static_cast<unsigned char>(number);
+        MumbleNetwork::EncodedFrame frame;
+        frame.Set(&payload, 1);
+        return frame;
+    }
+
+    tick_t Msecs(int msecs)
+    {
+        return static_cast<tick_t>(msecs) * Clock::TicksPerMillisecond();
+    }
+
+    /// Plays one frame from the buffer, and appends its number to played, or -1 if it was lost.
+    void PlayFrame(VoiceJitterBuffer &buffer, std::vector<int> &played)
+    {
+        MumbleNetwork::EncodedFrame frame;
+        VoiceJitterBuffer::FrameResult result = buffer.GetFrame(frame);
+        if (result == VoiceJitterBuffer::FrameData)
+            played.push_back(frame.data[0]);
+        else if (result == VoiceJitterBuffer::FrameLost)
+            played.push_back(-1);
+    }
+
+    /// Returns a mono 16-bit frame of random samples over the full range.
+    SoundBuffer RandomFrame(LCG &rng, int samples)
+    {
+        SoundBuffer frame;
+        frame.data.resize(samples * sizeof(s16));
+        s16 *data = reinterpret_cast<s16*>(&frame.data[0]);
+        for(int i = 0; i < samples; ++i)
+            data[i] = static_cast<s16>(rng.Int(-32768, 32767));
+        return frame;
+    }
+
+    SoundBuffer ConstantFrame(int samples, s16 value)
+    {
+        SoundBuffer frame;
+        frame.data.resize(samples * sizeof(s16));
+        s16 *data = reinterpret_cast<s16*>(&frame.data[0]);
+        for(int i = 0; i < samples; ++i)
+            data[i] = value;
+        return frame;
+    }
+
+    s16 Sample(const SoundBuffer &buffer, int index)
+    {
+        return reinterpret_cast<const s16*>(&buffer.data[0])[index];
+    }
+    /// Voice pipeline from capture to playback, with the network replaced by the packet framing of MumbleNetworkHandler.
+    /** Sends one packet per round and plays the frames the jitter buffer gives out, as AudioProcessor does
+        in the audio thread and the main thread, but without the timers in between. */
+    struct LoopbackPipeline
+    {
+        LoopbackPipeline(int framesPerPacket_) :
+            framesPerPacket(framesPerPacket_),
+            mixer(MUMBLE_AUDIO_SAMPLES_IN_FRAME),
+            mixedFrames(framesPerPacket_ * 2),
+            seq(0),
+            playedFrames(0),
+            datagramSize(0)
+        {
+            LCG rng(4321);
+            for(int i = 0; i < framesPerPacket; ++i)
+                capturedFrames.push_back(RandomFrame(rng, MUMBLE_AUDIO_SAMPLES_IN_FRAME));
+        }
+
+        /// Encodes the captured frames and frames them to a datagram.
+        void Send()
+        {
+            tick_t captureTime = Clock::Tick();
+            outgoing.numFrames = 0;
+            for(int i = 0; i < framesPerPacket; ++i)
+            {
+                MumbleNetwork::EncodedFrame &frame = outgoing.encodedFrames[outgoing.numFrames++];
+                frame.size = qBound(0, sender.Encode(capturedFrames[i], frame.data, MUMBLE_AUDIO_QUALITY_BALANCED), MumbleNetwork::MaxEncodedFrameSize);
+            }
+
+            Mumble::PacketDataStream stream(datagram, sizeof(datagram));
+            stream << seq;
+            for(int i = 0; i < outgoing.numFrames; ++i)
+            {
+                const MumbleNetwork::EncodedFrame &frame = outgoing.encodedFrames[i];
+                unsigned char head = static_cast<unsigned char>(frame.size);
+                if (i < outgoing.numFrames - 1)
+                    head |= 0x80;
+                stream.append(head);
+                stream.append(reinterpret_cast<const char*>(frame.data), frame.size);
+            }
+            datagramSize = stream.size();
+            captureToSend.Add(Clock::MillisecondsSinceF(captureTime));
+        }
+
+        /// Reads the datagram, and decodes, mixes and queues the frames that are due.
+        void Receive()
+        {
+            tick_t receiveTime = Clock::Tick();
+            Mumble::PacketDataStream stream(datagram, datagramSize);
+            uint packetSeq = 0;
+            stream >> packetSeq;
+            incoming.numFrames = 0;
+            bool lastFrame = false;
+            while(!lastFrame && stream.isValid())
+            {
+                u8 header = stream.next8();
+                uint frameSize = header & 0x7f;
+                lastFrame = !(header & 0x80);
+                if (frameSize > 0 && frameSize <= stream.left() && incoming.numFrames < MumbleNetwork::MaxFramesInVoicePacket)
+                    incoming.encodedFrames[incoming.numFrames++].Set(stream.charPtr(), frameSize);
+                stream.skip(frameSize);
+            }
+
+            // The packets arrive evenly spaced on the simulated clock, so the jitter buffer plays them out steadily.
+            jitterBuffer.Put(packetSeq, incoming.encodedFrames, incoming.numFrames, Msecs(1000 + packetSeq * framesPerPacket * 10));
+            ++seq;
+
+            MumbleNetwork::EncodedFrame frame;
+            for(int i = 0; i < framesPerPacket; ++i)
+            {
+                VoiceJitterBuffer::FrameResult result = jitterBuffer.GetFrame(frame);
+                if (result == VoiceJitterBuffer::FrameNone)
+                    continue;
+                int celtResult = (result == VoiceJitterBuffer::FrameData ?
+                    receiver.Decode(reinterpret_cast<const char*>(frame.data), frame.size, decodedFrame) :
+                    receiver.Decode(0, 0, decodedFrame));
+                if (celtResult != CELT_OK)
+                    continue;
+                mixer.Begin();
+                mixer.Add(decodedFrame, 1.f, 1.f);
+                SoundBuffer *mixedFrame = mixedFrames.PushSlot();
+                if (mixedFrame)
+                {
+                    mixer.End(*mixedFrame, 0);
+                    mixedFrames.CommitPush();
+                }
+            }
+
+            // The main thread takes the mixed frames for playback.
+            while(mixedFrames.Front())
+            {
+                mixedFrames.CommitPop();
+                ++playedFrames;
+            }
+            receiveToQueue.Add(Clock::MillisecondsSinceF(receiveTime));
+        }
+
+        int framesPerPacket;
+        std::vector<SoundBuffer> capturedFrames;
+        CeltCodec sender;
+        CeltCodec receiver;
+        VoiceJitterBuffer jitterBuffer;
+        VoiceMixer mixer;
+        SpscRing<SoundBuffer> mixedFrames;
+        SoundBuffer decodedFrame;
+        MumbleNetwork::VoicePacketInfo outgoing;
+        MumbleNetwork::VoicePacketInfo incoming;
+        char datagram[1024];
+        uint seq;
+        int playedFrames;
+        int datagramSize;
+        VoiceLatencyMeter captureToSend;
+        VoiceLatencyMeter receiveToQueue;
+    };
+}
+
+namespace TundraTest
+{
+    void MumbleAudio::JitterBufferReordering()
+    {
+        // One frame per packet every 10 ms, with every pair of packets swapped on the way.
+        const int numPackets = 20;
+        VoiceJitterBuffer buffer;
+        std::vector<int> played;
+        for(int tick = 0; tick < numPackets + 10; ++tick)
+        {
+            if (tick < numPackets)
+            {
+                const int seq = tick ^ 1;
+                const MumbleNetwork::EncodedFrame frame = NumberedFrame(seq);
+                buffer.Put(seq, &frame, 1, Msecs(1000 + tick * 10));
+            }
+            PlayFrame(buffer, played);
+        }
+
+        // All the frames are played in order, and the end of the talk spurt is concealed briefly.
+        QCOMPARE(played.size(), (size_t)numPackets + 3);
+        for(int i = 0; i < numPackets; ++i)
+            QCOMPARE(played[i], i);
+        for(size_t i = numPackets; i < played.size(); ++i)
+            QCOMPARE(played[i], -1);
+        QVERIFY(!buffer.IsPlaying());
+        QCOMPARE(buffer.BufferedFrames(), 0);
+    }
+
+    void MumbleAudio::JitterBufferLoss()
+    {
+        // Packets 5 and 6 are lost, and packet 12 arrives after its turn.
+        const int numPackets = 20;
+        VoiceJitterBuffer buffer;
+        std::vector<int> played;
+        for(int tick = 0; tick < numPackets + 10; ++tick)
+        {
+            int seq = tick < numPackets ? tick : -1;
+            if (tick == 5 || tick == 6 || tick == 12)
+                seq = -1;
+            else if (tick == 16)
+                seq = 12;
+            if (seq >= 0)
+            {
+                const MumbleNetwork::EncodedFrame frame = NumberedFrame(seq);
+                buffer.Put(seq, &frame, 1, Msecs(1000 + tick * 10));
+            }
+            if (tick == 16)
+            {
+                const MumbleNetwork::EncodedFrame frame = NumberedFrame(16);
+                buffer.Put(16, &frame, 1, Msecs(1000 + tick * 10));
+            }
+            PlayFrame(buffer, played);
+        }
+
+        // Each missing frame is concealed once in its place, and the late packet is dropped.
+        std::vector<int> expected;
+        for(int i = 0; i < numPackets; ++i)
+            expected.push_back(i == 5 || i == 6 || i == 12 ? -1 : i);
+        expected.push_back(-1);
+        expected.push_back(-1);
+        expected.push_back(-1);
+        QCOMPARE(played.size(), expected.size());
+        for(size_t i = 0; i < expected.size(); ++i)
+            QCOMPARE(played[i], expected[i]);
+        QCOMPARE(buffer.BufferedFrames(), 0);
+    }
+
+    void MumbleAudio::JitterBufferRestart()
+    {
+        // A talk spurt with steady arrivals far into the sequence.
+        VoiceJitterBuffer buffer;
+        std::vector<int> played;
+        for(int tick = 0; tick < 30; ++tick)
+        {
+            if (tick < 20)
+            {
+                const MumbleNetwork::EncodedFrame frame = NumberedFrame(100 + tick);
+                buffer.Put(1000 + tick, &frame, 1, Msecs(1000 + tick * 10));
+            }
+            PlayFrame(buffer, played);
+        }
+        QVERIFY(!buffer.IsPlaying());
+        QCOMPARE(buffer.TargetFrames(), 2);
+        for(int i = 0; i < 20; ++i)
+            QCOMPARE(played[i], 100 + i);
+
+        // The sender restarts its sequence from zero, and every other packet is late by 30 ms.
+        // The jitter is measured for the new sequence and the target delay follows it.
+        for(int seq = 0; seq < 20; ++seq)
+        {
+            const MumbleNetwork::EncodedFrame frame = NumberedFrame(seq);
+            buffer.Put(seq, &frame, 1, Msecs(2000 + seq * 10 + (seq % 2) * 30));
+        }
+        QVERIFY(buffer.TargetFrames() > 2);
+
+        // The new spurt plays in order up to its last frame, skipping frames to bring the latency down to the target.
+        played.clear();
+        for(int tick = 0; tick < 30; ++tick)
+            PlayFrame(buffer, played);
+        QVERIFY(!played.empty());
+        for(size_t i = 1; i < played.size(); ++i)
+            QVERIFY(played[i] == -1 || played[i] > played[i - 1]);
+        QVERIFY(std::find(played.begin(), played.end(), 19) != played.end());
+        QCOMPARE(buffer.BufferedFrames(), 0);
+    }
+
+    void MumbleAudio::MixerVectorized_data()
+    {
+        QTest::addColumn<int>("samples");
+        QTest::newRow("1 sample") << 1;
+        QTest::newRow("7 samples") << 7;
+        QTest::newRow("13 samples") << 13;
+        QTest::newRow("479 samples") << 479;
+        QTest::newRow("480 samples") << 480;
+    }
+
+    void MumbleAudio::MixerVectorized()
+    {
+        QFETCH(int, samples);
+
+        // The gains are multiples of 1/8, so that many mixed samples fall halfway between two integers.
+        LCG rng(1234);
+        VoiceMixer vectorized(samples, true);
+        VoiceMixer scalar(samples, false);
+        for(int frame = 0; frame < 10; ++frame)
+        {
+            vectorized.Begin();
+            scalar.Begin();
+            for(int source = 0; source < 3; ++source)
+            {
+                const SoundBuffer input = RandomFrame(rng, samples);
+                const float gainLeft = rng.Int(0, 8) / 8.f;
+                const float gainRight = rng.Int(0, 8) / 8.f;
+                vectorized.Add(input, gainLeft, gainRight);
+                scalar.Add(input, gainLeft, gainRight);
+            }
+
+            SoundBuffer vectorizedStereo, vectorizedMono, scalarStereo, scalarMono;
+            vectorized.End(vectorizedStereo, &vectorizedMono);
+            scalar.End(scalarStereo, &scalarMono);
+            QCOMPARE(vectorizedStereo.data.size(), (size_t)samples * 2 * sizeof(s16));
+            QCOMPARE(vectorizedMono.data.size(), (size_t)samples * sizeof(s16));
+            QVERIFY(vectorizedStereo.data == scalarStereo.data);
+            QVERIFY(vectorizedMono.data == scalarMono.data);
+        }
+    }
+
+    void MumbleAudio::MixerClipping()
+    {
+        const int samples = 13;
+        VoiceMixer mixer(samples);
+        mixer.Begin();
+        QVERIFY(mixer.IsEmpty());
+        mixer.Add(ConstantFrame(samples, 30000), 1.f, -1.f);
+        mixer.Add(ConstantFrame(samples, 30000), 1.f, -1.f);
+        mixer.Add(ConstantFrame(samples, 1000), 0.5f, 0.f);
+        QVERIFY(!mixer.IsEmpty());
+
+        SoundBuffer stereo, mono;
+        mixer.End(stereo, &mono);
+        QVERIFY(stereo.stereo && stereo.is16Bit);
+        QVERIFY(!mono.stereo && mono.is16Bit);
+        for(int i = 0; i < samples; ++i)
+        {
+            QCOMPARE(Sample(stereo, i * 2), (s16)32767);
+            QCOMPARE(Sample(stereo, i * 2 + 1), (s16)-32768);
+            // The mono downmix is taken before clipping, so the opposite channels cancel out.
+            QCOMPARE(Sample(mono, i), (s16)250);
+        }
+
+        // The mix starts over from silence.
+        mixer.Begin();
+        mixer.Add(ConstantFrame(samples, -100), 1.f, 1.f);
+        mixer.End(stereo, 0);
+        for(int i = 0; i < samples * 2; ++i)
+            QCOMPARE(Sample(stereo, i), (s16)-100);
+    }
+
+    void MumbleAudio::RingWrapAround()
+    {
+        // The capacity is rounded up to four slots, of which one is kept free.
+        SpscRing<std::vector<int> > ring(3);
+        int pushed = 0;
+        int popped = 0;
+        for(int round = 0; round < 10; ++round)
+        {
+            // Fill the ring, alternating between Push and PushSlot.
+            for(;;)
+            {
+                std::vector<int> value(1, pushed);
+                if (pushed % 2)
+                {
+                    if (!ring.Push(value))
+                    {
+                        QCOMPARE(value.size(), (size_t)1); // Left untouched when full.
+                        QCOMPARE(value[0], pushed);
+                        break;
+                    }
+                }
+                else
+                {
+                    std::vector<int> *slot = ring.PushSlot();
+                    if (!slot)
+                        break;
+                    slot->assign(1, pushed);
+                    ring.CommitPush();
+                }
+                ++pushed;
+            }
+            QCOMPARE(ring.Size(), 3);
+
+            // Drain a varying number of values, so that the ring wraps around at different positions.
+            const int numPops = round % 3 + 1;
+            for(int i = 0; i < numPops; ++i)
+            {
+                if (i % 2)
+                {
+                    std::vector<int> value;
+                    QVERIFY(ring.Pop(value));
+                    QCOMPARE(value.size(), (size_t)1);
+                    QCOMPARE(value[0], popped);
+                }
+                else
+                {
+                    std::vector<int> *front = ring.Front();
+                    QVERIFY(front);
+                    QCOMPARE(front->size(), (size_t)1);
+                    QCOMPARE((*front)[0], popped);
+                    ring.CommitPop();
+                }
+                ++popped;
+            }
+            QCOMPARE(ring.Size(), 3 - numPops);
+        }
+        QVERIFY(pushed > 10);
+
+        std::vector<int> value;
+        while(ring.Pop(value))
+            QCOMPARE(value[0], popped++);
+        QCOMPARE(popped, pushed);
+        QVERIFY(ring.IsEmpty());
+        QVERIFY(!ring.Front());
+
+        ring.Push(value);
+        ring.Clear();
+        QVERIFY(ring.IsEmpty());
+        QCOMPARE(ring.Size(), 0);
+    }
+
+    void MumbleAudio::Benchmark_Loopback()
+    {
+        LoopbackPipeline pipeline(MUMBLE_AUDIO_FRAMES_PER_PACKET_BALANCED);
+
+        // Fill the jitter buffer up to its target first, after that each packet plays out in full.
+        for(int i = 0; i < 10; ++i)
+        {
+            pipeline.Send();
+            pipeline.Receive();
+        }
+        QVERIFY(pipeline.jitterBuffer.IsPlaying());
+        QVERIFY(pipeline.playedFrames > 0);
+        QVERIFY(pipeline.datagramSize > pipeline.framesPerPacket);
+
+        int playedBefore = pipeline.playedFrames;
+        int rounds = 0;
+        QBENCHMARK
+        {
+            pipeline.Send();
+            pipeline.Receive();
+            ++rounds;
+        }
+        QCOMPARE(pipeline.playedFrames - playedBefore, rounds * pipeline.framesPerPacket);
+
+        qDebug() << "Capture, encode and send:" << pipeline.captureToSend.ToString();
+        qDebug() << "Receive, decode and queue for playback:" << pipeline.receiveToQueue.ToString();
+    }
+}
+
+// QTest entry point
+QTEST_APPLESS_MAIN(TundraTest::MumbleAudio);
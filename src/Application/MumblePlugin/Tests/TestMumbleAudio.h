@@ -0,0 +1,29 @@
+
+#pragma once
+
+#include <QObject>
+
+namespace TundraTest
+{
+    /// Tests the receiving and mixing of voice in MumblePlugin without audio devices or a network.
+    /** Plays packets through VoiceJitterBuffer on a simulated clock, compares the SSE2 and the scalar code of
+        VoiceMixer, and checks that SpscRing keeps its order when it wraps around. Benchmark_Loopback measures
+        the processing time of the voice pipeline from capture to playback, using the CELT codec. */
+    class MumbleAudio : public QObject
+    {
+        Q_OBJECT
+
+    private slots:
+        void JitterBufferReordering();
+        void JitterBufferLoss();
+        void JitterBufferRestart();
+
+        void MixerVectorized_data();
+        void MixerVectorized();
+        void MixerClipping();
+
+        void RingWrapAround();
+
+        void Benchmark_Loopback();
+    };
+}
@@ -0,0 +1,258 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "VoiceJitterBuffer.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace MumbleAudio
+{
+    namespace
+    {
+        /// Duration of one frame.
+        const float cFrameMsecs = 10.f;
+        /// Bounds of the target delay.
+        const int cMinTargetFrames = 2;
+        const int cMaxTargetFrames = 30;
+        /// Hard limit of the buffer, the oldest frames are dropped beyond this.
+        const int cMaxBufferedFrames = 100;
+        /// How many times the smoothed jitter is added to the packet duration for the target delay.
+        const float cJitterDelayFactor = 2.5f;
+        /// Arrival time deviations above this are pauses in the talk, not jitter.
+        const float cMaxJitterSampleMsecs = 500.f;
+        /// Longest run of lost frames that is concealed. A longer hole is skipped over.
+        const int cMaxLossConcealFrames = 12;
+        /// Frames concealed when the buffer runs dry before the talk spurt is considered to have ended.
+        const int cMaxUnderrunConcealFrames = 3;
+        /// A sequence number this much behind the playback position means that the sender has restarted its count.
+        const uint cSeqRestartDistance = 100;
+    }
+
+    VoiceJitterBuffer::VoiceJitterBuffer() :
+        frameSlots(cMaxBufferedFrames + MumbleNetwork::MaxFramesInVoicePacket)
+    {
+        freeSlots.reserve(frameSlots.size());
+        packets.reserve(frameSlots.size());
+        Reset();
+    }
+
+    void VoiceJitterBuffer::Reset()
+    {
+        packets.clear();
+        freeSlots.clear();
+        for(int i = static_cast<int>(frameSlots.size()) - 1; i >= 0; --i)
+            freeSlots.push_back(i);
+        playPacket.numFrames = 0;
+        playPosition = 0;
+        bufferedFrames = 0;
+        targetFrames = cMinTargetFrames;
+        packetFrames = 1;
+        concealedFrames = 0;
+        playing = false;
+        hasNextSeq = false;
+        nextSeq = 0;
+        seqCountsFrames = false;
+        seqCountsPackets = false;
+        hasLastArrival = false;
+        lastSeq = 0;
+        lastFrames = 0;
+        lastArrival = 0;
+        jitterMsecs = 0.f;
+    }
+
+    void VoiceJitterBuffer::Put(uint seq, const MumbleNetwork::EncodedFrame *frames, int numFrames, tick_t arrivalTime)
+    {
+        numFrames = std::min(numFrames, static_cast<int>(MumbleNetwork::MaxFramesInVoicePacket));
+        if (numFrames <= 0)
+            return;
+
+        if (playing && hasNextSeq && seq < nextSeq)
+        {
+            // Either the sender has restarted its sequence, e.g. after changing its audio settings, or the packet
+            // arrived after its frames were already due, in which case they have been concealed.
+            if (nextSeq - seq < cSeqRestartDistance)
+                return;
+            Reset();
+        }
+        else if (hasLastArrival && seq < lastSeq && lastSeq - seq >= cSeqRestartDistance)
+        {
+            // The sender has restarted its sequence between talk spurts. Start over, as otherwise the jitter
+            // would not be measured again until the sequence got past the old one.
+            Reset();
+        }
+        // Packets mostly arrive in order, so search for the place from the newest one.
+        std::vector<BufferedPacket>::iterator pos = packets.end();
+        while(pos != packets.begin() && (pos - 1)->seq >= seq)
+            --pos;
+        if (pos != packets.end() && pos->seq == seq)
+            return;
+
+        UpdateJitter(seq, numFrames, arrivalTime);
+
+        // There are always enough free slots, as at most cMaxBufferedFrames frames are kept between the calls.
+        BufferedPacket packet;
+        packet.seq = seq;
+        packet.numFrames = numFrames;
+        for(int i = 0; i < numFrames; ++i)
+        {
+            packet.slotIndices[i] = freeSlots.back();
+            freeSlots.pop_back();
+            frameSlots[packet.slotIndices[i]] = frames[i];
+        }
+        packets.insert(pos, packet);
+        bufferedFrames += numFrames;
+        packetFrames = numFrames;
+
+        // Never buffer more than a second, drop the oldest audio.
+        while(bufferedFrames > cMaxBufferedFrames)
+        {
+            if (PlayQueueSize() > 0)
+            {
+                PopPlayFrame(0);
+                continue;
+            }
+            DropOldestPacket();
+            if (hasNextSeq && !packets.empty())
+            {
+                nextSeq = packets.front().seq;
+                concealedFrames = 0;
+            }
+        }
+    }
+
+    void VoiceJitterBuffer::UpdateJitter(uint seq, int numFrames, tick_t arrivalTime)
+    {
+        if (hasLastArrival && seq > lastSeq)
+        {
+            // A packet of several frames is followed by one with the next sequence number if the sender
+            // counts packets, and by one further by the number of frames if it counts frames. The latter
+            // also happens when a packet counting sender loses packets, so only the former is conclusive.
+            if (lastFrames > 1 && !seqCountsPackets)
+            {
+                if (seq == lastSeq + 1)
+                {
+                    seqCountsPackets = true;
+                    seqCountsFrames = false;
+                }
+                else if (seq == lastSeq + static_cast<uint>(lastFrames))
+                    seqCountsFrames = true;
+            }
+
+            uint seqDelta = seq - lastSeq;
+            float expectedMsecs = (seqCountsFrames ? seqDelta : seqDelta * lastFrames) * cFrameMsecs;
+            float arrivalMsecs = Clock::TimespanToMillisecondsF(lastArrival, arrivalTime);
+            float deviation = fabs(arrivalMsecs - expectedMsecs);
+            if (deviation < cMaxJitterSampleMsecs)
+                jitterMsecs += (deviation - jitterMsecs) / 16.f;
+        }
+        if (!hasLastArrival || seq > lastSeq)
+        {
+            hasLastArrival = true;
+            lastSeq = seq;
+            lastFrames = numFrames;
+            lastArrival = arrivalTime;
+        }
+
+        int target = numFrames + static_cast<int>(ceilf(cJitterDelayFactor * jitterMsecs / cFrameMsecs));
+        targetFrames = std::min(std::max(target, cMinTargetFrames), cMaxTargetFrames);
+    }
+
+    bool VoiceJitterBuffer::TakeNextPacket()
+    {
+        // Drop the packets that playback has already passed, e.g. when a hole was skipped over.
+        while(!packets.empty() && packets.front().seq < nextSeq)
+            DropOldestPacket();
+
+        if (packets.empty() || packets.front().seq != nextSeq)
+            return false;
+
+        // The play queue is empty when this is called, so it is replaced by the frames of the packet.
+        playPacket = packets.front();
+        playPosition = 0;
+        packets.erase(packets.begin());
+        nextSeq = NextSeq(nextSeq, playPacket.numFrames);
+        concealedFrames = 0;
+        return true;
+    }
+
+    void VoiceJitterBuffer::DropOldestPacket()
+    {
+        const BufferedPacket &oldest = packets.front();
+        for(int i = 0; i < oldest.numFrames; ++i)
+            freeSlots.push_back(oldest.slotIndices[i]);
+        bufferedFrames -= oldest.numFrames;
+        packets.erase(packets.begin());
+    }
+
+    void VoiceJitterBuffer::PopPlayFrame(MumbleNetwork::EncodedFrame *frame)
+    {
+        int slot = playPacket.slotIndices[playPosition++];
+        if (frame)
+            *frame = frameSlots[slot];
+        freeSlots.push_back(slot);
+        --bufferedFrames;
+    }
+
+    VoiceJitterBuffer::FrameResult VoiceJitterBuffer::GetFrame(MumbleNetwork::EncodedFrame &frame)
+    {
+        if (!playing)
+        {
+            // Start a talk spurt once there is enough audio to ride out the jitter.
+            if (packets.empty() || bufferedFrames < targetFrames)
+                return FrameNone;
+            playing = true;
+            hasNextSeq = true;
+            nextSeq = packets.front().seq;
+            concealedFrames = 0;
+        }
+
+        // Latency has built up, skip a frame to catch up.
+        if (bufferedFrames > targetFrames + std::max(2, targetFrames / 2))
+        {
+            if (PlayQueueSize() > 0 || TakeNextPacket())
+                PopPlayFrame(0);
+        }
+
+        if (PlayQueueSize() == 0 && !TakeNextPacket())
+        {
+            if (packets.empty())
+            {
+                // Ran dry: the talk spurt has ended or the next packet is late. Conceal a few frames
+                // for the latter case and then stop; the next packet will start a new spurt.
+                if (concealedFrames >= cMaxUnderrunConcealFrames)
+                {
+                    playing = false;
+                    hasNextSeq = false;
+                    concealedFrames = 0;
+                    return FrameNone;
+                }
+                ++concealedFrames;
+                return FrameLost;
+            }
+
+            // The next packet is missing but later ones have arrived. The frames concealed while the buffer ran dry
+            // count towards the hole, so a hole that has been concealed already is not concealed again.
+            uint seqGap = packets.front().seq - nextSeq;
+            int missingFrames = static_cast<int>(seqCountsFrames ? seqGap : seqGap * packetFrames) - concealedFrames;
+            if (missingFrames <= 0 || missingFrames > cMaxLossConcealFrames)
+            {
+                nextSeq = packets.front().seq;
+                TakeNextPacket();
+            }
+            else
+            {
+                ++concealedFrames;
+                const int framesPerSeq = seqCountsFrames ? 1 : packetFrames;
+                while(concealedFrames >= framesPerSeq)
+                {
+                    nextSeq = NextSeq(nextSeq, framesPerSeq);
+                    concealedFrames -= framesPerSeq;
+                }
+                return FrameLost;
+            }
+        }
+
+        PopPlayFrame(&frame);
+        return FrameData;
+    }
+}
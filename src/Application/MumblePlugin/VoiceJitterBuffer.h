@@ -0,0 +1,109 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "MumbleNetwork.h"
+#include "Time/Clock.h"
+
+#include <vector>
+
+/// @cond PRIVATE
+namespace MumbleAudio
+{
+    /// Reorders the encoded voice packets of one user and plays them out one frame at a time with an adaptive delay.
+    /** Packets are kept ordered by their sequence number. Playback of a talk spurt starts once the buffer holds
+        the target delay worth of frames, and the target follows the measured arrival jitter of the packets.
+        A frame that is missing when it is due to be played is reported as lost, so that it can be concealed
+        by the decoder, and packets that arrive after their turn are dropped. If the buffer grows well past the
+        target, e.g. after a burst of delayed packets, frames are skipped to bring the latency back down.
+
+        Tundra clients increment the sequence number once per packet, the Mumble client once per frame.
+        Both are handled: the step is detected from consecutive packets.
+
+        The frames are stored in slots allocated up front, so buffering and playback do not allocate memory.
+
+        Used only in the audio thread. */
+    class VoiceJitterBuffer
+    {
+    public:
+        VoiceJitterBuffer();
+
+        /// Result of GetFrame.
+        enum FrameResult
+        {
+            FrameNone, ///< Not playing, nothing to output.
+            FrameData, ///< A frame was returned.
+            FrameLost  ///< The frame is missing and should be concealed.
+        };
+
+        /// Adds a received packet.
+        /** @param arrivalTime Time the packet was received from the network. */
+        void Put(uint seq, const MumbleNetwork::EncodedFrame *frames, int numFrames, tick_t arrivalTime);
+
+        /// Returns the next frame to play, called once per frame duration of output.
+        FrameResult GetFrame(MumbleNetwork::EncodedFrame &frame);
+
+        /// Drops all buffered frames and the jitter statistics.
+        void Reset();
+
+        /// Returns true during a talk spurt, i.e. when GetFrame is returning frames.
+        bool IsPlaying() const { return playing; }
+
+        /// Returns the number of frames buffered.
+        int BufferedFrames() const { return bufferedFrames; }
+
+        /// Returns the current target delay in frames.
+        int TargetFrames() const { return targetFrames; }
+
+    private:
+        /// Returns the sequence number of the packet that follows a packet of numFrames frames.
+        uint NextSeq(uint seq, int numFrames) const { return seq + (seqCountsFrames ? numFrames : 1); }
+
+        /// Updates the jitter estimate and the target delay with the arrival of a packet.
+        void UpdateJitter(uint seq, int numFrames, tick_t arrivalTime);
+
+        /// Moves the frames of the next packet to the play queue. Returns false if it has not arrived.
+        bool TakeNextPacket();
+
+        /// Removes the oldest packet and releases its frames.
+        void DropOldestPacket();
+
+        /// Releases the next frame of the play queue, copying it to frame if given.
+        void PopPlayFrame(MumbleNetwork::EncodedFrame *frame);
+
+        /// Returns the number of frames left in the play queue.
+        int PlayQueueSize() const { return playPacket.numFrames - playPosition; }
+
+        /// A buffered packet. Its frames are in frameSlots.
+        struct BufferedPacket
+        {
+            uint seq;
+            int numFrames;
+            int slotIndices[MumbleNetwork::MaxFramesInVoicePacket];
+        };
+
+        std::vector<MumbleNetwork::EncodedFrame> frameSlots; ///< Storage of the buffered frames.
+        std::vector<int> freeSlots; ///< Indices of the unused frameSlots.
+        std::vector<BufferedPacket> packets; ///< Received packets that have not been played, ordered by sequence number.
+        BufferedPacket playPacket; ///< Packet being played, its frames from playPosition onwards form the play queue.
+        int playPosition;
+
+        int bufferedFrames; ///< Frames in packets and the play queue.
+        int targetFrames;
+        int packetFrames; ///< Number of frames in the latest packet.
+        int concealedFrames; ///< Frames concealed in place of the packet nextSeq.
+
+        bool playing;
+        bool hasNextSeq;
+        uint nextSeq; ///< Sequence number of the packet to play next.
+
+        bool seqCountsFrames; ///< True if the sender increments the sequence number per frame instead of per packet.
+        bool seqCountsPackets; ///< True once the sender has been seen to increment the sequence number per packet.
+        bool hasLastArrival;
+        uint lastSeq;
+        int lastFrames;
+        tick_t lastArrival;
+        float jitterMsecs; ///< Smoothed arrival jitter, as in RFC 3550.
+    };
+}
+/// @endcond
@@ -0,0 +1,50 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "VoiceLatencyMeter.h"
+
+#include <algorithm>
+
+namespace MumbleAudio
+{
+    VoiceLatencyMeter::VoiceLatencyMeter() :
+        averageUsecs(0),
+        maxUsecs(0),
+        count(0)
+    {
+    }
+
+    void VoiceLatencyMeter::Add(float msecs)
+    {
+        int usecs = static_cast<int>(std::min(std::max(msecs, 0.f), 1e6f) * 1000.f);
+
+        // The first measurements are averaged evenly, after that older ones fade out over some seconds of speech.
+        int n = count;
+        int average = averageUsecs;
+        average += (usecs - average) / std::min(n + 1, 64);
+
+        averageUsecs.fetchAndStoreRelease(average);
+        if (usecs > maxUsecs)
+            maxUsecs.fetchAndStoreRelease(usecs);
+        count.fetchAndAddRelease(1);
+    }
+
+    float VoiceLatencyMeter::AverageMsecs() const
+    {
+        return averageUsecs / 1000.f;
+    }
+
+    float VoiceLatencyMeter::MaxMsecs() const
+    {
+        return maxUsecs / 1000.f;
+    }
+
+    int VoiceLatencyMeter::Count() const
+    {
+        return count;
+    }
+
+    QString VoiceLatencyMeter::ToString() const
+    {
+        return QString("%1 ms (max %2 ms, %3 samples)").arg(AverageMsecs(), 0, 'f', 2).arg(MaxMsecs(), 0, 'f', 2).arg(Count());
+    }
+}
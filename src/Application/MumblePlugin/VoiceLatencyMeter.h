@@ -0,0 +1,44 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include <QAtomicInt>
+#include <QString>
+
+/// @cond PRIVATE
+namespace MumbleAudio
+{
+    /// Measures the latency of one stage of the voice pipeline.
+    /** The measurements are added in one thread and can be read in any thread without locks.
+        Together the stages give the end-to-end latency of the own voice in loopback mode:
+        capture to send in the audio thread, the round trip to the server in the network thread
+        and receive to queueing for playback in the main thread. The time the audio then waits
+        in the OpenAL queue of the voice channel is not measured. */
+    class VoiceLatencyMeter
+    {
+    public:
+        VoiceLatencyMeter();
+
+        /// Adds a measurement. Call only in the measuring thread.
+        void Add(float msecs);
+
+        /// Returns the smoothed latency.
+        float AverageMsecs() const;
+
+        /// Returns the highest latency measured.
+        float MaxMsecs() const;
+
+        /// Returns the number of measurements.
+        int Count() const;
+
+        /// Returns a summary for printing, e.g. "12.30 ms (max 40.10 ms, 250 samples)".
+        QString ToString() const;
+
+    private:
+        // Microseconds, so that the values fit in atomic integers.
+        QAtomicInt averageUsecs;
+        QAtomicInt maxUsecs;
+        QAtomicInt count;
+    };
+}
+/// @endcond
@@ -0,0 +1,159 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "VoiceMixer.h"
+#include "MumbleDefines.h"
+#include "SoundBuffer.h"
+
+#include "Math/MathFunc.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MUMBLE_MIXER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace MumbleAudio
+{
+    namespace
+    {
+        /// Speakers are not panned fully to one side, so that they can be heard with both ears.
+        const float cMaxPan = 0.8f;
+
+        /// Converts a mixed sample to 16 bits in the same way as _mm_cvtps_epi32 and _mm_packs_epi32:
+        /// rounds to the nearest integer, halfway cases to even, and saturates.
+        s16 ToSample(float value)
+        {
+            float rounded = floor(value + 0.5f);
+            if (rounded - value == 0.5f && fmod(rounded, 2.f) != 0.f)
+                rounded -= 1.f;
+            return static_cast<s16>(Clamp(rounded, -32768.f, 32767.f));
+        }
+    }
+
+    VoiceMixer::VoiceMixer(int samplesPerFrame_, bool vectorized_) :
+        samplesPerFrame(samplesPerFrame_),
+        numSources(0),
+        vectorized(vectorized_),
+        mix(samplesPerFrame_ * 2, 0.f)
+    {
+    }
+
+    void VoiceMixer::Begin()
+    {
+        std::fill(mix.begin(), mix.end(), 0.f);
+        numSources = 0;
+    }
+
+    void VoiceMixer::Add(const SoundBuffer &frame, float gainLeft, float gainRight)
+    {
+        if (frame.data.size() < static_cast<size_t>(samplesPerFrame) * sizeof(s16))
+            return;
+
+        const s16 *in = reinterpret_cast<const s16*>(&frame.data[0]);
+        float *out = &mix[0];
+        int i = 0;
+
+#ifdef MUMBLE_MIXER_SSE2
+        const __m128 left = _mm_set1_ps(gainLeft);
+        const __m128 right = _mm_set1_ps(gainRight);
+        for(; vectorized && i + 8 <= samplesPerFrame; i += 8)
+        {
+            // Sign-extend eight samples to two vectors of 32-bit ints.
+            __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+            __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16));
+
+            // Scale to left and right and interleave.
+            __m128 loL = _mm_mul_ps(lo, left), loR = _mm_mul_ps(lo, right);
+            __m128 hiL = _mm_mul_ps(hi, left), hiR = _mm_mul_ps(hi, right);
+            float *dst = out + i * 2;
+            _mm_storeu_ps(dst, _mm_add_ps(_mm_loadu_ps(dst), _mm_unpacklo_ps(loL, loR)));
+            _mm_storeu_ps(dst + 4, _mm_add_ps(_mm_loadu_ps(dst + 4), _mm_unpackhi_ps(loL, loR)));
+            _mm_storeu_ps(dst + 8, _mm_add_ps(_mm_loadu_ps(dst + 8), _mm_unpacklo_ps(hiL, hiR)));
+            _mm_storeu_ps(dst + 12, _mm_add_ps(_mm_loadu_ps(dst + 12), _mm_unpackhi_ps(hiL, hiR)));
+        }
+#endif
+        for(; i < samplesPerFrame; ++i)
+        {
+            float sample = static_cast<float>(in[i]);
+            out[i * 2] += sample * gainLeft;
+            out[i * 2 + 1] += sample * gainRight;
+        }
+        ++numSources;
+    }
+
+    void VoiceMixer::End(SoundBuffer &stereoOut, SoundBuffer *monoOut)
+    {
+        stereoOut.data.resize(samplesPerFrame * 2 * sizeof(s16));
+        stereoOut.frequency = MUMBLE_AUDIO_SAMPLE_RATE;
+        stereoOut.is16Bit = true;
+        stereoOut.stereo = true;
+        s16 *stereo = reinterpret_cast<s16*>(&stereoOut.data[0]);
+
+        s16 *mono = 0;
+        if (monoOut)
+        {
+            monoOut->data.resize(samplesPerFrame * sizeof(s16));
+            monoOut->frequency = MUMBLE_AUDIO_SAMPLE_RATE;
+            monoOut->is16Bit = true;
+            monoOut->stereo = false;
+            mono = reinterpret_cast<s16*>(&monoOut->data[0]);
+        }
+
+        const float *in = &mix[0];
+        int i = 0;
+
+#ifdef MUMBLE_MIXER_SSE2
+        // Four stereo samples per iteration. cvtps rounds to nearest and packs saturates to the 16-bit range.
+        const __m128 half = _mm_set1_ps(0.5f);
+        for(; vectorized && i + 4 <= samplesPerFrame; i += 4)
+        {
+            __m128 a = _mm_loadu_ps(in + i * 2);
+            __m128 b = _mm_loadu_ps(in + i * 2 + 4);
+            __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(stereo + i * 2), packed);
+            if (mono)
+            {
+                __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+                __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+                __m128i m = _mm_cvtps_epi32(_mm_mul_ps(_mm_add_ps(left, right), half));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(mono + i), _mm_packs_epi32(m, m));
+            }
+        }
+#endif
+        for(; i < samplesPerFrame; ++i)
+        {
+            stereo[i * 2] = ToSample(in[i * 2]);
+            stereo[i * 2 + 1] = ToSample(in[i * 2 + 1]);
+            if (mono)
+                mono[i] = ToSample((in[i * 2] + in[i * 2 + 1]) * 0.5f);
+        }
+    }
+
+    void VoiceMixer::PositionalGains(const float3 &listenerPos, const Quat &listenerOrientation, const float3 &speakerPos,
+        float innerRange, float outerRange, float &gainLeft, float &gainRight)
+    {
+        float3 toSpeaker = speakerPos - listenerPos;
+        float distance = toSpeaker.Length();
+
+        // Same linear roll-off as SoundChannel::CalculateAttenuation with a roll-off factor of 1.
+        float attenuation = 1.f;
+        if (outerRange > 0.f && outerRange > innerRange)
+        {
+            if (distance >= outerRange)
+                attenuation = 0.f;
+            else if (distance > innerRange)
+                attenuation = 1.f - (distance - innerRange) / (outerRange - innerRange);
+        }
+
+        // Constant power panning, scaled so that a speaker straight ahead is played at full gain in both channels.
+        float pan = 0.f;
+        if (distance > 1e-3f)
+            pan = Clamp(Dot(toSpeaker / distance, listenerOrientation.WorldX()), -cMaxPan, cMaxPan);
+        float angle = (pan + 1.f) * pi / 4.f;
+        gainLeft = attenuation * Min(1.f, Sqrt(2.f) * Cos(angle));
+        gainRight = attenuation * Min(1.f, Sqrt(2.f) * Sin(angle));
+    }
+}
@@ -0,0 +1,54 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "Math/float3.h"
+#include "Math/Quat.h"
+
+#include <vector>
+
+class SoundBuffer;
+
+/// @cond PRIVATE
+namespace MumbleAudio
+{
+    /// Mixes the mono voice frames of any number of speakers to one stereo frame.
+    /** Positional speakers are attenuated by their distance to the listener, in the same way as
+        SoundChannel attenuates positional sounds, and panned between the left and right channel
+        by their direction from the listener. The accumulation and the conversion back to 16-bit
+        samples use SSE2 on x86 targets, and give the same result as the scalar code. */
+    class VoiceMixer
+    {
+    public:
+        /// @param vectorized If false, SSE2 is not used even where available, e.g. to compare the results in tests.
+        explicit VoiceMixer(int samplesPerFrame, bool vectorized = true);
+
+        /// Clears the mix for a new frame.
+        void Begin();
+
+        /// Adds a mono 16-bit frame of samplesPerFrame samples to the mix.
+        void Add(const SoundBuffer &frame, float gainLeft, float gainRight);
+
+        /// Returns true if no frame has been added since Begin.
+        bool IsEmpty() const { return numSources == 0; }
+
+        /// Writes the mix as interleaved 16-bit stereo, clamping it to the range of the samples.
+        /** @param monoOut If not null, receives the mix downmixed to mono, e.g. for echo cancellation. */
+        void End(SoundBuffer &stereoOut, SoundBuffer *monoOut);
+
+        /// Computes the gains of a positional speaker.
+        /** The listener looks towards -Z and has +X on its right, as cameras in Tundra.
+            @param innerRange Within this distance the speaker is played at full gain.
+            @param outerRange Beyond this distance the speaker is silent. If 0, there is no attenuation. */
+        static void PositionalGains(const float3 &listenerPos, const Quat &listenerOrientation, const float3 &speakerPos,
+            float innerRange, float outerRange, float &gainLeft, float &gainRight);
+
+    private:
+        int samplesPerFrame;
+        int numSources;
+        bool vectorized;
+        std::vector<float> mix; ///< Interleaved left and right, two floats per sample.
+    };
+}
+/// @endcond
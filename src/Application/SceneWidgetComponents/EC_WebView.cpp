@@ -406,6 +406,18 @@ void EC_WebView::RenderDelayed()
         QTimer::singleShot(10, this, SLOT(Render()));
 }
 
+void EC_WebView::PageRepaintRequested(const QRect &rect)
+{
+    EC_WidgetCanvas *sceneCanvas = GetSceneCanvasComponent();
+    if (sceneCanvas && webview_ && sceneCanvas->GetWidget() == webview_)
+        sceneCanvas->Invalidate(rect);
+}
+
+void EC_WebView::PageScrollRequested(int /*dx*/, int /*dy*/, const QRect &rectToScroll)
+{
+    PageRepaintRequested(rectToScroll);
+}
+
 void EC_WebView::RenderWindowResized()
 {
     if (!resizeRenderTimer_)
@@ -516,6 +528,8 @@ void EC_WebView::PrepareWebview()
     connect(webview_, SIGNAL(linkClicked(const QUrl&)), this, SLOT(LoadRequested(const QUrl&)), Qt::UniqueConnection);
     connect(webview_, SIGNAL(loadStarted()), this, SLOT(LoadStarted()), Qt::UniqueConnection);
     connect(webview_, SIGNAL(loadFinished(bool)), this, SLOT(LoadFinished(bool)), Qt::UniqueConnection);
+    connect(webview_->page(), SIGNAL(repaintRequested(const QRect&)), this, SLOT(PageRepaintRequested(const QRect&)), Qt::UniqueConnection);
+    connect(webview_->page(), SIGNAL(scrollRequested(int, int, const QRect&)), this, SLOT(PageScrollRequested(int, int, const QRect&)), Qt::UniqueConnection);
 
     /// @todo Use shared access manager from SceneWidgetComponent module?
     QNetworkAccessManager *networkAccess = webview_->page()->networkAccessManager();
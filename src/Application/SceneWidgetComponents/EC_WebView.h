@@ -18,6 +18,7 @@
 
 class QWebView;
 class QNetworkReply;
+class QRect;
 
 class EC_Mesh;
 class EC_WidgetCanvas;
@@ -184,6 +185,12 @@ private slots:
     /// Handler for window resize signal.
     void RenderWindowResized();
 
+    /// Reports the changed parts of the hidden QWebView to EC_WidgetCanvas, as it gets no paint events.
+    void PageRepaintRequested(const QRect &rect);
+
+    /// Reports the scrolled part of the hidden QWebView to EC_WidgetCanvas.
+    void PageScrollRequested(int dx, int dy, const QRect &rectToScroll);
+
     /// Prepares everything related to the parent widget and other needed components.
     void PrepareComponent();
 
@@ -13,6 +13,11 @@
 #include "OgreMaterialUtils.h"
 #include "EC_Mesh.h"
 #include "EC_OgreCustomObject.h"
+#include "EC_Camera.h"
+#include "EC_Placeable.h"
+#include "Geometry/AABB.h"
+#include "Geometry/Frustum.h"
+#include "Math/MathFunc.h"
 
 #include <OgreTextureManager.h>
 #include <OgreMaterialManager.h>
@@ -22,6 +27,7 @@
 #include <QTimer>
 #include <QWidget>
 #include <QPainter>
+#include <QPaintEvent>
 #include <QDebug>
 
 #if defined(DIRECTX_ENABLED) && defined(WIN32)
@@ -38,6 +44,19 @@
 
 #include "MemoryLeakCheck.h"
 
+namespace
+{
+    /// Up to this distance from the camera the canvas is updated at the full refresh rate.
+    const float cFullRateDistance = 10.f;
+    /// At this distance and beyond the canvas is updated only once per cMaxThrottleMsec.
+    const float cMinRateDistance = 100.f;
+    const int cMaxThrottleMsec = 1000;
+    /// How often an out of view canvas with pending changes checks if it has come into view.
+    const int cHiddenRetryMsec = 500;
+    /// Beyond this many changed rectangles their bounding rectangle is rendered and uploaded instead.
+    const int cMaxDirtyRects = 8;
+}
+
 EC_WidgetCanvas::EC_WidgetCanvas(Scene *scene) :
     IComponent(scene),
     widget_(0),
@@ -46,7 +65,10 @@ EC_WidgetCanvas::EC_WidgetCanvas(Scene *scene) :
     refresh_timer_(0),
     update_interval_msec_(0),
     material_name_(""),
-    texture_name_("")
+    texture_name_(""),
+    invalidate_reported_(false),
+    rendering_(false),
+    update_scheduled_(false)
 {
     connect(this, SIGNAL(ParentEntitySet()), SLOT(Initialize()));
     connect(this, SIGNAL(ParentEntitySet()), SLOT(OnParentEntitySet()));
@@ -154,10 +176,47 @@ void EC_WidgetCanvas::SetWidget(QWidget *widget)
 
     if (widget_ != widget)
     {
+        if (widget_)
+            widget_->removeEventFilter(this);
         widget_ = widget;
         if (widget_)
+        {
             connect(widget_, SIGNAL(destroyed(QObject*)), SLOT(WidgetDestroyed(QObject *)), Qt::UniqueConnection);
+            widget_->installEventFilter(this);
+        }
+        invalidate_reported_ = false;
+        InvalidateAll();
+    }
+}
+
+void EC_WidgetCanvas::Invalidate(const QRect &rect)
+{
+    if (framework->IsHeadless())
+        return;
+
+    invalidate_reported_ = true;
+    dirty_region_ += rect;
+}
+
+void EC_WidgetCanvas::InvalidateAll()
+{
+    if (framework->IsHeadless())
+        return;
+
+    if (widget_)
+        dirty_region_ = widget_->rect();
+}
+
+bool EC_WidgetCanvas::eventFilter(QObject *obj, QEvent *e)
+{
+    if (obj == widget_.data() && !rendering_)
+    {
+        if (e->type() == QEvent::Paint)
+            dirty_region_ += static_cast<QPaintEvent*>(e)->region();
+        else if (e->type() == QEvent::Resize)
+            InvalidateAll();
     }
+    return false;
 }
 
 void EC_WidgetCanvas::SetRefreshRate(int refresh_per_second)
@@ -227,15 +286,24 @@ void EC_WidgetCanvas::Update(QImage buffer)
     if (buffer.width() <= 0 || buffer.height() <= 0)
         return;
 
-    if (buffer.format() != QImage::Format_ARGB32 && buffer.format() != QImage::Format_ARGB32_Premultiplied)
+    // RGB32 has the same memory layout as ARGB32, with the alpha always 0xff.
+    if (buffer.format() != QImage::Format_ARGB32 && buffer.format() != QImage::Format_ARGB32_Premultiplied &&
+        buffer.format() != QImage::Format_RGB32)
     {
-        LogWarning("EC_WidgetCanvas::Update(QImage buffer): Input format needs to be Format_ARGB32 or Format_ARGB32_Premultiplied, preforming auto conversion!");
-        buffer = buffer.convertToFormat(QImage::Format_ARGB32);
-        if (buffer.isNull())
+        LogWarning("EC_WidgetCanvas::Update(QImage buffer): Input format needs to be Format_ARGB32, Format_ARGB32_Premultiplied or Format_RGB32, preforming auto conversion!");
+        // Draw to a reused image instead of allocating a converted copy every time.
+        if (convert_buffer_.size() != buffer.size())
+            convert_buffer_ = QImage(buffer.size(), QImage::Format_ARGB32);
+        if (convert_buffer_.isNull())
         {
             LogError("-- Auto conversion failed, not updating!");
             return;
         }
+        QPainter painter(&convert_buffer_);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.drawImage(0, 0, buffer);
+        painter.end();
+        buffer = convert_buffer_;
     }
 
     try
@@ -256,14 +324,7 @@ void EC_WidgetCanvas::Update(QImage buffer)
             update_internals_ = false;
         }
 
-        if ((int)texture->getWidth() != buffer.width() || (int)texture->getHeight() != buffer.height())
-        {
-            texture->freeInternalResources();
-            texture->setWidth(buffer.width());
-            texture->setHeight(buffer.height());
-            texture->createInternalResources();
-        }
-
+        ResizeTexture(texture, buffer.size());
         Blit(buffer, texture);
     }
     catch (Ogre::Exception &e) // inherits std::exception
@@ -286,20 +347,35 @@ void EC_WidgetCanvas::Update()
     if (widget_->width() <= 0 || widget_->height() <= 0)
         return;
 
+    // Keep the changes for later if the canvas is out of view or was rendered too recently for its distance.
+    int throttleMsec = ThrottleIntervalMsec();
+    if (throttleMsec < 0)
+    {
+        if (!dirty_region_.isEmpty() || update_internals_ || (!widget_->isVisible() && !invalidate_reported_))
+            ScheduleUpdate(cHiddenRetryMsec);
+        return;
+    }
+    if (throttleMsec > 0 && last_render_.isValid() && last_render_.elapsed() < throttleMsec)
+    {
+        ScheduleUpdate(throttleMsec - last_render_.elapsed());
+        return;
+    }
+
     try
     {
         Ogre::TexturePtr texture = Ogre::TextureManager::getSingleton().getByName(texture_name_);
         if (texture.isNull())
             return;
 
+        bool fullUpdate = false;
         if (buffer_.size() != widget_->size())
+        {
             buffer_ = QImage(widget_->size(), QImage::Format_ARGB32_Premultiplied);
+            fullUpdate = true;
+        }
         if (buffer_.width() <= 0 || buffer_.height() <= 0)
             return;
 
-        QPainter painter(&buffer_);
-        widget_->render(&painter);
-
         // Set texture to material
         if (update_internals_ && !material_name_.empty())
         {
@@ -310,28 +386,112 @@ void EC_WidgetCanvas::Update()
             OgreRenderer::SetTextureUnitOnMaterial(material, texture_name_);
             UpdateSubmeshes();
             update_internals_ = false;
+            fullUpdate = true;
         }
 
-        if ((int)texture->getWidth() != buffer_.width() || (int)texture->getHeight() != buffer_.height())
+        if (ResizeTexture(texture, buffer_.size()))
+            fullUpdate = true;
+
+        // A hidden widget gets no paint events, so without reported changes it has to be rendered whole every time.
+        if (!widget_->isVisible() && !invalidate_reported_)
+            fullUpdate = true;
+
+        QRegion region = fullUpdate ? QRegion(buffer_.rect()) : (dirty_region_ & buffer_.rect());
+        dirty_region_ = QRegion();
+        if (region.isEmpty())
+            return;
+
+        QVector<QRect> rects = region.rects();
+        if (rects.size() > cMaxDirtyRects)
         {
-            texture->freeInternalResources();
-            texture->setWidth(buffer_.width());
-            texture->setHeight(buffer_.height());
-            texture->createInternalResources();
+            rects.clear();
+            rects.append(region.boundingRect());
         }
 
-        Blit(buffer_, texture);
+        rendering_ = true;
+        QPainter painter(&buffer_);
+        for(int i = 0; i < rects.size(); ++i)
+        {
+            // Clear first so that translucent parts of the widget are not drawn on top of their previous contents.
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            painter.fillRect(rects[i], Qt::transparent);
+            painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+            widget_->render(&painter, rects[i].topLeft(), QRegion(rects[i]));
+        }
+        painter.end();
+        rendering_ = false;
+
+        for(int i = 0; i < rects.size(); ++i)
+            Blit(buffer_, rects[i], texture);
+        last_render_.start();
     }
     catch (Ogre::Exception &e) // inherits std::exception
     {
+        rendering_ = false;
         LogError("Exception occurred while blitting texture data from memory: " + std::string(e.what()));
     }
     catch (...)
     {
+        rendering_ = false;
         LogError("Unknown exception occurred while blitting texture data from memory.");
     }
 }
 
+void EC_WidgetCanvas::ScheduleUpdate(int msec)
+{
+    // The refresh timer calls Update again anyway.
+    if (refresh_timer_ && refresh_timer_->isActive())
+        return;
+    if (update_scheduled_)
+        return;
+
+    update_scheduled_ = true;
+    QTimer::singleShot(msec, this, SLOT(ScheduledUpdate()));
+}
+
+void EC_WidgetCanvas::ScheduledUpdate()
+{
+    update_scheduled_ = false;
+    Update();
+}
+
+int EC_WidgetCanvas::ThrottleIntervalMsec() const
+{
+    Entity *entity = ParentEntity();
+    EC_Mesh *mesh = entity ? entity->GetComponent<EC_Mesh>().get() : 0;
+    EC_Camera *camera = framework->Renderer() ? framework->Renderer()->MainCameraComponent() : 0;
+    if (!mesh || !camera || !camera->ParentEntity() || !camera->ParentEntity()->GetComponent<EC_Placeable>())
+        return 0;
+
+    AABB aabb = mesh->WorldAABB();
+    if (!aabb.IsFinite() || aabb.IsDegenerate())
+        return 0;
+
+    Frustum frustum = camera->ToFrustum();
+    if (frustum.type == InvalidFrustum)
+        return 0;
+    if (!frustum.Intersects(aabb))
+        return -1;
+
+    float distance = aabb.Distance(frustum.pos);
+    if (distance <= cFullRateDistance)
+        return 0;
+    float t = Min(1.f, (distance - cFullRateDistance) / (cMinRateDistance - cFullRateDistance));
+    return (int)(t * cMaxThrottleMsec);
+}
+
+bool EC_WidgetCanvas::ResizeTexture(Ogre::TexturePtr texture, const QSize &size)
+{
+    if ((int)texture->getWidth() == size.width() && (int)texture->getHeight() == size.height())
+        return false;
+
+    texture->freeInternalResources();
+    texture->setWidth(size.width());
+    texture->setHeight(size.height());
+    texture->createInternalResources();
+    return true;
+}
+
 void EC_WidgetCanvas::Initialize()
 {
     if (framework->IsHeadless())
@@ -368,6 +528,15 @@ void EC_WidgetCanvas::Initialize()
 
 bool EC_WidgetCanvas::Blit(const QImage &source, Ogre::TexturePtr destination)
 {
+    return Blit(source, source.rect(), destination);
+}
+
+bool EC_WidgetCanvas::Blit(const QImage &source, const QRect &rect, Ogre::TexturePtr destination)
+{
+    QRect r = rect & source.rect();
+    if (r.isEmpty())
+        return false;
+
 #if defined(DIRECTX_ENABLED) && defined(WIN32)
     Ogre::HardwarePixelBufferSharedPtr pb = destination->getBuffer();
     Ogre::D3D9HardwarePixelBuffer *pixelBuffer = dynamic_cast<Ogre::D3D9HardwarePixelBuffer*>(pb.get());
@@ -381,17 +550,20 @@ bool EC_WidgetCanvas::Blit(const QImage &source, Ogre::TexturePtr destination)
         HRESULT hr = surface->GetDesc(&desc);
         if (SUCCEEDED(hr))
         {
+            RECT lockRect = { r.left(), r.top(), r.right() + 1, r.bottom() + 1 };
             D3DLOCKED_RECT lock;
-            HRESULT hr = surface->LockRect(&lock, 0, 0);
+            HRESULT hr = surface->LockRect(&lock, &lockRect, 0);
             if (SUCCEEDED(hr))
             {
                 const int bytesPerPixel = 4; ///\todo Count from Ogre::PixelFormat!
-                const int sourceStride = bytesPerPixel * source.width();
-                if (lock.Pitch == sourceStride)
-                    memcpy(lock.pBits, source.bits(), sourceStride * source.height());
+                const int sourceStride = source.bytesPerLine();
+                const int rowBytes = bytesPerPixel * r.width();
+                const uchar *sourceBits = source.bits() + sourceStride * r.top() + bytesPerPixel * r.left();
+                if (lock.Pitch == sourceStride && rowBytes == sourceStride)
+                    memcpy(lock.pBits, sourceBits, sourceStride * r.height());
                 else
-                    for(int y = 0; y < source.height(); ++y)
-                        memcpy((u8*)lock.pBits + lock.Pitch * y, source.bits() + sourceStride * y, sourceStride);
+                    for(int y = 0; y < r.height(); ++y)
+                        memcpy((u8*)lock.pBits + lock.Pitch * y, sourceBits + sourceStride * y, rowBytes);
                 surface->UnlockRect();
             }
         }
@@ -399,9 +571,11 @@ bool EC_WidgetCanvas::Blit(const QImage &source, Ogre::TexturePtr destination)
 #else
     if (!destination->getBuffer().isNull())
     {
-        Ogre::Box update_box(0, 0, source.width(), source.height());
-        Ogre::PixelBox pixel_box(update_box, Ogre::PF_A8R8G8B8, (void*)source.bits());
-        destination->getBuffer()->blitFromMemory(pixel_box, update_box);
+        Ogre::PixelBox image_box(source.width(), source.height(), 1, Ogre::PF_A8R8G8B8, (void*)source.bits());
+        image_box.rowPitch = source.bytesPerLine() / 4;
+        image_box.slicePitch = image_box.rowPitch * source.height();
+        Ogre::Box update_box(r.left(), r.top(), r.right() + 1, r.bottom() + 1);
+        destination->getBuffer()->blitFromMemory(image_box.getSubVolume(update_box), update_box);
     }
 #endif
 
@@ -10,6 +10,8 @@
 #include <QPointer>
 #include <QWidget>
 #include <QString>
+#include <QRegion>
+#include <QTime>
 
 #include <OgreTexture.h>
 
@@ -30,6 +32,11 @@ they need QWidget painting done to a 3D object.
 Paints UI widgets on to a 3D object surface via EC_Mesh and a submesh index.
 So a EC_Mesh needs to be present on the entity this component is used.
 
+Only the parts of the widget that have changed since the previous update are rendered and uploaded
+to the texture. Changes are tracked from the paint events of the widget, and can be reported with
+Invalidate for widgets that are not painted on screen. Updates are skipped while the mesh is outside
+the view of the main camera and done less often the further away it is.
+
 Registered by SceneWidgetComponents plugin.
 
 <b>No Attributes</b>
@@ -40,6 +47,8 @@ Registered by SceneWidgetComponents plugin.
 <li>"Update":
 <li>"Setup":
 <li>"SetWidget":
+<li>"Invalidate": @copydoc Invalidate
+<li>"InvalidateAll": @copydoc InvalidateAll
 <li>"SetRefreshRate":
 <li>"SetSubmesh":
 <li>"SetSubmeshes":
@@ -82,6 +91,13 @@ public slots:
     void SetSubmeshes(const QList<uint> &submeshes);
     void SetSelfIllumination(bool illuminating);
 
+    /// Marks a rectangle of the widget as changed, so that the next Update renders and uploads it.
+    /** Paint events of a widget that is shown are tracked automatically. Widgets that are not shown
+        do not get paint events, so their changes need to be reported with this. */
+    void Invalidate(const QRect &rect);
+    /// Marks the whole widget as changed.
+    void InvalidateAll();
+
     QWidget *GetWidget() const { return widget_; }
     int GetRefreshRate() const { return update_interval_msec_; }
     QList<uint> GetSubMeshes() const { return submeshes_; }
@@ -92,6 +108,7 @@ public slots:
 private slots:
     void Initialize();
     bool Blit(const QImage &source, Ogre::TexturePtr destination);
+    bool Blit(const QImage &source, const QRect &rect, Ogre::TexturePtr destination);
     void WidgetDestroyed(QObject *obj);
     void MeshMaterialsUpdated(uint index, const QString &material_name);
 
@@ -101,7 +118,21 @@ private slots:
     /// Monitors this entitys removed components.
     void ComponentRemoved(IComponent *component, AttributeChange::Type change);
 
+    /// Runs an Update that was postponed by ScheduleUpdate.
+    void ScheduledUpdate();
+
+protected:
+    /// QObject override. Tracks the paint and resize events of the widget.
+    bool eventFilter(QObject *obj, QEvent *e);
+
 private:
+    /// Returns the minimum time between renders for the current distance of the mesh to the main camera, or -1 if the mesh is not in view.
+    int ThrottleIntervalMsec() const;
+    /// Postpones Update by msec, unless the refresh timer is going to call it anyway.
+    void ScheduleUpdate(int msec);
+    /// Resizes the texture to size if needed. Returns true if it was resized.
+    bool ResizeTexture(Ogre::TexturePtr texture, const QSize &size);
+
     QPointer<QWidget> widget_;
     QList<uint> submeshes_;
     QTimer *refresh_timer_;
@@ -114,6 +145,13 @@ private:
     bool update_internals_;
 
     QImage buffer_;
+    QImage convert_buffer_;
     bool mesh_hooked_;
+
+    QRegion dirty_region_; ///< Changed parts of the widget that have not been rendered yet.
+    bool invalidate_reported_; ///< True once Invalidate has been called, after which dirty_region_ is trusted also for a hidden widget.
+    bool rendering_; ///< True while the widget renders into buffer_, the paint events of which are not changes.
+    bool update_scheduled_;
+    QTime last_render_;
 };
 COMPONENT_TYPEDEFS(WidgetCanvas);
@@ -0,0 +1,1015 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   SceneTreeModel.cpp
+    @brief  Item model of the scene structure shown in SceneTreeWidget. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "SceneTreeModel.h"
+
+#include "Framework.h"
+#include "FrameAPI.h"
+#include "Scene/Scene.h"
+#include "Entity.h"
+#include "EC_Name.h"
+#include "AssetReference.h"
+#include "Profiler.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <algorithm>
+
+#include "MemoryLeakCheck.h"
+
+/// Layout computed by SceneTreeLayoutJob. Shared by the model and the job.
+struct SceneTreeLayoutResult
+{
+    SceneTreeLayoutResult() : finished(false), canceled(false) {}
+
+    QMutex mutex;
+    bool finished; ///< Has the job finished, guarded by @c mutex.
+    bool canceled; ///< Has the model lost interest in the result, guarded by @c mutex.
+    SceneTreeLayout layout; ///< Valid when @c finished is set.
+};
+
+namespace
+{
+    /// Number of child rows created at a time when the view fetches more rows.
+    const int cFetchChunkSize = 1000;
+
+    typedef QHash<entity_id_t, SceneTreeRecord> SceneTreeRecordMap;
+
+    struct SortKey
+    {
+        SortKey(entity_id_t entityId, const SceneTreeRecord *rec) : id(entityId), record(rec) {}
+
+        entity_id_t id;
+        const SceneTreeRecord *record;
+    };
+
+    /// Orders the entities in ascending order by the given criteria. The ID is used as the tie-breaker.
+    struct SortKeyLess
+    {
+        explicit SortKeyLess(SceneStructureWindow::SortCriteria sortCriteria) : criteria(sortCriteria) {}
+
+        /// Replicated entities go after the local ones, and persistent entities after the temporary ones.
+        static int TypeRank(const SceneTreeRecord &r) { return (r.local ? 0 : 2) + (r.temporary ? 0 : 1); }
+
+        bool operator()(const SortKey &lhs, const SortKey &rhs) const
+        {
+            if (criteria == SceneStructureWindow::SortByName)
+            {
+                const int result = QString::localeAwareCompare(lhs.record->name, rhs.record->name);
+                if (result != 0)
+                    return result < 0;
+            }
+            else if (criteria == SceneStructureWindow::SortByType)
+            {
+                const int lhsRank = TypeRank(*lhs.record);
+                const int rhsRank = TypeRank(*rhs.record);
+                if (lhsRank != rhsRank)
+                    return lhsRank < rhsRank;
+            }
+            return lhs.id < rhs.id;
+        }
+
+        SceneStructureWindow::SortCriteria criteria;
+    };
+
+    bool GroupNameLess(const QString &lhs, const QString &rhs)
+    {
+        return QString::localeAwareCompare(lhs, rhs) < 0;
+    }
+
+    /// Sorts, groups and filters the scene tree on a worker thread.
+    class SceneTreeLayoutJob : public QRunnable
+    {
+    public:
+        SceneTreeLayoutJob(const shared_ptr<SceneTreeLayoutResult> &layoutResult, const SceneTreeRecordMap &entityRecords,
+            SceneStructureWindow::SortCriteria sortCriteria, Qt::SortOrder order, bool groups, const QString &filterText) :
+            result(layoutResult),
+            records(entityRecords),
+            criteria(sortCriteria),
+            sortOrder(order),
+            showGroups(groups),
+            filter(filterText)
+        {
+        }
+
+        void run()
+        {
+            {
+                QMutexLocker lock(&result->mutex);
+                if (result->canceled)
+                    return;
+            }
+
+            SceneTreeLayout layout;
+            Compute(layout);
+
+            QMutexLocker lock(&result->mutex);
+            if (!result->canceled)
+                result->layout = layout;
+            result->finished = true;
+        }
+
+    private:
+        void Compute(SceneTreeLayout &layout)
+        {
+            std::vector<SortKey> keys;
+            keys.reserve(records.size());
+            for(SceneTreeRecordMap::const_iterator it = records.begin(); it != records.end(); ++it)
+                keys.push_back(SortKey(it.key(), &it.value()));
+            std::sort(keys.begin(), keys.end(), SortKeyLess(criteria));
+            if (sortOrder == Qt::DescendingOrder)
+                std::reverse(keys.begin(), keys.end());
+
+            // Distribute the entities to their parents, groups and the root, keeping the sorting order.
+            QStringList groupNames;
+            QVector<entity_id_t> rootEntities;
+            for(size_t i = 0; i < keys.size(); ++i)
+            {
+                const SceneTreeRecord &record = *keys[i].record;
+                if (record.parentId && records.contains(record.parentId))
+                    layout.children[record.parentId].append(keys[i].id);
+                else if (showGroups && !record.group.isEmpty())
+                {
+                    QHash<QString, QVector<entity_id_t> >::iterator group = layout.groups.find(record.group);
+                    if (group == layout.groups.end())
+                    {
+                        groupNames << record.group;
+                        group = layout.groups.insert(record.group, QVector<entity_id_t>());
+                    }
+                    group->append(keys[i].id);
+                }
+                else
+                    rootEntities.append(keys[i].id);
+            }
+            // Groups always go first in alphabetical order.
+            qSort(groupNames.begin(), groupNames.end(), GroupNameLess);
+
+            layout.filter = filter;
+            QString text = filter.trimmed();
+            const bool negation = (!text.isEmpty() && text[0] == '!');
+            if (negation)
+                text = text.mid(1);
+            layout.filtered = !text.isEmpty();
+
+            if (layout.filtered)
+            {
+                // Show the matching entities and their ancestors.
+                QSet<entity_id_t> ancestors;
+                for(size_t i = 0; i < keys.size(); ++i)
+                {
+                    const SceneTreeRecord &record = *keys[i].record;
+                    const bool match = record.name.contains(text, Qt::CaseInsensitive) || QString::number(keys[i].id).contains(text);
+                    if (match == negation)
+                        continue;
+                    layout.visible.insert(keys[i].id);
+                    for(entity_id_t parentId = record.parentId; parentId && !ancestors.contains(parentId);)
+                    {
+                        SceneTreeRecordMap::const_iterator parent = records.find(parentId);
+                        if (parent == records.end())
+                            break;
+                        ancestors.insert(parentId);
+                        parentId = parent->parentId;
+                    }
+                }
+                layout.visible.unite(ancestors);
+                if (!negation)
+                    layout.matchParents = ancestors;
+
+                // Show the groups that have visible entities, and all entities of the groups that match.
+                foreach(const QString &name, groupNames)
+                {
+                    const QVector<entity_id_t> &members = layout.groups[name];
+                    bool hasVisible = false;
+                    for(int i = 0; i < members.size() && !hasVisible; ++i)
+                        hasVisible = layout.visible.contains(members[i]);
+                    if (hasVisible && !negation)
+                        layout.matchGroups.insert(name);
+
+                    if (!negation && name.contains(text, Qt::CaseInsensitive))
+                    {
+                        for(int i = 0; i < members.size(); ++i)
+                            layout.visible.insert(members[i]);
+                        hasVisible = !members.isEmpty();
+                    }
+                    if (hasVisible)
+                        layout.roots.append(SceneTreeEntry(name));
+                }
+            }
+            else
+            {
+                foreach(const QString &name, groupNames)
+                    layout.roots.append(SceneTreeEntry(name));
+            }
+
+            layout.roots.reserve(layout.roots.size() + rootEntities.size());
+            for(int i = 0; i < rootEntities.size(); ++i)
+                if (!layout.filtered || layout.visible.contains(rootEntities[i]))
+                    layout.roots.append(SceneTreeEntry(rootEntities[i]));
+        }
+
+        shared_ptr<SceneTreeLayoutResult> result;
+        const SceneTreeRecordMap records; ///< Implicitly shared snapshot of the records of the model.
+        const SceneStructureWindow::SortCriteria criteria;
+        const Qt::SortOrder sortOrder;
+        const bool showGroups;
+        const QString filter;
+    };
+
+    /// Returns the item for the attribute @c attr and index @c index in @c items, or null if not found.
+    AttributeItem *FindAttributeItem(const QList<SceneTreeItem *> &items, IAttribute *attr, int index)
+    {
+        foreach(SceneTreeItem *item, items)
+            if (item->Type() == SceneTreeItem::AttributeType)
+            {
+                AttributeItem *aItem = static_cast<AttributeItem *>(item);
+                if (aItem->Attribute() == attr && aItem->index == index)
+                    return aItem;
+            }
+        return 0;
+    }
+
+    /// Returns @c eItem and its component items, the items that can have attribute items as children.
+    QList<SceneTreeItem *> AttributeParentItems(EntityItem *eItem)
+    {
+        QList<SceneTreeItem *> items;
+        items << eItem;
+        for(int i = 0; i < eItem->numFixedChildren; ++i)
+            if (eItem->children[i]->Type() == SceneTreeItem::ComponentType)
+                items << eItem->children[i];
+        return items;
+    }
+}
+
+bool SceneTreeRecord::operator ==(const SceneTreeRecord &rhs) const
+{
+    return parentId == rhs.parentId && local == rhs.local && temporary == rhs.temporary && name == rhs.name && group == rhs.group;
+}
+
+SceneTreeModel::SceneTreeModel(Framework *fw, QObject *parent) :
+    QAbstractItemModel(parent),
+    framework(fw),
+    root(new SceneTreeItem(SceneTreeItem::RootType, 0)),
+    sortingCriteria(SceneStructureWindow::SortByType),
+    sortOrder(Qt::DescendingOrder),
+    showGroups(true),
+    showComponents(true),
+    attributeVisibility(SceneStructureWindow::ShowAssetReferences),
+    layoutDirty(false),
+    contentDirty(false)
+{
+    root->populated = true;
+    connect(framework->Frame(), SIGNAL(Updated(float)), SLOT(ProcessChanges()));
+}
+
+SceneTreeModel::~SceneTreeModel()
+{
+    CancelLayoutJob();
+    QSet<SceneTreeItem *> items;
+    CollectItems(root, items);
+    qDeleteAll(items);
+    delete root;
+}
+
+void SceneTreeModel::SetScene(const ScenePtr &newScene)
+{
+    ScenePtr previous = scene.lock();
+    if (previous)
+        disconnect(previous.get(), 0, this, 0);
+
+    scene = newScene;
+    Reset();
+
+    if (!newScene)
+        return;
+
+    Scene *s = newScene.get();
+    connect(s, SIGNAL(EntityCreated(Entity *, AttributeChange::Type)), SLOT(OnEntityChanged(Entity *)));
+    connect(s, SIGNAL(EntityRemoved(Entity *, AttributeChange::Type)), SLOT(OnEntityChanged(Entity *)));
+    connect(s, SIGNAL(EntityTemporaryStateToggled(Entity *, AttributeChange::Type)), SLOT(OnEntityChanged(Entity *)));
+    connect(s, SIGNAL(EntityParentChanged(Entity *, Entity *, AttributeChange::Type)), SLOT(OnEntityChanged(Entity *)));
+    connect(s, SIGNAL(EntityAcked(Entity *, entity_id_t)), SLOT(OnEntityAcked(Entity *, entity_id_t)));
+    connect(s, SIGNAL(ComponentAdded(Entity *, IComponent *, AttributeChange::Type)), SLOT(OnComponentAddedOrRemoved(Entity *, IComponent *)));
+    connect(s, SIGNAL(ComponentRemoved(Entity *, IComponent *, AttributeChange::Type)), SLOT(OnComponentAddedOrRemoved(Entity *, IComponent *)));
+    connect(s, SIGNAL(AttributeChanged(IComponent *, IAttribute *, AttributeChange::Type)), SLOT(OnAttributeChanged(IComponent *)));
+    connect(s, SIGNAL(AttributeAdded(IComponent *, IAttribute *, AttributeChange::Type)), SLOT(OnAttributeAdded(IComponent *)));
+    connect(s, SIGNAL(AttributeRemoved(IComponent *, IAttribute *, AttributeChange::Type)), SLOT(OnAttributeRemoved(IComponent *, IAttribute *)));
+    connect(s, SIGNAL(SceneCleared(Scene *)), SLOT(OnSceneCleared()));
+
+    for(Scene::const_iterator it = s->begin(); it != s->end(); ++it)
+        UpdateRecord(s, it->first);
+    StartLayoutJob();
+}
+
+void SceneTreeModel::SortBy(SceneStructureWindow::SortCriteria criteria, Qt::SortOrder order)
+{
+    if (sortingCriteria == criteria && sortOrder == order)
+        return;
+    sortingCriteria = criteria;
+    sortOrder = order;
+    CancelLayoutJob();
+    layoutDirty = true;
+}
+
+void SceneTreeModel::SetShowGroups(bool show)
+{
+    if (showGroups == show)
+        return;
+    showGroups = show;
+    CancelLayoutJob();
+    layoutDirty = true;
+}
+
+void SceneTreeModel::SetShowComponents(bool show)
+{
+    if (showComponents == show)
+        return;
+    showComponents = show;
+    contentDirty = true;
+}
+
+void SceneTreeModel::SetAttributeVisibility(SceneStructureWindow::AttributeVisibilityType type)
+{
+    if (attributeVisibility == type)
+        return;
+    attributeVisibility = type;
+    contentDirty = true;
+}
+
+void SceneTreeModel::SetFilter(const QString &text)
+{
+    if (filter == text)
+        return;
+    filter = text;
+    CancelLayoutJob();
+    layoutDirty = true;
+}
+
+bool SceneTreeModel::IsFilterMatchParent(const QModelIndex &index) const
+{
+    SceneTreeItem *item = Item(index);
+    if (!item || !layout.filtered)
+        return false;
+    if (item->Type() == SceneTreeItem::GroupType)
+        return layout.matchGroups.contains(static_cast<EntityGroupItem *>(item)->GroupName());
+    if (item->Type() == SceneTreeItem::EntityType)
+        return layout.matchParents.contains(static_cast<EntityItem *>(item)->Id());
+    return false;
+}
+
+void SceneTreeModel::SetEntitySelected(entity_id_t id, bool selected)
+{
+    if (selected)
+        selectedEntities.insert(id);
+    else
+        selectedEntities.remove(id);
+
+    EntityItem *item = entityItems.value(id);
+    if (item && item->selected != selected)
+    {
+        item->selected = selected;
+        const QModelIndex index = IndexOf(item);
+        emit dataChanged(index, index);
+    }
+}
+
+void SceneTreeModel::ClearSelectedEntities()
+{
+    foreach(entity_id_t id, selectedEntities)
+        SetEntitySelected(id, false);
+}
+
+SceneTreeItem *SceneTreeModel::Item(const QModelIndex &index) const
+{
+    return (index.isValid() ? static_cast<SceneTreeItem *>(index.internalPointer()) : 0);
+}
+
+QModelIndex SceneTreeModel::IndexOf(SceneTreeItem *item) const
+{
+    return (item && item != root ? createIndex(item->row, 0, item) : QModelIndex());
+}
+
+QModelIndex SceneTreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    SceneTreeItem *parentItem = (parent.isValid() ? Item(parent) : root);
+    if (row < 0 || row >= parentItem->children.size() || column < 0 || column >= columnCount())
+        return QModelIndex();
+    return createIndex(row, column, parentItem->children[row]);
+}
+
+QModelIndex SceneTreeModel::parent(const QModelIndex &index) const
+{
+    SceneTreeItem *item = Item(index);
+    if (!item || !item->parent || item->parent == root)
+        return QModelIndex();
+    return createIndex(item->parent->row, 0, item->parent);
+}
+
+int SceneTreeModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return 0;
+    return (parent.isValid() ? Item(parent) : root)->children.size();
+}
+
+int SceneTreeModel::columnCount(const QModelIndex & /*parent*/) const
+{
+    return 2;
+}
+
+bool SceneTreeModel::hasChildren(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return false;
+    SceneTreeItem *item = (parent.isValid() ? Item(parent) : root);
+    if (item->populated)
+        return !item->children.isEmpty() || item->numFetchedEntries < item->entries.size();
+
+    switch(item->Type())
+    {
+    case SceneTreeItem::GroupType:
+        return true;
+    case SceneTreeItem::EntityType:
+    {
+        EntityPtr entity = static_cast<EntityItem *>(item)->Entity();
+        if (!entity)
+            return false;
+        if (layout.children.contains(entity->Id()))
+            return true;
+        const Entity::ComponentMap &components = entity->Components();
+        if (showComponents)
+            return !components.empty();
+        for(Entity::ComponentMap::const_iterator it = components.begin(); it != components.end(); ++it)
+            if (HasShownAttributes(it->second.get()))
+                return true;
+        return false;
+    }
+    case SceneTreeItem::ComponentType:
+    {
+        ComponentPtr comp = static_cast<ComponentItem *>(item)->Component();
+        return comp && HasShownAttributes(comp.get());
+    }
+    default:
+        return false;
+    }
+}
+
+bool SceneTreeModel::canFetchMore(const QModelIndex &parent) const
+{
+    SceneTreeItem *item = (parent.isValid() ? Item(parent) : root);
+    if (!item->populated)
+        return hasChildren(parent);
+    return item->numFetchedEntries < item->entries.size();
+}
+
+void SceneTreeModel::fetchMore(const QModelIndex &parent)
+{
+    PROFILE(SceneTreeModel_FetchMore)
+
+    SceneTreeItem *item = (parent.isValid() ? Item(parent) : root);
+    ScenePtr s = scene.lock();
+
+    QList<SceneTreeItem *> newItems;
+    if (!item->populated)
+    {
+        item->populated = true;
+        newItems = CreateFixedChildren(item, QList<SceneTreeItem *>());
+        item->numFixedChildren = newItems.size();
+        item->entries = Entries(item);
+        item->numFetchedEntries = 0;
+    }
+
+    for(int num = 0; item->numFetchedEntries < item->entries.size() && num < cFetchChunkSize;)
+    {
+        SceneTreeItem *child = ItemForEntry(s.get(), item->entries[item->numFetchedEntries++], item);
+        if (child)
+        {
+            newItems << child;
+            ++num;
+        }
+    }
+    if (newItems.isEmpty())
+        return;
+
+    const int first = item->children.size();
+    beginInsertRows(parent, first, first + newItems.size() - 1);
+    for(int i = 0; i < newItems.size(); ++i)
+    {
+        newItems[i]->parent = item;
+        newItems[i]->row = first + i;
+    }
+    item->children << newItems;
+    endInsertRows();
+}
+
+QVariant SceneTreeModel::data(const QModelIndex &index, int role) const
+{
+    SceneTreeItem *item = Item(index);
+    return (item ? item->Data(index.column(), role) : QVariant());
+}
+
+bool SceneTreeModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    SceneTreeItem *item = Item(index);
+    if (!item || role != Qt::EditRole || index.column() != 0 || item->Type() != SceneTreeItem::EntityType)
+        return false;
+
+    EntityPtr entity = static_cast<EntityItem *>(item)->Entity();
+    if (!entity)
+        return false;
+    const QString newName = value.toString();
+    if (newName != entity->Name())
+        emit EntityRenamed(entity.get(), newName);
+    return true;
+}
+
+QVariant SceneTreeModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole)
+        return (section == 0 ? tr("Entities") : QString());
+    return QVariant();
+}
+
+Qt::ItemFlags SceneTreeModel::flags(const QModelIndex &index) const
+{
+    SceneTreeItem *item = Item(index);
+    if (!item)
+        return Qt::ItemIsDropEnabled;
+    switch(item->Type())
+    {
+    case SceneTreeItem::EntityType:
+        return Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable | Qt::ItemIsDragEnabled | Qt::ItemIsDropEnabled;
+    case SceneTreeItem::GroupType:
+        return Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsDropEnabled;
+    default:
+        return Qt::ItemIsSelectable | Qt::ItemIsEnabled;
+    }
+}
+
+Qt::DropActions SceneTreeModel::supportedDropActions() const
+{
+    return Qt::CopyAction | Qt::MoveAction;
+}
+
+void SceneTreeModel::sort(int /*column*/, Qt::SortOrder order)
+{
+    SortBy(sortingCriteria, order);
+}
+
+void SceneTreeModel::OnEntityChanged(Entity *entity)
+{
+    dirtyEntities.insert(entity->Id());
+}
+
+void SceneTreeModel::OnEntityAcked(Entity *entity, entity_id_t oldId)
+{
+    const entity_id_t newId = entity->Id();
+    if (records.contains(oldId))
+        records.insert(newId, records.take(oldId));
+    if (selectedEntities.remove(oldId))
+        selectedEntities.insert(newId);
+
+    EntityItem *item = entityItems.take(oldId);
+    if (item)
+    {
+        item->Acked(entity->shared_from_this());
+        entityItems[newId] = item;
+    }
+
+    // The children refer to the parent by the old ID.
+    const EntityList children = entity->Children();
+    for(EntityList::const_iterator it = children.begin(); it != children.end(); ++it)
+        dirtyEntities.insert((*it)->Id());
+    dirtyEntities.insert(newId);
+    layoutDirty = true;
+}
+
+void SceneTreeModel::OnComponentAddedOrRemoved(Entity *entity, IComponent *comp)
+{
+    if (comp->TypeId() == EC_Name::ComponentTypeId)
+        dirtyEntities.insert(entity->Id());
+    EntityItem *item = entityItems.value(entity->Id());
+    if (item && item->populated)
+        contentDirty = true;
+}
+
+void SceneTreeModel::OnAttributeChanged(IComponent *comp)
+{
+    Entity *entity = comp->ParentEntity();
+    if (!entity)
+        return;
+    if (comp->TypeId() == EC_Name::ComponentTypeId)
+        dirtyEntities.insert(entity->Id());
+    EntityItem *item = entityItems.value(entity->Id());
+    if (item && item->populated)
+        touchedEntities.insert(entity->Id());
+}
+
+void SceneTreeModel::OnAttributeAdded(IComponent *comp)
+{
+    Entity *entity = comp->ParentEntity();
+    EntityItem *item = (entity ? entityItems.value(entity->Id()) : 0);
+    if (item && item->populated)
+        contentDirty = true;
+}
+
+void SceneTreeModel::OnAttributeRemoved(IComponent *comp, IAttribute *attr)
+{
+    Entity *entity = comp->ParentEntity();
+    EntityItem *item = (entity ? entityItems.value(entity->Id()) : 0);
+    if (!item || !item->populated)
+        return;
+
+    // The attribute is deleted before the items are recreated on the next frame, so forget it right away.
+    foreach(SceneTreeItem *parentItem, AttributeParentItems(item))
+        for(int i = 0; i < parentItem->numFixedChildren; ++i)
+            if (parentItem->children[i]->Type() == SceneTreeItem::AttributeType)
+            {
+                AttributeItem *aItem = static_cast<AttributeItem *>(parentItem->children[i]);
+                if (aItem->Attribute() == attr)
+                    aItem->Invalidate();
+            }
+    contentDirty = true;
+}
+
+void SceneTreeModel::OnComponentNameChanged()
+{
+    IComponent *comp = qobject_cast<IComponent *>(sender());
+    Entity *entity = (comp ? comp->ParentEntity() : 0);
+    if (entity && entityItems.contains(entity->Id()))
+        touchedEntities.insert(entity->Id());
+}
+
+void SceneTreeModel::OnSceneCleared()
+{
+    Reset();
+    ScenePtr s = scene.lock();
+    if (!s)
+        return;
+    for(Scene::const_iterator it = s->begin(); it != s->end(); ++it)
+        UpdateRecord(s.get(), it->first);
+    StartLayoutJob();
+}
+
+void SceneTreeModel::ProcessChanges()
+{
+    ScenePtr s = scene.lock();
+    if (!s)
+        return;
+
+    PROFILE(SceneTreeModel_ProcessChanges)
+
+    const bool layoutTaken = TakeLayout();
+
+    if (!dirtyEntities.isEmpty())
+    {
+        foreach(entity_id_t id, dirtyEntities)
+            if (UpdateRecord(s.get(), id))
+                layoutDirty = true;
+        dirtyEntities.clear();
+    }
+
+    // If a job is still running, the changes are picked up by the next one once it has finished.
+    if (layoutDirty && !pendingLayout)
+        StartLayoutJob();
+
+    if (layoutTaken || contentDirty)
+    {
+        contentDirty = false;
+        ApplyLayout();
+        touchedEntities.clear();
+    }
+    else if (!touchedEntities.isEmpty())
+        EmitTouchedItemsChanged();
+}
+
+void SceneTreeModel::Reset()
+{
+    CancelLayoutJob();
+
+    beginResetModel();
+    QSet<SceneTreeItem *> items;
+    CollectItems(root, items);
+    qDeleteAll(items);
+    root->children.clear();
+    root->entries.clear();
+    root->numFetchedEntries = 0;
+    entityItems.clear();
+    groupItems.clear();
+    records.clear();
+    layout = SceneTreeLayout();
+    endResetModel();
+
+    dirtyEntities.clear();
+    touchedEntities.clear();
+    layoutDirty = false;
+    contentDirty = false;
+}
+
+void SceneTreeModel::DeleteItem(SceneTreeItem *item)
+{
+    if (item->Type() == SceneTreeItem::EntityType)
+    {
+        EntityItem *eItem = static_cast<EntityItem *>(item);
+        QHash<entity_id_t, EntityItem *>::iterator it = entityItems.find(eItem->Id());
+        if (it != entityItems.end() && it.value() == eItem)
+            entityItems.erase(it);
+    }
+    else if (item->Type() == SceneTreeItem::GroupType)
+    {
+        EntityGroupItem *gItem = static_cast<EntityGroupItem *>(item);
+        QHash<QString, EntityGroupItem *>::iterator it = groupItems.find(gItem->GroupName());
+        if (it != groupItems.end() && it.value() == gItem)
+            groupItems.erase(it);
+    }
+    delete item;
+}
+
+void SceneTreeModel::CollectItems(SceneTreeItem *item, QSet<SceneTreeItem *> &items) const
+{
+    foreach(SceneTreeItem *child, item->children)
+    {
+        items.insert(child);
+        CollectItems(child, items);
+    }
+}
+
+bool SceneTreeModel::UpdateRecord(Scene *s, entity_id_t id)
+{
+    EntityPtr entity = s->EntityById(id);
+    if (!entity)
+        return records.remove(id) > 0;
+
+    SceneTreeRecord record;
+    EntityPtr parentEntity = entity->Parent();
+    record.parentId = (parentEntity ? parentEntity->Id() : 0);
+    record.name = entity->Name();
+    record.group = entity->Group().trimmed();
+    record.local = entity->IsLocal();
+    record.temporary = entity->IsTemporary();
+
+    QHash<entity_id_t, SceneTreeRecord>::iterator it = records.find(id);
+    if (it != records.end() && it.value() == record)
+        return false;
+    records.insert(id, record);
+    return true;
+}
+
+void SceneTreeModel::StartLayoutJob()
+{
+    layoutDirty = false;
+    pendingLayout = MAKE_SHARED(SceneTreeLayoutResult);
+    QThreadPool::globalInstance()->start(new SceneTreeLayoutJob(pendingLayout, records, sortingCriteria, sortOrder, showGroups, filter));
+}
+
+void SceneTreeModel::CancelLayoutJob()
+{
+    if (!pendingLayout)
+        return;
+    {
+        QMutexLocker lock(&pendingLayout->mutex);
+        pendingLayout->canceled = true;
+    }
+    pendingLayout.reset();
+    layoutDirty = true;
+}
+
+bool SceneTreeModel::TakeLayout()
+{
+    if (!pendingLayout)
+        return false;
+    {
+        QMutexLocker lock(&pendingLayout->mutex);
+        if (!pendingLayout->finished)
+            return false;
+        layout = pendingLayout->layout;
+    }
+    pendingLayout.reset();
+    return true;
+}
+
+void SceneTreeModel::ApplyLayout()
+{
+    PROFILE(SceneTreeModel_ApplyLayout)
+
+    ScenePtr s = scene.lock();
+    emit layoutAboutToBeChanged();
+
+    QSet<SceneTreeItem *> oldItems;
+    CollectItems(root, oldItems);
+
+    QSet<SceneTreeItem *> reached;
+    RebuildChildren(s.get(), root, reached);
+
+    // The items that were moved keep their persistent indexes, and so the selection, the current item and the expanded state.
+    const QModelIndexList oldIndexes = persistentIndexList();
+    QModelIndexList newIndexes;
+    foreach(const QModelIndex &index, oldIndexes)
+    {
+        SceneTreeItem *item = Item(index);
+        newIndexes << (item && reached.contains(item) ? createIndex(item->row, index.column(), item) : QModelIndex());
+    }
+    changePersistentIndexList(oldIndexes, newIndexes);
+
+    foreach(SceneTreeItem *item, oldItems)
+        if (!reached.contains(item))
+            DeleteItem(item);
+
+    emit layoutChanged();
+    emit LayoutApplied();
+}
+
+void SceneTreeModel::RebuildChildren(Scene *s, SceneTreeItem *item, QSet<SceneTreeItem *> &reached)
+{
+    const int numFetched = std::max(item->NumEntryChildren(), cFetchChunkSize);
+
+    QList<SceneTreeItem *> children = CreateFixedChildren(item, item->children.mid(0, item->numFixedChildren));
+    item->numFixedChildren = children.size();
+    item->entries = Entries(item);
+    item->numFetchedEntries = 0;
+    for(int num = 0; item->numFetchedEntries < item->entries.size() && num < numFetched;)
+    {
+        SceneTreeItem *child = ItemForEntry(s, item->entries[item->numFetchedEntries++], item);
+        if (child)
+        {
+            children << child;
+            ++num;
+        }
+    }
+
+    item->children = children;
+    for(int i = 0; i < children.size(); ++i)
+    {
+        SceneTreeItem *child = children[i];
+        child->parent = item;
+        child->row = i;
+        reached.insert(child);
+        if (child->populated)
+            RebuildChildren(s, child, reached);
+    }
+}
+
+QVector<SceneTreeEntry> SceneTreeModel::Entries(SceneTreeItem *item) const
+{
+    QVector<entity_id_t> ids;
+    if (item->Type() == SceneTreeItem::RootType)
+        return layout.roots;
+    else if (item->Type() == SceneTreeItem::GroupType)
+        ids = static_cast<EntityGroupItem *>(item)->entityIds;
+    else if (item->Type() == SceneTreeItem::EntityType)
+        ids = layout.children.value(static_cast<EntityItem *>(item)->Id());
+
+    QVector<SceneTreeEntry> entries;
+    entries.reserve(ids.size());
+    for(int i = 0; i < ids.size(); ++i)
+        if (!layout.filtered || layout.visible.contains(ids[i]))
+            entries.append(SceneTreeEntry(ids[i]));
+    return entries;
+}
+
+SceneTreeItem *SceneTreeModel::ItemForEntry(Scene *s, const SceneTreeEntry &entry, SceneTreeItem *parent)
+{
+    if (!entry.group.isEmpty())
+    {
+        EntityGroupItem *gItem = groupItems.value(entry.group);
+        if (!gItem)
+        {
+            gItem = new EntityGroupItem(entry.group, parent);
+            groupItems[entry.group] = gItem;
+        }
+        gItem->entityIds = layout.groups.value(entry.group);
+        return gItem;
+    }
+
+    EntityItem *eItem = entityItems.value(entry.id);
+    if (!eItem || !eItem->Entity())
+    {
+        // The item of a removed entity is deleted with the rest of the items that are not reached.
+        EntityPtr entity = (s ? s->EntityById(entry.id) : EntityPtr());
+        if (!entity)
+            return 0;
+        eItem = new EntityItem(entity, parent);
+        eItem->selected = selectedEntities.contains(entry.id);
+        entityItems[entry.id] = eItem;
+    }
+    return eItem;
+}
+
+QList<SceneTreeItem *> SceneTreeModel::CreateFixedChildren(SceneTreeItem *item, const QList<SceneTreeItem *> &existing)
+{
+    QList<SceneTreeItem *> items;
+    if (item->Type() == SceneTreeItem::EntityType)
+    {
+        EntityItem *eItem = static_cast<EntityItem *>(item);
+        EntityPtr entity = eItem->Entity();
+        if (!entity)
+            return items;
+
+        const Entity::ComponentMap &components = entity->Components();
+        for(Entity::ComponentMap::const_iterator it = components.begin(); it != components.end(); ++it)
+        {
+            if (showComponents)
+            {
+                ComponentItem *cItem = 0;
+                foreach(SceneTreeItem *e, existing)
+                    if (e->Type() == SceneTreeItem::ComponentType && static_cast<ComponentItem *>(e)->Component() == it->second)
+                    {
+                        cItem = static_cast<ComponentItem *>(e);
+                        break;
+                    }
+                if (!cItem)
+                {
+                    cItem = new ComponentItem(it->second, eItem);
+                    connect(it->second.get(), SIGNAL(ComponentNameChanged(const QString &, const QString &)),
+                        SLOT(OnComponentNameChanged()), Qt::UniqueConnection);
+                }
+                items << cItem;
+            }
+            else if (attributeVisibility != SceneStructureWindow::DoNotShowAttributes)
+                CreateAttributeItems(it->second.get(), item, existing, items);
+        }
+    }
+    else if (item->Type() == SceneTreeItem::ComponentType)
+    {
+        ComponentPtr comp = static_cast<ComponentItem *>(item)->Component();
+        if (comp && attributeVisibility != SceneStructureWindow::DoNotShowAttributes)
+            CreateAttributeItems(comp.get(), item, existing, items);
+    }
+    return items;
+}
+
+void SceneTreeModel::CreateAttributeItems(IComponent *comp, SceneTreeItem *parent, const QList<SceneTreeItem *> &existing, QList<SceneTreeItem *> &items)
+{
+    foreach(IAttribute *attr, comp->Attributes())
+    {
+        if (!attr || !IsAttributeShown(attr))
+            continue;
+
+        // An empty AssetReferenceList has a single item without an index so that it appears in the tree.
+        const u32 type = attr->TypeId();
+        const int numRefs = (type == cAttributeAssetReferenceList ? static_cast<Attribute<AssetReferenceList> *>(attr)->Get().Size() : 0);
+        for(int i = 0; i < std::max(numRefs, 1); ++i)
+        {
+            const int index = (numRefs > 0 ? i : -1);
+            AttributeItem *aItem = FindAttributeItem(existing, attr, index);
+            if (!aItem)
+            {
+                if (type == cAttributeAssetReference || type == cAttributeAssetReferenceList)
+                    aItem = (index > -1 ? new AssetRefItem(attr, index, parent) : new AssetRefItem(attr, parent));
+                else
+                    aItem = new AttributeItem(attr, parent);
+            }
+            items << aItem;
+        }
+    }
+}
+
+bool SceneTreeModel::IsAttributeShown(IAttribute *attr) const
+{
+    switch(attributeVisibility)
+    {
+    case SceneStructureWindow::ShowAllAttributes:
+        return true;
+    case SceneStructureWindow::ShowDynamicAttributes:
+        return attr->IsDynamic();
+    case SceneStructureWindow::ShowAssetReferences:
+        return attr->TypeId() == cAttributeAssetReference || attr->TypeId() == cAttributeAssetReferenceList;
+    default:
+        return false;
+    }
+}
+
+bool SceneTreeModel::HasShownAttributes(IComponent *comp) const
+{
+    if (attributeVisibility == SceneStructureWindow::DoNotShowAttributes)
+        return false;
+    foreach(IAttribute *attr, comp->Attributes())
+        if (attr && IsAttributeShown(attr))
+            return true;
+    return false;
+}
+
+void SceneTreeModel::EmitTouchedItemsChanged()
+{
+    foreach(entity_id_t id, touchedEntities)
+    {
+        EntityItem *item = entityItems.value(id);
+        if (!item)
+            continue;
+        foreach(SceneTreeItem *parentItem, AttributeParentItems(item))
+            if (parentItem->numFixedChildren > 0)
+            {
+                const QModelIndex parentIndex = IndexOf(parentItem);
+                emit dataChanged(index(0, 0, parentIndex), index(parentItem->numFixedChildren - 1, columnCount() - 1, parentIndex));
+            }
+    }
+    touchedEntities.clear();
+}
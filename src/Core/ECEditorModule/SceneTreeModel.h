@@ -0,0 +1,210 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   SceneTreeModel.h
+    @brief  Item model of the scene structure shown in SceneTreeWidget. */
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "SceneFwd.h"
+#include "SceneStructureWindow.h"
+#include "SceneTreeWidgetItems.h"
+
+#include <QAbstractItemModel>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+
+class Framework;
+
+struct SceneTreeLayoutResult;
+
+/// Properties of an entity by which the scene tree is sorted, filtered and grouped.
+struct SceneTreeRecord
+{
+    SceneTreeRecord() : parentId(0), local(false), temporary(false) {}
+
+    bool operator ==(const SceneTreeRecord &rhs) const;
+    bool operator !=(const SceneTreeRecord &rhs) const { return !(*this == rhs); }
+
+    entity_id_t parentId; ///< ID of the parent entity, 0 if the entity is not parented.
+    QString name; ///< Name of the entity.
+    QString group; ///< Group of the entity.
+    bool local; ///< Is the entity local.
+    bool temporary; ///< Is the entity temporary.
+};
+
+/// Sorted, filtered and grouped structure of the whole scene tree, computed on a worker thread.
+struct SceneTreeLayout
+{
+    SceneTreeLayout() : filtered(false) {}
+
+    QVector<SceneTreeEntry> roots; ///< Root-level groups and entities that pass the filter, in order.
+    QHash<QString, QVector<entity_id_t> > groups; ///< Entities of each group that are not parented, in order.
+    QHash<entity_id_t, QVector<entity_id_t> > children; ///< Child entities of each parent entity, in order.
+    QString filter; ///< Filter text the layout was computed with.
+    bool filtered; ///< Is a filter in use. If not, the sets below are empty.
+    QSet<entity_id_t> visible; ///< Entities that pass the filter, their ancestors and the entities of the groups that pass the filter.
+    QSet<entity_id_t> matchParents; ///< Ancestors of the entities that pass the filter.
+    QSet<QString> matchGroups; ///< Groups that contain entities, or ancestors of entities, that pass the filter.
+};
+
+/// Item model of the scene structure shown in SceneTreeWidget.
+/** The model is built for huge scenes: its cost scales with the rows shown instead of the size of the scene.
+    - The items are created only for the rows that the view fetches: the root level and large groups and parents a chunk
+      at a time when scrolled to, the children of an item when the item is expanded. Item texts are read from the scene when painted.
+    - The scene change signals are only recorded, and applied once per frame.
+    - Sorting, filtering and grouping need the whole scene, so they are done on a worker thread from a snapshot of the entity
+      names, groups and parents (SceneTreeRecord), which the model keeps up to date from the changes. The fetched items are then
+      moved to their new rows in a single layout change, which keeps the selection and the expanded items. */
+class SceneTreeModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    /// Constructor.
+    /** @param fw Framework.
+        @param parent Parent object. */
+    explicit SceneTreeModel(Framework *fw, QObject *parent = 0);
+    ~SceneTreeModel();
+
+    /// Sets the scene shown by the model. The items are created once the layout of the scene has been computed.
+    void SetScene(const ScenePtr &scene);
+
+    /// Sets the sorting criteria and order. Applied on a following frame.
+    void SortBy(SceneStructureWindow::SortCriteria criteria, Qt::SortOrder order);
+
+    /// Sets whether entity groups are shown. Applied on a following frame.
+    void SetShowGroups(bool show);
+
+    /// Sets whether components are shown. Applied on the next frame.
+    void SetShowComponents(bool show);
+
+    /// Sets which attributes are shown. Applied on the next frame.
+    void SetAttributeVisibility(SceneStructureWindow::AttributeVisibilityType type);
+
+    /// Shows only the entities and groups that contain @c filter (case-insensitive) in their name or ID, and the ancestors of those.
+    /** If @c filter begins with '!' the entities that contain the filter are hidden instead. Applied on a following frame. */
+    void SetFilter(const QString &filter);
+
+    /// Returns the filter text of the layout currently shown, which lags behind SetFilter until the layout has been computed.
+    const QString &LayoutFilter() const { return layout.filter; }
+
+    /// Returns true if the item at @c index is a parent or a group of an entity that passes the filter.
+    bool IsFilterMatchParent(const QModelIndex &index) const;
+
+    /// Decorates (bolds) or undecorates the item representing the entity @c id.
+    void SetEntitySelected(entity_id_t id, bool selected);
+
+    /// Undecorates all selected entities.
+    void ClearSelectedEntities();
+
+    /// Returns the item at @c index, or null for the root index.
+    SceneTreeItem *Item(const QModelIndex &index) const;
+
+    /// Returns the index of @c item, column 0.
+    QModelIndex IndexOf(SceneTreeItem *item) const;
+
+    /// Returns the number of entities in the scene.
+    int NumEntities() const { return records.size(); }
+
+    /// Returns true if any entity groups are shown.
+    bool HasGroups() const { return !layout.groups.isEmpty(); }
+
+    // QAbstractItemModel overrides.
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+    QModelIndex parent(const QModelIndex &index) const;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const;
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole);
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+    Qt::DropActions supportedDropActions() const;
+    /// Sorts by the current sorting criteria in @c order.
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+
+signals:
+    /// The user has entered a new name for @c entity in the view.
+    void EntityRenamed(Entity *entity, const QString &newName);
+
+    /// A new layout has been applied to the items, after a scene change or a change of the sorting, filtering or grouping.
+    void LayoutApplied();
+
+private slots:
+    /// Records a change of the name, group, parent or temporary state of the entity, or its creation or removal.
+    void OnEntityChanged(Entity *entity);
+    void OnEntityAcked(Entity *entity, entity_id_t oldId);
+    void OnComponentAddedOrRemoved(Entity *entity, IComponent *comp);
+    void OnAttributeChanged(IComponent *comp);
+    void OnAttributeAdded(IComponent *comp);
+    void OnAttributeRemoved(IComponent *comp, IAttribute *attr);
+    void OnComponentNameChanged();
+    void OnSceneCleared();
+
+    /// Applies the changes recorded during the frame.
+    void ProcessChanges();
+
+private:
+    /// Deletes all items, the records and the layout.
+    void Reset();
+    /// Deletes @c item, but not its children, and removes it from the item maps.
+    void DeleteItem(SceneTreeItem *item);
+    /// Adds the descendants of @c item to @c items.
+    void CollectItems(SceneTreeItem *item, QSet<SceneTreeItem *> &items) const;
+
+    /// Updates the record of the entity @c id. Returns true if the record changed.
+    bool UpdateRecord(Scene *scene, entity_id_t id);
+
+    /// Starts computing the layout of the current records on a worker thread.
+    void StartLayoutJob();
+    void CancelLayoutJob();
+    /// Takes the layout computed by the worker thread, if it has finished.
+    bool TakeLayout();
+
+    /// Moves the fetched items to their rows in the current layout, and recreates the component and attribute items.
+    void ApplyLayout();
+    void RebuildChildren(Scene *scene, SceneTreeItem *item, QSet<SceneTreeItem *> &reached);
+
+    /// Returns the child groups and entities of @c item in the current layout.
+    QVector<SceneTreeEntry> Entries(SceneTreeItem *item) const;
+    /// Returns an existing or a new item for @c entry, or null if the entity does not exist.
+    SceneTreeItem *ItemForEntry(Scene *scene, const SceneTreeEntry &entry, SceneTreeItem *parent);
+    /// Returns the component and attribute items of @c item, reusing the @c existing items when possible.
+    QList<SceneTreeItem *> CreateFixedChildren(SceneTreeItem *item, const QList<SceneTreeItem *> &existing);
+    void CreateAttributeItems(IComponent *comp, SceneTreeItem *parent, const QList<SceneTreeItem *> &existing, QList<SceneTreeItem *> &items);
+
+    bool IsAttributeShown(IAttribute *attr) const;
+    bool HasShownAttributes(IComponent *comp) const;
+
+    /// Emits dataChanged for the items of the entities whose attributes changed.
+    void EmitTouchedItemsChanged();
+
+    Framework *framework;
+    SceneWeakPtr scene;
+    SceneTreeItem *root; ///< Invisible root item.
+
+    SceneStructureWindow::SortCriteria sortingCriteria;
+    Qt::SortOrder sortOrder;
+    bool showGroups;
+    bool showComponents;
+    SceneStructureWindow::AttributeVisibilityType attributeVisibility;
+    QString filter;
+
+    QHash<entity_id_t, SceneTreeRecord> records; ///< Records of all entities in the scene.
+    SceneTreeLayout layout; ///< Current layout.
+    shared_ptr<SceneTreeLayoutResult> pendingLayout; ///< Layout being computed, null if none.
+
+    QHash<entity_id_t, EntityItem *> entityItems; ///< Fetched entity items.
+    QHash<QString, EntityGroupItem *> groupItems; ///< Fetched group items.
+    QSet<entity_id_t> selectedEntities; ///< Entities decorated as selected.
+
+    QSet<entity_id_t> dirtyEntities; ///< Entities whose records need to be updated.
+    QSet<entity_id_t> touchedEntities; ///< Populated entities whose attributes changed.
+    bool layoutDirty; ///< Does the layout need to be recomputed.
+    bool contentDirty; ///< Do the component and attribute items need to be recreated.
+};
@@ -9,6 +9,7 @@
 
 #include "SceneTreeWidget.h"
 #include "SceneTreeWidgetItems.h"
+#include "SceneTreeModel.h"
 #include "SceneStructureModule.h"
 #include "SupportedFileTypes.h"
 #include "Scene/Scene.h"
@@ -83,8 +84,9 @@ void Menu::keyReleaseEvent(QKeyEvent *e)
 // SceneTreeWidget
 
 SceneTreeWidget::SceneTreeWidget(Framework *fw, QWidget *parent) :
-    QTreeWidget(parent),
+    QTreeView(parent),
     framework(fw),
+    sceneModel(0),
     toolTip(new SceneTreeWidgetToolTip()),
     undoManager_(0),
     showComponents(false),
@@ -103,10 +105,14 @@ SceneTreeWidget::SceneTreeWidget(Framework *fw, QWidget *parent) :
     setExpandsOnDoubleClick(false);
     setAutoScroll(true);
     setAutoExpandDelay(-1);
+    setUniformRowHeights(true);
+
+    sceneModel = new SceneTreeModel(fw, this);
+    setModel(sceneModel);
+    setSortingEnabled(true);
+    connect(sceneModel, SIGNAL(EntityRenamed(Entity *, const QString &)), SLOT(OnEntityRenamed(Entity *, const QString &)));
 
     // Headers
-    setColumnCount(2);
-    setHeaderLabels(QStringList() << tr("Entities") << "");
     header()->setMinimumSectionSize(110);
     header()->setStretchLastSection(false);
     header()->setResizeMode(0, QHeaderView::Stretch);
@@ -127,8 +133,6 @@ SceneTreeWidget::SceneTreeWidget(Framework *fw, QWidget *parent) :
     connect(copyShortcut, SIGNAL(activated()), SLOT(Copy()));
     connect(pasteShortcut, SIGNAL(activated()), SLOT(Paste()));
 
-//    disconnect(this, SIGNAL(itemChanged(QTreeWidgetItem *, int)), this, SLOT(OnItemEdited(QTreeWidgetItem *, int)));
-
     LoadInvokeHistory();
 }
 
@@ -153,6 +157,7 @@ SceneTreeWidget::~SceneTreeWidget()
 void SceneTreeWidget::SetScene(const ScenePtr &s)
 {
     scene = s;
+    sceneModel->SetScene(s);
     SAFE_DELETE(undoManager_);
     if (s)
     {
@@ -184,7 +189,7 @@ void SceneTreeWidget::contextMenuEvent(QContextMenuEvent *e)
 void SceneTreeWidget::dragEnterEvent(QDragEnterEvent *e)
 {
     // Use base class to enable auto expansion/scroll. Ignore any accepts it does internally.
-    QTreeWidget::dragEnterEvent(e);
+    QTreeView::dragEnterEvent(e);
     e->ignore();
 
     // Clear tooltip and schedule a paint event
@@ -215,7 +220,7 @@ void SceneTreeWidget::dragEnterEvent(QDragEnterEvent *e)
 void SceneTreeWidget::dragMoveEvent(QDragMoveEvent *e)
 {
     // Use base class to enable auto expansion/scroll. Ignore any accepts it does internally.
-    QTreeWidget::dragMoveEvent(e);
+    QTreeView::dragMoveEvent(e);
     e->ignore();
 
     // Clear tooltip and schedule a paint event
@@ -235,7 +240,7 @@ void SceneTreeWidget::dragMoveEvent(QDragMoveEvent *e)
         SceneTreeWidgetSelection sel = SelectedItems();
         if (sel.HasEntitiesOnly())
         {
-            QTreeWidgetItem *underMouse = itemAt(e->pos());
+            SceneTreeItem *underMouse = sceneModel->Item(indexAt(e->pos()));
             
             // Unparent when dropping to the tree root.
             if (!underMouse)
@@ -256,7 +261,7 @@ void SceneTreeWidget::dragMoveEvent(QDragMoveEvent *e)
             else
             {
                 // If entity item, the target cannot be in the dragged set.
-                EntityItem *entItem = dynamic_cast<EntityItem*>(underMouse);
+                EntityItem *entItem = dynamic_cast<EntityItem *>(underMouse);
                 if (entItem && entItem->Entity())
                 {
                     if (!sel.entities.contains(entItem))
@@ -312,7 +317,7 @@ void SceneTreeWidget::dragMoveEvent(QDragMoveEvent *e)
 void SceneTreeWidget::dropEvent(QDropEvent *e)
 {
     // Don't call the base class impl. This will auto internal move items, we want to handle it here.
-    // Clear potential state and auto scroll that initiated in QTreeWidget::dragMoveEvent.
+    // Clear potential state and auto scroll that initiated in QTreeView::dragMoveEvent.
     stopAutoScroll();
     setState(QAbstractItemView::NoState);
 
@@ -350,7 +355,7 @@ void SceneTreeWidget::dropEvent(QDropEvent *e)
         SceneTreeWidgetSelection sel = SelectedItems();
         if (sel.HasEntitiesOnly())
         {
-            QTreeWidgetItem *underMouse = itemAt(e->pos());
+            SceneTreeItem *underMouse = sceneModel->Item(indexAt(e->pos()));
 
             if (!underMouse)
             {
@@ -379,7 +384,7 @@ void SceneTreeWidget::dropEvent(QDropEvent *e)
             else
             {
                 // If entity item, the target cannot be in the dragged set.
-                EntityItem *entItem = dynamic_cast<EntityItem*>(underMouse);
+                EntityItem *entItem = dynamic_cast<EntityItem *>(underMouse);
                 if (entItem && entItem->Entity())
                 {
                     if (!sel.entities.contains(entItem))
@@ -412,7 +417,7 @@ void SceneTreeWidget::dropEvent(QDropEvent *e)
                         }
 
                         // Expand the parent item
-                        entItem->setExpanded(true);
+                        expand(sceneModel->IndexOf(entItem));
 
                         e->acceptProposedAction();
                     }
@@ -432,10 +437,9 @@ void SceneTreeWidget::dropEvent(QDropEvent *e)
 
 void SceneTreeWidget::paintEvent(QPaintEvent *e)
 {
-    QTreeWidget::paintEvent(e);
+    QTreeView::paintEvent(e);
 
-    // Sorting should be disabled only when adding/removing stuff from/to the tree
-    if (!isSortingEnabled())
+    if (undoManager_ && undoManager_->CommandsExecuting())
     {
         int numRemoving = 0;
         QList<const RemoveCommand*> removeCommands = undoManager_->Commands<RemoveCommand>();
@@ -516,7 +520,7 @@ void SceneTreeWidget::AddAvailableAssetActions(QMenu *menu)
     QList<QObject *> targets;
     foreach(AssetRefItem *item, sel.assets)
     {
-        AssetPtr asset = framework->Asset()->GetAsset(item->id);
+        AssetPtr asset = framework->Asset()->GetAsset(item->Ref());
         if (asset)
             targets.append(asset.get());
     }
@@ -531,7 +535,8 @@ void SceneTreeWidget::AddAvailableAssetActions(QMenu *menu)
             action = new QAction(tr("Save selected assets..."), menu);
         else
         {
-            QString assetName = sel.assets[0]->id.right(sel.assets[0]->id.size() - sel.assets[0]->id.lastIndexOf("://") - 3);
+            const QString ref = sel.assets[0]->Ref();
+            QString assetName = ref.right(ref.size() - ref.lastIndexOf("://") - 3);
             action = new QAction(tr("Save") + " " + assetName + " " + tr("as..."), menu);
         }
         connect(action, SIGNAL(triggered()), SLOT(SaveAssetAs()));
@@ -566,7 +571,7 @@ void SceneTreeWidget::AddAvailableEntityActions(QMenu *menu)
     }
 
     // "Save scene as..." action is possible if we have at least one entity in the scene.
-    const bool saveSceneAsPossible = (topLevelItemCount() > 0);
+    const bool saveSceneAsPossible = (sceneModel->NumEntities() > 0);
     QAction *saveSceneAsAction = 0;
     QAction *exportAllAction = 0;
     if (saveSceneAsPossible)
@@ -859,11 +864,14 @@ void SceneTreeWidget::AddAvailableEntityActions(QMenu *menu)
 SceneTreeWidgetSelection SceneTreeWidget::SelectedItems() const
 {
     SceneTreeWidgetSelection ret;
-    QListIterator<QTreeWidgetItem *> it(selectedItems());
-    while(it.hasNext())
+    QSet<SceneTreeItem *> items; // The indexes of all columns are selected.
+    foreach(const QModelIndex &index, selectionModel()->selectedIndexes())
     {
-        QTreeWidgetItem *item = it.next();
-        
+        SceneTreeItem *item = sceneModel->Item(index);
+        if (!item || items.contains(item))
+            continue;
+        items.insert(item);
+
         EntityGroupItem *gItem = dynamic_cast<EntityGroupItem *>(item);
         if (gItem)
         {
@@ -932,12 +940,13 @@ QString SceneTreeWidget::SelectionAsXml() const
     }
     else if (selection.HasGroupsOnly())
     {
+        ScenePtr s = scene.lock();
         foreach(EntityGroupItem *gItem, selection.groups)
-            for (int i = 0; i < gItem->childCount(); ++i)
+            foreach(entity_id_t id, gItem->entityIds)
             {
-                EntityItem *eItem = static_cast<EntityItem*>(gItem->child(i));
-                if (eItem && eItem->Entity())
-                    eItem->Entity()->SerializeToXML(sceneDoc, sceneElem, serializeTemp, serializeLocal);
+                EntityPtr entity = (s ? s->EntityById(id) : EntityPtr());
+                if (entity)
+                    entity->SerializeToXML(sceneDoc, sceneElem, serializeTemp, serializeLocal);
             }
 
         sceneDoc.appendChild(sceneElem);
@@ -1058,112 +1067,17 @@ void SceneTreeWidget::EditInNew()
 
 void SceneTreeWidget::Rename()
 {
-    QModelIndex index = selectionModel()->currentIndex();
-    if (!index.isValid())
-        return;
-
     SceneTreeWidgetSelection sel = SelectedItems();
-    if (sel.entities.size() == 1)
-    {
-        EntityItem *eItem = sel.entities[0];
-        EntityPtr entity = eItem->Entity();
-        if (entity)
-        {
-            // Disable sorting when renaming so that the item will not jump around in the list.
-            setSortingEnabled(false);
-            // Remove the entity ID from the text when user is editing entity's name.
-            eItem->setText(0, entity->Name());
-//            openPersistentEditor(eItem);
-//            setCurrentIndex(index);
-            edit(index);
-            connect(this->itemDelegate(), SIGNAL(commitData(QWidget*)), SLOT(OnCommitData(QWidget*)), Qt::UniqueConnection);
-            connect(this, SIGNAL(itemChanged(QTreeWidgetItem *, int)), SLOT(OnItemEdited(QTreeWidgetItem *, int)), Qt::UniqueConnection);
-//            connect(this, SIGNAL(currentItemChanged(QTreeWidgetItem *, QTreeWidgetItem *)), SLOT(CloseEditor(QTreeWidgetItem *,QTreeWidgetItem *)));
-        }
-    }
-/*
-    else if (sel.components.size() == 1)
-    {
-        ComponentItem *cItem = sel.components[0];
-        // Remove the type name from the text when user is editing entity's name.
-        cItem->setText(0, cItem->name);
-        edit(index);
-//        connect(this, SIGNAL(itemChanged(QTreeWidgetItem *, int)), SLOT(OnItemEdited(QTreeWidgetItem *)), Qt::UniqueConnection);
-    }
-*/
-}
-
-void SceneTreeWidget::OnCommitData(QWidget * editor)
-{
-    QModelIndex index = selectionModel()->currentIndex();
-    if (!index.isValid())
-        return;
-
-    SceneTreeWidgetSelection selection = SelectedItems();
-    if (selection.entities.size() == 1)
-    {
-        EntityItem *entityItem = selection.entities[0];
-        EntityPtr entity = entityItem->Entity();
-        if (entity)
-        {
-            QLineEdit *edit = qobject_cast<QLineEdit*>(editor);
-            if (edit)
-                // If there are no changes, restore back the previous stripped entity ID from the item, and restore sorting
-                if (edit->text() == entity->Name())
-                {
-                    disconnect(this, SIGNAL(itemChanged(QTreeWidgetItem *, int)), this, SLOT(OnItemEdited(QTreeWidgetItem *, int)));
-                    entityItem->SetText(entity.get());
-                    setSortingEnabled(true);
-                }
-        }
-    }
+    if (sel.entities.size() == 1 && sel.entities[0]->Entity())
+        edit(sceneModel->IndexOf(sel.entities[0])); // The editor is given the bare entity name, without the entity ID.
 }
 
-void SceneTreeWidget::OnItemEdited(QTreeWidgetItem *item, int column)
+void SceneTreeWidget::OnEntityRenamed(Entity *entity, const QString &newName)
 {
-    if (column != 0)
-        return;
-
-    EntityItem *eItem = dynamic_cast<EntityItem *>(item);
-    if (eItem)
-    {
-        EntityPtr entity = eItem->Entity();
-        assert(entity);
-        if (entity)
-        {
-            QString newName = eItem->text(0);
-            disconnect(this, SIGNAL(itemChanged(QTreeWidgetItem *, int)), this, SLOT(OnItemEdited(QTreeWidgetItem *, int)));
-            // We don't need to set item text here. It's done when SceneStructureWindow gets AttributeChanged() signal from Scene.
-            undoManager_->Push(new RenameCommand(entity, undoManager_->Tracker(), entity->Name(), newName));
-//            closePersistentEditor(item);
-            setSortingEnabled(true);
-            return;
-        }
-    }
-/*
-    ComponentItem *cItem = dynamic_cast<ComponentItem *>(item);
-    EntityItem *parentItem = dynamic_cast<EntityItem *>(cItem->parent());
-    if (cItem && parentItem)
-    {
-        EntityPtr entity = scene->EntityById(parentItem->id);
-        QString newName = cItem->text(0);
-        disconnect(this, SIGNAL(itemChanged(QTreeWidgetItem *, int)), this, SLOT(OnItemEdited(QTreeWidgetItem *)));
-        ComponentPtr component = entity->Component(cItem->typeName, cItem->name);
-        if (component)
-            component->SetName(newName);
-        //cItem->typeName
-    }
-*/
+    // We don't need to set item text here. It's read from the entity when SceneTreeModel gets AttributeChanged() signal from Scene.
+    undoManager_->Push(new RenameCommand(entity->shared_from_this(), undoManager_->Tracker(), entity->Name(), newName));
 }
 
-/*
-void SceneTreeWidget::CloseEditor(QTreeWidgetItem *c, QTreeWidgetItem *p)
-{
-//    foreach(EntityItem *eItem, SelectedItems().entities)
-    closePersistentEditor(p);
-}
-*/
-
 void SceneTreeWidget::NewEntity()
 {
     if (scene.expired())
@@ -1253,7 +1167,8 @@ void SceneTreeWidget::ComponentDialogFinished(int result)
 
 void SceneTreeWidget::Delete()
 {
-    if (scene.expired())
+    ScenePtr s = scene.lock();
+    if (!s)
         return;
 
     QList<EntityWeakPtr> entities;
@@ -1275,21 +1190,29 @@ void SceneTreeWidget::Delete()
     // Remove entities.
     if (sel.HasEntities())
     {
-        foreach(EntityItem *eItem, SelectedItems().entities)
-            entities << eItem->Entity();
+        foreach(EntityItem *eItem, sel.entities)
+        {
+            EntityPtr entity = eItem->Entity();
+            if (entity)
+                entities << entity;
+        }
     }
     else if (sel.HasGroupsOnly())
     {
         foreach(EntityGroupItem *group, sel.groups)
         {
-            foreach(EntityItem *item, group->entityItems)
-                entities << item->Entity();
+            foreach(entity_id_t id, group->entityIds)
+            {
+                EntityPtr entity = s->EntityById(id);
+                if (entity)
+                    entities << entity;
+            }
         }
     }
 
-    if (undoManager_)
+    if (undoManager_ && (!entities.isEmpty() || !components.isEmpty()))
     {
-        RemoveCommand *command = new RemoveCommand(scene.lock(), undoManager_->Tracker(), entities, components);
+        RemoveCommand *command = new RemoveCommand(s, undoManager_->Tracker(), entities, components);
         connect(command, SIGNAL(Starting()), this, SLOT(OnCommandStarting()));
         connect(command, SIGNAL(Finished()), this, SLOT(OnCommmandFinished()));
         undoManager_->Push(command);
@@ -1298,17 +1221,13 @@ void SceneTreeWidget::Delete()
 
 void SceneTreeWidget::OnCommandStarting()
 {
-    setSortingEnabled(false);
+    // Repaint to show the progress of the command, see paintEvent.
+    viewport()->update();
 }
 
 void SceneTreeWidget::OnCommmandFinished()
 {
-    // There can be various command executing, wait for all of
-    // the to finish before turning sorting back on.
-    if (!undoManager_->CommandsExecuting())
-    {
-        setSortingEnabled(true);
-    }
+    viewport()->update();
 }
 
 void SceneTreeWidget::Copy()
@@ -1395,9 +1314,7 @@ void SceneTreeWidget::Paste()
     if (undoManager_)
         undoManager_->Clear(); // Unsupported action, clear undo stack
 
-    setSortingEnabled(false);
     scene.lock()->CreateContentFromXml(sceneDoc, false, AttributeChange::Replicate);
-    setSortingEnabled(true);
 }
 
 void SceneTreeWidget::SaveAs()
@@ -1761,7 +1678,8 @@ void SceneTreeWidget::ExportAllDialogClosed(int result)
     QFileDialog *dialog = qobject_cast<QFileDialog *>(sender());
     assert(dialog);
 
-    if (!dialog || result != QDialog::Accepted || dialog->selectedFiles().size() != 1 || scene.expired())
+    ScenePtr s = scene.lock();
+    if (!dialog || result != QDialog::Accepted || dialog->selectedFiles().size() != 1 || !s)
         return;
 
     // separate path from filename
@@ -1775,19 +1693,14 @@ void SceneTreeWidget::ExportAllDialogClosed(int result)
     if (!sel.HasEntities())
     {
         // Export all assets
-        for(int i = 0; i < topLevelItemCount(); ++i)
-        {
-            /// @bug Doesn't take EntityGroupItems into account. @todo fix 03.09.2013
-            EntityItem *eItem = dynamic_cast<EntityItem *>(topLevelItem(i));
-            if (eItem)
-                assets.unite(GetAssetRefs(eItem, false));
-        }
+        for(Scene::const_iterator it = s->begin(); it != s->end(); ++it)
+            assets.unite(GetAssetRefs(it->second, false));
     }
     else
     {
         // Export assets for selected entities
         foreach(EntityItem *eItem, sel.entities)
-            assets.unite(GetAssetRefs(eItem, false));
+            assets.unite(GetAssetRefs(eItem->Entity(), false));
     }
 
     savedAssets.clear();
@@ -1824,55 +1737,35 @@ void SceneTreeWidget::ExportAllDialogClosed(int result)
     }
 }
 
-QSet<QString> SceneTreeWidget::GetAssetRefs(const EntityItem *eItem, bool includeEmptyRefs) const
+QSet<QString> SceneTreeWidget::GetAssetRefs(const EntityPtr &entity, bool includeEmptyRefs) const
 {
-    assert(scene.lock());
     QSet<QString> assets;
+    if (!entity)
+        return assets;
 
-    EntityPtr entity = eItem->Entity();
-    if (entity)
+    const Entity::ComponentMap &components = entity->Components();
+    for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
     {
-        int entityChildCount = eItem->childCount();
-        for(int j = 0; j < entityChildCount; ++j)
+        foreach(IAttribute *attr, i->second->Attributes())
         {
-            ComponentItem *cItem = dynamic_cast<ComponentItem *>(eItem->child(j));
-            if (!cItem)
-                continue;
-            ComponentPtr comp = cItem->Component();
-            if (!comp)
+            if (!attr)
                 continue;
 
-            const Entity::ComponentMap &components = entity->Components();
-            for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
+            if (attr->TypeId() == cAttributeAssetReference)
+            {
+                Attribute<AssetReference> *assetRef = static_cast<Attribute<AssetReference> *>(attr);
+                if (!includeEmptyRefs && assetRef->Get().ref.trimmed().isEmpty())
+                    continue;
+                assets.insert(assetRef->Get().ref);
+            }
+            else if (attr->TypeId() == cAttributeAssetReferenceList)
             {
-                foreach(IAttribute *attr, i->second->Attributes())
+                Attribute<AssetReferenceList> *assetRefs = static_cast<Attribute<AssetReferenceList> *>(attr);
+                for(int j = 0; j < assetRefs->Get().Size(); ++j)
                 {
-                    if (!attr)
+                    if (!includeEmptyRefs && assetRefs->Get()[j].ref.trimmed().isEmpty())
                         continue;
-                    
-                    if (attr->TypeId() == cAttributeAssetReference)
-                    {
-                        Attribute<AssetReference> *assetRef = static_cast<Attribute<AssetReference> *>(attr);
-                        if (assetRef)
-                        {
-                            if (!includeEmptyRefs && assetRef->Get().ref.trimmed().isEmpty())
-                                continue;
-                            assets.insert(assetRef->Get().ref);
-                        }
-                    }
-                    else if (attr->TypeId() == cAttributeAssetReferenceList)
-                    {
-                        Attribute<AssetReferenceList> *assetRefs = static_cast<Attribute<AssetReferenceList> *>(attr);
-                        if (assetRefs)
-                        {
-                            for(int i = 0; i < assetRefs->Get().Size(); ++i)
-                            {
-                                if (!includeEmptyRefs && assetRefs->Get()[i].ref.trimmed().isEmpty())
-                                    continue;
-                                assets.insert(assetRefs->Get()[i].ref);
-                            }
-                        }
-                    }
+                    assets.insert(assetRefs->Get()[j].ref);
                 }
             }
         }
@@ -1999,7 +1892,7 @@ void SceneTreeWidget::SaveAssetAs()
 
     if (sel.assets.size() == 1)
     {
-        assetName = AssetAPI::ExtractFilenameFromAssetRef(sel.assets[0]->id);
+        assetName = AssetAPI::ExtractFilenameFromAssetRef(sel.assets[0]->Ref());
         fileDialog = SaveFileDialogNonModal("", tr("Save Asset As"), assetName, 0, this, SLOT(SaveAssetDialogClosed(int)));
     }
     else
@@ -2032,13 +1925,13 @@ void SceneTreeWidget::SaveAssetDialogClosed(int result)
     fetchReferences = false;
     foreach(AssetRefItem *aItem, sel.assets)
     {
-        AssetTransferPtr transfer = framework->Asset()->RequestAsset(aItem->id);
+        AssetTransferPtr transfer = framework->Asset()->RequestAsset(aItem->Ref());
 
         // if saving multiple assets, append filename to directory
         QString filename = files[0];
         if (isDir)
         {
-            QString assetName = AssetAPI::ExtractFilenameFromAssetRef(aItem->id);
+            QString assetName = AssetAPI::ExtractFilenameFromAssetRef(aItem->Ref());
             filename += "/" + assetName;
         }
 
@@ -2166,7 +2059,11 @@ void SceneTreeWidget::GroupEntities()
         {
             SceneTreeWidgetSelection sel = SelectedItems();
             foreach(entity_id_t id, sel.EntityIds())
-                entities << scn->EntityById(id);
+            {
+                EntityPtr entity = scn->EntityById(id);
+                if (entity)
+                    entities << entity;
+            }
         }
 
         if (!entities.isEmpty())
@@ -2251,10 +2148,11 @@ void SceneTreeWidget::UngroupEntities()
             if (!group)
                 continue;
 
-            foreach(EntityItem *groupped, group->entityItems)
+            foreach(entity_id_t id, group->entityIds)
             {
-                if (groupped && groupped->Entity())
-                    entities << groupped->Entity();
+                EntityPtr groupped = scn->EntityById(id);
+                if (groupped)
+                    entities << groupped;
             }
             if (!entities.isEmpty())
             {
@@ -2270,5 +2168,6 @@ void SceneTreeWidget::UngroupEntities()
 void SceneTreeWidget::SortBy(SceneStructureWindow::SortCriteria criteria, Qt::SortOrder order)
 {
     sortingCriteria = criteria;
-    sortItems(0, order);
+    sceneModel->SortBy(criteria, order);
+    header()->setSortIndicator(0, order);
 }
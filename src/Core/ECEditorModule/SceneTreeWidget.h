@@ -12,7 +12,7 @@
 
 #include "SceneStructureWindow.h"
 
-#include <QTreeWidget>
+#include <QTreeView>
 #include <QPointer>
 #include <QMenu>
 #include <QShortcut>
@@ -23,7 +23,7 @@ class QFileDialog;
 class ECEditorWindow;
 class IArgumentType;
 class IAssetTransfer;
-class EntityItem;
+class SceneTreeModel;
 class UndoManager;
 
 struct InvokeItem;
@@ -52,8 +52,9 @@ private:
 };
 /// @endcond
 
-/// Tree widget showing the scene structure.
-class SceneTreeWidget : public QTreeWidget
+/// Tree view showing the scene structure.
+/** The contents are provided by SceneTreeModel, which is created and owned by the view. */
+class SceneTreeWidget : public QTreeView
 {
     Q_OBJECT
 
@@ -70,6 +71,9 @@ public:
     /** @param scene Scene which contents we want to modify. */
     void SetScene(const ScenePtr &scene);
 
+    /// Returns the model of the tree view.
+    SceneTreeModel *Model() const { return sceneModel; }
+
     /// Do we show components in the tree widget or not.
     bool showComponents;
 
@@ -126,11 +130,12 @@ private:
     /// Return most recently used InvokeItem.
     InvokeItem *FindMruItem();
 
-    /// Returns all asset references for the specified entity item.
-    QSet<QString> GetAssetRefs(const EntityItem *eItem, bool includeEmptyRefs = true) const;
+    /// Returns all asset references for the specified entity.
+    QSet<QString> GetAssetRefs(const EntityPtr &entity, bool includeEmptyRefs = true) const;
 
     Framework *framework; ///< Framework pointer.
     SceneWeakPtr scene; ///< Scene which we are showing the in tree widget currently.
+    SceneTreeModel *sceneModel; ///< Model of the tree view.
     QList<QPointer<ECEditorWindow> > ecEditors; ///< This EC editors owned by this widget.
     int historyMaxItemCount; ///< Maximum count of invoke history items.
     int numberOfInvokeItemsVisible; ///< Number of visible invoke items in the context-menu.
@@ -166,14 +171,8 @@ private slots:
     /// Renames selected entity.
     void Rename();
 
-    /// Sets new name for item (entity or component) when it's renamed.
-    /** @item The item which was renamed. */
-    void OnItemEdited(QTreeWidgetItem *item, int);
-
-    /// Used to restore the entity ID in case the rename action does not make changes to the editing
-    /** @editor The editor widget (QLineEdit). */
-    void OnCommitData(QWidget * editor);
-//    void CloseEditor(QTreeWidgetItem *,QTreeWidgetItem *);
+    /// Sets new name for the entity when its item is renamed.
+    void OnEntityRenamed(Entity *entity, const QString &newName);
 
     /// Creates a new entity.
     void NewEntity();
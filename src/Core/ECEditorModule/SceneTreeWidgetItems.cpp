@@ -8,18 +8,14 @@
 #include "DebugOperatorNew.h"
 
 #include "SceneTreeWidgetItems.h"
-#include "SceneTreeWidget.h"
-#include "SceneStructureWindow.h"
 
 #include "Entity.h"
-#include "UniqueIdGenerator.h"
 #include "AssetReference.h"
 #include "IAsset.h"
 #include "IAssetBundle.h"
 #include "IAssetStorage.h"
 #include "AssetAPI.h"
 #include "LoggingFunctions.h"
-#include "Profiler.h"
 
 #include "MemoryLeakCheck.h"
 
@@ -31,198 +27,92 @@ namespace
     const QString disconnectedText = QApplication::translate("ComponentItem", "UpdateMode:Disconnected");
 }
 
-// EntityGroupItem
+// SceneTreeItem
 
-EntityGroupItem::EntityGroupItem(const QString &groupName) :
-    name(groupName)
+SceneTreeItem::SceneTreeItem(ItemType itemType, SceneTreeItem *parentItem) :
+    parent(parentItem),
+    row(0),
+    numFixedChildren(0),
+    numFetchedEntries(0),
+    populated(false),
+    type(itemType)
 {
-    setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable);
-    setTextColor(0, Qt::black);
-    setTextColor(1, QColor(68,68,68));
-
-    setText(0, "Group: " + name);
 }
 
-EntityGroupItem::~EntityGroupItem()
+SceneTreeItem::~SceneTreeItem()
 {
-    // Don't leave children free-floating.
-    if (treeWidget())
-    {
-        foreach(QTreeWidgetItem *child, takeChildren())
-            treeWidget()->addTopLevelItem(child);
-    }
 }
 
-void EntityGroupItem::UpdateText()
+QVariant SceneTreeItem::Data(int /*column*/, int /*role*/) const
 {
-    setText(0, "Group: " + name);
-    setText(1, QString("%1 %2").arg(entityItems.size()).arg(entityItems.size() > 1 ? "Entities" : "Entity"));
-
-    // Groups should be hidde if it has no child node. This can happen when group items are moved to parent entities.
-    // In this case the group is still defined in the Entity but Entity parenting takes priority in the tree.
-    bool visible = (childCount() > 0);
-    if (isHidden() == visible)
-        setHidden(!visible);
+    return QVariant();
 }
 
-void EntityGroupItem::AddEntityItems(QList<EntityItem*> eItems, bool checkParenting, bool addAsChild, bool updateText)
-{
-    foreach(EntityItem *eItem, eItems)
-        AddEntityItem(eItem, checkParenting, addAsChild, false);
-
-    if (updateText)
-        UpdateText();
-}
-
-void EntityGroupItem::AddEntityItem(EntityItem *eItem, bool checkParenting, bool addAsChild, bool updateText)
-{
-    if (entityItems.contains(eItem))
-    {
-        // Update visibility
-        if (updateText)
-            UpdateText();
-        return;
-    }
-
-    if (checkParenting)
-    {
-        EntityGroupItem *parentItem = eItem->Parent();
-        if (!parentItem && treeWidget())
-        {
-            // Currently a top-level item, remove from top-level.
-            int topLevelIndex = treeWidget()->indexOfTopLevelItem(eItem);
-            if (topLevelIndex != -1)
-                treeWidget()->takeTopLevelItem(topLevelIndex);
-        }
-        else if (parentItem && parentItem != this)
-            eItem->Parent()->RemoveEntityItem(eItem);
-    }
-
-    if (addAsChild)
-        addChild(eItem);
-    entityItems << eItem;
-
-    if (updateText)
-        UpdateText();
-}
-
-void EntityGroupItem::ClearEntityItems(bool updateText)
-{
-    entityItems.clear();
-    if (updateText)
-        UpdateText();
-}
-
-bool EntityGroupItem::ContainsAllItems(const QList<EntityItem*> &items)
-{
-    foreach(EntityItem *item, items)
-    {
-        if (!entityItems.contains(item))
-            return false;
-    }
-    return true;
-}
+// EntityGroupItem
 
-void EntityGroupItem::RemoveEntityItem(EntityItem *item, bool updateText)
+EntityGroupItem::EntityGroupItem(const QString &groupName, SceneTreeItem *parent) :
+    SceneTreeItem(GroupType, parent),
+    name(groupName)
 {
-    if (!entityItems.contains(item))
-        return;
-
-    EntityGroupItem *parentItem = item->Parent();
-    removeChild(item);
-
-    if (parentItem == this)
-        treeWidget()->addTopLevelItem(item);
-
-    entityItems.removeAll(item);
-
-    if (updateText)
-        UpdateText();
 }
 
-void EntityGroupItem::RemoveAndReparentEntityItem(EntityItem *item, QTreeWidgetItem *newParent, bool updateText)
+QVariant EntityGroupItem::Data(int column, int role) const
 {
-    if (entityItems.contains(item))
+    if (role == Qt::DisplayRole)
     {
-        removeChild(item);
-        entityItems.removeAll(item);
+        if (column == 0)
+            return "Group: " + name;
+        return QString("%1 %2").arg(entityIds.size()).arg(entityIds.size() > 1 ? "Entities" : "Entity");
     }
-    if (newParent)
-    {
-        EntityGroupItem *newGroup = dynamic_cast<EntityGroupItem*>(newParent);
-        EntityItem *newEntity = dynamic_cast<EntityItem*>(newParent);
-        if (newGroup)
-            newGroup->AddEntityItem(item, false, true, updateText);
-        else if (newEntity)
-        {
-            newEntity->addChild(item);
-            newEntity->UpdateText();
-        }
-        else
-            newParent->addChild(item);
-    }
-    if (updateText)
-        UpdateText();
-}
-
-bool EntityGroupItem::operator <(const QTreeWidgetItem &rhs) const
-{
-    PROFILE(EntityGroupItem_OperatorLessThan)
-
-    // Entities never go before groups, even when sorting by name.
-    const EntityGroupItem *group = dynamic_cast<const EntityGroupItem*>(&rhs);
-    if (!group)
-        return false;
-    // note This is deliberately >= 0 to sort groups alphabetically in the default view (decending).
-    return name.localeAwareCompare(group->GroupName()) >= 0;
+    else if (role == Qt::ForegroundRole)
+        return (column == 0 ? QColor(Qt::black) : QColor(68,68,68));
+    return QVariant();
 }
 
 // EntityItem
 
-EntityItem::EntityItem(const EntityPtr &entity, EntityGroupItem *parentItem) :
-    QTreeWidgetItem(parentItem),
-    ptr(entity),
-    id(entity->Id())
+EntityItem::EntityItem(const EntityPtr &entity, SceneTreeItem *parent) :
+    SceneTreeItem(EntityType, parent),
+    selected(false),
+    id(entity->Id()),
+    ptr(entity)
 {
-    setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable | Qt::ItemIsDragEnabled);
-
-    if (parentItem)
-        parentItem->AddEntityItem(this);
-
-    SetText(entity.get());
-}
-
-EntityItem::~EntityItem()
-{
-    if (Parent())
-        Parent()->RemoveEntityItem(this);
 }
 
 void EntityItem::Acked(const EntityPtr &entity)
 {
     ptr = entity;
     id = entity->Id();
+}
 
-    UpdateText();
+EntityPtr EntityItem::Entity() const
+{
+    return ptr.lock();
 }
 
-void EntityItem::UpdateText()
+entity_id_t EntityItem::Id() const
 {
-    SetText(ptr.lock().get());
+    return id;
 }
 
-void EntityItem::SetText(::Entity *entity)
+QVariant EntityItem::Data(int column, int role) const
 {
+    EntityPtr entity = ptr.lock();
     if (!entity)
+        return QVariant();
+
+    if (role == Qt::EditRole)
+        return (column == 0 ? QVariant(entity->Name()) : QVariant());
+    if (role == Qt::FontRole)
     {
-        setText(0, "Error: Invalid Entity");
-        return;
+        if (column != 0 || !selected)
+            return QVariant();
+        QFont font;
+        font.setBold(true);
+        return font;
     }
-    if (ptr.lock().get() != entity)
-        LogWarning("EntityItem::SetText: the entity given is different than the entity this item represents.");
-
-    QString entName = entity->Name();
-    QString name = QString("%1 %2").arg(entity->Id()).arg(entName.isEmpty() ? "(no name)" : entName);
+    if (role != Qt::DisplayRole && role != Qt::ForegroundRole)
+        return QVariant();
 
     const bool local = entity->IsLocal();
     const bool temp = entity->IsTemporary();
@@ -252,110 +142,44 @@ void EntityItem::SetText(::Entity *entity)
             descColor = QColor(68,68,68);
     }
 
-    if (text(0).compare(name, Qt::CaseSensitive) != 0)
-        setText(0, name);
-    if (text(1).compare(desc, Qt::CaseSensitive) != 0)
-        setText(1, desc);
-
-    if (textColor(0) != color)
-        setTextColor(0, color);
-    if (!desc.isEmpty() && textColor(1) != descColor)
-        setTextColor(1, descColor);
-}
-
-EntityGroupItem *EntityItem::Parent() const
-{
-    return dynamic_cast<EntityGroupItem *>(parent());
-}
-
-EntityPtr EntityItem::Entity() const
-{
-    return ptr.lock();
-}
-
-entity_id_t EntityItem::Id() const
-{
-    return id;
-}
-
-bool EntityItem::operator <(const QTreeWidgetItem &other) const
-{
-    PROFILE(EntityItem_OperatorLessThan)
-
-    // Entities never go before groups, even when sorting by name.
-    const EntityGroupItem *group = dynamic_cast<const EntityGroupItem*>(&other);
-    if (group)
-        return true;
-
-    SceneTreeWidget *tree = qobject_cast<SceneTreeWidget*>(treeWidget());
-    if (!tree)
-        return false;
-
-    // We can only compare two EntityItems. However this can be a Component/AttributeItem
-    // when Entity has children. In this case, those alway come before EntityItem so return true.
-    const EntityItem *otherItem = dynamic_cast<const EntityItem*>(&other);
-    if (!otherItem || !otherItem->Entity() || ptr.expired())
-        return true;
-
-    const SceneStructureWindow::SortCriteria criteria = tree->SortingCriteria();
-
-    if (criteria == SceneStructureWindow::SortByType || criteria == SceneStructureWindow::SortById)
-    {
-        entity_id_t id_other = otherItem->Id();
-        if (criteria == SceneStructureWindow::SortById)
-            return id < id_other;
-        else
-        {
-            bool replicated = (id < UniqueIdGenerator::FIRST_LOCAL_ID);
-            bool replicated_other = (id_other < UniqueIdGenerator::FIRST_LOCAL_ID);
-            bool temp = Entity()->IsTemporary();
-            bool temp_other = otherItem->Entity()->IsTemporary();
-
-            if ((replicated && !replicated_other) || (!temp && temp_other))
-                return false;
-            else if ((!replicated && replicated_other) || (temp && !temp_other))
-                return true;
-            // Both replicated, local or temp.
-            else
-                return id < id_other;
-        }
-    }
-    else if (criteria == SceneStructureWindow::SortByName)
+    if (column == 0)
     {
-        // Fast route for strings. Its more expensive to fetch EC_Name
-        // and the name attribute from both.
-        const QStringList text_me = text(0).split(" ");
-        const QStringList text_other = other.text(0).split(" ");
-        if (text_me.size() > 1 && text_other.size() > 1)
-            return (text_me[1].localeAwareCompare(text_other[1]) < 0);
-        else
-            return false;
+        if (role == Qt::ForegroundRole)
+            return color;
+        const QString entName = entity->Name();
+        return QString("%1 %2").arg(entity->Id()).arg(entName.isEmpty() ? "(no name)" : entName);
     }
-    else
-        return QTreeWidgetItem::operator <(other);
+    return (role == Qt::DisplayRole ? QVariant(desc) : QVariant(descColor));
 }
 
 // ComponentItem
 
 ComponentItem::ComponentItem(const ComponentPtr &comp, EntityItem *parent) :
-    QTreeWidgetItem(parent),
-    parentItem(parent),
-    ptr(comp),
+    SceneTreeItem(ComponentType, parent),
     typeId(comp->TypeId()),
     typeName(comp->TypeName()),
-    name(comp->Name())
+    ptr(comp)
+{
+}
+
+ComponentPtr ComponentItem::Component() const
+{
+    return ptr.lock();
+}
+
+EntityItem *ComponentItem::Parent() const
 {
-    setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable);
-    SetText(comp.get());
+    return static_cast<EntityItem *>(parent);
 }
 
-void ComponentItem::SetText(IComponent *comp)
+QVariant ComponentItem::Data(int column, int role) const
 {
-    if (ptr.lock().get() != comp)
-        LogWarning("ComponentItem::SetText: the component given is different than the component this item represents.");
+    if (role != Qt::DisplayRole && role != Qt::ForegroundRole)
+        return QVariant();
 
-    QString compType = IComponent::EnsureTypeNameWithoutPrefix(comp->TypeName());
-    QString name = QString("%1 %2").arg(compType).arg(comp->Name());
+    ComponentPtr comp = ptr.lock();
+    if (!comp)
+        return QVariant();
 
     const bool parentLocal = comp->ParentEntity() && comp->ParentEntity()->IsLocal();
     const bool parentTemp = comp->ParentEntity() && comp->ParentEntity()->IsTemporary();
@@ -395,74 +219,60 @@ void ComponentItem::SetText(IComponent *comp)
     if (color == Qt::red && desc == localText)
         color = Qt::blue;
 
-    if (text(0).compare(name, Qt::CaseSensitive) != 0)
-        setText(0, name);
-    if (text(1).compare(desc, Qt::CaseSensitive) != 0)
-        setText(1, desc);
-
-    if (textColor(0) != color)
-        setTextColor(0, color);
-    if (!desc.isEmpty() && textColor(1) != color)
-        setTextColor(1, color);
-}
-
-ComponentPtr ComponentItem::Component() const
-{
-    return ptr.lock();
-}
-
-EntityItem *ComponentItem::Parent() const
-{
-    return parentItem;
+    if (role == Qt::ForegroundRole)
+        return color;
+    if (column == 0)
+        return QString("%1 %2").arg(IComponent::EnsureTypeNameWithoutPrefix(comp->TypeName())).arg(comp->Name());
+    return desc;
 }
 
 // AttributeItem
 
-AttributeItem::AttributeItem(IAttribute *attr, QTreeWidgetItem *parent) :
-    QTreeWidgetItem(parent),
+AttributeItem::AttributeItem(IAttribute *attr, SceneTreeItem *parent) :
+    SceneTreeItem(AttributeType, parent),
     ptr(attr->Owner()->shared_from_this(), attr),
     index(-1)
 {
-    Update(attr);
 }
 
-void AttributeItem::Update(IAttribute *attr)
+QString AttributeItem::Value() const
 {
-    if (attr != ptr.Get())
-    {
-        LogError("AttributeItem::Update: trying to update item with wrong attribute.");
-        return;
-    }
-
-    type = attr->TypeName();
-    name = attr->Name();
-    id = attr->Id();
-    value = attr->ToString();
+    IAttribute *attr = ptr.Get();
+    if (!attr)
+        return QString();
 
     if (index > -1 && attr->TypeId() == cAttributeAssetReferenceList)
     {
         const AssetReferenceList &refs = static_cast<Attribute<AssetReferenceList> *>(attr)->Get();
-        if (index < refs.Size())
-            value = refs[index].ref;
-        id = id + "[" + QString::number(index) + "]";
+        return (index < refs.Size() ? refs[index].ref : QString());
     }
+    return attr->ToString();
+}
 
-    setText(0, QString("%1: %2").arg(id).arg(value));
+QVariant AttributeItem::Data(int column, int role) const
+{
+    IAttribute *attr = ptr.Get();
+    if (column != 0 || role != Qt::DisplayRole || !attr)
+        return QVariant();
+
+    QString id = attr->Id();
+    if (index > -1 && attr->TypeId() == cAttributeAssetReferenceList)
+        id = id + "[" + QString::number(index) + "]";
+    return QString("%1: %2").arg(id).arg(Value());
 }
 
 // AssetRefItem
 
-AssetRefItem::AssetRefItem(IAttribute *attr, QTreeWidgetItem *parent) :
+AssetRefItem::AssetRefItem(IAttribute *attr, SceneTreeItem *parent) :
     AttributeItem(attr, parent)
 {
 }
 
-AssetRefItem::AssetRefItem(IAttribute *attr, int assetRefIndex, QTreeWidgetItem *parent) :
+AssetRefItem::AssetRefItem(IAttribute *attr, int assetRefIndex, SceneTreeItem *parent) :
     AttributeItem(attr, parent)
 {
     // Override the regular AssetReferenceList value "ref1;ref2;etc." with a single ref.
     index = assetRefIndex;
-    Update(attr);
 }
 
 // SceneTreeWidgetSelection
@@ -516,7 +326,7 @@ int SceneTreeWidgetSelection::NumGroupChildren() const
 {
     int num = 0;
     foreach(EntityGroupItem *group, groups)
-        num += group->entityItems.size();
+        num += group->entityIds.size();
     return num;
 }
 
@@ -524,8 +334,8 @@ QList<entity_id_t> SceneTreeWidgetSelection::EntityIds() const
 {
     QSet<entity_id_t> ids;
     foreach(EntityGroupItem *g, groups)
-        foreach(EntityItem *e, g->entityItems)
-            ids.insert(e->Id());
+        foreach(entity_id_t id, g->entityIds)
+            ids.insert(id);
     foreach(EntityItem *e, entities)
         ids.insert(e->Id());
     foreach(ComponentItem *c, components)
@@ -10,80 +10,110 @@
 #include "AssetFwd.h"
 #include "IAttribute.h"
 
-class EntityItem;
+#include <QVector>
 
-/// Tree widget item representing an entity group.
-class EntityGroupItem : public QTreeWidgetItem
+/// A root-level or a group-level row of the scene tree: an entity group if @c group is set, otherwise the entity @c id.
+struct SceneTreeEntry
+{
+    SceneTreeEntry() : id(0) {}
+    explicit SceneTreeEntry(entity_id_t entityId) : id(entityId) {}
+    explicit SceneTreeEntry(const QString &groupName) : id(0), group(groupName) {}
+
+    entity_id_t id; ///< Entity ID, 0 for groups.
+    QString group; ///< Group name, empty for entities.
+};
+
+/// Item of SceneTreeModel.
+/** The model creates the items only for the rows that the view has fetched, and the children of an item only when it is expanded.
+    The text of the items is not stored but read from the scene when the view asks for it. */
+class SceneTreeItem
 {
 public:
-    explicit EntityGroupItem(const QString &groupName);
-    virtual ~EntityGroupItem();
+    enum ItemType
+    {
+        RootType, ///< The invisible root item of the model.
+        GroupType, ///< EntityGroupItem
+        EntityType, ///< EntityItem
+        ComponentType, ///< ComponentItem
+        AttributeType ///< AttributeItem or AssetRefItem
+    };
 
-    const QString &GroupName() const { return name; }
-    void UpdateText();
+    /// Constructor.
+    /** @param type Type of the item.
+        @param parent Parent item, null for the root item. */
+    SceneTreeItem(ItemType type, SceneTreeItem *parent);
+    /// The children are not deleted, SceneTreeModel manages the lifetime of the items.
+    virtual ~SceneTreeItem();
 
-    /// If @c eItem is attached to another group, it will be removed from that group.
-    void AddEntityItems(QList<EntityItem*> eItems, bool checkParenting, bool addAsChild, bool updateText);
-    void AddEntityItem(EntityItem *eItem, bool checkParenting = true, bool addAsChild = true, bool updateText = true);
-    
-    void RemoveEntityItem(EntityItem *item, bool updateText = true);
-    void RemoveAndReparentEntityItem(EntityItem *item, QTreeWidgetItem *newParent, bool updateText = true);
+    ItemType Type() const { return type; }
 
-    void ClearEntityItems(bool updateText);
+    /// Returns the data of the item for the model.
+    virtual QVariant Data(int column, int role) const;
 
-    bool ContainsAllItems(const QList<EntityItem*> &items);
+    /// Returns number of the fetched child group and entity items.
+    int NumEntryChildren() const { return children.size() - numFixedChildren; }
 
-    QList<EntityItem *> entityItems;
+    SceneTreeItem *parent; ///< Parent item.
+    int row; ///< Row of this item in the parent item.
+    QList<SceneTreeItem *> children; ///< Fetched child items, the component and attribute items first, then the group and entity items.
+    int numFixedChildren; ///< Number of the component and attribute items in @c children.
+    QVector<SceneTreeEntry> entries; ///< All child groups and entities of this item, of which the first @c numFetchedEntries have been fetched.
+    int numFetchedEntries; ///< Number of @c entries fetched. Entries of the entities that do not exist anymore are skipped when fetching.
+    bool populated; ///< Have the children of this item been fetched.
+
+private:
+    Q_DISABLE_COPY(SceneTreeItem)
+    const ItemType type;
+};
+
+/// Tree item representing an entity group.
+class EntityGroupItem : public SceneTreeItem
+{
+public:
+    EntityGroupItem(const QString &groupName, SceneTreeItem *parent);
+
+    const QString &GroupName() const { return name; }
 
-    /// QTreeWidgetItem override.
-    /** Uses SceneStructureWindow::SortingCriteria for the criteria, if applicable, otherwise treeWidget::sortColumn(). */
-    bool operator <(const QTreeWidgetItem &rhs) const;
+    /// SceneTreeItem override.
+    QVariant Data(int column, int role) const;
+
+    /// IDs of the entities in this group that are not parented to other entities, in the sorting order.
+    QVector<entity_id_t> entityIds;
 
 private:
-    Q_DISABLE_COPY(EntityGroupItem)
     const QString name;
 };
 
-/// Tree widget item representing an entity.
-class EntityItem : public QTreeWidgetItem
+/// Tree item representing an entity.
+class EntityItem : public SceneTreeItem
 {
 public:
     /// Constructor.
     /** @param entity Entity which the item represents. */
-    explicit EntityItem(const EntityPtr &entity, EntityGroupItem *parent = 0);
-    virtual ~EntityItem();
+    EntityItem(const EntityPtr &entity, SceneTreeItem *parent);
 
-    /// Entity was acked. Updates ptr, id and text.
+    /// Entity was acked. Updates ptr and id.
     void Acked(const EntityPtr &entity);
 
-    /// Calls SetText with current entity ptr.
-    void UpdateText();
-
-    /// Decorates the item (text + color) accordingly to the entity information.
-    /** @param entity Entity which the item represents. */
-    void SetText(::Entity *entity);
-
-    /// Parent entity group item, if the entity is assigned to a group
-    EntityGroupItem* Parent() const;
-
     /// Returns pointer to the entity this item represents.
     EntityPtr Entity() const;
 
-    /// Return Entity ID of the entity associated with this tree widget item.
+    /// Return Entity ID of the entity associated with this tree item.
     entity_id_t Id() const;
 
-    /// QTreeWidgetItem override.
-    /** Uses SceneStructureWindow::SortingCriteria for the criteria, if applicable, otherwise treeWidget::sortColumn(). */
-    bool operator <(const QTreeWidgetItem &rhs) const;
+    /// SceneTreeItem override.
+    /** Decorates the item (text + color) accordingly to the entity information. */
+    QVariant Data(int column, int role) const;
+
+    bool selected; ///< Is the entity selected in the scene, shown with a bold font.
 
 private:
-    Q_DISABLE_COPY(EntityItem)
-    entity_id_t id; ///< Entity ID associated with this tree widget item.
-    EntityWeakPtr ptr; ///< Weak pointer to the component this item represents.
+    entity_id_t id; ///< Entity ID associated with this tree item.
+    EntityWeakPtr ptr; ///< Weak pointer to the entity this item represents.
 };
 
-/// Tree widget item representing a component.
-class ComponentItem : public QTreeWidgetItem
+/// Tree item representing a component.
+class ComponentItem : public SceneTreeItem
 {
 public:
     /// Constructor.
@@ -91,61 +121,63 @@ public:
         @param parent Parent entity item. */
     ComponentItem(const ComponentPtr &comp, EntityItem *parent);
 
-    /// Decorates the item (text + color) accordingly to the component information.
-    /** @param comp Component which the item represents. */
-    void SetText(IComponent *comp);
-
-    /// Returns pointer to the entity this item represents.
+    /// Returns pointer to the component this item represents.
     ComponentPtr Component() const;
 
     /// Returns the parent entity item.
     EntityItem *Parent() const;
 
+    /// SceneTreeItem override.
+    /** Decorates the item (text + color) accordingly to the component information. */
+    QVariant Data(int column, int role) const;
+
     u32 typeId; ///< Type ID.
     QString typeName; ///< Type name.
-    QString name; ///< Name, if applicable.
 
 private:
-    Q_DISABLE_COPY(ComponentItem)
     ComponentWeakPtr ptr; ///< Weak pointer to the component this item represents.
-    EntityItem *parentItem; ///< Parent entity item.
 };
 
-/// Tree widget item representing an asset reference.
-class AttributeItem : public QTreeWidgetItem
+/// Tree item representing an attribute.
+class AttributeItem : public SceneTreeItem
 {
 public:
     /// Constructor.
-    /** @param attr Asset reference attribute.
+    /** @param attr The attribute.
         @param parent Parent item. */
-    AttributeItem(IAttribute *attr, QTreeWidgetItem *parent = 0);
+    AttributeItem(IAttribute *attr, SceneTreeItem *parent);
+
+    /// Returns the attribute, or null if it does not exist anymore.
+    IAttribute *Attribute() const { return ptr.Get(); }
+
+    /// Forgets the attribute, called when the attribute is about to be removed.
+    void Invalidate() { ptr = AttributeWeakPtr(); }
+
+    /// Returns the value of the attribute as a string, or the reference at @c index for AssetReferenceLists.
+    QString Value() const;
 
-    /// Updates the item's text accordingly to the current attribute information.
-    void Update(IAttribute *attr);
+    /// SceneTreeItem override.
+    QVariant Data(int column, int role) const;
 
     AttributeWeakPtr ptr;
-    QString type; ///< Type name.
-    QString id; ///< ID.
-    QString name; ///< Name.
-    QString value; ///< Value.
     int index; ///< AssetReference index in the AssetReferenceList. -1 if not initialized. @todo Maybe to this other list types too?
-
-private:
-    Q_DISABLE_COPY(AttributeItem)
 };
 
-/// Tree widget item representing an asset reference attribute.
+/// Tree item representing an asset reference attribute.
 class AssetRefItem : public AttributeItem
 {
 public:
     /// Constructor.
     /** @param attr AssetReference or AssetReferenceList attribute.
         @param parent Parent item. */
-    AssetRefItem(IAttribute *attr, QTreeWidgetItem *parent = 0);
+    AssetRefItem(IAttribute *attr, SceneTreeItem *parent);
 
     /// Constructor for creating individual items for AssetReferenceList.
-    /** @param assetRef Asset reference. */
-    AssetRefItem(IAttribute *attr, int assetRefIndex, QTreeWidgetItem *parent = 0);
+    /** @param assetRefIndex Index of the asset reference in the list. */
+    AssetRefItem(IAttribute *attr, int assetRefIndex, SceneTreeItem *parent);
+
+    /// Returns the asset reference.
+    QString Ref() const { return Value(); }
 };
 
 /// Represents selection of SceneTreeWidget items.
@@ -21,8 +21,15 @@
 #include "Profiler.h"
 #include "OgreRenderingModule.h"
 #include "OgreWorld.h"
+#include "FrameAPI.h"
+
+#include "Geometry/AABB.h"
+#include "Geometry/OBB.h"
+#include "Geometry/Ray.h"
+#include "Geometry/LineSegment.h"
 
 #include <Ogre.h>
+#include <QThreadPool>
 #include <utility>
 
 #include "MemoryLeakCheck.h"
@@ -30,6 +37,16 @@
 using namespace std;
 using namespace OgreRenderer;
 
+namespace
+{
+    /// If at most this many patches need to be regenerated at once, the geometry is generated synchronously on the main thread,
+    /// which is cheaper than the thread pool round trip for e.g. interactive terrain editing.
+    const size_t cMaxSynchronousPatches = 4;
+
+    /// Interval of the patch level of detail updates, in seconds.
+    const float cLodUpdateInterval = 0.25f;
+}
+
 EC_Terrain::EC_Terrain(Scene* scene) :
     IComponent(scene),
     INIT_ATTRIBUTE(nodeTransformation, "Transform"),
@@ -41,7 +58,10 @@ EC_Terrain::EC_Terrain(Scene* scene) :
     INIT_ATTRIBUTE_VALUE(vScale, "Tex. V scale", 0.13f),
     patchWidth(1),
     patchHeight(1),
-    rootNode(0)
+    rootNode(0),
+    nextGeometryGeneration(1),
+    lodDistance(64.f),
+    lodUpdateTimer(0.f)
 {
     connect(this, SIGNAL(ParentEntitySet()), this, SLOT(UpdateSignals()));
 
@@ -68,6 +88,8 @@ void EC_Terrain::UpdateSignals()
 
         world_ = ParentScene()->Subsystem<OgreWorld>();
         connect(world_.lock()->Renderer(), SIGNAL(DeviceCreated()), SLOT(Recreate()), Qt::UniqueConnection);
+        if (!framework->IsHeadless())
+            connect(framework->Frame(), SIGNAL(Updated(float)), SLOT(OnFrameUpdated(float)), Qt::UniqueConnection);
     }
 }
 
@@ -77,6 +99,10 @@ void EC_Terrain::MakePatchFlat(uint x, uint y, float heightValue)
     patch.heightData.clear();
     patch.heightData.insert(patch.heightData.end(), cPatchSize*cPatchSize, heightValue);
     patch.patch_geometry_dirty = true;
+
+    // The corner vertex of the patch is shared by the seams of all the preceding neighbor patches.
+    heightTree.MarkPatchDirty(x, y);
+    heightTree.MarkVertexDirty(x * cPatchSize, y * cPatchSize);
 }
 
 void EC_Terrain::MakeTerrainFlat(float heightValue)
@@ -122,6 +148,7 @@ void EC_Terrain::ResizeTerrain(uint newPatchWidth, uint newPatchHeight)
         for(uint x = 0; x < min(patchWidth, newPatchWidth); ++x)
             newPatches[y * newPatchWidth + x] = GetPatch(x, y);
     patches = newPatches;
+    heightTree.Invalidate();
     uint oldPatchWidth = patchWidth;
     uint oldPatchHeight = patchHeight;
     patchWidth = newPatchWidth;
@@ -246,6 +273,7 @@ void EC_Terrain::DestroyPatch(uint x, uint y)
     Ogre::SceneManager *sceneMgr = world_.lock()->OgreSceneManager();
     
     EC_Terrain::Patch &patch = GetPatch(x, y);
+    patch.pendingGeneration = 0; // Discard any geometry still being generated for this patch.
 
     if (patch.node)
     {
@@ -304,39 +332,28 @@ void EC_Terrain::SetPointHeight(uint x, uint y, float height)
         return; // Out of bounds signals are silently ignored.
 
     GetPatch(x / cPatchSize, y / cPatchSize).heightData[(y % cPatchSize) * cPatchSize + (x % cPatchSize)] = height;
+    heightTree.MarkVertexDirty(x, y);
 }
 
 float3 EC_Terrain::GetPointOnMap(const float3 &point) const 
 {
-    if (!rootNode)
-    {
-        LogError("GetPointOnMap called before rootNode initialized, returning zeros");
-        return float3(0, 0, 0);
-    }
-    Ogre::Matrix4 worldTM = rootNode->_getFullTransform();
+    float3x4 worldTM = WorldTransform();
 
     // Note: heightmap X & Y correspond to X & Z world axes, while height is world Y
-    Ogre::Matrix4 inv = worldTM.inverse(); // world->local
-    Ogre::Vector4 local = inv * Ogre::Vector4(point.x, point.y, point.z, 1.f);
+    float3x4 inv = worldTM.Inverted(); // world->local
+    float3 local = inv.MulPos(point);
     local.y = GetInterpolatedHeightValue(local.x, local.z);
-    Ogre::Vector4 world = worldTM * local;
-    return float3(world.x, world.y, world.z);
+    return worldTM.MulPos(local);
 }
 
 float3 EC_Terrain::GetPointOnMapLocal(const float3 &point) const
 {
-    if (!rootNode)
-    {
-        LogError("GetPointOnMapLocal called before rootNode initialized, returning zeros");
-        return float3(0, 0, 0);
-    }
-    Ogre::Matrix4 worldTM = rootNode->_getFullTransform();
+    float3x4 worldTM = WorldTransform();
 
     // Note: heightmap X & Y correspond to X & Z world axes, while height is world Y
-    Ogre::Matrix4 inv = worldTM.inverse(); // world->local
-    Ogre::Vector4 local = inv * Ogre::Vector4(point.x, point.y, point.z, 1.f);
+    float3 local = worldTM.Inverted().MulPos(point); // world->local
     local.y = GetInterpolatedHeightValue(local.x, local.z);
-    return float3(local.x, local.y, local.z);
+    return local;
 }
 
 float EC_Terrain::GetDistanceToTerrain(const float3 &point) const
@@ -345,6 +362,83 @@ float EC_Terrain::GetDistanceToTerrain(const float3 &point) const
     return point.y - pointOnMap.y;
 }
 
+void EC_Terrain::GetPointsOnMap(const std::vector<float3> &points, std::vector<float3> &outPoints) const
+{
+    PROFILE(EC_Terrain_GetPointsOnMap);
+
+    const float3x4 worldTM = WorldTransform();
+    const float3x4 inv = worldTM.Inverted();
+
+    outPoints.resize(points.size());
+    for(size_t i = 0; i < points.size(); ++i)
+    {
+        float3 local = inv.MulPos(points[i]);
+        local.y = GetInterpolatedHeightValue(local.x, local.z);
+        outPoints[i] = worldTM.MulPos(local);
+    }
+}
+
+void EC_Terrain::GetDistancesToTerrain(const std::vector<float3> &points, std::vector<float> &outDistances) const
+{
+    std::vector<float3> pointsOnMap;
+    GetPointsOnMap(points, pointsOnMap);
+
+    outDistances.resize(points.size());
+    for(size_t i = 0; i < points.size(); ++i)
+        outDistances[i] = points[i].y - pointsOnMap[i].y;
+}
+
+const TerrainHeightTree &EC_Terrain::HeightTree() const
+{
+    if (heightTree.NeedsUpdate())
+        heightTree.Update(*this);
+    return heightTree;
+}
+
+bool EC_Terrain::Raycast(const Ray &ray, float maxDistance, float &outDistance, float3 *outWorldPos) const
+{
+    const float3x4 worldTM = WorldTransform();
+
+    // The terrain transform may contain scale, so the local space ray is renormalized and
+    // the hit distance is mapped back to world space through the hit point.
+    Ray localRay(worldTM.Inverted().MulPos(ray.pos), worldTM.Inverted().MulDir(ray.dir));
+    const float localDirLength = localRay.dir.Length();
+    if (localDirLength < 1e-6f)
+        return false;
+    localRay.dir /= localDirLength;
+
+    float localMaxDistance = (maxDistance == FLOAT_INF) ? FLOAT_INF : maxDistance * localDirLength;
+    float localDistance;
+    if (!HeightTree().IntersectRay(*this, localRay, localMaxDistance, localDistance))
+        return false;
+
+    outDistance = localDistance / localDirLength;
+    if (outWorldPos)
+        *outWorldPos = ray.GetPoint(outDistance);
+    return true;
+}
+
+float EC_Terrain::RaycastDistance(const Ray &ray) const
+{
+    float distance;
+    return Raycast(ray, FLOAT_INF, distance) ? distance : FLOAT_INF;
+}
+
+bool EC_Terrain::IntersectsSegment(const LineSegment &segment) const
+{
+    const float length = segment.Length();
+    if (length < 1e-6f)
+        return GetDistanceToTerrain(segment.a) < 0.f;
+    float distance;
+    return Raycast(Ray(segment.a, (segment.b - segment.a) / length), length, distance);
+}
+
+bool EC_Terrain::IntersectsAABB(const AABB &aabb) const
+{
+    OBB localBox = aabb.Transform(WorldTransform().Inverted());
+    return HeightTree().IntersectsAABB(*this, localBox.MinimalEnclosingAABB());
+}
+
 bool EC_Terrain::IsOnTopOfMap(const float3 &point) const
 {
     return GetDistanceToTerrain(point) >= 0.f;
@@ -410,8 +504,18 @@ float3 EC_Terrain::Tangent(const float3 &worldPoint, const float3 &worldDir) con
 
 float3x4 EC_Terrain::WorldTransform() const
 {
-    Ogre::Matrix4 worldTM = rootNode->_getFullTransform();
-    return float4x4(worldTM).Float3x4Part();
+    if (rootNode && !framework->IsHeadless())
+    {
+        Ogre::Matrix4 worldTM = rootNode->_getFullTransform();
+        return float4x4(worldTM).Float3x4Part();
+    }
+
+    // No (up-to-date) Ogre scene node, e.g. on a headless server: compose the transform from the attributes in the same way
+    // the root node is set up in UpdateRootNodeTransform and AttachTerrainRootNode.
+    const Transform &tm = nodeTransformation.Get();
+    float3x4 localTM = float3x4::FromTRS(tm.pos, float3x3::FromEulerXYZ(DegToRad(tm.rot.x), DegToRad(tm.rot.y), DegToRad(tm.rot.z)), tm.scale);
+    shared_ptr<EC_Placeable> placeable = (ParentEntity() ? ParentEntity()->Component<EC_Placeable>() : shared_ptr<EC_Placeable>());
+    return placeable ? placeable->LocalToWorld() * localTM : localTM;
 }
 
 void EC_Terrain::GetTriangleNormals(float x, float y, float3 &n1, float3 &n2, float3 &n3, float &u, float &v) const
@@ -499,8 +603,7 @@ float3 EC_Terrain::GetPlaneNormal(float x, float y) const
     // h1 to h3 are the three terrain height points in local coordinate space.
     float3 normal = (h3-h2).Cross(h3-h1);
 
-    float4x4 worldTM = rootNode->_getFullTransform();
-    return worldTM.MulDir(normal).Normalized();
+    return WorldTransform().MulDir(normal).Normalized();
 }
 
 float3 EC_Terrain::GetInterpolatedNormal(float x, float y) const
@@ -512,8 +615,7 @@ float3 EC_Terrain::GetInterpolatedNormal(float x, float y) const
     // h1 to h3 are the three terrain height points in local coordinate space.
     float3 normal = (1.f - u - v) * n1 + u * n2 + v * n3;
 
-    float4x4 worldTM = rootNode->_getFullTransform();
-    return worldTM.MulDir(normal).Normalized();
+    return WorldTransform().MulDir(normal).Normalized();
 }
 
 float3 EC_Terrain::CalculateNormal(uint x, uint y, uint xinside, uint yinside) const
@@ -521,16 +623,17 @@ float3 EC_Terrain::CalculateNormal(uint x, uint y, uint xinside, uint yinside) c
     uint px = x * cPatchSize + xinside;
     uint py = y * cPatchSize + yinside;
 
-    uint xNext = Clamp(px+1, 0U, patchWidth * cPatchSize - 1);
-    uint yNext = Clamp(py+1, 0U, patchHeight * cPatchSize - 1);
-    uint xPrev = Clamp(px-1, 0U, patchWidth * cPatchSize - 1);
-    uint yPrev = Clamp(py-1, 0U, patchHeight * cPatchSize - 1);
+    // Note: keep in sync with the normal calculation in TerrainPatchGeometry.cpp.
+    uint xNext = min(px+1, patchWidth * cPatchSize - 1);
+    uint yNext = min(py+1, patchHeight * cPatchSize - 1);
+    uint xPrev = (px > 0) ? px-1 : px;
+    uint yPrev = (py > 0) ? py-1 : py;
 
     float x_slope = GetPoint(xPrev, py) - GetPoint(xNext, py);
-    if ((px <= 0) || (px >= patchWidth * cPatchSize))
+    if ((px <= 0) || (px + 1 >= patchWidth * cPatchSize))
         x_slope *= 2;
     float y_slope = GetPoint(px, yPrev) - GetPoint(px, yNext);
-    if ((py <= 0) || (py >= patchHeight * cPatchSize))
+    if ((py <= 0) || (py + 1 >= patchHeight * cPatchSize))
         y_slope *= 2;
 
     // Note: heightmap X & Y correspond to X & Z world axes, while height is world Y
@@ -636,6 +739,7 @@ bool EC_Terrain::LoadFromDataInMemory(const char *data, size_t numBytes)
     Destroy();
 
     patches = newPatches;
+    heightTree.Invalidate();
     patchWidth = xPatches;
     patchHeight = yPatches;
 
@@ -1170,8 +1274,63 @@ void EC_Terrain::GenerateTerrainGeometryForOnePatch(uint patchX, uint patchY)
 {
     PROFILE(EC_Terrain_GenerateTerrainGeometryForOnePatch);
 
+    if (!ViewEnabled())
+        return;
+    if (world_.expired())
+        return;
+
+    TerrainPatchGeometryInput input;
+    CreatePatchGeometryInput(patchX, patchY, input);
+
+    TerrainPatchGeometry geometry;
+    GenerateTerrainPatchGeometry(input, geometry);
+    UploadPatchGeometry(geometry);
+}
+
+void EC_Terrain::CreatePatchGeometryInput(uint patchX, uint patchY, TerrainPatchGeometryInput &input)
+{
     EC_Terrain::Patch &patch = GetPatch(patchX, patchY);
 
+    input.patchX = patchX;
+    input.patchY = patchY;
+    input.lod = (lodDistance > 0.f ? patch.lod : 0);
+    input.generation = nextGeometryGeneration++;
+    input.verticesWidth = VerticesWidth();
+    input.verticesHeight = VerticesHeight();
+    input.uScale = uScale.Get();
+    input.vScale = vScale.Get();
+
+    // The skirts need to reach down at least as far as any crack between this patch and a neighbor of different level of detail can be.
+    float minHeight, maxHeight;
+    if (lodDistance > 0.f && HeightTree().PatchHeightRange(patchX, patchY, minHeight, maxHeight))
+        input.skirtDepth = maxHeight - minHeight + 1.f;
+
+    // Snapshot the heights of the patch, its seams and a one-vertex border needed for the normals.
+    input.windowX = (patchX > 0) ? patchX * cPatchSize - 1 : 0;
+    input.windowY = (patchY > 0) ? patchY * cPatchSize - 1 : 0;
+    const uint windowEndX = min((patchX + 1) * cPatchSize + 2, VerticesWidth());
+    const uint windowEndY = min((patchY + 1) * cPatchSize + 2, VerticesHeight());
+    input.windowWidth = windowEndX - input.windowX;
+    input.windowHeight = windowEndY - input.windowY;
+    input.heights.resize(input.windowWidth * input.windowHeight);
+    for(uint y = 0; y < input.windowHeight; ++y)
+        for(uint x = 0; x < input.windowWidth; ++x)
+            input.heights[y * input.windowWidth + x] = GetPoint(input.windowX + x, input.windowY + y);
+
+    patch.pendingGeneration = input.generation;
+    patch.patch_geometry_dirty = false;
+}
+
+void EC_Terrain::UploadPatchGeometry(const TerrainPatchGeometry &geometry)
+{
+    PROFILE(EC_Terrain_UploadPatchGeometry);
+
+    if (!PatchExists(geometry.patchX, geometry.patchY))
+        return;
+    EC_Terrain::Patch &patch = GetPatch(geometry.patchX, geometry.patchY);
+    if (patch.pendingGeneration != geometry.generation)
+        return; // The patch has been modified, resized or destroyed after this geometry was requested.
+
     if (!ViewEnabled())
         return;
     if (world_.expired())
@@ -1180,8 +1339,6 @@ void EC_Terrain::GenerateTerrainGeometryForOnePatch(uint patchX, uint patchY)
     Ogre::SceneManager *sceneMgr = world->OgreSceneManager();
 
     Ogre::SceneNode *node = patch.node;
-    bool firstTimeFill = (node == 0);
-    UNREFERENCED_PARAM(firstTimeFill);
     if (!node)
     {
         CreateOgreTerrainPatchNode(node, patch.x, patch.y);
@@ -1197,96 +1354,19 @@ void EC_Terrain::GenerateTerrainGeometryForOnePatch(uint patchX, uint patchY)
     manual->setCastShadows(false);
 
     manual->clear();
-    manual->estimateVertexCount((cPatchSize+1)*(cPatchSize+1));
-    manual->estimateIndexCount((cPatchSize+1)*(cPatchSize+1)*3*2);
+    manual->estimateVertexCount(geometry.positions.size());
+    manual->estimateIndexCount(geometry.indices.size());
     manual->begin(terrainMaterial->getName(), Ogre::RenderOperation::OT_TRIANGLE_LIST);
 
-    const float vertexSpacingX = 1.f;
-    const float vertexSpacingY = 1.f;
-    const float patchSpacingX = cPatchSize * vertexSpacingX;
-    const float patchSpacingY = cPatchSize * vertexSpacingY;
-    const Ogre::Vector3 patchOrigin(patch.x * patchSpacingX, 0.f, patch.y * patchSpacingY);
-// Opensim:    const Ogre::Vector3 patchOrigin(patch.x * patchSpacingX, patch.y * patchSpacingY, 0.f);
-
-    int curIndex = 0;
-
-    const int cPatchVertexWidth = cPatchSize; // The number of vertices in the patch in horizontal direction. We use the fixed value of cPatchSize==16.
-    const int cPatchVertexHeight = cPatchSize; // The number of vertices in the patch in vertical  direction. We use the fixed value of cPatchSize==16.
-    // If we assume each patch is 16x16 vertices, then all the internal patches will get a 17x17 grid, since we need to connect seams.
-    // But, the outermost patch row and column at the terrain edge will not have this, since they do not need to connect to a next patch.
-    // This is the vertex stride for the terrain.
-    const int stride = (patch.x + 1 >= patchWidth) ? cPatchVertexWidth : (cPatchVertexWidth+1);
-
-    const float uScale = this->uScale.Get();
-    const float vScale = this->vScale.Get();
-
-    for(int y = 0; y <= cPatchVertexHeight; ++y)
-        for(int x = 0; x <= cPatchVertexWidth; ++x)
-        {
-            if ((patch.x + 1 >= patchWidth && x == cPatchVertexWidth) ||
-                (patch.y + 1 >= patchHeight && y == cPatchVertexHeight))
-                continue; // We are at the single corner-most vertex of the whole terrain. That is to be skipped.
-
-            // These coordinates are directly generated to our Ogre coordinate system, i.e. are cycled from OpenSim XYZ -> our YZX.
-            // see OpenSimToOgreCoordinateAxes.
-            Ogre::Vector3 pos;
-            pos.x = vertexSpacingX * x;
-            pos.z = vertexSpacingY * y;
-// Opensim:             pos.x = vertexSpacingX * x;
-// Opensim              pos.y = vertexSpacingY * y;
-
-            EC_Terrain::Patch *thisPatch;
-            int X = x;
-            int Y = y;
-            if (x < cPatchVertexWidth && y < cPatchVertexHeight)
-            {
-                thisPatch = &patch;
-
-                if ((patch.x + 1 < patchWidth || x+1 < cPatchVertexWidth) &&
-                    (patch.y + 1 < patchHeight || y+1 < cPatchVertexHeight))
-                {
-                    // Note: winding needs to be flipped when terrain X axis goes along world X axis and terrain Y axis along world Z
-                    manual->index(curIndex+stride);
-                    manual->index(curIndex+1);
-                    manual->index(curIndex);
-
-                    manual->index(curIndex+stride);
-                    manual->index(curIndex+stride+1);
-                    manual->index(curIndex+1);
-                }
-            }
-            else if (x == cPatchVertexWidth && y == cPatchVertexHeight)
-            {
-                thisPatch = &GetPatch(patch.x + 1, patch.y + 1);
-                X = 0;
-                Y = 0;
-            }
-            else if (x == cPatchVertexWidth)
-            {
-                thisPatch = &GetPatch(patch.x + 1, patch.y);
-                X = 0;
-            }
-            else // (y == patchHeight)
-            {
-                thisPatch = &GetPatch(patch.x, patch.y + 1);
-                Y = 0;
-            }
-
-            pos.y = thisPatch->heightData[Y*cPatchVertexWidth+X];
-// Opensim:            pos.z = thisPatch->heightData[Y*cPatchVertexWidth+X];
-
-            manual->position(pos);
-            manual->normal(CalculateNormal(thisPatch->x, thisPatch->y, X, Y));
-
-            // The UV set 0 contains the diffuse texture UV map. Do a planar mapping with the given specified UV scale.
-            manual->textureCoord((patchOrigin.x + pos.x) * uScale, (patchOrigin.z + pos.z) * vScale);
-// Opensim:             manual->textureCoord((patchOrigin.x + pos.x) * uScale, (patchOrigin.y + pos.y) * vScale);
-
-            // The UV set 1 contains the terrain blend mask UV map, which stretches once across the whole terrain.
-            manual->textureCoord((float)(patch.x*cPatchSize + x)/(VerticesWidth()-1), (float)(patch.y*cPatchSize + y)/(VerticesHeight()-1)); 
-
-            ++curIndex;
-        }
+    for(size_t i = 0; i < geometry.positions.size(); ++i)
+    {
+        manual->position(geometry.positions[i]);
+        manual->normal(geometry.normals[i]);
+        manual->textureCoord(geometry.uv0[i].x, geometry.uv0[i].y);
+        manual->textureCoord(geometry.uv1[i].x, geometry.uv1[i].y);
+    }
+    for(size_t i = 0; i < geometry.indices.size(); ++i)
+        manual->index(geometry.indices[i]);
 
     manual->end();
 
@@ -1324,8 +1404,109 @@ void EC_Terrain::GenerateTerrainGeometryForOnePatch(uint patchX, uint patchY)
     node->detachAllObjects();
     // Now attach the new built terrain mesh.
     node->attachObject(patch.entity);
+}
 
-    patch.patch_geometry_dirty = false;
+void EC_Terrain::ProcessCompletedPatchGeometry()
+{
+    if (!geometryQueue)
+        return;
+
+    QList<TerrainPatchGeometry> completed;
+    geometryQueue->TakeCompleted(completed);
+    if (completed.isEmpty())
+        return;
+
+    PROFILE(EC_Terrain_ProcessCompletedPatchGeometry);
+
+    for(int i = 0; i < completed.size(); ++i)
+        UploadPatchGeometry(completed[i]);
+
+    if (geometryQueue->NumPending() == 0)
+    {
+        // Re-apply the placeable visibility on the new geometry.
+        AttachTerrainRootNode();
+        emit TerrainRegenerated();
+    }
+}
+
+void EC_Terrain::SetLodDistance(float distance)
+{
+    distance = max(0.f, distance);
+    if (distance == lodDistance)
+        return;
+
+    // Enabling or disabling level of detail changes the skirts of all patches.
+    if ((distance > 0.f) != (lodDistance > 0.f))
+        DirtyAllTerrainPatches();
+    lodDistance = distance;
+    UpdatePatchLods();
+    RegenerateDirtyTerrainPatches();
+}
+
+uint EC_Terrain::PatchLodForDistance(float distance) const
+{
+    if (lodDistance <= 0.f || distance < lodDistance)
+        return 0;
+    // Each level of detail is used until twice the distance of the previous one.
+    const uint lod = 1 + (uint)Log2(distance / lodDistance);
+    return lod < cMaxPatchLod ? lod : cMaxPatchLod;
+}
+
+void EC_Terrain::UpdatePatchLods()
+{
+    if (lodDistance <= 0.f || world_.expired())
+        return;
+
+    Entity *cameraEntity = world_.lock()->Renderer()->MainCamera();
+    if (!cameraEntity || cameraEntity->ParentScene() != ParentScene())
+        return;
+    shared_ptr<EC_Placeable> cameraPlaceable = cameraEntity->Component<EC_Placeable>();
+    if (!cameraPlaceable)
+        return;
+
+    PROFILE(EC_Terrain_UpdatePatchLods);
+
+    const float3x4 worldTM = WorldTransform();
+    const float3 cameraWorldPos = cameraPlaceable->WorldPosition();
+    const float3 cameraLocalPos = worldTM.Inverted().MulPos(cameraWorldPos);
+    const TerrainHeightTree &tree = HeightTree();
+
+    bool lodChanged = false;
+    for(uint y = 0; y < patchHeight; ++y)
+        for(uint x = 0; x < patchWidth; ++x)
+        {
+            EC_Terrain::Patch &patch = GetPatch(x, y);
+            float minHeight, maxHeight;
+            if (!patch.node || !tree.PatchHeightRange(x, y, minHeight, maxHeight))
+                continue;
+
+            // Measure the distance in world space to the closest point of the patch bounds.
+            AABB patchBounds(float3((float)(x * cPatchSize), minHeight, (float)(y * cPatchSize)),
+                float3((float)((x + 1) * cPatchSize), maxHeight, (float)((y + 1) * cPatchSize)));
+            const float distance = worldTM.MulPos(patchBounds.ClosestPoint(cameraLocalPos)).Distance(cameraWorldPos);
+            const uint lod = PatchLodForDistance(distance);
+            if (lod != patch.lod)
+            {
+                patch.lod = lod;
+                patch.patch_geometry_dirty = true;
+                lodChanged = true;
+            }
+        }
+
+    if (lodChanged)
+        RegenerateDirtyTerrainPatches();
+}
+
+void EC_Terrain::OnFrameUpdated(float frameTime)
+{
+    ProcessCompletedPatchGeometry();
+
+    lodUpdateTimer -= frameTime;
+    if (lodUpdateTimer <= 0.f)
+    {
+        lodUpdateTimer = cLodUpdateInterval;
+        UpdatePatchLods();
+    }
 }
 
 void EC_Terrain::CreateRootNode()
@@ -1409,6 +1590,7 @@ void EC_Terrain::Resize(uint newWidth, uint newHeight, uint oldPatchStartX, uint
             newPatches[y * newWidth + x] = patches[(y + oldPatchStartY) * xPatches.Get() + x + oldPatchStartX];
 
     patches = newPatches;
+    heightTree.Invalidate();
     xPatches.Set(newWidth, AttributeChange::Disconnected);
     yPatches.Set(newHeight, AttributeChange::Disconnected);
     patchWidth = newWidth;
@@ -1444,8 +1626,9 @@ void EC_Terrain::RegenerateDirtyTerrainPatches()
     if (!parentEntity)
         return;
     EC_Placeable *position = parentEntity->Component<EC_Placeable>().get();
-    if (!GetFramework()->IsHeadless() && (!position || position->visible.Get())) // Only need to create GPU resources if the placeable itself is visible.
+    if (!GetFramework()->IsHeadless() && (!position || position->visible.Get()) && ViewEnabled() && !world_.expired()) // Only need to create GPU resources if the placeable itself is visible.
     {
+        std::vector<uint> readyPatches;
         for(uint y = 0; y < patchHeight; ++y)
             for(uint x = 0; x < patchWidth; ++x)
             {
@@ -1476,13 +1659,35 @@ void EC_Terrain::RegenerateDirtyTerrainPatches()
                 }
 
                 if (neighborsLoaded)
-                    GenerateTerrainGeometryForOnePatch(x, y);
+                    readyPatches.push_back(y * patchWidth + x);
             }
+
+        if (readyPatches.size() <= cMaxSynchronousPatches)
+        {
+            for(size_t i = 0; i < readyPatches.size(); ++i)
+                GenerateTerrainGeometryForOnePatch(readyPatches[i] % patchWidth, readyPatches[i] / patchWidth);
+        }
+        else
+        {
+            // Generate the vertex, normal and index data on the worker threads. The results are uploaded
+            // to the GPU on the main thread in ProcessCompletedPatchGeometry.
+            if (!geometryQueue)
+                geometryQueue = MAKE_SHARED(TerrainPatchGeometryQueue);
+            for(size_t i = 0; i < readyPatches.size(); ++i)
+            {
+                TerrainPatchGeometryInput input;
+                CreatePatchGeometryInput(readyPatches[i] % patchWidth, readyPatches[i] / patchWidth, input);
+                geometryQueue->JobStarted();
+                QThreadPool::globalInstance()->start(new TerrainPatchGeometryJob(geometryQueue, input));
+            }
+        }
     }
     
     // All the new geometry we created will be visible for Ogre by default. If the EC_Placeable's visible attribute is false,
     // we need to hide all newly created geometry.
     AttachTerrainRootNode();
 
-    emit TerrainRegenerated();
+    // If geometry is still being generated, the signal is emitted once the last patch has been uploaded.
+    if (!geometryQueue || geometryQueue->NumPending() == 0)
+        emit TerrainRegenerated();
 }
@@ -10,6 +10,8 @@
 #include "AssetFwd.h"
 #include "AssetRefListener.h"
 #include "OgreModuleFwd.h"
+#include "TerrainHeightTree.h"
+#include "TerrainPatchGeometry.h"
 
 namespace Ogre { class Matrix4; }
 
@@ -96,6 +98,9 @@ public:
     /// Each patch is a square containing this many vertices per side.
     static const uint cPatchSize = 16;
 
+    /// The coarsest patch level of detail, which reduces a patch to a single quad.
+    static const uint cMaxPatchLod = 4;
+
     /// Describes a single patch that is present in the scene.
     /** A patch can be in one of the following three states:
         - not loaded. The height data nor the GPU data is present, but the Patch struct itself is initialized. heightData.size() == 0, node == entity == 0. meshGeometryName == "".
@@ -104,7 +109,7 @@ public:
         - fully loaded. The GPU data is also loaded and the node, entity and meshGeometryName fields specify the used GPU resources. */
     struct Patch
     {
-        Patch():x(0),y(0), node(0), entity(0), patch_geometry_dirty(true) {}
+        Patch():x(0),y(0), node(0), entity(0), patch_geometry_dirty(true), lod(0), pendingGeneration(0) {}
 
         /// X-coordinate on the grid of patches. In the range [0, EC_Terrain::PatchWidth()].
         uint x;
@@ -130,6 +135,12 @@ public:
         /// in yet.
         bool patch_geometry_dirty;
 
+        /// The level of detail of the patch geometry. The patch grid is decimated to every (1 << lod)th vertex.
+        uint lod;
+
+        /// Identifies the most recently requested geometry generation for this patch. Results of older requests are discarded.
+        u32 pendingGeneration;
+
         /// Call only when you've checked that this patch has been loaded in.
         float GetHeightValue(uint x, uint y) const { return heightData[y*cPatchSize+x]; }
     };
@@ -163,6 +174,28 @@ public:
 
     float3 CalculateNormal(uint mapX, uint mapY) const { return CalculateNormal( (uint) mapX / cPatchSize, (uint) mapY / cPatchSize, mapX % cPatchSize, mapY % cPatchSize); }
 
+    /// Computes the closest intersection of the given world space ray with the terrain.
+    /** Uses the terrain height tree and works without a renderer, e.g. on headless servers.
+        @param ray The ray in world space.
+        @param maxDistance Hits further away than this along the ray are ignored.
+        @param outDistance [out] The distance along the ray to the hit point.
+        @param outWorldPos [out] If non-null, receives the hit point in world space.
+        @return True if the ray hits the terrain. */
+    bool Raycast(const Ray &ray, float maxDistance, float &outDistance, float3 *outWorldPos = 0) const;
+
+    /// Returns the points on the terrain in world space that lie on top of the given world space points.
+    /** Batched version of GetPointOnMap: the world transform of the terrain is computed only once for the whole batch.
+        @param points The points in world space.
+        @param outPoints [out] Receives the corresponding points on the terrain, in the same order. */
+    void GetPointsOnMap(const std::vector<float3> &points, std::vector<float3> &outPoints) const;
+
+    /// Returns the signed distances (in world space) of the given points to the terrain, in the same order.
+    /** Batched version of GetDistanceToTerrain. */
+    void GetDistancesToTerrain(const std::vector<float3> &points, std::vector<float> &outDistances) const;
+
+    /// Returns the min/max height acceleration structure of this terrain, brought up to date with the current height data.
+    const TerrainHeightTree &HeightTree() const;
+
 public slots:
     /// Returns true if the given patch exists, i.e. whether the given coordinates are within the current terrain patch dimensions.
     /** This function does not tell whether the data for the patch is actually loaded on the CPU or the GPU. */
@@ -210,6 +243,21 @@ public slots:
     /// Returns true if given point in world space is on top (in terms of the local terrain up axis) of, or lying on, the terrain.
     bool IsOnTopOfMap(const float3 &point) const;
 
+    /// Casts a world space ray against the terrain.
+    /** Uses the terrain height tree and works without a renderer, e.g. on headless servers.
+        @param ray The ray in world space.
+        @return The distance along the ray to the closest hit point, or infinity if the ray does not hit the terrain. */
+    float RaycastDistance(const Ray &ray) const;
+
+    /// Tests whether the given world space line segment passes through the terrain surface.
+    /** Useful for line-of-sight checks. Works without a renderer. */
+    bool IntersectsSegment(const LineSegment &segment) const;
+
+    /// Tests whether the terrain surface passes through the given world space AABB.
+    /** The box is transformed to the local space of the terrain, where a bounding box of the transformed
+        box is used, so the test is conservative for rotated terrains. Works without a renderer. */
+    bool IntersectsAABB(const AABB &aabb) const;
+
     /// Returns the interpolated height value of the terrain at the given fractional coordinate.
     /// @param x In the range [0, EC_Terrain::PatchWidth * EC_Terrain::cPatchSize-1.0f ].
     /// @param y In the range [0, EC_Terrain::PatchHeight * EC_Terrain::cPatchSize-1.0f ].
@@ -350,6 +398,17 @@ public slots:
 
     void RegenerateDirtyTerrainPatches();
 
+    /// Sets the camera distance (in world units) at which terrain patches switch to the first decimated level of detail.
+    /** Each further level of detail is used at twice the distance of the previous one. Pass 0 to disable level of detail,
+        in which case all patches are generated at full resolution and without skirts. The default is 64. */
+    void SetLodDistance(float distance);
+
+    /// Returns the camera distance at which terrain patches switch to the first decimated level of detail.
+    float LodDistance() const { return lodDistance; }
+
+    /// Returns the level of detail that is used for a patch at the given distance from the camera.
+    uint PatchLodForDistance(float distance) const;
+
     /// Returns the minimum height value in the whole terrain.
     /** This function blindly iterates through the whole terrain, so avoid calling it in performance-critical code. */
     float GetTerrainMinHeight() const;
@@ -375,6 +434,9 @@ private slots:
     void MaterialAssetLoaded(AssetPtr asset);
     void TerrainAssetLoaded(AssetPtr asset);
 
+    /// Uploads completed patch geometry and updates the patch levels of detail.
+    void OnFrameUpdated(float frameTime);
+
     /// (Re)checks whether this entity has EC_Placeable (or if it was just added or removed), and reparents the rootNode of this component to it or the scene root.
     /** Additionally re-applies the visibility of each terrain patch that is currently attached to the terrain node. */
     void AttachTerrainRootNode();
@@ -405,9 +467,21 @@ private:
     void SetTerrainMaterialTexture(uint index, const QString &textureName);
 
     /// Creates Ogre geometry data for the single given patch, or updates the geometry for an existing
-    /// patch if the associated Ogre resources already exist.
+    /// patch if the associated Ogre resources already exist. Generates the geometry synchronously on the main thread.
     void GenerateTerrainGeometryForOnePatch(uint patchX, uint patchY);
 
+    /// Fills in the geometry generation request for the given patch and assigns it a new generation number.
+    void CreatePatchGeometryInput(uint patchX, uint patchY, TerrainPatchGeometryInput &input);
+
+    /// Creates or updates the Ogre resources of a patch from the given CPU-side geometry. Stale geometry is ignored.
+    void UploadPatchGeometry(const TerrainPatchGeometry &geometry);
+
+    /// Uploads all patch geometry that the worker jobs have completed since the last call.
+    void ProcessCompletedPatchGeometry();
+
+    /// Recomputes the level of detail of each patch from the main camera position, and regenerates the patches whose level changed.
+    void UpdatePatchLods();
+
     shared_ptr<AssetRefListener> heightMapAsset;
 
     /// For all terrain patches, we maintain a global parent/root node to be able to transform the whole terrain at one go.
@@ -425,8 +499,23 @@ private:
 
     /// Stores the actual height patches.
     std::vector<Patch> patches;
+
+    /// Min/max height pyramid over the patches, used for the CPU-side spatial queries. Updated lazily on query.
+    mutable TerrainHeightTree heightTree;
     
     /// Ogre world for referring to the Ogre scene manager
     OgreWorldWeakPtr world_;
+
+    /// Receives the patch geometry generated by worker jobs. Created on first use.
+    TerrainPatchGeometryQueuePtr geometryQueue;
+
+    /// Generation number to give for the next patch geometry request.
+    u32 nextGeometryGeneration;
+
+    /// Camera distance at which the first decimated level of detail is used. Zero if level of detail is disabled.
+    float lodDistance;
+
+    /// Time left until the next level of detail update, in seconds.
+    float lodUpdateTimer;
 };
 COMPONENT_TYPEDEFS(Terrain);
@@ -8,6 +8,7 @@
 
 #include "EC_WaterPlane.h"
 #include "EC_Terrain.h"
+#include "TerrainSpatialBoundsProvider.h"
 
 #include "Framework.h"
 #include "SceneAPI.h"
@@ -30,6 +31,7 @@ DEFINE_STATIC_PLUGIN_MAIN(EnvironmentModule)
     Framework::SetInstance(fw); // Inside this DLL, remember the pointer to the global framework object.
     fw->Scene()->RegisterComponentFactory(MAKE_SHARED(GenericComponentFactory<EC_Terrain>));
     fw->Scene()->RegisterComponentFactory(MAKE_SHARED(GenericComponentFactory<EC_WaterPlane>));
+    fw->Scene()->RegisterSpatialBoundsProvider(MAKE_SHARED(TerrainSpatialBoundsProvider));
     // Create an asset type factory for Terrain assets. The terrain assets are handled as binary blobs - the EC_Terrain parses it when showing the asset.
     fw->Asset()->RegisterAssetTypeFactory(MAKE_SHARED(BinaryAssetFactory, "Terrain", ".ntf"));
 }
@@ -0,0 +1,414 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "DebugOperatorNew.h"
+
+#include "TerrainHeightTree.h"
+#include "EC_Terrain.h"
+#include "Profiler.h"
+
+#include "Geometry/AABB.h"
+#include "Geometry/Ray.h"
+#include "Geometry/Triangle.h"
+#include "Math/float3.h"
+#include "Math/MathFunc.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    const uint cPatchSize = EC_Terrain::cPatchSize;
+
+    /// Reads the height of the given terrain vertex. Returns false if the patch the vertex belongs to has not been loaded yet.
+    inline bool VertexHeight(const EC_Terrain &terrain, uint x, uint y, float &height)
+    {
+        const EC_Terrain::Patch &patch = terrain.GetPatch(x / cPatchSize, y / cPatchSize);
+        if (patch.heightData.empty())
+            return false;
+        height = patch.GetHeightValue(x % cPatchSize, y % cPatchSize);
+        return true;
+    }
+
+    struct ChildHit
+    {
+        uint x;
+        uint y;
+        float tNear;
+
+        bool operator <(const ChildHit &rhs) const { return tNear < rhs.tNear; }
+    };
+}
+
+TerrainHeightTree::TerrainHeightTree() :
+    verticesWidth(0),
+    verticesHeight(0),
+    needsRebuild(true)
+{
+}
+
+void TerrainHeightTree::Invalidate()
+{
+    levels.clear();
+    dirtyPatches.clear();
+    patchDirtyFlags.clear();
+    verticesWidth = 0;
+    verticesHeight = 0;
+    needsRebuild = true;
+}
+
+void TerrainHeightTree::MarkPatchDirty(uint patchX, uint patchY)
+{
+    if (needsRebuild || levels.empty())
+        return; // The whole tree will be rebuilt anyways.
+
+    const Level &leaves = levels.front();
+    if (patchX >= leaves.width || patchY >= leaves.height)
+        return;
+
+    const uint index = patchY * leaves.width + patchX;
+    if (!patchDirtyFlags[index])
+    {
+        patchDirtyFlags[index] = true;
+        dirtyPatches.push_back(index);
+    }
+}
+
+void TerrainHeightTree::MarkVertexDirty(uint x, uint y)
+{
+    const uint patchX = x / cPatchSize;
+    const uint patchY = y / cPatchSize;
+    MarkPatchDirty(patchX, patchY);
+
+    // Vertices on the first row or column of a patch are also the seam vertices of the preceding patches.
+    const bool onSeamX = (x % cPatchSize == 0 && patchX > 0);
+    const bool onSeamY = (y % cPatchSize == 0 && patchY > 0);
+    if (onSeamX)
+        MarkPatchDirty(patchX - 1, patchY);
+    if (onSeamY)
+        MarkPatchDirty(patchX, patchY - 1);
+    if (onSeamX && onSeamY)
+        MarkPatchDirty(patchX - 1, patchY - 1);
+}
+
+void TerrainHeightTree::Update(const EC_Terrain &terrain)
+{
+    if (needsRebuild || levels.empty() || levels.front().width != terrain.PatchWidth() || levels.front().height != terrain.PatchHeight())
+    {
+        Rebuild(terrain);
+        return;
+    }
+
+    if (dirtyPatches.empty())
+        return;
+
+    PROFILE(TerrainHeightTree_Update);
+
+    const uint leafWidth = levels.front().width;
+    for(size_t i = 0; i < dirtyPatches.size(); ++i)
+    {
+        uint x = dirtyPatches[i] % leafWidth;
+        uint y = dirtyPatches[i] / leafWidth;
+        patchDirtyFlags[dirtyPatches[i]] = false;
+        ComputeLeaf(terrain, x, y);
+
+        // Propagate the change up to the root. Siblings dirtied in the same batch get recomputed redundantly, but
+        // the cost is four node reads per level, which is negligible compared to the leaf refresh.
+        for(uint level = 1; level < levels.size(); ++level)
+        {
+            x /= 2;
+            y /= 2;
+            ComputeParent(level, x, y);
+        }
+    }
+    dirtyPatches.clear();
+}
+
+void TerrainHeightTree::Rebuild(const EC_Terrain &terrain)
+{
+    PROFILE(TerrainHeightTree_Rebuild);
+
+    levels.clear();
+    dirtyPatches.clear();
+    needsRebuild = false;
+
+    verticesWidth = terrain.VerticesWidth();
+    verticesHeight = terrain.VerticesHeight();
+
+    Level leaves;
+    leaves.width = terrain.PatchWidth();
+    leaves.height = terrain.PatchHeight();
+    if (leaves.width == 0 || leaves.height == 0)
+    {
+        patchDirtyFlags.clear();
+        return;
+    }
+    leaves.nodes.resize(leaves.width * leaves.height);
+    levels.push_back(leaves);
+    patchDirtyFlags.assign(leaves.nodes.size(), false);
+
+    for(uint y = 0; y < leaves.height; ++y)
+        for(uint x = 0; x < leaves.width; ++x)
+            ComputeLeaf(terrain, x, y);
+
+    while(levels.back().width > 1 || levels.back().height > 1)
+    {
+        Level parent;
+        parent.width = (levels.back().width + 1) / 2;
+        parent.height = (levels.back().height + 1) / 2;
+        parent.nodes.resize(parent.width * parent.height);
+        levels.push_back(parent);
+
+        const uint level = (uint)levels.size() - 1;
+        for(uint y = 0; y < parent.height; ++y)
+            for(uint x = 0; x < parent.width; ++x)
+                ComputeParent(level, x, y);
+    }
+}
+
+void TerrainHeightTree::PatchVertexRange(uint patchX, uint patchY, uint &x0, uint &y0, uint &x1, uint &y1) const
+{
+    x0 = patchX * cPatchSize;
+    y0 = patchY * cPatchSize;
+    x1 = std::min((patchX + 1) * cPatchSize, verticesWidth - 1);
+    y1 = std::min((patchY + 1) * cPatchSize, verticesHeight - 1);
+}
+
+void TerrainHeightTree::ComputeLeaf(const EC_Terrain &terrain, uint patchX, uint patchY)
+{
+    Node &node = levels.front().At(patchX, patchY);
+    node.minHeight = std::numeric_limits<float>::infinity();
+    node.maxHeight = -std::numeric_limits<float>::infinity();
+
+    uint x0, y0, x1, y1;
+    PatchVertexRange(patchX, patchY, x0, y0, x1, y1);
+    for(uint y = y0; y <= y1; ++y)
+        for(uint x = x0; x <= x1; ++x)
+        {
+            float h;
+            if (VertexHeight(terrain, x, y, h))
+            {
+                node.minHeight = std::min(node.minHeight, h);
+                node.maxHeight = std::max(node.maxHeight, h);
+            }
+        }
+}
+
+void TerrainHeightTree::ComputeParent(uint level, uint x, uint y)
+{
+    const Level &children = levels[level-1];
+    Node &node = levels[level].At(x, y);
+    node.minHeight = std::numeric_limits<float>::infinity();
+    node.maxHeight = -std::numeric_limits<float>::infinity();
+
+    const uint cx1 = std::min(2*x + 2, children.width);
+    const uint cy1 = std::min(2*y + 2, children.height);
+    for(uint cy = 2*y; cy < cy1; ++cy)
+        for(uint cx = 2*x; cx < cx1; ++cx)
+        {
+            const Node &child = children.At(cx, cy);
+            node.minHeight = std::min(node.minHeight, child.minHeight);
+            node.maxHeight = std::max(node.maxHeight, child.maxHeight);
+        }
+}
+
+AABB TerrainHeightTree::NodeAABB(uint level, uint x, uint y) const
+{
+    const Level &leaves = levels.front();
+    const uint firstPatchX = x << level;
+    const uint firstPatchY = y << level;
+    const uint lastPatchX = std::min((x + 1) << level, leaves.width) - 1;
+    const uint lastPatchY = std::min((y + 1) << level, leaves.height) - 1;
+
+    const Node &node = levels[level].At(x, y);
+    const float x0 = (float)(firstPatchX * cPatchSize);
+    const float z0 = (float)(firstPatchY * cPatchSize);
+    const float x1 = (float)std::min((lastPatchX + 1) * cPatchSize, verticesWidth - 1);
+    const float z1 = (float)std::min((lastPatchY + 1) * cPatchSize, verticesHeight - 1);
+    return AABB(float3(x0, node.minHeight, z0), float3(x1, node.maxHeight, z1));
+}
+
+bool TerrainHeightTree::HeightRange(float &minHeight, float &maxHeight) const
+{
+    if (levels.empty())
+        return false;
+    const Node &root = levels.back().At(0, 0);
+    minHeight = root.minHeight;
+    maxHeight = root.maxHeight;
+    return root.minHeight <= root.maxHeight;
+}
+
+bool TerrainHeightTree::PatchHeightRange(uint patchX, uint patchY, float &minHeight, float &maxHeight) const
+{
+    if (levels.empty() || patchX >= levels.front().width || patchY >= levels.front().height)
+        return false;
+    const Node &node = levels.front().At(patchX, patchY);
+    minHeight = node.minHeight;
+    maxHeight = node.maxHeight;
+    return node.minHeight <= node.maxHeight;
+}
+
+bool TerrainHeightTree::IntersectRay(const EC_Terrain &terrain, const Ray &localRay, float maxDistance, float &outDistance) const
+{
+    if (levels.empty())
+        return false;
+
+    PROFILE(TerrainHeightTree_IntersectRay);
+
+    float bestDistance = maxDistance;
+    const uint rootLevel = (uint)levels.size() - 1;
+    if (!IntersectRayNode(terrain, localRay, rootLevel, 0, 0, bestDistance))
+        return false;
+    outDistance = bestDistance;
+    return true;
+}
+
+bool TerrainHeightTree::IntersectRayNode(const EC_Terrain &terrain, const Ray &localRay, uint level, uint x, uint y, float &bestDistance) const
+{
+    const Node &node = levels[level].At(x, y);
+    if (node.minHeight > node.maxHeight)
+        return false; // No height data loaded under this node.
+
+    float tNear, tFar;
+    if (!localRay.Intersects(NodeAABB(level, x, y), tNear, tFar) || tNear > bestDistance)
+        return false;
+
+    if (level == 0)
+        return IntersectRayPatch(terrain, localRay, x, y, tNear, std::min(tFar, bestDistance), bestDistance);
+
+    // Visit the children front-to-back so that the closest hit can cull the rest.
+    const Level &children = levels[level-1];
+    ChildHit hits[4];
+    int numHits = 0;
+    const uint cx1 = std::min(2*x + 2, children.width);
+    const uint cy1 = std::min(2*y + 2, children.height);
+    for(uint cy = 2*y; cy < cy1; ++cy)
+        for(uint cx = 2*x; cx < cx1; ++cx)
+        {
+            const Node &child = children.At(cx, cy);
+            if (child.minHeight > child.maxHeight)
+                continue;
+            float childNear, childFar;
+            if (localRay.Intersects(NodeAABB(level-1, cx, cy), childNear, childFar) && childNear <= bestDistance)
+            {
+                hits[numHits].x = cx;
+                hits[numHits].y = cy;
+                hits[numHits].tNear = childNear;
+                ++numHits;
+            }
+        }
+    std::sort(hits, hits + numHits);
+
+    bool hit = false;
+    for(int i = 0; i < numHits; ++i)
+    {
+        if (hits[i].tNear > bestDistance)
+            break;
+        if (IntersectRayNode(terrain, localRay, level-1, hits[i].x, hits[i].y, bestDistance))
+            hit = true;
+    }
+    return hit;
+}
+
+bool TerrainHeightTree::IntersectRayPatch(const EC_Terrain &terrain, const Ray &localRay, uint patchX, uint patchY, float tNear, float tFar, float &bestDistance) const
+{
+    uint vx0, vy0, vx1, vy1;
+    PatchVertexRange(patchX, patchY, vx0, vy0, vx1, vy1);
+    if (vx1 <= vx0 || vy1 <= vy0)
+        return false; // The patch has no cells (single vertex row or column at the terrain edge).
+
+    // Restrict the tested cells to the 2D bounding rectangle of the ray segment inside the patch.
+    const float3 entry = localRay.GetPoint(tNear);
+    const float3 exit = localRay.GetPoint(tFar);
+    const uint cx0 = (uint)Clamp((int)floor(std::min(entry.x, exit.x)), (int)vx0, (int)vx1 - 1);
+    const uint cx1 = (uint)Clamp((int)floor(std::max(entry.x, exit.x)), (int)vx0, (int)vx1 - 1);
+    const uint cy0 = (uint)Clamp((int)floor(std::min(entry.z, exit.z)), (int)vy0, (int)vy1 - 1);
+    const uint cy1 = (uint)Clamp((int)floor(std::max(entry.z, exit.z)), (int)vy0, (int)vy1 - 1);
+
+    bool hit = false;
+    for(uint y = cy0; y <= cy1; ++y)
+        for(uint x = cx0; x <= cx1; ++x)
+        {
+            float h00, h10, h01, h11;
+            if (!VertexHeight(terrain, x, y, h00) || !VertexHeight(terrain, x+1, y, h10) ||
+                !VertexHeight(terrain, x, y+1, h01) || !VertexHeight(terrain, x+1, y+1, h11))
+                continue;
+
+            // The cell is split along the (x+1,y)-(x,y+1) diagonal, matching EC_Terrain::GetInterpolatedHeightValue.
+            const float3 v00((float)x, h00, (float)y);
+            const float3 v10((float)x+1.f, h10, (float)y);
+            const float3 v01((float)x, h01, (float)y+1.f);
+            const float3 v11((float)x+1.f, h11, (float)y+1.f);
+
+            float d;
+            if (localRay.Intersects(Triangle(v00, v10, v01), &d, 0) && d < bestDistance)
+            {
+                bestDistance = d;
+                hit = true;
+            }
+            if (localRay.Intersects(Triangle(v11, v10, v01), &d, 0) && d < bestDistance)
+            {
+                bestDistance = d;
+                hit = true;
+            }
+        }
+    return hit;
+}
+
+bool TerrainHeightTree::IntersectsAABB(const EC_Terrain &terrain, const AABB &localAabb) const
+{
+    if (levels.empty())
+        return false;
+    return IntersectsAABBNode(terrain, localAabb, (uint)levels.size() - 1, 0, 0);
+}
+
+bool TerrainHeightTree::IntersectsAABBNode(const EC_Terrain &terrain, const AABB &localAabb, uint level, uint x, uint y) const
+{
+    const Node &node = levels[level].At(x, y);
+    if (node.minHeight > node.maxHeight)
+        return false;
+
+    const AABB nodeAabb = NodeAABB(level, x, y);
+    if (!nodeAabb.Intersects(localAabb))
+        return false;
+
+    // If the whole height range of the node lies inside the vertical extent of the box, the surface must pass through the
+    // part of the box that overlaps the node on the XZ plane.
+    if (node.minHeight >= localAabb.minPoint.y && node.maxHeight <= localAabb.maxPoint.y)
+        return true;
+
+    if (level > 0)
+    {
+        const Level &children = levels[level-1];
+        const uint cx1 = std::min(2*x + 2, children.width);
+        const uint cy1 = std::min(2*y + 2, children.height);
+        for(uint cy = 2*y; cy < cy1; ++cy)
+            for(uint cx = 2*x; cx < cx1; ++cx)
+                if (IntersectsAABBNode(terrain, localAabb, level-1, cx, cy))
+                    return true;
+        return false;
+    }
+
+    // Leaf: compare against the vertices of the cells the box overlaps.
+    uint vx0, vy0, vx1, vy1;
+    PatchVertexRange(x, y, vx0, vy0, vx1, vy1);
+    const uint x0 = (uint)Clamp((int)floor(localAabb.minPoint.x), (int)vx0, (int)vx1);
+    const uint x1 = (uint)Clamp((int)ceil(localAabb.maxPoint.x), (int)vx0, (int)vx1);
+    const uint y0 = (uint)Clamp((int)floor(localAabb.minPoint.z), (int)vy0, (int)vy1);
+    const uint y1 = (uint)Clamp((int)ceil(localAabb.maxPoint.z), (int)vy0, (int)vy1);
+
+    float minHeight = std::numeric_limits<float>::infinity();
+    float maxHeight = -std::numeric_limits<float>::infinity();
+    for(uint vy = y0; vy <= y1; ++vy)
+        for(uint vx = x0; vx <= x1; ++vx)
+        {
+            float h;
+            if (VertexHeight(terrain, vx, vy, h))
+            {
+                minHeight = std::min(minHeight, h);
+                maxHeight = std::max(maxHeight, h);
+            }
+        }
+    return minHeight <= localAabb.maxPoint.y && maxHeight >= localAabb.minPoint.y;
+}
@@ -0,0 +1,112 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "EnvironmentModuleApi.h"
+#include "CoreTypes.h"
+#include "Math/MathFwd.h"
+
+#include <vector>
+
+class EC_Terrain;
+
+/// A min/max height pyramid built over the patch grid of EC_Terrain.
+/** The leaf level stores the height range of each terrain patch (including the seam vertices shared with the next patch
+    in the +X and +Y directions), and each level above it combines 2x2 nodes of the level below until a single root node remains.
+    The tree allows answering ray, segment and AABB queries against the terrain surface on the CPU without visiting the whole
+    height map and without relying on Ogre scene queries, so it works also in headless mode.
+
+    All queries are performed in the local space of the terrain, where the X and Z axes run along the height map grid
+    (one unit per vertex) and Y is the height.
+
+    The tree does not store height values itself, but reads them from the EC_Terrain passed in. Height modifications
+    are tracked with MarkVertexDirty and MarkPatchDirty, and the affected nodes are refreshed on the next call to Update.
+    Any change to the patch grid dimensions requires calling Invalidate. */
+class ENVIRONMENT_MODULE_API TerrainHeightTree
+{
+public:
+    TerrainHeightTree();
+
+    /// Discards all data. The next call to Update will rebuild the whole tree.
+    void Invalidate();
+
+    /// Marks the given patch as changed. The node and its ancestors are refreshed on the next Update.
+    void MarkPatchDirty(uint patchX, uint patchY);
+
+    /// Marks the patches that contain the given terrain vertex as changed.
+    /** A vertex on a patch border also belongs to the seam of the previous patch, so up to four patches can be dirtied. */
+    void MarkVertexDirty(uint x, uint y);
+
+    /// Returns true if Update needs to be called before the tree reflects the current height data.
+    bool NeedsUpdate() const { return needsRebuild || !dirtyPatches.empty(); }
+
+    /// Brings the tree up to date with the height data of the given terrain.
+    /** Performs a full rebuild if the tree was invalidated, otherwise only refreshes the dirty leaves and their ancestors. */
+    void Update(const EC_Terrain &terrain);
+
+    /// Returns the height range of the whole terrain, as stored in the root node.
+    /** @return False if the tree is empty. */
+    bool HeightRange(float &minHeight, float &maxHeight) const;
+
+    /// Returns the height range of the given patch. The range includes the seam vertices of the patch.
+    bool PatchHeightRange(uint patchX, uint patchY, float &minHeight, float &maxHeight) const;
+
+    /// Computes the closest intersection of the given terrain-local space ray with the terrain surface.
+    /** @param localRay The ray in the local space of the terrain. The direction must be normalized.
+        @param maxDistance Intersections further away than this along the ray are ignored.
+        @param outDistance [out] If the ray hits the terrain, receives the distance along the ray to the hit.
+        @return True if the ray hits the terrain surface. */
+    bool IntersectRay(const EC_Terrain &terrain, const Ray &localRay, float maxDistance, float &outDistance) const;
+
+    /// Tests whether the terrain surface passes through the given terrain-local space AABB.
+    /** The test is conservative inside a single grid cell: it compares the box against the height range
+        of the vertices of the cells that the box overlaps. */
+    bool IntersectsAABB(const EC_Terrain &terrain, const AABB &localAabb) const;
+
+    /// Returns the number of levels in the tree. Level 0 contains the patch leaves.
+    uint NumLevels() const { return (uint)levels.size(); }
+
+private:
+    struct Node
+    {
+        float minHeight;
+        float maxHeight;
+    };
+
+    struct Level
+    {
+        uint width;
+        uint height;
+        std::vector<Node> nodes;
+
+        Node &At(uint x, uint y) { return nodes[y * width + x]; }
+        const Node &At(uint x, uint y) const { return nodes[y * width + x]; }
+    };
+
+    void Rebuild(const EC_Terrain &terrain);
+    void ComputeLeaf(const EC_Terrain &terrain, uint patchX, uint patchY);
+    void ComputeParent(uint level, uint x, uint y);
+
+    /// Returns the terrain-local bounding box of the given node.
+    AABB NodeAABB(uint level, uint x, uint y) const;
+
+    /// Returns the vertex range [x0, x1] x [y0, y1] covered by the given patch, including the seam vertices.
+    void PatchVertexRange(uint patchX, uint patchY, uint &x0, uint &y0, uint &x1, uint &y1) const;
+
+    bool IntersectRayNode(const EC_Terrain &terrain, const Ray &localRay, uint level, uint x, uint y, float &bestDistance) const;
+    bool IntersectRayPatch(const EC_Terrain &terrain, const Ray &localRay, uint patchX, uint patchY, float tNear, float tFar, float &bestDistance) const;
+    bool IntersectsAABBNode(const EC_Terrain &terrain, const AABB &localAabb, uint level, uint x, uint y) const;
+
+    /// levels[0] holds the patch leaves, levels.back() the single root node.
+    std::vector<Level> levels;
+
+    /// Number of vertices in the terrain in the X and Y directions at the time of the last rebuild.
+    uint verticesWidth;
+    uint verticesHeight;
+
+    /// Leaf indices (patchY * patchWidth + patchX) that need to be refreshed on the next Update.
+    std::vector<uint> dirtyPatches;
+    std::vector<bool> patchDirtyFlags;
+
+    bool needsRebuild;
+};
@@ -0,0 +1,208 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "DebugOperatorNew.h"
+
+#include "TerrainPatchGeometry.h"
+
+#include <QMutexLocker>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    const uint cPatchSize = 16; ///< @note Must match EC_Terrain::cPatchSize.
+
+    /// Returns the height of the given terrain vertex from the input window. The coordinates are clamped to the window.
+    inline float WindowHeight(const TerrainPatchGeometryInput &input, uint x, uint y)
+    {
+        x = std::min(std::max(x, input.windowX), input.windowX + input.windowWidth - 1);
+        y = std::min(std::max(y, input.windowY), input.windowY + input.windowHeight - 1);
+        return input.heights[(y - input.windowY) * input.windowWidth + (x - input.windowX)];
+    }
+
+    /// Computes the vertex normal at the given terrain vertex. Uses the same central differences as EC_Terrain::CalculateNormal.
+    float3 WindowNormal(const TerrainPatchGeometryInput &input, uint x, uint y)
+    {
+        const uint xPrev = (x > 0) ? x - 1 : x;
+        const uint xNext = (x + 1 < input.verticesWidth) ? x + 1 : x;
+        const uint yPrev = (y > 0) ? y - 1 : y;
+        const uint yNext = (y + 1 < input.verticesHeight) ? y + 1 : y;
+
+        float xSlope = WindowHeight(input, xPrev, y) - WindowHeight(input, xNext, y);
+        if (x == 0 || x + 1 >= input.verticesWidth)
+            xSlope *= 2.f;
+        float ySlope = WindowHeight(input, x, yPrev) - WindowHeight(input, x, yNext);
+        if (y == 0 || y + 1 >= input.verticesHeight)
+            ySlope *= 2.f;
+
+        // Note: heightmap X & Y correspond to X & Z world axes, while height is world Y
+        return float3(xSlope, 2.f, ySlope).Normalized();
+    }
+
+    /// Fills 'coords' with the patch-local vertex offsets [0, last] taken with the given step. The last offset is always included.
+    void DecimatedOffsets(uint last, uint step, std::vector<uint> &coords)
+    {
+        coords.clear();
+        for(uint i = 0; i < last; i += step)
+            coords.push_back(i);
+        coords.push_back(last);
+    }
+}
+
+void GenerateTerrainPatchGeometry(const TerrainPatchGeometryInput &input, TerrainPatchGeometry &geometry)
+{
+    geometry.patchX = input.patchX;
+    geometry.patchY = input.patchY;
+    geometry.lod = input.lod;
+    geometry.generation = input.generation;
+    geometry.positions.clear();
+    geometry.normals.clear();
+    geometry.uv0.clear();
+    geometry.uv1.clear();
+    geometry.indices.clear();
+
+    if (input.heights.empty() || input.verticesWidth < 2 || input.verticesHeight < 2)
+        return;
+
+    const uint originX = input.patchX * cPatchSize;
+    const uint originY = input.patchY * cPatchSize;
+
+    // Internal patches get a 17x17 grid to connect to the seams of the next patches. The outermost patch row and column
+    // at the terrain edge do not have a next patch, so they use a 16x16 grid instead.
+    const uint lastX = std::min(cPatchSize, input.verticesWidth - 1 - originX);
+    const uint lastY = std::min(cPatchSize, input.verticesHeight - 1 - originY);
+    const uint step = std::min(1U << input.lod, cPatchSize);
+
+    std::vector<uint> xs, ys;
+    DecimatedOffsets(lastX, step, xs);
+    DecimatedOffsets(lastY, step, ys);
+    const uint stride = (uint)xs.size();
+    const uint numGridVertices = stride * (uint)ys.size();
+    const uint numSkirtVertices = (input.skirtDepth > 0.f) ? 2 * (stride + (uint)ys.size()) - 4 : 0;
+
+    geometry.positions.reserve(numGridVertices + numSkirtVertices);
+    geometry.normals.reserve(numGridVertices + numSkirtVertices);
+    geometry.uv0.reserve(numGridVertices + numSkirtVertices);
+    geometry.uv1.reserve(numGridVertices + numSkirtVertices);
+    geometry.indices.reserve((stride - 1) * (ys.size() - 1) * 6 + numSkirtVertices * 6);
+
+    const float uvMaskScaleX = 1.f / (input.verticesWidth - 1);
+    const float uvMaskScaleY = 1.f / (input.verticesHeight - 1);
+
+    for(size_t j = 0; j < ys.size(); ++j)
+        for(size_t i = 0; i < xs.size(); ++i)
+        {
+            const uint x = originX + xs[i];
+            const uint y = originY + ys[j];
+
+            // These coordinates are directly generated to our Ogre coordinate system, i.e. terrain X and Y map to X and Z.
+            geometry.positions.push_back(float3((float)xs[i], WindowHeight(input, x, y), (float)ys[j]));
+            geometry.normals.push_back(WindowNormal(input, x, y));
+            // The UV set 0 contains the diffuse texture UV map. Do a planar mapping with the given specified UV scale.
+            geometry.uv0.push_back(float2(x * input.uScale, y * input.vScale));
+            // The UV set 1 contains the terrain blend mask UV map, which stretches once across the whole terrain.
+            geometry.uv1.push_back(float2(x * uvMaskScaleX, y * uvMaskScaleY));
+        }
+
+    for(uint j = 0; j + 1 < ys.size(); ++j)
+        for(uint i = 0; i + 1 < stride; ++i)
+        {
+            const u32 index = j * stride + i;
+            // Note: winding needs to be flipped when terrain X axis goes along world X axis and terrain Y axis along world Z
+            geometry.indices.push_back(index + stride);
+            geometry.indices.push_back(index + 1);
+            geometry.indices.push_back(index);
+
+            geometry.indices.push_back(index + stride);
+            geometry.indices.push_back(index + stride + 1);
+            geometry.indices.push_back(index + 1);
+        }
+
+    if (numSkirtVertices == 0)
+        return;
+
+    // Walk the border of the grid so that the outside of the patch is always on the right hand side: along +X on the first row,
+    // along +Z on the last column, along -X on the last row and along -Z on the first column. Each border vertex gets a copy
+    // pushed down by the skirt depth, and consecutive border vertices are connected to their copies with an outward facing quad.
+    std::vector<u32> border;
+    border.reserve(numSkirtVertices);
+    const uint lastRow = (uint)ys.size() - 1;
+    for(uint i = 0; i < stride; ++i)
+        border.push_back(i);
+    for(uint j = 1; j <= lastRow; ++j)
+        border.push_back(j * stride + stride - 1);
+    for(int i = (int)stride - 2; i >= 0; --i)
+        border.push_back(lastRow * stride + i);
+    for(uint j = lastRow - 1; j >= 1; --j)
+        border.push_back(j * stride);
+
+    const u32 firstSkirtVertex = (u32)geometry.positions.size();
+    for(size_t k = 0; k < border.size(); ++k)
+    {
+        const u32 top = border[k];
+        float3 pos = geometry.positions[top];
+        pos.y -= input.skirtDepth;
+        geometry.positions.push_back(pos);
+        geometry.normals.push_back(geometry.normals[top]);
+        geometry.uv0.push_back(geometry.uv0[top]);
+        geometry.uv1.push_back(geometry.uv1[top]);
+    }
+
+    for(size_t k = 0; k < border.size(); ++k)
+    {
+        const size_t next = (k + 1) % border.size();
+        const u32 p = border[k];
+        const u32 q = border[next];
+        const u32 pSkirt = firstSkirtVertex + (u32)k;
+        const u32 qSkirt = firstSkirtVertex + (u32)next;
+
+        geometry.indices.push_back(p);
+        geometry.indices.push_back(q);
+        geometry.indices.push_back(pSkirt);
+
+        geometry.indices.push_back(q);
+        geometry.indices.push_back(qSkirt);
+        geometry.indices.push_back(pSkirt);
+    }
+}
+
+void TerrainPatchGeometryQueue::JobStarted()
+{
+    QMutexLocker lock(&mutex);
+    ++numPending;
+}
+
+void TerrainPatchGeometryQueue::Push(const TerrainPatchGeometry &geometry)
+{
+    QMutexLocker lock(&mutex);
+    completed.push_back(geometry);
+}
+
+void TerrainPatchGeometryQueue::TakeCompleted(QList<TerrainPatchGeometry> &out)
+{
+    QMutexLocker lock(&mutex);
+    out = completed;
+    completed.clear();
+    numPending -= out.size();
+}
+
+int TerrainPatchGeometryQueue::NumPending() const
+{
+    QMutexLocker lock(&mutex);
+    return numPending;
+}
+
+TerrainPatchGeometryJob::TerrainPatchGeometryJob(const TerrainPatchGeometryQueuePtr &queue, const TerrainPatchGeometryInput &input) :
+    queue_(queue),
+    input_(input)
+{
+    // Make sure this worker object is deleted by QThreadPool once run() completes.
+    setAutoDelete(true);
+}
+
+void TerrainPatchGeometryJob::run()
+{
+    TerrainPatchGeometry geometry;
+    GenerateTerrainPatchGeometry(input_, geometry);
+    queue_->Push(geometry);
+}
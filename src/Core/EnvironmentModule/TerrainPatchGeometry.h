@@ -0,0 +1,117 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "EnvironmentModuleApi.h"
+#include "CoreTypes.h"
+#include "Math/float2.h"
+#include "Math/float3.h"
+
+#include <QRunnable>
+#include <QMutex>
+#include <QList>
+
+#include <vector>
+
+/// Describes the work needed to generate the geometry of one terrain patch.
+/** Contains a snapshot of the height values the patch geometry depends on, so that the geometry can be
+    generated on a worker thread without accessing EC_Terrain. */
+struct TerrainPatchGeometryInput
+{
+    TerrainPatchGeometryInput() :
+        patchX(0), patchY(0), lod(0), generation(0), verticesWidth(0), verticesHeight(0),
+        windowX(0), windowY(0), windowWidth(0), windowHeight(0), uScale(1.f), vScale(1.f), skirtDepth(0.f) {}
+
+    /// The patch to generate, in patch grid coordinates.
+    uint patchX;
+    uint patchY;
+
+    /// Level of detail. The patch grid is decimated to every (1 << lod)th vertex.
+    uint lod;
+
+    /// Identifies the request, so that stale results can be discarded.
+    u32 generation;
+
+    /// Size of the whole terrain, in vertices.
+    uint verticesWidth;
+    uint verticesHeight;
+
+    /// The rectangle of terrain vertices stored in 'heights', in terrain vertex coordinates.
+    /** Covers the patch, its seam to the next patches and a one-vertex border for normal calculation. */
+    uint windowX;
+    uint windowY;
+    uint windowWidth;
+    uint windowHeight;
+    std::vector<float> heights;
+
+    /// Texture coordinate scaling factors of the diffuse UV set.
+    float uScale;
+    float vScale;
+
+    /// If greater than zero, a vertical skirt of this depth is generated around the patch to hide the cracks between
+    /// neighboring patches of different level of detail.
+    float skirtDepth;
+};
+
+/// CPU-side geometry of one terrain patch, in the local space of the patch.
+struct TerrainPatchGeometry
+{
+    TerrainPatchGeometry() : patchX(0), patchY(0), lod(0), generation(0) {}
+
+    uint patchX;
+    uint patchY;
+    uint lod;
+    u32 generation;
+
+    std::vector<float3> positions;
+    std::vector<float3> normals;
+    /// Diffuse texture UV set.
+    std::vector<float2> uv0;
+    /// Blend mask UV set, which stretches once across the whole terrain.
+    std::vector<float2> uv1;
+    /// Triangle list indices.
+    std::vector<u32> indices;
+};
+
+/// Generates the patch geometry described by the given input. Thread-safe.
+void ENVIRONMENT_MODULE_API GenerateTerrainPatchGeometry(const TerrainPatchGeometryInput &input, TerrainPatchGeometry &geometry);
+
+/// Thread-safe queue of completed patch geometries, shared between EC_Terrain and its worker jobs.
+/** The jobs keep the queue alive, so a terrain can be destroyed while it still has jobs in flight. */
+class ENVIRONMENT_MODULE_API TerrainPatchGeometryQueue
+{
+public:
+    TerrainPatchGeometryQueue() : numPending(0) {}
+
+    /// Called on the main thread when a job is started.
+    void JobStarted();
+
+    /// Called from the worker thread when a job has completed.
+    void Push(const TerrainPatchGeometry &geometry);
+
+    /// Moves all completed geometries to 'out'. Called on the main thread.
+    void TakeCompleted(QList<TerrainPatchGeometry> &out);
+
+    /// Returns the number of jobs that have been started but whose results have not yet been taken.
+    int NumPending() const;
+
+private:
+    mutable QMutex mutex;
+    QList<TerrainPatchGeometry> completed;
+    int numPending;
+};
+typedef shared_ptr<TerrainPatchGeometryQueue> TerrainPatchGeometryQueuePtr;
+
+/// Threaded terrain patch geometry generation. Used internally by EC_Terrain.
+class ENVIRONMENT_MODULE_API TerrainPatchGeometryJob : public QRunnable
+{
+public:
+    TerrainPatchGeometryJob(const TerrainPatchGeometryQueuePtr &queue, const TerrainPatchGeometryInput &input);
+
+    /// QRunnable override.
+    virtual void run();
+
+private:
+    TerrainPatchGeometryQueuePtr queue_;
+    TerrainPatchGeometryInput input_;
+};
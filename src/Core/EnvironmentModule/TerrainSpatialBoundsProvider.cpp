@@ -0,0 +1,48 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "DebugOperatorNew.h"
+
+#include "TerrainSpatialBoundsProvider.h"
+#include "EC_Terrain.h"
+#include "SpatialWorld.h"
+#include "Geometry/AABB.h"
+#include "Geometry/Ray.h"
+
+#include "MemoryLeakCheck.h"
+
+u32 TerrainSpatialBoundsProvider::ComponentTypeId() const
+{
+    return EC_Terrain::ComponentTypeId;
+}
+
+bool TerrainSpatialBoundsProvider::WorldBounds(IComponent *component, AABB &outBounds) const
+{
+    EC_Terrain *terrain = static_cast<EC_Terrain*>(component);
+    float minHeight, maxHeight;
+    if (terrain->PatchWidth() == 0 || terrain->PatchHeight() == 0 || !terrain->HeightTree().HeightRange(minHeight, maxHeight))
+        return false;
+
+    outBounds = AABB(float3(0.f, minHeight, 0.f), float3((float)(terrain->VerticesWidth() - 1), maxHeight, (float)(terrain->VerticesHeight() - 1)));
+    outBounds.Transform(terrain->WorldTransform());
+    return true;
+}
+
+bool TerrainSpatialBoundsProvider::Raycast(IComponent *component, const Ray &ray, float maxDistance, float &outDistance, float3 &outNormal) const
+{
+    EC_Terrain *terrain = static_cast<EC_Terrain*>(component);
+    float3 worldPos;
+    if (!terrain->Raycast(ray, maxDistance, outDistance, &worldPos))
+        return false;
+
+    const float3 localPos = terrain->WorldTransform().Inverted().MulPos(worldPos);
+    outNormal = terrain->GetPlaneNormal(localPos.x, localPos.z);
+    if (outNormal.Dot(ray.dir) > 0.f)
+        outNormal = -outNormal;
+    return true;
+}
+
+void TerrainSpatialBoundsProvider::ConnectChangeSignals(IComponent *component, SpatialWorld *world) const
+{
+    // Height map changes, e.g. terrain editing or the terrain asset finishing loading, do not go through attributes.
+    QObject::connect(component, SIGNAL(TerrainRegenerated()), world, SLOT(MarkComponentDirty()), Qt::UniqueConnection);
+}
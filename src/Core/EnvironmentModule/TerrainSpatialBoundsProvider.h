@@ -0,0 +1,16 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "ISpatialBoundsProvider.h"
+
+/// Provides the bounds of EC_Terrain for SpatialWorld, and an exact raycast using the terrain height tree.
+class TerrainSpatialBoundsProvider : public ISpatialBoundsProvider
+{
+public:
+    u32 ComponentTypeId() const;
+    bool WorldBounds(IComponent *component, AABB &outBounds) const;
+    bool SupportsRaycast() const { return true; }
+    bool Raycast(IComponent *component, const Ray &ray, float maxDistance, float &outDistance, float3 &outNormal) const;
+    void ConnectChangeSignals(IComponent *component, SpatialWorld *world) const;
+};
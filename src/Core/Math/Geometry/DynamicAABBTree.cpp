@@ -0,0 +1,390 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   DynamicAABBTree.cpp
+    @brief  A bounding volume hierarchy of axis-aligned bounding boxes that supports incremental updates. */
+
+#include "DynamicAABBTree.h"
+
+#include "Math/MathFunc.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+MATH_BEGIN_NAMESPACE
+
+namespace
+{
+    inline AABB Union(const AABB &a, const AABB &b)
+    {
+        return AABB(Min(a.minPoint, b.minPoint), Max(a.maxPoint, b.maxPoint));
+    }
+
+    /// Half of the surface area, which is proportional to the probability of a random ray hitting the box.
+    inline float Cost(const AABB &aabb)
+    {
+        const float3 d = aabb.maxPoint - aabb.minPoint;
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+
+    inline bool ContainsBox(const AABB &outer, const AABB &inner)
+    {
+        return outer.minPoint.x <= inner.minPoint.x && outer.minPoint.y <= inner.minPoint.y && outer.minPoint.z <= inner.minPoint.z &&
+            outer.maxPoint.x >= inner.maxPoint.x && outer.maxPoint.y >= inner.maxPoint.y && outer.maxPoint.z >= inner.maxPoint.z;
+    }
+}
+
+DynamicAABBTree::DynamicAABBTree(float margin_) :
+    root(cNullNode),
+    freeList(cNullNode),
+    numProxies(0),
+    margin(margin_)
+{
+}
+
+int DynamicAABBTree::Insert(const AABB &aabb, u32 userData)
+{
+    const int proxyId = AllocateNode();
+    Node &node = nodes[proxyId];
+    node.bounds = aabb;
+    node.aabb = AABB(aabb.minPoint - float3(margin, margin, margin), aabb.maxPoint + float3(margin, margin, margin));
+    node.userData = userData;
+    node.height = 0;
+    InsertLeaf(proxyId);
+    ++numProxies;
+    return proxyId;
+}
+
+void DynamicAABBTree::Remove(int proxyId)
+{
+    assert(proxyId >= 0 && proxyId < (int)nodes.size() && nodes[proxyId].IsLeaf());
+    RemoveLeaf(proxyId);
+    FreeNode(proxyId);
+    --numProxies;
+}
+
+bool DynamicAABBTree::Move(int proxyId, const AABB &aabb)
+{
+    assert(proxyId >= 0 && proxyId < (int)nodes.size() && nodes[proxyId].IsLeaf());
+    nodes[proxyId].bounds = aabb;
+
+    // Keep the proxy in place while it fits its fat box, unless it has shrunk so much that the fat box would hurt queries.
+    const AABB &fat = nodes[proxyId].aabb;
+    if (ContainsBox(fat, aabb))
+    {
+        const float3 slack = (fat.maxPoint - fat.minPoint) - (aabb.maxPoint - aabb.minPoint);
+        if (slack.MaxElement() <= 4.f * margin)
+            return false;
+    }
+
+    RemoveLeaf(proxyId);
+    nodes[proxyId].aabb = AABB(aabb.minPoint - float3(margin, margin, margin), aabb.maxPoint + float3(margin, margin, margin));
+    InsertLeaf(proxyId);
+    return true;
+}
+
+void DynamicAABBTree::Clear()
+{
+    nodes.clear();
+    root = cNullNode;
+    freeList = cNullNode;
+    numProxies = 0;
+}
+
+AABB DynamicAABBTree::RootAABB() const
+{
+    if (root == cNullNode)
+    {
+        AABB aabb;
+        aabb.SetNegativeInfinity();
+        return aabb;
+    }
+    return nodes[root].aabb;
+}
+
+int DynamicAABBTree::AllocateNode()
+{
+    int nodeId;
+    if (freeList != cNullNode)
+    {
+        nodeId = freeList;
+        freeList = nodes[nodeId].parent;
+    }
+    else
+    {
+        nodeId = (int)nodes.size();
+        nodes.push_back(Node());
+    }
+    Node &node = nodes[nodeId];
+    node.parent = cNullNode;
+    node.child1 = cNullNode;
+    node.child2 = cNullNode;
+    node.height = 0;
+    node.userData = 0;
+    return nodeId;
+}
+
+void DynamicAABBTree::FreeNode(int nodeId)
+{
+    nodes[nodeId].parent = freeList;
+    nodes[nodeId].height = -1;
+    freeList = nodeId;
+}
+
+void DynamicAABBTree::InsertLeaf(int leaf)
+{
+    if (root == cNullNode)
+    {
+        root = leaf;
+        nodes[root].parent = cNullNode;
+        return;
+    }
+
+    // Find the best sibling for the new leaf by descending to the child that increases the surface area least.
+    const AABB leafAABB = nodes[leaf].aabb;
+    int index = root;
+    while(!nodes[index].IsLeaf())
+    {
+        const Node &node = nodes[index];
+        const float area = Cost(node.aabb);
+        const float combinedArea = Cost(Union(node.aabb, leafAABB));
+
+        // Cost of creating a new parent for this node and the new leaf.
+        const float cost = 2.f * combinedArea;
+        // Minimum cost of pushing the leaf further down the tree.
+        const float inheritanceCost = 2.f * (combinedArea - area);
+
+        float childCost[2];
+        const int children[2] = { node.child1, node.child2 };
+        for(int i = 0; i < 2; ++i)
+        {
+            const Node &child = nodes[children[i]];
+            const float unionArea = Cost(Union(leafAABB, child.aabb));
+            childCost[i] = (child.IsLeaf() ? unionArea : unionArea - Cost(child.aabb)) + inheritanceCost;
+        }
+
+        if (cost < childCost[0] && cost < childCost[1])
+            break;
+        index = childCost[0] < childCost[1] ? children[0] : children[1];
+    }
+
+    const int sibling = index;
+    const int oldParent = nodes[sibling].parent;
+    const int newParent = AllocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].aabb = Union(leafAABB, nodes[sibling].aabb);
+    nodes[newParent].height = nodes[sibling].height + 1;
+    nodes[newParent].child1 = sibling;
+    nodes[newParent].child2 = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    if (oldParent != cNullNode)
+    {
+        if (nodes[oldParent].child1 == sibling)
+            nodes[oldParent].child1 = newParent;
+        else
+            nodes[oldParent].child2 = newParent;
+    }
+    else
+        root = newParent;
+
+    Refit(nodes[leaf].parent);
+}
+
+void DynamicAABBTree::RemoveLeaf(int leaf)
+{
+    if (leaf == root)
+    {
+        root = cNullNode;
+        return;
+    }
+
+    const int parent = nodes[leaf].parent;
+    const int grandParent = nodes[parent].parent;
+    const int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+    if (grandParent != cNullNode)
+    {
+        if (nodes[grandParent].child1 == parent)
+            nodes[grandParent].child1 = sibling;
+        else
+            nodes[grandParent].child2 = sibling;
+        nodes[sibling].parent = grandParent;
+        FreeNode(parent);
+        Refit(grandParent);
+    }
+    else
+    {
+        root = sibling;
+        nodes[sibling].parent = cNullNode;
+        FreeNode(parent);
+    }
+}
+
+void DynamicAABBTree::Refit(int nodeId)
+{
+    while(nodeId != cNullNode)
+    {
+        nodeId = Balance(nodeId);
+        Node &node = nodes[nodeId];
+        node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+        node.aabb = Union(nodes[node.child1].aabb, nodes[node.child2].aabb);
+        nodeId = node.parent;
+    }
+}
+
+int DynamicAABBTree::Balance(int a)
+{
+    // Performs a left or right rotation if the children of node A differ in height by more than one.
+    if (nodes[a].IsLeaf() || nodes[a].height < 2)
+        return a;
+
+    const int b = nodes[a].child1;
+    const int c = nodes[a].child2;
+    const int balance = nodes[c].height - nodes[b].height;
+
+    if (balance > 1)
+    {
+        // Rotate C up.
+        const int f = nodes[c].child1;
+        const int g = nodes[c].child2;
+
+        nodes[c].child1 = a;
+        nodes[c].parent = nodes[a].parent;
+        nodes[a].parent = c;
+        if (nodes[c].parent != cNullNode)
+        {
+            if (nodes[nodes[c].parent].child1 == a)
+                nodes[nodes[c].parent].child1 = c;
+            else
+                nodes[nodes[c].parent].child2 = c;
+        }
+        else
+            root = c;
+
+        // Keep the taller of F and G under C, and move the other one under A.
+        const int keep = nodes[f].height > nodes[g].height ? f : g;
+        const int move = keep == f ? g : f;
+        nodes[c].child2 = keep;
+        nodes[a].child2 = move;
+        nodes[move].parent = a;
+        nodes[a].aabb = Union(nodes[b].aabb, nodes[move].aabb);
+        nodes[c].aabb = Union(nodes[a].aabb, nodes[keep].aabb);
+        nodes[a].height = 1 + std::max(nodes[b].height, nodes[move].height);
+        nodes[c].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+        return c;
+    }
+
+    if (balance < -1)
+    {
+        // Rotate B up.
+        const int d = nodes[b].child1;
+        const int e = nodes[b].child2;
+
+        nodes[b].child1 = a;
+        nodes[b].parent = nodes[a].parent;
+        nodes[a].parent = b;
+        if (nodes[b].parent != cNullNode)
+        {
+            if (nodes[nodes[b].parent].child1 == a)
+                nodes[nodes[b].parent].child1 = b;
+            else
+                nodes[nodes[b].parent].child2 = b;
+        }
+        else
+            root = b;
+
+        const int keep = nodes[d].height > nodes[e].height ? d : e;
+        const int move = keep == d ? e : d;
+        nodes[b].child2 = keep;
+        nodes[a].child1 = move;
+        nodes[move].parent = a;
+        nodes[a].aabb = Union(nodes[c].aabb, nodes[move].aabb);
+        nodes[b].aabb = Union(nodes[a].aabb, nodes[keep].aabb);
+        nodes[a].height = 1 + std::max(nodes[c].height, nodes[move].height);
+        nodes[b].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+        return b;
+    }
+
+    return a;
+}
+
+bool DynamicAABBTree::Validate() const
+{
+    int numLeaves = 0;
+    if (root != cNullNode && ValidateNode(root, cNullNode, numLeaves) < 0)
+        return false;
+    return numLeaves == numProxies;
+}
+
+int DynamicAABBTree::ValidateNode(int nodeId, int parent, int &numLeaves) const
+{
+    const Node &node = nodes[nodeId];
+    if (node.parent != parent)
+        return -1;
+    if (node.IsLeaf())
+    {
+        ++numLeaves;
+        return (node.height == 0 && ContainsBox(node.aabb, node.bounds)) ? 0 : -1;
+    }
+    const int height1 = ValidateNode(node.child1, nodeId, numLeaves);
+    const int height2 = ValidateNode(node.child2, nodeId, numLeaves);
+    if (height1 < 0 || height2 < 0)
+        return -1;
+    if (node.height != 1 + std::max(height1, height2) || abs(height1 - height2) > 1)
+        return -1;
+    if (!ContainsBox(node.aabb, nodes[node.child1].aabb) || !ContainsBox(node.aabb, nodes[node.child2].aabb))
+        return -1;
+    return node.height;
+}
+
+float DynamicAABBTree::DistanceSq(const AABB &aabb, const float3 &point)
+{
+    const float3 d = Max(Max(aabb.minPoint - point, point - aabb.maxPoint), float3::zero);
+    return d.LengthSq();
+}
+
+bool DynamicAABBTree::IntersectsFrustum(const AABB &aabb, const float *planes)
+{
+    const float3 center = (aabb.minPoint + aabb.maxPoint) * 0.5f;
+    const float3 halfSize = (aabb.maxPoint - aabb.minPoint) * 0.5f;
+    for(int i = 0; i < 6; ++i)
+    {
+        const float *p = planes + i*4;
+        const float distance = p[0] * center.x + p[1] * center.y + p[2] * center.z - p[3];
+        const float radius = fabs(p[0]) * halfSize.x + fabs(p[1]) * halfSize.y + fabs(p[2]) * halfSize.z;
+        if (distance > radius)
+            return false;
+    }
+    return true;
+}
+
+bool DynamicAABBTree::IntersectRay(const AABB &aabb, const RayInfo &ray, float maxDistance, float &outDistance)
+{
+    float tNear = 0.f;
+    float tFar = maxDistance;
+    for(int axis = 0; axis < 3; ++axis)
+    {
+        const float invDir = ray.invDir[axis];
+        const float pos = ray.pos[axis];
+        if (IsFinite(invDir))
+        {
+            float t1 = (aabb.minPoint[axis] - pos) * invDir;
+            float t2 = (aabb.maxPoint[axis] - pos) * invDir;
+            if (t1 > t2)
+                std::swap(t1, t2);
+            tNear = t1 > tNear ? t1 : tNear;
+            tFar = t2 < tFar ? t2 : tFar;
+            if (tNear > tFar)
+                return false;
+        }
+        // The ray is parallel to this slab, so it has to start inside it.
+        else if (pos < aabb.minPoint[axis] || pos > aabb.maxPoint[axis])
+            return false;
+    }
+    outDistance = tNear;
+    return true;
+}
+
+MATH_END_NAMESPACE
@@ -0,0 +1,307 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   DynamicAABBTree.h
+    @brief  A bounding volume hierarchy of axis-aligned bounding boxes that supports incremental updates. */
+
+#pragma once
+
+#include "Math/MathNamespace.h"
+#include "Math/float3.h"
+#include "Geometry/AABB.h"
+#include "Geometry/Ray.h"
+#include "Geometry/Sphere.h"
+#include "Geometry/Frustum.h"
+#include "Geometry/Plane.h"
+#include "Types.h"
+
+#include <vector>
+#include <queue>
+#include <utility>
+#include <functional>
+#include <cmath>
+
+MATH_BEGIN_NAMESPACE
+
+/// A bounding volume hierarchy of axis-aligned bounding boxes that supports incremental updates.
+/** Each object stored in the tree is a proxy that has a tight bounding box, a user data value and a "fat" bounding box
+    that is enlarged by a margin. The tree is built out of the fat boxes, so an object can move within its fat box without
+    restructuring the tree. When an object moves outside its fat box, it is removed and reinserted with the surface area heuristic,
+    and the tree is rebalanced with tree rotations.
+
+    The query functions test the tight boxes of the proxies, and report each hit to a callback object:
+    - QueryAABB, QuerySphere and QueryFrustum call bool callback(int proxyId). Returning false stops the query.
+    - Raycast calls float callback(int proxyId, float distance), where distance is the entry distance of the ray to the tight box.
+      The callback returns the new maximum distance of the ray, which allows clipping the ray to the closest hit found so far.
+      Returning a negative value stops the query.
+    - QueryNearest calls bool callback(int proxyId, float distance) in the order of increasing distance from the point to the
+      tight box. Returning false stops the query. */
+class DynamicAABBTree
+{
+public:
+    /// Denotes an invalid node or proxy id.
+    static const int cNullNode = -1;
+
+    /** @param margin The amount the fat boxes are enlarged in each direction. */
+    explicit DynamicAABBTree(float margin = 0.2f);
+
+    /// Inserts a new proxy to the tree. The box must be finite.
+    /** @return The id of the new proxy. */
+    int Insert(const AABB &aabb, u32 userData);
+
+    /// Removes the given proxy from the tree.
+    void Remove(int proxyId);
+
+    /// Updates the box of the given proxy.
+    /** @return True if the proxy was reinserted into the tree, false if the new box was contained in the old fat box. */
+    bool Move(int proxyId, const AABB &aabb);
+
+    /// Removes all proxies.
+    void Clear();
+
+    /// Returns the tight box of the given proxy.
+    const AABB &Bounds(int proxyId) const { return nodes[proxyId].bounds; }
+
+    /// Returns the fat box of the given proxy.
+    const AABB &FatAABB(int proxyId) const { return nodes[proxyId].aabb; }
+
+    /// Returns the user data of the given proxy.
+    u32 UserData(int proxyId) const { return nodes[proxyId].userData; }
+
+    /// Returns the number of proxies in the tree.
+    int NumProxies() const { return numProxies; }
+
+    /// Returns the height of the tree, 0 for a tree with a single proxy and -1 for an empty tree.
+    int Height() const { return root == cNullNode ? -1 : nodes[root].height; }
+
+    /// Returns the margin the fat boxes are enlarged by.
+    float Margin() const { return margin; }
+
+    /// Returns the box of the whole tree, or a negative infinity box if the tree is empty.
+    AABB RootAABB() const;
+
+    /// Checks the tree structure, and returns false if an inconsistency is found. For debugging and tests.
+    bool Validate() const;
+
+    template<typename Callback>
+    void QueryAABB(const AABB &aabb, Callback &callback) const;
+
+    template<typename Callback>
+    void QuerySphere(const Sphere &sphere, Callback &callback) const;
+
+    /// @note The test is conservative: boxes that are outside the frustum near its corners may be reported.
+    template<typename Callback>
+    void QueryFrustum(const Frustum &frustum, Callback &callback) const;
+
+    template<typename Callback>
+    void Raycast(const Ray &ray, float maxDistance, Callback &callback) const;
+
+    template<typename Callback>
+    void QueryNearest(const float3 &point, float maxDistance, Callback &callback) const;
+
+private:
+    struct Node
+    {
+        AABB aabb; ///< Fat box. For internal nodes, the union of the children's boxes.
+        AABB bounds; ///< Tight box of a leaf.
+        int parent; ///< Parent node, or the next free node if this node is in the free list.
+        int child1;
+        int child2;
+        int height; ///< 0 for leaves, -1 for free nodes.
+        u32 userData;
+
+        bool IsLeaf() const { return child1 == cNullNode; }
+    };
+
+    /// The ray in the form used by the slab test.
+    struct RayInfo
+    {
+        float3 pos;
+        float3 invDir;
+    };
+
+    int AllocateNode();
+    void FreeNode(int nodeId);
+    void InsertLeaf(int leaf);
+    void RemoveLeaf(int leaf);
+    int Balance(int nodeId);
+    /// Recomputes the boxes and heights from the given node up to the root, rebalancing on the way.
+    void Refit(int nodeId);
+    int ValidateNode(int nodeId, int parent, int &numLeaves) const;
+
+    static float DistanceSq(const AABB &aabb, const float3 &point);
+    static bool IntersectsFrustum(const AABB &aabb, const float *planes);
+    static bool IntersectRay(const AABB &aabb, const RayInfo &ray, float maxDistance, float &outDistance);
+
+    std::vector<Node> nodes;
+    int root;
+    int freeList;
+    int numProxies;
+    float margin;
+};
+
+template<typename Callback>
+void DynamicAABBTree::QueryAABB(const AABB &aabb, Callback &callback) const
+{
+    if (root == cNullNode)
+        return;
+    std::vector<int> stack;
+    stack.push_back(root);
+    while(!stack.empty())
+    {
+        const int nodeId = stack.back();
+        stack.pop_back();
+        const Node &node = nodes[nodeId];
+        if (!node.aabb.Intersects(aabb))
+            continue;
+        if (node.IsLeaf())
+        {
+            if (node.bounds.Intersects(aabb) && !callback(nodeId))
+                return;
+        }
+        else
+        {
+            stack.push_back(node.child1);
+            stack.push_back(node.child2);
+        }
+    }
+}
+
+template<typename Callback>
+void DynamicAABBTree::QuerySphere(const Sphere &sphere, Callback &callback) const
+{
+    if (root == cNullNode)
+        return;
+    const float radiusSq = sphere.r * sphere.r;
+    std::vector<int> stack;
+    stack.push_back(root);
+    while(!stack.empty())
+    {
+        const int nodeId = stack.back();
+        stack.pop_back();
+        const Node &node = nodes[nodeId];
+        if (DistanceSq(node.aabb, sphere.pos) > radiusSq)
+            continue;
+        if (node.IsLeaf())
+        {
+            if (DistanceSq(node.bounds, sphere.pos) <= radiusSq && !callback(nodeId))
+                return;
+        }
+        else
+        {
+            stack.push_back(node.child1);
+            stack.push_back(node.child2);
+        }
+    }
+}
+
+template<typename Callback>
+void DynamicAABBTree::QueryFrustum(const Frustum &frustum, Callback &callback) const
+{
+    if (root == cNullNode)
+        return;
+    Plane planes[6];
+    frustum.GetPlanes(planes);
+    float planeData[24];
+    for(int i = 0; i < 6; ++i)
+    {
+        planeData[i*4] = planes[i].normal.x;
+        planeData[i*4+1] = planes[i].normal.y;
+        planeData[i*4+2] = planes[i].normal.z;
+        planeData[i*4+3] = planes[i].d;
+    }
+
+    std::vector<int> stack;
+    stack.push_back(root);
+    while(!stack.empty())
+    {
+        const int nodeId = stack.back();
+        stack.pop_back();
+        const Node &node = nodes[nodeId];
+        if (!IntersectsFrustum(node.aabb, planeData))
+            continue;
+        if (node.IsLeaf())
+        {
+            if (IntersectsFrustum(node.bounds, planeData) && !callback(nodeId))
+                return;
+        }
+        else
+        {
+            stack.push_back(node.child1);
+            stack.push_back(node.child2);
+        }
+    }
+}
+
+template<typename Callback>
+void DynamicAABBTree::Raycast(const Ray &ray, float maxDistance, Callback &callback) const
+{
+    if (root == cNullNode)
+        return;
+    RayInfo info;
+    info.pos = ray.pos;
+    info.invDir = float3(1.f / ray.dir.x, 1.f / ray.dir.y, 1.f / ray.dir.z);
+
+    std::vector<int> stack;
+    stack.push_back(root);
+    float distance;
+    while(!stack.empty())
+    {
+        const int nodeId = stack.back();
+        stack.pop_back();
+        const Node &node = nodes[nodeId];
+        if (!IntersectRay(node.aabb, info, maxDistance, distance))
+            continue;
+        if (node.IsLeaf())
+        {
+            if (IntersectRay(node.bounds, info, maxDistance, distance))
+            {
+                maxDistance = callback(nodeId, distance);
+                if (maxDistance < 0.f)
+                    return;
+            }
+        }
+        else
+        {
+            stack.push_back(node.child1);
+            stack.push_back(node.child2);
+        }
+    }
+}
+
+template<typename Callback>
+void DynamicAABBTree::QueryNearest(const float3 &point, float maxDistance, Callback &callback) const
+{
+    if (root == cNullNode)
+        return;
+    // Best-first traversal: the queue holds both nodes, keyed by the distance to their fat box, and leaves, keyed by
+    // the distance to their tight box. As the fat box contains the tight box, a leaf is popped only after every node
+    // that could contain a closer leaf has been expanded. Leaves are marked by storing their id as -(id + 2).
+    typedef std::pair<float, int> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > queue;
+    const float maxDistanceSq = maxDistance * maxDistance;
+    queue.push(Entry(DistanceSq(nodes[root].aabb, point), root));
+    while(!queue.empty())
+    {
+        const Entry entry = queue.top();
+        queue.pop();
+        if (entry.first > maxDistanceSq)
+            return;
+        if (entry.second < 0)
+        {
+            if (!callback(-entry.second - 2, sqrtf(entry.first)))
+                return;
+            continue;
+        }
+        const Node &node = nodes[entry.second];
+        if (node.IsLeaf())
+            queue.push(Entry(DistanceSq(node.bounds, point), -entry.second - 2));
+        else
+        {
+            queue.push(Entry(DistanceSq(nodes[node.child1].aabb, point), node.child1));
+            queue.push(Entry(DistanceSq(nodes[node.child2].aabb, point), node.child2));
+        }
+    }
+}
+
+MATH_END_NAMESPACE
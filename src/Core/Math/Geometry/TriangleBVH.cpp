@@ -0,0 +1,699 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   TriangleBVH.cpp
+    @brief  A bounding volume hierarchy of static triangles: the build, the scalar kernel and the runtime dispatch. */
+
+#include "TriangleBVH.h"
+#include "TriangleBVHKernels.h"
+#include "Math/BatchOps.h"
+#include "Math/float3.h"
+#include "Geometry/Triangle.h"
+#include "Geometry/Ray.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QAtomicInt>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+MATH_BEGIN_NAMESPACE
+
+namespace
+{
+    /// Number of bins per axis when evaluating the split candidates.
+    const int cNumBins = 16;
+    /// Cost of visiting a node, relative to the cost of testing a packet of four triangles.
+    const float cTraversalCost = 1.f;
+    /// Below this depth, the splits are picked by the surface area heuristic. Deeper ranges are split at the median, which
+    /// halves the number of triangles on each level and keeps the tree within cMaxDepth.
+    const int cMaxSahDepth = TriangleBVH::cMaxDepth - 32;
+    /// Subtrees with fewer triangles are never built as separate parallel tasks.
+    const int cMinTaskTriangles = 4096;
+    /// Marks a ChildRef that refers to a task instead of a node or a leaf.
+    const u32 cTaskRef = 0xFFFFFFFF;
+
+    inline int NumPackets(int numTriangles) { return (numTriangles + 3) / 4; }
+
+    struct Box
+    {
+        float min[3];
+        float max[3];
+
+        void SetEmpty()
+        {
+            min[0] = min[1] = min[2] = FLT_MAX;
+            max[0] = max[1] = max[2] = -FLT_MAX;
+        }
+        void Enclose(const float *point)
+        {
+            for(int i = 0; i < 3; ++i)
+            {
+                min[i] = std::min(min[i], point[i]);
+                max[i] = std::max(max[i], point[i]);
+            }
+        }
+        void Enclose(const Box &box)
+        {
+            for(int i = 0; i < 3; ++i)
+            {
+                min[i] = std::min(min[i], box.min[i]);
+                max[i] = std::max(max[i], box.max[i]);
+            }
+        }
+        /// Half of the surface area, which is all the heuristic needs. 0 for an empty box.
+        float HalfArea() const
+        {
+            const float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+            if (dx < 0.f || dy < 0.f || dz < 0.f)
+                return 0.f;
+            return dx * dy + dy * dz + dz * dx;
+        }
+    };
+
+    /// Stores the box of the child i of the node.
+    void SetChildBounds(TriangleBVHNode &node, int i, const Box &box)
+    {
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            node.bounds[axis * 4 + i] = box.min[axis];
+            node.bounds[axis * 4 + 2 + i] = box.max[axis];
+        }
+    }
+
+    /// Returns the box that encloses both children of the node.
+    Box NodeBounds(const TriangleBVHNode &node)
+    {
+        Box box;
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            box.min[axis] = std::min(node.bounds[axis * 4], node.bounds[axis * 4 + 1]);
+            box.max[axis] = std::max(node.bounds[axis * 4 + 2], node.bounds[axis * 4 + 3]);
+        }
+        return box;
+    }
+
+    /// Writes the vertex and the edges of the triangle to the lane of the packet.
+    void SetPacketLane(TriangleBVHPacket &packet, int lane, const Triangle &tri)
+    {
+        const float3 e1 = tri.b - tri.a;
+        const float3 e2 = tri.c - tri.a;
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            packet.v0[axis][lane] = tri.a[axis];
+            packet.e1[axis][lane] = e1[axis];
+            packet.e2[axis][lane] = e2[axis];
+        }
+    }
+
+    /// A triangle during the build.
+    struct BuildRef
+    {
+        Box box;
+        float centroid[3];
+        u32 index;
+    };
+
+    /// Reference to a built subtree, in the format of TriangleBVHNode::child and TriangleBVHNode::numTriangles.
+    /// During a parallel build, numTriangles == cTaskRef marks a subtree that is built by the task at index child.
+    struct ChildRef
+    {
+        u32 child;
+        u32 numTriangles;
+    };
+
+    struct BuildOutput
+    {
+        BuildOutput() : numLeaves(0), depth(0) {}
+
+        std::vector<TriangleBVHNode> nodes;
+        std::vector<TriangleBVHPacket> packets;
+        int numLeaves;
+        int depth;
+    };
+
+    /// A subtree built in parallel with the others, into its own output. The indices are relocated when the outputs are merged.
+    struct BuildTask
+    {
+        int begin;
+        int end;
+        int depth;
+        Box bounds;
+        ChildRef root;
+        BuildOutput output;
+    };
+
+    struct BinLess
+    {
+        int axis;
+        float min;
+        float scale;
+        int bin;
+
+        bool operator()(const BuildRef &ref) const
+        {
+            return std::min((int)((ref.centroid[axis] - min) * scale), cNumBins - 1) < bin;
+        }
+    };
+
+    struct CentroidLess
+    {
+        int axis;
+
+        bool operator()(const BuildRef &a, const BuildRef &b) const { return a.centroid[axis] < b.centroid[axis]; }
+    };
+
+    class Builder
+    {
+    public:
+        Builder(const Triangle *triangles_, BuildRef *refs_, int taskSize_) : triangles(triangles_), refs(refs_), taskSize(taskSize_) {}
+
+        /// Builds the subtree of the triangles [begin, end[, whose box is bounds.
+        /** If tasks is not null, the subtrees of at most taskSize triangles are not built but added to tasks. */
+        ChildRef Build(BuildOutput &out, int begin, int end, const Box &bounds, int depth, std::vector<BuildTask> *tasks) const;
+
+        void Run(BuildTask &task) const
+        {
+            task.root = Build(task.output, task.begin, task.end, task.bounds, task.depth, 0);
+        }
+
+    private:
+        ChildRef MakeLeaf(BuildOutput &out, int begin, int end, int depth) const;
+        /// Finds the best split with the binned surface area heuristic. Returns false if no split separates the centroids.
+        bool FindSplit(int begin, int end, const Box &centroidBounds, BinLess &outSplit, float &outCost) const;
+        Box Bounds(int begin, int end) const;
+
+        const Triangle *triangles;
+        BuildRef *refs;
+        int taskSize;
+    };
+
+    ChildRef Builder::Build(BuildOutput &out, int begin, int end, const Box &bounds, int depth, std::vector<BuildTask> *tasks) const
+    {
+        const int count = end - begin;
+        if (tasks && depth > 0 && count <= taskSize)
+        {
+            BuildTask task;
+            task.begin = begin;
+            task.end = end;
+            task.depth = depth;
+            task.bounds = bounds;
+            tasks->push_back(task);
+            ChildRef ref = { (u32)tasks->size() - 1, cTaskRef };
+            return ref;
+        }
+        if (count <= 1)
+            return MakeLeaf(out, begin, end, depth);
+
+        Box centroidBounds;
+        centroidBounds.SetEmpty();
+        for(int i = begin; i < end; ++i)
+            centroidBounds.Enclose(refs[i].centroid);
+
+        BinLess split;
+        float splitCost = FLT_MAX;
+        const bool canSplit = depth < cMaxSahDepth && FindSplit(begin, end, centroidBounds, split, splitCost);
+        if (count <= TriangleBVH::cMaxLeafTriangles)
+        {
+            // The costs are in the units of one packet test, and the split cost is the probability of hitting each child,
+            // i.e. the ratio of the surface areas, times the cost of testing it.
+            const float area = bounds.HalfArea();
+            if (!canSplit || area <= 0.f || (float)NumPackets(count) <= cTraversalCost + splitCost / area)
+                return MakeLeaf(out, begin, end, depth);
+        }
+
+        int mid;
+        if (canSplit)
+            mid = (int)(std::partition(refs + begin, refs + end, split) - refs);
+        else
+        {
+            CentroidLess less;
+            less.axis = 0;
+            for(int i = 1; i < 3; ++i)
+                if (centroidBounds.max[i] - centroidBounds.min[i] > centroidBounds.max[less.axis] - centroidBounds.min[less.axis])
+                    less.axis = i;
+            mid = begin + count / 2;
+            std::nth_element(refs + begin, refs + mid, refs + end, less);
+        }
+
+        const Box leftBounds = Bounds(begin, mid);
+        const Box rightBounds = Bounds(mid, end);
+        const int nodeIndex = (int)out.nodes.size();
+        out.nodes.push_back(TriangleBVHNode());
+        const ChildRef left = Build(out, begin, mid, leftBounds, depth + 1, tasks);
+        const ChildRef right = Build(out, mid, end, rightBounds, depth + 1, tasks);
+
+        TriangleBVHNode &node = out.nodes[nodeIndex];
+        SetChildBounds(node, 0, leftBounds);
+        SetChildBounds(node, 1, rightBounds);
+        node.child[0] = left.child;
+        node.numTriangles[0] = left.numTriangles;
+        node.child[1] = right.child;
+        node.numTriangles[1] = right.numTriangles;
+
+        ChildRef ref = { (u32)nodeIndex, 0 };
+        return ref;
+    }
+
+    bool Builder::FindSplit(int begin, int end, const Box &centroidBounds, BinLess &outSplit, float &outCost) const
+    {
+        bool found = false;
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            const float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+            if (!(extent > 0.f))
+                continue;
+
+            BinLess binning;
+            binning.axis = axis;
+            binning.min = centroidBounds.min[axis];
+            binning.scale = cNumBins / extent;
+
+            Box binBounds[cNumBins];
+            int binCounts[cNumBins];
+            for(int i = 0; i < cNumBins; ++i)
+            {
+                binBounds[i].SetEmpty();
+                binCounts[i] = 0;
+            }
+            for(int i = begin; i < end; ++i)
+            {
+                const int bin = std::min((int)((refs[i].centroid[axis] - binning.min) * binning.scale), cNumBins - 1);
+                binBounds[bin].Enclose(refs[i].box);
+                ++binCounts[bin];
+            }
+
+            // Sweep from the left to get the cost of the left side of each split, then from the right to evaluate the splits.
+            float leftCosts[cNumBins];
+            int leftCounts[cNumBins];
+            Box bounds;
+            bounds.SetEmpty();
+            int count = 0;
+            for(int i = 0; i < cNumBins - 1; ++i)
+            {
+                bounds.Enclose(binBounds[i]);
+                count += binCounts[i];
+                leftCounts[i] = count;
+                leftCosts[i] = bounds.HalfArea() * NumPackets(count);
+            }
+            bounds.SetEmpty();
+            count = 0;
+            for(int i = cNumBins - 1; i > 0; --i)
+            {
+                bounds.Enclose(binBounds[i]);
+                count += binCounts[i];
+                if (count == 0 || leftCounts[i - 1] == 0)
+                    continue;
+                const float cost = leftCosts[i - 1] + bounds.HalfArea() * NumPackets(count);
+                if (cost < outCost)
+                {
+                    outCost = cost;
+                    outSplit = binning;
+                    outSplit.bin = i;
+                    found = true;
+                }
+            }
+        }
+        return found;
+    }
+
+    ChildRef Builder::MakeLeaf(BuildOutput &out, int begin, int end, int depth) const
+    {
+        const u32 first = (u32)out.packets.size();
+        for(int i = begin; i < end; i += 4)
+        {
+            TriangleBVHPacket packet;
+            memset(&packet, 0, sizeof(packet));
+            for(int lane = 0; lane < 4; ++lane)
+            {
+                if (i + lane >= end)
+                {
+                    packet.index[lane] = 0xFFFFFFFF;
+                    continue;
+                }
+                const u32 index = refs[i + lane].index;
+                SetPacketLane(packet, lane, triangles[index]);
+                packet.index[lane] = index;
+            }
+            out.packets.push_back(packet);
+        }
+        ++out.numLeaves;
+        out.depth = std::max(out.depth, depth);
+        ChildRef ref = { TriangleBVHNode::cLeafFlag | first, (u32)(end - begin) };
+        return ref;
+    }
+
+    Box Builder::Bounds(int begin, int end) const
+    {
+        Box bounds;
+        bounds.SetEmpty();
+        for(int i = begin; i < end; ++i)
+            bounds.Enclose(refs[i].box);
+        return bounds;
+    }
+
+    /// The tasks of a parallel build, shared by the worker threads.
+    struct ParallelBuild
+    {
+        ParallelBuild(const Builder &builder_, std::vector<BuildTask> &tasks_) : builder(builder_), tasks(tasks_), next(0) {}
+
+        /// Runs tasks until there are none left.
+        void Run()
+        {
+            for(;;)
+            {
+                const int i = next.fetchAndAddOrdered(1);
+                if (i >= (int)order.size())
+                    return;
+                builder.Run(tasks[order[i]]);
+            }
+        }
+
+        const Builder &builder;
+        std::vector<BuildTask> &tasks;
+        std::vector<int> order; ///< Indices of the tasks, largest first.
+        QAtomicInt next;
+        QSemaphore finished; ///< Released by each worker once it runs out of tasks.
+    };
+
+    class BuildWorker : public QRunnable
+    {
+    public:
+        explicit BuildWorker(ParallelBuild *build_) : build(build_) {}
+        void run()
+        {
+            build->Run();
+            build->finished.release();
+        }
+
+    private:
+        ParallelBuild *build;
+    };
+
+    struct TaskSizeGreater
+    {
+        const std::vector<BuildTask> *tasks;
+
+        bool operator()(int a, int b) const
+        {
+            return (*tasks)[a].end - (*tasks)[a].begin > (*tasks)[b].end - (*tasks)[b].begin;
+        }
+    };
+
+    /// Runs the tasks on the calling thread and on the idle threads of the global thread pool.
+    /** The calling thread only borrows idle threads and works on the tasks itself, so this can not deadlock even if
+        it is called from a pool thread while the pool is busy. */
+    void RunTasks(const Builder &builder, std::vector<BuildTask> &tasks, int maxThreads)
+    {
+        ParallelBuild build(builder, tasks);
+        for(size_t i = 0; i < tasks.size(); ++i)
+            build.order.push_back((int)i);
+        TaskSizeGreater greater = { &tasks };
+        std::sort(build.order.begin(), build.order.end(), greater);
+
+        int numWorkers = 0;
+        for(int i = 1; i < maxThreads && i < (int)tasks.size(); ++i)
+        {
+            BuildWorker *worker = new BuildWorker(&build);
+            if (!QThreadPool::globalInstance()->tryStart(worker))
+            {
+                delete worker;
+                break;
+            }
+            ++numWorkers;
+        }
+        build.Run();
+        build.finished.acquire(numWorkers);
+    }
+
+    inline u32 Relocate(u32 child, u32 numTriangles, u32 nodeOffset, u32 packetOffset)
+    {
+        if (child & TriangleBVHNode::cLeafFlag)
+            return TriangleBVHNode::cLeafFlag | ((child & ~TriangleBVHNode::cLeafFlag) + packetOffset);
+        return numTriangles == cTaskRef ? child : child + nodeOffset;
+    }
+
+    struct ScalarKernel
+    {
+        explicit ScalarKernel(const TriangleBVHRay &ray_) : ray(ray_) {}
+
+        int IntersectChildren(const TriangleBVHNode &node, float maxT, float *tNear) const
+        {
+            int mask = 0;
+            for(int i = 0; i < 2; ++i)
+            {
+                float tMin = 0.f;
+                float tMax = maxT;
+                for(int axis = 0; axis < 3; ++axis)
+                {
+                    float t0 = (node.bounds[axis * 4 + i] - ray.pos[axis]) * ray.invDir[axis];
+                    float t1 = (node.bounds[axis * 4 + 2 + i] - ray.pos[axis]) * ray.invDir[axis];
+                    if (t0 > t1)
+                        std::swap(t0, t1);
+                    tMin = std::max(tMin, t0);
+                    tMax = std::min(tMax, t1);
+                }
+                if (tMin <= tMax)
+                {
+                    mask |= 1 << i;
+                    tNear[i] = tMin;
+                }
+            }
+            return mask;
+        }
+
+        bool IntersectLeaf(const TriangleBVHPacket *packets, u32 numTriangles, TriangleBVHHit &hit) const
+        {
+            bool found = false;
+            for(u32 i = 0; i < numTriangles; ++i)
+                if (IntersectTriangleBVHLane(packets[i / 4], i % 4, ray, hit))
+                    found = true;
+            return found;
+        }
+
+        const TriangleBVHRay &ray;
+    };
+}
+
+bool TriangleBVHRaycast_Scalar(const TriangleBVHNode *nodes, const TriangleBVHPacket *packets, const TriangleBVHRay &ray, TriangleBVHHit &hit)
+{
+    return TraverseTriangleBVH<ScalarKernel>(nodes, packets, ray, hit);
+}
+
+TriangleBVH::TriangleBVH()
+{
+    Clear();
+}
+
+void TriangleBVH::Clear()
+{
+    std::vector<u8>().swap(storage);
+    nodes = 0;
+    packets = 0;
+    numTriangles = 0;
+    numNodes = 0;
+    numLeaves = 0;
+    numPackets = 0;
+    depth = 0;
+    bounds.SetNegativeInfinity();
+}
+
+void TriangleBVH::Swap(TriangleBVH &rhs)
+{
+    // Swapping the vectors keeps their buffers, so the pointers to them stay valid.
+    storage.swap(rhs.storage);
+    std::swap(nodes, rhs.nodes);
+    std::swap(packets, rhs.packets);
+    std::swap(numTriangles, rhs.numTriangles);
+    std::swap(numNodes, rhs.numNodes);
+    std::swap(numLeaves, rhs.numLeaves);
+    std::swap(numPackets, rhs.numPackets);
+    std::swap(depth, rhs.depth);
+    std::swap(bounds, rhs.bounds);
+}
+
+void TriangleBVH::Build(const Triangle *triangles, int count, int maxThreads)
+{
+    Clear();
+    if (!triangles || count <= 0)
+        return;
+
+    std::vector<BuildRef> refs(count);
+    Box rootBounds;
+    rootBounds.SetEmpty();
+    for(int i = 0; i < count; ++i)
+    {
+        BuildRef &ref = refs[i];
+        ref.box.SetEmpty();
+        for(int v = 0; v < 3; ++v)
+            ref.box.Enclose(triangles[i].Vertex(v).ptr());
+        for(int axis = 0; axis < 3; ++axis)
+            ref.centroid[axis] = (ref.box.min[axis] + ref.box.max[axis]) * 0.5f;
+        ref.index = (u32)i;
+        rootBounds.Enclose(ref.box);
+    }
+
+    if (maxThreads <= 0)
+        maxThreads = QThread::idealThreadCount();
+    const bool parallel = maxThreads > 1 && count > 2 * cMinTaskTriangles;
+    // A few tasks per thread balances the load, as the subtrees differ in size.
+    const Builder builder(triangles, &refs[0], std::max(cMinTaskTriangles, count / (std::max(maxThreads, 1) * 4)));
+    std::vector<BuildTask> tasks;
+    BuildOutput top;
+    ChildRef root = builder.Build(top, 0, count, rootBounds, 0, parallel ? &tasks : 0);
+    if (!tasks.empty())
+        RunTasks(builder, tasks, maxThreads);
+
+    if (root.child & TriangleBVHNode::cLeafFlag)
+    {
+        // The traversal starts from a node, so a tree of a single leaf gets a root node that refers to the leaf twice.
+        TriangleBVHNode node;
+        SetChildBounds(node, 0, rootBounds);
+        SetChildBounds(node, 1, rootBounds);
+        node.child[0] = node.child[1] = root.child;
+        node.numTriangles[0] = node.numTriangles[1] = root.numTriangles;
+        top.nodes.push_back(node);
+        top.depth = 1;
+    }
+
+    size_t totalNodes = top.nodes.size();
+    size_t totalPackets = top.packets.size();
+    numLeaves = top.numLeaves;
+    depth = top.depth;
+    for(size_t i = 0; i < tasks.size(); ++i)
+    {
+        totalNodes += tasks[i].output.nodes.size();
+        totalPackets += tasks[i].output.packets.size();
+        numLeaves += tasks[i].output.numLeaves;
+        depth = std::max(depth, tasks[i].output.depth);
+    }
+
+    const size_t cAlignment = 64;
+    storage.resize(cAlignment + totalNodes * sizeof(TriangleBVHNode) + totalPackets * sizeof(TriangleBVHPacket));
+    u8 *aligned = &storage[0] + (cAlignment - ((size_t)&storage[0] % cAlignment)) % cAlignment;
+    nodes = reinterpret_cast<TriangleBVHNode *>(aligned);
+    packets = reinterpret_cast<TriangleBVHPacket *>(aligned + totalNodes * sizeof(TriangleBVHNode));
+
+    // The top of the tree comes first, so the root is node 0. The subtrees of the tasks follow it, each relocated to its
+    // place in the merged arrays, and the references to the tasks in the top nodes are replaced with the relocated roots.
+    std::copy(top.nodes.begin(), top.nodes.end(), nodes);
+    std::copy(top.packets.begin(), top.packets.end(), packets);
+    u32 nodeOffset = (u32)top.nodes.size();
+    u32 packetOffset = (u32)top.packets.size();
+    for(size_t i = 0; i < tasks.size(); ++i)
+    {
+        BuildTask &task = tasks[i];
+        for(size_t j = 0; j < task.output.nodes.size(); ++j)
+        {
+            TriangleBVHNode &node = nodes[nodeOffset + j];
+            node = task.output.nodes[j];
+            for(int c = 0; c < 2; ++c)
+                node.child[c] = Relocate(node.child[c], node.numTriangles[c], nodeOffset, packetOffset);
+        }
+        std::copy(task.output.packets.begin(), task.output.packets.end(), packets + packetOffset);
+        task.root.child = Relocate(task.root.child, task.root.numTriangles, nodeOffset, packetOffset);
+        nodeOffset += (u32)task.output.nodes.size();
+        packetOffset += (u32)task.output.packets.size();
+        std::vector<TriangleBVHNode>().swap(task.output.nodes);
+    }
+    for(size_t i = 0; i < top.nodes.size(); ++i)
+        for(int c = 0; c < 2; ++c)
+            if (nodes[i].numTriangles[c] == cTaskRef)
+            {
+                const ChildRef &taskRoot = tasks[nodes[i].child[c]].root;
+                nodes[i].child[c] = taskRoot.child;
+                nodes[i].numTriangles[c] = taskRoot.numTriangles;
+            }
+
+    numTriangles = count;
+    numNodes = (int)totalNodes;
+    numPackets = (int)totalPackets;
+    bounds = AABB(float3(rootBounds.min[0], rootBounds.min[1], rootBounds.min[2]), float3(rootBounds.max[0], rootBounds.max[1], rootBounds.max[2]));
+}
+
+bool TriangleBVH::Refit(const Triangle *triangles, int count)
+{
+    if (count != numTriangles || (count > 0 && !triangles))
+        return false;
+    if (numNodes == 0)
+        return true;
+
+    for(int i = 0; i < numPackets; ++i)
+        for(int lane = 0; lane < 4; ++lane)
+            if (packets[i].index[lane] != 0xFFFFFFFF)
+                SetPacketLane(packets[i], lane, triangles[packets[i].index[lane]]);
+
+    // The children are always stored after their parents, so walking the nodes backwards refits the children first.
+    for(int i = numNodes - 1; i >= 0; --i)
+    {
+        TriangleBVHNode &node = nodes[i];
+        for(int c = 0; c < 2; ++c)
+        {
+            if (!node.IsLeaf(c))
+            {
+                SetChildBounds(node, c, NodeBounds(nodes[node.child[c]]));
+                continue;
+            }
+            Box box;
+            box.SetEmpty();
+            const TriangleBVHPacket *leaf = packets + (node.child[c] & ~TriangleBVHNode::cLeafFlag);
+            for(u32 j = 0; j < node.numTriangles[c]; ++j)
+                for(int v = 0; v < 3; ++v)
+                    box.Enclose(triangles[leaf[j / 4].index[j % 4]].Vertex(v).ptr());
+            SetChildBounds(node, c, box);
+        }
+    }
+
+    const Box rootBounds = NodeBounds(nodes[0]);
+    bounds = AABB(float3(rootBounds.min[0], rootBounds.min[1], rootBounds.min[2]), float3(rootBounds.max[0], rootBounds.max[1], rootBounds.max[2]));
+    return true;
+}
+
+bool TriangleBVH::Raycast(const Ray &ray, float maxDistance, TriangleBVHHit &outHit) const
+{
+    if (numNodes == 0)
+        return false;
+
+    TriangleBVHRay r;
+    for(int i = 0; i < 3; ++i)
+    {
+        r.pos[i] = ray.pos[i];
+        r.dir[i] = ray.dir[i];
+        float d = ray.dir[i];
+        if (fabs(d) < 1e-20f)
+            d = d < 0.f ? -1e-20f : 1e-20f;
+        r.invDir[i] = 1.f / d;
+    }
+    r.pos[3] = r.dir[3] = r.invDir[3] = 0.f;
+
+    TriangleBVHHit hit;
+    hit.t = maxDistance;
+    bool found;
+    switch(ActiveBatchSimdLevel())
+    {
+#ifdef MATH_BATCH_AVX
+    case BatchSimdAVX:
+        found = TriangleBVHRaycast_AVX(nodes, packets, r, hit);
+        break;
+#endif
+#ifdef MATH_BATCH_SSE2
+    case BatchSimdSSE2:
+    case BatchSimdSSE41:
+        found = TriangleBVHRaycast_SSE2(nodes, packets, r, hit);
+        break;
+#endif
+    default:
+        found = TriangleBVHRaycast_Scalar(nodes, packets, r, hit);
+        break;
+    }
+    if (found)
+        outHit = hit;
+    return found;
+}
+
+MATH_END_NAMESPACE
@@ -0,0 +1,134 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   TriangleBVH.h
+    @brief  A bounding volume hierarchy of static triangles, built with the binned surface area heuristic. */
+
+#pragma once
+
+#include "Math/MathNamespace.h"
+#include "Math/MathFwd.h"
+#include "Math/MathConstants.h"
+#include "Geometry/AABB.h"
+#include "Types.h"
+
+#include <vector>
+
+MATH_BEGIN_NAMESPACE
+
+/// A node of TriangleBVH. Holds the boxes and the references of both of its children, and fills exactly one cache line.
+struct TriangleBVHNode
+{
+    /// Marks a leaf in child. The rest of the bits are the index of the first packet of the leaf.
+    static const u32 cLeafFlag = 0x80000000;
+
+    /// The boxes of the children, grouped by axis as (child0.min, child1.min, child0.max, child1.max) for x, then y and z,
+    /// so that the slab tests of both children fit in one 4-wide SIMD operation per axis.
+    float bounds[12];
+    /// Index of the child node, or cLeafFlag | the index of the first packet of the child leaf.
+    u32 child[2];
+    /// Number of triangles in the child leaf, 0 for child nodes.
+    u32 numTriangles[2];
+
+    bool IsLeaf(int i) const { return (child[i] & cLeafFlag) != 0; }
+};
+
+/// Four triangles of a TriangleBVH leaf in structure-of-arrays layout, as a vertex and two edges for the Moller-Trumbore test.
+/** The unused lanes of the last packet of a leaf have zero edges, which the intersection test rejects. */
+struct TriangleBVHPacket
+{
+    float v0[3][4];
+    float e1[3][4];
+    float e2[3][4];
+    u32 index[4]; ///< Index of each triangle in the array the tree was built from.
+};
+
+/// The nearest hit of a ray query.
+struct TriangleBVHHit
+{
+    TriangleBVHHit() : t(FLOAT_INF), triangleIndex(0xFFFFFFFF), u(0.f), v(0.f) {}
+
+    float t; ///< Distance along the ray, FLOAT_INF if nothing was hit.
+    u32 triangleIndex; ///< Index of the triangle, 0xFFFFFFFF if nothing was hit.
+    float u; ///< Barycentric coordinate of the hit, the weight of the second vertex.
+    float v; ///< Barycentric coordinate of the hit, the weight of the third vertex.
+};
+
+/// A bounding volume hierarchy of static triangles, for fast ray queries against large meshes.
+/** The tree is built top-down with the binned surface area heuristic, in O(n log n) time and without duplicating triangles
+    that straddle a split. The large subtrees are built in parallel on the global QThreadPool, and the calling thread works
+    on them as well, so Build may also be called from a pool thread.
+
+    The nodes are stored flat and 64-byte aligned, one cache line per node, and the leaves hold their triangles in SIMD
+    packets of four. The traversal is dispatched to the same instruction set level as the batch operations in BatchOps.h:
+    SSE2 tests both children of a node at once and four triangles at a time, and AVX tests up to eight triangles at a time.
+    The results are identical at every level, up to floating-point rounding. */
+class TriangleBVH
+{
+public:
+    /// The tree is never deeper than this.
+    static const int cMaxDepth = 64;
+    /// The leaves hold at most this many triangles, i.e. two packets.
+    static const int cMaxLeafTriangles = 8;
+
+    TriangleBVH();
+
+    /// Builds the tree out of the given triangles, replacing the previous contents.
+    /** The triangles are not referenced after the build. The hits report the indices of the triangles in this array.
+        @param maxThreads The maximum number of threads to use, including the calling thread. 0 uses QThread::idealThreadCount(). */
+    void Build(const Triangle *triangles, int numTriangles, int maxThreads = 0);
+
+    /// Moves the triangles to new positions, and updates the boxes of the tree to enclose them, without changing its topology.
+    /** This is an order of magnitude faster than a rebuild, and suits deforming meshes, e.g. skinned characters, whose
+        triangles keep their neighbors. The more the triangles move relative to each other since the build, the more the
+        boxes overlap, and the slower the ray queries get.
+        @param triangles The triangles in the same order as they were given to Build.
+        @param numTriangles Must be the same as in the build.
+        @return False if the number of triangles differs from the build, in which case the tree is left unchanged. */
+    bool Refit(const Triangle *triangles, int numTriangles);
+
+    /// Empties the tree.
+    void Clear();
+
+    /// Swaps the contents of the two trees. Allows building a tree on another thread and taking it into use in constant time.
+    void Swap(TriangleBVH &rhs);
+
+    /// Finds the nearest triangle hit by the ray.
+    /** @param ray The ray. The direction must be normalized for the distances to be in world units.
+        @param maxDistance Hits farther than this are ignored.
+        @param outHit [out] Receives the nearest hit, and is left untouched if nothing was hit.
+        @return True if a triangle was hit. */
+    bool Raycast(const Ray &ray, float maxDistance, TriangleBVHHit &outHit) const;
+
+    bool IsEmpty() const { return numTriangles == 0; }
+    int NumTriangles() const { return numTriangles; }
+    int NumNodes() const { return numNodes; }
+    int NumLeaves() const { return numLeaves; }
+    int NumPackets() const { return numPackets; }
+    /// Returns the length of the longest path from the root to a leaf, 0 for an empty tree.
+    int Depth() const { return depth; }
+    /// Returns the number of bytes allocated for the nodes and the packets.
+    size_t MemoryUsage() const { return storage.capacity(); }
+
+    /// Returns the box of all triangles, or a negative infinity box if the tree is empty.
+    const AABB &BoundingAABB() const { return bounds; }
+
+    const TriangleBVHNode *Nodes() const { return nodes; }
+    const TriangleBVHPacket *Packets() const { return packets; }
+
+private:
+    std::vector<u8> storage; ///< The nodes followed by the packets, starting at a 64-byte boundary.
+    TriangleBVHNode *nodes;
+    TriangleBVHPacket *packets;
+    int numTriangles;
+    int numNodes;
+    int numLeaves;
+    int numPackets;
+    int depth;
+    AABB bounds;
+
+    TriangleBVH(const TriangleBVH &);
+    void operator =(const TriangleBVH &);
+};
+
+MATH_END_NAMESPACE
@@ -0,0 +1,131 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   TriangleBVHKernels.h
+    @brief  Internal traversal kernel interface of TriangleBVH. Do not include outside TriangleBVH*.cpp. */
+
+#pragma once
+
+#include "Math/BatchOpsKernels.h"
+#include "Geometry/TriangleBVH.h"
+
+MATH_BEGIN_NAMESPACE
+
+/// The tolerance of the ray-triangle test. The same as in Triangle::IntersectLineTri, so that the hits match the kD-tree.
+const float cTriangleBVHEpsilon = 1e-4f;
+
+/// A ray prepared for the traversal. The fourth components are unused.
+struct TriangleBVHRay
+{
+    float pos[4];
+    float dir[4];
+    float invDir[4]; ///< 1 / dir, with the zero components replaced by a tiny value so that the slab tests never produce NaNs.
+};
+
+/// Finds the nearest hit of the ray, closer than hit.t, and stores it to hit. Returns true if a hit was found.
+typedef bool (*TriangleBVHRaycastFunc)(const TriangleBVHNode *nodes, const TriangleBVHPacket *packets, const TriangleBVHRay &ray, TriangleBVHHit &hit);
+
+bool TriangleBVHRaycast_Scalar(const TriangleBVHNode *nodes, const TriangleBVHPacket *packets, const TriangleBVHRay &ray, TriangleBVHHit &hit);
+#ifdef MATH_BATCH_SSE2
+bool TriangleBVHRaycast_SSE2(const TriangleBVHNode *nodes, const TriangleBVHPacket *packets, const TriangleBVHRay &ray, TriangleBVHHit &hit);
+#endif
+#ifdef MATH_BATCH_AVX
+bool TriangleBVHRaycast_AVX(const TriangleBVHNode *nodes, const TriangleBVHPacket *packets, const TriangleBVHRay &ray, TriangleBVHHit &hit);
+#endif
+
+/// Tests one lane of a packet, and stores the hit to hit if it is closer. Used by the scalar kernel and to resolve the SIMD hits.
+inline bool IntersectTriangleBVHLane(const TriangleBVHPacket &packet, int lane, const TriangleBVHRay &ray, TriangleBVHHit &hit)
+{
+    const float e1x = packet.e1[0][lane], e1y = packet.e1[1][lane], e1z = packet.e1[2][lane];
+    const float e2x = packet.e2[0][lane], e2y = packet.e2[1][lane], e2z = packet.e2[2][lane];
+    const float px = ray.dir[1] * e2z - ray.dir[2] * e2y;
+    const float py = ray.dir[2] * e2x - ray.dir[0] * e2z;
+    const float pz = ray.dir[0] * e2y - ray.dir[1] * e2x;
+    const float det = e1x * px + e1y * py + e1z * pz;
+    if (det <= cTriangleBVHEpsilon && det >= -cTriangleBVHEpsilon)
+        return false;
+    const float recipDet = 1.f / det;
+    const float sx = ray.pos[0] - packet.v0[0][lane], sy = ray.pos[1] - packet.v0[1][lane], sz = ray.pos[2] - packet.v0[2][lane];
+    const float u = (sx * px + sy * py + sz * pz) * recipDet;
+    if (u < -cTriangleBVHEpsilon || u > 1.f + cTriangleBVHEpsilon)
+        return false;
+    const float qx = sy * e1z - sz * e1y;
+    const float qy = sz * e1x - sx * e1z;
+    const float qz = sx * e1y - sy * e1x;
+    const float v = (ray.dir[0] * qx + ray.dir[1] * qy + ray.dir[2] * qz) * recipDet;
+    if (v < -cTriangleBVHEpsilon || u + v > 1.f + cTriangleBVHEpsilon)
+        return false;
+    const float t = (e2x * qx + e2y * qy + e2z * qz) * recipDet;
+    if (t < 0.f || t >= hit.t)
+        return false;
+    hit.t = t;
+    hit.u = u;
+    hit.v = v;
+    hit.triangleIndex = packet.index[lane];
+    return true;
+}
+
+/// The closest-hit traversal shared by all kernels.
+/** Kernel is constructed from the ray, and must have the member functions
+    - int IntersectChildren(const TriangleBVHNode &node, float maxT, float *tNear) const, which returns a bit mask of
+      the children whose boxes the ray enters before maxT, and stores the entry distances to tNear.
+    - bool IntersectLeaf(const TriangleBVHPacket *packets, u32 numTriangles, TriangleBVHHit &hit) const, which works like
+      IntersectTriangleBVHLane for all the triangles of a leaf.
+    The nearer child is visited first, and the farther one is skipped if a hit closer than its entry distance has been found. */
+template<typename Kernel>
+bool TraverseTriangleBVH(const TriangleBVHNode *nodes, const TriangleBVHPacket *packets, const TriangleBVHRay &ray, TriangleBVHHit &hit)
+{
+    struct Entry
+    {
+        u32 child;
+        u32 numTriangles;
+        float tNear;
+    };
+    const Kernel kernel(ray);
+    // Each visited node replaces itself with at most two children, so the stack never holds more than one entry per level plus one.
+    Entry stack[TriangleBVH::cMaxDepth + 2];
+    int size = 1;
+    stack[0].child = 0;
+    stack[0].numTriangles = 0;
+    stack[0].tNear = 0.f;
+    bool found = false;
+    float tNear[2];
+    while(size > 0)
+    {
+        const Entry entry = stack[--size];
+        if (entry.tNear > hit.t)
+            continue;
+        if (entry.child & TriangleBVHNode::cLeafFlag)
+        {
+            if (kernel.IntersectLeaf(packets + (entry.child & ~TriangleBVHNode::cLeafFlag), entry.numTriangles, hit))
+                found = true;
+            continue;
+        }
+        const TriangleBVHNode &node = nodes[entry.child];
+        const int mask = kernel.IntersectChildren(node, hit.t, tNear);
+        if (mask == 3)
+        {
+            const int nearer = tNear[1] < tNear[0] ? 1 : 0;
+            const int farther = 1 - nearer;
+            stack[size].child = node.child[farther];
+            stack[size].numTriangles = node.numTriangles[farther];
+            stack[size].tNear = tNear[farther];
+            ++size;
+            stack[size].child = node.child[nearer];
+            stack[size].numTriangles = node.numTriangles[nearer];
+            stack[size].tNear = tNear[nearer];
+            ++size;
+        }
+        else if (mask != 0)
+        {
+            const int i = mask - 1;
+            stack[size].child = node.child[i];
+            stack[size].numTriangles = node.numTriangles[i];
+            stack[size].tNear = tNear[i];
+            ++size;
+        }
+    }
+    return found;
+}
+
+MATH_END_NAMESPACE
@@ -0,0 +1,129 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   TriangleBVH_AVX.cpp
+    @brief  AVX traversal kernel of TriangleBVH: both children of a node and all eight triangles of a leaf at a time. */
+
+#include "TriangleBVHKernels.h"
+
+#ifdef MATH_BATCH_AVX
+
+#include <immintrin.h>
+
+MATH_BEGIN_NAMESPACE
+
+namespace
+{
+    /// Loads four floats of the first packet to the low half, and four floats of the second packet, if any, to the high half.
+    /// The high half of a single packet is zero, which the intersection test rejects like the unused lanes of a packet.
+    inline __m256 LoadPair(const float *first, const float *second)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(first)), second ? _mm_load_ps(second) : _mm_setzero_ps(), 1);
+    }
+
+    struct AVXKernel
+    {
+        explicit AVXKernel(const TriangleBVHRay &ray)
+        {
+            for(int i = 0; i < 3; ++i)
+            {
+                pos[i] = _mm_set1_ps(ray.pos[i]);
+                invDir[i] = _mm_set1_ps(ray.invDir[i]);
+                pos8[i] = _mm256_set1_ps(ray.pos[i]);
+                dir8[i] = _mm256_set1_ps(ray.dir[i]);
+            }
+        }
+
+        /// The same as the SSE2 version, there are only two boxes to test.
+        int IntersectChildren(const TriangleBVHNode &node, float maxT, float *tNear) const
+        {
+            __m128 tMin = _mm_setzero_ps();
+            __m128 tMax = _mm_set1_ps(maxT);
+            for(int axis = 0; axis < 3; ++axis)
+            {
+                const __m128 t = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds + axis * 4), pos[axis]), invDir[axis]);
+                const __m128 swapped = _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 0, 3, 2));
+                tMin = _mm_max_ps(tMin, _mm_min_ps(t, swapped));
+                tMax = _mm_min_ps(tMax, _mm_max_ps(t, swapped));
+            }
+            _mm_storel_pi(reinterpret_cast<__m64 *>(tNear), tMin);
+            return _mm_movemask_ps(_mm_cmple_ps(tMin, tMax)) & 3;
+        }
+
+        bool IntersectLeaf(const TriangleBVHPacket *packets, u32 numTriangles, TriangleBVHHit &hit) const
+        {
+            // The leaves have at most two packets, which fit one AVX register.
+            const TriangleBVHPacket &p0 = packets[0];
+            const TriangleBVHPacket *p1 = numTriangles > 4 ? &packets[1] : 0;
+            const __m256 e1x = LoadPair(p0.e1[0], p1 ? p1->e1[0] : 0);
+            const __m256 e1y = LoadPair(p0.e1[1], p1 ? p1->e1[1] : 0);
+            const __m256 e1z = LoadPair(p0.e1[2], p1 ? p1->e1[2] : 0);
+            const __m256 e2x = LoadPair(p0.e2[0], p1 ? p1->e2[0] : 0);
+            const __m256 e2y = LoadPair(p0.e2[1], p1 ? p1->e2[1] : 0);
+            const __m256 e2z = LoadPair(p0.e2[2], p1 ? p1->e2[2] : 0);
+            const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dir8[1], e2z), _mm256_mul_ps(dir8[2], e2y));
+            const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dir8[2], e2x), _mm256_mul_ps(dir8[0], e2z));
+            const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dir8[0], e2y), _mm256_mul_ps(dir8[1], e2x));
+            const __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+            __m256 mask = _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.f), det), _mm256_set1_ps(cTriangleBVHEpsilon), _CMP_GT_OQ);
+            if (_mm256_movemask_ps(mask) == 0)
+                return false;
+
+            const __m256 recipDet = _mm256_div_ps(_mm256_set1_ps(1.f), det);
+            const __m256 sx = _mm256_sub_ps(pos8[0], LoadPair(p0.v0[0], p1 ? p1->v0[0] : 0));
+            const __m256 sy = _mm256_sub_ps(pos8[1], LoadPair(p0.v0[1], p1 ? p1->v0[1] : 0));
+            const __m256 sz = _mm256_sub_ps(pos8[2], LoadPair(p0.v0[2], p1 ? p1->v0[2] : 0));
+            const __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), recipDet);
+            const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+            const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+            const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+            const __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dir8[0], qx), _mm256_mul_ps(dir8[1], qy)), _mm256_mul_ps(dir8[2], qz)), recipDet);
+            const __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), recipDet);
+
+            const __m256 negEpsilon = _mm256_set1_ps(-cTriangleBVHEpsilon);
+            const __m256 onePlusEpsilon = _mm256_set1_ps(1.f + cTriangleBVHEpsilon);
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, negEpsilon, _CMP_GE_OQ));
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, onePlusEpsilon, _CMP_LE_OQ));
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, negEpsilon, _CMP_GE_OQ));
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), onePlusEpsilon, _CMP_LE_OQ));
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_GE_OQ));
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_set1_ps(hit.t), _CMP_LT_OQ));
+            const int bits = _mm256_movemask_ps(mask);
+            if (bits == 0)
+                return false;
+
+            float ts[8], us[8], vs[8];
+            _mm256_storeu_ps(ts, t);
+            _mm256_storeu_ps(us, u);
+            _mm256_storeu_ps(vs, v);
+            bool found = false;
+            for(int lane = 0; lane < 8; ++lane)
+                if ((bits & (1 << lane)) && ts[lane] < hit.t)
+                {
+                    hit.t = ts[lane];
+                    hit.u = us[lane];
+                    hit.v = vs[lane];
+                    hit.triangleIndex = (lane < 4 ? p0 : *p1).index[lane & 3];
+                    found = true;
+                }
+            return found;
+        }
+
+        __m128 pos[3];
+        __m128 invDir[3];
+        __m256 pos8[3];
+        __m256 dir8[3];
+    };
+}
+
+bool TriangleBVHRaycast_AVX(const TriangleBVHNode *nodes, const TriangleBVHPacket *packets, const TriangleBVHRay &ray, TriangleBVHHit &hit)
+{
+    const bool found = TraverseTriangleBVH<AVXKernel>(nodes, packets, ray, hit);
+    // Avoid the penalty of mixing the upper halves of the AVX registers with legacy SSE code compiled elsewhere.
+    _mm256_zeroupper();
+    return found;
+}
+
+MATH_END_NAMESPACE
+
+#endif
@@ -0,0 +1,121 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   TriangleBVH_SSE2.cpp
+    @brief  SSE2 traversal kernel of TriangleBVH: both children of a node and four triangles at a time. */
+
+#include "TriangleBVHKernels.h"
+
+#ifdef MATH_BATCH_SSE2
+
+#include <emmintrin.h>
+
+MATH_BEGIN_NAMESPACE
+
+namespace
+{
+    struct SSE2Kernel
+    {
+        explicit SSE2Kernel(const TriangleBVHRay &ray)
+        {
+            for(int i = 0; i < 3; ++i)
+            {
+                pos[i] = _mm_set1_ps(ray.pos[i]);
+                dir[i] = _mm_set1_ps(ray.dir[i]);
+                invDir[i] = _mm_set1_ps(ray.invDir[i]);
+            }
+        }
+
+        int IntersectChildren(const TriangleBVHNode &node, float maxT, float *tNear) const
+        {
+            // Each axis is one register of (child0.min, child1.min, child0.max, child1.max). Swapping the halves pairs the
+            // entry and exit distances of both children, whichever way the ray points.
+            __m128 tMin = _mm_setzero_ps();
+            __m128 tMax = _mm_set1_ps(maxT);
+            for(int axis = 0; axis < 3; ++axis)
+            {
+                const __m128 t = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds + axis * 4), pos[axis]), invDir[axis]);
+                const __m128 swapped = _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 0, 3, 2));
+                tMin = _mm_max_ps(tMin, _mm_min_ps(t, swapped));
+                tMax = _mm_min_ps(tMax, _mm_max_ps(t, swapped));
+            }
+            _mm_storel_pi(reinterpret_cast<__m64 *>(tNear), tMin);
+            return _mm_movemask_ps(_mm_cmple_ps(tMin, tMax)) & 3;
+        }
+
+        bool IntersectPacket(const TriangleBVHPacket &packet, TriangleBVHHit &hit) const
+        {
+            const __m128 e1x = _mm_load_ps(packet.e1[0]), e1y = _mm_load_ps(packet.e1[1]), e1z = _mm_load_ps(packet.e1[2]);
+            const __m128 e2x = _mm_load_ps(packet.e2[0]), e2y = _mm_load_ps(packet.e2[1]), e2z = _mm_load_ps(packet.e2[2]);
+            const __m128 px = _mm_sub_ps(_mm_mul_ps(dir[1], e2z), _mm_mul_ps(dir[2], e2y));
+            const __m128 py = _mm_sub_ps(_mm_mul_ps(dir[2], e2x), _mm_mul_ps(dir[0], e2z));
+            const __m128 pz = _mm_sub_ps(_mm_mul_ps(dir[0], e2y), _mm_mul_ps(dir[1], e2x));
+            const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+            const __m128 epsilon = _mm_set1_ps(cTriangleBVHEpsilon);
+            __m128 mask = _mm_cmpgt_ps(_mm_andnot_ps(_mm_set1_ps(-0.f), det), epsilon);
+            if (_mm_movemask_ps(mask) == 0)
+                return false;
+
+            const __m128 recipDet = _mm_div_ps(_mm_set1_ps(1.f), det);
+            const __m128 sx = _mm_sub_ps(pos[0], _mm_load_ps(packet.v0[0]));
+            const __m128 sy = _mm_sub_ps(pos[1], _mm_load_ps(packet.v0[1]));
+            const __m128 sz = _mm_sub_ps(pos[2], _mm_load_ps(packet.v0[2]));
+            const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), recipDet);
+            const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+            const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+            const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+            const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dir[0], qx), _mm_mul_ps(dir[1], qy)), _mm_mul_ps(dir[2], qz)), recipDet);
+            const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), recipDet);
+
+            const __m128 negEpsilon = _mm_set1_ps(-cTriangleBVHEpsilon);
+            const __m128 onePlusEpsilon = _mm_set1_ps(1.f + cTriangleBVHEpsilon);
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(u, negEpsilon));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(u, onePlusEpsilon));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(v, negEpsilon));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), onePlusEpsilon));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(t, _mm_setzero_ps()));
+            mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(hit.t)));
+            const int bits = _mm_movemask_ps(mask);
+            if (bits == 0)
+                return false;
+
+            float ts[4], us[4], vs[4];
+            _mm_storeu_ps(ts, t);
+            _mm_storeu_ps(us, u);
+            _mm_storeu_ps(vs, v);
+            bool found = false;
+            for(int lane = 0; lane < 4; ++lane)
+                if ((bits & (1 << lane)) && ts[lane] < hit.t)
+                {
+                    hit.t = ts[lane];
+                    hit.u = us[lane];
+                    hit.v = vs[lane];
+                    hit.triangleIndex = packet.index[lane];
+                    found = true;
+                }
+            return found;
+        }
+
+        bool IntersectLeaf(const TriangleBVHPacket *packets, u32 numTriangles, TriangleBVHHit &hit) const
+        {
+            bool found = false;
+            for(u32 i = 0; i < numTriangles; i += 4)
+                if (IntersectPacket(packets[i / 4], hit))
+                    found = true;
+            return found;
+        }
+
+        __m128 pos[3];
+        __m128 dir[3];
+        __m128 invDir[3];
+    };
+}
+
+bool TriangleBVHRaycast_SSE2(const TriangleBVHNode *nodes, const TriangleBVHPacket *packets, const TriangleBVHRay &ray, TriangleBVHHit &hit)
+{
+    return TraverseTriangleBVH<SSE2Kernel>(nodes, packets, ray, hit);
+}
+
+MATH_END_NAMESPACE
+
+#endif
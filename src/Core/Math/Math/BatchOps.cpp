@@ -0,0 +1,528 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   BatchOps.cpp
+    @brief  Batch operations over arrays of points, AABBs and spheres: scalar kernels and runtime dispatch. */
+
+#include "BatchOps.h"
+#include "BatchOpsKernels.h"
+#include "Math/float3.h"
+#include "Math/float3x4.h"
+#include "Geometry/AABB.h"
+#include "Geometry/Sphere.h"
+#include "Geometry/Frustum.h"
+#include "Geometry/Plane.h"
+
+#include <cmath>
+#include <limits>
+
+#ifdef MATH_BATCH_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+MATH_BEGIN_NAMESPACE
+
+namespace
+{
+    BatchKernels activeKernels;
+    BatchSimdLevel activeLevel = BatchSimdScalar;
+    bool kernelsInitialized = false;
+
+    /// Selects the kernels of the detected level, unless SetBatchSimdLevel has already selected them.
+    bool InitializeKernels()
+    {
+        if (!kernelsInitialized)
+            SetBatchSimdLevel(DetectBatchSimdLevel());
+        return true;
+    }
+
+    // The kernels are selected when the module is loaded, before any thread can run a batch operation. VS2008 and VS2010
+    // do not make the initialization of function-local statics thread-safe, so the selection is not left to the first call.
+    const bool kernelsSelectedOnLoad = InitializeKernels();
+
+    const BatchKernels &Kernels()
+    {
+        // Only true for calls from the static initializers of other files, which run before this file's and in one thread.
+        if (!kernelsInitialized)
+            InitializeKernels();
+        return activeKernels;
+    }
+
+#ifdef MATH_BATCH_SSE2
+    /// Executes CPUID with the given function id. Returns the EAX, EBX, ECX and EDX registers in that order.
+    void CpuId(int function, unsigned int regs[4])
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, function);
+        for(int i = 0; i < 4; ++i)
+            regs[i] = (unsigned int)info[i];
+#else
+        if (!__get_cpuid((unsigned int)function, &regs[0], &regs[1], &regs[2], &regs[3]))
+            regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+    }
+
+    /// Returns true if the operating system saves the AVX register state on context switches.
+    bool OsSupportsAVX()
+    {
+#if defined(_MSC_VER) && defined(_MSC_FULL_VER) && _MSC_FULL_VER >= 160040219 // VS2010 SP1 introduced _xgetbv.
+        return (_xgetbv(0) & 6) == 6;
+#elif defined(__GNUC__)
+        unsigned int eax, edx;
+        // xgetbv, encoded as bytes as older assemblers do not know the mnemonic.
+        __asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (eax & 6) == 6;
+#else
+        return false;
+#endif
+    }
+#endif
+
+    inline float Abs(float f) { return f >= 0.f ? f : -f; }
+}
+
+BatchSimdLevel DetectBatchSimdLevel()
+{
+#ifdef MATH_BATCH_SSE2
+    unsigned int regs[4];
+    CpuId(0, regs);
+    if (regs[0] < 1)
+        return BatchSimdScalar;
+
+    CpuId(1, regs);
+    const unsigned int ecx = regs[2];
+    const unsigned int edx = regs[3];
+#ifdef MATH_BATCH_AVX
+    const bool hasOsxsave = (ecx & (1 << 27)) != 0;
+    const bool hasAVX = (ecx & (1 << 28)) != 0;
+    if (hasOsxsave && hasAVX && OsSupportsAVX())
+        return BatchSimdAVX;
+#endif
+    if ((ecx & (1 << 19)) != 0)
+        return BatchSimdSSE41;
+    if ((edx & (1 << 26)) != 0)
+        return BatchSimdSSE2;
+#endif
+    return BatchSimdScalar;
+}
+
+BatchSimdLevel ActiveBatchSimdLevel()
+{
+    Kernels();
+    return activeLevel;
+}
+
+BatchSimdLevel SetBatchSimdLevel(BatchSimdLevel level)
+{
+    const BatchSimdLevel detected = DetectBatchSimdLevel();
+    if (level > detected)
+        level = detected;
+
+    GetBatchKernels_Scalar(activeKernels);
+    activeLevel = BatchSimdScalar;
+#ifdef MATH_BATCH_SSE2
+    if (level >= BatchSimdSSE2)
+    {
+        GetBatchKernels_SSE2(activeKernels);
+        activeLevel = level >= BatchSimdSSE41 ? BatchSimdSSE41 : BatchSimdSSE2;
+    }
+#endif
+#ifdef MATH_BATCH_AVX
+    if (level >= BatchSimdAVX)
+    {
+        GetBatchKernels_AVX(activeKernels);
+        activeLevel = BatchSimdAVX;
+    }
+#endif
+    kernelsInitialized = true;
+    return activeLevel;
+}
+
+const char *BatchSimdLevelName(BatchSimdLevel level)
+{
+    switch(level)
+    {
+    case BatchSimdSSE2: return "SSE2";
+    case BatchSimdSSE41: return "SSE4.1";
+    case BatchSimdAVX: return "AVX";
+    default: return "Scalar";
+    }
+}
+
+// PointArray
+
+void PointArray::Resize(int size)
+{
+    x.resize(size);
+    y.resize(size);
+    z.resize(size);
+}
+
+void PointArray::Clear()
+{
+    x.clear();
+    y.clear();
+    z.clear();
+}
+
+void PointArray::Add(const float3 &point)
+{
+    x.push_back(point.x);
+    y.push_back(point.y);
+    z.push_back(point.z);
+}
+
+void PointArray::Set(int index, const float3 &point)
+{
+    x[index] = point.x;
+    y[index] = point.y;
+    z[index] = point.z;
+}
+
+float3 PointArray::At(int index) const
+{
+    return float3(x[index], y[index], z[index]);
+}
+
+// AABBArray
+
+void AABBArray::Resize(int size)
+{
+    minX.resize(size);
+    minY.resize(size);
+    minZ.resize(size);
+    maxX.resize(size);
+    maxY.resize(size);
+    maxZ.resize(size);
+}
+
+void AABBArray::Clear()
+{
+    Resize(0);
+}
+
+void AABBArray::Add(const AABB &aabb)
+{
+    Resize(Size() + 1);
+    Set(Size() - 1, aabb);
+}
+
+void AABBArray::Set(int index, const AABB &aabb)
+{
+    minX[index] = aabb.minPoint.x;
+    minY[index] = aabb.minPoint.y;
+    minZ[index] = aabb.minPoint.z;
+    maxX[index] = aabb.maxPoint.x;
+    maxY[index] = aabb.maxPoint.y;
+    maxZ[index] = aabb.maxPoint.z;
+}
+
+AABB AABBArray::At(int index) const
+{
+    return AABB(float3(minX[index], minY[index], minZ[index]), float3(maxX[index], maxY[index], maxZ[index]));
+}
+
+// SphereArray
+
+void SphereArray::Resize(int size)
+{
+    x.resize(size);
+    y.resize(size);
+    z.resize(size);
+    r.resize(size);
+}
+
+void SphereArray::Clear()
+{
+    Resize(0);
+}
+
+void SphereArray::Add(const Sphere &sphere)
+{
+    x.push_back(sphere.pos.x);
+    y.push_back(sphere.pos.y);
+    z.push_back(sphere.pos.z);
+    r.push_back(sphere.r);
+}
+
+void SphereArray::Set(int index, const Sphere &sphere)
+{
+    x[index] = sphere.pos.x;
+    y[index] = sphere.pos.y;
+    z[index] = sphere.pos.z;
+    r[index] = sphere.r;
+}
+
+Sphere SphereArray::At(int index) const
+{
+    return Sphere(float3(x[index], y[index], z[index]), r[index]);
+}
+
+// Public API
+
+namespace
+{
+    AABBStreams Streams(const AABBArray &aabbs)
+    {
+        AABBStreams s;
+        const bool empty = aabbs.minX.empty();
+        s.v[0] = empty ? 0 : &aabbs.minX[0];
+        s.v[1] = empty ? 0 : &aabbs.minY[0];
+        s.v[2] = empty ? 0 : &aabbs.minZ[0];
+        s.v[3] = empty ? 0 : &aabbs.maxX[0];
+        s.v[4] = empty ? 0 : &aabbs.maxY[0];
+        s.v[5] = empty ? 0 : &aabbs.maxZ[0];
+        return s;
+    }
+
+    AABBOutStreams OutStreams(AABBArray &aabbs)
+    {
+        AABBOutStreams s;
+        const bool empty = aabbs.minX.empty();
+        s.v[0] = empty ? 0 : &aabbs.minX[0];
+        s.v[1] = empty ? 0 : &aabbs.minY[0];
+        s.v[2] = empty ? 0 : &aabbs.minZ[0];
+        s.v[3] = empty ? 0 : &aabbs.maxX[0];
+        s.v[4] = empty ? 0 : &aabbs.maxY[0];
+        s.v[5] = empty ? 0 : &aabbs.maxZ[0];
+        return s;
+    }
+
+    /// Returns the six frustum planes as (nx, ny, nz, d) quadruplets.
+    void FrustumPlanes(const Frustum &frustum, float *planes)
+    {
+        Plane p[6];
+        frustum.GetPlanes(p);
+        for(int i = 0; i < 6; ++i)
+        {
+            planes[i*4] = p[i].normal.x;
+            planes[i*4+1] = p[i].normal.y;
+            planes[i*4+2] = p[i].normal.z;
+            planes[i*4+3] = p[i].d;
+        }
+    }
+}
+
+void BatchTransformPoints(const float3x4 &transform, const PointArray &points, PointArray &outPoints)
+{
+    const int count = points.Size();
+    outPoints.Resize(count);
+    if (count == 0)
+        return;
+    Kernels().transformPoints(transform.ptr(), &points.x[0], &points.y[0], &points.z[0], &outPoints.x[0], &outPoints.y[0], &outPoints.z[0], count);
+}
+
+void BatchTransformAABBs(const float3x4 &transform, const AABBArray &aabbs, AABBArray &outAABBs)
+{
+    const int count = aabbs.Size();
+    outAABBs.Resize(count);
+    if (count == 0)
+        return;
+    Kernels().transformAABBs(transform.ptr(), Streams(aabbs), OutStreams(outAABBs), count);
+}
+
+AABB BatchComputeBounds(const PointArray &points)
+{
+    AABB bounds;
+    bounds.SetNegativeInfinity();
+    const int count = points.Size();
+    if (count == 0)
+        return bounds;
+    Kernels().computeBounds(&points.x[0], &points.y[0], &points.z[0], count, bounds.minPoint.ptr(), bounds.maxPoint.ptr());
+    return bounds;
+}
+
+int BatchCullAABBs(const Frustum &frustum, const AABBArray &aabbs, std::vector<u8> &outVisible)
+{
+    const int count = aabbs.Size();
+    outVisible.resize(count);
+    if (count == 0)
+        return 0;
+    float planes[24];
+    FrustumPlanes(frustum, planes);
+    return Kernels().cullAABBs(planes, 6, Streams(aabbs), &outVisible[0], count);
+}
+
+int BatchCullSpheres(const Frustum &frustum, const SphereArray &spheres, std::vector<u8> &outVisible)
+{
+    const int count = spheres.Size();
+    outVisible.resize(count);
+    if (count == 0)
+        return 0;
+    float planes[24];
+    FrustumPlanes(frustum, planes);
+    return Kernels().cullSpheres(planes, 6, &spheres.x[0], &spheres.y[0], &spheres.z[0], &spheres.r[0], &outVisible[0], count);
+}
+
+int BatchIntersectAABBs(const Sphere &sphere, const AABBArray &aabbs, std::vector<u8> &outIntersects)
+{
+    const int count = aabbs.Size();
+    outIntersects.resize(count);
+    if (count == 0)
+        return 0;
+    const float s[4] = { sphere.pos.x, sphere.pos.y, sphere.pos.z, sphere.r };
+    return Kernels().intersectAABBsSphere(s, Streams(aabbs), &outIntersects[0], count);
+}
+
+int BatchIntersectSpheres(const Sphere &sphere, const SphereArray &spheres, std::vector<u8> &outIntersects)
+{
+    const int count = spheres.Size();
+    outIntersects.resize(count);
+    if (count == 0)
+        return 0;
+    const float s[4] = { sphere.pos.x, sphere.pos.y, sphere.pos.z, sphere.r };
+    return Kernels().intersectSpheresSphere(s, &spheres.x[0], &spheres.y[0], &spheres.z[0], &spheres.r[0], &outIntersects[0], count);
+}
+
+// Scalar kernels
+
+void BatchTransformPoints_Scalar(const float *m, const float *x, const float *y, const float *z, float *outX, float *outY, float *outZ, int count)
+{
+    for(int i = 0; i < count; ++i)
+    {
+        const float px = x[i], py = y[i], pz = z[i];
+        outX[i] = m[0]*px + m[1]*py + m[2]*pz + m[3];
+        outY[i] = m[4]*px + m[5]*py + m[6]*pz + m[7];
+        outZ[i] = m[8]*px + m[9]*py + m[10]*pz + m[11];
+    }
+}
+
+void BatchTransformAABBs_Scalar(const float *m, const AABBStreams &in, const AABBOutStreams &out, int count)
+{
+    // Transform the center point and compute the new half-extents from the absolute values of the matrix (Arvo's method).
+    for(int i = 0; i < count; ++i)
+    {
+        const float cx = (in.v[0][i] + in.v[3][i]) * 0.5f;
+        const float cy = (in.v[1][i] + in.v[4][i]) * 0.5f;
+        const float cz = (in.v[2][i] + in.v[5][i]) * 0.5f;
+        const float ex = (in.v[3][i] - in.v[0][i]) * 0.5f;
+        const float ey = (in.v[4][i] - in.v[1][i]) * 0.5f;
+        const float ez = (in.v[5][i] - in.v[2][i]) * 0.5f;
+        for(int row = 0; row < 3; ++row)
+        {
+            const float *r = m + row*4;
+            const float c = r[0]*cx + r[1]*cy + r[2]*cz + r[3];
+            const float e = Abs(r[0])*ex + Abs(r[1])*ey + Abs(r[2])*ez;
+            out.v[row][i] = c - e;
+            out.v[row+3][i] = c + e;
+        }
+    }
+}
+
+void BatchComputeBounds_Scalar(const float *x, const float *y, const float *z, int count, float *outMin, float *outMax)
+{
+    for(int i = 0; i < count; ++i)
+    {
+        outMin[0] = x[i] < outMin[0] ? x[i] : outMin[0];
+        outMin[1] = y[i] < outMin[1] ? y[i] : outMin[1];
+        outMin[2] = z[i] < outMin[2] ? z[i] : outMin[2];
+        outMax[0] = x[i] > outMax[0] ? x[i] : outMax[0];
+        outMax[1] = y[i] > outMax[1] ? y[i] : outMax[1];
+        outMax[2] = z[i] > outMax[2] ? z[i] : outMax[2];
+    }
+}
+
+int BatchCullAABBs_Scalar(const float *planes, int numPlanes, const AABBStreams &in, u8 *outVisible, int count)
+{
+    int numVisible = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        const float cx = (in.v[0][i] + in.v[3][i]) * 0.5f;
+        const float cy = (in.v[1][i] + in.v[4][i]) * 0.5f;
+        const float cz = (in.v[2][i] + in.v[5][i]) * 0.5f;
+        const float ex = (in.v[3][i] - in.v[0][i]) * 0.5f;
+        const float ey = (in.v[4][i] - in.v[1][i]) * 0.5f;
+        const float ez = (in.v[5][i] - in.v[2][i]) * 0.5f;
+        u8 visible = 1;
+        for(int p = 0; p < numPlanes; ++p)
+        {
+            const float *plane = planes + p*4;
+            const float distance = plane[0]*cx + plane[1]*cy + plane[2]*cz - plane[3];
+            const float radius = Abs(plane[0])*ex + Abs(plane[1])*ey + Abs(plane[2])*ez;
+            if (distance > radius)
+            {
+                visible = 0;
+                break;
+            }
+        }
+        outVisible[i] = visible;
+        numVisible += visible;
+    }
+    return numVisible;
+}
+
+int BatchCullSpheres_Scalar(const float *planes, int numPlanes, const float *x, const float *y, const float *z, const float *r, u8 *outVisible, int count)
+{
+    int numVisible = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        u8 visible = 1;
+        for(int p = 0; p < numPlanes; ++p)
+        {
+            const float *plane = planes + p*4;
+            if (plane[0]*x[i] + plane[1]*y[i] + plane[2]*z[i] - plane[3] > r[i])
+            {
+                visible = 0;
+                break;
+            }
+        }
+        outVisible[i] = visible;
+        numVisible += visible;
+    }
+    return numVisible;
+}
+
+int BatchIntersectAABBsSphere_Scalar(const float *sphere, const AABBStreams &in, u8 *outIntersects, int count)
+{
+    int numIntersecting = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        // Squared distance from the sphere center to the closest point of the box.
+        float distanceSq = 0.f;
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            const float below = in.v[axis][i] - sphere[axis];
+            const float above = sphere[axis] - in.v[axis+3][i];
+            const float d = (below > 0.f ? below : 0.f) + (above > 0.f ? above : 0.f);
+            distanceSq += d*d;
+        }
+        const u8 intersects = distanceSq <= sphere[3]*sphere[3] ? 1 : 0;
+        outIntersects[i] = intersects;
+        numIntersecting += intersects;
+    }
+    return numIntersecting;
+}
+
+int BatchIntersectSpheresSphere_Scalar(const float *sphere, const float *x, const float *y, const float *z, const float *r, u8 *outIntersects, int count)
+{
+    int numIntersecting = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        const float dx = x[i] - sphere[0];
+        const float dy = y[i] - sphere[1];
+        const float dz = z[i] - sphere[2];
+        const float radius = r[i] + sphere[3];
+        const u8 intersects = dx*dx + dy*dy + dz*dz <= radius*radius ? 1 : 0;
+        outIntersects[i] = intersects;
+        numIntersecting += intersects;
+    }
+    return numIntersecting;
+}
+
+void GetBatchKernels_Scalar(BatchKernels &kernels)
+{
+    kernels.transformPoints = &BatchTransformPoints_Scalar;
+    kernels.transformAABBs = &BatchTransformAABBs_Scalar;
+    kernels.computeBounds = &BatchComputeBounds_Scalar;
+    kernels.cullAABBs = &BatchCullAABBs_Scalar;
+    kernels.cullSpheres = &BatchCullSpheres_Scalar;
+    kernels.intersectAABBsSphere = &BatchIntersectAABBsSphere_Scalar;
+    kernels.intersectSpheresSphere = &BatchIntersectSpheresSphere_Scalar;
+}
+
+MATH_END_NAMESPACE
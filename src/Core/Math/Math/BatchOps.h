@@ -0,0 +1,126 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   BatchOps.h
+    @brief  Batch operations over arrays of points, AABBs and spheres stored in structure-of-arrays layout.
+
+    The operations are dispatched at runtime to SSE2 or AVX kernels when the CPU supports them, and fall back to
+    scalar code otherwise. All kernels produce the same results as their scalar counterparts, up to floating-point
+    rounding differences. */
+
+#pragma once
+
+#include "Math/MathNamespace.h"
+#include "Math/MathFwd.h"
+#include "Types.h"
+
+#include <vector>
+
+MATH_BEGIN_NAMESPACE
+
+/// The instruction set levels the batch operations can be dispatched to.
+enum BatchSimdLevel
+{
+    BatchSimdScalar = 0, ///< Plain C++.
+    BatchSimdSSE2,       ///< 4-wide SSE2 kernels.
+    BatchSimdSSE41,      ///< SSE4.1 is detected, but uses the SSE2 kernels as the batch operations do not benefit from it.
+    BatchSimdAVX         ///< 8-wide AVX kernels.
+};
+
+/// Returns the best instruction set level supported by both this build and the CPU.
+BatchSimdLevel DetectBatchSimdLevel();
+
+/// Returns the instruction set level the batch operations are currently dispatched to.
+BatchSimdLevel ActiveBatchSimdLevel();
+
+/// Forces the batch operations to the given instruction set level, e.g. for testing and benchmarking.
+/** The level is clamped to the one returned by DetectBatchSimdLevel().
+    @note Not thread-safe. Do not call while batch operations are running on other threads.
+    @return The level that was set. */
+BatchSimdLevel SetBatchSimdLevel(BatchSimdLevel level);
+
+/// Returns a human-readable name of the given level, e.g. "AVX".
+const char *BatchSimdLevelName(BatchSimdLevel level);
+
+/// A set of 3D points in structure-of-arrays layout.
+struct PointArray
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+
+    int Size() const { return (int)x.size(); }
+    void Resize(int size);
+    void Clear();
+    void Add(const float3 &point);
+    void Set(int index, const float3 &point);
+    float3 At(int index) const;
+};
+
+/// A set of axis-aligned bounding boxes in structure-of-arrays layout.
+struct AABBArray
+{
+    std::vector<float> minX;
+    std::vector<float> minY;
+    std::vector<float> minZ;
+    std::vector<float> maxX;
+    std::vector<float> maxY;
+    std::vector<float> maxZ;
+
+    int Size() const { return (int)minX.size(); }
+    void Resize(int size);
+    void Clear();
+    void Add(const AABB &aabb);
+    void Set(int index, const AABB &aabb);
+    AABB At(int index) const;
+};
+
+/// A set of spheres in structure-of-arrays layout.
+struct SphereArray
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> r;
+
+    int Size() const { return (int)x.size(); }
+    void Resize(int size);
+    void Clear();
+    void Add(const Sphere &sphere);
+    void Set(int index, const Sphere &sphere);
+    Sphere At(int index) const;
+};
+
+/// Transforms the given points by the given affine transform. outPoints is resized to match. In-place transformation is allowed.
+void BatchTransformPoints(const float3x4 &transform, const PointArray &points, PointArray &outPoints);
+
+/// Computes the axis-aligned bounding boxes of the given AABBs after transforming them by the given affine transform.
+/** outAABBs is resized to match. In-place transformation is allowed. */
+void BatchTransformAABBs(const float3x4 &transform, const AABBArray &aabbs, AABBArray &outAABBs);
+
+/// Computes the bounding box of the given points.
+/** @return The bounds, or a negative infinity AABB if there are no points. */
+AABB BatchComputeBounds(const PointArray &points);
+
+/// Tests the given AABBs against the given frustum.
+/** The test is conservative: a box is reported as visible unless it lies completely outside one of the frustum planes.
+    @param outVisible [out] Receives 1 for each visible box and 0 for each culled box.
+    @return The number of visible boxes. */
+int BatchCullAABBs(const Frustum &frustum, const AABBArray &aabbs, std::vector<u8> &outVisible);
+
+/// Tests the given spheres against the given frustum. The test is conservative in the same way as in BatchCullAABBs.
+/** @param outVisible [out] Receives 1 for each visible sphere and 0 for each culled sphere.
+    @return The number of visible spheres. */
+int BatchCullSpheres(const Frustum &frustum, const SphereArray &spheres, std::vector<u8> &outVisible);
+
+/// Tests which of the given AABBs intersect the given sphere.
+/** @param outIntersects [out] Receives 1 for each box that intersects the sphere, and 0 otherwise.
+    @return The number of intersecting boxes. */
+int BatchIntersectAABBs(const Sphere &sphere, const AABBArray &aabbs, std::vector<u8> &outIntersects);
+
+/// Tests which of the given spheres intersect the given sphere.
+/** @param outIntersects [out] Receives 1 for each sphere that intersects the sphere, and 0 otherwise.
+    @return The number of intersecting spheres. */
+int BatchIntersectSpheres(const Sphere &sphere, const SphereArray &spheres, std::vector<u8> &outIntersects);
+
+MATH_END_NAMESPACE
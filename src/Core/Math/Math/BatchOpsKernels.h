@@ -0,0 +1,65 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   BatchOpsKernels.h
+    @brief  Internal kernel interface of BatchOps. Do not include outside BatchOps*.cpp and the other SIMD kernels of the library. */
+
+#pragma once
+
+#include "Math/MathNamespace.h"
+#include "Types.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+/// The SSE2 kernels are compiled in on all x86 and x64 targets.
+#define MATH_BATCH_SSE2
+#else
+/// MATH_BATCH_AVX is defined in CMakeLists.txt when the compiler can target AVX, but it is only meaningful on x86 and x64.
+#undef MATH_BATCH_AVX
+#endif
+
+MATH_BEGIN_NAMESPACE
+
+/// Pointers to the six coordinate arrays of an AABBArray, in the order minX, minY, minZ, maxX, maxY, maxZ.
+struct AABBStreams
+{
+    const float *v[6];
+};
+
+/// Pointers to the six coordinate arrays of an output AABBArray.
+struct AABBOutStreams
+{
+    float *v[6];
+};
+
+/// Function table of one instruction set level.
+/** Matrices are passed as the 12 floats of a row-major float3x4, and planes as (nx, ny, nz, d) with nx*x + ny*y + nz*z = d,
+    the normal pointing outside of the volume. Spheres are passed as (x, y, z, r). Each kernel processes the elements [0, count[. */
+struct BatchKernels
+{
+    void (*transformPoints)(const float *m, const float *x, const float *y, const float *z, float *outX, float *outY, float *outZ, int count);
+    void (*transformAABBs)(const float *m, const AABBStreams &in, const AABBOutStreams &out, int count);
+    void (*computeBounds)(const float *x, const float *y, const float *z, int count, float *outMin, float *outMax);
+    int (*cullAABBs)(const float *planes, int numPlanes, const AABBStreams &in, u8 *outVisible, int count);
+    int (*cullSpheres)(const float *planes, int numPlanes, const float *x, const float *y, const float *z, const float *r, u8 *outVisible, int count);
+    int (*intersectAABBsSphere)(const float *sphere, const AABBStreams &in, u8 *outIntersects, int count);
+    int (*intersectSpheresSphere)(const float *sphere, const float *x, const float *y, const float *z, const float *r, u8 *outIntersects, int count);
+};
+
+/// Scalar kernels. The SIMD kernels use these for the remainder elements that do not fill a whole SIMD register.
+void BatchTransformPoints_Scalar(const float *m, const float *x, const float *y, const float *z, float *outX, float *outY, float *outZ, int count);
+void BatchTransformAABBs_Scalar(const float *m, const AABBStreams &in, const AABBOutStreams &out, int count);
+void BatchComputeBounds_Scalar(const float *x, const float *y, const float *z, int count, float *outMin, float *outMax);
+int BatchCullAABBs_Scalar(const float *planes, int numPlanes, const AABBStreams &in, u8 *outVisible, int count);
+int BatchCullSpheres_Scalar(const float *planes, int numPlanes, const float *x, const float *y, const float *z, const float *r, u8 *outVisible, int count);
+int BatchIntersectAABBsSphere_Scalar(const float *sphere, const AABBStreams &in, u8 *outIntersects, int count);
+int BatchIntersectSpheresSphere_Scalar(const float *sphere, const float *x, const float *y, const float *z, const float *r, u8 *outIntersects, int count);
+
+void GetBatchKernels_Scalar(BatchKernels &kernels);
+#ifdef MATH_BATCH_SSE2
+void GetBatchKernels_SSE2(BatchKernels &kernels);
+#endif
+#ifdef MATH_BATCH_AVX
+void GetBatchKernels_AVX(BatchKernels &kernels);
+#endif
+
+MATH_END_NAMESPACE
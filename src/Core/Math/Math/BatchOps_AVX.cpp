@@ -0,0 +1,240 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   BatchOps_AVX.cpp
+    @brief  8-wide AVX kernels of the batch operations. */
+
+#include "BatchOpsKernels.h"
+
+#ifdef MATH_BATCH_AVX
+
+#include <immintrin.h>
+
+MATH_BEGIN_NAMESPACE
+
+namespace
+{
+    inline __m256 Abs8(__m256 v)
+    {
+        return _mm256_andnot_ps(_mm256_set1_ps(-0.f), v);
+    }
+
+    /// Writes the low eight bits of 'bits' as 0 or 1 bytes. Returns the number of set bits.
+    inline int StoreBits8(int bits, u8 *out)
+    {
+        int numSet = 0;
+        for(int lane = 0; lane < 8; ++lane)
+        {
+            out[lane] = (u8)((bits >> lane) & 1);
+            numSet += out[lane];
+        }
+        return numSet;
+    }
+
+    /// Writes the eight lanes of the given comparison mask as 0 or 1 bytes. Returns the number of set lanes.
+    inline int StoreMask8(__m256 mask, u8 *out)
+    {
+        return StoreBits8(_mm256_movemask_ps(mask), out);
+    }
+
+    void TransformPoints(const float *m, const float *x, const float *y, const float *z, float *outX, float *outY, float *outZ, int count)
+    {
+        const __m256 m00 = _mm256_set1_ps(m[0]), m01 = _mm256_set1_ps(m[1]), m02 = _mm256_set1_ps(m[2]), m03 = _mm256_set1_ps(m[3]);
+        const __m256 m10 = _mm256_set1_ps(m[4]), m11 = _mm256_set1_ps(m[5]), m12 = _mm256_set1_ps(m[6]), m13 = _mm256_set1_ps(m[7]);
+        const __m256 m20 = _mm256_set1_ps(m[8]), m21 = _mm256_set1_ps(m[9]), m22 = _mm256_set1_ps(m[10]), m23 = _mm256_set1_ps(m[11]);
+        int i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            const __m256 px = _mm256_loadu_ps(x + i);
+            const __m256 py = _mm256_loadu_ps(y + i);
+            const __m256 pz = _mm256_loadu_ps(z + i);
+            _mm256_storeu_ps(outX + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m00, px), _mm256_mul_ps(m01, py)), _mm256_add_ps(_mm256_mul_ps(m02, pz), m03)));
+            _mm256_storeu_ps(outY + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m10, px), _mm256_mul_ps(m11, py)), _mm256_add_ps(_mm256_mul_ps(m12, pz), m13)));
+            _mm256_storeu_ps(outZ + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m20, px), _mm256_mul_ps(m21, py)), _mm256_add_ps(_mm256_mul_ps(m22, pz), m23)));
+        }
+        BatchTransformPoints_Scalar(m, x + i, y + i, z + i, outX + i, outY + i, outZ + i, count - i);
+    }
+
+    void TransformAABBs(const float *m, const AABBStreams &in, const AABBOutStreams &out, int count)
+    {
+        const __m256 half = _mm256_set1_ps(0.5f);
+        int i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            const __m256 minX = _mm256_loadu_ps(in.v[0] + i), minY = _mm256_loadu_ps(in.v[1] + i), minZ = _mm256_loadu_ps(in.v[2] + i);
+            const __m256 maxX = _mm256_loadu_ps(in.v[3] + i), maxY = _mm256_loadu_ps(in.v[4] + i), maxZ = _mm256_loadu_ps(in.v[5] + i);
+            const __m256 cx = _mm256_mul_ps(_mm256_add_ps(minX, maxX), half);
+            const __m256 cy = _mm256_mul_ps(_mm256_add_ps(minY, maxY), half);
+            const __m256 cz = _mm256_mul_ps(_mm256_add_ps(minZ, maxZ), half);
+            const __m256 ex = _mm256_mul_ps(_mm256_sub_ps(maxX, minX), half);
+            const __m256 ey = _mm256_mul_ps(_mm256_sub_ps(maxY, minY), half);
+            const __m256 ez = _mm256_mul_ps(_mm256_sub_ps(maxZ, minZ), half);
+            for(int row = 0; row < 3; ++row)
+            {
+                const float *r = m + row*4;
+                const __m256 c = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(r[0]), cx), _mm256_mul_ps(_mm256_set1_ps(r[1]), cy)),
+                    _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(r[2]), cz), _mm256_set1_ps(r[3])));
+                const __m256 e = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(Abs8(_mm256_set1_ps(r[0])), ex), _mm256_mul_ps(Abs8(_mm256_set1_ps(r[1])), ey)),
+                    _mm256_mul_ps(Abs8(_mm256_set1_ps(r[2])), ez));
+                _mm256_storeu_ps(out.v[row] + i, _mm256_sub_ps(c, e));
+                _mm256_storeu_ps(out.v[row+3] + i, _mm256_add_ps(c, e));
+            }
+        }
+        AABBStreams tailIn;
+        AABBOutStreams tailOut;
+        for(int k = 0; k < 6; ++k)
+        {
+            tailIn.v[k] = in.v[k] + i;
+            tailOut.v[k] = out.v[k] + i;
+        }
+        BatchTransformAABBs_Scalar(m, tailIn, tailOut, count - i);
+    }
+
+    void ComputeBounds(const float *x, const float *y, const float *z, int count, float *outMin, float *outMax)
+    {
+        __m256 minX = _mm256_set1_ps(outMin[0]), minY = _mm256_set1_ps(outMin[1]), minZ = _mm256_set1_ps(outMin[2]);
+        __m256 maxX = _mm256_set1_ps(outMax[0]), maxY = _mm256_set1_ps(outMax[1]), maxZ = _mm256_set1_ps(outMax[2]);
+        int i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            const __m256 px = _mm256_loadu_ps(x + i);
+            const __m256 py = _mm256_loadu_ps(y + i);
+            const __m256 pz = _mm256_loadu_ps(z + i);
+            minX = _mm256_min_ps(minX, px);
+            minY = _mm256_min_ps(minY, py);
+            minZ = _mm256_min_ps(minZ, pz);
+            maxX = _mm256_max_ps(maxX, px);
+            maxY = _mm256_max_ps(maxY, py);
+            maxZ = _mm256_max_ps(maxZ, pz);
+        }
+        // Reduce the min lanes into outMin and the max lanes into outMax. The lanes still hold the seed values
+        // if there were fewer than 8 points, so they must not be mixed. The scalar kernel handles the remainder.
+        float lanes[6][8];
+        _mm256_storeu_ps(lanes[0], minX);
+        _mm256_storeu_ps(lanes[1], minY);
+        _mm256_storeu_ps(lanes[2], minZ);
+        _mm256_storeu_ps(lanes[3], maxX);
+        _mm256_storeu_ps(lanes[4], maxY);
+        _mm256_storeu_ps(lanes[5], maxZ);
+        for(int l = 0; l < 8; ++l)
+            for(int k = 0; k < 3; ++k)
+            {
+                outMin[k] = lanes[k][l] < outMin[k] ? lanes[k][l] : outMin[k];
+                outMax[k] = lanes[3+k][l] > outMax[k] ? lanes[3+k][l] : outMax[k];
+            }
+        BatchComputeBounds_Scalar(x + i, y + i, z + i, count - i, outMin, outMax);
+    }
+
+    int CullAABBs(const float *planes, int numPlanes, const AABBStreams &in, u8 *outVisible, int count)
+    {
+        const __m256 half = _mm256_set1_ps(0.5f);
+        int numVisible = 0;
+        int i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            const __m256 minX = _mm256_loadu_ps(in.v[0] + i), minY = _mm256_loadu_ps(in.v[1] + i), minZ = _mm256_loadu_ps(in.v[2] + i);
+            const __m256 maxX = _mm256_loadu_ps(in.v[3] + i), maxY = _mm256_loadu_ps(in.v[4] + i), maxZ = _mm256_loadu_ps(in.v[5] + i);
+            const __m256 cx = _mm256_mul_ps(_mm256_add_ps(minX, maxX), half);
+            const __m256 cy = _mm256_mul_ps(_mm256_add_ps(minY, maxY), half);
+            const __m256 cz = _mm256_mul_ps(_mm256_add_ps(minZ, maxZ), half);
+            const __m256 ex = _mm256_mul_ps(_mm256_sub_ps(maxX, minX), half);
+            const __m256 ey = _mm256_mul_ps(_mm256_sub_ps(maxY, minY), half);
+            const __m256 ez = _mm256_mul_ps(_mm256_sub_ps(maxZ, minZ), half);
+            __m256 outside = _mm256_setzero_ps();
+            for(int p = 0; p < numPlanes; ++p)
+            {
+                const float *plane = planes + p*4;
+                const __m256 distance = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane[0]), cx), _mm256_mul_ps(_mm256_set1_ps(plane[1]), cy)),
+                    _mm256_mul_ps(_mm256_set1_ps(plane[2]), cz)), _mm256_set1_ps(plane[3]));
+                const __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(Abs8(_mm256_set1_ps(plane[0])), ex), _mm256_mul_ps(Abs8(_mm256_set1_ps(plane[1])), ey)),
+                    _mm256_mul_ps(Abs8(_mm256_set1_ps(plane[2])), ez));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, radius, _CMP_GT_OQ));
+            }
+            numVisible += StoreBits8(~_mm256_movemask_ps(outside), outVisible + i);
+        }
+        AABBStreams tail;
+        for(int k = 0; k < 6; ++k)
+            tail.v[k] = in.v[k] + i;
+        return numVisible + BatchCullAABBs_Scalar(planes, numPlanes, tail, outVisible + i, count - i);
+    }
+
+    int CullSpheres(const float *planes, int numPlanes, const float *x, const float *y, const float *z, const float *r, u8 *outVisible, int count)
+    {
+        int numVisible = 0;
+        int i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            const __m256 px = _mm256_loadu_ps(x + i);
+            const __m256 py = _mm256_loadu_ps(y + i);
+            const __m256 pz = _mm256_loadu_ps(z + i);
+            const __m256 radius = _mm256_loadu_ps(r + i);
+            __m256 outside = _mm256_setzero_ps();
+            for(int p = 0; p < numPlanes; ++p)
+            {
+                const float *plane = planes + p*4;
+                const __m256 distance = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane[0]), px), _mm256_mul_ps(_mm256_set1_ps(plane[1]), py)),
+                    _mm256_mul_ps(_mm256_set1_ps(plane[2]), pz)), _mm256_set1_ps(plane[3]));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, radius, _CMP_GT_OQ));
+            }
+            numVisible += StoreBits8(~_mm256_movemask_ps(outside), outVisible + i);
+        }
+        return numVisible + BatchCullSpheres_Scalar(planes, numPlanes, x + i, y + i, z + i, r + i, outVisible + i, count - i);
+    }
+
+    int IntersectAABBsSphere(const float *sphere, const AABBStreams &in, u8 *outIntersects, int count)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 s[3] = { _mm256_set1_ps(sphere[0]), _mm256_set1_ps(sphere[1]), _mm256_set1_ps(sphere[2]) };
+        const __m256 radiusSq = _mm256_set1_ps(sphere[3] * sphere[3]);
+        int numIntersecting = 0;
+        int i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            __m256 distanceSq = zero;
+            for(int axis = 0; axis < 3; ++axis)
+            {
+                const __m256 below = _mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(in.v[axis] + i), s[axis]), zero);
+                const __m256 above = _mm256_max_ps(_mm256_sub_ps(s[axis], _mm256_loadu_ps(in.v[axis+3] + i)), zero);
+                const __m256 d = _mm256_add_ps(below, above);
+                distanceSq = _mm256_add_ps(distanceSq, _mm256_mul_ps(d, d));
+            }
+            numIntersecting += StoreMask8(_mm256_cmp_ps(distanceSq, radiusSq, _CMP_LE_OQ), outIntersects + i);
+        }
+        AABBStreams tail;
+        for(int k = 0; k < 6; ++k)
+            tail.v[k] = in.v[k] + i;
+        return numIntersecting + BatchIntersectAABBsSphere_Scalar(sphere, tail, outIntersects + i, count - i);
+    }
+
+    int IntersectSpheresSphere(const float *sphere, const float *x, const float *y, const float *z, const float *r, u8 *outIntersects, int count)
+    {
+        const __m256 sx = _mm256_set1_ps(sphere[0]), sy = _mm256_set1_ps(sphere[1]), sz = _mm256_set1_ps(sphere[2]), sr = _mm256_set1_ps(sphere[3]);
+        int numIntersecting = 0;
+        int i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), sx);
+            const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), sy);
+            const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + i), sz);
+            const __m256 radius = _mm256_add_ps(_mm256_loadu_ps(r + i), sr);
+            const __m256 distanceSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+            numIntersecting += StoreMask8(_mm256_cmp_ps(distanceSq, _mm256_mul_ps(radius, radius), _CMP_LE_OQ), outIntersects + i);
+        }
+        return numIntersecting + BatchIntersectSpheresSphere_Scalar(sphere, x + i, y + i, z + i, r + i, outIntersects + i, count - i);
+    }
+}
+
+void GetBatchKernels_AVX(BatchKernels &kernels)
+{
+    kernels.transformPoints = &TransformPoints;
+    kernels.transformAABBs = &TransformAABBs;
+    kernels.computeBounds = &ComputeBounds;
+    kernels.cullAABBs = &CullAABBs;
+    kernels.cullSpheres = &CullSpheres;
+    kernels.intersectAABBsSphere = &IntersectAABBsSphere;
+    kernels.intersectSpheresSphere = &IntersectSpheresSphere;
+}
+
+MATH_END_NAMESPACE
+
+#endif
@@ -0,0 +1,238 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   BatchOps_SSE2.cpp
+    @brief  4-wide SSE2 kernels of the batch operations. */
+
+#include "BatchOpsKernels.h"
+
+#ifdef MATH_BATCH_SSE2
+
+#include <emmintrin.h>
+
+MATH_BEGIN_NAMESPACE
+
+namespace
+{
+    inline __m128 Abs4(__m128 v)
+    {
+        return _mm_andnot_ps(_mm_set1_ps(-0.f), v);
+    }
+
+    /// Writes the low four bits of 'bits' as 0 or 1 bytes. Returns the number of set bits.
+    inline int StoreBits4(int bits, u8 *out)
+    {
+        out[0] = (u8)(bits & 1);
+        out[1] = (u8)((bits >> 1) & 1);
+        out[2] = (u8)((bits >> 2) & 1);
+        out[3] = (u8)((bits >> 3) & 1);
+        return out[0] + out[1] + out[2] + out[3];
+    }
+
+    /// Writes the four lanes of the given comparison mask as 0 or 1 bytes. Returns the number of set lanes.
+    inline int StoreMask4(__m128 mask, u8 *out)
+    {
+        return StoreBits4(_mm_movemask_ps(mask), out);
+    }
+
+    void TransformPoints(const float *m, const float *x, const float *y, const float *z, float *outX, float *outY, float *outZ, int count)
+    {
+        const __m128 m00 = _mm_set1_ps(m[0]), m01 = _mm_set1_ps(m[1]), m02 = _mm_set1_ps(m[2]), m03 = _mm_set1_ps(m[3]);
+        const __m128 m10 = _mm_set1_ps(m[4]), m11 = _mm_set1_ps(m[5]), m12 = _mm_set1_ps(m[6]), m13 = _mm_set1_ps(m[7]);
+        const __m128 m20 = _mm_set1_ps(m[8]), m21 = _mm_set1_ps(m[9]), m22 = _mm_set1_ps(m[10]), m23 = _mm_set1_ps(m[11]);
+        int i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            const __m128 px = _mm_loadu_ps(x + i);
+            const __m128 py = _mm_loadu_ps(y + i);
+            const __m128 pz = _mm_loadu_ps(z + i);
+            _mm_storeu_ps(outX + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, px), _mm_mul_ps(m01, py)), _mm_add_ps(_mm_mul_ps(m02, pz), m03)));
+            _mm_storeu_ps(outY + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, px), _mm_mul_ps(m11, py)), _mm_add_ps(_mm_mul_ps(m12, pz), m13)));
+            _mm_storeu_ps(outZ + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, px), _mm_mul_ps(m21, py)), _mm_add_ps(_mm_mul_ps(m22, pz), m23)));
+        }
+        BatchTransformPoints_Scalar(m, x + i, y + i, z + i, outX + i, outY + i, outZ + i, count - i);
+    }
+
+    void TransformAABBs(const float *m, const AABBStreams &in, const AABBOutStreams &out, int count)
+    {
+        const __m128 half = _mm_set1_ps(0.5f);
+        int i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            const __m128 minX = _mm_loadu_ps(in.v[0] + i), minY = _mm_loadu_ps(in.v[1] + i), minZ = _mm_loadu_ps(in.v[2] + i);
+            const __m128 maxX = _mm_loadu_ps(in.v[3] + i), maxY = _mm_loadu_ps(in.v[4] + i), maxZ = _mm_loadu_ps(in.v[5] + i);
+            const __m128 cx = _mm_mul_ps(_mm_add_ps(minX, maxX), half);
+            const __m128 cy = _mm_mul_ps(_mm_add_ps(minY, maxY), half);
+            const __m128 cz = _mm_mul_ps(_mm_add_ps(minZ, maxZ), half);
+            const __m128 ex = _mm_mul_ps(_mm_sub_ps(maxX, minX), half);
+            const __m128 ey = _mm_mul_ps(_mm_sub_ps(maxY, minY), half);
+            const __m128 ez = _mm_mul_ps(_mm_sub_ps(maxZ, minZ), half);
+            for(int row = 0; row < 3; ++row)
+            {
+                const float *r = m + row*4;
+                const __m128 c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[0]), cx), _mm_mul_ps(_mm_set1_ps(r[1]), cy)),
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[2]), cz), _mm_set1_ps(r[3])));
+                const __m128 e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Abs4(_mm_set1_ps(r[0])), ex), _mm_mul_ps(Abs4(_mm_set1_ps(r[1])), ey)),
+                    _mm_mul_ps(Abs4(_mm_set1_ps(r[2])), ez));
+                _mm_storeu_ps(out.v[row] + i, _mm_sub_ps(c, e));
+                _mm_storeu_ps(out.v[row+3] + i, _mm_add_ps(c, e));
+            }
+        }
+        AABBStreams tailIn;
+        AABBOutStreams tailOut;
+        for(int k = 0; k < 6; ++k)
+        {
+            tailIn.v[k] = in.v[k] + i;
+            tailOut.v[k] = out.v[k] + i;
+        }
+        BatchTransformAABBs_Scalar(m, tailIn, tailOut, count - i);
+    }
+
+    void ComputeBounds(const float *x, const float *y, const float *z, int count, float *outMin, float *outMax)
+    {
+        __m128 minX = _mm_set1_ps(outMin[0]), minY = _mm_set1_ps(outMin[1]), minZ = _mm_set1_ps(outMin[2]);
+        __m128 maxX = _mm_set1_ps(outMax[0]), maxY = _mm_set1_ps(outMax[1]), maxZ = _mm_set1_ps(outMax[2]);
+        int i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            const __m128 px = _mm_loadu_ps(x + i);
+            const __m128 py = _mm_loadu_ps(y + i);
+            const __m128 pz = _mm_loadu_ps(z + i);
+            minX = _mm_min_ps(minX, px);
+            minY = _mm_min_ps(minY, py);
+            minZ = _mm_min_ps(minZ, pz);
+            maxX = _mm_max_ps(maxX, px);
+            maxY = _mm_max_ps(maxY, py);
+            maxZ = _mm_max_ps(maxZ, pz);
+        }
+        // Reduce the min lanes into outMin and the max lanes into outMax. The lanes still hold the seed values
+        // if there were fewer than 4 points, so they must not be mixed. The scalar kernel handles the remainder.
+        float lanes[6][4];
+        _mm_storeu_ps(lanes[0], minX);
+        _mm_storeu_ps(lanes[1], minY);
+        _mm_storeu_ps(lanes[2], minZ);
+        _mm_storeu_ps(lanes[3], maxX);
+        _mm_storeu_ps(lanes[4], maxY);
+        _mm_storeu_ps(lanes[5], maxZ);
+        for(int l = 0; l < 4; ++l)
+            for(int k = 0; k < 3; ++k)
+            {
+                outMin[k] = lanes[k][l] < outMin[k] ? lanes[k][l] : outMin[k];
+                outMax[k] = lanes[3+k][l] > outMax[k] ? lanes[3+k][l] : outMax[k];
+            }
+        BatchComputeBounds_Scalar(x + i, y + i, z + i, count - i, outMin, outMax);
+    }
+
+    int CullAABBs(const float *planes, int numPlanes, const AABBStreams &in, u8 *outVisible, int count)
+    {
+        const __m128 half = _mm_set1_ps(0.5f);
+        int numVisible = 0;
+        int i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            const __m128 minX = _mm_loadu_ps(in.v[0] + i), minY = _mm_loadu_ps(in.v[1] + i), minZ = _mm_loadu_ps(in.v[2] + i);
+            const __m128 maxX = _mm_loadu_ps(in.v[3] + i), maxY = _mm_loadu_ps(in.v[4] + i), maxZ = _mm_loadu_ps(in.v[5] + i);
+            const __m128 cx = _mm_mul_ps(_mm_add_ps(minX, maxX), half);
+            const __m128 cy = _mm_mul_ps(_mm_add_ps(minY, maxY), half);
+            const __m128 cz = _mm_mul_ps(_mm_add_ps(minZ, maxZ), half);
+            const __m128 ex = _mm_mul_ps(_mm_sub_ps(maxX, minX), half);
+            const __m128 ey = _mm_mul_ps(_mm_sub_ps(maxY, minY), half);
+            const __m128 ez = _mm_mul_ps(_mm_sub_ps(maxZ, minZ), half);
+            __m128 outside = _mm_setzero_ps();
+            for(int p = 0; p < numPlanes; ++p)
+            {
+                const float *plane = planes + p*4;
+                const __m128 distance = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), cx), _mm_mul_ps(_mm_set1_ps(plane[1]), cy)),
+                    _mm_mul_ps(_mm_set1_ps(plane[2]), cz)), _mm_set1_ps(plane[3]));
+                const __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Abs4(_mm_set1_ps(plane[0])), ex), _mm_mul_ps(Abs4(_mm_set1_ps(plane[1])), ey)),
+                    _mm_mul_ps(Abs4(_mm_set1_ps(plane[2])), ez));
+                outside = _mm_or_ps(outside, _mm_cmpgt_ps(distance, radius));
+            }
+            numVisible += StoreBits4(~_mm_movemask_ps(outside), outVisible + i);
+        }
+        AABBStreams tail;
+        for(int k = 0; k < 6; ++k)
+            tail.v[k] = in.v[k] + i;
+        return numVisible + BatchCullAABBs_Scalar(planes, numPlanes, tail, outVisible + i, count - i);
+    }
+
+    int CullSpheres(const float *planes, int numPlanes, const float *x, const float *y, const float *z, const float *r, u8 *outVisible, int count)
+    {
+        int numVisible = 0;
+        int i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            const __m128 px = _mm_loadu_ps(x + i);
+            const __m128 py = _mm_loadu_ps(y + i);
+            const __m128 pz = _mm_loadu_ps(z + i);
+            const __m128 radius = _mm_loadu_ps(r + i);
+            __m128 outside = _mm_setzero_ps();
+            for(int p = 0; p < numPlanes; ++p)
+            {
+                const float *plane = planes + p*4;
+                const __m128 distance = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), px), _mm_mul_ps(_mm_set1_ps(plane[1]), py)),
+                    _mm_mul_ps(_mm_set1_ps(plane[2]), pz)), _mm_set1_ps(plane[3]));
+                outside = _mm_or_ps(outside, _mm_cmpgt_ps(distance, radius));
+            }
+            numVisible += StoreBits4(~_mm_movemask_ps(outside), outVisible + i);
+        }
+        return numVisible + BatchCullSpheres_Scalar(planes, numPlanes, x + i, y + i, z + i, r + i, outVisible + i, count - i);
+    }
+
+    int IntersectAABBsSphere(const float *sphere, const AABBStreams &in, u8 *outIntersects, int count)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 s[3] = { _mm_set1_ps(sphere[0]), _mm_set1_ps(sphere[1]), _mm_set1_ps(sphere[2]) };
+        const __m128 radiusSq = _mm_set1_ps(sphere[3] * sphere[3]);
+        int numIntersecting = 0;
+        int i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            __m128 distanceSq = zero;
+            for(int axis = 0; axis < 3; ++axis)
+            {
+                const __m128 below = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(in.v[axis] + i), s[axis]), zero);
+                const __m128 above = _mm_max_ps(_mm_sub_ps(s[axis], _mm_loadu_ps(in.v[axis+3] + i)), zero);
+                const __m128 d = _mm_add_ps(below, above);
+                distanceSq = _mm_add_ps(distanceSq, _mm_mul_ps(d, d));
+            }
+            numIntersecting += StoreMask4(_mm_cmple_ps(distanceSq, radiusSq), outIntersects + i);
+        }
+        AABBStreams tail;
+        for(int k = 0; k < 6; ++k)
+            tail.v[k] = in.v[k] + i;
+        return numIntersecting + BatchIntersectAABBsSphere_Scalar(sphere, tail, outIntersects + i, count - i);
+    }
+
+    int IntersectSpheresSphere(const float *sphere, const float *x, const float *y, const float *z, const float *r, u8 *outIntersects, int count)
+    {
+        const __m128 sx = _mm_set1_ps(sphere[0]), sy = _mm_set1_ps(sphere[1]), sz = _mm_set1_ps(sphere[2]), sr = _mm_set1_ps(sphere[3]);
+        int numIntersecting = 0;
+        int i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), sx);
+            const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), sy);
+            const __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + i), sz);
+            const __m128 radius = _mm_add_ps(_mm_loadu_ps(r + i), sr);
+            const __m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            numIntersecting += StoreMask4(_mm_cmple_ps(distanceSq, _mm_mul_ps(radius, radius)), outIntersects + i);
+        }
+        return numIntersecting + BatchIntersectSpheresSphere_Scalar(sphere, x + i, y + i, z + i, r + i, outIntersects + i, count - i);
+    }
+}
+
+void GetBatchKernels_SSE2(BatchKernels &kernels)
+{
+    kernels.transformPoints = &TransformPoints;
+    kernels.transformAABBs = &TransformAABBs;
+    kernels.computeBounds = &ComputeBounds;
+    kernels.cullAABBs = &CullAABBs;
+    kernels.cullSpheres = &CullSpheres;
+    kernels.intersectAABBsSphere = &IntersectAABBsSphere;
+    kernels.intersectSpheresSphere = &IntersectSpheresSphere;
+}
+
+MATH_END_NAMESPACE
+
+#endif
@@ -0,0 +1,16 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include <OgreSimpleRenderable.h>
+
+/// A renderable drawn in a plane that faces the camera like a billboard, e.g. the text quads of EC_HoveringText.
+/** getWorldTransforms maps the local x-y plane of the content to world space, facing the camera. OgreWorld raycasts
+    these against the rectangle returned by FacingBounds in that plane, as billboards are raycast against their quads. */
+class CameraFacingRenderable : public Ogre::SimpleRenderable
+{
+public:
+    /// Returns the rectangle that contains the drawn content in the local plane, x to the right and y up.
+    /** @return False if nothing is drawn. */
+    virtual bool FacingBounds(float &left, float &top, float &right, float &bottom) const = 0;
+};
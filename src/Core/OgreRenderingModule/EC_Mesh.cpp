@@ -13,6 +13,7 @@
 #include "OgreSkeletonAsset.h"
 #include "OgreMeshAsset.h"
 #include "OgreMaterialAsset.h"
+#include "OgreSkinnedMeshRaycast.h"
 #include "IAssetTransfer.h"
 #include "AssetAPI.h"
 #include "AttributeMetadata.h"
@@ -414,6 +415,7 @@ void EC_Mesh::RemoveMesh()
         
         RemoveAllAttachments();
         DetachEntity();
+        skinnedRaycasts_.clear();
         
         OgreWorldPtr world = world_.lock();
         if (world.get() && entity_)
@@ -594,6 +596,7 @@ void EC_Mesh::RemoveAttachmentMesh(uint index)
     {
         if (attachmentEntities_[index]->sharesSkeletonInstance())
             attachmentEntities_[index]->stopSharingSkeletonInstance();
+        ReleaseSkinnedRaycast(attachmentEntities_[index]);
         sceneMgr->destroyEntity(attachmentEntities_[index]);
         attachmentEntities_[index] = 0;
     }
@@ -1553,6 +1556,23 @@ void EC_Mesh::DeserializeFrom(QDomElement& element, AttributeChange::Type change
     }
 }
 
+void EC_Mesh::DeserializeFrom(const ComponentDesc& desc, AttributeChange::Type change)
+{
+    if (!BeginDeserialization(desc))
+        return;
+
+    if (change == AttributeChange::Default)
+        change = updateMode;
+    assert(change != AttributeChange::Default);
+
+    foreach(AttributeDesc attributeDesc, desc.attributes)
+    {
+        if (attributeDesc.id.isEmpty() && attributeDesc.name.compare("Mesh materials", Qt::CaseInsensitive) == 0)
+            attributeDesc.name = "Material refs";
+        DeserializeAttributeFrom(attributeDesc, change);
+    }
+}
+
 Ogre::Vector2 FindUVs(const Ogre::Vector3& hitPoint, const Ogre::Vector3& t1, const Ogre::Vector3& t2, const Ogre::Vector3& t3, const Ogre::Vector2& tex1, const Ogre::Vector2& tex2, const Ogre::Vector2& tex3)
 {
     Ogre::Vector3 v1 = hitPoint - t1;
@@ -1597,6 +1617,48 @@ bool EC_Mesh::Raycast(Ogre::Entity* meshEntity, const Ray& ray, float* distance,
     localRay.Transform(worldToLocal);
     Ogre::Ray ogreLocalRay = localRay;
 
+    // Skeletal entities of EC_Mesh are raycast against a BVH that is refit to their current pose.
+    if (meshEntity->hasSkeleton())
+    {
+        EC_Mesh *owner = 0;
+        const Ogre::Any &any = meshEntity->getUserAny();
+        if (!any.isEmpty())
+        {
+            try
+            {
+                owner = dynamic_cast<EC_Mesh*>(Ogre::any_cast<IComponent*>(any));
+            }
+            catch(const Ogre::InvalidParametersException &/*e*/)
+            {
+            }
+        }
+        OgreSkinnedMeshRaycast *skinnedRaycast = owner ? owner->SkinnedRaycast(meshEntity) : 0;
+        if (skinnedRaycast)
+        {
+            OgreSkinnedMeshRaycast::Hit hit;
+            if (!skinnedRaycast->Raycast(localRay, hit))
+                return false;
+
+            float3 worldHitPoint = localToWorld.TransformPos(localRay.pos + hit.t * localRay.dir);
+            if (subMeshIndex)
+                *subMeshIndex = hit.submeshIndex;
+            if (triangleIndex)
+                *triangleIndex = hit.triangleIndex;
+            if (distance)
+                *distance = (worldHitPoint - ray.pos).Length();
+            if (hitPosition)
+                *hitPosition = worldHitPoint;
+            if (uv)
+                *uv = hit.uv;
+            if (normal)
+            {
+                *normal = localToWorld.TransformDir(hit.normal);
+                normal->Normalize();
+            }
+            return true;
+        }
+    }
+
     Ogre::MeshPtr mesh = meshEntity->getMesh();
     bool useSoftwareBlendingVertices = meshEntity->hasSkeleton();
     
@@ -1724,6 +1786,28 @@ bool EC_Mesh::Raycast(Ogre::Entity* meshEntity, const Ray& ray, float* distance,
     return closestDistance >= 0.0f;
 }
 
+OgreSkinnedMeshRaycast *EC_Mesh::SkinnedRaycast(Ogre::Entity *entity)
+{
+    if (!entity || !entity->hasSkeleton())
+        return 0;
+    for(size_t i = 0; i < skinnedRaycasts_.size(); ++i)
+        if (skinnedRaycasts_[i]->IsFor(entity))
+            return skinnedRaycasts_[i].get();
+    ReleaseSkinnedRaycast(entity);
+    skinnedRaycasts_.push_back(MAKE_SHARED(OgreSkinnedMeshRaycast, entity));
+    return skinnedRaycasts_.back().get();
+}
+
+void EC_Mesh::ReleaseSkinnedRaycast(Ogre::Entity *entity)
+{
+    for(size_t i = 0; i < skinnedRaycasts_.size(); ++i)
+        if (skinnedRaycasts_[i]->OgreEntity() == entity)
+        {
+            skinnedRaycasts_.erase(skinnedRaycasts_.begin() + i);
+            return;
+        }
+}
+
 Ogre::Entity* EC_Mesh::OgreEntity() const
 {
     return entity_;
@@ -15,6 +15,8 @@
 
 #include <QList>
 
+class OgreSkinnedMeshRaycast;
+
 /// Ogre mesh entity component
 /** <table class="header">
     <tr>
@@ -343,6 +345,7 @@ public slots:
     /// IComponent override, implemented to support old TXML with the "Mesh materials" attribute instead of "materialRefs"/"Material refs".
     /// @todo 2014-10-17 This can be removed at some point when enough time has passed.
     void DeserializeFrom(QDomElement& element, AttributeChange::Type change);
+    void DeserializeFrom(const ComponentDesc& desc, AttributeChange::Type change); /**< @overload */
 
     /// @cond PRIVATE
     // DEPRECATED
@@ -495,6 +498,12 @@ private:
     /// Detaches entity from placeable
     void DetachEntity();
 
+    /// Returns the raycast data of a skeletal entity of this mesh, i.e. entity_ or an attachment, creating it if necessary.
+    OgreSkinnedMeshRaycast *SkinnedRaycast(Ogre::Entity *entity);
+
+    /// Releases the raycast data of a skeletal entity that is about to be destroyed.
+    void ReleaseSkinnedRaycast(Ogre::Entity *entity);
+
     /// Placeable component 
     ComponentPtr placeable_;
 
@@ -534,5 +543,8 @@ private:
 
     /// Tracking pending failed material applies.
     QList<uint> pendingFailedMaterials_;
+
+    /// Raycast data of the skeletal entities, created on their first raycast.
+    std::vector<shared_ptr<OgreSkinnedMeshRaycast> > skinnedRaycasts_;
 };
 COMPONENT_TYPEDEFS(Mesh);
@@ -195,13 +195,14 @@ EC_Placeable::EC_Placeable(Scene* scene) :
     if (scene)
         world_ = scene->GetWorld<OgreWorld>();
     
-    // Enable network interpolation for the transform
+    // Enable network interpolation for the transform, and send it quantized to about a millimeter within 4 km of the origin
     static AttributeMetadata transAttrData;
     static AttributeMetadata nonDesignableAttrData;
     static bool metadataInitialized = false;
     if(!metadataInitialized)
     {
         transAttrData.interpolation = AttributeMetadata::Interpolate;
+        transAttrData.SetQuantization(AttributeMetadata::QuantizeRange, 23, -4096.f, 4096.f);
         nonDesignableAttrData.designable = false;
         metadataInitialized = true;
     }
@@ -10,9 +10,13 @@
 #include "AssetCache.h"
 #include "Profiler.h"
 #include "Geometry/Ray.h"
+#include "Geometry/TriangleBVH.h"
 
 #include <QFile>
 #include <QFileInfo>
+#include <QMutex>
+#include <QRunnable>
+#include <QThreadPool>
 #include <Ogre.h>
 
 #include "LoggingFunctions.h"
@@ -20,9 +24,54 @@
 
 int total_edge = 0;
 
+/// CPU-side triangle data of a mesh and its BVH, shared between OgreMeshAsset and the job building the BVH.
+struct OgreMeshRaycastData
+{
+    OgreMeshRaycastData() : finished(false), canceled(false) {}
+
+    QMutex mutex;
+    bool finished; ///< Has the BVH been built, guarded by @c mutex.
+    bool canceled; ///< Has the asset been unloaded, guarded by @c mutex.
+    std::vector<Triangle> triangles; ///< Not modified after the build has been started.
+    TriangleBVH bvh; ///< Valid when @c finished is set.
+};
+
+namespace
+{
+    /// Meshes with fewer triangles than this are built right away, as the build takes less time than queuing the job.
+    const int cBackgroundBuildTriangles = 4096;
+
+    class OgreMeshBVHJob : public QRunnable
+    {
+    public:
+        explicit OgreMeshBVHJob(const shared_ptr<OgreMeshRaycastData> &raycastData) : data(raycastData) {}
+
+        void run()
+        {
+            {
+                QMutexLocker lock(&data->mutex);
+                if (data->canceled)
+                    return;
+            }
+
+            TriangleBVH bvh;
+            bvh.Build(&data->triangles[0], (int)data->triangles.size());
+
+            QMutexLocker lock(&data->mutex);
+            if (!data->canceled)
+                data->bvh.Swap(bvh);
+            data->finished = true;
+        }
+
+    private:
+        shared_ptr<OgreMeshRaycastData> data;
+    };
+}
+
 OgreMeshAsset::OgreMeshAsset(AssetAPI *owner, const QString &type_, const QString &name_) :
     IAsset(owner, type_, name_),
-    loadTicket_(0)
+    loadTicket_(0),
+    meshDataBVHReady(false)
 {
 }
 
@@ -132,79 +181,77 @@ bool OgreMeshAsset::DeserializeFromData(const u8 *data_, size_t numBytes, bool a
         return false;
 }
 
-struct KdTreeRayQueryFirstHitVisitor
+RayQueryResult OgreMeshAsset::Raycast(const Ray &ray)
 {
     RayQueryResult result;
+    if (!ogreMesh.get())
+        return result;
+    if (!meshData)
+        CreateRaycastData();
 
-    KdTreeRayQueryFirstHitVisitor()
-    {
-        result.entity = 0;
-        result.component = 0;
-        result.t = std::numeric_limits<float>::infinity();
-        result.triangleIndex = KdTree<Triangle>::BUCKET_SENTINEL;
-        result.submeshIndex = (u32)-1;
-    }
-    bool operator()(KdTree<Triangle> &tree, const KdTreeNode &leaf, const Ray &ray, float tNear, float tFar)
+    TriangleBVHHit hit;
+    if (IsRaycastBVHReady())
+        meshData->bvh.Raycast(ray, FLOAT_INF, hit);
+    else
     {
-        u32 *bucket = tree.Bucket(leaf.bucketIndex);
-        assert(bucket);
-        while(*bucket != KdTree<Triangle>::BUCKET_SENTINEL)
+        // The BVH is still being built in the background, test the triangles one by one meanwhile.
+        const std::vector<Triangle> &triangles = meshData->triangles;
+        for(size_t i = 0; i < triangles.size(); ++i)
         {
-            const Triangle &tri = tree.Object(*bucket);
-            float u, v, t;
-            t = Triangle::IntersectLineTri(ray.pos, ray.dir, tri.a, tri.b, tri.c, u, v);
-            bool intersects = t < std::numeric_limits<float>::infinity();
-            if (intersects && t >= tNear && t <= tFar && t < result.t)
+            float u, v;
+            const float t = Triangle::IntersectLineTri(ray.pos, ray.dir, triangles[i].a, triangles[i].b, triangles[i].c, u, v);
+            if (t >= 0.f && t < hit.t)
             {
-                result.t = t;
-                result.pos = ray.GetPoint(t);
-                result.triangleIndex = *bucket;
-                result.submeshIndex = (u32)-1;
-                result.barycentricUV = float2(u,v);
+                hit.t = t;
+                hit.triangleIndex = (u32)i;
+                hit.u = u;
+                hit.v = v;
             }
-            ++bucket;
-            
         }
-        return result.t < std::numeric_limits<float>::infinity(); // If we hit a triangle, no need to visit any farther nodes, since we are only interested in the nearest hit.
     }
-};
 
-RayQueryResult OgreMeshAsset::Raycast(const Ray &ray)
-{
-    if (!ogreMesh.get())
-        return RayQueryResult();
-    if (meshData.NumObjects() == 0)
-        CreateKdTree();
-    KdTreeRayQueryFirstHitVisitor visitor;
-    meshData.RayQuery(ray, visitor);
-    if (visitor.result.triangleIndex != KdTree<Triangle>::BUCKET_SENTINEL)
-    {
-        visitor.result.normal = normals[visitor.result.triangleIndex];
-        float2 uv = (uvs.size() > visitor.result.triangleIndex*3+2) ?
-                       (1.f - visitor.result.barycentricUV.x - visitor.result.barycentricUV.y) * uvs[visitor.result.triangleIndex*3]
-                       + visitor.result.barycentricUV.x * uvs[visitor.result.triangleIndex*3+1]
-                       + visitor.result.barycentricUV.y * uvs[visitor.result.triangleIndex*3+2]
+    result.t = hit.t;
+    if (hit.triangleIndex != 0xFFFFFFFF)
+    {
+        result.pos = ray.GetPoint(hit.t);
+        result.triangleIndex = hit.triangleIndex;
+        result.barycentricUV = float2(hit.u, hit.v);
+        result.normal = normals[result.triangleIndex];
+        float2 uv = (uvs.size() > result.triangleIndex*3+2) ?
+                       (1.f - result.barycentricUV.x - result.barycentricUV.y) * uvs[result.triangleIndex*3]
+                       + result.barycentricUV.x * uvs[result.triangleIndex*3+1]
+                       + result.barycentricUV.y * uvs[result.triangleIndex*3+2]
                     : float2(-1, -1);
-        visitor.result.uv = uv;
-        int triangleIndex = visitor.result.triangleIndex;
+        result.uv = uv;
+        int triangleIndex = result.triangleIndex;
         for(size_t i = 0; i < subMeshTriangleCounts.size(); ++i)
         {
             if (triangleIndex < subMeshTriangleCounts[i])
             {
-                visitor.result.submeshIndex = (unsigned)i;
+                result.submeshIndex = (unsigned)i;
                 break;
             }
             else
                 triangleIndex -= subMeshTriangleCounts[i];
         }
     }
-    return visitor.result;
+    return result;
+}
+
+bool OgreMeshAsset::IsRaycastBVHReady()
+{
+    if (!meshDataBVHReady && meshData)
+    {
+        QMutexLocker lock(&meshData->mutex);
+        meshDataBVHReady = meshData->finished;
+    }
+    return meshDataBVHReady;
 }
 
 Triangle OgreMeshAsset::Tri(int submeshIndex, int triangleIndex)
 {
-    if (subMeshTriangleCounts.size() == 0)
-        CreateKdTree();
+    if (!meshData)
+        CreateRaycastData();
 
     if (triangleIndex < 0 || NumTris(submeshIndex) < triangleIndex)
     {
@@ -214,21 +261,21 @@ Triangle OgreMeshAsset::Tri(int submeshIndex, int triangleIndex)
     // Shift to index in proper location of the submesh triangles array.
     for(int i = 0; i < submeshIndex; ++i)
         triangleIndex += subMeshTriangleCounts[i];
-    return meshData.Object(triangleIndex);
+    return meshData->triangles[triangleIndex];
 }
 
 size_t OgreMeshAsset::NumSubmeshes()
 {
-    if (subMeshTriangleCounts.size() == 0)
-        CreateKdTree();
+    if (!meshData)
+        CreateRaycastData();
 
     return subMeshTriangleCounts.size();
 }
 
 int OgreMeshAsset::NumTris(int submeshIndex)
 {
-    if (subMeshTriangleCounts.size() == 0)
-        CreateKdTree();
+    if (!meshData)
+        CreateRaycastData();
 
     if (submeshIndex >= 0 && (size_t)submeshIndex < subMeshTriangleCounts.size())
         return subMeshTriangleCounts[submeshIndex];
@@ -237,9 +284,16 @@ int OgreMeshAsset::NumTris(int submeshIndex)
     return 0;
 }
 
-void OgreMeshAsset::CreateKdTree()
+void OgreMeshAsset::CreateRaycastData()
 {
-    meshData.Clear();
+    if (meshData)
+    {
+        QMutexLocker lock(&meshData->mutex);
+        meshData->canceled = true;
+    }
+    meshData = MAKE_SHARED(OgreMeshRaycastData);
+    meshDataBVHReady = false;
+    std::vector<Triangle> &triangles = meshData->triangles;
     normals.clear();
     uvs.clear();
     subMeshTriangleCounts.clear();
@@ -309,8 +363,7 @@ void OgreMeshAsset::CreateKdTree()
             float3 v0 = *(float3*)(pos + posOffset + i0 * posSize);
             float3 v1 = *(float3*)(pos + posOffset + i1 * posSize);
             float3 v2 = *(float3*)(pos + posOffset + i2 * posSize);
-            Triangle t(v0, v1, v2);
-            meshData.AddObjects(&t, 1);
+            triangles.push_back(Triangle(v0, v1, v2));
 
             if (texElem)
             {
@@ -333,10 +386,15 @@ void OgreMeshAsset::CreateKdTree()
         ibuf->unlock();
     }
 
+    if (triangles.size() < (size_t)cBackgroundBuildTriangles)
     {
-        PROFILE(OgreMeshAsset_KdTree_Build);
-        meshData.Build();
+        PROFILE(OgreMeshAsset_BVH_Build);
+        if (!triangles.empty())
+            meshData->bvh.Build(&triangles[0], (int)triangles.size(), 1);
+        meshData->finished = true;
     }
+    else
+        QThreadPool::globalInstance()->start(new OgreMeshBVHJob(meshData));
 }
 
 bool OgreMeshAsset::GenerateMeshData()
@@ -433,6 +491,16 @@ bool OgreMeshAsset::GenerateMeshData()
     //internal_name_ = AssetAPI::SanitateAssetRef(id_);
     //LogDebug("Ogre mesh " + this->Name().toStdString() + " created");
 
+    // Start building the raycast data right away, so that it is likely to be ready by the time the mesh is first picked.
+    try
+    {
+        CreateRaycastData();
+    }
+    catch(const Ogre::Exception &e)
+    {
+        LogError("OgreMeshAsset::GenerateMeshData: Failed to read the triangles of mesh " + this->Name() + " for raycasting: " + QString(e.what()));
+    }
+
     return true;
 }
 
@@ -480,6 +548,18 @@ void OgreMeshAsset::DoUnload()
         Ogre::ResourceBackgroundQueue::getSingleton().abortRequest(loadTicket_);
         loadTicket_ = 0;
     }
+
+    // Let a pending BVH build know that its result is not needed anymore.
+    if (meshData)
+    {
+        QMutexLocker lock(&meshData->mutex);
+        meshData->canceled = true;
+    }
+    meshData.reset();
+    meshDataBVHReady = false;
+    normals.clear();
+    uvs.clear();
+    subMeshTriangleCounts.clear();
     
     if (ogreMesh.isNull())
         return;
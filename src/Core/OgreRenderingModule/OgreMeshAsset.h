@@ -9,10 +9,11 @@
 #include <OgreMesh.h>
 #include <OgreResourceBackgroundQueue.h>
 #include "Math/float2.h"
-#include "Geometry/KdTree.h"
 #include "Geometry/Triangle.h"
 #include "IRenderer.h"
 
+struct OgreMeshRaycastData;
+
 /// Represents an Ogre mesh loaded to the GPU.
 class OGRE_MODULE_API OgreMeshAsset : public IAsset, Ogre::ResourceBackgroundQueue::Listener
 {
@@ -77,8 +78,13 @@ private:
     /// Unload mesh from Ogre. IAsset override.
     virtual void DoUnload();
 
-    /// Precomputes a kD-tree for the triangle data of this mesh.
-    void CreateKdTree();
+    /// Copies the triangle data of this mesh to the CPU and starts building a BVH of it for raycasting.
+    /** Large meshes are built in the background on the global QThreadPool, and Raycast tests the triangles one by one until the
+        build has finished. */
+    void CreateRaycastData();
+
+    /// Returns true if the BVH of the mesh data has been built.
+    bool IsRaycastBVHReady();
 
     /// Process mesh data after loading to create tangents and such.
     bool GenerateMeshData();
@@ -89,8 +95,12 @@ private:
     /// Ticket for ogres threaded loading operation.
     Ogre::BackgroundProcessTicket loadTicket_;
 
-    /// Stores a CPU-side version of the mesh geometry data (positions), for raycasting purposes.
-    KdTree<Triangle> meshData;
+    /// Stores a CPU-side version of the mesh geometry data (positions) and its BVH, for raycasting purposes.
+    /// Shared with the background build job, which may outlive the asset.
+    shared_ptr<OgreMeshRaycastData> meshData;
+
+    /// Has the BVH of meshData been taken into use. Avoids locking meshData on every raycast.
+    bool meshDataBVHReady;
 
     /// Triangle normals. One per triangle (not per-vertex normals).
     std::vector<float3> normals;
@@ -12,6 +12,7 @@ namespace Ogre
 {
     class Entity;
     class Mesh;
+    class SubMesh;
     class Node;
     class SceneNode;
     class Camera;
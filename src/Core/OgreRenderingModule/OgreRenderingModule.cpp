@@ -26,6 +26,7 @@
 #include "OgreSkeletonAsset.h"
 #include "OgreMaterialAsset.h"
 #include "TextureAsset.h"
+#include "OgreSpatialBoundsProviders.h"
 
 #include "Application.h"
 #include "Entity.h"
@@ -125,6 +126,9 @@ void OgreRenderingModule::Load()
     framework_->Scene()->RegisterComponentFactory(MAKE_SHARED(GenericComponentFactory<EC_EnvironmentLight>));
     framework_->Scene()->RegisterComponentFactory(MAKE_SHARED(GenericComponentFactory<EC_SceneShadowSetup>));
 
+    framework_->Scene()->RegisterSpatialBoundsProvider(MAKE_SHARED(PlaceableSpatialBoundsProvider));
+    framework_->Scene()->RegisterSpatialBoundsProvider(MAKE_SHARED(MeshSpatialBoundsProvider));
+
     // Main ogre .mesh extension
     QStringList meshExtensions;
     meshExtensions << ".mesh";
@@ -0,0 +1,349 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#define MATH_OGRE_INTEROP
+#include "DebugOperatorNew.h"
+
+#include "OgreSkinnedMeshRaycast.h"
+#include "Profiler.h"
+#include "LoggingFunctions.h"
+#include "Math/MathFunc.h"
+#include "Geometry/Ray.h"
+
+#include <Ogre.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    /// Number of floats of a bone matrix that are compared and used. The last row of the affine matrices is constant.
+    const size_t cMatrixFloats = 12;
+
+    inline float3 TransformPos(const Ogre::Matrix4 &m, const float3 &v)
+    {
+        return float3(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z + m[0][3],
+                      m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z + m[1][3],
+                      m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z + m[2][3]);
+    }
+
+    /// Returns the largest factor by which the matrix scales a distance.
+    inline float MaxScale(const Ogre::Matrix4 &m)
+    {
+        float maxLengthSq = 0.f;
+        for(int col = 0; col < 3; ++col)
+            maxLengthSq = std::max(maxLengthSq, m[0][col] * m[0][col] + m[1][col] * m[1][col] + m[2][col] * m[2][col]);
+        return Sqrt(maxLengthSq);
+    }
+}
+
+OgreSkinnedMeshRaycast::OgreSkinnedMeshRaycast(Ogre::Entity *entity_) :
+    entity(entity_),
+    mesh(entity_ ? entity_->getMesh().get() : 0),
+    built(false),
+    valid(false),
+    numRefits(0)
+{
+    staticBounds.SetNegativeInfinity();
+}
+
+bool OgreSkinnedMeshRaycast::IsFor(Ogre::Entity *entity_) const
+{
+    return entity == entity_ && entity_ && mesh == entity_->getMesh().get();
+}
+
+bool OgreSkinnedMeshRaycast::Raycast(const Ray &localRay, Hit &outHit)
+{
+    if (!built)
+    {
+        built = true;
+        valid = Build();
+    }
+    if (!valid || !IntersectsSkeleton(localRay))
+        return false;
+
+    UpdatePose();
+
+    TriangleBVHHit hit;
+    if (!bvh.Raycast(localRay, FLOAT_INF, hit))
+        return false;
+
+    const u32 *tri = &indices[hit.triangleIndex * 3];
+    outHit.t = hit.t;
+    outHit.barycentricUV = float2(hit.u, hit.v);
+    const Triangle &hitTriangle = triangles[hit.triangleIndex];
+    outHit.normal = (hitTriangle.b - hitTriangle.a).Cross(hitTriangle.c - hitTriangle.a);
+    outHit.uv = (1.f - hit.u - hit.v) * uvs[tri[0]] + hit.u * uvs[tri[1]] + hit.v * uvs[tri[2]];
+    outHit.submeshIndex = 0;
+    int triangleIndex = (int)hit.triangleIndex;
+    for(size_t i = 0; i < submeshTriangleCounts.size(); ++i)
+    {
+        if (triangleIndex < submeshTriangleCounts[i])
+        {
+            outHit.submeshIndex = (unsigned)i;
+            break;
+        }
+        triangleIndex -= submeshTriangleCounts[i];
+    }
+    outHit.triangleIndex = (unsigned)triangleIndex;
+    return true;
+}
+
+bool OgreSkinnedMeshRaycast::Build()
+{
+    PROFILE(OgreSkinnedMeshRaycast_Build);
+
+    Ogre::MeshPtr ogreMesh = entity->getMesh();
+    if (ogreMesh.isNull())
+        return false;
+
+    try
+    {
+        // Each vertex data set is read once, the shared vertices when the first submesh refers to them.
+        size_t sharedOffset = 0;
+        bool sharedRead = false;
+        for(unsigned short i = 0; i < ogreMesh->getNumSubMeshes(); ++i)
+        {
+            Ogre::SubMesh *submesh = ogreMesh->getSubMesh(i);
+            if (submesh->useSharedVertices && !sharedRead)
+            {
+                sharedOffset = bindVertices.size();
+                sharedRead = true;
+                ReadSubmesh(submesh, true, sharedOffset);
+            }
+            else
+                ReadSubmesh(submesh, false, submesh->useSharedVertices ? sharedOffset : bindVertices.size());
+        }
+    }
+    catch(const Ogre::Exception &e)
+    {
+        LogError("OgreSkinnedMeshRaycast: Failed to read the geometry of mesh " + ogreMesh->getName() + ": " + e.what());
+        return false;
+    }
+    if (indices.empty())
+        return false;
+
+    triangles.resize(indices.size() / 3);
+    for(size_t i = 0; i < triangles.size(); ++i)
+        triangles[i] = Triangle(bindVertices[indices[i * 3]], bindVertices[indices[i * 3 + 1]], bindVertices[indices[i * 3 + 2]]);
+    bvh.Build(&triangles[0], (int)triangles.size());
+    posedVertices.resize(bindVertices.size());
+    ComputeBoneSpheres();
+    return true;
+}
+
+void OgreSkinnedMeshRaycast::ReadSubmesh(Ogre::SubMesh *submesh, bool readVertices, size_t vertexOffset)
+{
+    Ogre::Mesh *ogreMesh = submesh->parent;
+    const Ogre::VertexData *vertexData = submesh->useSharedVertices ? ogreMesh->sharedVertexData : submesh->vertexData;
+    const Ogre::VertexElement *posElem = vertexData ? vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_POSITION) : 0;
+    if (!posElem || !submesh->indexData || submesh->indexData->indexCount < 3)
+    {
+        submeshTriangleCounts.push_back(0);
+        return;
+    }
+
+    if (!submesh->useSharedVertices)
+        readVertices = true;
+    if (readVertices)
+    {
+        Ogre::HardwareVertexBufferSharedPtr vbufPos = vertexData->vertexBufferBinding->getBuffer(posElem->getSource());
+        const unsigned char *pos = static_cast<const unsigned char*>(vbufPos->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
+        const size_t posOffset = posElem->getOffset();
+        const size_t posSize = vbufPos->getVertexSize();
+
+        // Texcoord element is not mandatory
+        const unsigned char *texCoord = 0;
+        size_t texOffset = 0;
+        size_t texSize = 0;
+        Ogre::HardwareVertexBufferSharedPtr vbufTex;
+        const Ogre::VertexElement *texElem = vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_TEXTURE_COORDINATES);
+        if (texElem)
+        {
+            vbufTex = vertexData->vertexBufferBinding->getBuffer(texElem->getSource());
+            if (vbufTex != vbufPos)
+                texCoord = static_cast<const unsigned char*>(vbufTex->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
+            else
+                texCoord = pos;
+            texOffset = texElem->getOffset();
+            texSize = vbufTex->getVertexSize();
+        }
+
+        const size_t first = bindVertices.size();
+        for(size_t i = 0; i < vertexData->vertexCount; ++i)
+        {
+            const size_t index = vertexData->vertexStart + i;
+            bindVertices.push_back(*(const float3*)(pos + posOffset + index * posSize));
+            uvs.push_back(texCoord ? *(const float2*)(texCoord + texOffset + index * texSize) : float2(-1.f, -1.f));
+            VertexWeights weights;
+            memset(&weights, 0, sizeof(weights));
+            vertexWeights.push_back(weights);
+        }
+
+        vbufPos->unlock();
+        if (!vbufTex.isNull() && vbufTex != vbufPos)
+            vbufTex->unlock();
+
+        // Ogre has already limited the assignments to four per vertex and normalized their weights when the mesh was loaded.
+        const Ogre::Mesh::VertexBoneAssignmentList &assignments = (submesh->useSharedVertices ? ogreMesh->getBoneAssignments() : submesh->getBoneAssignments());
+        for(Ogre::Mesh::VertexBoneAssignmentList::const_iterator it = assignments.begin(); it != assignments.end(); ++it)
+        {
+            const Ogre::VertexBoneAssignment &assignment = it->second;
+            if (assignment.vertexIndex < vertexData->vertexStart || assignment.vertexIndex - vertexData->vertexStart >= vertexData->vertexCount)
+                continue;
+            VertexWeights &weights = vertexWeights[first + assignment.vertexIndex - vertexData->vertexStart];
+            if (weights.count < 4 && assignment.weight > 0.f)
+            {
+                weights.bones[weights.count] = assignment.boneIndex;
+                weights.weights[weights.count] = assignment.weight;
+                ++weights.count;
+            }
+        }
+    }
+
+    Ogre::IndexData *indexData = submesh->indexData;
+    Ogre::HardwareIndexBufferSharedPtr ibuf = indexData->indexBuffer;
+    const u32 *pLong = static_cast<const u32*>(ibuf->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
+    const u16 *pShort = reinterpret_cast<const u16*>(pLong);
+    const bool use32BitIndices = (ibuf->getType() == Ogre::HardwareIndexBuffer::IT_32BIT);
+    const size_t vertexStart = vertexData->vertexStart;
+    const size_t vertexCount = vertexData->vertexCount;
+    int numTriangles = 0;
+    for(size_t j = indexData->indexStart; j + 2 < indexData->indexStart + indexData->indexCount; j += 3)
+    {
+        u32 tri[3];
+        for(int k = 0; k < 3; ++k)
+            tri[k] = (use32BitIndices ? pLong[j + k] : pShort[j + k]);
+        // The triangle numbering must match the submesh, so a triangle that refers outside the vertex data is degenerated
+        // instead of skipped.
+        for(int k = 0; k < 3; ++k)
+            indices.push_back((u32)(vertexOffset + (tri[k] >= vertexStart && tri[k] - vertexStart < vertexCount ? tri[k] - vertexStart : 0)));
+        ++numTriangles;
+    }
+    ibuf->unlock();
+    submeshTriangleCounts.push_back(numTriangles);
+}
+
+void OgreSkinnedMeshRaycast::ComputeBoneSpheres()
+{
+    // The sphere of a bone is centered at the average of its vertices. Skinning moves each vertex to a weighted average
+    // of the bones transforming it, so a skinned vertex stays within the convex hull of the transformed spheres.
+    std::vector<float3> sums;
+    std::vector<int> counts;
+    for(size_t i = 0; i < bindVertices.size(); ++i)
+    {
+        const VertexWeights &weights = vertexWeights[i];
+        if (weights.count == 0)
+            staticBounds.Enclose(bindVertices[i]);
+        for(int j = 0; j < weights.count; ++j)
+        {
+            const u16 bone = weights.bones[j];
+            if (bone >= sums.size())
+            {
+                sums.resize(bone + 1, float3::zero);
+                counts.resize(bone + 1, 0);
+            }
+            sums[bone] += bindVertices[i];
+            ++counts[bone];
+        }
+    }
+
+    std::vector<int> sphereIndex(sums.size(), -1);
+    for(size_t bone = 0; bone < sums.size(); ++bone)
+        if (counts[bone] > 0)
+        {
+            BoneSphere sphere;
+            sphere.bone = (u16)bone;
+            sphere.center = sums[bone] / (float)counts[bone];
+            sphere.radius = 0.f;
+            sphereIndex[bone] = (int)boneSpheres.size();
+            boneSpheres.push_back(sphere);
+        }
+    for(size_t i = 0; i < bindVertices.size(); ++i)
+    {
+        const VertexWeights &weights = vertexWeights[i];
+        for(int j = 0; j < weights.count; ++j)
+        {
+            BoneSphere &sphere = boneSpheres[sphereIndex[weights.bones[j]]];
+            sphere.radius = std::max(sphere.radius, sphere.center.Distance(bindVertices[i]));
+        }
+    }
+}
+
+bool OgreSkinnedMeshRaycast::IntersectsSkeleton(const Ray &localRay) const
+{
+    const Ogre::Matrix4 *matrices = entity->_getBoneMatrices();
+    const size_t numMatrices = entity->_getNumBoneMatrices();
+    AABB bounds;
+    if (!entity->_isAnimated() || !matrices)
+        bounds = bvh.BoundingAABB();
+    else
+    {
+        bounds = staticBounds;
+        for(size_t i = 0; i < boneSpheres.size(); ++i)
+        {
+            const BoneSphere &sphere = boneSpheres[i];
+            if (sphere.bone >= numMatrices)
+                return true; // The skeleton does not match the bone assignments, can not cull.
+            const Ogre::Matrix4 &m = matrices[sphere.bone];
+            const float3 center = TransformPos(m, sphere.center);
+            const float radius = sphere.radius * MaxScale(m);
+            bounds.Enclose(center - float3(radius, radius, radius));
+            bounds.Enclose(center + float3(radius, radius, radius));
+        }
+    }
+    float dNear, dFar;
+    return bounds.IsFinite() && bounds.Intersects(localRay, dNear, dFar);
+}
+
+void OgreSkinnedMeshRaycast::UpdatePose()
+{
+    const Ogre::Matrix4 *matrices = entity->_getBoneMatrices();
+    const size_t numMatrices = entity->_getNumBoneMatrices();
+    if (!entity->_isAnimated() || !matrices || numMatrices == 0)
+    {
+        // Ogre renders an entity without animations in the bind pose.
+        if (!poseMatrices.empty())
+        {
+            for(size_t i = 0; i < triangles.size(); ++i)
+                triangles[i] = Triangle(bindVertices[indices[i * 3]], bindVertices[indices[i * 3 + 1]], bindVertices[indices[i * 3 + 2]]);
+            bvh.Refit(&triangles[0], (int)triangles.size());
+            poseMatrices.clear();
+            ++numRefits;
+        }
+        return;
+    }
+
+    bool changed = poseMatrices.size() != numMatrices * cMatrixFloats;
+    if (!changed)
+        for(size_t i = 0; i < numMatrices && !changed; ++i)
+            changed = memcmp(matrices[i][0], &poseMatrices[i * cMatrixFloats], cMatrixFloats * sizeof(float)) != 0;
+    if (!changed)
+        return;
+
+    PROFILE(OgreSkinnedMeshRaycast_Refit);
+    poseMatrices.resize(numMatrices * cMatrixFloats);
+    for(size_t i = 0; i < numMatrices; ++i)
+        memcpy(&poseMatrices[i * cMatrixFloats], matrices[i][0], cMatrixFloats * sizeof(float));
+
+    for(size_t i = 0; i < bindVertices.size(); ++i)
+    {
+        const VertexWeights &weights = vertexWeights[i];
+        if (weights.count == 0)
+        {
+            posedVertices[i] = bindVertices[i];
+            continue;
+        }
+        float3 pos = float3::zero;
+        for(int j = 0; j < weights.count; ++j)
+            if (weights.bones[j] < numMatrices)
+                pos += weights.weights[j] * TransformPos(matrices[weights.bones[j]], bindVertices[i]);
+        posedVertices[i] = pos;
+    }
+    for(size_t i = 0; i < triangles.size(); ++i)
+        triangles[i] = Triangle(posedVertices[indices[i * 3]], posedVertices[indices[i * 3 + 1]], posedVertices[indices[i * 3 + 2]]);
+    bvh.Refit(&triangles[0], (int)triangles.size());
+    ++numRefits;
+}
@@ -0,0 +1,107 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "OgreModuleFwd.h"
+#include "Math/float2.h"
+#include "Math/float3.h"
+#include "Geometry/AABB.h"
+#include "Geometry/Triangle.h"
+#include "Geometry/TriangleBVH.h"
+
+#include <vector>
+
+/// Raycasts against the animated geometry of one skeletal Ogre::Entity.
+/** The triangles and the bone weights are copied from the bind pose of the mesh on the first raycast, and a TriangleBVH is
+    built of them once. The vertices are skinned on the CPU with the bone matrices Ogre last rendered the entity with, and
+    the BVH is refit, not rebuilt, to the skinned triangles. This only happens when a ray actually reaches the mesh and
+    the matrices have changed since the previous refit, i.e. once per animation frame at most.
+
+    Before that, the ray is tested against the bounds of the skeleton, which are computed from the bone matrices alone:
+    each bone carries a sphere that encloses the bind pose vertices it influences, so rays that miss a character skip the
+    skinning altogether.
+
+    Owned by EC_Mesh, one for its entity and each of its skeletal attachments. */
+class OgreSkinnedMeshRaycast
+{
+public:
+    explicit OgreSkinnedMeshRaycast(Ogre::Entity *entity);
+
+    /// The result of Raycast.
+    struct Hit
+    {
+        float t; ///< Distance along the local ray, in the units of its direction.
+        unsigned submeshIndex;
+        unsigned triangleIndex; ///< Index of the triangle in the submesh.
+        float2 barycentricUV;
+        float3 normal; ///< Unnormalized face normal in the local space of the entity.
+        float2 uv; ///< Texture coordinates of the hit, (-1, -1) if the mesh has none.
+    };
+
+    /// Finds the nearest triangle hit by a ray in the local space of the entity. Returns false if nothing was hit.
+    bool Raycast(const Ray &localRay, Hit &outHit);
+
+    /// Returns the entity this raycasts against.
+    Ogre::Entity *OgreEntity() const { return entity; }
+
+    /// Returns true if this was created for the given entity and its current mesh.
+    bool IsFor(Ogre::Entity *entity) const;
+
+    /// Returns the number of times the BVH has been refit, for profiling.
+    int NumRefits() const { return numRefits; }
+
+private:
+    /// The bones that move a vertex. Ogre uses at most four.
+    struct VertexWeights
+    {
+        u16 bones[4];
+        float weights[4];
+        int count; ///< 0 for the vertices without bone assignments, which are not animated.
+    };
+
+    /// Sphere that encloses the bind pose vertices influenced by a bone, in the bind pose.
+    struct BoneSphere
+    {
+        u16 bone;
+        float3 center;
+        float radius;
+    };
+
+    /// Copies the bind pose geometry and builds the BVH. Returns false if the mesh can not be raycast.
+    bool Build();
+
+    /// Reads the triangles of a submesh, and its vertices if the submesh has its own or readVertices is set.
+    /** @param vertexOffset Index of the first vertex of the vertex data of the submesh in bindVertices. */
+    void ReadSubmesh(Ogre::SubMesh *submesh, bool readVertices, size_t vertexOffset);
+
+    /// Computes the bone spheres out of the bind pose vertices and the bone weights.
+    void ComputeBoneSpheres();
+
+    /// Returns false if the ray misses the bounds of the skeleton posed with the current bone matrices.
+    bool IntersectsSkeleton(const Ray &localRay) const;
+
+    /// Refits the BVH to the current pose if the bone matrices have changed since the last refit.
+    void UpdatePose();
+
+    Ogre::Entity *entity;
+    const Ogre::Mesh *mesh; ///< The mesh of the entity when this was built, to detect a changed mesh.
+    bool built;
+    bool valid;
+
+    std::vector<float3> bindVertices;
+    std::vector<float2> uvs; ///< Parallel to bindVertices, (-1, -1) for the vertices without texture coordinates.
+    std::vector<VertexWeights> vertexWeights; ///< Parallel to bindVertices.
+    std::vector<BoneSphere> boneSpheres;
+    AABB staticBounds; ///< Box of the vertices without bone assignments.
+
+    std::vector<u32> indices; ///< Three vertex indices per triangle.
+    std::vector<int> submeshTriangleCounts;
+
+    std::vector<float3> posedVertices;
+    std::vector<Triangle> triangles; ///< In the pose the BVH has last been fit to.
+    TriangleBVH bvh;
+
+    /// The bone matrices the BVH has last been refit to, 12 floats per bone. Empty when the BVH is in the bind pose.
+    std::vector<float> poseMatrices;
+    int numRefits;
+};
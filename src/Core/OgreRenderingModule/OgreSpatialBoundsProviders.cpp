@@ -0,0 +1,127 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#define MATH_OGRE_INTEROP
+#include "DebugOperatorNew.h"
+
+#include "OgreSpatialBoundsProviders.h"
+#include "EC_Placeable.h"
+#include "EC_Mesh.h"
+#include "OgreMeshAsset.h"
+#include "Entity.h"
+#include "SpatialWorld.h"
+#include "Geometry/AABB.h"
+#include "Geometry/OBB.h"
+#include "Geometry/Ray.h"
+
+#include <Ogre.h>
+
+#include "MemoryLeakCheck.h"
+
+u32 PlaceableSpatialBoundsProvider::ComponentTypeId() const
+{
+    return EC_Placeable::ComponentTypeId;
+}
+
+bool PlaceableSpatialBoundsProvider::WorldBounds(IComponent *component, AABB &outBounds) const
+{
+    EC_Placeable *placeable = static_cast<EC_Placeable*>(component);
+    const float3 pos = placeable->LocalToWorld().TranslatePart();
+    outBounds = AABB(pos, pos);
+    return true;
+}
+
+bool PlaceableSpatialBoundsProvider::SelectionLayer(IComponent *component, u32 &outLayer) const
+{
+    outLayer = (u32)static_cast<EC_Placeable*>(component)->selectionLayer.Get();
+    return true;
+}
+
+void PlaceableSpatialBoundsProvider::ConnectChangeSignals(IComponent *component, SpatialWorld *world) const
+{
+    // Changes of the own transform are attribute changes, but changes up in the parent chain are not.
+    QObject::connect(component, SIGNAL(ParentChainTransformsChanged()), world, SLOT(MarkComponentDirty()), Qt::UniqueConnection);
+}
+
+u32 MeshSpatialBoundsProvider::ComponentTypeId() const
+{
+    return EC_Mesh::ComponentTypeId;
+}
+
+bool MeshSpatialBoundsProvider::WorldOBB(IComponent *component, OBB &outOBB) const
+{
+    EC_Mesh *mesh = static_cast<EC_Mesh*>(component);
+    if (mesh->HasMesh())
+        outOBB = mesh->WorldOBB();
+    else
+    {
+        // Headless, or the mesh is not loaded yet: use the asset, if it exists, with the transforms of the attributes.
+        OgreMeshAssetPtr asset = mesh->MeshAsset();
+        if (!asset || asset->ogreMesh.isNull())
+            return false;
+        Entity *entity = mesh->ParentEntity();
+        shared_ptr<EC_Placeable> placeable = entity ? entity->Component<EC_Placeable>() : shared_ptr<EC_Placeable>();
+        if (!placeable)
+            return false;
+        outOBB = OBB(AABB(asset->ogreMesh->getBounds()));
+        outOBB.Transform(placeable->LocalToWorld() * mesh->nodeTransformation.Get().ToFloat3x4());
+    }
+    return outOBB.IsFinite() && !outOBB.IsDegenerate();
+}
+
+bool MeshSpatialBoundsProvider::WorldBounds(IComponent *component, AABB &outBounds) const
+{
+    OBB obb;
+    if (!WorldOBB(component, obb))
+        return false;
+    outBounds = obb.MinimalEnclosingAABB();
+    return true;
+}
+
+bool MeshSpatialBoundsProvider::Raycast(IComponent *component, const Ray &ray, float maxDistance, float &outDistance, float3 &outNormal) const
+{
+    EC_Mesh *mesh = static_cast<EC_Mesh*>(component);
+    if (mesh->OgreEntity())
+    {
+        // Exact per-triangle test when the mesh has been instantiated.
+        float distance;
+        float3 normal;
+        if (!EC_Mesh::Raycast(mesh->OgreEntity(), ray, &distance, 0, 0, 0, &normal) || distance > maxDistance)
+            return false;
+        outDistance = distance;
+        outNormal = normal;
+        return true;
+    }
+
+    OBB obb;
+    if (!WorldOBB(component, obb))
+        return false;
+    float dNear, dFar;
+    if (!obb.Intersects(ray, dNear, dFar))
+        return false;
+    const float distance = dNear > 0.f ? dNear : 0.f;
+    if (distance > maxDistance)
+        return false;
+
+    // The normal is the axis of the OBB face the hit point lies on.
+    const float3 local = ray.GetPoint(distance) - obb.pos;
+    int axis = 0;
+    float maxRatio = -1.f;
+    for(int i = 0; i < 3; ++i)
+    {
+        const float ratio = obb.r[i] > 1e-6f ? Abs(local.Dot(obb.axis[i])) / obb.r[i] : 0.f;
+        if (ratio > maxRatio)
+        {
+            maxRatio = ratio;
+            axis = i;
+        }
+    }
+    outNormal = local.Dot(obb.axis[axis]) >= 0.f ? obb.axis[axis] : -obb.axis[axis];
+    outDistance = distance;
+    return true;
+}
+
+void MeshSpatialBoundsProvider::ConnectChangeSignals(IComponent *component, SpatialWorld *world) const
+{
+    QObject::connect(component, SIGNAL(MeshChanged()), world, SLOT(MarkComponentDirty()), Qt::UniqueConnection);
+}
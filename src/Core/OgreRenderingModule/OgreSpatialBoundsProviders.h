@@ -0,0 +1,34 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "ISpatialBoundsProvider.h"
+
+/// Provides the position and the selection layer of EC_Placeable for SpatialWorld.
+/** The position is used as the bounds of entities that do not have any geometry. */
+class PlaceableSpatialBoundsProvider : public ISpatialBoundsProvider
+{
+public:
+    u32 ComponentTypeId() const;
+    bool WorldBounds(IComponent *component, AABB &outBounds) const;
+    bool IsFallback() const { return true; }
+    bool SelectionLayer(IComponent *component, u32 &outLayer) const;
+    void ConnectChangeSignals(IComponent *component, SpatialWorld *world) const;
+};
+
+/// Provides the bounds of EC_Mesh for SpatialWorld.
+/** When the mesh has been instantiated to Ogre, the world OBB of the mesh is used. In headless mode, the bounds of
+    the mesh asset are transformed with the placeable of the mesh, if the asset has been loaded by someone else, e.g. physics. */
+class MeshSpatialBoundsProvider : public ISpatialBoundsProvider
+{
+public:
+    u32 ComponentTypeId() const;
+    bool WorldBounds(IComponent *component, AABB &outBounds) const;
+    bool SupportsRaycast() const { return true; }
+    bool Raycast(IComponent *component, const Ray &ray, float maxDistance, float &outDistance, float3 &outNormal) const;
+    void ConnectChangeSignals(IComponent *component, SpatialWorld *world) const;
+
+private:
+    /// Returns the world space OBB of the mesh, or false if the mesh is not available.
+    bool WorldOBB(IComponent *component, OBB &outOBB) const;
+};
@@ -11,6 +11,7 @@
 #include "EC_Camera.h"
 #include "EC_Placeable.h"
 #include "EC_Mesh.h"
+#include "CameraFacingRenderable.h"
 #include "OgreCompositionHandler.h"
 #include "OgreShadowCameraSetupFocusedPSSM.h"
 #include "OgreBulletCollisionsDebugLines.h"
@@ -773,6 +774,7 @@ void OgreWorld::RaycastInternal(unsigned layerMask, float maxDistance, bool getA
         else
         {
             Ogre::BillboardSet *bbs = dynamic_cast<Ogre::BillboardSet*>(entry.movable);
+            CameraFacingRenderable *facing = dynamic_cast<CameraFacingRenderable*>(entry.movable);
             if (bbs)
             {
                 float3x4 camWorldTransform = float4x4(renderer_->MainOgreCamera()->getParentSceneNode()->_getFullTransform()).Float3x4Part();
@@ -849,6 +851,45 @@ void OgreWorld::RaycastInternal(unsigned layerMask, float maxDistance, bool getA
                     ++hitIndex;
                 }
             }
+            else if (facing)
+            {
+                // Test a precise hit to the rectangle of the content, in its plane facing the camera.
+                float left, top, right, bottom;
+                if (!facing->FacingBounds(left, top, right, bottom) || right <= left || top <= bottom)
+                    continue;
+
+                Ogre::Matrix4 w_;
+                facing->getWorldTransforms(&w_);
+                float3x4 world = float4x4(w_).Float3x4Part(); // Maps the local x-y plane of the content to world space.
+                float3 frontDir = world.Col(2).Normalized();
+                Plane plane(world.TranslatePart(), frontDir);
+                float d;
+                if (!plane.Intersects(ray, &d) || d > maxDistance)
+                    continue;
+                if (!getAllResults && closestDistance >= 0.0f && d >= closestDistance)
+                    continue;
+                if (!world.Inverse())
+                    continue;
+
+                float3 intersectionPoint = ray.GetPoint(d);
+                const float3 hit = world.MulPos(intersectionPoint); // The hit in the local plane of the content.
+                if (hit.x >= left && hit.x <= right && hit.y >= bottom && hit.y <= top)
+                {
+                    closestDistance = d;
+                    RaycastResult* result = GetOrCreateRaycastResult(hitIndex);
+                    result->entity = entity;
+                    result->component = component;
+                    result->pos = intersectionPoint;
+                    result->normal = frontDir;
+                    result->submesh = 0;
+                    result->index = (unsigned int)-1; // Not applicable, as for billboards.
+                    result->u = (hit.x - left) / (right - left);
+                    result->v = (hit.y - bottom) / (top - bottom);
+                    result->t = d;
+                    rayHits_.push_back(result);
+                    ++hitIndex;
+                }
+            }
             else
             {
                 // Not a mesh entity, fall back to just using the bounding box - ray intersection
@@ -11,6 +11,7 @@
 #include "EC_VolumeTrigger.h"
 #include "EC_PhysicsMotor.h"
 #include "EC_PhysicsConstraint.h"
+#include "RigidBodySpatialBoundsProvider.h"
 
 #include "OgreRenderingModule.h"
 #include "EC_Mesh.h"
@@ -64,6 +65,8 @@ void PhysicsModule::Load()
     framework_->Scene()->RegisterComponentFactory(MAKE_SHARED(GenericComponentFactory<EC_VolumeTrigger>));
     framework_->Scene()->RegisterComponentFactory(MAKE_SHARED(GenericComponentFactory<EC_PhysicsMotor>));
     framework_->Scene()->RegisterComponentFactory(MAKE_SHARED(GenericComponentFactory<EC_PhysicsConstraint>));
+
+    framework_->Scene()->RegisterSpatialBoundsProvider(MAKE_SHARED(RigidBodySpatialBoundsProvider));
 }
 
 void PhysicsModule::Initialize()
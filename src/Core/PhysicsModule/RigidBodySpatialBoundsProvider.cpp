@@ -0,0 +1,22 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "RigidBodySpatialBoundsProvider.h"
+#include "EC_RigidBody.h"
+#include "Geometry/AABB.h"
+
+#include "MemoryLeakCheck.h"
+
+u32 RigidBodySpatialBoundsProvider::ComponentTypeId() const
+{
+    return EC_RigidBody::ComponentTypeId;
+}
+
+bool RigidBodySpatialBoundsProvider::WorldBounds(IComponent *component, AABB &outBounds) const
+{
+    // Returns a negative infinity box if the body has not been created yet.
+    outBounds = static_cast<EC_RigidBody*>(component)->ShapeAABB();
+    return outBounds.IsFinite();
+}
@@ -0,0 +1,14 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "ISpatialBoundsProvider.h"
+
+/// Provides the bounds of the collision shape of EC_RigidBody for SpatialWorld.
+/** Bullet keeps the world space AABBs of the bodies up to date, so this works the same on servers and clients. */
+class RigidBodySpatialBoundsProvider : public ISpatialBoundsProvider
+{
+public:
+    u32 ComponentTypeId() const;
+    bool WorldBounds(IComponent *component, AABB &outBounds) const;
+};
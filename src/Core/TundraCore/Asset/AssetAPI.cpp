@@ -34,9 +34,19 @@
 
 #include "MemoryLeakCheck.h"
 
+namespace
+{
+    /// The maximum number of entries in each of the ref caches. A cache that gets full is cleared, instead of tracking the use of the entries.
+    const int cMaxCachedAssetRefs = 16384;
+}
+
 AssetAPI::AssetAPI(Framework *framework, bool headless) :
     fw(framework),
     isHeadless(headless),
+    currentTransfers(&assetRefs),
+    bundleMonitors(&assetRefs),
+    assets(&assetRefs),
+    assetBundles(&assetRefs),
     assetCache(0),
     diskSourceChangeWatcher(0)
 {
@@ -135,7 +145,10 @@ bool AssetAPI::RemoveAssetStorage(const QString &name)
     /// not be possible to specify which storage to delete.
     foreach(const AssetProviderPtr &provider, AssetProviders())
         if (provider->RemoveAssetStorage(name))
+        {
+            InvalidateRefCaches();
             return true;
+        }
 
     return false;
 }
@@ -175,6 +188,7 @@ AssetStoragePtr AssetAPI::DefaultAssetStorage() const
 void AssetAPI::SetDefaultAssetStorage(const AssetStoragePtr &storage)
 {
     defaultStorage = storage;
+    InvalidateRefCaches();
     if (storage)
         LogInfo("Set asset storage \"" + storage->Name() + "\" as the default storage (" + storage->SerializeToString() + ").");
     else
@@ -184,9 +198,9 @@ void AssetAPI::SetDefaultAssetStorage(const AssetStoragePtr &storage)
 AssetMap AssetAPI::AssetsOfType(const QString& type) const
 {
     AssetMap ret;
-    for(AssetMap::const_iterator i = assets.begin(); i != assets.end(); ++i)
+    for(AssetIdMap::const_iterator i = assets.begin(); i != assets.end(); ++i)
         if (i->second->Type().compare(type, Qt::CaseInsensitive) == 0)
-            ret[i->first] = i->second;
+            ret[assets.Name(i)] = i->second;
     return ret;
 }
 
@@ -524,12 +538,12 @@ bool AssetAPI::ForgetAsset(AssetPtr asset, bool removeDiskSource)
     asset->Unload();
 
     // Remove any pending transfers for this asset.
-    AssetTransferMap::iterator transferIter = FindTransferIterator(asset->Name());
+    AssetTransferIdMap::iterator transferIter = FindTransferIterator(asset->Name());
     if (transferIter != currentTransfers.end())
         currentTransfers.erase(transferIter);
 
     // Remove the asset from internal state.
-    AssetMap::iterator iter = assets.find(asset->Name());
+    AssetIdMap::iterator iter = assets.find(asset->Name());
     if (iter == assets.end())
     {
         LogError("AssetAPI::ForgetAsset called on asset \"" + asset->Name() + "\", which does not exist in AssetAPI!");
@@ -539,6 +553,7 @@ bool AssetAPI::ForgetAsset(AssetPtr asset, bool removeDiskSource)
     // Remove file from disk watcher.
     if (diskSourceChangeWatcher && !asset->DiskSource().isEmpty())
         diskSourceChangeWatcher->removePath(asset->DiskSource());
+    RemoveAssetDependencies(asset->Name());
     assets.erase(iter);
     return true;
 }
@@ -572,7 +587,7 @@ bool AssetAPI::ForgetBundle(AssetBundlePtr bundle, bool removeDiskSource)
     // some object left a dangling strong ref to an asset).
     bundle->Unload();
 
-    AssetBundleMap::iterator iter = assetBundles.find(bundle->Name());
+    AssetBundleIdMap::iterator iter = assetBundles.find(bundle->Name());
     if (iter == assetBundles.end())
     {
         LogError("AssetAPI::ForgetBundle called on asset \"" + bundle->Name() + "\", which does not exist in AssetAPI!");
@@ -753,7 +768,7 @@ void AssetAPI::ForgetAllAssets()
         abortTransfer.reset();
         
         // Make sure the abort chain removed the transfer, otherwise we are in a infinite loop.
-        AssetTransferMap::iterator iter = currentTransfers.find(abortRef);
+        AssetTransferIdMap::iterator iter = currentTransfers.find(abortRef);
         if (iter != currentTransfers.end())
             currentTransfers.erase(iter);
     }
@@ -774,16 +789,20 @@ void AssetAPI::Reset()
     defaultStorage.reset();
     readyTransfers.clear();
     readySubTransfers.clear();
-    assetDependencies.clear();
+    dependencyGraph.Clear();
     currentUploadTransfers.clear();
     currentTransfers.clear();
+    // All the maps keyed by the interned refs are now empty.
+    assetRefs.Clear();
+    parsedRefs.clear();
+    InvalidateRefCaches();
     providers.clear();
 }
 
 std::vector<AssetTransferPtr> AssetAPI::PendingTransfers() const
 {
     std::vector<AssetTransferPtr> transfers;
-    for(AssetTransferMap::const_iterator iter = currentTransfers.begin(); iter != currentTransfers.end(); ++iter)
+    for(AssetTransferIdMap::const_iterator iter = currentTransfers.begin(); iter != currentTransfers.end(); ++iter)
         transfers.push_back(iter->second);
 
     transfers.insert(transfers.end(), readyTransfers.begin(), readyTransfers.end());
@@ -792,7 +811,7 @@ std::vector<AssetTransferPtr> AssetAPI::PendingTransfers() const
 
 AssetTransferPtr AssetAPI::PendingTransfer(QString assetRef) const
 {
-    AssetTransferMap::const_iterator iter = currentTransfers.find(assetRef);
+    AssetTransferIdMap::const_iterator iter = currentTransfers.find(assetRef);
     if (iter != currentTransfers.end())
         return iter->second;
     for(size_t i = 0; i < readyTransfers.size(); ++i)
@@ -822,8 +841,10 @@ AssetTransferPtr AssetAPI::RequestAsset(QString assetRef, QString assetType, boo
         return AssetTransferPtr();
 
     // Parse out full reference, main asset ref and sub asset ref.
-    QString fullAssetRef, subAssetPart, mainAssetPart;
-    ParseAssetRef(assetRef, 0, 0, 0, 0, 0, 0, 0, &subAssetPart, &fullAssetRef, &mainAssetPart);
+    const ParsedAssetRef &parsedRef = ParseAssetRefCached(assetRef);
+    const QString fullAssetRef = parsedRef.fullRef;
+    const QString subAssetPart = parsedRef.subAssetName;
+    const QString mainAssetPart = parsedRef.fullRefNoSubAssetName;
     
     // Detect if the requested asset is a sub asset. Replace the lookup ref with the parent bundle reference.
     // Note that bundle handling has its own code paths as we need to load the bundle first before
@@ -840,7 +861,7 @@ AssetTransferPtr AssetAPI::RequestAsset(QString assetRef, QString assetType, boo
     // To optimize, we first check if there is an outstanding request to the given asset. If so, we return that request. In effect, we never
     // have multiple transfers running to the same asset. Important: This must occur before checking the assets map for whether we already have the asset in memory, since
     // an asset will be stored in the AssetMap when it has been downloaded, but it might not yet have all its dependencies loaded.
-    AssetTransferMap::iterator ongoingTransferIter = currentTransfers.find(assetRef);
+    AssetTransferIdMap::iterator ongoingTransferIter = currentTransfers.find(assetRef);
     if (ongoingTransferIter != currentTransfers.end())
     {
         AssetTransferPtr transfer = ongoingTransferIter->second;
@@ -854,7 +875,7 @@ AssetTransferPtr AssetAPI::RequestAsset(QString assetRef, QString assetType, boo
         // If this is a sub asset ref to a bundle, we just found the bundle transfer with assetRef. 
         // We need to add this sub asset transfer to the bundles monitor. We return the virtual transfer that
         // will get loaded once the bundle is loaded.
-        AssetBundleMonitorMap::iterator bundleMonitorIter = bundleMonitors.find(assetRef);
+        AssetBundleMonitorIdMap::iterator bundleMonitorIter = bundleMonitors.find(assetRef);
         if (bundleMonitorIter != bundleMonitors.end())
         {
             AssetBundleMonitorPtr assetBundleMonitor = (*bundleMonitorIter).second;
@@ -891,7 +912,7 @@ AssetTransferPtr AssetAPI::RequestAsset(QString assetRef, QString assetType, boo
     // unless the client explicitly forces so, or if we get a change notification signal from the source asset provider telling the asset was changed.
     // Note that we are using fullRef here as it has the complete sub asset ref also in it. If this is a sub asset request the assetRef has already been modified.
     AssetPtr existingAsset;
-    AssetMap::iterator existingAssetIter = assets.find(fullAssetRef);
+    AssetIdMap::iterator existingAssetIter = assets.find(fullAssetRef);
     if (existingAssetIter != assets.end())
     {
         existingAsset = existingAssetIter->second;
@@ -940,12 +961,12 @@ AssetTransferPtr AssetAPI::RequestAsset(QString assetRef, QString assetType, boo
     if (isSubAsset)
     {
         // Check if sub asset transfer is ongoing, meaning we already have been below and its still being processed.
-        AssetTransferMap::iterator ongoingSubAssetTransferIter = currentTransfers.find(fullAssetRef);
+        AssetTransferIdMap::iterator ongoingSubAssetTransferIter = currentTransfers.find(fullAssetRef);
         if (ongoingSubAssetTransferIter != currentTransfers.end())
             return ongoingSubAssetTransferIter->second;
         
         // Create a new transfer and load the asset from the bundle to it
-        AssetBundleMap::iterator bundleIter = assetBundles.find(assetRef);
+        AssetBundleIdMap::iterator bundleIter = assetBundles.find(assetRef);
         if (bundleIter != assetBundles.end())
         {
             // Return existing loader transfer
@@ -1022,7 +1043,7 @@ AssetTransferPtr AssetAPI::RequestAsset(QString assetRef, QString assetType, boo
         // It will connect to the asset transfer and create the bundle on download succeeded or handle it failing
         // by notifying all the child transfer failed.
         AssetBundleMonitorPtr bundleMonitor;
-        AssetBundleMonitorMap::iterator bundleMonitorIter = bundleMonitors.find(assetRef);
+        AssetBundleMonitorIdMap::iterator bundleMonitorIter = bundleMonitors.find(assetRef);
         if (bundleMonitorIter != bundleMonitors.end())
         {
             // Add the sub asset to an existing bundle monitor.
@@ -1106,16 +1127,33 @@ QString AssetAPI::ResolveAssetRef(QString context, QString assetRef) const
     context = context.trimmed();
 
     // First see if we have an exact match for the ref to an existing asset.
-    AssetMap::const_iterator iter = assets.find(assetRef);
+    AssetIdMap::const_iterator iter = assets.find(assetRef);
     if (iter != assets.end())
         return assetRef; // Use the ref as-is, there's an existing asset to map this string to.
 
+    // Without a context the result depends only on the ref and the storages, so it can be cached until the storages change.
+    if (context.isEmpty())
+    {
+        QHash<QString, QString>::const_iterator cached = resolvedRefs.find(assetRef);
+        if (cached != resolvedRefs.end())
+            return cached.value();
+        if (resolvedRefs.size() >= cMaxCachedAssetRefs)
+            resolvedRefs.clear();
+        const QString resolved = ResolveAssetRefUncached(QString(), assetRef);
+        resolvedRefs.insert(assetRef, resolved);
+        return resolved;
+    }
+    return ResolveAssetRefUncached(context, assetRef);
+}
+
+QString AssetAPI::ResolveAssetRefUncached(const QString &context, QString assetRef) const
+{
     // If the assetRef is by local filename without a reference to a provider or storage, use the default asset storage in the system for this assetRef.
-    QString assetPath;
-    QString namedStorage;
-    QString fullRef;
-    AssetRefType assetRefType = ParseAssetRef(assetRef, 0, &namedStorage, 0, &assetPath, 0, 0, 0, 0, &fullRef);
-    assetRef = fullRef; // The first thing we do is normalize the form of the ref. This means e.g. adding 'http://' in front of refs that look like 'www.server.com/'.
+    const ParsedAssetRef &parsedRef = ParseAssetRefCached(assetRef);
+    const AssetRefType assetRefType = parsedRef.type;
+    const QString assetPath = parsedRef.path_Filename_SubAssetName;
+    const QString namedStorage = parsedRef.namedStorage;
+    assetRef = parsedRef.fullRef; // The first thing we do is normalize the form of the ref. This means e.g. adding 'http://' in front of refs that look like 'www.server.com/'.
     
     switch(assetRefType)
     {
@@ -1135,12 +1173,13 @@ QString AssetAPI::ResolveAssetRef(QString context, QString assetRef) const
             else
             {
                 // Join the context to form a full url, e.g. context: "http://myserver.com/path/myasset.material", ref: "texture.png" returns "http://myserver.com/path/texture.png".
-                QString contextPath;
-                QString contextNamedStorage;
-                QString contextProtocolSpecifier;
-                QString contextSubAssetPart;
-                QString contextMainPart;
-                AssetRefType contextRefType = ParseAssetRef(context, &contextProtocolSpecifier, &contextNamedStorage, 0, 0, 0, &contextPath, 0, &contextSubAssetPart, 0, &contextMainPart);
+                const ParsedAssetRef &parsedContext = ParseAssetRefCached(context);
+                const QString contextPath = parsedContext.path;
+                const QString contextNamedStorage = parsedContext.namedStorage;
+                const QString contextProtocolSpecifier = parsedContext.protocolPart;
+                const QString contextSubAssetPart = parsedContext.subAssetName;
+                const QString contextMainPart = parsedContext.fullRefNoSubAssetName;
+                const AssetRefType contextRefType = parsedContext.type;
                 if (contextRefType == AssetRefRelativePath || contextRefType == AssetRefInvalid)
                 {
                     LogError("Asset ref context \"" + contextPath + "\" is a relative path and cannot be used as a context for lookup for ref \"" + assetRef + "\"!");
@@ -1192,6 +1231,7 @@ void AssetAPI::RegisterAssetTypeFactory(AssetTypeFactoryPtr factory)
 
     assert(factory->Type() == factory->Type().trimmed());
     assetTypeFactories.push_back(factory);
+    InvalidateRefCaches();
 }
 
 void AssetAPI::RegisterAssetBundleTypeFactory(AssetBundleTypeFactoryPtr factory)
@@ -1205,6 +1245,7 @@ void AssetAPI::RegisterAssetBundleTypeFactory(AssetBundleTypeFactoryPtr factory)
 
     assert(factory->Type() == factory->Type().trimmed());
     assetBundleTypeFactories.push_back(factory);
+    InvalidateRefCaches();
 }
 
 QString AssetAPI::GenerateUniqueAssetName(QString assetTypePrefix, QString assetNamePrefix) const
@@ -1305,6 +1346,10 @@ AssetPtr AssetAPI::CreateNewAsset(QString type, QString name, AssetStoragePtr st
     // Remember this asset in the global AssetAPI storage.
     assets[name] = asset;
 
+    // Track the completeness of the asset for the dependency tracking.
+    connect(asset.get(), SIGNAL(Loaded(AssetPtr)), this, SLOT(OnAssetLoaded(AssetPtr)), Qt::UniqueConnection);
+    connect(asset.get(), SIGNAL(Unloaded(IAsset*)), this, SLOT(OnAssetUnloaded(IAsset*)), Qt::UniqueConnection);
+
     ///\bug DiskSource and DiskSourceType are not set yet.
     {
         PROFILE(AssetAPI_CreateNewAsset_emit_AssetCreated);
@@ -1355,7 +1400,7 @@ bool AssetAPI::LoadSubAssetToTransfer(AssetTransferPtr transfer, const QString &
         return false;
     }
 
-    AssetBundleMap::iterator bundleIter = assetBundles.find(bundleRef);
+    AssetBundleIdMap::iterator bundleIter = assetBundles.find(bundleRef);
     if (bundleIter != assetBundles.end())
         return LoadSubAssetToTransfer(transfer, (*bundleIter).second.get(), fullSubAssetRef, subAssetType);
     else
@@ -1468,7 +1513,7 @@ AssetBundleTypeFactoryPtr AssetAPI::AssetBundleTypeFactory(const QString &typeNa
 AssetPtr AssetAPI::FindAsset(QString assetRef) const
 {
     // First try to see if the ref has an exact match.
-    AssetMap::const_iterator iter = assets.find(assetRef);
+    AssetIdMap::const_iterator iter = assets.find(assetRef);
     if (iter != assets.end())
         return iter->second;
 
@@ -1484,7 +1529,7 @@ AssetPtr AssetAPI::FindAsset(QString assetRef) const
 AssetBundlePtr AssetAPI::FindBundle(QString bundleRef) const
 {
     // First try to see if the ref has an exact match.
-    AssetBundleMap::const_iterator iter = assetBundles.find(bundleRef);
+    AssetBundleIdMap::const_iterator iter = assetBundles.find(bundleRef);
     if (iter != assetBundles.end())
         return iter->second;
 
@@ -1575,34 +1620,43 @@ std::map<QString, QString> ParseAssetRefArgs(const QString &url, QString *body)
     return keyValues;
 }
 
-AssetTransferMap::iterator AssetAPI::FindTransferIterator(QString assetRef)
+AssetAPI::AssetTransferIdMap::iterator AssetAPI::FindTransferIterator(QString assetRef)
 {
     return currentTransfers.find(assetRef);
 }
 
-AssetTransferMap::const_iterator AssetAPI::FindTransferIterator(QString assetRef) const
+AssetAPI::AssetTransferIdMap::const_iterator AssetAPI::FindTransferIterator(QString assetRef) const
 {
     return currentTransfers.find(assetRef);
 }
 
-AssetTransferMap::iterator AssetAPI::FindTransferIterator(IAssetTransfer *transfer)
+AssetAPI::AssetTransferIdMap::iterator AssetAPI::FindTransferIterator(IAssetTransfer *transfer)
 {
     if (!transfer)
         return currentTransfers.end();
 
-    for(AssetTransferMap::iterator iter = currentTransfers.begin(); iter != currentTransfers.end(); ++iter)
+    // The transfers are usually stored by their source ref, so try it first before looking through all transfers.
+    AssetTransferIdMap::iterator iter = currentTransfers.find(transfer->source.ref);
+    if (iter != currentTransfers.end() && iter->second.get() == transfer)
+        return iter;
+
+    for(iter = currentTransfers.begin(); iter != currentTransfers.end(); ++iter)
         if (iter->second.get() == transfer)
             return iter;
 
     return currentTransfers.end();
 }
 
-AssetTransferMap::const_iterator AssetAPI::FindTransferIterator(IAssetTransfer *transfer) const
+AssetAPI::AssetTransferIdMap::const_iterator AssetAPI::FindTransferIterator(IAssetTransfer *transfer) const
 {
     if (!transfer)
         return currentTransfers.end();
 
-    for(AssetTransferMap::const_iterator iter = currentTransfers.begin(); iter != currentTransfers.end(); ++iter)
+    AssetTransferIdMap::const_iterator iter = currentTransfers.find(transfer->source.ref);
+    if (iter != currentTransfers.end() && iter->second.get() == transfer)
+        return iter;
+
+    for(iter = currentTransfers.begin(); iter != currentTransfers.end(); ++iter)
         if (iter->second.get() == transfer)
             return iter;
 
@@ -1629,19 +1683,19 @@ void AssetAPI::AssetTransferCompleted(IAssetTransfer *transfer_)
         transfer->EmitAssetDownloaded();
         transfer->EmitTransferSucceeded();
         pendingDownloadRequests.erase(transfer->source.ref);
-        AssetTransferMap::iterator iter = FindTransferIterator(transfer.get());
+        AssetTransferIdMap::iterator iter = FindTransferIterator(transfer.get());
         if (iter != currentTransfers.end())
             currentTransfers.erase(iter);
         return;
     }
 
     // We should be tracking this transfer in an internal data structure.
-    AssetTransferMap::iterator iter = FindTransferIterator(transfer_);
+    AssetTransferIdMap::iterator iter = FindTransferIterator(transfer_);
     if (iter == currentTransfers.end())
         LogError("AssetAPI: Asset \"" + transfer->assetType + "\", name \"" + transfer->source.ref + "\" transfer finished, but no corresponding AssetTransferPtr was tracked by AssetAPI!");
 
     // Transfer is for an asset bundle.
-    AssetBundleMonitorMap::iterator bundleIter = bundleMonitors.find(transfer->source.ref);
+    AssetBundleMonitorIdMap::iterator bundleIter = bundleMonitors.find(transfer->source.ref);
     if (bundleIter != bundleMonitors.end())
     {
         AssetBundlePtr assetBundle = CreateNewAssetBundle(transfer->assetType, transfer->source.ref);
@@ -1687,9 +1741,11 @@ void AssetAPI::AssetTransferCompleted(IAssetTransfer *transfer_)
             LogError(error);
             transfer->EmitAssetFailed(error);
             
-            // Cleanup
-            currentTransfers.erase(iter);
-            bundleMonitors.erase(bundleIter);
+            // Cleanup. The handlers of the above signal may have added transfers, which can invalidate the iterators, so look them up again.
+            iter = FindTransferIterator(transfer.get());
+            if (iter != currentTransfers.end())
+                currentTransfers.erase(iter);
+            bundleMonitors.erase(transfer->source.ref);
             return;
         }
     }
@@ -1753,8 +1809,7 @@ void AssetAPI::AssetTransferFailed(IAssetTransfer *transfer, QString reason)
 
     ///\todo In this function, there is a danger of reaching an infinite recursion. Remember recursion parents and avoid infinite loops. (A -> B -> C -> A)
 
-    AssetTransferMap::iterator iter = currentTransfers.find(transfer->source.ref);
-    if (iter == currentTransfers.end())
+    if (currentTransfers.find(transfer->source.ref) == currentTransfers.end())
         LogError("AssetAPI: Asset \"" + transfer->assetType + "\", name \"" + transfer->source.ref + "\" transfer failed, but no corresponding AssetTransferPtr was tracked by AssetAPI!");
 
     // Signal any listeners that this asset transfer failed.
@@ -1772,9 +1827,9 @@ void AssetAPI::AssetTransferFailed(IAssetTransfer *transfer, QString reason)
         }
     }
 
+    // The signal handlers and the propagation may have modified the transfers, so look the transfer up again.
     pendingDownloadRequests.erase(transfer->source.ref);
-    if (iter != currentTransfers.end())
-        currentTransfers.erase(iter);
+    currentTransfers.erase(transfer->source.ref);
 }
 
 void AssetAPI::AssetTransferAborted(IAssetTransfer *transfer)
@@ -1784,8 +1839,6 @@ void AssetAPI::AssetTransferAborted(IAssetTransfer *transfer)
         
     // Don't log any errors for aborter transfers. This is unwanted spam when we disconnect 
     // from a server and have x amount of pending transfers that get aborter.
-    AssetTransferMap::iterator iter = currentTransfers.find(transfer->source.ref);
-    
     transfer->EmitAssetFailed("Transfer aborted.");   
 
     // Propagate the failure of this asset transfer to all assets which depend on this asset.
@@ -1797,9 +1850,9 @@ void AssetAPI::AssetTransferAborted(IAssetTransfer *transfer)
             AssetTransferAborted(dependentTransfer.get());
     }
 
+    // The signal handlers and the propagation may have modified the transfers, so look the transfer up again.
     pendingDownloadRequests.erase(transfer->source.ref);
-    if (iter != currentTransfers.end())
-        currentTransfers.erase(iter);
+    currentTransfers.erase(transfer->source.ref);
 }
 
 void AssetAPI::AssetLoadCompleted(const QString assetRef)
@@ -1807,8 +1860,8 @@ void AssetAPI::AssetLoadCompleted(const QString assetRef)
     PROFILE(AssetAPI_AssetLoadCompleted);
 
     AssetPtr asset;
-    AssetTransferMap::const_iterator iter = FindTransferIterator(assetRef);
-    AssetMap::iterator iter2 = assets.find(assetRef);
+    AssetTransferIdMap::const_iterator iter = FindTransferIterator(assetRef);
+    AssetIdMap::iterator iter2 = assets.find(assetRef);
     
     // Check for new transfer: not in the assets map yet
     if (iter != currentTransfers.end())
@@ -1877,8 +1930,8 @@ void AssetAPI::AssetLoadCompleted(const QString assetRef)
 
 void AssetAPI::AssetLoadFailed(const QString assetRef)
 {
-    AssetTransferMap::iterator iter = FindTransferIterator(assetRef);
-    AssetMap::const_iterator iter2 = assets.find(assetRef);
+    AssetTransferIdMap::iterator iter = FindTransferIterator(assetRef);
+    AssetIdMap::const_iterator iter2 = assets.find(assetRef);
 
     if (iter != currentTransfers.end())
     {
@@ -1899,13 +1952,13 @@ void AssetAPI::AssetBundleLoadCompleted(IAssetBundle *bundle)
     // First erase the transfer as the below sub asset loading can trigger new
     // dependency asset requests to the bundle. In this case we want to load them from the
     // completed asset bundle not add them to the monitors queue.
-    AssetTransferMap::iterator bundleTransferIter = FindTransferIterator(bundle->Name());
+    AssetTransferIdMap::iterator bundleTransferIter = FindTransferIterator(bundle->Name());
     if (bundleTransferIter != currentTransfers.end())
         currentTransfers.erase(bundleTransferIter);
     else
         LogWarning("AssetAPI: Asset bundle load completed, but transfer was not tracked: " + bundle->Name());
     
-    AssetBundleMonitorMap::iterator monitorIter = bundleMonitors.find(bundle->Name());
+    AssetBundleMonitorIdMap::iterator monitorIter = bundleMonitors.find(bundle->Name());
     if (monitorIter != bundleMonitors.end())
     {
         // We have no need for the monitor anymore as the AssetBundle has been added to the assetBundles map earlier for reuse.
@@ -1926,7 +1979,7 @@ void AssetAPI::AssetBundleLoadFailed(IAssetBundle *bundle)
     AssetLoadFailed(bundle->Name());
     
     // We have no need for the monitor anymore as the AssetBundle has been added to the assetBundles map earlier for reuse.
-    AssetBundleMonitorMap::iterator monitorIter = bundleMonitors.find(bundle->Name());
+    AssetBundleMonitorIdMap::iterator monitorIter = bundleMonitors.find(bundle->Name());
     if (monitorIter != bundleMonitors.end())
         bundleMonitors.erase(monitorIter);
 }
@@ -1978,7 +2031,7 @@ void AssetAPI::AssetDependenciesCompleted(AssetTransferPtr transfer)
     transfer->EmitTransferSucceeded();
 
     // This asset transfer has finished, remove it from the internal state.
-    AssetTransferMap::iterator transferIter = FindTransferIterator(transfer.get());
+    AssetTransferIdMap::iterator transferIter = FindTransferIterator(transfer.get());
     if (transferIter != currentTransfers.end())
         currentTransfers.erase(transferIter);
     PendingDownloadRequestMap::iterator downloadIter = pendingDownloadRequests.find(transfer->source.ref);
@@ -1989,21 +2042,37 @@ void AssetAPI::AssetDependenciesCompleted(AssetTransferPtr transfer)
 void AssetAPI::NotifyAssetDependenciesChanged(AssetPtr asset)
 {
     PROFILE(AssetAPI_NotifyAssetDependenciesChanged);
+    UpdateAssetDependencies(asset);
+}
 
-    /// Delete all old stored asset dependencies for this asset.
-    RemoveAssetDependencies(asset->Name());
+AssetDependencyGraph::NodeId AssetAPI::DependencyNode(const QString &assetRef) const
+{
+    AssetIdMap::const_iterator iter = assets.find(assetRef);
+    if (iter != assets.end())
+        return dependencyGraph.Intern(assets.Name(iter));
+    return dependencyGraph.Intern(ResolveAssetRef("", assetRef));
+}
+
+AssetDependencyGraph::NodeId AssetAPI::UpdateAssetDependencies(const AssetPtr &asset) const
+{
+    const AssetDependencyGraph::NodeId node = dependencyGraph.Intern(asset->Name());
 
     std::vector<AssetReference> refs = asset->FindReferences();
+    AssetDependencyGraph::NodeList dependencies;
+    dependencies.reserve(refs.size());
     for(size_t i = 0; i < refs.size(); ++i)
     {
-        // Turn named storage (and default storage) specifiers to absolute specifiers.
-        QString ref = refs[i].ref;
-        if (ref.isEmpty())
+        if (refs[i].ref.isEmpty())
+            continue;
+
+        // We silently ignore this dependency if the asset type in question is disabled.
+        if (dynamic_cast<NullAssetFactory*>(AssetTypeFactory(ResourceTypeForAssetRef(refs[i])).get()))
             continue;
 
-        // Remember this assetref for future lookup.
-        assetDependencies.push_back(std::make_pair(asset->Name(), ref));
+        dependencies.push_back(DependencyNode(refs[i].ref));
     }
+    dependencyGraph.SetDependencies(node, dependencies);
+    return node;
 }
 
 void AssetAPI::RequestAssetDependencies(AssetPtr asset)
@@ -2031,12 +2100,18 @@ void AssetAPI::RequestAssetDependencies(AssetPtr asset)
 void AssetAPI::RemoveAssetDependencies(QString asset)
 {
     PROFILE(AssetAPI_RemoveAssetDependencies);
-    for(size_t i = 0; i < assetDependencies.size(); ++i)
-        if (QString::compare(assetDependencies[i].first, asset, Qt::CaseInsensitive) == 0)
-        {
-            assetDependencies.erase(assetDependencies.begin() + i);
-            --i;
-        }
+    AssetDependencyGraph::NodeId node = dependencyGraph.Find(asset);
+    if (node != AssetDependencyGraph::cInvalidNode)
+        dependencyGraph.Remove(node);
+}
+
+AssetDependencyGraph::NodeId AssetAPI::TrackedDependencyNode(const AssetPtr &asset) const
+{
+    // The dependencies are updated when the asset loads, so only an asset that has not been seen loading yet is scanned here.
+    AssetDependencyGraph::NodeId node = dependencyGraph.Find(asset->Name());
+    if (node != AssetDependencyGraph::cInvalidNode && dependencyGraph.IsTracked(node))
+        return node;
+    return UpdateAssetDependencies(asset);
 }
 
 std::vector<AssetPtr> AssetAPI::FindDependents(QString dependee)
@@ -2044,14 +2119,18 @@ std::vector<AssetPtr> AssetAPI::FindDependents(QString dependee)
     PROFILE(AssetAPI_FindDependents);
 
     std::vector<AssetPtr> dependents;
-    for(size_t i = 0; i < assetDependencies.size(); ++i)
+    AssetDependencyGraph::NodeId node = dependencyGraph.Find(dependee);
+    if (node == AssetDependencyGraph::cInvalidNode)
+        node = dependencyGraph.Find(ResolveAssetRef("", dependee));
+    if (node == AssetDependencyGraph::cInvalidNode)
+        return dependents;
+
+    const AssetDependencyGraph::NodeList &nodes = dependencyGraph.Dependents(node);
+    for(size_t i = 0; i < nodes.size(); ++i)
     {
-        if (QString::compare(assetDependencies[i].second, dependee, Qt::CaseInsensitive) == 0)
-        {
-            AssetMap::iterator iter = assets.find(assetDependencies[i].first);
-            if (iter != assets.end())
-                dependents.push_back(iter->second);
-        }
+        AssetIdMap::iterator iter = assets.find(dependencyGraph.Name(nodes[i]));
+        if (iter != assets.end())
+            dependents.push_back(iter->second);
     }
     return dependents;
 }
@@ -2059,81 +2138,14 @@ std::vector<AssetPtr> AssetAPI::FindDependents(QString dependee)
 int AssetAPI::NumPendingDependencies(AssetPtr asset) const
 {
     PROFILE(AssetAPI_NumPendingDependencies);
-    int numDependencies = 0;
-
-    std::vector<AssetReference> refs = asset->FindReferences();
-    for(size_t i = 0; i < refs.size(); ++i)
-    {
-        QString ref = refs[i].ref;
-        if (ref.isEmpty())
-            continue;
-
-        // We silently ignore this dependency if the asset type in question is disabled.
-        if (dynamic_cast<NullAssetFactory*>(AssetTypeFactory(GetResourceTypeFromAssetRef(refs[i])).get()))
-            continue;
-
-        AssetPtr existing = FindAsset(refs[i].ref);
-        if (!existing)
-        {
-            // Not loaded, just mark the single one
-            ++numDependencies;
-        }
-        else
-        {
-            // If asset is empty, count it as an unloaded dependency
-            if (existing->IsEmpty())
-                ++numDependencies;
-            else
-            {
-                if (!existing->IsLoaded())
-                    ++numDependencies;
-                // Ask the dependencies of the dependency, we want all of the asset
-                // down the chain to be loaded before we load the base asset
-                // Note: if the dependency is unloaded, it may or may not be able to tell the dependencies correctly
-                numDependencies += NumPendingDependencies(existing);
-            }
-        }
-    }
-
-    return numDependencies;
+    return dependencyGraph.NumPendingDependenciesRecursive(TrackedDependencyNode(asset));
 }
 
 bool AssetAPI::HasPendingDependencies(AssetPtr asset) const
 {
     PROFILE(AssetAPI_HasPendingDependencies);
-
-    std::vector<AssetReference> refs = asset->FindReferences();
-    for(size_t i = 0; i < refs.size(); ++i)
-    {
-        if (refs[i].ref.isEmpty())
-            continue;
-
-        // We silently ignore this dependency if the asset type in question is disabled.
-        if (dynamic_cast<NullAssetFactory*>(AssetTypeFactory(ResourceTypeForAssetRef(refs[i])).get()))
-            continue;
-
-        AssetPtr existing = FindAsset(refs[i].ref);
-        if (!existing) // Not loaded, just mark the single one
-            return true;
-        else
-        {            
-            if (existing->IsEmpty())
-                return true; // If asset is empty, count it as an unloaded dependency
-            else
-            {
-                if (!existing->IsLoaded())
-                    return true;
-                // Ask the dependencies of the dependency, we want all of the asset
-                // down the chain to be loaded before we load the base asset
-                // Note: if the dependency is unloaded, it may or may not be able to tell the dependencies correctly
-                bool dependencyHasDependencies = HasPendingDependencies(existing);
-                if (dependencyHasDependencies)
-                    return true;
-            }
-        }
-    }
-
-    return false;
+    // Each dependency that is not complete is counted, whether it is missing, not loaded, or waiting for its own dependencies.
+    return dependencyGraph.NumPendingDependencies(TrackedDependencyNode(asset)) > 0;
 }
 
 void AssetAPI::HandleAssetDiscovery(const QString &assetRef, const QString &assetType)
@@ -2179,6 +2191,7 @@ void AssetAPI::EmitAssetStorageAdded(AssetStoragePtr newStorage)
     // from its refs whenever new assets are added to this storage from external sources.
     connect(newStorage.get(), SIGNAL(AssetChanged(QString, QString, IAssetStorage::ChangeType)),
         SLOT(OnAssetChanged(QString, QString, IAssetStorage::ChangeType)), Qt::UniqueConnection);
+    InvalidateRefCaches();
     emit AssetStorageAdded(newStorage);
 }
 
@@ -2221,6 +2234,9 @@ void AssetAPI::OnAssetLoaded(AssetPtr asset)
 {
     PROFILE(AssetAPI_OnAssetLoaded);
 
+    // The asset emits Loaded only when it has no pending dependencies, so it is now complete.
+    dependencyGraph.SetLoaded(UpdateAssetDependencies(asset), true);
+
     std::vector<AssetPtr> dependents = FindDependents(asset->Name());
     for(size_t i = 0; i < dependents.size(); ++i)
     {
@@ -2230,7 +2246,7 @@ void AssetAPI::OnAssetLoaded(AssetPtr asset)
         dependent->DependencyLoaded(asset);
 
         // Check if this dependency was the last one of the given asset's dependencies.
-        AssetTransferMap::iterator iter = currentTransfers.find(dependent->Name());
+        AssetTransferIdMap::iterator iter = currentTransfers.find(dependent->Name());
         if (iter != currentTransfers.end())
         {
             AssetTransferPtr transfer = iter->second;
@@ -2240,33 +2256,45 @@ void AssetAPI::OnAssetLoaded(AssetPtr asset)
     }
 }
 
+void AssetAPI::OnAssetUnloaded(IAsset *asset)
+{
+    AssetDependencyGraph::NodeId node = dependencyGraph.Find(asset->Name());
+    if (node != AssetDependencyGraph::cInvalidNode)
+        dependencyGraph.SetLoaded(node, false);
+}
+
 void AssetAPI::OnAssetDiskSourceChanged(const QString &path_)
 {
+    // Collect the assets first, as reloading them can request new assets, which invalidates the iterators of the asset map.
     QDir path(path_);
-    for(AssetMap::iterator iter = assets.begin(); iter != assets.end(); ++iter)
+    std::vector<AssetPtr> changedAssets;
+    for(AssetIdMap::iterator iter = assets.begin(); iter != assets.end(); ++iter)
     {
         QString assetDiskSource = iter->second->DiskSource();
         if (!assetDiskSource.isEmpty() && QDir(assetDiskSource) == path && QFile::exists(assetDiskSource))
+            changedAssets.push_back(iter->second);
+    }
+
+    for(size_t i = 0; i < changedAssets.size(); ++i)
+    {
+        AssetPtr asset = changedAssets[i];
+        AssetStoragePtr storage = asset->AssetStorage();
+        if (storage)
         {
-            AssetPtr asset = iter->second;
-            AssetStoragePtr storage = asset->AssetStorage();
-            if (storage)
+            if (storage->HasLiveUpdate())
             {
-                if (storage->HasLiveUpdate())
-                {
-                    LogInfo("AssetAPI: Detected file changes in '" + path_ + "', reloading asset.");
-                    bool success = asset->LoadFromCache();
-                    if (!success)
-                        LogError("Failed to reload changed asset \"" + asset->ToString() + "\" from file \"" + path_ + "\"!");
-                    else
-                        LogDebug("Reloaded changed asset \"" + asset->ToString() + "\" from file \"" + path_ + "\".");
-                }
-                
-                emit AssetDiskSourceChanged(asset);
+                LogInfo("AssetAPI: Detected file changes in '" + path_ + "', reloading asset.");
+                bool success = asset->LoadFromCache();
+                if (!success)
+                    LogError("Failed to reload changed asset \"" + asset->ToString() + "\" from file \"" + path_ + "\"!");
+                else
+                    LogDebug("Reloaded changed asset \"" + asset->ToString() + "\" from file \"" + path_ + "\".");
             }
-            else
-                LogError("Detected file change for a storageless asset " + asset->Name());
+            
+            emit AssetDiskSourceChanged(asset);
         }
+        else
+            LogError("Detected file change for a storageless asset " + asset->Name());
     }
 }
 
@@ -2380,12 +2408,21 @@ QString AssetAPI::ResourceTypeForAssetRef(const AssetReference &ref) const
 
 QString AssetAPI::ResourceTypeForAssetRef(QString assetRef) const
 {
-    QString filenameParsed;
-    QString subAssetFilename;
-    ParseAssetRef(assetRef, 0, 0, 0, 0, 0, 0, &filenameParsed, &subAssetFilename);
-    if (!subAssetFilename.isEmpty())
-        filenameParsed = subAssetFilename;
-    QString filename = filenameParsed.trimmed();
+    // The result depends only on the ref and the registered factories, so it can be cached until the factories change.
+    QHash<QString, QString>::const_iterator cached = resourceTypes.find(assetRef);
+    if (cached != resourceTypes.end())
+        return cached.value();
+    if (resourceTypes.size() >= cMaxCachedAssetRefs)
+        resourceTypes.clear();
+    const QString type = ResourceTypeForAssetRefUncached(assetRef);
+    resourceTypes.insert(assetRef, type);
+    return type;
+}
+
+QString AssetAPI::ResourceTypeForAssetRefUncached(const QString &assetRef) const
+{
+    const ParsedAssetRef &parsedRef = ParseAssetRefCached(assetRef);
+    const QString filename = (!parsedRef.subAssetName.isEmpty() ? parsedRef.subAssetName : parsedRef.filename).trimmed();
 
     // Query all registered asset factories if they provide this asset type.
     for(size_t i=0; i<assetTypeFactories.size(); ++i)
@@ -2424,6 +2461,27 @@ QString AssetAPI::ResourceTypeForAssetRef(QString assetRef) const
     return "Binary";
 }
 
+const AssetAPI::ParsedAssetRef &AssetAPI::ParseAssetRefCached(const QString &assetRef) const
+{
+    QHash<QString, ParsedAssetRef>::const_iterator cached = parsedRefs.find(assetRef);
+    if (cached != parsedRefs.end())
+        return cached.value();
+    if (parsedRefs.size() >= cMaxCachedAssetRefs)
+        parsedRefs.clear();
+
+    ParsedAssetRef parsed;
+    parsed.type = ParseAssetRef(assetRef, &parsed.protocolPart, &parsed.namedStorage, &parsed.protocol_Path, &parsed.path_Filename_SubAssetName,
+        &parsed.path_Filename, &parsed.path, &parsed.filename, &parsed.subAssetName, &parsed.fullRef, &parsed.fullRefNoSubAssetName);
+    return parsedRefs.insert(assetRef, parsed).value();
+}
+
+void AssetAPI::InvalidateRefCaches()
+{
+    // The parse results do not depend on the state of the Asset API, so they are kept.
+    resolvedRefs.clear();
+    resourceTypes.clear();
+}
+
 QString AssetAPI::SanitateAssetRef(const QString& input)
 {
     QString ret = input;
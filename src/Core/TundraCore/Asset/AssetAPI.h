@@ -7,6 +7,8 @@
 #include "CoreStringUtils.h"
 #include "AssetFwd.h"
 #include "IAssetStorage.h"
+#include "AssetDependencyGraph.h"
+#include "AssetRefTable.h"
 
 #include <QObject>
 #include <vector>
@@ -119,11 +121,14 @@ public:
 
     void AssetDependenciesCompleted(AssetTransferPtr transfer);
 
+    /// Updates the dependencies of the given asset. Call if the references of a loaded asset change, e.g. when it is edited in place.
+    /** The dependencies are otherwise updated only when the asset loads, not on each HasPendingDependencies or NumPendingDependencies. */
     void NotifyAssetDependenciesChanged(AssetPtr asset);
 
     bool IsHeadless() const { return isHeadless; }
 
     /// Returns all the currently loaded assets which depend on the asset dependeeAssetRef.
+    /** O(number of dependents). */
     std::vector<AssetPtr> FindDependents(QString dependeeAssetRef);
 
     /// Specifies the different possible results for AssetAPI::ResolveLocalAssetPath.
@@ -195,10 +200,10 @@ public:
 
 public slots:
     /// Returns all assets known to the asset system.
-    AssetMap Assets() const { return assets; }
+    AssetMap Assets() const { return assets.ToNameMap<AssetMap>(); }
 
     /// Returns all asset bundles known to the asset system.
-    AssetBundleMap AssetBundles() const { return assetBundles; }
+    AssetBundleMap AssetBundles() const { return assetBundles.ToNameMap<AssetBundleMap>(); }
 
     /// Returns all assets of a specific type.
     AssetMap AssetsOfType(const QString& type) const;
@@ -412,11 +417,13 @@ public slots:
     void RequestAssetDependencies(AssetPtr transfer);
 
     /// A utility function that counts the number of dependencies the given asset has to other assets that have not been loaded in.
+    /** The whole dependency chain is counted, and each asset in it only once. */
     int NumPendingDependencies(AssetPtr asset) const;
 
     /// A utility function that returns true if the given asset still has some unloaded dependencies left to process.
     /// @note For performance reasons, calling this function is highly advisable instead of calling NumPendingDependencies, if it is only
-    ///       desirable to known whether the asset has any pending dependencies or not.
+    ///       desirable to known whether the asset has any pending dependencies or not. This function is O(1), as the dependencies
+    ///       and their completeness are tracked incrementally as the assets load.
     bool HasPendingDependencies(AssetPtr asset) const;
 
     /// Handle discovery of a new asset through the AssetDiscovery network message
@@ -432,13 +439,13 @@ public slots:
     void EmitAssetStorageAdded(AssetStoragePtr newStorage);
 
     /// Return current asset transfers
-    AssetTransferMap CurrentTransfers() const { return currentTransfers; }
+    AssetTransferMap CurrentTransfers() const { return currentTransfers.ToNameMap<AssetTransferMap>(); }
 
     /// A utility function that counts the number of current asset transfers.
     size_t NumCurrentTransfers() const { return currentTransfers.size(); }
     
     /// Return the current asset dependency map (debugging)
-    const AssetDependenciesMap& DebugGetAssetDependencies() const { return assetDependencies; }
+    AssetDependenciesMap DebugGetAssetDependencies() const { return dependencyGraph.Edges(); }
     
     /// Return ready asset transfers (debugging)
     const std::vector<AssetTransferPtr>& DebugGetReadyTransfers() const { return readyTransfers; }
@@ -502,6 +509,9 @@ private slots:
     /// The Asset API listens on each asset when they get loaded, to track the completion of the dependencies of other loaded assets.
     void OnAssetLoaded(AssetPtr asset);
 
+    /// Marks the asset incomplete for the dependency tracking.
+    void OnAssetUnloaded(IAsset *asset);
+
     /// The Asset API reloads all assets from file when their disk source contents change.
     void OnAssetDiskSourceChanged(const QString &path);
 
@@ -515,15 +525,61 @@ private slots:
     void AssetBundleLoadFailed(IAssetBundle *bundle);
 
 private:
-    AssetTransferMap::iterator FindTransferIterator(QString assetRef);
-    AssetTransferMap::const_iterator FindTransferIterator(QString assetRef) const;
+    /// The internal asset maps, keyed by the interned refs. The public functions return the corresponding maps keyed by the ref strings.
+    typedef AssetRefHashMap<AssetPtr> AssetIdMap;
+    typedef AssetRefHashMap<AssetTransferPtr> AssetTransferIdMap;
+    typedef AssetRefHashMap<AssetBundlePtr> AssetBundleIdMap;
+    typedef AssetRefHashMap<AssetBundleMonitorPtr> AssetBundleMonitorIdMap;
+
+    /// The result of ParseAssetRef for each of its out parameters.
+    struct ParsedAssetRef
+    {
+        AssetRefType type;
+        QString protocolPart;
+        QString namedStorage;
+        QString protocol_Path;
+        QString path_Filename_SubAssetName;
+        QString path_Filename;
+        QString path;
+        QString filename;
+        QString subAssetName;
+        QString fullRef;
+        QString fullRefNoSubAssetName;
+    };
+
+    /// Returns the result of ParseAssetRef for the given ref from the parse cache, parsing the ref on the first call.
+    /** The returned reference is valid until the next call. */
+    const ParsedAssetRef &ParseAssetRefCached(const QString &assetRef) const;
+
+    /// Does the work of ResolveAssetRef after the lookups to the existing assets and the cache.
+    QString ResolveAssetRefUncached(const QString &context, QString assetRef) const;
+
+    /// Does the work of ResourceTypeForAssetRef after the lookup to the cache.
+    QString ResourceTypeForAssetRefUncached(const QString &assetRef) const;
+
+    /// Clears the caches of ResolveAssetRef and ResourceTypeForAssetRef. Called when the storages or the asset type factories change.
+    void InvalidateRefCaches();
 
-    AssetTransferMap::iterator FindTransferIterator(IAssetTransfer *transfer);
-    AssetTransferMap::const_iterator FindTransferIterator(IAssetTransfer *transfer) const;
+    AssetTransferIdMap::iterator FindTransferIterator(QString assetRef);
+    AssetTransferIdMap::const_iterator FindTransferIterator(QString assetRef) const;
 
-    /// Removes from AssetDependenciesMap all dependencies the given asset has.
+    AssetTransferIdMap::iterator FindTransferIterator(IAssetTransfer *transfer);
+    AssetTransferIdMap::const_iterator FindTransferIterator(IAssetTransfer *transfer) const;
+
+    /// Removes the given asset from the dependency graph, along with all dependencies it has.
+    /** Assets that depend on it keep it as a pending dependency. */
     void RemoveAssetDependencies(QString asset);
 
+    /// Returns the dependency graph node of the given asset ref. Uses the name of an existing asset if there is one, otherwise the resolved ref.
+    AssetDependencyGraph::NodeId DependencyNode(const QString &assetRef) const;
+
+    /// Updates the dependencies of the given asset in the dependency graph from IAsset::FindReferences, and returns the node of the asset.
+    /** Called when the asset has loaded, see AssetLoadCompleted and OnAssetLoaded, and from NotifyAssetDependenciesChanged. */
+    AssetDependencyGraph::NodeId UpdateAssetDependencies(const AssetPtr &asset) const;
+
+    /// Returns the dependency graph node of the given asset, scanning its dependencies only if they are not tracked yet.
+    AssetDependencyGraph::NodeId TrackedDependencyNode(const AssetPtr &asset) const;
+
     /// Handle discovery of a new asset, when the storage is already known. This is used internally for optimization, so that providers don't need to be queried
     void HandleAssetDiscovery(const QString &assetRef, const QString &assetType, AssetStoragePtr storage);
     
@@ -538,19 +594,28 @@ private:
 
     bool isHeadless;
 
+    /// Interns the keys of the asset maps. Declared before the maps, as they refer to it.
+    AssetRefTable assetRefs;
+
+    /// Maps asset ref strings to their parsed forms, and to the results of ResolveAssetRef with no context and ResourceTypeForAssetRef.
+    /** The same refs are requested over and over by the components, so the parsing is done only once for each. */
+    mutable QHash<QString, ParsedAssetRef> parsedRefs;
+    mutable QHash<QString, QString> resolvedRefs;
+    mutable QHash<QString, QString> resourceTypes;
+
     /// Stores all the currently ongoing asset transfers.
-    AssetTransferMap currentTransfers;
+    AssetTransferIdMap currentTransfers;
 
     /// Stores all the currently ongoing asset bundle monitors.
-    AssetBundleMonitorMap bundleMonitors;
+    AssetBundleMonitorIdMap bundleMonitors;
 
     typedef std::map<QString, AssetUploadTransferPtr, QStringLessThanNoCase> AssetUploadTransferMap;
     /// Stores all the currently ongoing asset uploads, maps full assetRefs to the asset upload transfer structures.
     AssetUploadTransferMap currentUploadTransfers;
 
-    /// Keeps track of all the dependencies each asset has to each other asset.
-    /// \todo Find a more effective data structure for this. Needs something like boost::bimap but for multi-indices.
-    AssetDependenciesMap assetDependencies;
+    /// Keeps track of all the dependencies each asset has to each other asset, and which assets are complete.
+    /// Mutable, as the const queries add the assets that have not been seen loading yet.
+    mutable AssetDependencyGraph dependencyGraph;
 
     /// Stores a list of asset requests to assets that have already been downloaded into the system. These requests don't go to the asset providers
     /// to process, but are internally filled by the Asset API. This member vector is needed to be able to delay the requests and virtual completions
@@ -584,10 +649,10 @@ private:
     PendingDownloadRequestMap pendingDownloadRequests;
 
     /// Stores all the already loaded assets in the system.
-    AssetMap assets;
+    AssetIdMap assets;
 
     /// Stores all the already loaded asset bundles in the system.
-    AssetBundleMap assetBundles;
+    AssetBundleIdMap assetBundles;
 
     /// Tracks all loaded assets if their DiskSources change, and issues a reload of the assets.
     QFileSystemWatcher *diskSourceChangeWatcher;
@@ -12,7 +12,7 @@ template<typename T>
 std::vector<shared_ptr<T> > AssetAPI::AssetsOfType() const
 {
     std::vector<shared_ptr<T> > ret;
-    for(AssetMap::const_iterator i = assets.begin(); i != assets.end(); ++i)
+    for(AssetIdMap::const_iterator i = assets.begin(); i != assets.end(); ++i)
     {
         shared_ptr<T> asset = dynamic_pointer_cast<T>(i->second);
         if (asset)
@@ -0,0 +1,192 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "AssetDependencyGraph.h"
+
+#include <algorithm>
+
+#include "MemoryLeakCheck.h"
+
+AssetDependencyGraph::NodeId AssetDependencyGraph::Intern(const QString &assetName)
+{
+    const QString key = assetName.toLower();
+    QHash<QString, NodeId>::const_iterator iter = ids.find(key);
+    if (iter != ids.end())
+        return iter.value();
+
+    NodeId node;
+    if (!freeNodes.empty())
+    {
+        node = freeNodes.back();
+        freeNodes.pop_back();
+    }
+    else
+    {
+        node = (NodeId)nodes.size();
+        nodes.push_back(Node());
+    }
+    nodes[node].name = assetName;
+    ids.insert(key, node);
+    return node;
+}
+
+AssetDependencyGraph::NodeId AssetDependencyGraph::Find(const QString &assetName) const
+{
+    QHash<QString, NodeId>::const_iterator iter = ids.find(assetName.toLower());
+    return iter != ids.end() ? iter.value() : cInvalidNode;
+}
+
+bool AssetDependencyGraph::SetDependencies(NodeId node, NodeList dependencies)
+{
+    std::sort(dependencies.begin(), dependencies.end());
+    dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+
+    Node &n = nodes[node];
+    n.tracked = true;
+    if (dependencies == n.dependencies)
+        return false;
+
+    const bool wasComplete = IsComplete(node);
+
+    // Both lists are sorted, so walk them side by side to find the removed and the added dependencies.
+    const NodeList &old = n.dependencies;
+    NodeList removed;
+    size_t i = 0, j = 0;
+    while(i < old.size() || j < dependencies.size())
+    {
+        if (j >= dependencies.size() || (i < old.size() && old[i] < dependencies[j]))
+        {
+            NodeList &dependents = nodes[old[i]].dependents;
+            NodeList::iterator iter = std::find(dependents.begin(), dependents.end(), node);
+            if (iter != dependents.end())
+            {
+                *iter = dependents.back();
+                dependents.pop_back();
+            }
+            if (!IsComplete(old[i]))
+                --n.numPending;
+            removed.push_back(old[i]);
+            --numEdges;
+            ++i;
+        }
+        else if (i >= old.size() || dependencies[j] < old[i])
+        {
+            nodes[dependencies[j]].dependents.push_back(node);
+            if (!IsComplete(dependencies[j]))
+                ++n.numPending;
+            ++numEdges;
+            ++j;
+        }
+        else
+        {
+            ++i;
+            ++j;
+        }
+    }
+    n.dependencies.swap(dependencies);
+
+    if (IsComplete(node) != wasComplete)
+        PropagateCompleteness(node, !wasComplete);
+    for(size_t k = 0; k < removed.size(); ++k)
+        FreeIfUnused(removed[k]);
+    return true;
+}
+
+void AssetDependencyGraph::Remove(NodeId node)
+{
+    RemoveDependencies(node);
+    SetLoaded(node, false);
+    nodes[node].tracked = false;
+    FreeIfUnused(node);
+}
+
+void AssetDependencyGraph::FreeIfUnused(NodeId node)
+{
+    Node &n = nodes[node];
+    if (n.tracked || n.loaded || !n.dependents.empty())
+        return;
+    // Untracked nodes have no dependencies, and a node that nothing depends on is not counted as pending anywhere.
+    ids.remove(n.name.toLower());
+    n = Node();
+    freeNodes.push_back(node);
+}
+
+void AssetDependencyGraph::SetLoaded(NodeId node, bool loaded)
+{
+    if (nodes[node].loaded == loaded)
+        return;
+    const bool wasComplete = IsComplete(node);
+    nodes[node].loaded = loaded;
+    if (IsComplete(node) != wasComplete)
+        PropagateCompleteness(node, !wasComplete);
+}
+
+void AssetDependencyGraph::PropagateCompleteness(NodeId node, bool complete)
+{
+    std::vector<std::pair<NodeId, bool> > stack;
+    stack.push_back(std::make_pair(node, complete));
+    while(!stack.empty())
+    {
+        const NodeId changed = stack.back().first;
+        const bool becameComplete = stack.back().second;
+        stack.pop_back();
+
+        const NodeList &dependents = nodes[changed].dependents;
+        for(size_t i = 0; i < dependents.size(); ++i)
+        {
+            const NodeId dependent = dependents[i];
+            const bool wasComplete = IsComplete(dependent);
+            nodes[dependent].numPending += becameComplete ? -1 : 1;
+            if (IsComplete(dependent) != wasComplete)
+                stack.push_back(std::make_pair(dependent, !wasComplete));
+        }
+    }
+}
+
+int AssetDependencyGraph::NumPendingDependenciesRecursive(NodeId node) const
+{
+    // Complete nodes have no pending dependencies down their chain, so the walk only needs to enter incomplete nodes.
+    std::vector<bool> visited(nodes.size(), false);
+    NodeList stack;
+    stack.push_back(node);
+    visited[node] = true;
+    int numPending = 0;
+    while(!stack.empty())
+    {
+        const Node &n = nodes[stack.back()];
+        stack.pop_back();
+        if (n.numPending == 0)
+            continue;
+        for(size_t i = 0; i < n.dependencies.size(); ++i)
+        {
+            const NodeId dependency = n.dependencies[i];
+            if (visited[dependency] || IsComplete(dependency))
+                continue;
+            visited[dependency] = true;
+            if (!nodes[dependency].loaded)
+                ++numPending;
+            stack.push_back(dependency);
+        }
+    }
+    return numPending;
+}
+
+std::vector<std::pair<QString, QString> > AssetDependencyGraph::Edges() const
+{
+    std::vector<std::pair<QString, QString> > edges;
+    edges.reserve(numEdges);
+    for(size_t i = 0; i < nodes.size(); ++i)
+        for(size_t j = 0; j < nodes[i].dependencies.size(); ++j)
+            edges.push_back(std::make_pair(nodes[i].name, nodes[nodes[i].dependencies[j]].name));
+    return edges;
+}
+
+void AssetDependencyGraph::Clear()
+{
+    nodes.clear();
+    freeNodes.clear();
+    ids.clear();
+    numEdges = 0;
+}
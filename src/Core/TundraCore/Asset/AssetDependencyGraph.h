@@ -0,0 +1,122 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+
+#include <QString>
+#include <QHash>
+
+#include <vector>
+#include <utility>
+
+/// Tracks the dependencies between assets, and which assets are ready to be used by their dependents.
+/** Asset names are interned to integer node ids, case-insensitively. Each node stores both its dependencies and its dependents,
+    so finding the dependents of an asset is O(number of dependents).
+
+    An asset is complete when it has been loaded, and all of its dependencies are complete. Each node stores the number of its
+    direct dependencies that are not complete, and these counters are updated incrementally as the assets load and unload:
+    a change in the completeness of an asset touches only its direct dependents, and further only the dependents whose completeness
+    changes as a result.
+
+    Assets that are part of a dependency cycle never become complete.
+
+    A node stands for an asset once its dependencies have been set, see IsTracked. Other nodes are only names that assets refer to.
+    Removing the node of a forgotten asset keeps it as a pending dependency while other nodes still depend on it. A node that
+    is neither tracked, loaded nor depended on is freed, and its id is reused.
+
+    Used internally by AssetAPI. */
+class TUNDRACORE_API AssetDependencyGraph
+{
+public:
+    typedef int NodeId;
+    typedef std::vector<NodeId> NodeList;
+
+    /// Denotes an invalid node id.
+    static const NodeId cInvalidNode = -1;
+
+    AssetDependencyGraph() : numEdges(0) {}
+
+    /// Returns the node id of the given asset name, creating a new node if one does not exist.
+    /** Node ids of freed nodes are reused, so do not keep ids of nodes that may be freed. */
+    NodeId Intern(const QString &assetName);
+
+    /// Returns the node id of the given asset name, or cInvalidNode if the name is not known.
+    NodeId Find(const QString &assetName) const;
+
+    /// Returns the asset name of the given node, in the case it was first interned with.
+    const QString &Name(NodeId node) const { return nodes[node].name; }
+
+    /// Replaces the dependencies of the given node, and marks it tracked.
+    /** Duplicates in @c dependencies are ignored. Dependencies that are dropped are freed if nothing else keeps them.
+        @return True if the dependencies changed. */
+    bool SetDependencies(NodeId node, NodeList dependencies);
+
+    /// Removes all dependencies of the given node. The node keeps its dependents.
+    void RemoveDependencies(NodeId node) { SetDependencies(node, NodeList()); }
+
+    /// Returns true if the dependencies of the given node have been set, and it has not been removed since.
+    bool IsTracked(NodeId node) const { return nodes[node].tracked; }
+
+    /// Removes the asset of the given node: drops its dependencies and marks it not loaded.
+    /** The node is freed unless other nodes depend on it, in which case it stays as their pending dependency. */
+    void Remove(NodeId node);
+
+    /// Returns the direct dependencies of the given node.
+    const NodeList &Dependencies(NodeId node) const { return nodes[node].dependencies; }
+
+    /// Returns the direct dependents of the given node, i.e. the nodes that have this node as a dependency.
+    const NodeList &Dependents(NodeId node) const { return nodes[node].dependents; }
+
+    /// Sets whether the asset of the given node is loaded, and propagates the change of completeness to the dependents.
+    void SetLoaded(NodeId node, bool loaded);
+
+    /// Returns whether the asset of the given node is loaded.
+    bool IsLoaded(NodeId node) const { return nodes[node].loaded; }
+
+    /// Returns true if the asset of the given node is loaded, and all of its dependencies are complete.
+    bool IsComplete(NodeId node) const { return nodes[node].loaded && nodes[node].numPending == 0; }
+
+    /// Returns the number of direct dependencies of the given node that are not complete. O(1).
+    int NumPendingDependencies(NodeId node) const { return nodes[node].numPending; }
+
+    /// Returns the number of distinct assets down the dependency chain of the given node that are not loaded.
+    /** Each asset is counted once, even if it is reachable through several paths. O(size of the incomplete part of the dependency chain). */
+    int NumPendingDependenciesRecursive(NodeId node) const;
+
+    /// Returns all dependencies as (dependent, dependency) name pairs. For debugging.
+    std::vector<std::pair<QString, QString> > Edges() const;
+
+    /// Returns the number of interned asset names.
+    size_t NumNodes() const { return nodes.size() - freeNodes.size(); }
+
+    /// Returns the number of dependencies between the nodes.
+    size_t NumEdges() const { return numEdges; }
+
+    /// Removes all nodes.
+    void Clear();
+
+private:
+    struct Node
+    {
+        Node() : loaded(false), tracked(false), numPending(0) {}
+
+        QString name;
+        NodeList dependencies; ///< Sorted.
+        NodeList dependents; ///< Unordered.
+        bool loaded;
+        bool tracked;
+        int numPending; ///< Number of dependencies that are not complete.
+    };
+
+    /// Adjusts the pending counters of the dependents of a node whose completeness changed, and so on down the chain.
+    void PropagateCompleteness(NodeId node, bool complete);
+
+    /// Frees the given node if it is not tracked or loaded, and nothing depends on it.
+    void FreeIfUnused(NodeId node);
+
+    std::vector<Node> nodes;
+    NodeList freeNodes; ///< Ids of the freed nodes, reused by Intern.
+    QHash<QString, NodeId> ids; ///< Maps lowercase asset names to node ids.
+    size_t numEdges;
+};
@@ -0,0 +1,93 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "AssetRefTable.h"
+
+#include "MemoryLeakCheck.h"
+
+AssetRefTable::AssetRefTable()
+{
+    entries.push_back(Entry());
+}
+
+AssetRefId AssetRefTable::Intern(const QString &ref)
+{
+    AssetRefId id = Find(ref);
+    if (id.IsValid())
+        return id;
+
+    u32 newId;
+    if (!freeIds.empty())
+    {
+        newId = freeIds.back();
+        freeIds.pop_back();
+    }
+    else
+    {
+        newId = (u32)entries.size();
+        entries.push_back(Entry());
+    }
+    Entry &entry = entries[newId];
+    entry.name = ref;
+    entry.spellings << ref;
+    folded.insert(ref.toLower(), newId);
+    spellings.insert(ref, newId);
+    return AssetRefId(newId);
+}
+
+AssetRefId AssetRefTable::Find(const QString &ref) const
+{
+    QHash<QString, u32>::const_iterator iter = spellings.find(ref);
+    if (iter != spellings.end())
+        return AssetRefId(iter.value());
+
+    iter = folded.find(ref.toLower());
+    if (iter == folded.end())
+        return AssetRefId();
+
+    // Remember this spelling, so that the next lookup with it does not need to fold the case.
+    spellings.insert(ref, iter.value());
+    entries[iter.value()].spellings << ref;
+    return AssetRefId(iter.value());
+}
+
+const QString &AssetRefTable::Name(AssetRefId ref) const
+{
+    return ref.Id() < entries.size() ? entries[ref.Id()].name : entries[0].name;
+}
+
+void AssetRefTable::AddRef(AssetRefId ref)
+{
+    if (ref.IsValid() && ref.Id() < entries.size())
+        ++entries[ref.Id()].refCount;
+}
+
+void AssetRefTable::Release(AssetRefId ref)
+{
+    if (!ref.IsValid() || ref.Id() >= entries.size())
+        return;
+
+    Entry &entry = entries[ref.Id()];
+    if (entry.refCount > 0 && --entry.refCount == 0)
+        Remove(ref.Id());
+}
+
+void AssetRefTable::Remove(u32 id)
+{
+    Entry &entry = entries[id];
+    folded.remove(entry.name.toLower());
+    foreach(const QString &spelling, entry.spellings)
+        spellings.remove(spelling);
+    entry = Entry();
+    freeIds.push_back(id);
+}
+
+void AssetRefTable::Clear()
+{
+    entries.resize(1);
+    freeIds.clear();
+    folded.clear();
+    spellings.clear();
+}
@@ -0,0 +1,188 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "CoreTypes.h"
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+
+#include <vector>
+
+/// Compact handle to an asset reference interned in an AssetRefTable.
+/** Two handles from the same table are equal if and only if the refs they were interned from are equal case-insensitively. */
+class AssetRefId
+{
+public:
+    AssetRefId() : id(0) {}
+    explicit AssetRefId(u32 id_) : id(id_) {}
+
+    /// Returns false for the default-constructed handle, which does not refer to any ref.
+    bool IsValid() const { return id != 0; }
+    /// Returns the integer value of the handle.
+    u32 Id() const { return id; }
+
+    bool operator ==(const AssetRefId &rhs) const { return id == rhs.id; }
+    bool operator !=(const AssetRefId &rhs) const { return id != rhs.id; }
+    bool operator <(const AssetRefId &rhs) const { return id < rhs.id; }
+
+    /// Hash functor for using AssetRefId as a key of unordered_map.
+    struct Hash
+    {
+        size_t operator()(const AssetRefId &ref) const { return (size_t)ref.id; }
+    };
+
+private:
+    u32 id;
+};
+
+/// Interns asset reference strings to AssetRefIds.
+/** The refs are case-folded before interning, so the lookups are case-insensitive like with QStringLessThanNoCase.
+    Each distinct spelling of a ref that has been looked up is remembered, so that a repeated lookup costs a single
+    hash of the string, without the temporary lowercase copy.
+
+    The elements of AssetRefHashMaps hold their refs with AddRef. When the last element of a ref is erased, the ref,
+    its folded key and its spellings are forgotten, and its handle is reused for a later ref. A handle is therefore
+    only valid while an element holds it.
+
+    Used internally by AssetAPI. */
+class TUNDRACORE_API AssetRefTable
+{
+public:
+    AssetRefTable();
+
+    /// Returns the handle of the given ref, interning the ref if it is not yet known.
+    AssetRefId Intern(const QString &ref);
+
+    /// Returns the handle of the given ref, or an invalid handle if the ref is not known.
+    AssetRefId Find(const QString &ref) const;
+
+    /// Returns the ref of the given handle, in the case it was first interned with.
+    const QString &Name(AssetRefId ref) const;
+
+    /// Adds a holder to the ref of the given handle.
+    void AddRef(AssetRefId ref);
+
+    /// Removes a holder added with AddRef. Forgets the ref when it has no holders left.
+    void Release(AssetRefId ref);
+
+    /// Returns the number of distinct refs in the table.
+    size_t Size() const { return entries.size() - 1 - freeIds.size(); }
+
+    /// Returns the number of spellings remembered for the refs in the table.
+    size_t NumSpellings() const { return spellings.size(); }
+
+    /// Forgets all refs. All previously returned handles become invalid.
+    void Clear();
+
+private:
+    struct Entry
+    {
+        Entry() : refCount(0) {}
+
+        QString name; ///< The ref in the case it was first interned with. Empty if the id is free.
+        int refCount; ///< Number of AddRef calls without a Release.
+        mutable QStringList spellings; ///< Keys of this ref in spellings, so that they can be removed with the ref.
+    };
+
+    /// Forgets the ref of the given id and frees the id.
+    void Remove(u32 id);
+
+    std::vector<Entry> entries; ///< Indexed by AssetRefId::Id. Index 0 is reserved for the invalid handle.
+    std::vector<u32> freeIds; ///< Ids of removed refs, reused by Intern.
+    QHash<QString, u32> folded; ///< Maps the lowercase refs to their ids.
+    mutable QHash<QString, u32> spellings; ///< Maps each spelling of a ref seen in a lookup to its id.
+};
+
+/// Hash map keyed by AssetRefId, which can also be accessed with ref strings through an AssetRefTable.
+/** Replaces std::map<QString, T, QStringLessThanNoCase> for the internal asset maps of AssetAPI. Note that unlike with std::map,
+    inserting to the map can invalidate all iterators of the map. Each element holds its ref in the AssetRefTable, so the
+    elements must be inserted and erased through the functions of this class, not those of the base class. */
+template <typename T>
+class AssetRefHashMap : public unordered_map<AssetRefId, T, AssetRefId::Hash>
+{
+public:
+    typedef unordered_map<AssetRefId, T, AssetRefId::Hash> Base;
+    typedef typename Base::iterator iterator;
+    typedef typename Base::const_iterator const_iterator;
+    typedef typename Base::size_type size_type;
+
+    explicit AssetRefHashMap(AssetRefTable *refTable) : refs(refTable) {}
+
+    using Base::find;
+
+    /// Returns the element of the given ref, or end() if there is none. Does not intern the ref.
+    iterator find(const QString &ref)
+    {
+        AssetRefId id = refs->Find(ref);
+        return id.IsValid() ? Base::find(id) : Base::end();
+    }
+    const_iterator find(const QString &ref) const /**< @overload */
+    {
+        AssetRefId id = refs->Find(ref);
+        return id.IsValid() ? Base::find(id) : Base::end();
+    }
+
+    /// Returns the element of the given ref, inserting a default-constructed element if there is none.
+    T &operator[](const QString &ref) { return operator[](refs->Intern(ref)); }
+    T &operator[](AssetRefId id) /**< @overload */
+    {
+        std::pair<iterator, bool> inserted = Base::insert(typename Base::value_type(id, T()));
+        if (inserted.second)
+            refs->AddRef(id);
+        return inserted.first->second;
+    }
+
+    /// Erases the element pointed to by the given iterator.
+    void erase(iterator iter)
+    {
+        AssetRefId id = iter->first;
+        Base::erase(iter);
+        refs->Release(id);
+    }
+
+    /// Erases the element of the given ref, if there is one.
+    size_type erase(AssetRefId id)
+    {
+        size_type erased = Base::erase(id);
+        if (erased)
+            refs->Release(id);
+        return erased;
+    }
+    size_type erase(const QString &ref) /**< @overload */
+    {
+        AssetRefId id = refs->Find(ref);
+        return id.IsValid() ? erase(id) : 0;
+    }
+
+    /// Erases all elements.
+    void clear()
+    {
+        for(const_iterator iter = Base::begin(); iter != Base::end(); ++iter)
+            refs->Release(iter->first);
+        Base::clear();
+    }
+
+    /// Returns the ref of the element pointed to by the given iterator.
+    const QString &Name(const_iterator iter) const { return refs->Name(iter->first); }
+
+    /// Returns a copy of the map keyed by the ref strings, for the public AssetAPI functions.
+    template <typename NameMap>
+    NameMap ToNameMap() const
+    {
+        NameMap ret;
+        for(const_iterator iter = Base::begin(); iter != Base::end(); ++iter)
+            ret[refs->Name(iter->first)] = iter->second;
+        return ret;
+    }
+
+private:
+    // Inserting or copying without holding the refs would let the table forget refs that are still in use.
+    using Base::insert;
+    AssetRefHashMap(const AssetRefHashMap &);
+    void operator =(const AssetRefHashMap &);
+
+    AssetRefTable *refs;
+};
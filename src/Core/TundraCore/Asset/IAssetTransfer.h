@@ -42,6 +42,10 @@ public:
     /// Specifies the storage this asset is being downloaded from.
     AssetStorageWeakPtr storage;
 
+    /// Priority of the transfer. Providers that queue their transfers serve the ones with higher priority first. Default: 0.
+    /** Can be changed after the transfer has been requested, as long as it has not been started yet. */
+    int priority;
+
     /// Emits Downloaded signal.
     void EmitAssetDownloaded();
 
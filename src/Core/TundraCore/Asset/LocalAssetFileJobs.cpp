@@ -0,0 +1,166 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "LocalAssetFileJobs.h"
+
+#include <QMutexLocker>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDirIterator>
+
+#include <algorithm>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    /// Number of found paths after which the scan hands out a batch.
+    const int cScanBatchSize = 256;
+
+    /// Returns true for the names of version control files and directories, which are left out of the storage index.
+    bool IsVersionControlName(const QString &name)
+    {
+        return name.contains(".git") || name.contains(".svn") || name.contains(".hg");
+    }
+}
+
+void LocalFileReadQueue::JobStarted()
+{
+    QMutexLocker lock(&mutex);
+    ++numPending;
+}
+
+void LocalFileReadQueue::Push(const LocalFileReadPtr &read)
+{
+    QMutexLocker lock(&mutex);
+    completed.push_back(read);
+}
+
+void LocalFileReadQueue::TakeCompleted(std::vector<LocalFileReadPtr> &out)
+{
+    QMutexLocker lock(&mutex);
+    out.insert(out.end(), completed.begin(), completed.end());
+    numPending -= (int)completed.size();
+    completed.clear();
+}
+
+int LocalFileReadQueue::NumPending() const
+{
+    QMutexLocker lock(&mutex);
+    return numPending;
+}
+
+LocalFileReadJob::LocalFileReadJob(const LocalFileReadQueuePtr &queue, const LocalFileReadPtr &read) :
+    queue_(queue),
+    read_(read)
+{
+    // Make sure this worker object is deleted by QThreadPool once run() completes.
+    setAutoDelete(true);
+}
+
+void LocalFileReadJob::run()
+{
+    // Note: no logging here, LoggingFunctions must only be used from the main thread. The provider reports the errors.
+    read_->result = LocalFileRead::NotFound;
+    for(int i = 0; i < read_->candidates.size(); ++i)
+    {
+        QFileInfo info(read_->candidates[i]);
+        if (!info.isFile())
+            continue;
+
+        read_->candidateIndex = i;
+        read_->result = LocalFileRead::ReadFailed;
+
+        QFile file(read_->candidates[i]);
+        if (file.open(QIODevice::ReadOnly))
+        {
+            const qint64 fileSize = file.size();
+            read_->data.resize((size_t)std::max<qint64>(fileSize, 0));
+            if (fileSize <= 0 || file.read((char*)&read_->data[0], fileSize) == fileSize)
+                read_->result = LocalFileRead::Succeeded;
+            else
+                read_->data.clear();
+        }
+        break;
+    }
+    queue_->Push(read_);
+}
+
+void LocalStorageScan::Cancel()
+{
+    QMutexLocker lock(&mutex);
+    canceled = true;
+}
+
+bool LocalStorageScan::IsCanceled() const
+{
+    QMutexLocker lock(&mutex);
+    return canceled;
+}
+
+void LocalStorageScan::PushBatch(QStringList &files, QStringList &dirs)
+{
+    QMutexLocker lock(&mutex);
+    foundFiles.append(files);
+    foundDirs.append(dirs);
+    files.clear();
+    dirs.clear();
+}
+
+void LocalStorageScan::Finish()
+{
+    QMutexLocker lock(&mutex);
+    finished = true;
+}
+
+bool LocalStorageScan::TakeBatches(QStringList &files, QStringList &dirs)
+{
+    QMutexLocker lock(&mutex);
+    files.append(foundFiles);
+    dirs.append(foundDirs);
+    foundFiles.clear();
+    foundDirs.clear();
+    return finished;
+}
+
+LocalStorageScanJob::LocalStorageScanJob(const LocalStorageScanPtr &scan, const QString &directory, bool recursive) :
+    scan_(scan),
+    directory_(directory),
+    recursive_(recursive)
+{
+    setAutoDelete(true);
+}
+
+void LocalStorageScanJob::run()
+{
+    QStringList files;
+    QStringList dirs;
+    QStringList pendingDirs;
+    pendingDirs.append(directory_);
+    while(!pendingDirs.isEmpty() && !scan_->IsCanceled())
+    {
+        QDirIterator it(pendingDirs.takeLast(), QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+        while(it.hasNext())
+        {
+            const QString path = it.next();
+            if (IsVersionControlName(it.fileName()))
+                continue;
+            if (it.fileInfo().isDir())
+            {
+                dirs.append(path);
+                if (recursive_)
+                    pendingDirs.append(path);
+            }
+            else
+                files.append(path);
+        }
+
+        if (files.size() + dirs.size() >= cScanBatchSize)
+            scan_->PushBatch(files, dirs);
+    }
+    scan_->PushBatch(files, dirs);
+    scan_->Finish();
+}
@@ -0,0 +1,133 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "CoreTypes.h"
+
+#include <QRunnable>
+#include <QMutex>
+#include <QStringList>
+
+#include <vector>
+
+/// Describes a read of one local asset file, performed on a worker thread.
+/** The candidate filenames are tried in order, and the first one that exists is read. This way the probing
+    of the storage directories for a relative asset ref is done on the worker thread as well. */
+struct LocalFileRead
+{
+    /// The outcome of the read.
+    enum Result
+    {
+        Pending, ///< The read has not completed yet.
+        NotFound, ///< None of the candidate files exist.
+        ReadFailed, ///< A candidate file exists, but reading it failed.
+        Succeeded ///< A candidate file was read to 'data'.
+    };
+
+    LocalFileRead() : id(0), result(Pending), candidateIndex(-1) {}
+
+    /// Identifies the read in LocalAssetProvider.
+    u32 id;
+
+    /// Absolute filenames to try, in order.
+    QStringList candidates;
+
+    Result result;
+
+    /// Index of the candidate that was found, or -1 if none was found.
+    int candidateIndex;
+
+    /// Contents of the file, if the read succeeded.
+    std::vector<u8> data;
+};
+typedef shared_ptr<LocalFileRead> LocalFileReadPtr;
+
+/// Thread-safe queue of completed local file reads, shared between LocalAssetProvider and its worker jobs.
+/** The jobs keep the queue alive, so the provider can be destroyed while it still has jobs in flight. */
+class TUNDRACORE_API LocalFileReadQueue
+{
+public:
+    LocalFileReadQueue() : numPending(0) {}
+
+    /// Called on the main thread when a job is started.
+    void JobStarted();
+
+    /// Called from the worker thread when a job has completed.
+    void Push(const LocalFileReadPtr &read);
+
+    /// Appends all completed reads to 'out'. Called on the main thread.
+    void TakeCompleted(std::vector<LocalFileReadPtr> &out);
+
+    /// Returns the number of jobs that have been started but whose results have not yet been taken.
+    int NumPending() const;
+
+private:
+    mutable QMutex mutex;
+    std::vector<LocalFileReadPtr> completed;
+    int numPending;
+};
+typedef shared_ptr<LocalFileReadQueue> LocalFileReadQueuePtr;
+
+/// Threaded local file read. Used internally by LocalAssetProvider.
+class TUNDRACORE_API LocalFileReadJob : public QRunnable
+{
+public:
+    LocalFileReadJob(const LocalFileReadQueuePtr &queue, const LocalFileReadPtr &read);
+
+    /// QRunnable override.
+    virtual void run();
+
+private:
+    LocalFileReadQueuePtr queue_;
+    LocalFileReadPtr read_;
+};
+
+/// The state of a background directory scan of a LocalAssetStorage, shared between the storage and the worker job.
+/** The worker hands out the found files and directories in batches, so that the storage can index them incrementally
+    while the scan is still running. */
+class TUNDRACORE_API LocalStorageScan
+{
+public:
+    LocalStorageScan() : canceled(false), finished(false) {}
+
+    /// Asks the worker to stop the scan as soon as possible. Called on the main thread.
+    void Cancel();
+
+    /// Returns true if the scan has been canceled.
+    bool IsCanceled() const;
+
+    /// Hands out a batch of found files and directories, and clears the given lists. Called from the worker thread.
+    void PushBatch(QStringList &files, QStringList &dirs);
+
+    /// Marks the scan finished. Called from the worker thread.
+    void Finish();
+
+    /// Appends the files and directories found since the last call to the given lists. Called on the main thread.
+    /** @return True if the scan has finished, and all of its results have been taken. */
+    bool TakeBatches(QStringList &files, QStringList &dirs);
+
+private:
+    mutable QMutex mutex;
+    QStringList foundFiles;
+    QStringList foundDirs;
+    bool canceled;
+    bool finished;
+};
+typedef shared_ptr<LocalStorageScan> LocalStorageScanPtr;
+
+/// Threaded directory scan. Used internally by LocalAssetStorage.
+/** Lists the files and the directories under the given directory, skipping version control directories. */
+class TUNDRACORE_API LocalStorageScanJob : public QRunnable
+{
+public:
+    LocalStorageScanJob(const LocalStorageScanPtr &scan, const QString &directory, bool recursive);
+
+    /// QRunnable override.
+    virtual void run();
+
+private:
+    LocalStorageScanPtr scan_;
+    QString directory_;
+    bool recursive_;
+};
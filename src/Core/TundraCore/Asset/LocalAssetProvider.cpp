@@ -25,17 +25,35 @@
 #include <QFileSystemWatcher>
 #include <QMap>
 
+#include <algorithm>
+
 #include "MemoryLeakCheck.h"
 
+namespace
+{
+    /// Number of worker threads reading the asset files.
+    const int cNumReadThreads = 4;
+    /// Maximum number of file reads handed to the worker threads at a time. The rest of the downloads wait in the priority order.
+    const int cMaxReadsInProgress = 16;
+}
+
 LocalAssetProvider::LocalAssetProvider(Framework* framework_) :
-    framework(framework_)
+    framework(framework_),
+    readQueue(MAKE_SHARED(LocalFileReadQueue)),
+    nextReadId(1)
 {
     enableRequestsOutsideStorages = (framework_->HasCommandLineParameter("--acceptUnknownLocalSources") ||
         framework_->HasCommandLineParameter("--accept_unknown_local_sources"));  /**< @todo Remove support for the deprecated underscore version at some point. */
+
+    readThreads.setMaxThreadCount(cNumReadThreads);
+    scanThreads.setMaxThreadCount(1);
 }
 
 LocalAssetProvider::~LocalAssetProvider()
 {
+    // The thread pools wait for their jobs when destroyed, so stop the scans, which may take long.
+    for(size_t i = 0; i < storages.size(); ++i)
+        storages[i]->CancelScan();
 }
 
 QString LocalAssetProvider::Name() const
@@ -83,8 +101,10 @@ AssetTransferPtr LocalAssetProvider::RequestAsset(QString assetRef, QString asse
     transfer->source.ref = assetRef.trimmed();
     transfer->assetType = assetType;
     transfer->diskSourceType = IAsset::Original; // The disk source represents the original authoritative source for the asset.
-    
-    pendingDownloads.push_back(transfer);
+
+    PendingDownload download;
+    download.transfer = transfer;
+    pendingDownloads.push_back(download);
 
     return transfer;
 }
@@ -94,9 +114,9 @@ bool LocalAssetProvider::AbortTransfer(IAssetTransfer *transfer)
     if (!transfer)
         return false;
 
-    for (std::vector<AssetTransferPtr>::iterator iter = pendingDownloads.begin(); iter != pendingDownloads.end(); ++iter)
+    for (std::vector<PendingDownload>::iterator iter = pendingDownloads.begin(); iter != pendingDownloads.end(); ++iter)
     {
-        AssetTransferPtr ongoingTransfer = (*iter);
+        AssetTransferPtr ongoingTransfer = iter->transfer;
         if (ongoingTransfer.get() == transfer)
         {
             framework->Asset()->AssetTransferAborted(transfer);
@@ -106,6 +126,18 @@ bool LocalAssetProvider::AbortTransfer(IAssetTransfer *transfer)
             return true;
         }
     }
+
+    // If the file is already being read, the result of the read is discarded when it completes.
+    for (QHash<u32, ReadInProgress>::iterator iter = readsInProgress.begin(); iter != readsInProgress.end(); ++iter)
+    {
+        AssetTransferPtr ongoingTransfer = iter->download.transfer;
+        if (ongoingTransfer.get() == transfer)
+        {
+            readsInProgress.erase(iter);
+            framework->Asset()->AssetTransferAborted(transfer);
+            return true;
+        }
+    }
     return false;
 }
 
@@ -170,7 +202,10 @@ void LocalAssetProvider::Update(f64 /*frametime*/)
     /// asset into the same asset storage. If the download request was processed before the upload request, the download
     /// request would fail on missing file, and the entity would erroneously get an "asset not found" result.
     CompletePendingFileUploads();
+    for(size_t i = 0; i < storages.size(); ++i)
+        storages[i]->UpdateScan();
     CompletePendingFileDownloads();
+    StartPendingFileDownloads();
     CheckForPendingFileSystemChanges();
 }
 
@@ -205,6 +240,7 @@ bool LocalAssetProvider::RemoveAssetStorage(QString storageName)
     for(size_t i = 0; i < storages.size(); ++i)
         if (storages[i]->name.compare(storageName, Qt::CaseInsensitive) == 0)
         {
+            storages[i]->CancelScan();
             storages.erase(storages.begin() + i);
             return true;
         }
@@ -252,7 +288,7 @@ LocalAssetStoragePtr LocalAssetProvider::AddStorageDirectory(QString directory,
 #ifndef ANDROID
     if (!framework->HasCommandLineParameter("--noFileWatcher"))
     {
-        storage->SetupWatcher(); // Start listening on file change notifications. Note: it's important that recursive is set before calling this!
+        storage->SetupEmptyWatcher(); // Start listening on file change notifications. The contents of the storage are added to the watch list by the scan below.
         connect(storage->changeWatcher, SIGNAL(directoryChanged(const QString&)), SLOT(OnDirectoryChanged(const QString &)), Qt::UniqueConnection);
         connect(storage->changeWatcher, SIGNAL(fileChanged(const QString &)), SLOT(OnFileChanged(const QString &)), Qt::UniqueConnection);
     }
@@ -262,9 +298,9 @@ LocalAssetStoragePtr LocalAssetProvider::AddStorageDirectory(QString directory,
     // Tell the Asset API that we have created a new storage.
     framework->Asset()->EmitAssetStorageAdded(storage);
 
-    // If autodiscovery is on, make the storage refresh itself immediately.
-    if (storage->AutoDiscoverable())
-        storage->RefreshAssetRefs();
+    // Index the storage in the background, so that adding a big storage does not block. If autodiscovery is on,
+    // the storage emits AssetChanged(AssetCreate) for the files as they are found. Note: it's important that recursive is set before calling this!
+    storage->StartScan(&scanThreads);
 
     return storage;
 }
@@ -304,83 +340,173 @@ AssetUploadTransferPtr LocalAssetProvider::UploadAssetFromFileInMemory(const u8
     return transfer;
 }
 
-void LocalAssetProvider::CompletePendingFileDownloads()
+bool LocalAssetProvider::HasHigherPriority(const PendingDownload &a, const PendingDownload &b)
+{
+    return a.transfer->priority > b.transfer->priority;
+}
+
+bool LocalAssetProvider::IsScanningStorages() const
+{
+    for(size_t i = 0; i < storages.size(); ++i)
+        if (storages[i]->IsScanning())
+            return true;
+    return false;
+}
+
+void LocalAssetProvider::StartFileRead(const PendingDownload &download)
+{
+    AssetTransferPtr transfer = download.transfer;
+    QString ref = transfer->source.ref;
+
+    QString path_filename;
+    AssetAPI::AssetRefType refType = AssetAPI::ParseAssetRef(ref.trimmed(), 0, 0, 0, 0, &path_filename);
+
+    LocalFileReadPtr read = MAKE_SHARED(LocalFileRead);
+    read->id = nextReadId++;
+    ReadInProgress progress;
+    progress.download = download;
+
+    // Resolve the candidate filenames without touching the disk. The worker thread reads the first one of them that exists.
+    if (refType == AssetAPI::AssetRefLocalPath || AssetAPI::ParseAssetRef(path_filename) == AssetAPI::AssetRefLocalPath) // 'file://C:/path/to/asset/asset.png'.
+    {
+        read->candidates.append(QFileInfo(path_filename).absoluteFilePath());
+        progress.candidateStorages.push_back(LocalAssetStoragePtr());
+    }
+    else // Using a local relative path, like "local://asset.ref" or "asset.ref".
+    {
+        // Check first all storage directories without recursion, then the files known to be in their subdirectories.
+        for(size_t i = 0; i < storages.size(); ++i)
+        {
+            read->candidates.append(QFileInfo(GuaranteeTrailingSlash(storages[i]->directory) + path_filename).absoluteFilePath());
+            progress.candidateStorages.push_back(storages[i]);
+        }
+        for(size_t i = 0; i < storages.size(); ++i)
+        {
+            if (!storages[i]->recursive)
+                continue;
+            std::map<QString, QString, QStringLessThanNoCase>::const_iterator iter = storages[i]->cachedFiles.find(path_filename);
+            if (iter != storages[i]->cachedFiles.end())
+            {
+                read->candidates.append(QFileInfo(iter->second).absoluteFilePath());
+                progress.candidateStorages.push_back(storages[i]);
+            }
+        }
+    }
+
+    if (read->candidates.isEmpty())
+    {
+        framework->Asset()->AssetTransferFailed(transfer.get(), "Failed to find local asset with filename \"" + ref + "\"!");
+        return;
+    }
+
+    readsInProgress.insert(read->id, progress);
+    readQueue->JobStarted();
+    readThreads.start(new LocalFileReadJob(readQueue, read));
+}
+
+void LocalAssetProvider::StartPendingFileDownloads()
 {
     // If we have any uploads running, first wait for each of them to complete, until we download any more.
     // This is because we might want to download the same asset that we uploaded, so they must be done in
     // the proper order.
-    if (pendingUploads.size() > 0)
+    if (pendingUploads.size() > 0 || pendingDownloads.empty() || readsInProgress.size() >= cMaxReadsInProgress)
         return;
 
+    PROFILE(LocalAssetProvider_StartPendingFileDownloads);
+
+    // Take the queue aside, since failing a transfer may cause new requests to be made.
+    std::vector<PendingDownload> queued;
+    queued.swap(pendingDownloads);
+    std::stable_sort(queued.begin(), queued.end(), &LocalAssetProvider::HasHigherPriority); // Stable, so that requests of equal priority are served in order.
+
+    const bool scanning = IsScanningStorages();
+    std::vector<PendingDownload> waiting;
+    size_t i = 0;
+    for(; i < queued.size() && readsInProgress.size() < cMaxReadsInProgress; ++i)
+    {
+        if (queued[i].waitForScan && scanning)
+            waiting.push_back(queued[i]);
+        else
+            StartFileRead(queued[i]);
+    }
+
+    waiting.insert(waiting.end(), queued.begin() + i, queued.end());
+    waiting.insert(waiting.end(), pendingDownloads.begin(), pendingDownloads.end());
+    pendingDownloads.swap(waiting);
+}
+
+void LocalAssetProvider::CompletePendingFileDownloads()
+{
+    readQueue->TakeCompleted(completedReads);
+
     const int maxLoadMSecs = 16;
     tick_t startTime = GetCurrentClockTime();
 
-    while(pendingDownloads.size() > 0)
+    size_t numProcessed = 0;
+    while(numProcessed < completedReads.size())
     {
         PROFILE(LocalAssetProvider_ProcessPendingDownload);
 
-        AssetTransferPtr transfer = pendingDownloads.back();
-        pendingDownloads.pop_back();
-            
-        QString ref = transfer->source.ref;
-
-        QString path_filename;
-        AssetAPI::AssetRefType refType = AssetAPI::ParseAssetRef(ref.trimmed(), 0, 0, 0, 0, &path_filename);
-
-        LocalAssetStoragePtr storage;
+        LocalFileReadPtr read = completedReads[numProcessed++];
+        QHash<u32, ReadInProgress>::iterator iter = readsInProgress.find(read->id);
+        if (iter == readsInProgress.end())
+            continue; // The transfer was aborted while the file was being read.
+        ReadInProgress progress = iter.value();
+        readsInProgress.erase(iter);
 
-        QFileInfo file;
+        AssetTransferPtr transfer = progress.download.transfer;
+        QString ref = transfer->source.ref;
 
-        if (refType == AssetAPI::AssetRefLocalPath)
-        {
-            file = QFileInfo(path_filename);
-        }
-        else // Using a local relative path, like "local://asset.ref" or "asset.ref".
+        if (read->result == LocalFileRead::NotFound)
         {
-            AssetAPI::AssetRefType urlRefType = AssetAPI::ParseAssetRef(path_filename);
-            if (urlRefType == AssetAPI::AssetRefLocalPath)
-                file = QFileInfo(path_filename); // 'file://C:/path/to/asset/asset.png'.
-            else // The ref is of form 'file://relativePath/asset.png'.
+            // A relative ref may point to a subdirectory of a recursive storage that has not been indexed yet. If so,
+            // retry once the scans are done. Storages without a change watcher are rescanned, once per request,
+            // since their index is not kept up to date.
+            const bool relativeRef = !progress.candidateStorages.empty() && progress.candidateStorages.front();
+            PendingDownload retry = progress.download;
+            if (relativeRef && !retry.rescanned && !IsScanningStorages())
             {
-                QString path = GetPathForAsset(path_filename, &storage);
-                if (path.isEmpty())
-                {
-                    QString reason = "Failed to find local asset with filename \"" + ref + "\"!";
-                    framework->Asset()->AssetTransferFailed(transfer.get(), reason);
-                    // Also throttle asset loading here. This is needed in the case we have a lot of failed refs.
-                    //if (GetCurrentClockTime() - startTime >= GetCurrentClockFreq() * maxLoadMSecs / 1000)
-                    //    break;
-                    continue;
-                }
-            
-                file = QFileInfo(GuaranteeTrailingSlash(path) + path_filename);
+                for(size_t i = 0; i < storages.size(); ++i)
+                    if (storages[i]->recursive && !storages[i]->changeWatcher)
+                    {
+                        storages[i]->StartScan(&scanThreads);
+                        retry.rescanned = true;
+                    }
+            }
+            if (relativeRef && IsScanningStorages())
+            {
+                retry.waitForScan = true;
+                pendingDownloads.push_back(retry);
+                continue;
             }
-        }
-        QString absoluteFilename = file.absoluteFilePath();
 
-        bool success = LoadFileToVector(absoluteFilename, transfer->rawAssetData);
-        if (!success)
+            QString reason = "Failed to find local asset with filename \"" + ref + "\"!";
+            framework->Asset()->AssetTransferFailed(transfer.get(), reason);
+        }
+        else if (read->result != LocalFileRead::Succeeded)
         {
-            QString reason = "Failed to read asset data for asset \"" + ref + "\" from file \"" + absoluteFilename + "\"";
+            QString reason = "Failed to read asset data for asset \"" + ref + "\" from file \"" + read->candidates[read->candidateIndex] + "\"";
             framework->Asset()->AssetTransferFailed(transfer.get(), reason);
-            // Also throttle asset loading here. This is needed in the case we have a lot of failed refs.
-            if (GetCurrentClockTime() - startTime >= GetCurrentClockFreq() * maxLoadMSecs / 1000)
-                break;
-            continue;
         }
-        
-        // Tell the Asset API that this asset should not be cached into the asset cache, and instead the original filename should be used
-        // as a disk source, rather than generating a cache file for it.
-        transfer->SetCachingBehavior(false, absoluteFilename);
-        transfer->storage = storage;
+        else
+        {
+            transfer->rawAssetData.swap(read->data);
 
-        // Signal the Asset API that this asset is now successfully downloaded.
-        framework->Asset()->AssetTransferCompleted(transfer.get());
+            // Tell the Asset API that this asset should not be cached into the asset cache, and instead the original filename should be used
+            // as a disk source, rather than generating a cache file for it.
+            transfer->SetCachingBehavior(false, read->candidates[read->candidateIndex]);
+            transfer->storage = progress.candidateStorages[read->candidateIndex];
 
-        // Throttle asset loading to at most 16 msecs/frame.
+            // Signal the Asset API that this asset is now successfully downloaded.
+            framework->Asset()->AssetTransferCompleted(transfer.get());
+        }
+
+        // Throttle asset loading to at most 16 msecs/frame. This is also needed in the case we have a lot of failed refs.
         if (GetCurrentClockTime() - startTime >= GetCurrentClockFreq() * maxLoadMSecs / 1000)
             break;
     }
+
+    completedReads.erase(completedReads.begin(), completedReads.begin() + numProcessed);
 }
 
 AssetStoragePtr LocalAssetProvider::TryDeserializeStorageFromString(const QString &storage, bool /*fromNetwork*/)
@@ -5,8 +5,11 @@
 #include "TundraCoreApi.h"
 #include "IAssetProvider.h"
 #include "AssetFwd.h"
+#include "LocalAssetFileJobs.h"
 
 #include <QSet>
+#include <QHash>
+#include <QThreadPool>
 
 /// Provides access to files on the local file system using the 'local://' URL specifier.
 class TUNDRACORE_API LocalAssetProvider : public QObject, public IAssetProvider, public enable_shared_from_this<LocalAssetProvider>
@@ -71,9 +74,41 @@ private:
     /// @param storage [out] Receives the local storage that contains the asset.
     QString GetPathForAsset(const QString &localFilename, LocalAssetStoragePtr *storage) const;
 
-    /// Takes all the pending file download transfers and finishes them.
+    /// A download that has not yet been handed to a worker thread.
+    struct PendingDownload
+    {
+        PendingDownload() : waitForScan(false), rescanned(false) {}
+
+        AssetTransferPtr transfer;
+        /// If true, the file was not found while the storages were still being scanned, so retry once the scans are done.
+        bool waitForScan;
+        /// If true, the storages have already been rescanned for this download.
+        bool rescanned;
+    };
+
+    /// A download whose file is being read on a worker thread.
+    struct ReadInProgress
+    {
+        PendingDownload download;
+        /// The storage of each candidate filename of the read, or null for the filenames outside the storages.
+        std::vector<LocalAssetStoragePtr> candidateStorages;
+    };
+
+    /// Returns true if the pending download a should be started before b.
+    static bool HasHigherPriority(const PendingDownload &a, const PendingDownload &b);
+
+    /// Starts reading the file of the given download on a worker thread.
+    void StartFileRead(const PendingDownload &download);
+
+    /// Hands the pending downloads to the worker threads in the order of priority, keeping the number of reads in progress bounded.
+    void StartPendingFileDownloads();
+
+    /// Takes the completed file reads and finishes their transfers.
     void CompletePendingFileDownloads();
 
+    /// Returns true if any of the storages is being scanned in the background.
+    bool IsScanningStorages() const;
+
     /// Takes all the pending file upload transfers and finishes them.
     void CompletePendingFileUploads();
 
@@ -83,7 +118,13 @@ private:
     Framework *framework;
     std::vector<LocalAssetStoragePtr> storages; ///< Asset directories to search, may be recursive or not
     std::vector<AssetUploadTransferPtr> pendingUploads; ///< The following asset uploads are pending to be completed by this provider.
-    std::vector<AssetTransferPtr> pendingDownloads; ///< The following asset downloads are pending to be completed by this provider.
+    std::vector<PendingDownload> pendingDownloads; ///< The following asset downloads are waiting for a free worker.
+    QHash<u32, ReadInProgress> readsInProgress; ///< The downloads being read on the worker threads, keyed by LocalFileRead::id.
+    std::vector<LocalFileReadPtr> completedReads; ///< Completed reads whose transfers have not yet been finished.
+    LocalFileReadQueuePtr readQueue; ///< Receives the completed reads from the worker threads.
+    u32 nextReadId; ///< Id of the next LocalFileRead.
+    QThreadPool readThreads; ///< Worker threads for the file reads.
+    QThreadPool scanThreads; ///< Worker thread for the background storage scans.
     QSet<QString> changedFiles; ///< Pending file changes.
     QSet<QString> changedDirectories; ///< Pending directory changes.
 
@@ -12,6 +12,7 @@
 #include "LoggingFunctions.h"
 
 #include <QFileSystemWatcher>
+#include <QThreadPool>
 #include <QDir>
 #include <utility>
 
@@ -29,6 +30,7 @@ LocalAssetStorage::LocalAssetStorage(bool writable_, bool liveUpdate_, bool auto
 
 LocalAssetStorage::~LocalAssetStorage()
 {
+    CancelScan();
     RemoveWatcher();
 }
 
@@ -67,23 +69,26 @@ void LocalAssetStorage::CacheStorageContents()
 {
     cachedFiles.clear();
 
-    foreach(QString str, DirectorySearch(directory, recursive, QDir::Files | QDir::NoDotAndDotDot | QDir::NoSymLinks))
+    foreach(const QString &str, DirectorySearch(directory, recursive, QDir::Files | QDir::NoDotAndDotDot | QDir::NoSymLinks))
         if (!(str.contains(".git") || str.contains(".svn") || str.contains(".hg")))
-        {
-            QString diskSource = str;
-            int lastSlash = str.lastIndexOf('/');
-            if (lastSlash != -1)
-                str = str.right(str.length() - lastSlash - 1);
-            QString localName = str;
+            AddToCache(str);
+}
 
+void LocalAssetStorage::AddToCache(const QString &diskSource)
+{
+    QString localName = diskSource;
+    int lastSlash = localName.lastIndexOf('/');
+    if (lastSlash != -1)
+        localName = localName.right(localName.length() - lastSlash - 1);
+
+    std::map<QString, QString, QStringLessThanNoCase>::iterator iter = cachedFiles.find(localName);
 ///\todo This is an often-received error condition if the user is not aware, but also occurs naturally in built-in Ogre Media storages.
 /// Fix this check to occur somehow nicer (without additional constraints to asset load time) without a hardcoded check
 /// against the storage name.
-            if (Name() != "Ogre Media" && cachedFiles.find(localName) != cachedFiles.end())
-                LogWarning("Warning: Asset Storage \"" + Name() + "\" contains ambiguous assets \"" + cachedFiles[localName] + "\" and \"" + diskSource + "\" in two different subdirectories!");
+    if (Name() != "Ogre Media" && iter != cachedFiles.end() && iter->second != diskSource)
+        LogWarning("Warning: Asset Storage \"" + Name() + "\" contains ambiguous assets \"" + iter->second + "\" and \"" + diskSource + "\" in two different subdirectories!");
 
-            cachedFiles[localName] = diskSource;
-        }
+    cachedFiles[localName] = diskSource;
 }
 
 QString LocalAssetStorage::GetFullPathForAsset(const QString &assetname, bool recursiveLookup)
@@ -95,7 +100,8 @@ QString LocalAssetStorage::GetFullPathForAsset(const QString &assetname, bool re
     std::map<QString, QString, QStringLessThanNoCase>::iterator iter = cachedFiles.find(assetname);
     if (iter == cachedFiles.end())
     {
-        if (!recursive || !recursiveLookup)
+        // While the background scan is running, the index will be completed by it, so do not block on a directory search of our own.
+        if (!recursive || !recursiveLookup || IsScanning())
             return "";
         else
             CacheStorageContents();
@@ -146,15 +152,23 @@ void LocalAssetStorage::EmitAssetChanged(QString absoluteFilename, IAssetStorage
     if (assetRefs.contains(assetRef) && change == IAssetStorage::AssetCreate)
         LogDebug("LocalAssetStorage::EmitAssetChanged: Emitting AssetCreate signal for already existing asset " + assetRef +
             ", file " + absoluteFilename + ". Asset was probably removed and then added back.");
+
+    // Keep the cached index up to date, so that it does not need to be rebuilt when the contents of the storage change.
+    if (change == IAssetStorage::AssetCreate)
+        AddToCache(absoluteFilename);
+    else if (change == IAssetStorage::AssetDelete)
+    {
+        std::map<QString, QString, QStringLessThanNoCase>::iterator iter = cachedFiles.find(localName);
+        if (iter != cachedFiles.end() && iter->second == absoluteFilename)
+            cachedFiles.erase(iter);
+    }
+
     emit AssetChanged(localName, absoluteFilename, change);
 }
 
 void LocalAssetStorage::SetupWatcher()
 {
-    if (changeWatcher) // Remove the old watcher if one exists.
-        RemoveWatcher();
-
-    changeWatcher = new QFileSystemWatcher();
+    SetupEmptyWatcher();
 
     // Add directory contents to watch list.
     if (recursive)
@@ -170,7 +184,6 @@ void LocalAssetStorage::SetupWatcher()
 
     QStringList paths = DirectorySearch(directory, recursive, QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot | QDir::NoSymLinks);
 #ifndef Q_WS_MAC
-    changeWatcher->addPath(QDir::fromNativeSeparators(directory));
     changeWatcher->addPaths(paths);
 #endif
 
@@ -181,3 +194,83 @@ void LocalAssetStorage::RemoveWatcher()
 {
     SAFE_DELETE(changeWatcher);
 }
+
+void LocalAssetStorage::SetupEmptyWatcher()
+{
+    if (changeWatcher) // Remove the old watcher if one exists.
+        RemoveWatcher();
+
+    changeWatcher = new QFileSystemWatcher();
+#ifndef Q_WS_MAC
+    changeWatcher->addPath(QDir::fromNativeSeparators(directory));
+#endif
+}
+
+void LocalAssetStorage::StartScan(QThreadPool *threadPool)
+{
+    if (scan)
+        return;
+
+    LogDebug("LocalAssetStorage: Scanning " + directory + " recursive=" + BoolToString(recursive) + " in the background.");
+    scan = MAKE_SHARED(LocalStorageScan);
+    scanKnownRefs = assetRefs.toSet();
+    threadPool->start(new LocalStorageScanJob(scan, directory, recursive));
+}
+
+void LocalAssetStorage::UpdateScan()
+{
+    if (!scan)
+        return;
+
+    PROFILE(LocalAssetStorage_UpdateScan);
+    QStringList files;
+    QStringList dirs;
+    const bool finished = scan->TakeBatches(files, dirs);
+
+#ifndef Q_WS_MAC
+    if (changeWatcher)
+    {
+        if (!dirs.isEmpty())
+            changeWatcher->addPaths(dirs);
+        if (!files.isEmpty())
+            changeWatcher->addPaths(files);
+    }
+#endif
+
+    foreach(const QString &diskSource, files)
+    {
+        AddToCache(diskSource);
+
+        if (AutoDiscoverable())
+        {
+            QString localName = diskSource;
+            int lastSlash = localName.lastIndexOf('/');
+            if (lastSlash != -1)
+                localName = localName.right(localName.length() - lastSlash - 1);
+            QString assetRef = "local://" + localName;
+            if (!scanKnownRefs.contains(assetRef))
+            {
+                scanKnownRefs.insert(assetRef);
+                assetRefs.append(assetRef);
+                emit AssetChanged(localName, diskSource, IAssetStorage::AssetCreate);
+            }
+        }
+    }
+
+    if (finished)
+    {
+        LogDebug("LocalAssetStorage: Finished scanning " + directory + ", " + QString::number(cachedFiles.size()) + " files indexed.");
+        scan.reset();
+        scanKnownRefs.clear();
+    }
+}
+
+void LocalAssetStorage::CancelScan()
+{
+    if (scan)
+    {
+        scan->Cancel();
+        scan.reset();
+        scanKnownRefs.clear();
+    }
+}
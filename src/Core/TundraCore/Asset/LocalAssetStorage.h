@@ -5,10 +5,13 @@
 #include "TundraCoreApi.h"
 #include "IAssetStorage.h"
 #include "CoreStringUtils.h"
+#include "LocalAssetFileJobs.h"
 
 #include <QMap>
+#include <QSet>
 
 class QFileSystemWatcher;
+class QThreadPool;
 class AssetAPI;
 
 /// Represents a single (possibly recursive) directory on the local file system.
@@ -36,6 +39,23 @@ public:
     /// Stops and deallocates the directory change listener.
     void RemoveWatcher();
 
+    /// Starts listening on the storage directory itself. The contents are added to the watch list by the background scan.
+    void SetupEmptyWatcher();
+
+    /// Starts a background scan of the storage directory on the given thread pool, unless a scan is already running.
+    /** The found files are added to the cached index, and to the watch list if there is one. If the storage is autodiscoverable,
+        AssetChanged(AssetCreate) is also emitted for each new file, like in RefreshAssetRefs. The results are merged in UpdateScan. */
+    void StartScan(QThreadPool *threadPool);
+
+    /// Merges the results of the background scan that have become available since the last call. Called each frame by LocalAssetProvider.
+    void UpdateScan();
+
+    /// Stops the background scan, if one is running.
+    void CancelScan();
+
+    /// Returns true if a background scan is running. While it is, the cached index of the storage is incomplete.
+    bool IsScanning() const { return scan.get() != 0; }
+
     /// Load all assets of specific suffix
     void LoadAllAssetsOfType(AssetAPI *assetAPI, const QString &suffix, const QString &assetType);
 
@@ -90,6 +110,15 @@ public slots:
 private:
     friend class LocalAssetProvider;
 
+    /// Adds the given file to the cached index, warning about ambiguous filenames.
+    void AddToCache(const QString &diskSource);
+
+    /// The background scan in progress, or null if there is none.
+    LocalStorageScanPtr scan;
+
+    /// The refs of assetRefs as a set, for checking the scanned files against them quickly. Valid while a scan is running.
+    QSet<QString> scanKnownRefs;
+
     /// Maps a file basename 'asset.mesh' to its full path 'c:\project\assets\asset.mesh'.
     /// Used to quickly lookup known assets by basename instead of having to do an expensive recursive directory search.
     std::map<QString, QString, QStringLessThanNoCase> cachedFiles;
@@ -7,6 +7,8 @@
 #include "AudioAPI.h"
 #include "AudioAsset.h"
 #include "SoundChannel.h"
+#include "SoundBackend.h"
+#include "SoundSourcePool.h"
 
 #include "CoreDefines.h"
 #include "CoreTypes.h"
@@ -33,6 +35,9 @@
 
 using namespace std;
 
+/// The most sources taken for sound channels. The quietest channels beyond these play virtually.
+static const int cMaxSoundSources = 64;
+
 struct AudioAPI::Impl
 {
     Impl() :
@@ -43,6 +48,7 @@ struct AudioAPI::Impl
         device(0),
         captureDevice(0),
         captureSampleSize(0),
+        backend(0),
         nextChannelId(0),
         masterGain(1.f)
     {
@@ -61,6 +67,10 @@ struct AudioAPI::Impl
     ALCdevice *captureDevice;
     /// Capture sample size
     uint captureSampleSize;
+    /// Backend the sources are played with
+    SoundBackend *backend;
+    /// Sources shared by the channels
+    SoundSourcePoolPtr sourcePool;
     /// Active channels
     SoundChannelMap channels;
     /// Next channel id
@@ -138,6 +148,8 @@ bool AudioAPI::Initialize(const QString &playbackDeviceName)
     if (!playbackDeviceName.isEmpty())
         LogInfo("Opened OpenAL playback device '" + playbackDeviceName + "'.");
 
+    impl->backend = new OpenALSoundBackend(impl->device);
+    impl->sourcePool = MAKE_SHARED(SoundSourcePool, impl->backend, min(impl->backend->MaxSources(), cMaxSoundSources));
     impl->initialized = true;
     
 #endif
@@ -183,6 +195,9 @@ void AudioAPI::Uninitialize()
     StopRecording();
 
     impl->channels.clear();
+    // Channels that are still referenced elsewhere lose their source with the pool
+    impl->sourcePool.reset();
+    SAFE_DELETE(impl->backend);
 
 #ifndef TUNDRA_NO_AUDIO
     if (impl->context)
@@ -216,30 +231,30 @@ std::vector<SoundChannelPtr> AudioAPI::ActiveSounds() const
     return ret;
 }
 
-void AudioAPI::Update(f64 /*frametime*/)
+void AudioAPI::Update(f64 frametime)
 {
     if (!impl->initialized)
         return;
     
-#ifndef TUNDRA_NO_AUDIO
     PROFILE(AudioAPI_Update);
 
 //        mutex.lock();
     std::vector<SoundChannelMap::iterator> channelsToDelete;
 
     // Update listener position/orientation to sound device
-    ALfloat pos[] = {impl->listenerPosition.x, impl->listenerPosition.y, impl->listenerPosition.z};
-    alListenerfv(AL_POSITION, pos);
-    float3 front = impl->listenerOrientation * float3(0.0f, -1.0f, 0.0f);
-    float3 up = impl->listenerOrientation * float3(0.0f, 0.0f, -1.0f);
-    ALfloat orient[] = {front.x, front.y, front.z, up.x, up.y, up.z};
-    alListenerfv(AL_ORIENTATION, orient);
-
-    // Update channel attenuations, check which have stopped
+    impl->backend->SetListener(impl->listenerPosition, impl->listenerOrientation);
+
+    // Attenuate all channels at once, and choose the channels that play through a source.
+    // The channels that became virtual give up their sources first, so that the others can take them in the same update.
+    impl->sourcePool->Update(impl->listenerPosition);
+    for(SoundChannelMap::iterator i = impl->channels.begin(); i != impl->channels.end(); ++i)
+        i->second->YieldSource();
+
+    // Play or advance the channels, check which have stopped
     SoundChannelMap::iterator i = impl->channels.begin();
     while(i != impl->channels.end())
     {
-        i->second->Update(impl->listenerPosition);
+        i->second->Update(frametime);
         if (i->second->State() == SoundChannel::Stopped)
         {
             channelsToDelete.push_back(i);
@@ -252,7 +267,6 @@ void AudioAPI::Update(f64 /*frametime*/)
         impl->channels.erase(channelsToDelete[j]);
 
  //   mutex.unlock();
-#endif
 }
 
 bool AudioAPI::IsInitialized() const
@@ -260,6 +274,11 @@ bool AudioAPI::IsInitialized() const
     return impl->initialized;
 }
 
+SoundVoiceStats AudioAPI::VoiceStats() const
+{
+    return impl->sourcePool ? impl->sourcePool->Stats() : SoundVoiceStats();
+}
+
 void AudioAPI::SaveSoundSettingsToConfig()
 {
     if (IsInitialized())
@@ -343,7 +362,7 @@ SoundChannelPtr AudioAPI::PlaySound(const AssetPtr &audioAsset, SoundChannel::So
     if (!channel)
     {
         sound_id_t newId = NextSoundChannelID();
-        channel = MAKE_SHARED(SoundChannel, newId, type);
+        channel = MAKE_SHARED(SoundChannel, newId, type, impl->sourcePool);
         impl->channels.insert(make_pair(newId, channel));
     }
 
@@ -362,7 +381,7 @@ SoundChannelPtr AudioAPI::PlaySound3D(const float3 &position, const AssetPtr &au
     if (!channel)
     {
         sound_id_t newId = NextSoundChannelID();
-        channel = MAKE_SHARED(SoundChannel, newId, type);
+        channel = MAKE_SHARED(SoundChannel, newId, type, impl->sourcePool);
         impl->channels.insert(make_pair(newId, channel));
     }
 
@@ -382,7 +401,7 @@ SoundChannelPtr AudioAPI::PlaySoundBuffer(const SoundBuffer &buffer, SoundChanne
     if (!channel)
     {
         sound_id_t newId = NextSoundChannelID();
-        channel = MAKE_SHARED(SoundChannel, newId, type);
+        channel = MAKE_SHARED(SoundChannel, newId, type, impl->sourcePool);
         impl->channels.insert(make_pair(newId, channel));
     }
 
@@ -403,7 +422,7 @@ SoundChannelPtr AudioAPI::PlaySoundBuffer3D(const SoundBuffer &buffer, SoundChan
     if (!channel)
     {
         sound_id_t newId = NextSoundChannelID();
-        channel = MAKE_SHARED(SoundChannel, newId, type);
+        channel = MAKE_SHARED(SoundChannel, newId, type, impl->sourcePool);
         impl->channels.insert(make_pair(newId, channel));
     }
 
@@ -6,6 +6,7 @@
 #include "AssetFwd.h"
 #include "AudioAsset.h"
 #include "SoundChannel.h"
+#include "SoundSourcePool.h"
 #include "Math/float3.h"
 #include "Math/Quat.h"
 
@@ -63,6 +64,9 @@ public:
     /// Returns initialized status
     bool IsInitialized() const;
 
+    /// Returns the counts of sound channels playing through a source and virtually, and of the sources in use.
+    SoundVoiceStats VoiceStats() const;
+
     /// Saves sound settings to config.
     void SaveSoundSettingsToConfig();
 
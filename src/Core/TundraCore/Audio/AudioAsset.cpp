@@ -24,7 +24,7 @@
 #include "MemoryLeakCheck.h"
 
 AudioAsset::AudioAsset(AssetAPI *owner, const QString &type_, const QString &name_)
-:IAsset(owner, type_, name_), handle(0)
+:IAsset(owner, type_, name_), handle(0), lengthSeconds(0.f)
 {
 }
 
@@ -42,6 +42,7 @@ void AudioAsset::DoUnload()
         handle = 0;
     }
 #endif
+    lengthSeconds = 0.f;
 }
 
 bool AudioAsset::DeserializeFromData(const u8 *data, size_t numBytes, bool /*allowAsynchronous*/)
@@ -90,16 +91,17 @@ bool AudioAsset::LoadFromOggVorbisFileInMemory(const u8 *data, size_t numBytes)
 
 bool AudioAsset::LoadFromRawPCMWavData(const u8 *data, size_t numBytes, bool stereo, bool is16Bit, int frequency)
 {
-    // Clean up the previous OpenAL audio buffer handle, if old data existed.
-    DoUnload();
-
 #ifndef TUNDRA_NO_AUDIO
     if (!data || numBytes == 0)
     {
+        DoUnload();
         LogError("AudioAsset::LoadFromRawPCMWavData: Null data passed in!");
         return false;
     }
 
+    // Refill the previous OpenAL audio buffer, if old data existed, so that a sound streamed in pieces does not create a buffer for each.
+    lengthSeconds = 0.f;
+    const bool refill = handle != 0;
     if (!CreateBuffer())
         return false;
 
@@ -109,8 +111,18 @@ bool AudioAsset::LoadFromRawPCMWavData(const u8 *data, size_t numBytes, bool ste
     else if (stereo && !is16Bit) openALFormat = AL_FORMAT_STEREO8;
     else /* (!stereo && !is16Bit)*/ openALFormat = AL_FORMAT_MONO8;
 
+    alGetError();
     alBufferData(handle, openALFormat, (const ALvoid*)data, (ALsizei)numBytes, frequency);
     ALenum error = alGetError();
+    if (error != AL_NONE && refill)
+    {
+        // The old buffer is still queued to a source, e.g. an asset reloaded while it plays. Clean it up and use a new buffer.
+        DoUnload();
+        if (!CreateBuffer())
+            return false;
+        alBufferData(handle, openALFormat, (const ALvoid*)data, (ALsizei)numBytes, frequency);
+        error = alGetError();
+    }
     if (error != AL_NONE)
     {
         const ALchar unknownError[] = "unknown error";
@@ -121,8 +133,12 @@ bool AudioAsset::LoadFromRawPCMWavData(const u8 *data, size_t numBytes, bool ste
         DoUnload();
         return false;
     }
+
+    const int bytesPerSecond = frequency * (stereo ? 2 : 1) * (is16Bit ? 2 : 1);
+    lengthSeconds = bytesPerSecond > 0 ? (float)numBytes / bytesPerSecond : 0.f;
     return true;
 #else
+    DoUnload();
     return false;
 #endif
 }
@@ -26,6 +26,8 @@ public:
     bool LoadFromOggVorbisFileInMemory(const u8 *data, size_t numBytes);
 
     /// Loads this audio asset from the given raw PCM WAV data.
+    /// The OpenAL buffer of the asset is refilled if it has one, so an asset can be reused for the pieces of a streamed sound
+    /// once its buffer is no longer queued to a source.
     /// @param data Contains the source data. This data is copied to internal AudioAsset memory, and does not need
     ///    to be stored in memory afterwards.
     /// @param numBytes The size of data, in bytes.
@@ -45,11 +47,18 @@ public:
 
     bool IsLoaded() const;
 
+    /// Returns the play time of the sound at its original pitch, in seconds, or 0 if not loaded.
+    float LengthSeconds() const { return lengthSeconds; }
+
 private:
     virtual void DoUnload();
 
+protected:
     /// The actual sound data is stored in an OpenAL internal audio buffer. This handle specifies the buffer.
     /// If == 0, then this AudioAsset is unloaded.
     ALuint handle;
+
+    /// Play time of the loaded data, in seconds.
+    float lengthSeconds;
 };
 
@@ -17,6 +17,12 @@ typedef weak_ptr<SoundChannel> SoundChannelWeakPtr;
 
 typedef std::map<sound_id_t, SoundChannelPtr> SoundChannelMap;
 
+class SoundBackend;
+class SoundSourcePool;
+typedef shared_ptr<SoundSourcePool> SoundSourcePoolPtr;
+typedef weak_ptr<SoundSourcePool> SoundSourcePoolWeakPtr;
+struct SoundVoiceStats;
+
 class AudioAsset;
 typedef shared_ptr<AudioAsset> AudioAssetPtr;
 typedef weak_ptr<AudioAsset> AudioAssetWeakPtr;
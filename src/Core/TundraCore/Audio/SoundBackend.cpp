@@ -0,0 +1,314 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "SoundBackend.h"
+#include "LoggingFunctions.h"
+
+#ifndef TUNDRA_NO_AUDIO
+#ifndef Q_WS_MAC
+#include <AL/al.h>
+#include <AL/alc.h>
+#else
+#include <al.h>
+#include <alc.h>
+#endif
+#endif
+
+#include "MemoryLeakCheck.h"
+
+/// Number of sources assumed when the device does not tell its limit. OpenAL implementations guarantee at least this many.
+static const int cFallbackMaxSources = 16;
+
+OpenALSoundBackend::OpenALSoundBackend(ALCdevice *device_) :
+    device(device_)
+{
+}
+
+int OpenALSoundBackend::MaxSources() const
+{
+#ifndef TUNDRA_NO_AUDIO
+    ALCint monoSources = 0;
+    if (device)
+        alcGetIntegerv(device, ALC_MONO_SOURCES, 1, &monoSources);
+    return monoSources > 0 ? monoSources : cFallbackMaxSources;
+#else
+    return 0;
+#endif
+}
+
+ALuint OpenALSoundBackend::CreateSource()
+{
+#ifndef TUNDRA_NO_AUDIO
+    ALuint source = 0;
+    alGetError();
+    alGenSources(1, &source);
+    if (alGetError() != AL_NONE)
+        return 0;
+
+    // No matter whether sound is positional or not, we use own attenuation, so OpenAL rolloff is 0
+    alSourcef(source, AL_ROLLOFF_FACTOR, 0.0);
+    return source;
+#else
+    return 0;
+#endif
+}
+
+void OpenALSoundBackend::DeleteSource(ALuint source)
+{
+#ifndef TUNDRA_NO_AUDIO
+    alSourceStop(source);
+    alDeleteSources(1, &source);
+#endif
+}
+
+bool OpenALSoundBackend::QueueBuffer(ALuint source, ALuint buffer)
+{
+#ifndef TUNDRA_NO_AUDIO
+    alGetError();
+    alSourceQueueBuffers(source, 1, &buffer);
+    if (alGetError() == AL_NONE)
+        return true;
+
+    // If queuing fails, we may have changed sound format. Stop, flush queue & retry
+    alSourceStop(source);
+    alSourcei(source, AL_BUFFER, 0);
+    alSourceQueueBuffers(source, 1, &buffer);
+    ALenum error = alGetError();
+    if (error != AL_NONE)
+    {
+        LogError("Could not queue OpenAL sound buffer: " + QString::number(error));
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+ALuint OpenALSoundBackend::UnqueueProcessedBuffer(ALuint source)
+{
+#ifndef TUNDRA_NO_AUDIO
+    ALint processed = 0;
+    alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+    if (processed <= 0)
+        return 0;
+
+    ALuint buffer = 0;
+    alSourceUnqueueBuffers(source, 1, &buffer);
+    return buffer;
+#else
+    return 0;
+#endif
+}
+
+void OpenALSoundBackend::Play(ALuint source)
+{
+#ifndef TUNDRA_NO_AUDIO
+    alSourcePlay(source);
+#endif
+}
+
+void OpenALSoundBackend::Stop(ALuint source)
+{
+#ifndef TUNDRA_NO_AUDIO
+    alSourceStop(source);
+    // Set null buffer to be sure we cleared the buffer queue
+    alSourcei(source, AL_BUFFER, 0);
+#endif
+}
+
+bool OpenALSoundBackend::IsPlaying(ALuint source) const
+{
+#ifndef TUNDRA_NO_AUDIO
+    ALint state = 0;
+    alGetSourcei(source, AL_SOURCE_STATE, &state);
+    return state == AL_PLAYING;
+#else
+    return false;
+#endif
+}
+
+float OpenALSoundBackend::Offset(ALuint source) const
+{
+#ifndef TUNDRA_NO_AUDIO
+    ALfloat seconds = 0.f;
+    alGetSourcef(source, AL_SEC_OFFSET, &seconds);
+    return seconds;
+#else
+    return 0.f;
+#endif
+}
+
+void OpenALSoundBackend::SetOffset(ALuint source, float seconds)
+{
+#ifndef TUNDRA_NO_AUDIO
+    alSourcef(source, AL_SEC_OFFSET, seconds);
+#endif
+}
+
+void OpenALSoundBackend::SetGain(ALuint source, float gain)
+{
+#ifndef TUNDRA_NO_AUDIO
+    alSourcef(source, AL_GAIN, gain);
+#endif
+}
+
+void OpenALSoundBackend::SetPitch(ALuint source, float pitch)
+{
+#ifndef TUNDRA_NO_AUDIO
+    alSourcef(source, AL_PITCH, pitch);
+#endif
+}
+
+void OpenALSoundBackend::SetLooping(ALuint source, bool looping)
+{
+#ifndef TUNDRA_NO_AUDIO
+    alSourcei(source, AL_LOOPING, looping ? AL_TRUE : AL_FALSE);
+#endif
+}
+
+void OpenALSoundBackend::SetPosition(ALuint source, bool positional, const float3 &position)
+{
+#ifndef TUNDRA_NO_AUDIO
+    if (positional)
+    {
+        alSourcei(source, AL_SOURCE_RELATIVE, AL_FALSE);
+        ALfloat sound_pos[] = {position.x, position.y, position.z};
+        alSourcefv(source, AL_POSITION, sound_pos);
+    }
+    else
+    {
+        alSourcei(source, AL_SOURCE_RELATIVE, AL_TRUE);
+        ALfloat sound_pos[] = {0.0, 0.0, 0.0};
+        alSourcefv(source, AL_POSITION, sound_pos);
+    }
+#endif
+}
+
+void OpenALSoundBackend::SetListener(const float3 &position, const Quat &orientation)
+{
+#ifndef TUNDRA_NO_AUDIO
+    ALfloat pos[] = {position.x, position.y, position.z};
+    alListenerfv(AL_POSITION, pos);
+    float3 front = orientation * float3(0.0f, -1.0f, 0.0f);
+    float3 up = orientation * float3(0.0f, 0.0f, -1.0f);
+    ALfloat orient[] = {front.x, front.y, front.z, up.x, up.y, up.z};
+    alListenerfv(AL_ORIENTATION, orient);
+#endif
+}
+
+NullSoundBackend::NullSoundBackend(int maxSources_) :
+    maxSources(maxSources_),
+    numCreatedSources(0),
+    nextSource(1)
+{
+}
+
+const NullSoundBackend::NullSource *NullSoundBackend::Source(ALuint source) const
+{
+    std::map<ALuint, NullSource>::const_iterator iter = sources.find(source);
+    return iter != sources.end() ? &iter->second : 0;
+}
+
+ALuint NullSoundBackend::CreateSource()
+{
+    if ((int)sources.size() >= maxSources)
+        return 0;
+    ALuint source = nextSource++;
+    sources[source] = NullSource();
+    ++numCreatedSources;
+    return source;
+}
+
+void NullSoundBackend::DeleteSource(ALuint source)
+{
+    sources.erase(source);
+}
+
+bool NullSoundBackend::QueueBuffer(ALuint source, ALuint buffer)
+{
+    std::map<ALuint, NullSource>::iterator iter = sources.find(source);
+    if (iter == sources.end() || !buffer)
+        return false;
+    iter->second.queue.push_back(buffer);
+    return true;
+}
+
+ALuint NullSoundBackend::UnqueueProcessedBuffer(ALuint /*source*/)
+{
+    return 0;
+}
+
+void NullSoundBackend::Play(ALuint source)
+{
+    std::map<ALuint, NullSource>::iterator iter = sources.find(source);
+    if (iter != sources.end())
+        iter->second.playing = !iter->second.queue.empty();
+}
+
+void NullSoundBackend::Stop(ALuint source)
+{
+    std::map<ALuint, NullSource>::iterator iter = sources.find(source);
+    if (iter != sources.end())
+    {
+        iter->second.playing = false;
+        iter->second.offset = 0.f;
+        iter->second.queue.clear();
+    }
+}
+
+bool NullSoundBackend::IsPlaying(ALuint source) const
+{
+    const NullSource *s = Source(source);
+    return s && s->playing;
+}
+
+float NullSoundBackend::Offset(ALuint source) const
+{
+    const NullSource *s = Source(source);
+    return s ? s->offset : 0.f;
+}
+
+void NullSoundBackend::SetOffset(ALuint source, float seconds)
+{
+    std::map<ALuint, NullSource>::iterator iter = sources.find(source);
+    if (iter != sources.end())
+        iter->second.offset = seconds;
+}
+
+void NullSoundBackend::SetGain(ALuint source, float gain)
+{
+    std::map<ALuint, NullSource>::iterator iter = sources.find(source);
+    if (iter != sources.end())
+        iter->second.gain = gain;
+}
+
+void NullSoundBackend::SetPitch(ALuint source, float pitch)
+{
+    std::map<ALuint, NullSource>::iterator iter = sources.find(source);
+    if (iter != sources.end())
+        iter->second.pitch = pitch;
+}
+
+void NullSoundBackend::SetLooping(ALuint source, bool looping)
+{
+    std::map<ALuint, NullSource>::iterator iter = sources.find(source);
+    if (iter != sources.end())
+        iter->second.looping = looping;
+}
+
+void NullSoundBackend::SetPosition(ALuint source, bool positional, const float3 &position)
+{
+    std::map<ALuint, NullSource>::iterator iter = sources.find(source);
+    if (iter != sources.end())
+    {
+        iter->second.positional = positional;
+        iter->second.position = positional ? position : float3::zero;
+    }
+}
+
+void NullSoundBackend::SetListener(const float3 & /*position*/, const Quat & /*orientation*/)
+{
+}
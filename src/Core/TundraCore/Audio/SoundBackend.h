@@ -0,0 +1,140 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "AudioFwd.h"
+#include "Math/float3.h"
+#include "Math/Quat.h"
+
+#include <map>
+#include <vector>
+
+/// Plays sound sources of a playback device.
+/** Sound channels and SoundSourcePool drive their sources only through this interface. Sources are identified by
+    nonzero handles, and buffers by the OpenAL buffer handles of audio assets. */
+class TUNDRACORE_API SoundBackend
+{
+public:
+    virtual ~SoundBackend() {}
+
+    /// Returns the most sources the device can play at the same time.
+    virtual int MaxSources() const = 0;
+
+    /// Creates a source. Returns 0 on failure.
+    virtual ALuint CreateSource() = 0;
+    /// Deletes a source.
+    virtual void DeleteSource(ALuint source) = 0;
+
+    /// Appends a buffer to the play queue of a source.
+    /** @return false if the buffer could not be queued. */
+    virtual bool QueueBuffer(ALuint source, ALuint buffer) = 0;
+    /// Removes a buffer that has finished playing from the front of the play queue.
+    /** @return The buffer, or 0 if no queued buffer has been played yet. */
+    virtual ALuint UnqueueProcessedBuffer(ALuint source) = 0;
+
+    /// Starts or resumes playing the queue of a source.
+    virtual void Play(ALuint source) = 0;
+    /// Stops a source and empties its play queue.
+    virtual void Stop(ALuint source) = 0;
+    /// Returns whether a source is playing.
+    virtual bool IsPlaying(ALuint source) const = 0;
+
+    /// Returns the playback position from the start of the first queued buffer, in seconds.
+    virtual float Offset(ALuint source) const = 0;
+    /// Sets the playback position from the start of the first queued buffer, in seconds.
+    virtual void SetOffset(ALuint source, float seconds) = 0;
+
+    /// Sets the gain of a source. Distance attenuation is applied by the caller, the sources do not attenuate.
+    virtual void SetGain(ALuint source, float gain) = 0;
+    /// Sets the pitch of a source, 1.0 = original.
+    virtual void SetPitch(ALuint source, float pitch) = 0;
+    /// Sets whether a source loops.
+    virtual void SetLooping(ALuint source, bool looping) = 0;
+    /// Sets the position of a source. A non-positional source is placed at the listener.
+    virtual void SetPosition(ALuint source, bool positional, const float3 &position) = 0;
+
+    /// Sets the listener position & orientation.
+    virtual void SetListener(const float3 &position, const Quat &orientation) = 0;
+};
+
+/// Plays sources with the current OpenAL context.
+class TUNDRACORE_API OpenALSoundBackend : public SoundBackend
+{
+public:
+    /// @param device Device of the current OpenAL context.
+    explicit OpenALSoundBackend(ALCdevice *device);
+
+    int MaxSources() const;
+    ALuint CreateSource();
+    void DeleteSource(ALuint source);
+    bool QueueBuffer(ALuint source, ALuint buffer);
+    ALuint UnqueueProcessedBuffer(ALuint source);
+    void Play(ALuint source);
+    void Stop(ALuint source);
+    bool IsPlaying(ALuint source) const;
+    float Offset(ALuint source) const;
+    void SetOffset(ALuint source, float seconds);
+    void SetGain(ALuint source, float gain);
+    void SetPitch(ALuint source, float pitch);
+    void SetLooping(ALuint source, bool looping);
+    void SetPosition(ALuint source, bool positional, const float3 &position);
+    void SetListener(const float3 &position, const Quat &orientation);
+
+private:
+    ALCdevice *device;
+};
+
+/// Keeps the state of sources in memory without playing anything.
+/** Used to run the sound system without a playback device, e.g. in tests. The sources never finish playing
+    on their own, and the state set to them can be inspected with Source(). */
+class TUNDRACORE_API NullSoundBackend : public SoundBackend
+{
+public:
+    /// State of a source.
+    struct NullSource
+    {
+        NullSource() : playing(false), offset(0.f), gain(1.f), pitch(1.f), looping(false), positional(false) {}
+
+        std::vector<ALuint> queue;
+        bool playing;
+        float offset;
+        float gain;
+        float pitch;
+        bool looping;
+        bool positional;
+        float3 position;
+    };
+
+    /// @param maxSources The most sources the backend can create at the same time.
+    explicit NullSoundBackend(int maxSources);
+
+    /// Returns the state of a source, or null if the source does not exist.
+    const NullSource *Source(ALuint source) const;
+    /// Returns the number of existing sources.
+    int NumSources() const { return (int)sources.size(); }
+    /// Returns the number of sources created since construction, including the deleted ones.
+    int NumCreatedSources() const { return numCreatedSources; }
+
+    int MaxSources() const { return maxSources; }
+    ALuint CreateSource();
+    void DeleteSource(ALuint source);
+    bool QueueBuffer(ALuint source, ALuint buffer);
+    ALuint UnqueueProcessedBuffer(ALuint source);
+    void Play(ALuint source);
+    void Stop(ALuint source);
+    bool IsPlaying(ALuint source) const;
+    float Offset(ALuint source) const;
+    void SetOffset(ALuint source, float seconds);
+    void SetGain(ALuint source, float gain);
+    void SetPitch(ALuint source, float pitch);
+    void SetLooping(ALuint source, bool looping);
+    void SetPosition(ALuint source, bool positional, const float3 &position);
+    void SetListener(const float3 &position, const Quat &orientation);
+
+private:
+    std::map<ALuint, NullSource> sources;
+    int maxSources;
+    int numCreatedSources;
+    ALuint nextSource;
+};
@@ -4,20 +4,13 @@
 #include "DebugOperatorNew.h"
 
 #include "SoundChannel.h"
+#include "SoundSourcePool.h"
+#include "SoundBackend.h"
 #include "LoggingFunctions.h"
 #include "Math/MathFunc.h"
 
-#ifndef TUNDRA_NO_AUDIO
-#ifndef Q_WS_MAC
-#include <AL/al.h>
-#include <AL/alc.h>
-#else
-#include <al.h>
-#include <alc.h>
-#endif
-#endif
-
 #include <cfloat>
+#include <cmath>
 
 #include "MemoryLeakCheck.h"
 
@@ -25,10 +18,15 @@ static const float cMinimumRollOff = 0.1f;
 static const float cDefaultRollOff = 2.0f;
 static const float cDefaultInnerRadius = 1.0f;
 static const float cDefaultOuterRadius = 50.0f;
+/// Weight of voice chat when choosing the channels that have a source, so that speech is kept over effects of about the same loudness.
+static const float cVoicePriority = 2.0f;
 
-SoundChannel::SoundChannel(sound_id_t channelId_, SoundType type) :
+SoundChannel::SoundChannel(sound_id_t channelId_, SoundType type, const SoundSourcePoolPtr &pool) :
     type_(type),
+    pool_(pool),
+    voice_(pool->CreateVoice()),
     handle_(0),
+    play_offset_(0.0f),
     pitch_(1.0f),
     gain_(1.0f),
     master_gain_(1.0f),
@@ -36,53 +34,80 @@ SoundChannel::SoundChannel(sound_id_t channelId_, SoundType type) :
     inner_radius_(cDefaultInnerRadius),
     outer_radius_(cDefaultOuterRadius),
     rolloff_(cDefaultRollOff),
-    attenuation_(1.0f),
     positional_(false),
     looped_(false),
     buffered_mode_(false),
     state_(Stopped),
     channelId(channelId_)
 { 
+    pool->SetRange(voice_, inner_radius_, outer_radius_, rolloff_);
+    pool->SetGain(voice_, master_gain_ * gain_);
+    pool->SetPriority(voice_, type_ == Voice ? cVoicePriority : 1.0f);
 }
 
 SoundChannel::~SoundChannel()
 {
-    DeleteSource();
+    SoundSourcePoolPtr pool = pool_.lock();
+    if (pool)
+        pool->DestroyVoice(voice_);
 }
 
-void SoundChannel::Update(const float3& listener_pos)
+void SoundChannel::YieldSource()
 {
-#ifndef TUNDRA_NO_AUDIO
-    CalculateAttenuation(listener_pos);
-    SetAttenuatedGain();
+    if (!handle_)
+        return;
+    SoundSourcePoolPtr pool = pool_.lock();
+    if (!pool)
+    {
+        handle_ = 0;
+        return;
+    }
+    if (pool->ShouldHaveSource(voice_))
+        return;
+
+    // Continue virtually from where the source is. A source that has finished playing leaves nothing to continue.
+    UnqueueBuffers();
+    if (state_ == Playing && !pool->Backend()->IsPlaying(handle_))
+        playing_sounds_.clear();
+    play_offset_ = pool->Backend()->Offset(handle_);
+    ReleaseSource();
+}
+
+void SoundChannel::Update(f64 frametime)
+{
+    SoundSourcePoolPtr pool = pool_.lock();
+    if (!pool)
+        return;
+
+    if (!handle_ && state_ != Stopped && pool->ShouldHaveSource(voice_))
+        AcquireSource(*pool);
+
     QueueBuffers();
+
+    if (!handle_)
+    {
+        AdvanceVirtualPlayback(frametime);
+        return;
+    }
+
+    SetAttenuatedGain();
     UnqueueBuffers();
-    
-    if (state_ == Playing)
+
+    if (state_ == Playing && !pool->Backend()->IsPlaying(handle_))
     {
-        if (handle_)
-        {
-            ALint playing;
-            alGetSourcei(handle_, AL_SOURCE_STATE, &playing);
-            if (playing != AL_PLAYING)
-            {
-                // Stopped state may trigger removal of audio channel, so don't
-                // do that in buffered mode
-                if (buffered_mode_)
-                {
-                    state_ = Pending;
-                }
-                else
-                    state_ = Stopped;
-            }
-        }
+        // Stopped state may trigger removal of audio channel, so don't
+        // do that in buffered mode
+        if (buffered_mode_)
+            SetState(Pending);
+        else
+            SetState(Stopped);
     }
-#endif
+    if (state_ == Stopped)
+        ReleaseSource();
 }
 
 void SoundChannel::Play(AudioAssetPtr audioAsset)
 {
-#ifndef TUNDRA_NO_AUDIO
     // Stop any previously buffered sound
     Stop();
 
@@ -92,14 +117,12 @@ void SoundChannel::Play(AudioAssetPtr audioAsset)
     pending_sounds_.push_back(audioAsset);
 
     // Start actual playback on next update
-    state_ = Pending;
+    SetState(Pending);
     buffered_mode_ = false;
-#endif
 }
 
 void SoundChannel::AddBuffer(AudioAssetPtr buffer)
 {
-#ifndef TUNDRA_NO_AUDIO
     pending_sounds_.push_back(buffer);
 
     // Buffered mode should not loop
@@ -107,65 +130,98 @@ void SoundChannel::AddBuffer(AudioAssetPtr buffer)
 
     // Start actual playback on next update
     if (state_ == Stopped)
-        state_ = Pending;
+        SetState(Pending);
     buffered_mode_ = true;
-#endif
 }
 
-bool SoundChannel::CreateSource()
+bool SoundChannel::AcquireSource(SoundSourcePool &pool)
 {
-#ifndef TUNDRA_NO_AUDIO
+    handle_ = pool.AcquireSource(voice_);
     if (!handle_)
-        alGenSources(1, &handle_);
-
-    if (!handle_)
-    {
-        LogError("Could not create OpenAL sound source");
         return false;
-    }
-
-    alSourcef(handle_, AL_PITCH, pitch_);
-    alSourcei(handle_, AL_LOOPING, looped_ ? AL_TRUE : AL_FALSE);
-    // No matter whether sound is positional or not, we use own attenuation, so OpenAL rolloff is 0
-    alSourcef(handle_, AL_ROLLOFF_FACTOR, 0.0);
 
+    SoundBackend *backend = pool.Backend();
+    backend->SetPitch(handle_, pitch_);
+    backend->SetLooping(handle_, looped_);
     SetPositionAndMode();
     SetAttenuatedGain();
 
+    // Continue the sounds played so far virtually from the same position
+    if (!playing_sounds_.empty())
+    {
+        for(uint i = 0; i < playing_sounds_.size(); ++i)
+            if (playing_sounds_[i]->GetHandle())
+                backend->QueueBuffer(handle_, playing_sounds_[i]->GetHandle());
+        backend->SetOffset(handle_, play_offset_);
+        if (state_ == Playing)
+            backend->Play(handle_);
+    }
+    play_offset_ = 0.0f;
+
     return true;
-#else
-    return false;
-#endif
 }
 
-void SoundChannel::DeleteSource()
+void SoundChannel::ReleaseSource()
 {
-#ifndef TUNDRA_NO_AUDIO
-    Stop();
+    if (!handle_)
+        return;
 
-    if (handle_)
+    SoundSourcePoolPtr pool = pool_.lock();
+    if (pool)
+        pool->ReleaseSource(voice_);
+    handle_ = 0;
+}
+
+void SoundChannel::AdvanceVirtualPlayback(f64 frametime)
+{
+    if (state_ != Playing)
+        return;
+
+    play_offset_ += (float)frametime * pitch_;
+    while(!playing_sounds_.empty())
     {
-        alDeleteSources(1, &handle_);
-        handle_ = 0;
+        float length = playing_sounds_.front()->LengthSeconds();
+        if (play_offset_ < length)
+            return;
+        if (looped_ && playing_sounds_.size() == 1 && length > 0.0f)
+        {
+            play_offset_ = fmod(play_offset_, length);
+            return;
+        }
+        play_offset_ -= length;
+        playing_sounds_.erase(playing_sounds_.begin());
     }
-#endif
+
+    play_offset_ = 0.0f;
+    SetState(buffered_mode_ ? Pending : Stopped);
+}
+
+void SoundChannel::SetState(SoundState state)
+{
+    state_ = state;
+    SoundSourcePoolPtr pool = pool_.lock();
+    if (pool)
+        pool->SetPlaying(voice_, state_ != Stopped);
+}
+
+SoundBackend *SoundChannel::Backend() const
+{
+    SoundSourcePoolPtr pool = pool_.lock();
+    return pool ? pool->Backend() : 0;
 }
 
 void SoundChannel::Stop()
 {
-#ifndef TUNDRA_NO_AUDIO
-    if (handle_)
-    {
-        alSourceStop(handle_);
-        // Set null buffer to be sure we cleared the buffer queue
-        alSourcei(handle_, AL_BUFFER, 0);
-    }
+    SoundBackend *backend = Backend();
+    if (handle_ && backend)
+        backend->Stop(handle_);
+    ReleaseSource();
     
     pending_sounds_.clear();
     playing_sounds_.clear();
+    play_offset_ = 0.0f;
     
-    state_ = Stopped;
-#endif
+    SetState(Stopped);
 }
 
 QString SoundChannel::SoundName() const
@@ -196,34 +252,38 @@ void SoundChannel::SetPositional(bool enable)
 
 void SoundChannel::SetLooped(bool enable)
 {
-#ifndef TUNDRA_NO_AUDIO
     // Can not set looping in buffered mode
     if (buffered_mode_)
         enable = false;
 
     looped_ = enable;
-    if (handle_)
-        alSourcei(handle_, AL_LOOPING, looped_ ? AL_TRUE : AL_FALSE);
-#endif
+    SoundBackend *backend = Backend();
+    if (handle_ && backend)
+        backend->SetLooping(handle_, looped_);
 }
 
 void SoundChannel::SetPitch(float pitch)
 {
-#ifndef TUNDRA_NO_AUDIO
     pitch_ = pitch;
-    if (handle_)
-        alSourcef(handle_, AL_PITCH, pitch_);
-#endif
+    SoundBackend *backend = Backend();
+    if (handle_ && backend)
+        backend->SetPitch(handle_, pitch_);
 }
 
 void SoundChannel::SetGain(float gain)
 {
     gain_ = Clamp(gain, 0.f, 1.f);
+    SoundSourcePoolPtr pool = pool_.lock();
+    if (pool)
+        pool->SetGain(voice_, master_gain_ * gain_);
 }
 
 void SoundChannel::SetMasterGain(float masterGain)
 {
     master_gain_ = Clamp(masterGain, 0.f, 1.f);
+    SoundSourcePoolPtr pool = pool_.lock();
+    if (pool)
+        pool->SetGain(voice_, master_gain_ * gain_);
 }
 
 void SoundChannel::SetRange(float inner_radius, float outer_radius, float rolloff)
@@ -231,86 +291,38 @@ void SoundChannel::SetRange(float inner_radius, float outer_radius, float rollof
     inner_radius_ = Clamp(inner_radius, 0.f, FLT_MAX);
     outer_radius_ = Clamp(outer_radius, 0.f, FLT_MAX);
     rolloff_ = Clamp(rolloff, cMinimumRollOff, FLT_MAX);
+    SoundSourcePoolPtr pool = pool_.lock();
+    if (pool)
+        pool->SetRange(voice_, inner_radius_, outer_radius_, rolloff_);
 }
 
 void SoundChannel::SetPositionAndMode()
 {
-#ifndef TUNDRA_NO_AUDIO
-    if (handle_)
-    {
-        if (positional_)
-        {
-            alSourcei(handle_, AL_SOURCE_RELATIVE, AL_FALSE);
-            ALfloat sound_pos[] = {position_.x, position_.y, position_.z};
-            alSourcefv(handle_, AL_POSITION, sound_pos);
+    SoundSourcePoolPtr pool = pool_.lock();
+    if (!pool)
+        return;
 
-        }
-        else
-        {
-            alSourcei(handle_, AL_SOURCE_RELATIVE, AL_TRUE);
-            ALfloat sound_pos[] = {0.0, 0.0, 0.0};
-            alSourcefv(handle_, AL_POSITION, sound_pos);
-        }
-    }
-#endif
+    pool->SetPosition(voice_, position_);
+    pool->SetPositional(voice_, positional_);
+    if (handle_)
+        pool->Backend()->SetPosition(handle_, positional_, position_);
 }
 
-void SoundChannel::CalculateAttenuation(const float3& listener_pos)
-{
-    if ((outer_radius_ == 0.0f) || (outer_radius_ <= inner_radius_))
-    {
-        attenuation_ = 1.0f;
-        return;
-    }
-      
-    float distance = (position_ - listener_pos).Length();
-    if (distance <= inner_radius_)
-    {
-        attenuation_ = 1.0f;
-        return;
-    }
-    if (distance >= outer_radius_)
-    {
-        attenuation_ = 0.0f;
-        return;
-    }
-    
-    attenuation_ = pow(1.0f - (distance - inner_radius_) / (outer_radius_ - inner_radius_), rolloff_);
-}  
-
 void SoundChannel::SetAttenuatedGain()
 {
-#ifndef TUNDRA_NO_AUDIO
-    if (handle_)
-    {
-        if (positional_)
-            alSourcef(handle_, AL_GAIN, master_gain_ * gain_ * attenuation_);
-        else
-            alSourcef(handle_, AL_GAIN, master_gain_ * gain_);
-    }
-#endif
+    // Attenuation is calculated for all channels at once by the pool
+    SoundSourcePoolPtr pool = pool_.lock();
+    if (pool && handle_)
+        pool->Backend()->SetGain(handle_, pool->AttenuatedGain(voice_));
 }
 
 void SoundChannel::QueueBuffers()
 {
-#ifndef TUNDRA_NO_AUDIO
-    // See that we do have waiting sounds and they're ready to play
-    AudioAssetPtr pending = !pending_sounds_.empty() ? pending_sounds_.front() : AudioAssetPtr();
-
-    if (!pending)
-        return;
-    
-    // Create source now if did not exist already
-    if (!CreateSource())
-    {
-        state_ = Stopped;
-        pending_sounds_.clear();
-        return;
-    }
-    
+    SoundBackend *backend = Backend();
     bool queued = false;
     
-    // Buffer pending sounds, move them to playing vector
+    // Buffer pending sounds that are ready to play, move them to playing vector.
+    // A virtual channel only moves them, and plays them when it gets a source.
     while(!pending_sounds_.empty())
     {
         AudioAssetPtr sound = pending_sounds_.front();
@@ -322,29 +334,12 @@ void SoundChannel::QueueBuffers()
         ALuint buffer = sound->GetHandle();
         // If no valid handle yet, cannot play this one, break out
         if (!buffer)
-            return;
-        
-        alGetError();
-        alSourceQueueBuffers(handle_, 1, &buffer);
-        ALenum error = alGetError();
+            break;
         
-        if (error != AL_NONE)
-        {
-            // If queuing fails, we may have changed sound format. Stop, flush queue & retry
-            alSourceStop(handle_);
-            alSourcei(handle_, AL_BUFFER, 0);
-            alSourceQueueBuffers(handle_, 1, &buffer);
-            ALenum error = alGetError();
-            if (error != AL_NONE)
-                LogError("Could not queue OpenAL sound buffer: " + QString::number(error));
-            else
-            {
-                playing_sounds_.push_back(sound);
-                queued = true;
-            }
-        }
-        else
+        if (!handle_ || !backend || backend->QueueBuffer(handle_, buffer))
         {
+            if (playing_sounds_.empty())
+                play_offset_ = 0.0f;
             playing_sounds_.push_back(sound);
             queued = true;
         }
@@ -355,40 +350,32 @@ void SoundChannel::QueueBuffers()
     // If at least one sound queued, start playback if not already playing
     if (queued)
     {
-        ALint playing;
-        alGetSourcei(handle_, AL_SOURCE_STATE, &playing);
-        if (playing != AL_PLAYING)
-            alSourcePlay(handle_);
-        state_ = Playing;
+        if (handle_ && backend && !backend->IsPlaying(handle_))
+            backend->Play(handle_);
+        SetState(Playing);
     }
-#endif
 }
 
 void SoundChannel::UnqueueBuffers()
 {
-#ifndef TUNDRA_NO_AUDIO
-    if (handle_)
+    SoundBackend *backend = Backend();
+    if (!handle_ || !backend)
+        return;
+
+    for(;;)
     {
-        int processed = 0;
-        alGetSourcei(handle_, AL_BUFFERS_PROCESSED, &processed);
-        while(processed--)
+        ALuint buffer = backend->UnqueueProcessedBuffer(handle_);
+        if (!buffer)
+            break;
+        // See if we find matching buffer from the sounds vector.
+        // If found, erase so that the sound may be freed if not used elsewhere
+        for(uint i = 0; i < playing_sounds_.size(); ++i)
         {
-            ALuint buffer = 0;
-            alSourceUnqueueBuffers(handle_, 1, &buffer);
-            if (buffer)
+            if (playing_sounds_[i]->GetHandle() == buffer)
             {
-                // See if we find matching buffer from the sounds vector.
-                // If found, erase so that the sound may be freed if not used elsewhere
-                for(uint i = 0; i < playing_sounds_.size(); ++i)
-                {
-                    if (playing_sounds_[i]->GetHandle() == buffer)
-                    {
-                        playing_sounds_.erase(playing_sounds_.begin() + i);
-                        break;
-                    }
-                }
+                playing_sounds_.erase(playing_sounds_.begin() + i);
+                break;
             }
         }
     }
-#endif
 }
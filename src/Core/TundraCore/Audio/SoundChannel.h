@@ -9,7 +9,10 @@
 #include "Math/float3.h"
 #include "AssetFwd.h"
 
-/// An OpenAL sound channel (source).
+/// A sound channel.
+/** The channel plays through a source of the SoundSourcePool while it is among the loudest playing channels.
+    Otherwise the channel is virtual: it keeps track of the playback position without a source, and continues
+    from it if it gets a source again. */
 class TUNDRACORE_API SoundChannel : public QObject, public enable_shared_from_this<SoundChannel>
 {
     Q_OBJECT
@@ -45,7 +48,8 @@ public:
         Voice
     };
 
-    SoundChannel(sound_id_t channelId, SoundType type);
+    /// @param pool Pool to take the source from when the channel is audible.
+    SoundChannel(sound_id_t channelId, SoundType type, const SoundSourcePoolPtr &pool);
     ~SoundChannel();
     
 public slots:
@@ -71,8 +75,17 @@ public slots:
     void SetRange(float innerRadius, float outerRadius, float rollOff);
 
 public:
-    /// Per-frame update with new listener position
-    void Update(const float3& listenerPos);
+    /// Per-frame update, after SoundSourcePool::Update and YieldSource.
+    /** Takes a source if the pool has chosen the channel to have one, and otherwise advances the playback position virtually.
+        @param frametime Time since the last update, in seconds. */
+    void Update(f64 frametime);
+
+    /// Returns the source to the pool if the pool has chosen the channel to be virtual.
+    /** Called on all channels before Update, so that the sources are free to be taken in the same frame. */
+    void YieldSource();
+
+    /// Returns whether the channel is playing without a source.
+    bool IsVirtual() const { return state_ != Stopped && !handle_; }
 
     /// Return current state of channel.
     SoundState State() const { return state_; }
@@ -133,21 +146,31 @@ private:
     void QueueBuffers();
     /// Remove processed buffers
     void UnqueueBuffers();
-    /// Create OpenAL source if one does not exist yet
-    bool CreateSource();
-    /// Delete OpenAL source
-    void DeleteSource();
-    /// Calculate attenuation from position, listener position & range parameters
-    void CalculateAttenuation(const float3 &listener_pos);
+    /// Take a source from the pool and continue playing from the virtual playback position
+    bool AcquireSource(SoundSourcePool &pool);
+    /// Return the source to the pool
+    void ReleaseSource();
+    /// Advance the playback position of a virtual channel, dropping the sounds that have been played
+    void AdvanceVirtualPlayback(f64 frametime);
+    /// Set state, and whether the voice of the channel needs a source
+    void SetState(SoundState state);
     /// Set positionality & position
     void SetPositionAndMode();
     /// Set gain, taking attenuation into account
     void SetAttenuatedGain();
+    /// Return the backend of the sources, or null if the pool no longer exists
+    SoundBackend *Backend() const;
     
     /// Sound type
     SoundType type_;
-    /// OpenAL handle
+    /// Pool of the sources
+    SoundSourcePoolWeakPtr pool_;
+    /// Voice in the pool
+    int voice_;
+    /// Source from the pool, 0 if the channel is virtual
     ALuint handle_;
+    /// Playback position in the first playing sound in seconds, kept while the channel is virtual
+    float play_offset_;
     /// Sounds buffers pending to be played
     std::list<AudioAssetPtr> pending_sounds_;
     /// Currently playing sound buffers
@@ -164,8 +187,6 @@ private:
     float outer_radius_;
     /// Roll-off power factor
     float rolloff_;
-    /// Last calculated attenuation factor
-    float attenuation_;
     /// Looped flag
     bool looped_;
     /// Positional flag
@@ -0,0 +1,230 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "SoundSourcePool.h"
+#include "SoundBackend.h"
+#include "LoggingFunctions.h"
+
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+#include "MemoryLeakCheck.h"
+
+/// Attenuated gain under which a voice is not heard, -60 dB.
+static const float cInaudibleGain = 0.001f;
+/// Weight of a voice that already has a source, so that two voices of about the same loudness do not trade their source back and forth.
+static const float cSourceHoldBias = 1.25f;
+
+SoundSourcePool::SoundSourcePool(SoundBackend *backend_, int maxSources_) :
+    backend(backend_),
+    maxSources(std::max(maxSources_, 0)),
+    numSources(0)
+{
+    assert(backend);
+}
+
+SoundSourcePool::~SoundSourcePool()
+{
+    for(size_t i = 0; i < source.size(); ++i)
+        if (source[i])
+            backend->DeleteSource(source[i]);
+    for(size_t i = 0; i < freeSources.size(); ++i)
+        backend->DeleteSource(freeSources[i]);
+}
+
+void SoundSourcePool::SetMaxSources(int maxSources_)
+{
+    maxSources = std::max(maxSources_, 0);
+    TrimSources();
+}
+
+int SoundSourcePool::CreateVoice()
+{
+    int voice;
+    if (!freeVoices.empty())
+    {
+        voice = freeVoices.back();
+        freeVoices.pop_back();
+    }
+    else
+    {
+        voice = (int)inUse.size();
+        const size_t size = inUse.size() + 1;
+        positionX.resize(size); positionY.resize(size); positionZ.resize(size);
+        innerRadius.resize(size); outerRadius.resize(size); rollOff.resize(size);
+        gain.resize(size); priority.resize(size);
+        positional.resize(size); playing.resize(size); inUse.resize(size);
+        distance.resize(size); attenuatedGain.resize(size); shouldHaveSource.resize(size);
+        source.resize(size, 0);
+    }
+
+    positionX[voice] = positionY[voice] = positionZ[voice] = 0.f;
+    innerRadius[voice] = outerRadius[voice] = 0.f;
+    rollOff[voice] = 1.f;
+    gain[voice] = 1.f;
+    priority[voice] = 1.f;
+    positional[voice] = 0;
+    playing[voice] = 0;
+    inUse[voice] = 1;
+    distance[voice] = 0.f;
+    attenuatedGain[voice] = 1.f;
+    shouldHaveSource[voice] = 0;
+    return voice;
+}
+
+void SoundSourcePool::DestroyVoice(int voice)
+{
+    if (voice < 0 || voice >= (int)inUse.size() || !inUse[voice])
+        return;
+    ReleaseSource(voice);
+    playing[voice] = 0;
+    shouldHaveSource[voice] = 0;
+    inUse[voice] = 0;
+    freeVoices.push_back(voice);
+}
+
+void SoundSourcePool::SetPlaying(int voice, bool enable)
+{
+    playing[voice] = enable ? 1 : 0;
+}
+
+void SoundSourcePool::SetPosition(int voice, const float3 &position)
+{
+    positionX[voice] = position.x;
+    positionY[voice] = position.y;
+    positionZ[voice] = position.z;
+}
+
+void SoundSourcePool::SetPositional(int voice, bool enable)
+{
+    positional[voice] = enable ? 1 : 0;
+}
+
+void SoundSourcePool::SetRange(int voice, float innerRadius_, float outerRadius_, float rollOff_)
+{
+    innerRadius[voice] = innerRadius_;
+    outerRadius[voice] = outerRadius_;
+    rollOff[voice] = rollOff_;
+}
+
+void SoundSourcePool::SetGain(int voice, float gain_)
+{
+    gain[voice] = gain_;
+}
+
+void SoundSourcePool::SetPriority(int voice, float priority_)
+{
+    priority[voice] = priority_;
+}
+
+void SoundSourcePool::Update(const float3 &listenerPos)
+{
+    const size_t numVoices = inUse.size();
+
+    // Distances first in a pass of their own, which the compiler can vectorize.
+    for(size_t i = 0; i < numVoices; ++i)
+    {
+        const float dx = positionX[i] - listenerPos.x;
+        const float dy = positionY[i] - listenerPos.y;
+        const float dz = positionZ[i] - listenerPos.z;
+        distance[i] = std::sqrt(dx*dx + dy*dy + dz*dz);
+    }
+
+    // Between the radiuses the attenuation is interpolated and raised to the power of roll-off. Outer radius 0 means no attenuation.
+    for(size_t i = 0; i < numVoices; ++i)
+    {
+        float attenuation = 1.f;
+        const float range = outerRadius[i] - innerRadius[i];
+        if (positional[i] && outerRadius[i] != 0.f && range > 0.f && distance[i] > innerRadius[i])
+            attenuation = distance[i] >= outerRadius[i] ? 0.f : std::pow(1.f - (distance[i] - innerRadius[i]) / range, rollOff[i]);
+        attenuatedGain[i] = gain[i] * attenuation;
+    }
+
+    candidates.clear();
+    for(size_t i = 0; i < numVoices; ++i)
+    {
+        shouldHaveSource[i] = 0;
+        if (playing[i] && attenuatedGain[i] >= cInaudibleGain)
+            candidates.push_back(std::make_pair(attenuatedGain[i] * priority[i] * (source[i] ? cSourceHoldBias : 1.f), (int)i));
+    }
+
+    const size_t numReal = std::min(candidates.size(), (size_t)maxSources);
+    if (numReal < candidates.size())
+        std::nth_element(candidates.begin(), candidates.begin() + numReal, candidates.end(), std::greater<std::pair<float, int> >());
+    for(size_t i = 0; i < numReal; ++i)
+        shouldHaveSource[candidates[i].second] = 1;
+}
+
+ALuint SoundSourcePool::AcquireSource(int voice)
+{
+    if (source[voice])
+        return source[voice];
+
+    ALuint s = 0;
+    if (!freeSources.empty())
+    {
+        s = freeSources.back();
+        freeSources.pop_back();
+    }
+    else if (numSources < maxSources)
+    {
+        s = backend->CreateSource();
+        if (!s)
+        {
+            // The device has fewer sources than it claimed, do not try to go past this again.
+            LogWarning("SoundSourcePool: Could not create sound source, limiting to " + QString::number(numSources) + " sources.");
+            maxSources = numSources;
+            return 0;
+        }
+        ++numSources;
+    }
+
+    source[voice] = s;
+    return s;
+}
+
+void SoundSourcePool::ReleaseSource(int voice)
+{
+    ALuint s = source[voice];
+    if (!s)
+        return;
+
+    backend->Stop(s);
+    source[voice] = 0;
+    freeSources.push_back(s);
+    TrimSources();
+}
+
+SoundVoiceStats SoundSourcePool::Stats() const
+{
+    SoundVoiceStats stats;
+    for(size_t i = 0; i < inUse.size(); ++i)
+    {
+        if (!inUse[i])
+            continue;
+        ++stats.voices;
+        if (playing[i])
+        {
+            if (source[i])
+                ++stats.activeVoices;
+            else
+                ++stats.virtualVoices;
+        }
+    }
+    stats.sources = numSources;
+    stats.maxSources = maxSources;
+    return stats;
+}
+
+void SoundSourcePool::TrimSources()
+{
+    while(numSources > maxSources && !freeSources.empty())
+    {
+        backend->DeleteSource(freeSources.back());
+        freeSources.pop_back();
+        --numSources;
+    }
+}
@@ -0,0 +1,124 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "AudioFwd.h"
+#include "Math/float3.h"
+
+#include <vector>
+#include <utility>
+
+/// Counts of the voices of a SoundSourcePool.
+struct TUNDRACORE_API SoundVoiceStats
+{
+    SoundVoiceStats() : voices(0), activeVoices(0), virtualVoices(0), sources(0), maxSources(0) {}
+
+    /// Voices that exist, playing or not.
+    int voices;
+    /// Playing voices that have a source.
+    int activeVoices;
+    /// Playing voices without a source, because they are inaudible or lost their source to louder voices.
+    int virtualVoices;
+    /// Sources created to the backend, in use or free.
+    int sources;
+    /// The most sources the pool creates.
+    int maxSources;
+};
+
+/// Shares a fixed number of backend sources between any number of sound voices.
+/** Each sound channel has a voice, which holds the parameters the attenuation of the channel depends on. The parameters
+    are kept in separate arrays so that Update attenuates all voices in one pass. Update then chooses the loudest
+    playing voices, weighted by their priority, to have a source, up to the most sources of the pool. The other
+    playing voices are virtual: their channel keeps track of the playback position without a source, and continues
+    from it when the voice gets a source again. Voices that are inaudible at the listener position are always virtual.
+
+    The sources are created on first use, and are not deleted when they are released, but reused by the next voice. */
+class TUNDRACORE_API SoundSourcePool
+{
+public:
+    /// @param backend Backend to create the sources with. Must outlive the pool.
+    /// @param maxSources The most sources the pool creates.
+    SoundSourcePool(SoundBackend *backend, int maxSources);
+    /// Deletes all sources, including the ones still in use.
+    ~SoundSourcePool();
+
+    /// Returns the backend of the sources.
+    SoundBackend *Backend() const { return backend; }
+
+    /// Returns the most sources the pool creates.
+    int MaxSources() const { return maxSources; }
+    /// Sets the most sources the pool creates.
+    /** If there are more sources in use, the surplus voices become virtual on the next Update. */
+    void SetMaxSources(int maxSources);
+
+    /// Creates a voice. The voice is stopped, at full gain and not positional.
+    int CreateVoice();
+    /// Releases the source of a voice and destroys it.
+    void DestroyVoice(int voice);
+
+    /// Sets whether a voice is playing, and needs a source to be heard.
+    void SetPlaying(int voice, bool playing);
+    /// Sets the position of a voice.
+    void SetPosition(int voice, const float3 &position);
+    /// Sets whether a voice is attenuated by its distance from the listener.
+    void SetPositional(int voice, bool positional);
+    /// Sets the range parameters of a voice, see SoundChannel::SetRange.
+    void SetRange(int voice, float innerRadius, float outerRadius, float rollOff);
+    /// Sets the unattenuated gain of a voice.
+    void SetGain(int voice, float gain);
+    /// Sets the weight of a voice when choosing the voices that have a source. The default is 1.
+    void SetPriority(int voice, float priority);
+
+    /// Attenuates all voices with the listener position, and chooses the voices that should have a source.
+    void Update(const float3 &listenerPos);
+
+    /// Returns the gain of a voice attenuated by its distance from the listener on the last Update.
+    float AttenuatedGain(int voice) const { return attenuatedGain[voice]; }
+    /// Returns whether a voice was chosen to have a source on the last Update.
+    bool ShouldHaveSource(int voice) const { return shouldHaveSource[voice] != 0; }
+
+    /// Returns the source of a voice, or 0 if the voice is virtual.
+    ALuint Source(int voice) const { return source[voice]; }
+    /// Gives a source to a voice, if it does not have one yet.
+    /** @return The source, or 0 if all sources are in use or a source could not be created. */
+    ALuint AcquireSource(int voice);
+    /// Stops the source of a voice, and returns it to the pool.
+    void ReleaseSource(int voice);
+
+    /// Returns the counts of voices and sources.
+    SoundVoiceStats Stats() const;
+
+private:
+    /// Deletes free sources until there are at most maxSources.
+    void TrimSources();
+
+    SoundBackend *backend;
+    int maxSources;
+    /// Number of sources that exist, in use or free.
+    int numSources;
+    std::vector<ALuint> freeSources;
+    std::vector<int> freeVoices;
+
+    // Voice parameters, indexed by voice.
+    std::vector<float> positionX;
+    std::vector<float> positionY;
+    std::vector<float> positionZ;
+    std::vector<float> innerRadius;
+    std::vector<float> outerRadius;
+    std::vector<float> rollOff;
+    std::vector<float> gain;
+    std::vector<float> priority;
+    std::vector<u8> positional;
+    std::vector<u8> playing;
+    std::vector<u8> inUse;
+
+    // Results of Update, indexed by voice.
+    std::vector<float> distance;
+    std::vector<float> attenuatedGain;
+    std::vector<u8> shouldHaveSource;
+    std::vector<ALuint> source;
+
+    /// Weights and indices of the audible playing voices on Update. Kept to avoid allocating each update.
+    std::vector<std::pair<float, int> > candidates;
+};
@@ -193,6 +193,7 @@ Framework::Framework(int argc_, char** argv_, Application *app) :
         cmdLineDescs.commands["--connect"] = "Connects to a Tundra server automatically. Syntax: '--connect serverIp;port;protocol;name;password'. Password is optional."; // TundraLogicModule & AssetModule
         cmdLineDescs.commands["--login"] = "Automatically login to server using provided data. Url syntax: {tundra|http|https}://host[:port]/?username=x[&password=y&avatarurl=z&protocol={udp|tcp}]. Minimum information needed to try a connection in the url are host and username."; // TundraLogicModule & AssetModule
         cmdLineDescs.commands["--netRate"] = "Specifies the number of network updates per second. Default: 30."; // TundraLogicModule
+        cmdLineDescs.commands["--transformTolerance"] = "Specifies how far, in meters, the position of an entity may drift from the position extrapolated by a client before the server sends an update. Default: 0.03."; // TundraLogicModule
         cmdLineDescs.commands["--noAssetCache"] = "Disable asset cache."; // Framework
         cmdLineDescs.commands["--assetCacheDir"] = "Specify asset cache directory to use."; // Framework
         cmdLineDescs.commands["--clearAssetCache"] = "At the start of Tundra, remove all data and metadata files from asset cache."; // AssetCache
@@ -225,6 +226,10 @@ Framework::Framework(int argc_, char** argv_, Application *app) :
         cmdLineDescs.commands["--acceptUnknownLocalSources"] = "If specified, assets outside any known local storages are allowed. Otherwise, requests to them will fail."; // AssetModule
         cmdLineDescs.commands["--acceptUnknownHttpSources"] = "If specified, asset requests outside any registered HTTP storages are also accepted, and will appear as assets with no storage. "
             "Otherwise, all requests to assets outside any registered storage will fail."; // AssetModule
+        cmdLineDescs.commands["--loadTest"] = "Runs a load test with the given number of simulated users against a server, by default the one on this machine. Usage: '--loadTest <numUsers>'."; // LoadTestModule
+        cmdLineDescs.commands["--loadTestAddress"] = "Specifies the server of the load test. Usage: '--loadTestAddress <host[:port]>'. Default: 127.0.0.1 and the port of --port, or 2345."; // LoadTestModule
+        cmdLineDescs.commands["--loadTestProtocol"] = "Specifies the protocol of the load test: 'udp' or 'tcp'. Defaults to the protocol of --protocol, or udp."; // LoadTestModule
+        cmdLineDescs.commands["--loadTestDuration"] = "Specifies the length of the load test in seconds. Tundra exits after printing the final report."; // LoadTestModule
         cmdLineDescs.commands["--audioDevice"] = "Specifies the name of a specific audio device to be used for audio playback."; // AudioAPI
 
         LogInfo("Supported command line arguments (case-insensitive):");
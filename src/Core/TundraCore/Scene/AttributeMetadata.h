@@ -29,6 +29,16 @@ public:
         Interpolate
     };
 
+    /// Quantization of the attribute value in network replication.
+    /** Only used when both ends of the connection support quantized attributes, and only for static attributes, as the metadata
+        of dynamic attributes is not replicated. Values that do not fit the quantization are sent in full precision. */
+    enum QuantizationMode
+    {
+        NotQuantized, ///< Sent in full precision.
+        QuantizeRange, ///< Each component of a float, float2, float3, float4, Color or Transform attribute within [quantizeMin, quantizeMax] is sent with quantizeBits bits.
+        QuantizeSmallestThree ///< Quat attributes are sent as the three smallest components of the normalized quaternion, with quantizeBits bits each.
+    };
+
     /// Contains all information needed to create QPushButtons to ECEditor.
     struct ButtonInfo
     {
@@ -59,7 +69,7 @@ public:
     typedef std::map<int, QString> EnumDescMap_t;
 
     /// Default constructor.
-    AttributeMetadata() : interpolation(None), designable(true) {}
+    AttributeMetadata() : interpolation(None), designable(true), quantization(NotQuantized), quantizeMin(0.f), quantizeMax(0.f), quantizeBits(0) {}
 
     /// Constructor.
     /** @param desc Description.
@@ -77,8 +87,25 @@ public:
         step(step_),
         enums(enum_desc),
         interpolation(interpolation_),
-        designable(designable_)
+        designable(designable_),
+        quantization(NotQuantized),
+        quantizeMin(0.f),
+        quantizeMax(0.f),
+        quantizeBits(0)
+    {
+    }
+
+    /// Sets the network quantization of the attribute.
+    /** @param mode Quantization mode.
+        @param bits Bits per quantized component, clamped to [2, 24].
+        @param min Lower bound of the range for QuantizeRange.
+        @param max Upper bound of the range for QuantizeRange. */
+    void SetQuantization(QuantizationMode mode, int bits, float min = 0.f, float max = 0.f)
     {
+        quantization = mode;
+        quantizeBits = bits < 2 ? 2 : (bits > 24 ? 24 : bits);
+        quantizeMin = min;
+        quantizeMax = max;
     }
 
     /// Destructor.
@@ -111,6 +138,18 @@ public:
     /// Indicates if Attribute should be shown in designer/editor ui.
     bool designable;
 
+    /// Network quantization mode, see SetQuantization.
+    QuantizationMode quantization;
+
+    /// Lower bound of the quantization range.
+    float quantizeMin;
+
+    /// Upper bound of the quantization range.
+    float quantizeMax;
+
+    /// Bits per quantized component.
+    int quantizeBits;
+
 private:
     AttributeMetadata(const AttributeMetadata &);
     void operator=(const AttributeMetadata &);
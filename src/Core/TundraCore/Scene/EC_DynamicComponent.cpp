@@ -64,6 +64,19 @@ void EC_DynamicComponent::DeserializeFrom(QDomElement& element, AttributeChange:
     DeserializeCommon(deserializedAttributes, change);
 }
 
+void EC_DynamicComponent::DeserializeFrom(const ComponentDesc& desc, AttributeChange::Type change)
+{
+    if (!BeginDeserialization(desc))
+        return;
+
+    std::vector<AttributeDesc> deserializedAttributes(desc.attributes.begin(), desc.attributes.end());
+    for(size_t i = 0; i < deserializedAttributes.size(); ++i)
+        if (deserializedAttributes[i].id.isEmpty()) // Fallback if ID is not defined
+            deserializedAttributes[i].id = deserializedAttributes[i].name;
+
+    DeserializeCommon(deserializedAttributes, change);
+}
+
 void EC_DynamicComponent::DeserializeCommon(std::vector<AttributeDesc>& deserializedAttributes, AttributeChange::Type change)
 {
     // Sort both lists in alphabetical order.
@@ -69,6 +69,9 @@ public:
     /// IComponent override.
     void DeserializeFrom(QDomElement& element, AttributeChange::Type change);
 
+    /// IComponent override.
+    void DeserializeFrom(const ComponentDesc& desc, AttributeChange::Type change);
+
     /// IComponent override
     virtual void SerializeToBinary(kNet::DataSerializer& dest) const;
 
@@ -15,6 +15,7 @@
 #include "Profiler.h"
 
 #include <QDomDocument>
+#include <QXmlStreamWriter>
 
 #include <kNet/DataSerializer.h>
 #include <kNet/DataDeserializer.h>
@@ -524,6 +525,32 @@ void Entity::SerializeToXML(QDomDocument &doc, QDomElement &base_element, bool s
         doc.appendChild(entity_elem);
 }
 
+void Entity::SerializeToXML(QXmlStreamWriter& writer, bool serializeTemporary, bool serializeLocal, bool serializeChildren) const
+{
+    writer.writeStartElement("entity");
+    writer.writeAttribute("id", QString::number(Id()));
+    writer.writeAttribute("sync", BoolToString(IsReplicated()));
+    if (serializeTemporary)
+        writer.writeAttribute("temporary", BoolToString(IsTemporary()));
+
+    for (ComponentMap::const_iterator i = components_.begin(); i != components_.end(); ++i)
+        if (i->second->ShouldBeSerialized(serializeTemporary, serializeLocal))
+            i->second->SerializeTo(writer, serializeTemporary);
+
+    // Serialize child entities
+    if (serializeChildren)
+    {
+        for(ChildEntityVector::const_iterator i = children_.begin(); i != children_.end(); ++i)
+        {
+            const EntityPtr child = i->lock();
+            if (child && child->ShouldBeSerialized(serializeTemporary, serializeLocal, serializeChildren))
+                child->SerializeToXML(writer, serializeTemporary, serializeLocal);
+        }
+    }
+
+    writer.writeEndElement();
+}
+
 /* Disabled for now, since have to decide how entityID conflicts are handled.
 void Entity::DeserializeFromXML(QDomElement& element, AttributeChange::Type change)
 {
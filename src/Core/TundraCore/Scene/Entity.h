@@ -293,6 +293,9 @@ public slots:
         @param bool serializeLocal Serialize local entities. Default true.
         @param serializeChildren Serialize child entities. Default true.*/
     void SerializeToXML(QDomDocument& doc, QDomElement& base_element, bool serializeTemporary = false, bool serializeLocal = true, bool serializeChildren = true) const;
+    /// Serializes this entity and its' components to an XML stream. Produces the same <entity> element as the QDomDocument version.
+    /** @param writer The XML stream, positioned inside the <scene> element or the <entity> element of the parent. */
+    void SerializeToXML(QXmlStreamWriter& writer, bool serializeTemporary = false, bool serializeLocal = true, bool serializeChildren = true) const;
 //        void DeserializeFromXML(QDomElement& element, AttributeChange::Type change);
 
     /// Serializes this entity, and returns the generated XML as a string
@@ -10,6 +10,7 @@
 #include "IAttribute.h"
 #include "Entity.h"
 #include "IComponent.h"
+#include "AttributeMetadata.h"
 #include "CoreTypes.h"
 #include "CoreDefines.h"
 #include "Transform.h"
@@ -930,6 +931,291 @@ template<> void TUNDRACORE_API Attribute<QPoint>::FromBinary(kNet::DataDeseriali
     Set(value, change);
 }
 
+// QUANTIZED BINARY IMPLEMENTATIONS
+
+namespace
+{
+    /// Transform rotations are Euler angles in degrees and are sent with this many bits in [-180, 180].
+    const int cTransformAngleBits = 16;
+
+    /// Values below this are sent as variable-length integers, larger ones in full 32 bits.
+    const u32 cMaxVLEValue = 1 << 30;
+
+    void WriteCompactU32(kNet::DataSerializer &dest, u32 value)
+    {
+        if (value < cMaxVLEValue)
+        {
+            dest.Add<kNet::bit>(1);
+            dest.AddVLE<kNet::VLE8_16_32>(value);
+        }
+        else
+        {
+            dest.Add<kNet::bit>(0);
+            dest.Add<u32>(value);
+        }
+    }
+
+    u32 ReadCompactU32(kNet::DataDeserializer &source)
+    {
+        if (source.Read<kNet::bit>())
+            return source.ReadVLE<kNet::VLE8_16_32>();
+        return source.Read<u32>();
+    }
+
+    /// Writes a float quantized to the range, or in full precision after a cleared marker bit if it is outside the range.
+    void WriteQuantizedFloat(kNet::DataSerializer &dest, float minValue, float maxValue, int bits, float value)
+    {
+        if (value >= minValue && value <= maxValue) // Fails for NaNs as well.
+        {
+            dest.Add<kNet::bit>(1);
+            dest.AddQuantizedFloat(minValue, maxValue, bits, value);
+        }
+        else
+        {
+            dest.Add<kNet::bit>(0);
+            dest.Add<float>(value);
+        }
+    }
+
+    float ReadQuantizedFloat(kNet::DataDeserializer &source, float minValue, float maxValue, int bits)
+    {
+        if (!source.Read<kNet::bit>())
+            return source.Read<float>();
+        // Dequantize the same way as DataSerializer::AddQuantizedFloat quantizes.
+        const u32 quantized = source.ReadBits(bits);
+        return minValue + quantized * (maxValue - minValue) / (float)((1 << bits) - 1);
+    }
+
+    /// Writes the float components of a value with the range quantization of the metadata.
+    void WriteQuantizedFloats(kNet::DataSerializer &dest, const AttributeMetadata &meta, const float *values, int count)
+    {
+        for(int i = 0; i < count; ++i)
+            WriteQuantizedFloat(dest, meta.quantizeMin, meta.quantizeMax, meta.quantizeBits, values[i]);
+    }
+
+    void ReadQuantizedFloats(kNet::DataDeserializer &source, const AttributeMetadata &meta, float *values, int count)
+    {
+        for(int i = 0; i < count; ++i)
+            values[i] = ReadQuantizedFloat(source, meta.quantizeMin, meta.quantizeMax, meta.quantizeBits);
+    }
+
+    /// Writes a quaternion as the index of its largest component followed by the three other components of the normalized quaternion.
+    /** The sign of the quaternion is flipped to make the largest component positive, so it can be recovered from the unit length.
+        The three smallest components of a unit quaternion are within [-1/sqrt(2), 1/sqrt(2)]. Quaternions that are not
+        normalized are sent in full precision after a cleared marker bit. */
+    void WriteSmallestThree(kNet::DataSerializer &dest, const Quat &q, int bits)
+    {
+        if (!q.IsNormalized())
+        {
+            dest.Add<kNet::bit>(0);
+            dest.Add<float>(q.x);
+            dest.Add<float>(q.y);
+            dest.Add<float>(q.z);
+            dest.Add<float>(q.w);
+            return;
+        }
+
+        const Quat n = q.Normalized();
+        const float components[4] = { n.x, n.y, n.z, n.w };
+        int largest = 0;
+        for(int i = 1; i < 4; ++i)
+            if (Abs(components[i]) > Abs(components[largest]))
+                largest = i;
+        const float sign = components[largest] < 0.f ? -1.f : 1.f;
+        const float range = 1.f / Sqrt(2.f);
+
+        dest.Add<kNet::bit>(1);
+        dest.AppendBits(largest, 2);
+        for(int i = 0; i < 4; ++i)
+            if (i != largest)
+                dest.AddQuantizedFloat(-range, range, bits, Clamp(sign * components[i], -range, range));
+    }
+
+    Quat ReadSmallestThree(kNet::DataDeserializer &source, int bits)
+    {
+        Quat q;
+        if (!source.Read<kNet::bit>())
+        {
+            q.x = source.Read<float>();
+            q.y = source.Read<float>();
+            q.z = source.Read<float>();
+            q.w = source.Read<float>();
+            return q;
+        }
+
+        const int largest = (int)source.ReadBits(2);
+        const float range = 1.f / Sqrt(2.f);
+        float components[4];
+        float sumSq = 0.f;
+        for(int i = 0; i < 4; ++i)
+        {
+            if (i == largest)
+                continue;
+            components[i] = -range + source.ReadBits(bits) * 2.f * range / (float)((1 << bits) - 1);
+            sumSq += components[i] * components[i];
+        }
+        components[largest] = Sqrt(Max(0.f, 1.f - sumSq));
+        q.x = components[0];
+        q.y = components[1];
+        q.z = components[2];
+        q.w = components[3];
+        return q;
+    }
+}
+
+void IAttribute::ToQuantizedBinary(kNet::DataSerializer& dest, bool useMetadata) const
+{
+    // The metadata of dynamic attributes is not replicated, so the other end can not know their quantization.
+    const AttributeMetadata *meta = (useMetadata && !dynamic && metadata && metadata->quantization != AttributeMetadata::NotQuantized) ? metadata : 0;
+    const bool range = meta && meta->quantization == AttributeMetadata::QuantizeRange;
+
+    switch(TypeId())
+    {
+    case BoolId:
+        dest.Add<kNet::bit>(static_cast<const Attribute<bool>*>(this)->Get() ? 1 : 0);
+        break;
+    case IntId:
+    {
+        // Zigzag encoding keeps small negative values small.
+        const s32 value = static_cast<const Attribute<int>*>(this)->Get();
+        WriteCompactU32(dest, ((u32)value << 1) ^ (u32)(value >> 31));
+        break;
+    }
+    case UIntId:
+        WriteCompactU32(dest, static_cast<const Attribute<uint>*>(this)->Get());
+        break;
+    case RealId:
+    case Float2Id:
+    case Float3Id:
+    case Float4Id:
+    case ColorId:
+        if (range)
+        {
+            float values[4];
+            int count = 1;
+            switch(TypeId())
+            {
+            case RealId: values[0] = static_cast<const Attribute<float>*>(this)->Get(); break;
+            case Float2Id: { float2 v = static_cast<const Attribute<float2>*>(this)->Get(); values[0] = v.x; values[1] = v.y; count = 2; break; }
+            case Float3Id: { float3 v = static_cast<const Attribute<float3>*>(this)->Get(); values[0] = v.x; values[1] = v.y; values[2] = v.z; count = 3; break; }
+            case Float4Id: { float4 v = static_cast<const Attribute<float4>*>(this)->Get(); values[0] = v.x; values[1] = v.y; values[2] = v.z; values[3] = v.w; count = 4; break; }
+            default: { Color v = static_cast<const Attribute<Color>*>(this)->Get(); values[0] = v.r; values[1] = v.g; values[2] = v.b; values[3] = v.a; count = 4; break; }
+            }
+            WriteQuantizedFloats(dest, *meta, values, count);
+        }
+        else
+            ToBinary(dest);
+        break;
+    case QuatId:
+        if (meta && meta->quantization == AttributeMetadata::QuantizeSmallestThree)
+            WriteSmallestThree(dest, static_cast<const Attribute<Quat>*>(this)->Get(), meta->quantizeBits);
+        else
+            ToBinary(dest);
+        break;
+    case TransformId:
+        if (range)
+        {
+            const Transform &t = static_cast<const Attribute<Transform>*>(this)->Get();
+            WriteQuantizedFloats(dest, *meta, t.pos.ptr(), 3);
+            for(int i = 0; i < 3; ++i)
+                WriteQuantizedFloat(dest, -180.f, 180.f, cTransformAngleBits, t.rot[i]);
+            // Unit scale is by far the most common one, and is sent exactly with a single bit.
+            const bool unitScale = t.scale.x == 1.f && t.scale.y == 1.f && t.scale.z == 1.f;
+            dest.Add<kNet::bit>(unitScale ? 1 : 0);
+            if (!unitScale)
+                WriteQuantizedFloats(dest, *meta, t.scale.ptr(), 3);
+        }
+        else
+            ToBinary(dest);
+        break;
+    default:
+        ToBinary(dest);
+        break;
+    }
+}
+
+void IAttribute::FromQuantizedBinary(kNet::DataDeserializer& source, AttributeChange::Type change, bool useMetadata)
+{
+    const AttributeMetadata *meta = (useMetadata && !dynamic && metadata && metadata->quantization != AttributeMetadata::NotQuantized) ? metadata : 0;
+    const bool range = meta && meta->quantization == AttributeMetadata::QuantizeRange;
+
+    switch(TypeId())
+    {
+    case BoolId:
+        static_cast<Attribute<bool>*>(this)->Set(source.Read<kNet::bit>() != 0, change);
+        break;
+    case IntId:
+    {
+        const u32 zigzag = ReadCompactU32(source);
+        static_cast<Attribute<int>*>(this)->Set((s32)(zigzag >> 1) ^ -(s32)(zigzag & 1), change);
+        break;
+    }
+    case UIntId:
+        static_cast<Attribute<uint>*>(this)->Set(ReadCompactU32(source), change);
+        break;
+    case RealId:
+    case Float2Id:
+    case Float3Id:
+    case Float4Id:
+    case ColorId:
+        if (range)
+        {
+            float values[4];
+            switch(TypeId())
+            {
+            case RealId:
+                ReadQuantizedFloats(source, *meta, values, 1);
+                static_cast<Attribute<float>*>(this)->Set(values[0], change);
+                break;
+            case Float2Id:
+                ReadQuantizedFloats(source, *meta, values, 2);
+                static_cast<Attribute<float2>*>(this)->Set(float2(values[0], values[1]), change);
+                break;
+            case Float3Id:
+                ReadQuantizedFloats(source, *meta, values, 3);
+                static_cast<Attribute<float3>*>(this)->Set(float3(values[0], values[1], values[2]), change);
+                break;
+            case Float4Id:
+                ReadQuantizedFloats(source, *meta, values, 4);
+                static_cast<Attribute<float4>*>(this)->Set(float4(values[0], values[1], values[2], values[3]), change);
+                break;
+            default:
+                ReadQuantizedFloats(source, *meta, values, 4);
+                static_cast<Attribute<Color>*>(this)->Set(Color(values[0], values[1], values[2], values[3]), change);
+                break;
+            }
+        }
+        else
+            FromBinary(source, change);
+        break;
+    case QuatId:
+        if (meta && meta->quantization == AttributeMetadata::QuantizeSmallestThree)
+            static_cast<Attribute<Quat>*>(this)->Set(ReadSmallestThree(source, meta->quantizeBits), change);
+        else
+            FromBinary(source, change);
+        break;
+    case TransformId:
+        if (range)
+        {
+            Transform t;
+            ReadQuantizedFloats(source, *meta, t.pos.ptr(), 3);
+            for(int i = 0; i < 3; ++i)
+                t.rot[i] = ReadQuantizedFloat(source, -180.f, 180.f, cTransformAngleBits);
+            if (source.Read<kNet::bit>())
+                t.scale = float3::one;
+            else
+                ReadQuantizedFloats(source, *meta, t.scale.ptr(), 3);
+            static_cast<Attribute<Transform>*>(this)->Set(t, change);
+        }
+        else
+            FromBinary(source, change);
+        break;
+    default:
+        FromBinary(source, change);
+        break;
+    }
+}
+
 // INTERPOLATE TEMPLATE IMPLEMENTATIONS
 
 template<> void TUNDRACORE_API Attribute<QString>::Interpolate(IAttribute* /*start*/, IAttribute* /*end*/, float /*t*/, AttributeChange::Type /*change*/)
@@ -73,6 +73,18 @@ public:
     /// Reads attribute from binary for binary deserialization
     virtual void FromBinary(kNet::DataDeserializer& source, AttributeChange::Type change) = 0;
 
+    /// Writes attribute to binary for network replication, using the compact encoding of the attribute type.
+    /** Booleans are sent as single bits and integers as variable-length integers. Float-based values are quantized
+        according to the quantization of the metadata of static attributes, see AttributeMetadata::QuantizationMode.
+        Other values are written as with ToBinary. Both ends must have the same metadata for the attribute.
+        @param useMetadata False to write float-based values at full precision regardless of the metadata, e.g. when the other end
+        may only have a placeholder component without the metadata. */
+    void ToQuantizedBinary(kNet::DataSerializer& dest, bool useMetadata = true) const;
+
+    /// Reads attribute from binary written by ToQuantizedBinary.
+    /** @param useMetadata Has to be the same as when the value was written. */
+    void FromQuantizedBinary(kNet::DataDeserializer& source, AttributeChange::Type change, bool useMetadata = true);
+
     /// Returns the value as QVariant (For scripts).
     virtual QVariant ToQVariant() const = 0;
 
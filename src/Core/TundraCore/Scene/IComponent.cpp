@@ -17,6 +17,7 @@
 #include "LoggingFunctions.h"
 
 #include <QDomDocument>
+#include <QXmlStreamWriter>
 
 #include <kNet.h>
 
@@ -504,6 +505,17 @@ bool IComponent::BeginDeserialization(QDomElement& compElem)
     return false;
 }
 
+bool IComponent::BeginDeserialization(const ComponentDesc& desc)
+{
+    if (desc.typeId == TypeId() || EnsureTypeNameWithPrefix(desc.typeName) == TypeName())
+    {
+        SetName(desc.name);
+        return true;
+    }
+
+    return false;
+}
+
 void IComponent::EmitAttributeChanged(IAttribute* attribute, AttributeChange::Type change)
 {
     // If this message should be sent with the default attribute change mode specified in the IComponent,
@@ -560,6 +572,31 @@ void IComponent::SerializeTo(QDomDocument& doc, QDomElement& base_element, bool
             WriteAttribute(doc, comp_element, attributes[i]);
 }
 
+void IComponent::SerializeTo(QXmlStreamWriter& writer, bool serializeTemporary) const
+{
+    writer.writeStartElement("component");
+    writer.writeAttribute("type", EnsureTypeNameWithoutPrefix(TypeName()));
+    writer.writeAttribute("typeId", QString::number(TypeId()));
+    if (!Name().isEmpty())
+        writer.writeAttribute("name", Name());
+    writer.writeAttribute("sync", BoolToString(replicated));
+    if (serializeTemporary)
+        writer.writeAttribute("temporary", BoolToString(temporary));
+
+    for(uint i = 0; i < attributes.size(); ++i)
+    {
+        if (!attributes[i])
+            continue;
+        writer.writeEmptyElement("attribute");
+        writer.writeAttribute("name", attributes[i]->Name());
+        writer.writeAttribute("id", attributes[i]->Id());
+        writer.writeAttribute("value", attributes[i]->ToString());
+        writer.writeAttribute("type", attributes[i]->TypeName());
+    }
+
+    writer.writeEndElement();
+}
+
 void IComponent::DeserializeFrom(QDomElement& element, AttributeChange::Type change)
 {
     if (!BeginDeserialization(element))
@@ -602,6 +639,35 @@ void IComponent::DeserializeAttributeFrom(QDomElement& attributeElement, Attribu
         attr->FromString(attributeElement.attribute("value"), change);
 }
 
+void IComponent::DeserializeFrom(const ComponentDesc& desc, AttributeChange::Type change)
+{
+    if (!BeginDeserialization(desc))
+        return;
+
+    if (change == AttributeChange::Default)
+        change = updateMode;
+    assert(change != AttributeChange::Default);
+
+    // Like with the XML element, only the attributes present in the description are applied.
+    for(int i = 0; i < desc.attributes.size(); ++i)
+        DeserializeAttributeFrom(desc.attributes[i], change);
+}
+
+void IComponent::DeserializeAttributeFrom(const AttributeDesc& attributeDesc, AttributeChange::Type change)
+{
+    IAttribute* attr = 0;
+    // Prefer lookup by ID if it's specified, but fallback to using attribute's human-readable name if ID not defined or erroneous.
+    if (!attributeDesc.id.isEmpty())
+        attr = AttributeById(attributeDesc.id);
+    if (!attr)
+        attr = AttributeByName(attributeDesc.name);
+
+    if (!attr)
+        LogWarning(TypeName() + "::DeserializeFrom: Could not find attribute \"" + (attributeDesc.name.isEmpty() ? attributeDesc.id : attributeDesc.name) + "\" specified in the component description.");
+    else
+        attr->FromString(attributeDesc.value, change);
+}
+
 void IComponent::SerializeToBinary(kNet::DataSerializer& dest) const
 {
     dest.Add<u8>((u8)attributes.size());
@@ -633,9 +699,34 @@ void IComponent::ComponentChanged(AttributeChange::Type change)
     // We are signalling attribute changes, but the desired change type is saying "don't signal about changes".
     assert(change != AttributeChange::Default && change != AttributeChange::Disconnected);
 
+    // Signal the attributes in the same order as EmitAttributeChanged does, but as the derived class reacts to all
+    // of the changed attributes at once, notify it again only if a handler of the signals has changed some attribute since.
+    Scene* scene = ParentScene();
+    bool notified = false;
     for(uint i = 0; i < attributes.size(); ++i)
-        if (attributes[i])
-            EmitAttributeChanged(attributes[i], change);
+    {
+        if (!attributes[i])
+            continue;
+        if (scene)
+            scene->EmitAttributeChanged(this, attributes[i], change);
+        emit AttributeChanged(attributes[i], change);
+
+        if (notified && !HasChangedAttributes())
+            continue;
+        AttributesChanged();
+        for(size_t j = 0; j < attributes.size(); ++j)
+            if (attributes[j])
+                attributes[j]->ClearChangedFlag();
+        notified = true;
+    }
+}
+
+bool IComponent::HasChangedAttributes() const
+{
+    for(size_t i = 0; i < attributes.size(); ++i)
+        if (attributes[i] && attributes[i]->ValueChanged())
+            return true;
+    return false;
 }
 
 void IComponent::SetTemporary(bool enable)
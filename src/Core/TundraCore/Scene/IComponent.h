@@ -17,6 +17,7 @@
 
 class QDomDocument;
 class QDomElement;
+class QXmlStreamWriter;
 
 class Framework;
 
@@ -174,6 +175,12 @@ public:
             is only for metadata purposes and doesn't have an actual effect. The default value is false.*/
     virtual void SerializeTo(QDomDocument& doc, QDomElement& baseElement, bool serializeTemporary = false) const;
 
+    /// Serializes this component and all its Attributes to an XML stream.
+    /** Produces the same <component> element as the QDomDocument version, written at the current position of @c writer.
+        @param writer The XML stream, positioned inside the <entity> element that owns this component.
+        @param serializeTemporary Whether to write the temporary flag of the component. The default value is false. */
+    virtual void SerializeTo(QXmlStreamWriter& writer, bool serializeTemporary = false) const;
+
     /// Deserializes this component from the given XML document.
     /** @param element Points to the <component> element that is the root of the serialized form of this Component.
         @param change Specifies the source of this change. This field controls whether the deserialization
@@ -181,6 +188,12 @@ public:
                      the network and only local application of the data suffices. */
     virtual void DeserializeFrom(QDomElement& element, AttributeChange::Type change);
 
+    /// Deserializes this component from a component description, f.ex. one read by SceneXmlReader.
+    /** Applies the attribute values present in the description the same way as the QDomDocument version.
+        @param desc Description of the component. The type ID or the type name must match this component.
+        @param change Specifies the source of this change. */
+    virtual void DeserializeFrom(const ComponentDesc& desc, AttributeChange::Type change);
+
     /// Serialize attributes to binary
     /** @note does not include sync mode, type name or name. These are left for higher-level logic, and
         it depends on the situation if they are needed or not */
@@ -334,7 +347,9 @@ public slots:
 
     /// Informs that every attribute in this Component has changed with the change
     /** you specify. If change is Replicate, or it is Default and the UpdateMode is Replicate,
-        every attribute will be synced to the network. */
+        every attribute will be synced to the network. The signals are emitted for each attribute in turn, followed by
+        AttributesChanged as with EmitAttributeChanged, but AttributesChanged is called again only if some attribute
+        has changed value since the previous call. */
     void ComponentChanged(AttributeChange::Type change);
 
     /// Returns the Entity this Component is part of.
@@ -416,6 +431,7 @@ signals:
 protected:
     /// Deserializes a single attribute.
     void DeserializeAttributeFrom(QDomElement& attributeElement, AttributeChange::Type change);
+    void DeserializeAttributeFrom(const AttributeDesc& attributeDesc, AttributeChange::Type change); /**< @overload */
 
     /// Helper function for starting component serialization.
     /** This function creates an XML element <component> with the name of this component, adds it to the document, and returns it. 
@@ -430,6 +446,7 @@ protected:
     /** Checks that XML element contains the right kind of EC, and if it is right, sets the component name.
         Otherwise returns false and does nothing. */
     bool BeginDeserialization(QDomElement& compElement);
+    bool BeginDeserialization(const ComponentDesc& desc); /**< @overload */
 
     /// Add attribute to this component.
     /** If the attribute is dynamic, a matching QObject property will be automatically added to this component.
@@ -483,6 +500,9 @@ private:
     /// and after reacting to the change, call IAttribute::ClearChangedFlag().
     virtual void AttributesChanged() {}
 
+    /// Returns true if some attribute has changed value and AttributesChanged has not reacted to it yet.
+    bool HasChangedAttributes() const;
+
     /// Set component id. Called by Entity
     void SetNewId(component_id_t newId);
 
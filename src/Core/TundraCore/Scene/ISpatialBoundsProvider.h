@@ -0,0 +1,47 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "CoreTypes.h"
+#include "Math/MathFwd.h"
+
+class IComponent;
+class SpatialWorld;
+
+/// A common interface for computing the world space bounds of components of one type for SpatialWorld.
+/** Modules register a provider for each component type that has a spatial extent with SceneAPI::RegisterSpatialBoundsProvider.
+    The bounds of an entity are the union of the bounds of its components. Attribute changes of the handled component type mark
+    the entity for a refit automatically. Changes that do not go through attributes, e.g. a mesh asset finishing loading,
+    must be connected to SpatialWorld::MarkComponentDirty in ConnectChangeSignals. */
+class TUNDRACORE_API ISpatialBoundsProvider
+{
+public:
+    ISpatialBoundsProvider() {}
+    virtual ~ISpatialBoundsProvider() {}
+
+    /// Returns the type id of the component type this provider handles.
+    virtual u32 ComponentTypeId() const = 0;
+
+    /// Computes the world space bounds of the component.
+    /** @return False if the component does not currently have valid bounds, e.g. its mesh is not loaded yet. */
+    virtual bool WorldBounds(IComponent *component, AABB &outBounds) const = 0;
+
+    /// Returns true if the bounds of this provider are used only when no other component of the entity has bounds.
+    /** For example the position of a placeable is used for entities that do not have any geometry. */
+    virtual bool IsFallback() const { return false; }
+
+    /// Returns the selection layer bitmask of the entity, if this component defines one.
+    virtual bool SelectionLayer(IComponent * /*component*/, u32 & /*outLayer*/) const { return false; }
+
+    /// Returns true if this provider implements an exact Raycast test. Otherwise the ray is tested against the bounds.
+    virtual bool SupportsRaycast() const { return false; }
+
+    /// Tests the ray against the actual geometry of the component.
+    /** @param outDistance [out] Distance along the ray to the hit.
+        @param outNormal [out] World space normal of the surface at the hit. */
+    virtual bool Raycast(IComponent * /*component*/, const Ray & /*ray*/, float /*maxDistance*/, float & /*outDistance*/, float3 & /*outNormal*/) const { return false; }
+
+    /// Connects any change signals of the component that do not go through attributes to SpatialWorld::MarkComponentDirty.
+    virtual void ConnectChangeSignals(IComponent * /*component*/, SpatialWorld * /*world*/) const {}
+};
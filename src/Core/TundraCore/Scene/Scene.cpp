@@ -7,6 +7,7 @@
 #include "Scene/Scene.h"
 #include "Entity.h"
 #include "SceneDesc.h"
+#include "SceneXmlReader.h"
 #include "IComponent.h"
 #include "IAttribute.h"
 #include "EC_Name.h"
@@ -19,14 +20,24 @@
 #include "FrameAPI.h"
 #include "Profiler.h"
 #include "LoggingFunctions.h"
+#include "Transform.h"
+#include "Color.h"
+#include "Math/Quat.h"
+#include "Math/float2.h"
+#include "Math/float4.h"
 
 #include <QString>
 #include <QRegExp>
 #include <QDomDocument>
+#include <QXmlStreamWriter>
+#include <QBuffer>
 #include <QFile>
 #include <QDir>
 #include <QTextStream>
 #include <QHash>
+#include <QSet>
+#include <QThread>
+#include <QPoint>
 
 #include <kNet/DataDeserializer.h>
 #include <kNet/DataSerializer.h>
@@ -37,6 +48,12 @@
 
 using namespace kNet;
 
+namespace
+{
+    /// Number of entities LoadSceneXML creates before signaling them.
+    const int cXmlImportBatchSize = 1000;
+}
+
 Scene::Scene(const QString &name, Framework *framework, bool viewEnabled, bool authority) :
     name_(name),
     framework_(framework),
@@ -461,60 +478,72 @@ QByteArray Scene::GetSceneXML(bool serializeTemporary, bool serializeLocal) cons
 
 QList<Entity *> Scene::LoadSceneXML(const QString& filename, bool clearScene, bool useEntityIDsFromFile, AttributeChange::Type change)
 {
-    QList<Entity *> ret;
-
     QFile file(filename);
     if (!file.open(QIODevice::ReadOnly))
     {
         LogError("Scene::LoadSceneXML: Failed to open file " + filename + ".");
-        return ret;
+        return QList<Entity *>();
     }
 
-    QTextStream stream(&file);
-    stream.setCodec("UTF-8");
-    QDomDocument scene_doc("Scene");
-    QString errorMsg;
-    int errorLine, errorColumn;
-    if (!scene_doc.setContent(stream.readAll(), &errorMsg, &errorLine, &errorColumn))
+    SceneXmlReader reader(&file, QThread::idealThreadCount());
+    if (!reader.ReadSceneStart())
     {
-        LogError(QString("Scene::LoadSceneXML: Parsing scene XML from %1 failed when loading Scene XML: %2 at line %3 column %4.")
-            .arg(filename).arg(errorMsg).arg(errorLine).arg(errorColumn));
-        file.close();
-        return ret;
+        LogError(QString("Scene::LoadSceneXML: Could not find 'scene' element from %1. %2").arg(filename).arg(reader.ErrorString()));
+        return QList<Entity *>();
     }
 
     // Purge all old entities. Send events for the removal
     if (clearScene)
         RemoveAllEntities(true, change);
 
-    return CreateContentFromXml(scene_doc, useEntityIDsFromFile, change);
+    return CreateContentFromXml(reader, useEntityIDsFromFile, change, cXmlImportBatchSize);
 }
 
 QByteArray Scene::SerializeToXmlString(bool serializeTemporary, bool serializeLocal) const
 {
-    QDomDocument sceneDoc("Scene");
-    QDomElement sceneElem = sceneDoc.createElement("scene");
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+    SerializeToXml(&buffer, serializeTemporary, serializeLocal);
+    return bytes;
+}
+
+bool Scene::SerializeToXml(QIODevice *device, bool serializeTemporary, bool serializeLocal) const
+{
+    if (!device || !device->isWritable())
+    {
+        LogError("Scene::SerializeToXml: Device is not open for writing.");
+        return false;
+    }
+
+    QXmlStreamWriter writer(device);
+    writer.setAutoFormatting(true);
+    writer.setAutoFormattingIndent(1);
+    writer.writeDTD("<!DOCTYPE Scene>");
+    writer.writeStartElement("scene");
 
     const bool serializeChildren = true;
 
     foreach(const EntityPtr ent, RootLevelEntities())
         if (ent->ShouldBeSerialized(serializeTemporary, serializeLocal, serializeChildren))
-            ent->SerializeToXML(sceneDoc, sceneElem, serializeTemporary, serializeLocal, serializeChildren);
+            ent->SerializeToXML(writer, serializeTemporary, serializeLocal, serializeChildren);
 
-    sceneDoc.appendChild(sceneElem);
+    writer.writeEndElement();
+    writer.writeEndDocument();
 
-    return sceneDoc.toByteArray();
+    return !writer.hasError();
 }
 
 bool Scene::SaveSceneXML(const QString& filename, bool serializeTemporary, bool serializeLocal) const
 {
-    const QByteArray bytes = SerializeToXmlString(serializeTemporary, serializeLocal);
     QFile scenefile(filename);
     if (scenefile.open(QFile::WriteOnly))
     {
-        scenefile.write(bytes);
+        const bool success = SerializeToXml(&scenefile, serializeTemporary, serializeLocal);
         scenefile.close();
-        return true;
+        if (!success)
+            LogError("SaveSceneXML: Failed to write file " + filename + ".");
+        return success;
     }
     else
     {
@@ -588,18 +617,121 @@ bool Scene::SaveSceneBinary(const QString& filename, bool serializeTemporary, bo
 
 QList<Entity *> Scene::CreateContentFromXml(const QString &xml,  bool useEntityIDsFromFile, AttributeChange::Type change)
 {
+    SceneXmlReader reader(xml);
+    if (!reader.ReadSceneStart())
+    {
+        LogError("Scene::CreateContentFromXml: Could not find 'scene' element from XML. " + reader.ErrorString());
+        return QList<Entity*>();
+    }
+
+    return CreateContentFromXml(reader, useEntityIDsFromFile, change, 0);
+}
+
+QList<Entity *> Scene::CreateContentFromXml(QIODevice *device, bool useEntityIDsFromFile, AttributeChange::Type change, int batchSize)
+{
+    if (!device || !device->isReadable())
+    {
+        LogError("Scene::CreateContentFromXml: Device is not open for reading.");
+        return QList<Entity*>();
+    }
+
+    SceneXmlReader reader(device, QThread::idealThreadCount());
+    if (!reader.ReadSceneStart())
+    {
+        LogError("Scene::CreateContentFromXml: Could not find 'scene' element from XML. " + reader.ErrorString());
+        return QList<Entity*>();
+    }
+
+    return CreateContentFromXml(reader, useEntityIDsFromFile, change, batchSize);
+}
+
+QList<Entity *> Scene::CreateContentFromXml(SceneXmlReader &reader, bool useEntityIDsFromFile, AttributeChange::Type change, int batchSize)
+{
+    if (!IsAuthority() && parentTracker_.IsTracking())
+    {
+        LogError("Scene::CreateContentFromXml: Still waiting for previous content creation to complete on the server. Try again after it completes.");
+        return QList<Entity*>();
+    }
+
+    QList<EntityWeakPtr> entities;
+    QList<Entity *> batch;
+    QList<EntityWeakPtr> unresolvedParents;
+    EntityIdMap oldToNewIds;
+    EntityDesc entityDesc;
+    QString storageSpecifier;
+
+    bool done = false;
+    while(!done)
+    {
+        // Only one root-level entity, with its children, is held in memory at a time.
+        switch(reader.ReadNext(entityDesc, storageSpecifier))
+        {
+        case SceneXmlReader::Storage:
+            framework_->Asset()->DeserializeAssetStorageFromString(Application::ParseWildCardFilename(storageSpecifier), false);
+            break;
+        case SceneXmlReader::RootEntity:
+            CreateEntityFromDesc(EntityPtr(), entityDesc, useEntityIDsFromFile, change, batch, oldToNewIds);
+            break;
+        case SceneXmlReader::Error:
+            LogError("Scene::CreateContentFromXml: Parsing scene XML failed: " + reader.ErrorString() + ". Only the content preceding the error was created.");
+            done = true;
+            break;
+        default:
+            done = true;
+            break;
+        }
+
+        // Signal the entities in batches so that the scene is populated while the rest of the XML is still being read.
+        if (batch.isEmpty() || (!done && (batchSize <= 0 || batch.size() < batchSize)))
+            continue;
+
+        QList<EntityWeakPtr> batchEntities;
+        batchEntities.reserve(batch.size());
+        foreach(Entity *entity, batch)
+            batchEntities << entity->shared_from_this();
+        batch.clear();
+
+        // Sort the entity list so that parents are before children.
+        // This is done to combat the runtime detection of "parent entity/placeable created"
+        // that slows down the import considerably on large scenes that relies heavily on parenting.
+        QList<EntityWeakPtr> sortedBatch = SortEntities(batchEntities);
+
+        // Fix parent ref of EC_Placeable if new entity IDs were generated.
+        // This should be done first so that we wont be firing signals
+        // with partially updated state (these ends are already in the scene for querying).
+        if (!useEntityIDsFromFile)
+        {
+            // Parent refs to entities further in the file are fixed once all the entities have been created.
+            if (!done)
+            {
+                foreach(const EntityWeakPtr &weakEnt, sortedBatch)
+                {
+                    const entity_id_t refId = PlaceableParentId(weakEnt.lock().get());
+                    if (refId > 0 && !oldToNewIds.contains(refId))
+                        unresolvedParents << weakEnt;
+                }
+            }
+            FixPlaceableParentIds(sortedBatch, oldToNewIds, AttributeChange::Disconnected);
+        }
+
+        EmitContentCreated(sortedBatch, change);
+        entities << sortedBatch;
+    }
+
+    // The entities have already been signaled, so the late parent ref fixes are signaled as regular attribute changes.
+    if (!unresolvedParents.isEmpty())
+        FixPlaceableParentIds(unresolvedParents, oldToNewIds, change);
+
+    // The above signals may have caused scripts to remove entities. Return those that still exist.
     QList<Entity *> ret;
-    QString errorMsg;
-    QDomDocument scene_doc("Scene");
-    int errorLine, errorColumn;
-    if (!scene_doc.setContent(xml, false, &errorMsg, &errorLine, &errorColumn))
+    ret.reserve(entities.size());
+    for(int i=0, len=entities.size(); i<len; ++i)
     {
-        LogError(QString("Scene::CreateContentFromXml: Parsing scene XML from text failed when loading Scene XML: %1 at line %2 column %3.")
-            .arg(errorMsg).arg(errorLine).arg(errorColumn));
-        return ret;
+        if (!entities[i].expired())
+            ret.append(entities[i].lock().get());
     }
 
-    return CreateContentFromXml(scene_doc, useEntityIDsFromFile, change);
+    return ret;
 }
 
 QList<Entity *> Scene::CreateContentFromXml(const QDomDocument &xml, bool useEntityIDsFromFile, AttributeChange::Type change)
@@ -655,16 +787,47 @@ QList<Entity *> Scene::CreateContentFromXml(const QDomDocument &xml, bool useEnt
         FixPlaceableParentIds(sortedDescEntities, oldToNewIds, AttributeChange::Disconnected);
 
     // Now that we have each entity spawned to the scene, trigger all the signals for EntityCreated/ComponentChanged messages.
+    EmitContentCreated(sortedDescEntities, change);
+    
+    // The above signals may have caused scripts to remove entities. Return those that still exist.
+    QList<Entity *> ret;
+    ret.reserve(sortedDescEntities.size());
     for(int i=0, len=sortedDescEntities.size(); i<len; ++i)
     {
-        EntityWeakPtr weakEnt = sortedDescEntities[i];
+        if (!sortedDescEntities[i].expired())
+            ret.append(sortedDescEntities[i].lock().get());
+    }
+    
+    return ret;
+}
+
+void Scene::EmitContentCreated(const QList<EntityWeakPtr> &entities, AttributeChange::Type change)
+{
+    // Remove the whole batch from the frame end signalling queue in one pass, instead of searching the queue once per entity.
+    if (!entitiesCreatedThisFrame_.empty())
+    {
+        QSet<Entity *> batch;
+        batch.reserve(entities.size());
+        for(int i=0, len=entities.size(); i<len; ++i)
+            batch.insert(entities[i].lock().get());
+        size_t numQueued = 0;
+        for(size_t i = 0; i < entitiesCreatedThisFrame_.size(); ++i)
+            if (!batch.contains(entitiesCreatedThisFrame_[i].first.lock().get()))
+                entitiesCreatedThisFrame_[numQueued++] = entitiesCreatedThisFrame_[i];
+        entitiesCreatedThisFrame_.resize(numQueued);
+    }
+
+    const AttributeChange::Type signalChange = (change == AttributeChange::Default ? AttributeChange::Replicate : change);
+    for(int i=0, len=entities.size(); i<len; ++i)
+    {
+        EntityWeakPtr weakEnt = entities[i];
 
         // On a client start tracking of the server ack messages.
         if (!IsAuthority() && !weakEnt.expired())
             parentTracker_.Track(weakEnt.lock().get());
 
-        if (!weakEnt.expired())
-            EmitEntityCreated(weakEnt.lock().get(), change);
+        if (!weakEnt.expired() && change != AttributeChange::Disconnected)
+            emit EntityCreated(weakEnt.lock().get(), signalChange);
         if (!weakEnt.expired())
         {
             EntityPtr entityShared = weakEnt.lock();
@@ -673,17 +836,17 @@ QList<Entity *> Scene::CreateContentFromXml(const QDomDocument &xml, bool useEnt
                 i->second->ComponentChanged(change);
         }
     }
-    
-    // The above signals may have caused scripts to remove entities. Return those that still exist.
-    QList<Entity *> ret;
-    ret.reserve(sortedDescEntities.size());
-    for(int i=0, len=sortedDescEntities.size(); i<len; ++i)
-    {
-        if (!sortedDescEntities[i].expired())
-            ret.append(sortedDescEntities[i].lock().get());
-    }
-    
-    return ret;
+
+    if (change == AttributeChange::Disconnected)
+        return;
+    // The signals above may have caused scripts to remove entities.
+    QList<Entity *> created;
+    created.reserve(entities.size());
+    for(int i=0, len=entities.size(); i<len; ++i)
+        if (!entities[i].expired())
+            created.append(entities[i].lock().get());
+    if (!created.isEmpty())
+        emit EntitiesCreated(created, signalChange);
 }
 
 void Scene::CreateEntityFromXml(EntityPtr parent, const QDomElement& ent_elem, bool useEntityIDsFromFile,
@@ -820,25 +983,8 @@ QList<Entity *> Scene::CreateContentFromBinary(const char *data, int numBytes, b
         FixPlaceableParentIds(entities, oldToNewIds, AttributeChange::Disconnected);
 
     // Now that we have each entity spawned to the scene, trigger all the signals for EntityCreated/ComponentChanged messages.
-    for(int i = 0; i < entities.size(); ++i)
-    {
-        EntityWeakPtr weakEnt = entities[i];
-
-        // On a client start tracking of the server ack messages.
-        if (!IsAuthority() && !weakEnt.expired())
-            parentTracker_.Track(weakEnt.lock().get());
+    EmitContentCreated(entities, change);
 
-        if (!weakEnt.expired())
-            EmitEntityCreated(weakEnt.lock().get(), change);
-        if (!weakEnt.expired())
-        {
-            EntityPtr entityShared = weakEnt.lock();
-            const Entity::ComponentMap &components = entityShared->Components();
-            for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
-                i->second->ComponentChanged(change);
-        }
-    }
-    
     // The above signals may have caused scripts to remove entities. Return those that still exist.
     QList<Entity *> ret;
     ret.reserve(entities.size());
@@ -961,36 +1107,37 @@ QList<Entity *> Scene::CreateContentFromSceneDesc(const SceneDesc &desc, bool us
         FixPlaceableParentIds(ret, oldToNewIds, AttributeChange::Disconnected);
 
     // All entities & components have been loaded. Trigger change for them now.
+    QList<EntityWeakPtr> entities;
+    entities.reserve(ret.size());
     foreach(Entity *entity, ret)
-    {
-        // On a client start tracking of the server ack messages.
-        if (!IsAuthority())
-            parentTracker_.Track(entity);
-
-        // Entity
-        EmitEntityCreated(entity, change);
-
-        // Components
-        const Entity::ComponentMap &components = entity->Components();
-        for(Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
-            i->second->ComponentChanged(change);
-    }
+        entities << entity->shared_from_this();
+    EmitContentCreated(entities, change);
 
+    // The above signals may have caused scripts to remove entities. Return those that still exist.
+    ret.clear();
+    for(int i = 0; i < entities.size(); ++i)
+        if (!entities[i].expired())
+            ret.append(entities[i].lock().get());
     return ret;
 }
 
 void Scene::CreateEntityFromDesc(EntityPtr parent, const EntityDesc& e, bool useEntityIDsFromFile,
     AttributeChange::Type change, QList<Entity *>& entities, EntityIdMap& oldToNewIds)
 {
-    entity_id_t id = e.id.toUInt();
+    entity_id_t id = e.id.toUInt(); // toUInt() return 0 on failure.
 
-    if (e.id.isEmpty() || !useEntityIDsFromFile)
+    if (!useEntityIDsFromFile || id == 0) // If we don't want to use entity IDs from file, or if file doesn't contain one, generate a new one.
     {
         entity_id_t originaId = id;
         id = e.local ? NextFreeIdLocal() : NextFreeId();
         if (originaId != 0 && !oldToNewIds.contains(originaId))
             oldToNewIds[originaId] = id;
     }
+    else if (HasEntity(id)) // If we use IDs from file and they conflict with some of the existing IDs, change the ID of the old entity
+    {
+        entity_id_t newID = e.local ? NextFreeIdLocal() : NextFreeId();
+        ChangeEntityId(id, newID);
+    }
 
     if (HasEntity(id)) // If the entity we are about to add conflicts in ID with an existing entity in the scene.
     {
@@ -1005,72 +1152,43 @@ void Scene::CreateEntityFromDesc(EntityPtr parent, const EntityDesc& e, bool use
     else
         entity = parent->CreateChild(id);
 
-    assert(entity);
     if (entity)
     {
+        entity->SetTemporary(e.temporary);
+
         foreach(const ComponentDesc &c, e.components)
         {
-            if (c.typeName.isEmpty())
+            if (c.typeName.isEmpty() && c.typeId == 0xffffffff)
                 continue;
 
             // If we encounter an unknown component type, now is the time to register a placeholder type for it
             // The componentdesc holds all needed data for it
             SceneAPI* sceneAPI = framework_->Scene();
-            if (!sceneAPI->IsComponentTypeRegistered(c.typeName))
+            if (!c.typeName.isEmpty() && !sceneAPI->IsComponentTypeRegistered(c.typeName))
                 sceneAPI->RegisterPlaceholderComponentType(c);
 
-            ComponentPtr comp = entity->GetOrCreateComponent(c.typeName, c.name);
-            assert(comp);
+            ComponentPtr comp = (!c.typeName.isEmpty() ? entity->GetOrCreateComponent(c.typeName, c.name, AttributeChange::Default, c.sync) :
+                entity->GetOrCreateComponent(c.typeId, c.name, AttributeChange::Default, c.sync));
             if (!comp)
             {
                 LogError(QString("Scene::CreateEntityFromDesc: failed to create component %1 %2 .").arg(c.typeName).arg(c.name));
                 continue;
             }
-            if (comp->TypeId() == 25 /*EC_DynamicComponent*/)
-            {
-                QDomDocument temp_doc;
-                QDomElement root_elem = temp_doc.createElement("component");
-                root_elem.setAttribute("typeId", QString::number(c.typeId)); // Ambiguous on VC9 as u32
-                root_elem.setAttribute("type", c.typeName);
-                root_elem.setAttribute("name", c.name);
-                root_elem.setAttribute("sync", c.sync);
-                foreach(const AttributeDesc &a, c.attributes)
-                {
-                    QDomElement child_elem = temp_doc.createElement("attribute");
-                    child_elem.setAttribute("id", a.id);
-                    child_elem.setAttribute("value", a.value);
-                    child_elem.setAttribute("type", a.typeName);
-                    child_elem.setAttribute("name", a.name);
-                    root_elem.appendChild(child_elem);
-                }
-                comp->DeserializeFrom(root_elem, AttributeChange::Default);
-            }
-            else
-            {
-                foreach(IAttribute *attr, comp->Attributes())
-                {
-                    if (!attr)
-                        continue;
-                    foreach(const AttributeDesc &a, c.attributes)
-                    {
-                        if (attr->TypeName().compare(a.typeName, Qt::CaseInsensitive) == 0 &&
-                            (attr->Id().compare(a.id, Qt::CaseInsensitive) == 0 ||
-                             attr->Name().compare(a.name, Qt::CaseInsensitive) == 0))
-                        {
-                           attr->FromString(a.value, AttributeChange::Disconnected); // Trigger no signal yet when scene is in incoherent state
-                        }
-                    }
-                }
-            }
+
+            comp->SetTemporary(c.temporary);
+            comp->DeserializeFrom(c, AttributeChange::Disconnected); // Trigger no signal yet when scene is in incoherent state
         }
 
-        entity->SetTemporary(e.temporary);
         entities.append(entity.get());
 
         // Create child entities recursively
         foreach(const EntityDesc &ce, e.children)
             CreateEntityFromDesc(entity, ce, useEntityIDsFromFile, change, entities, oldToNewIds);
     }
+    else
+    {
+        LogError("Scene::CreateEntityFromDesc: Failed to create entity with id " + QString::number(id) + "!");
+    }
 }
 
 SceneDesc Scene::CreateSceneDescFromXml(const QString &filename, bool resolveAssets) const
@@ -1092,91 +1210,84 @@ SceneDesc Scene::CreateSceneDescFromXml(const QString &filename, bool resolveAss
         return sceneDesc;
     }
 
-    QByteArray data = file.readAll();
-    file.close();
-
-    return CreateSceneDescFromXml(data, sceneDesc, resolveAssets);
+    return CreateSceneDescFromXml(&file, sceneDesc, resolveAssets);
 }
 
 SceneDesc Scene::CreateSceneDescFromXml(QByteArray &data, SceneDesc &sceneDesc, bool resolveAssets) const
 {
-    QTextStream stream(&data);
-    stream.setCodec("UTF-8");
-    QDomDocument scene_doc("Scene");
-    QString errorMsg;
-    int errorLine, errorColumn;
-    if (!scene_doc.setContent(stream.readAll(), &errorMsg, &errorLine, &errorColumn))
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    return CreateSceneDescFromXml(&buffer, sceneDesc, resolveAssets);
+}
+
+SceneDesc Scene::CreateSceneDescFromXml(QIODevice *device, SceneDesc &sceneDesc, bool resolveAssets) const
+{
+    if (!device || !device->isReadable())
     {
-        LogError(QString("Scene::CreateSceneDescFromXml: Parsing scene XML from %1 failed when loading Scene XML: %2 at line %3 column %4.")
-            .arg(sceneDesc.filename).arg(errorMsg).arg(errorLine).arg(errorColumn));
+        LogError("Scene::CreateSceneDescFromXml: Device is not open for reading.");
         return sceneDesc;
     }
 
     // Check for existence of the scene element before we begin
-    QDomElement scene_elem = scene_doc.firstChildElement("scene");
-    if (scene_elem.isNull())
+    SceneXmlReader reader(device, QThread::idealThreadCount());
+    if (!reader.ReadSceneStart())
     {
-        LogError("Scene::CreateSceneDescFromXml: Could not find 'scene' element from XML.");
+        LogError(QString("Scene::CreateSceneDescFromXml: Could not find 'scene' element from %1. %2").arg(sceneDesc.filename).arg(reader.ErrorString()));
         return sceneDesc;
     }
 
-    QDomElement ent_elem = scene_elem.firstChildElement("entity");
-    while(!ent_elem.isNull())
+    EntityDesc entityDesc;
+    QString storageSpecifier;
+    SceneXmlReader::Item item;
+    while((item = reader.ReadNext(entityDesc, storageSpecifier)) != SceneXmlReader::End && item != SceneXmlReader::Error)
     {
-        CreateEntityDescFromXml(sceneDesc, sceneDesc.entities, ent_elem, resolveAssets);
-        // Process siblings.
-        ent_elem = ent_elem.nextSiblingElement("entity");
+        if (item == SceneXmlReader::RootEntity && ResolveEntityDescFromXml(sceneDesc, entityDesc, resolveAssets))
+            sceneDesc.entities.append(entityDesc);
+    }
+
+    if (item == SceneXmlReader::Error)
+    {
+        LogError(QString("Scene::CreateSceneDescFromXml: Parsing scene XML from %1 failed when loading Scene XML: %2.")
+            .arg(sceneDesc.filename).arg(reader.ErrorString()));
+        sceneDesc.entities.clear();
+        sceneDesc.assets.clear();
     }
 
     return sceneDesc;
 }
 
-void Scene::CreateEntityDescFromXml(SceneDesc& sceneDesc, QList<EntityDesc>& dest, const QDomElement& ent_elem, bool resolveAssets) const
+bool Scene::ResolveEntityDescFromXml(SceneDesc& sceneDesc, EntityDesc& entityDesc, bool resolveAssets) const
 {
-    QString id_str = ent_elem.attribute("id");
-    if (id_str.isEmpty())
-        return;
-    
-    EntityDesc entityDesc;
-    entityDesc.id = id_str;
-    entityDesc.local = !ParseBool(ent_elem.attribute("sync"), true); /**< @todo if no "sync"* attr, deduct from the ID. */
-    entityDesc.temporary = ParseBool(ent_elem.attribute("temporary"), false);
+    if (entityDesc.id.isEmpty())
+        return false;
 
-    QDomElement comp_elem = ent_elem.firstChildElement("component");
-    while(!comp_elem.isNull())
+    for(ComponentDescList::iterator ci = entityDesc.components.begin(); ci != entityDesc.components.end();)
     {
-        ComponentDesc compDesc;
-        compDesc.typeName = comp_elem.attribute("type");
-        compDesc.typeId = ParseUInt(comp_elem.attribute("typeId"), 0xffffffff);
+        ComponentDesc &compDesc = *ci;
         /// @todo 27.09.2013 assert that typeName and typeId match
         /// @todo 27.09.2013 If mismatch, show warning, and use SceneAPI's
         /// ComponentTypeNameForTypeId and ComponentTypeIdForTypeName to resolve one or the other?
-        compDesc.name = comp_elem.attribute("name");
-        compDesc.sync = ParseBool(comp_elem.attribute("sync"));
         const bool hasTypeId = compDesc.typeId != 0xffffffff;
+        ComponentPtr comp = (hasTypeId ? framework_->Scene()->CreateComponentById(0, compDesc.typeId, compDesc.name) :
+            framework_->Scene()->CreateComponentByName(0, compDesc.typeName, compDesc.name));
+        if (!comp) // Drop the component if its creation fails.
+        {
+            ci = entityDesc.components.erase(ci);
+            continue;
+        }
+
+        comp->DeserializeFrom(compDesc, AttributeChange::Disconnected);
 
         // A bit of a hack to get the name from EC_Name.
-        if (entityDesc.name.isEmpty() && (compDesc.typeId == EC_Name::ComponentTypeId ||
-            IComponent::EnsureTypeNameWithPrefix(compDesc.typeName) == EC_Name::TypeNameStatic()))
+        if (entityDesc.name.isEmpty() && comp->TypeId() == EC_Name::ComponentTypeId)
         {
-            ComponentPtr comp = (hasTypeId ? framework_->Scene()->CreateComponentById(0, compDesc.typeId, compDesc.name) :
-                framework_->Scene()->CreateComponentByName(0, compDesc.typeName, compDesc.name));
             EC_Name *ecName = checked_static_cast<EC_Name*>(comp.get());
-            ecName->DeserializeFrom(comp_elem, AttributeChange::Disconnected);
             entityDesc.name = ecName->name.Get();
             entityDesc.group = ecName->group.Get();
         }
 
-        ComponentPtr comp = (hasTypeId ? framework_->Scene()->CreateComponentById(0, compDesc.typeId, compDesc.name) :
-            framework_->Scene()->CreateComponentByName(0, compDesc.typeName, compDesc.name));
-        if (!comp) // Move to next element if component creation fails.
-        {
-            comp_elem = comp_elem.nextSiblingElement("component");
-            continue;
-        }
-
-        // Find asset references.
-        comp->DeserializeFrom(comp_elem, AttributeChange::Disconnected);
+        // Replace the attributes read from the XML with all the attributes of the component, and find asset references.
+        compDesc.attributes.clear();
         foreach(IAttribute *a,comp->Attributes())
         {
             if (!a)
@@ -1223,20 +1334,19 @@ void Scene::CreateEntityDescFromXml(SceneDesc& sceneDesc, QList<EntityDesc>& des
             }
         }
 
-        entityDesc.components.append(compDesc);
-
-        comp_elem = comp_elem.nextSiblingElement("component");
+        ++ci;
     }
 
     // Process child entities
-    QDomElement childEnt_elem = ent_elem.firstChildElement("entity");
-    while (!childEnt_elem.isNull())
+    for(EntityDescList::iterator ei = entityDesc.children.begin(); ei != entityDesc.children.end();)
     {
-        CreateEntityDescFromXml(sceneDesc, entityDesc.children, childEnt_elem, resolveAssets);
-        childEnt_elem = childEnt_elem.nextSiblingElement("entity");
+        if (ResolveEntityDescFromXml(sceneDesc, *ei, resolveAssets))
+            ++ei;
+        else
+            ei = entityDesc.children.erase(ei);
     }
 
-    dest.append(entityDesc);
+    return true;
 }
 
 ///\todo This function is a redundant duplicate copy of void ScriptAsset::ParseReferences(). Delete this code. -jj.
@@ -1675,122 +1785,304 @@ EntityList Scene::RootLevelEntities() const
     return entities;
 }
 
-// Returns insert index to 'container' for 'ent'. Return -1 if can be appended as last element.
-// Note: At the moment the Entity parenting with both Entity and Placable level is so complex that this proably
-// will not handle all exotic deep recursions correctly. In the case of Placeable parenting children may come before parent
-// in 'container'. In the case of Entity level parenting the 'container' can be assumed to be in the correct order already.
-// Todo: Deeper Placeable hierarchy inspection to fix above note.
-template <typename T>
-int EntityInsertIndex(const Scene *scene, const Entity *ent, T &container)
+namespace
 {
-    int insertIndex = -1;
-    if (!ent)
-        return insertIndex;
-
-    entity_id_t parentId = scene->EntityParentId(ent);
-    
-    // Has children
-    if (ent->NumChildren() > 0)
+    /// Returns the attribute of the component with the given ID. 'index' is a guess of the index of the attribute, which is
+    /// updated when the guess is wrong. For the components of one type, the guess is almost always right.
+    IAttribute *FindAttribute(const IComponent *component, const QString &id, size_t &index)
     {
-        // Parented parent
-        if (parentId > 0)
-        {
-            for (int sorti=0, sortlen=container.size(); sorti<sortlen; ++sorti)
+        const AttributeVector &attributes = component->Attributes();
+        if (index < attributes.size() && attributes[index] && attributes[index]->Id() == id)
+            return attributes[index];
+        for(size_t i = 0; i < attributes.size(); ++i)
+            if (attributes[i] && attributes[i]->Id() == id)
             {
-                // Todo: Inspect if parent is one of children of this entity?
-                // Parent already in the container? Insert after it.
-                if (container[sorti]->Id() == parentId)
-                {
-                    insertIndex = sorti + 1;
-                    break;
-                }
+                index = i;
+                return attributes[i];
             }
+        return 0;
+    }
+
+    inline void Append(std::vector<float> &values, const float3 &v)
+    {
+        values.push_back(v.x);
+        values.push_back(v.y);
+        values.push_back(v.z);
+    }
+
+    void AppendAttributeValue(const IAttribute *attribute, std::vector<float> &values)
+    {
+        switch(attribute->TypeId())
+        {
+        case IAttribute::RealId:
+            values.push_back(static_cast<const Attribute<float>*>(attribute)->Get());
+            break;
+        case IAttribute::IntId:
+            values.push_back((float)static_cast<const Attribute<int>*>(attribute)->Get());
+            break;
+        case IAttribute::UIntId:
+            values.push_back((float)static_cast<const Attribute<uint>*>(attribute)->Get());
+            break;
+        case IAttribute::BoolId:
+            values.push_back(static_cast<const Attribute<bool>*>(attribute)->Get() ? 1.f : 0.f);
+            break;
+        case IAttribute::Float2Id:
+        {
+            const float2 v = static_cast<const Attribute<float2>*>(attribute)->Get();
+            values.push_back(v.x);
+            values.push_back(v.y);
+            break;
         }
-        // - Parented parent where the parent was not already in container
-        // - Unparented parent
-        if (insertIndex == -1)
+        case IAttribute::Float3Id:
+            Append(values, static_cast<const Attribute<float3>*>(attribute)->Get());
+            break;
+        case IAttribute::Float4Id:
         {
-            // Find first non-parent Entity and insert before it.
-            for (int sorti=0, sortlen=container.size(); sorti<sortlen; ++sorti)
-            {
-                if (container[sorti]->NumChildren() == 0)
-                {
-                    insertIndex = sorti;
-                    break;
-                }
-            }
+            const float4 v = static_cast<const Attribute<float4>*>(attribute)->Get();
+            Append(values, v.xyz());
+            values.push_back(v.w);
+            break;
+        }
+        case IAttribute::QuatId:
+        {
+            const Quat q = static_cast<const Attribute<Quat>*>(attribute)->Get();
+            Append(values, float3(q.x, q.y, q.z));
+            values.push_back(q.w);
+            break;
+        }
+        case IAttribute::ColorId:
+        {
+            const Color c = static_cast<const Attribute<Color>*>(attribute)->Get();
+            Append(values, float3(c.r, c.g, c.b));
+            values.push_back(c.a);
+            break;
+        }
+        case IAttribute::TransformId:
+        {
+            const Transform &t = static_cast<const Attribute<Transform>*>(attribute)->Get();
+            Append(values, t.pos);
+            Append(values, t.rot);
+            Append(values, t.scale);
+            break;
+        }
+        case IAttribute::PointId:
+        {
+            const QPoint p = static_cast<const Attribute<QPoint>*>(attribute)->Get();
+            values.push_back((float)p.x());
+            values.push_back((float)p.y());
+            break;
+        }
+        default:
+            break;
         }
     }
-    // No children
-    else
+
+    void SetAttributeValue(IAttribute *attribute, const float *v, AttributeChange::Type change)
     {
-        if (parentId > 0)
+        switch(attribute->TypeId())
         {
-            for (int sorti=0, sortlen=container.size(); sorti<sortlen; ++sorti)
-            {
-                // Todo: Inspect if parent is one of children of this entity?
-                // Parent already in the container? Insert after it.
-                if (container[sorti]->Id() == parentId)
-                {
-                    insertIndex = sorti + 1;
-                    break;
-                }
-            }
+        case IAttribute::RealId:
+            static_cast<Attribute<float>*>(attribute)->Set(v[0], change);
+            break;
+        case IAttribute::IntId:
+            static_cast<Attribute<int>*>(attribute)->Set((int)v[0], change);
+            break;
+        case IAttribute::UIntId:
+            static_cast<Attribute<uint>*>(attribute)->Set((uint)v[0], change);
+            break;
+        case IAttribute::BoolId:
+            static_cast<Attribute<bool>*>(attribute)->Set(v[0] != 0.f, change);
+            break;
+        case IAttribute::Float2Id:
+            static_cast<Attribute<float2>*>(attribute)->Set(float2(v[0], v[1]), change);
+            break;
+        case IAttribute::Float3Id:
+            static_cast<Attribute<float3>*>(attribute)->Set(float3(v[0], v[1], v[2]), change);
+            break;
+        case IAttribute::Float4Id:
+            static_cast<Attribute<float4>*>(attribute)->Set(float4(v[0], v[1], v[2], v[3]), change);
+            break;
+        case IAttribute::QuatId:
+            static_cast<Attribute<Quat>*>(attribute)->Set(Quat(v[0], v[1], v[2], v[3]), change);
+            break;
+        case IAttribute::ColorId:
+            static_cast<Attribute<Color>*>(attribute)->Set(Color(v[0], v[1], v[2], v[3]), change);
+            break;
+        case IAttribute::TransformId:
+            static_cast<Attribute<Transform>*>(attribute)->Set(Transform(float3(v[0], v[1], v[2]), float3(v[3], v[4], v[5]), float3(v[6], v[7], v[8])), change);
+            break;
+        case IAttribute::PointId:
+            static_cast<Attribute<QPoint>*>(attribute)->Set(QPoint((int)v[0], (int)v[1]), change);
+            break;
+        default:
+            break;
         }
-        // - Parented entity where the parent was not already in container.
-        // - Unparented entity
-        if (insertIndex == -1)
+    }
+}
+
+int Scene::AttributeArrayStride(u32 attributeTypeId)
+{
+    switch(attributeTypeId)
+    {
+    case IAttribute::RealId:
+    case IAttribute::IntId:
+    case IAttribute::UIntId:
+    case IAttribute::BoolId:
+        return 1;
+    case IAttribute::Float2Id:
+    case IAttribute::PointId:
+        return 2;
+    case IAttribute::Float3Id:
+        return 3;
+    case IAttribute::Float4Id:
+    case IAttribute::QuatId:
+    case IAttribute::ColorId:
+        return 4;
+    case IAttribute::TransformId:
+        return 9;
+    default:
+        return 0;
+    }
+}
+
+bool Scene::QueryAttributeArrays(u32 componentTypeId, const QStringList &attributeIds, std::vector<entity_id_t> &outEntityIds,
+    std::vector<std::vector<float> > &outValues) const
+{
+    PROFILE(Scene_QueryAttributeArrays);
+
+    outEntityIds.clear();
+    outValues.clear();
+    outValues.resize(attributeIds.size());
+    if (componentTypeId == 0 || componentTypeId == 0xffffffff)
+        return false;
+
+    std::vector<size_t> indices(attributeIds.size(), 0);
+    std::vector<u32> types(attributeIds.size(), 0); // Set from the first component that has all the attributes.
+    std::vector<IAttribute*> attributes(attributeIds.size(), 0);
+    for(const_iterator it = begin(); it != end(); ++it)
+    {
+        ComponentPtr component = it->second->Component(componentTypeId);
+        if (!component)
+            continue;
+
+        bool hasAll = true;
+        for(int i = 0; i < attributeIds.size() && hasAll; ++i)
         {
-            // Find first non-parent + unparented Entity and insert after it.
-            for (int sorti=0, sortlen=container.size(); sorti<sortlen; ++sorti)
+            attributes[i] = FindAttribute(component.get(), attributeIds[i], indices[i]);
+            if (!attributes[i] || (types[i] && attributes[i]->TypeId() != types[i]))
+                hasAll = false;
+            else if (AttributeArrayStride(attributes[i]->TypeId()) == 0)
             {
-                if (container[sorti]->NumChildren() == 0 && scene->EntityParentId(container[sorti]) == 0)
-                {
-                    insertIndex = sorti + 1;
-                    break;
-                }
+                LogError(QString("Scene::QueryAttributeArrays: Attribute \"%1\" is of type %2, which can not be packed to a float array.")
+                    .arg(attributeIds[i]).arg(attributes[i]->TypeName()));
+                outEntityIds.clear();
+                outValues.clear();
+                return false;
             }
         }
+        if (!hasAll)
+            continue;
+
+        outEntityIds.push_back(it->first);
+        for(int i = 0; i < attributeIds.size(); ++i)
+        {
+            types[i] = attributes[i]->TypeId();
+            AppendAttributeValue(attributes[i], outValues[i]);
+        }
     }
-    return (insertIndex < container.size() ? insertIndex : -1);
+    return true;
 }
 
-QList<EntityWeakPtr> Scene::SortEntities(const QList<EntityWeakPtr> &entities) const
+int Scene::SetAttributeArrays(u32 componentTypeId, const std::vector<entity_id_t> &entityIds, const QString &attributeId,
+    const std::vector<float> &values, AttributeChange::Type change)
 {
-    PolledTimer t;
+    PROFILE(Scene_SetAttributeArrays);
 
-    QList<Entity*> rawEntities;
-    /// @todo In Scene's internal usage we know that nothing has could not have
-    /// deleted the entities yet (no signals triggered) and this could be skipped.
-    for (size_t ei=0, eilen=entities.size(); ei<eilen; ++ei)
+    int numSet = 0;
+    size_t index = 0;
+    for(size_t i = 0; i < entityIds.size(); ++i)
     {
-        EntityWeakPtr weakEnt = entities[ei];
-        if (weakEnt.expired())
+        EntityPtr entity = EntityById(entityIds[i]);
+        ComponentPtr component = entity ? entity->Component(componentTypeId) : ComponentPtr();
+        IAttribute *attribute = component ? FindAttribute(component.get(), attributeId, index) : 0;
+        if (!attribute)
+            continue;
+
+        const size_t stride = (size_t)AttributeArrayStride(attribute->TypeId());
+        if (stride == 0)
         {
-            LogError(QString("Scene::SortEntities: Input contained an expired weak_ptr at index %1. Aborting sort and returning original list.").arg(ei));
-            return entities;
+            LogError(QString("Scene::SetAttributeArrays: Attribute \"%1\" is of type %2, which can not be set from a float array.").arg(attributeId).arg(attribute->TypeName()));
+            return numSet;
+        }
+        if (values.size() < entityIds.size() * stride)
+        {
+            LogError(QString("Scene::SetAttributeArrays: Expected %1 values for %2 entities, got %3.").arg(entityIds.size() * stride).arg(entityIds.size()).arg(values.size()));
+            return numSet;
         }
-        rawEntities.push_back(weakEnt.lock().get());
+        SetAttributeValue(attribute, &values[i * stride], change);
+        ++numSet;
     }
+    return numSet;
+}
 
-    QList<EntityWeakPtr> sortedEntities;
-    for (size_t ei=0, eilen=entities.size(); ei<eilen; ++ei)
+QVariantMap Scene::QueryAttributeArrays(const QString &componentType, const QStringList &attributeIds) const
+{
+    QVariantMap ret;
+    std::vector<entity_id_t> ids;
+    std::vector<std::vector<float> > values;
+    if (!QueryAttributeArrays(framework_->Scene()->ComponentTypeIdForTypeName(componentType), attributeIds, ids, values))
+        return ret;
+
+    QVariantList idList;
+    idList.reserve((int)ids.size());
+    for(size_t i = 0; i < ids.size(); ++i)
+        idList.append(ids[i]);
+    ret["ids"] = idList;
+
+    for(int i = 0; i < attributeIds.size(); ++i)
     {
-        EntityWeakPtr weakEnt = entities[ei];
-        int insertIndex = EntityInsertIndex(this, weakEnt.lock().get(), rawEntities);
-        if (insertIndex == -1 || insertIndex >= sortedEntities.size())
-            sortedEntities.push_back(weakEnt);
-        else
-            sortedEntities.insert(insertIndex, weakEnt);
+        QVariantList valueList;
+        valueList.reserve((int)values[i].size());
+        for(size_t j = 0; j < values[i].size(); ++j)
+            valueList.append(values[i][j]);
+        ret[attributeIds[i]] = valueList;
     }
-    if (sortedEntities.size() != entities.size())
+    return ret;
+}
+
+int Scene::SetAttributeArrays(const QString &componentType, const QVariantList &entityIds, const QString &attributeId,
+    const QVariantList &values, AttributeChange::Type change)
+{
+    std::vector<entity_id_t> ids;
+    ids.reserve(entityIds.size());
+    foreach(const QVariant &id, entityIds)
+        ids.push_back(id.toUInt());
+    std::vector<float> floats;
+    floats.reserve(values.size());
+    foreach(const QVariant &value, values)
+        floats.push_back(value.toFloat());
+    return SetAttributeArrays(framework_->Scene()->ComponentTypeIdForTypeName(componentType), ids, attributeId, floats, change);
+}
+
+QList<EntityWeakPtr> Scene::SortEntities(const QList<EntityWeakPtr> &entities) const
+{
+    QList<Entity*> rawEntities;
+    rawEntities.reserve(entities.size());
+    for (int ei=0, eilen=entities.size(); ei<eilen; ++ei)
     {
-        LogError(QString("Scene::SortEntities: Sorting resulted in loss of information. Returning original unsorted list. Sorted size: %1 Unsorted size: %2.")
-            .arg(sortedEntities.size()).arg(entities.size()));
-        return entities;
+        if (entities[ei].expired())
+        {
+            LogError(QString("Scene::SortEntities: Input contained an expired weak_ptr at index %1. Aborting sort and returning original list.").arg(ei));
+            return entities;
+        }
+        rawEntities.push_back(entities[ei].lock().get());
     }
 
-    LogDebug(QString("Scene::SortEntities: Sorted Entities in %1 msecs. Input Entities %2").arg(t.MSecsElapsed(), 0, 'f', 4).arg(entities.size()));
+    rawEntities = SortEntities(rawEntities);
+    QList<EntityWeakPtr> sortedEntities;
+    sortedEntities.reserve(rawEntities.size());
+    for (int ei=0, eilen=rawEntities.size(); ei<eilen; ++ei)
+        sortedEntities.push_back(rawEntities[ei]->shared_from_this());
     return sortedEntities;
 }
 
@@ -1798,27 +2090,42 @@ QList<Entity*> Scene::SortEntities(const QList<Entity*> &entities) const
 {
     PolledTimer t;
 
-    QList<Entity*> sortedEntities;
+    // Index the input by ID, so that the parent of an entity is found in constant time.
+    QHash<entity_id_t, int> indices;
+    indices.reserve(entities.size());
     for (int ei=0, eilen=entities.size(); ei<eilen; ++ei)
     {
-        Entity *ent = entities[ei];
-        if (!ent)
+        if (!entities[ei])
         {
             LogError(QString("Scene::SortEntities: Input contained a null pointer at index %1. Aborting sort and returning original list.").arg(ei));
             return entities;
         }
-
-        int insertIndex = EntityInsertIndex(this, ent, sortedEntities);
-        if (insertIndex == -1 || insertIndex >= sortedEntities.size())
-            sortedEntities.push_back(ent);
-        else
-            sortedEntities.insert(insertIndex, ent);
+        indices[entities[ei]->Id()] = ei;
     }
-    if (sortedEntities.size() != entities.size())
+
+    // Walk up the parent chain of each entity as long as the parents are in the input and not yet sorted,
+    // and append the chain starting from the topmost parent. Each entity is visited once, the input order is kept otherwise.
+    QList<Entity*> sortedEntities;
+    sortedEntities.reserve(entities.size());
+    std::vector<u8> sorted(entities.size(), 0); // 1 when on the chain being walked, 2 when sorted.
+    std::vector<int> chain;
+    for (int ei=0, eilen=entities.size(); ei<eilen; ++ei)
     {
-        LogError(QString("Scene::SortEntities: Sorting resulted in loss of information. Returning original unsorted list. Sorted size: %1 Unsorted size: %2.")
-            .arg(sortedEntities.size()).arg(entities.size()));
-        return entities;
+        chain.clear();
+        int current = ei;
+        while(current >= 0 && sorted[current] == 0) // Stops also on a parenting loop.
+        {
+            sorted[current] = 1;
+            chain.push_back(current);
+            const entity_id_t parentId = EntityParentId(entities[current]);
+            QHash<entity_id_t, int>::const_iterator parent = (parentId > 0 ? indices.constFind(parentId) : indices.constEnd());
+            current = (parent != indices.constEnd() ? parent.value() : -1);
+        }
+        for (std::vector<int>::reverse_iterator ci = chain.rbegin(); ci != chain.rend(); ++ci)
+        {
+            sorted[*ci] = 2;
+            sortedEntities.push_back(entities[*ci]);
+        }
     }
 
     LogDebug(QString("Scene::SortEntities: Sorted Entities in %1 msecs. Input Entities %2").arg(t.MSecsElapsed(), 0, 'f', 4).arg(entities.size()));
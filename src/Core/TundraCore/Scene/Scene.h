@@ -22,6 +22,8 @@ class Framework;
 /// Maybe have some kind of UserConnection interface class defined in Framework and use that instead.
 class UserConnection;
 class QDomDocument;
+class QIODevice;
+class SceneXmlReader;
 
 /// A collection of entities which form an observable world.
 /** Acts as a factory for all entities.
@@ -126,6 +128,12 @@ public:
         Resolving assets under certain storage setups can perform poorly.
         You should only set true if really interested in all the assets and their disk paths. */
     SceneDesc CreateSceneDescFromXml(QByteArray &data, SceneDesc &sceneDesc, bool resolveAssets = true) const;
+    /// @overload
+    /** Reads the XML incrementally from @c device, without loading the whole document to memory.
+        @param device Device open for reading, f.ex. a QFile.
+        @param sceneDesc Initialized SceneDesc with filename prepared.
+        @param resolveAssets If SceneDesc::assets map should be populated. */
+    SceneDesc CreateSceneDescFromXml(QIODevice *device, SceneDesc &sceneDesc, bool resolveAssets = true) const;
 
     /// Inspects file and returns a scene description structure from the contents of binary file.
     /** @param filename File name.
@@ -218,6 +226,30 @@ public:
     template <typename T>
     EntityList EntitiesWithComponent(const QString &name = "") const;
 
+    /// Reads the given attributes of all components of the given type into packed float arrays, in one pass over the scene.
+    /** The first component of the type is used for each entity. For each attribute, @c outValues receives one flat array
+        that has AttributeArrayStride floats per entity, in the order of @c outEntityIds: x,y(,z,w) for float2, float3, float4 and Quat,
+        r,g,b,a for Color, pos, rot (Euler angles in degrees) and scale for Transform, a single float for real, int, uint and bool, and x,y for QPoint.
+        Entities whose component does not have all of the attributes, or has them with different types than the first component
+        that has them, are skipped. This can happen only with EC_DynamicComponent.
+        @param componentTypeId Type ID of the component.
+        @param attributeIds IDs of the attributes.
+        @return False if the component type is unknown, or an attribute is of a type that can not be packed.
+        @note int and uint values above 2^24 lose precision. */
+    bool QueryAttributeArrays(u32 componentTypeId, const QStringList &attributeIds, std::vector<entity_id_t> &outEntityIds,
+        std::vector<std::vector<float> > &outValues) const;
+
+    /// Writes packed values, in the format of QueryAttributeArrays, to the given attribute of the components of the given type.
+    /** Entities that do not exist, or whose component does not have the attribute, are skipped.
+        @param values AttributeArrayStride floats per entity, in the order of @c entityIds.
+        @return Number of attributes set. */
+    int SetAttributeArrays(u32 componentTypeId, const std::vector<entity_id_t> &entityIds, const QString &attributeId,
+        const std::vector<float> &values, AttributeChange::Type change = AttributeChange::Default);
+
+    /// Returns the number of floats a value of the given attribute type takes in packed attribute arrays, or 0 if the type can not be packed.
+    /** @param attributeTypeId IAttribute::TypeId */
+    static int AttributeArrayStride(u32 attributeTypeId);
+
     /// @cond PRIVATE
     /// Do not directly allocate new scenes using operator new, but use the factory-based SceneAPI::CreateScene functions instead.
     /** @param name Name of the scene.
@@ -387,8 +419,23 @@ public slots:
     /// Return root-level entities, i.e. those that have no parent.
     EntityList RootLevelEntities() const;
 
+    /// Reads the given attributes of all components of the given type in one call.
+    /** Returns an object that has the entity ids in "ids", and a flat number array for each attribute, keyed by the attribute ID,
+        e.g. scene.QueryAttributeArrays("Placeable", ["transform"]) returns { ids: [...], transform: [px,py,pz,rx,ry,rz,sx,sy,sz, ...] }.
+        Meant for scripts that process large numbers of entities per frame, as no wrapper objects are created per entity or component.
+        See the C++ overload for the packing format. Returns an empty object on failure.
+        @param componentType Type name of the component. */
+    QVariantMap QueryAttributeArrays(const QString &componentType, const QStringList &attributeIds) const;
+
+    /// Writes a flat number array, in the format of QueryAttributeArrays, to the given attribute of the components of the given type.
+    /** @param entityIds Entity ids, e.g. the "ids" array returned by QueryAttributeArrays.
+        @return Number of attributes set. */
+    int SetAttributeArrays(const QString &componentType, const QVariantList &entityIds, const QString &attributeId,
+        const QVariantList &values, AttributeChange::Type change = AttributeChange::Default);
+
     /// Loads the scene from XML.
-    /** @param filename File name
+    /** The file is read incrementally, and the created entities are signaled in batches while the rest of the file is still being read.
+        @param filename File name
         @param clearScene Do we want to clear the existing scene.
         @param useEntityIDsFromFile If true, the created entities will use the Entity IDs from the original file. 
                   If the scene contains any previous entities with conflicting IDs, those are removed. If false, the entity IDs from the files are ignored,
@@ -404,6 +451,14 @@ public slots:
         @return The scene XML as a byte array string. */
     QByteArray SerializeToXmlString(bool serializeTemporary, bool serializeLocal) const;
 
+    /// Writes the scene content as XML to a device.
+    /** Streams the XML directly to @c device without building the whole document in memory.
+        @param device Device open for writing, f.ex. a QFile.
+        @param serializeTemporary Are temporary entities wanted to be included.
+        @param serializeLocal Are local entities wanted to be included.
+        @return true if successful */
+    bool SerializeToXml(QIODevice *device, bool serializeTemporary, bool serializeLocal) const;
+
     /// Saves the scene to XML.
     /** @param filename File name
         @param saveTemporary Are temporary entities wanted to be included.
@@ -439,6 +494,12 @@ public slots:
         @todo Return list of EntityPtrs instead of raw pointers. Could also consider EntityList ,though QList[] has the nice operator [] accessor. */
     QList<Entity *> CreateContentFromXml(const QString &xml, bool useEntityIDsFromFile, AttributeChange::Type change);
     QList<Entity *> CreateContentFromXml(const QDomDocument &xml, bool useEntityIDsFromFile, AttributeChange::Type change); /**< @overload @param xml XML document. */
+    /// @overload
+    /** Reads the XML incrementally from @c device, creating the entities as they are read, without loading the whole document to memory.
+        If the XML is malformed, the content preceding the error is created.
+        @param device Device open for reading, f.ex. a QFile.
+        @param batchSize Number of entities created before signaling them. If 0, all the entities are signaled once the whole XML has been read. */
+    QList<Entity *> CreateContentFromXml(QIODevice *device, bool useEntityIDsFromFile, AttributeChange::Type change, int batchSize = 0);
 
     /// Creates scene content from binary file.
     /** @param filename File name.
@@ -522,6 +583,12 @@ signals:
     /** @note Entity::IsTemporary() information might not be accurate yet, as it depends on the method that was used to create the entity. */
     void EntityCreated(Entity* entity, AttributeChange::Type change);
 
+    /// Signal when a batch of content has been created, for example by LoadSceneXML or CreateContentFromBinary.
+    /** Emitted once for the batch, after the EntityCreated signals of its entities and the ComponentChanged
+        signals of their components, so listeners can process new content in bulk instead of entity by entity.
+        @param entities The entities of the batch that still exist, parents before children. */
+    void EntitiesCreated(const QList<Entity*>& entities, AttributeChange::Type change);
+
     /// Signal when an entity deleted
     void EntityRemoved(Entity* entity, AttributeChange::Type change);
 
@@ -571,8 +638,14 @@ private:
     /// Create entity from entity desc and recurse into child entities. Called internally.
     void CreateEntityFromDesc(EntityPtr parent, const EntityDesc& source, bool useEntityIDsFromFile,
         AttributeChange::Type change, QList<Entity *>& entities, EntityIdMap& oldToNewIds);
-    /// Create entity desc from an XML element and recurse into child entities. Called internally.
-    void CreateEntityDescFromXml(SceneDesc& sceneDesc, QList<EntityDesc>& dest, const QDomElement& ent_elem, bool resolveAssets) const;
+    /// Create scene content from the scene element the reader is positioned in. Called internally.
+    QList<Entity *> CreateContentFromXml(SceneXmlReader &reader, bool useEntityIDsFromFile, AttributeChange::Type change, int batchSize);
+    /// Trigger the EntityCreated, ComponentChanged and EntitiesCreated signals of newly created content. Called internally.
+    void EmitContentCreated(const QList<EntityWeakPtr> &entities, AttributeChange::Type change);
+    /// Replace the attributes of an entity desc read from XML with the full attributes of the components, resolve
+    /// the asset references and recurse into child entities. Called internally.
+    /** @return False if the entity has no ID and should be skipped. */
+    bool ResolveEntityDescFromXml(SceneDesc& sceneDesc, EntityDesc& entityDesc, bool resolveAssets) const;
 
     /// Container for an ongoing attribute interpolation
     struct AttributeInterpolation
@@ -6,6 +6,8 @@
 #include "SceneAPI.h"
 #include "Scene/Scene.h"
 #include "IComponentFactory.h"
+#include "ISpatialBoundsProvider.h"
+#include "SpatialWorld.h"
 #include "IComponent.h"
 #include "IRenderer.h"
 #include "AssetReference.h"
@@ -58,6 +60,10 @@ SceneAPI::~SceneAPI()
 
 void SceneAPI::Reset()
 {
+    for(SpatialWorldMap::iterator iter = spatialWorlds.begin(); iter != spatialWorlds.end(); ++iter)
+        iter->first->setProperty(SpatialWorld::PropertyName(), QVariant());
+    spatialWorlds.clear();
+    spatialBoundsProviders.clear();
     scenes.clear();
     componentFactories.clear();
     componentFactoriesByTypeid.clear();
@@ -86,6 +92,12 @@ ScenePtr SceneAPI::CreateScene(const QString &name, bool viewEnabled, bool autho
     ScenePtr newScene = MAKE_SHARED(Scene, name, framework, viewEnabled, authority);
     scenes[name] = newScene;
 
+    // Add the spatial index to every scene, also to those created without the signals, and before the signal,
+    // so that it is in place before anyone gets to add content to the scene.
+    SpatialWorldPtr spatialWorld = MAKE_SHARED(SpatialWorld, newScene.get());
+    spatialWorlds[newScene.get()] = spatialWorld;
+    newScene->setProperty(SpatialWorld::PropertyName(), QVariant::fromValue<QObject*>(spatialWorld.get()));
+
     // Emit signal of creation
     if (change != AttributeChange::Disconnected)
     {
@@ -112,6 +124,13 @@ bool SceneAPI::RemoveScene(const QString &name, AttributeChange::Type change)
         emit SceneRemoved(name);
     }
 
+    SpatialWorldMap::iterator spatialIter = spatialWorlds.find(sceneIter->second.get());
+    if (spatialIter != spatialWorlds.end())
+    {
+        sceneIter->second->setProperty(SpatialWorld::PropertyName(), QVariant());
+        spatialWorlds.erase(spatialIter);
+    }
+
     scenes.erase(sceneIter);
     return true;
 }
@@ -143,6 +162,30 @@ bool SceneAPI::IsComponentTypeRegistered(const QString& typeName) const
         placeholderComponentTypeIds.find(nameWithPrefix) != placeholderComponentTypeIds.end();
 }
 
+void SceneAPI::RegisterSpatialBoundsProvider(const SpatialBoundsProviderPtr &provider)
+{
+    if (!provider || provider->ComponentTypeId() == 0)
+    {
+        LogError("SceneAPI::RegisterSpatialBoundsProvider: Invalid input!");
+        return;
+    }
+    if (spatialBoundsProviders.find(provider->ComponentTypeId()) != spatialBoundsProviders.end())
+    {
+        LogError("SceneAPI::RegisterSpatialBoundsProvider: A provider for component typeid " + QString::number(provider->ComponentTypeId()) + " already exists!");
+        return;
+    }
+
+    spatialBoundsProviders[provider->ComponentTypeId()] = provider;
+    for(SpatialWorldMap::iterator iter = spatialWorlds.begin(); iter != spatialWorlds.end(); ++iter)
+        iter->second->Rebuild();
+}
+
+ISpatialBoundsProvider *SceneAPI::SpatialBoundsProvider(u32 componentTypeId) const
+{
+    SpatialBoundsProviderMap::const_iterator iter = spatialBoundsProviders.find(componentTypeId);
+    return iter != spatialBoundsProviders.end() ? iter->second.get() : 0;
+}
+
 void SceneAPI::RegisterComponentFactory(const ComponentFactoryPtr &factory)
 {
     if (factory->TypeName().trimmed() != factory->TypeName() || factory->TypeName().isEmpty() || factory->TypeId() == 0)
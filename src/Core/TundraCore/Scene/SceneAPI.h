@@ -60,6 +60,13 @@ public:
     /// Returns the registered placeholder component descs.
     const PlaceholderComponentTypeMap& GetPlaceholderComponentTypes() const { return placeholderComponentTypes; }
 
+    /// Registers a provider that computes the bounds of one component type for the SpatialWorlds of the scenes.
+    /** Existing SpatialWorlds are rebuilt to take the new provider into account. */
+    void RegisterSpatialBoundsProvider(const SpatialBoundsProviderPtr &provider);
+
+    /// Returns the bounds provider of the given component type, or null if the type has no spatial extent.
+    ISpatialBoundsProvider *SpatialBoundsProvider(u32 componentTypeId) const;
+
 public slots:
     /// Returns a pointer to a scene
     /** Manage the pointer carefully, as scenes may not get deleted properly if
@@ -87,7 +94,7 @@ public slots:
 
         @note As Tundra doesn't currently support multiple replicated scenes, @c change has no real effect,
         unless AttributeChange::Disconnected is passed, which can be used f.ex. when creating dummy scenes silently
-        (no OgreWorld or PhysicsWorld will be created) for serialization purposes.
+        (no OgreWorld or PhysicsWorld will be created) for serialization purposes. The SpatialWorld of the scene is created regardless.
 
         @return The new scene, or empty pointer if scene with the specified name already exists. */
     ScenePtr CreateScene(const QString &name, bool viewEnabled, bool authority, AttributeChange::Type change = AttributeChange::Default);
@@ -220,8 +227,13 @@ private:
     typedef std::map<QString, ComponentFactoryPtr, QStringLessThanNoCase> ComponentFactoryMap;
     typedef std::map<u32, weak_ptr<IComponentFactory> > ComponentFactoryWeakMap;
 
+    typedef std::map<u32, SpatialBoundsProviderPtr> SpatialBoundsProviderMap;
+    typedef std::map<Scene*, SpatialWorldPtr> SpatialWorldMap;
+
     ComponentFactoryMap componentFactories;
     ComponentFactoryWeakMap componentFactoriesByTypeid;
+    SpatialBoundsProviderMap spatialBoundsProviders;
+    SpatialWorldMap spatialWorlds; ///< The SpatialWorlds of the scenes. Owned here, accessible via Scene::Subsystem.
     PlaceholderComponentTypeMap placeholderComponentTypes;
     PlaceholderComponentTypeIdMap placeholderComponentTypeIds;
 
@@ -124,9 +124,10 @@ struct TUNDRACORE_API ComponentDesc
     QString name;                       ///< Name (if applicable).
 
     bool sync;                          ///< Synchronize component.
+    bool temporary;                     ///< Is component temporary.
     AttributeDescList attributes;       ///< List of attributes the component has.
 
-    ComponentDesc() : sync(true), typeId(0xffffffff) {}
+    ComponentDesc() : sync(true), temporary(false), typeId(0xffffffff) {}
 
     /// Equality operator. Returns true if all values match, false otherwise.
     bool operator ==(const ComponentDesc &rhs) const
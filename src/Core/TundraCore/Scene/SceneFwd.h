@@ -18,6 +18,8 @@ class IComponentFactory;
 class IAttribute;
 class AttributeMetadata;
 class ChangeRequest;
+class SpatialWorld;
+class ISpatialBoundsProvider;
 
 struct SceneDesc;
 struct EntityDesc;
@@ -36,6 +38,9 @@ typedef std::list<EntityPtr> EntityList;
 typedef shared_ptr<IComponent> ComponentPtr;
 typedef weak_ptr<IComponent> ComponentWeakPtr;
 typedef shared_ptr<IComponentFactory> ComponentFactoryPtr;
+typedef shared_ptr<SpatialWorld> SpatialWorldPtr;
+typedef weak_ptr<SpatialWorld> SpatialWorldWeakPtr;
+typedef shared_ptr<ISpatialBoundsProvider> SpatialBoundsProviderPtr;
 typedef std::vector<IAttribute*> AttributeVector;
 typedef std::map<QString, ScenePtr> SceneMap;
 
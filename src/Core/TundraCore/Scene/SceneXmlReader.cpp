@@ -0,0 +1,541 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "SceneXmlReader.h"
+#include "CoreStringUtils.h"
+
+#include <QIODevice>
+#include <QBuffer>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QStringList>
+
+#include <cctype>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    /// Default size of the blocks read from the device.
+    const int cReadBlockSize = 4 * 1024 * 1024;
+
+    /// Returns the index of the '>' that ends the tag starting at @c start, skipping quoted attribute values, or -1.
+    int FindTagEnd(const QByteArray &data, int start)
+    {
+        const char *d = data.constData();
+        const int size = data.size();
+        char quote = 0;
+        for(int i = start + 1; i < size; ++i)
+        {
+            if (quote)
+            {
+                if (d[i] == quote)
+                    quote = 0;
+            }
+            else if (d[i] == '"' || d[i] == '\'')
+                quote = d[i];
+            else if (d[i] == '>')
+                return i;
+        }
+        return -1;
+    }
+
+    /// Returns the index of the '>' that ends the markup declaration (comment, CDATA, DOCTYPE) starting at @c start, or -1.
+    int FindDeclarationEnd(const QByteArray &data, int start)
+    {
+        if (data.mid(start, 4) == "<!--")
+        {
+            const int end = data.indexOf("-->", start + 4);
+            return end < 0 ? -1 : end + 2;
+        }
+        if (data.mid(start, 9) == "<![CDATA[")
+        {
+            const int end = data.indexOf("]]>", start + 9);
+            return end < 0 ? -1 : end + 2;
+        }
+        // DOCTYPE, possibly with an internal subset.
+        const char *d = data.constData();
+        char quote = 0;
+        int brackets = 0;
+        for(int i = start + 2; i < data.size(); ++i)
+        {
+            if (quote)
+            {
+                if (d[i] == quote)
+                    quote = 0;
+            }
+            else if (d[i] == '"' || d[i] == '\'')
+                quote = d[i];
+            else if (d[i] == '[')
+                ++brackets;
+            else if (d[i] == ']')
+                --brackets;
+            else if (d[i] == '>' && brackets <= 0)
+                return i;
+        }
+        return -1;
+    }
+
+    /// Finds the ends of the root-level elements of the scene element.
+    /** @param data Content of the scene element, starting at a root level.
+        @param rootEnds [out] Index after each complete root-level element.
+        @return Index of the scene end tag, or -1 if it is not in @c data. */
+    int ScanRootElements(const QByteArray &data, QList<int> &rootEnds)
+    {
+        rootEnds.clear();
+        const char *d = data.constData();
+        const int size = data.size();
+        int depth = 0;
+        int i = 0;
+        while(i < size)
+        {
+            if (d[i] != '<')
+            {
+                ++i;
+                continue;
+            }
+            if (i + 1 >= size)
+                break;
+
+            int end;
+            if (d[i+1] == '!')
+                end = FindDeclarationEnd(data, i);
+            else if (d[i+1] == '?')
+            {
+                end = data.indexOf("?>", i + 2);
+                if (end >= 0)
+                    ++end;
+            }
+            else if (d[i+1] == '/')
+            {
+                if (depth == 0)
+                    return i;
+                end = data.indexOf('>', i + 2);
+                if (end >= 0 && --depth == 0)
+                    rootEnds.append(end + 1);
+            }
+            else
+            {
+                end = FindTagEnd(data, i);
+                if (end >= 0)
+                {
+                    if (d[end-1] != '/')
+                        ++depth;
+                    else if (depth == 0)
+                        rootEnds.append(end + 1);
+                }
+            }
+            if (end < 0)
+                break; // The rest of the markup has not been read yet.
+            i = end + 1;
+        }
+        return -1;
+    }
+
+    /// Returns whether the parallel parse can handle the encoding of a document starting with @c data.
+    bool IsUtf8Document(const QByteArray &data)
+    {
+        // UTF-16 and UTF-32, with or without a byte order mark.
+        if (data.size() >= 2 && (data[0] == '\0' || data[1] == '\0' || (uchar)data[0] == 0xFE || (uchar)data[0] == 0xFF))
+            return false;
+        const int start = data.startsWith("\xEF\xBB\xBF") ? 3 : 0;
+        if (data.mid(start, 5) != "<?xml")
+            return true;
+        const int declEnd = data.indexOf("?>", start);
+        const QByteArray decl = data.mid(start, declEnd < 0 ? -1 : declEnd - start);
+        const int encoding = decl.indexOf("encoding");
+        if (encoding < 0)
+            return true;
+        QByteArray value = decl.mid(encoding + 8).simplified();
+        value = value.mid(value.indexOf('=') + 1).trimmed();
+        if (value.isEmpty())
+            return true;
+        const char quote = value[0];
+        value = value.mid(1, value.indexOf(quote, 1) - 1).toLower();
+        return value == "utf-8" || value == "utf8" || value == "us-ascii" || value == "ascii";
+    }
+}
+
+/// Parses a slice of root-level elements of the scene element.
+class SceneXmlReader::ParseJob : public QRunnable
+{
+public:
+    ParseJob(const QByteArray &slice, int line) :
+        data("<scene>" + slice + "</scene>"),
+        firstLine(line),
+        nextItem(0),
+        nextStorage(0),
+        nextEntity(0)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        SceneXmlReader reader(&buffer);
+        reader.ReadSceneStart();
+        EntityDesc entity;
+        QString storage;
+        for(;;)
+        {
+            const Item item = reader.ReadNext(entity, storage);
+            if (item == RootEntity)
+                entities.append(entity);
+            else if (item == Storage)
+                storages.append(storage);
+            else
+            {
+                if (item == Error)
+                    error = QString("%1 at line %2 column %3").arg(reader.xml_.errorString())
+                        .arg(firstLine + reader.xml_.lineNumber() - 1).arg(reader.xml_.columnNumber());
+                break;
+            }
+            items.append(item);
+        }
+        data.clear();
+    }
+
+    QByteArray data;
+    int firstLine;
+    QList<Item> items; ///< Storage and RootEntity in document order.
+    QStringList storages;
+    QList<EntityDesc> entities;
+    QString error;
+    int nextItem;
+    int nextStorage;
+    int nextEntity;
+};
+
+SceneXmlReader::SceneXmlReader(QIODevice *device) :
+    xml_(device),
+    device_(device),
+    threadPool_(0),
+    numThreads_(1),
+    readBlockSize_(cReadBlockSize),
+    line_(1),
+    sceneEnded_(false)
+{
+}
+
+SceneXmlReader::SceneXmlReader(QIODevice *device, int numThreads) :
+    device_(device),
+    threadPool_(0),
+    numThreads_(numThreads),
+    readBlockSize_(cReadBlockSize),
+    line_(1),
+    sceneEnded_(false)
+{
+    if (numThreads_ > 1)
+    {
+        threadPool_ = new QThreadPool();
+        threadPool_->setMaxThreadCount(numThreads_);
+    }
+    else
+        xml_.setDevice(device);
+}
+
+SceneXmlReader::SceneXmlReader(const QString &xml) :
+    xml_(xml),
+    device_(0),
+    threadPool_(0),
+    numThreads_(1),
+    readBlockSize_(cReadBlockSize),
+    line_(1),
+    sceneEnded_(false)
+{
+}
+
+SceneXmlReader::~SceneXmlReader()
+{
+    DeleteJobs();
+    delete threadPool_;
+}
+
+void SceneXmlReader::SetReadBlockSize(int bytes)
+{
+    readBlockSize_ = qMax(bytes, 1);
+}
+
+bool SceneXmlReader::ReadSceneStart()
+{
+    if (threadPool_)
+        return ReadSceneStartParallel();
+    return xml_.readNextStartElement() && xml_.name() == "scene";
+}
+
+SceneXmlReader::Item SceneXmlReader::ReadNext(EntityDesc &entity, QString &storageSpecifier)
+{
+    if (!threadPool_)
+        return ReadNextSequential(entity, storageSpecifier);
+
+    while(error_.isEmpty())
+    {
+        if (readyJobs_.isEmpty())
+        {
+            if (runningJobs_.isEmpty())
+                break;
+            TakeResults();
+            continue;
+        }
+
+        ParseJob *job = readyJobs_.first();
+        if (job->nextItem < job->items.size())
+        {
+            if (job->items[job->nextItem++] == Storage)
+            {
+                storageSpecifier = job->storages[job->nextStorage++];
+                return Storage;
+            }
+            entity = job->entities[job->nextEntity];
+            job->entities[job->nextEntity++] = EntityDesc(); // Release the memory as we go.
+            return RootEntity;
+        }
+        if (!job->error.isEmpty())
+        {
+            error_ = job->error;
+            DeleteJobs();
+            break;
+        }
+        delete readyJobs_.takeFirst();
+    }
+
+    if (error_.isEmpty())
+        error_ = endError_;
+    return error_.isEmpty() ? End : Error;
+}
+
+SceneXmlReader::Item SceneXmlReader::ReadNextSequential(EntityDesc &entity, QString &storageSpecifier)
+{
+    while(xml_.readNextStartElement())
+    {
+        if (xml_.name() == "entity")
+        {
+            entity = EntityDesc();
+            ReadEntity(entity);
+            return xml_.hasError() ? Error : RootEntity;
+        }
+        else if (xml_.name() == "storage")
+        {
+            storageSpecifier = xml_.attributes().value("specifier").toString();
+            xml_.skipCurrentElement();
+            return xml_.hasError() ? Error : Storage;
+        }
+        else
+            xml_.skipCurrentElement();
+    }
+
+    return xml_.hasError() ? Error : End;
+}
+
+QString SceneXmlReader::ErrorString() const
+{
+    if (threadPool_)
+        return error_;
+    if (!xml_.hasError())
+        return "";
+    return QString("%1 at line %2 column %3").arg(xml_.errorString()).arg(xml_.lineNumber()).arg(xml_.columnNumber());
+}
+
+void SceneXmlReader::ReadEntity(EntityDesc &entity)
+{
+    const QXmlStreamAttributes attributes = xml_.attributes();
+    entity.id = attributes.value("id").toString();
+    entity.local = !ParseBool(attributes.value("sync").toString(), true);
+    entity.temporary = ParseBool(attributes.value("temporary").toString(), false);
+
+    while(xml_.readNextStartElement())
+    {
+        if (xml_.name() == "component")
+        {
+            entity.components.append(ComponentDesc());
+            ReadComponent(entity.components.last());
+        }
+        else if (xml_.name() == "entity")
+        {
+            entity.children.append(EntityDesc());
+            ReadEntity(entity.children.last());
+        }
+        else
+            xml_.skipCurrentElement();
+    }
+}
+
+void SceneXmlReader::ReadComponent(ComponentDesc &component)
+{
+    const QXmlStreamAttributes attributes = xml_.attributes();
+    component.typeName = attributes.value("type").toString();
+    component.typeId = ParseUInt(attributes.value("typeId").toString(), 0xffffffff);
+    component.name = attributes.value("name").toString();
+    component.sync = ParseBool(attributes.value("sync").toString(), true);
+    component.temporary = ParseBool(attributes.value("temporary").toString(), false);
+
+    while(xml_.readNextStartElement())
+    {
+        if (xml_.name() == "attribute")
+        {
+            const QXmlStreamAttributes attrAttributes = xml_.attributes();
+            AttributeDesc attr;
+            attr.typeName = attrAttributes.value("type").toString();
+            attr.name = attrAttributes.value("name").toString();
+            attr.value = attrAttributes.value("value").toString();
+            attr.id = attrAttributes.value("id").toString();
+            component.attributes.append(attr);
+        }
+        xml_.skipCurrentElement();
+    }
+}
+
+bool SceneXmlReader::ReadSceneStartParallel()
+{
+    while(buffer_.size() < readBlockSize_ && ReadMore()) {}
+    if (!IsUtf8Document(buffer_))
+    {
+        FallbackToSequential();
+        return ReadSceneStart();
+    }
+
+    // Skip the prolog up to the start tag of the document element.
+    int i = buffer_.startsWith("\xEF\xBB\xBF") ? 3 : 0;
+    for(;;)
+    {
+        while(i < buffer_.size() && isspace((uchar)buffer_[i]))
+            ++i;
+        int end = -1;
+        if (i + 1 < buffer_.size())
+        {
+            if (buffer_[i] != '<')
+                return false;
+            if (buffer_[i+1] == '?')
+            {
+                end = buffer_.indexOf("?>", i + 2);
+                if (end >= 0)
+                    ++end;
+            }
+            else if (buffer_[i+1] == '!')
+                end = FindDeclarationEnd(buffer_, i);
+            else
+            {
+                end = FindTagEnd(buffer_, i);
+                if (end >= 0)
+                {
+                    // Compare the element name.
+                    int nameEnd = i + 1;
+                    while(nameEnd < end && !isspace((uchar)buffer_[nameEnd]) && buffer_[nameEnd] != '/')
+                        ++nameEnd;
+                    if (buffer_.mid(i + 1, nameEnd - i - 1) != "scene")
+                        return false;
+                    sceneEnded_ = buffer_[end-1] == '/';
+                    line_ += buffer_.left(end + 1).count('\n');
+                    buffer_.remove(0, end + 1);
+                    StartJobs();
+                    return true;
+                }
+            }
+        }
+        if (end >= 0)
+            i = end + 1;
+        else if (!ReadMore())
+            return false;
+    }
+}
+
+bool SceneXmlReader::ReadMore()
+{
+    if (!device_)
+        return false;
+    const QByteArray block = device_->read(readBlockSize_);
+    if (block.isEmpty())
+        return false;
+    buffer_.append(block);
+    return true;
+}
+
+void SceneXmlReader::StartJobs()
+{
+    if (sceneEnded_ || !error_.isEmpty() || !endError_.isEmpty())
+        return;
+
+    while(buffer_.size() < readBlockSize_ && ReadMore()) {}
+    QList<int> rootEnds;
+    int sceneEnd = ScanRootElements(buffer_, rootEnds);
+    // A single root-level element can be larger than the window.
+    while(sceneEnd < 0 && rootEnds.isEmpty() && ReadMore())
+        sceneEnd = ScanRootElements(buffer_, rootEnds);
+
+    int end;
+    if (sceneEnd >= 0)
+    {
+        end = sceneEnd;
+        sceneEnded_ = true;
+    }
+    else if (!rootEnds.isEmpty())
+        end = rootEnds.last();
+    else
+    {
+        // The document ended before the scene did. Parse the rest to report a possible error in it.
+        end = buffer_.size();
+        endError_ = QString("Premature end of document at line %1").arg(line_ + buffer_.count('\n'));
+    }
+
+    // Split the window into a chunk per thread, at the ends of root-level elements.
+    int start = 0;
+    int nextRoot = 0;
+    for(int chunk = 1; start < end; ++chunk)
+    {
+        int chunkEnd = end;
+        if (chunk < numThreads_)
+        {
+            const int target = (int)((qint64)end * chunk / numThreads_);
+            while(nextRoot < rootEnds.size() && rootEnds[nextRoot] < target)
+                ++nextRoot;
+            if (nextRoot < rootEnds.size() && rootEnds[nextRoot] < end)
+                chunkEnd = rootEnds[nextRoot];
+        }
+        if (chunkEnd <= start)
+            continue;
+
+        const QByteArray slice = buffer_.mid(start, chunkEnd - start);
+        ParseJob *job = new ParseJob(slice, line_);
+        line_ += slice.count('\n');
+        runningJobs_.append(job);
+        threadPool_->start(job);
+        start = chunkEnd;
+    }
+    buffer_.remove(0, end);
+    if (sceneEnded_)
+        buffer_.clear();
+}
+
+void SceneXmlReader::TakeResults()
+{
+    threadPool_->waitForDone();
+    readyJobs_ = runningJobs_;
+    runningJobs_.clear();
+    // Parse the next window while the caller processes the results of this one.
+    StartJobs();
+}
+
+void SceneXmlReader::DeleteJobs()
+{
+    if (threadPool_)
+        threadPool_->waitForDone();
+    qDeleteAll(runningJobs_);
+    runningJobs_.clear();
+    qDeleteAll(readyJobs_);
+    readyJobs_.clear();
+}
+
+void SceneXmlReader::FallbackToSequential()
+{
+    delete threadPool_;
+    threadPool_ = 0;
+    if (device_)
+        buffer_.append(device_->readAll());
+    xml_.clear();
+    xml_.addData(buffer_);
+    buffer_.clear();
+}
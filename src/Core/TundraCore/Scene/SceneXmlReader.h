@@ -0,0 +1,106 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "SceneDesc.h"
+
+#include <QXmlStreamReader>
+#include <QByteArray>
+#include <QList>
+
+class QIODevice;
+class QThreadPool;
+
+/// Pull parser for Tundra scene XML (.txml).
+/** Reads the scene one top-level item at a time without building a DOM of the whole document,
+    so the memory use is bound by the size of the largest root-level entity instead of the size of the file.
+    The entities are read into EntityDesc structures, with the attributes of the components as they appear in the XML.
+
+    Usage:
+    @code
+    SceneXmlReader reader(&file);
+    if (!reader.ReadSceneStart())
+        return;
+    EntityDesc entity;
+    QString storage;
+    SceneXmlReader::Item item;
+    while((item = reader.ReadNext(entity, storage)) != SceneXmlReader::End && item != SceneXmlReader::Error)
+        ...
+    @endcode
+
+    When constructed with more than one thread, the reader parses the scene in parallel: the document is read in large windows,
+    which are split at the boundaries of the root-level elements and parsed on worker threads, while the caller consumes
+    the results of the previous window. The items are returned in document order either way. Documents that are not
+    UTF-8 encoded are parsed on the calling thread. */
+class TUNDRACORE_API SceneXmlReader
+{
+public:
+    /// Top-level items of the scene element.
+    enum Item
+    {
+        Storage, ///< An asset storage specifier was read.
+        RootEntity, ///< A root-level entity, and its child entities, was read.
+        End, ///< The end of the scene element was reached.
+        Error ///< The XML is malformed, see ErrorString.
+    };
+
+    /// Reads from @c device, which must be open for reading.
+    explicit SceneXmlReader(QIODevice *device);
+    /// Reads from @c device in parallel, using up to @c numThreads worker threads.
+    /** With @c numThreads of 1 or less this is the same as SceneXmlReader(QIODevice*). */
+    SceneXmlReader(QIODevice *device, int numThreads);
+    /// Reads from an XML string.
+    explicit SceneXmlReader(const QString &xml);
+    ~SceneXmlReader();
+
+    /// Sets the size of the blocks read from the device when parsing in parallel. The default is 4 MB.
+    /** A window parsed in parallel is at least one block. Call before ReadSceneStart. */
+    void SetReadBlockSize(int bytes);
+
+    /// Reads up to and including the start of the 'scene' element.
+    /** @return False if the document has no scene root element. */
+    bool ReadSceneStart();
+
+    /// Reads the next top-level item of the scene element.
+    /** @param entity Filled when RootEntity is returned.
+        @param storageSpecifier Filled when Storage is returned. */
+    Item ReadNext(EntityDesc &entity, QString &storageSpecifier);
+
+    /// Returns the parse error with its line and column, or an empty string if there is no error.
+    QString ErrorString() const;
+
+private:
+    Q_DISABLE_COPY(SceneXmlReader)
+    class ParseJob;
+
+    Item ReadNextSequential(EntityDesc &entity, QString &storageSpecifier);
+    void ReadEntity(EntityDesc &entity);
+    void ReadComponent(ComponentDesc &component);
+
+    bool ReadSceneStartParallel();
+    /// Reads a block from the device to buffer_. Returns false at the end of the device.
+    bool ReadMore();
+    /// Splits the next window of buffer_ into chunks and starts parsing them on the worker threads.
+    void StartJobs();
+    /// Waits for the running jobs and makes their results available.
+    void TakeResults();
+    void DeleteJobs();
+    /// Continues the parse on the calling thread, for the documents the parallel parse does not handle.
+    void FallbackToSequential();
+
+    QXmlStreamReader xml_;
+
+    // Parallel parse
+    QIODevice *device_;
+    QThreadPool *threadPool_; ///< Null when parsing sequentially.
+    int numThreads_;
+    int readBlockSize_;
+    QByteArray buffer_; ///< Read but not yet parsed data, starts at a boundary of a root-level element.
+    int line_; ///< Line number of the start of buffer_.
+    bool sceneEnded_;
+    QList<ParseJob *> runningJobs_; ///< Jobs of the window being parsed.
+    QList<ParseJob *> readyJobs_; ///< Parsed jobs whose results are being returned.
+    QString error_;
+    QString endError_; ///< Error to report after the results of the last window, if the document ended prematurely.
+};
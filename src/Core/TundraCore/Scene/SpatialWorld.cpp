@@ -0,0 +1,550 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "SpatialWorld.h"
+#include "ISpatialBoundsProvider.h"
+#include "Scene/Scene.h"
+#include "SceneAPI.h"
+#include "Entity.h"
+#include "IComponent.h"
+#include "IRenderer.h"
+#include "Framework.h"
+#include "Profiler.h"
+#include "Geometry/Ray.h"
+
+#include <algorithm>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    inline bool LayerMatches(u32 layer, u32 layerMask)
+    {
+        return (layer & layerMask) != 0;
+    }
+
+    /// Returns true if the box is finite and not inverted. Boxes of zero size, e.g. the position of a placeable, are valid.
+    inline bool IsValidBounds(const AABB &aabb)
+    {
+        return aabb.IsFinite() && aabb.minPoint.x <= aabb.maxPoint.x && aabb.minPoint.y <= aabb.maxPoint.y && aabb.minPoint.z <= aabb.maxPoint.z;
+    }
+
+    /// Returns the outward normal of the face of the box that the given point on its surface lies on.
+    float3 BoxFaceNormal(const AABB &aabb, const float3 &point)
+    {
+        const float3 center = aabb.CenterPoint();
+        const float3 halfSize = Max(aabb.HalfSize(), float3(1e-6f, 1e-6f, 1e-6f));
+        const float3 local = (point - center).Div(halfSize);
+        const int axis = local.Abs().MaxElementIndex();
+        float3 normal = float3::zero;
+        normal[axis] = local[axis] >= 0.f ? 1.f : -1.f;
+        return normal;
+    }
+
+    bool RayQueryResultLessThan(const RayQueryResult &a, const RayQueryResult &b)
+    {
+        return a.t < b.t;
+    }
+}
+
+/// Collects the entities of the proxies reported by the tree, filtered by the layer mask.
+struct SpatialWorld::EntityCollector
+{
+    EntityCollector(const SpatialWorld *world_, u32 layerMask_, std::vector<Entity*> &entities_) :
+        world(world_), layerMask(layerMask_), entities(entities_) {}
+
+    bool operator()(int proxyId)
+    {
+        if (LayerMatches(world->proxyLayers_[proxyId], layerMask))
+        {
+            EntityPtr entity = world->scene_->EntityById(world->tree_.UserData(proxyId));
+            if (entity)
+                entities.push_back(entity.get());
+        }
+        return true;
+    }
+
+    const SpatialWorld *world;
+    u32 layerMask;
+    std::vector<Entity*> &entities;
+};
+
+/// Collects the entities of the proxies in the order reported by DynamicAABBTree::QueryNearest until enough have been found.
+struct SpatialWorld::NearestCollector
+{
+    NearestCollector(const SpatialWorld *world_, u32 layerMask_, int count_, std::vector<Entity*> &entities_) :
+        world(world_), layerMask(layerMask_), count(count_), entities(entities_) {}
+
+    bool operator()(int proxyId, float /*distance*/)
+    {
+        if (LayerMatches(world->proxyLayers_[proxyId], layerMask))
+        {
+            EntityPtr entity = world->scene_->EntityById(world->tree_.UserData(proxyId));
+            if (entity)
+            {
+                entities.push_back(entity.get());
+                if (--count <= 0)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    const SpatialWorld *world;
+    u32 layerMask;
+    int count;
+    std::vector<Entity*> &entities;
+};
+
+/// Refines the ray hits of the tree with the exact tests of the entities. When only the closest hit is needed,
+/// the ray is clipped to the closest hit found so far.
+struct SpatialWorld::RayCollector
+{
+    RayCollector(const SpatialWorld *world_, const Ray &ray_, u32 layerMask_, float maxDistance_, bool getAllResults_, std::vector<RayQueryResult> &results_) :
+        world(world_), ray(ray_), layerMask(layerMask_), maxDistance(maxDistance_), getAllResults(getAllResults_), results(results_) {}
+
+    float operator()(int proxyId, float boundsDistance)
+    {
+        if (!LayerMatches(world->proxyLayers_[proxyId], layerMask))
+            return maxDistance;
+        EntityPtr entity = world->scene_->EntityById(world->tree_.UserData(proxyId));
+        if (!entity)
+            return maxDistance;
+
+        RayQueryResult result;
+        if (world->RaycastEntity(entity.get(), ray, maxDistance, boundsDistance, result))
+        {
+            if (getAllResults)
+                results.push_back(result);
+            else
+            {
+                results.clear();
+                results.push_back(result);
+                maxDistance = result.t;
+            }
+        }
+        return maxDistance;
+    }
+
+    const SpatialWorld *world;
+    Ray ray;
+    u32 layerMask;
+    float maxDistance;
+    bool getAllResults;
+    std::vector<RayQueryResult> &results;
+};
+
+SpatialWorld::SpatialWorld(Scene *scene) :
+    scene_(scene),
+    tree_(0.2f)
+{
+    connect(scene_, SIGNAL(ComponentAdded(Entity*, IComponent*, AttributeChange::Type)), SLOT(OnComponentAdded(Entity*, IComponent*, AttributeChange::Type)));
+    connect(scene_, SIGNAL(ComponentRemoved(Entity*, IComponent*, AttributeChange::Type)), SLOT(OnComponentRemoved(Entity*, IComponent*, AttributeChange::Type)));
+    connect(scene_, SIGNAL(AttributeChanged(IComponent*, IAttribute*, AttributeChange::Type)), SLOT(OnAttributeChanged(IComponent*, IAttribute*, AttributeChange::Type)));
+    connect(scene_, SIGNAL(EntityRemoved(Entity*, AttributeChange::Type)), SLOT(OnEntityRemoved(Entity*, AttributeChange::Type)));
+    connect(scene_, SIGNAL(EntityParentChanged(Entity*, Entity*, AttributeChange::Type)), SLOT(OnEntityParentChanged(Entity*, Entity*, AttributeChange::Type)));
+
+    Rebuild();
+}
+
+SpatialWorld::~SpatialWorld()
+{
+    for(size_t i = 0; i < rayResults_.size(); ++i)
+        delete rayResults_[i];
+    rayResults_.clear();
+}
+
+void SpatialWorld::Update()
+{
+    if (dirty_.empty())
+        return;
+
+    PROFILE(SpatialWorld_Update);
+
+    for(std::set<entity_id_t>::const_iterator iter = dirty_.begin(); iter != dirty_.end(); ++iter)
+    {
+        const entity_id_t id = *iter;
+        EntityProxyMap::iterator proxy = proxies_.find(id);
+        EntityPtr entity = scene_->EntityById(id);
+
+        AABB bounds;
+        u32 layer = 0xFFFFFFFF;
+        if (!entity || !ComputeEntityBounds(entity.get(), bounds, layer))
+        {
+            if (proxy != proxies_.end())
+            {
+                tree_.Remove(proxy->second);
+                proxies_.erase(proxy);
+            }
+            continue;
+        }
+
+        int proxyId;
+        if (proxy != proxies_.end())
+        {
+            proxyId = proxy->second;
+            tree_.Move(proxyId, bounds);
+        }
+        else
+        {
+            proxyId = tree_.Insert(bounds, id);
+            proxies_[id] = proxyId;
+        }
+        if ((int)proxyLayers_.size() <= proxyId)
+            proxyLayers_.resize(proxyId + 1);
+        proxyLayers_[proxyId] = layer;
+    }
+    dirty_.clear();
+}
+
+void SpatialWorld::Rebuild()
+{
+    PROFILE(SpatialWorld_Rebuild);
+
+    tree_.Clear();
+    proxies_.clear();
+    proxyLayers_.clear();
+    dirty_.clear();
+
+    SceneAPI *sceneAPI = scene_->GetFramework()->Scene();
+    for(Scene::const_iterator iter = scene_->begin(); iter != scene_->end(); ++iter)
+    {
+        Entity *entity = iter->second.get();
+        const Entity::ComponentMap &components = entity->Components();
+        for(Entity::ComponentMap::const_iterator comp = components.begin(); comp != components.end(); ++comp)
+        {
+            ISpatialBoundsProvider *provider = sceneAPI->SpatialBoundsProvider(comp->second->TypeId());
+            if (provider)
+                provider->ConnectChangeSignals(comp->second.get(), this);
+        }
+        dirty_.insert(entity->Id());
+    }
+}
+
+bool SpatialWorld::ComputeEntityBounds(Entity *entity, AABB &outBounds, u32 &outLayer) const
+{
+    SceneAPI *sceneAPI = scene_->GetFramework()->Scene();
+    bool hasBounds = false;
+    bool hasFallback = false;
+    AABB fallback;
+    outLayer = 0xFFFFFFFF;
+
+    const Entity::ComponentMap &components = entity->Components();
+    for(Entity::ComponentMap::const_iterator iter = components.begin(); iter != components.end(); ++iter)
+    {
+        IComponent *component = iter->second.get();
+        ISpatialBoundsProvider *provider = sceneAPI->SpatialBoundsProvider(component->TypeId());
+        if (!provider)
+            continue;
+
+        u32 layer;
+        if (provider->SelectionLayer(component, layer))
+            outLayer = layer;
+
+        AABB bounds;
+        if (!provider->WorldBounds(component, bounds) || !IsValidBounds(bounds))
+            continue;
+
+        if (provider->IsFallback())
+        {
+            fallback = bounds;
+            hasFallback = true;
+        }
+        else if (!hasBounds)
+        {
+            outBounds = bounds;
+            hasBounds = true;
+        }
+        else
+            outBounds.Enclose(bounds);
+    }
+
+    if (!hasBounds && hasFallback)
+    {
+        outBounds = fallback;
+        hasBounds = true;
+    }
+    return hasBounds;
+}
+
+bool SpatialWorld::RaycastEntity(Entity *entity, const Ray &ray, float maxDistance, float boundsDistance, RayQueryResult &outResult) const
+{
+    SceneAPI *sceneAPI = scene_->GetFramework()->Scene();
+    bool hasExactTest = false;
+    bool hit = false;
+    IComponent *boundsComponent = 0;
+
+    const Entity::ComponentMap &components = entity->Components();
+    for(Entity::ComponentMap::const_iterator iter = components.begin(); iter != components.end(); ++iter)
+    {
+        IComponent *component = iter->second.get();
+        ISpatialBoundsProvider *provider = sceneAPI->SpatialBoundsProvider(component->TypeId());
+        if (!provider)
+            continue;
+        if (!boundsComponent || (!provider->IsFallback() && sceneAPI->SpatialBoundsProvider(boundsComponent->TypeId())->IsFallback()))
+            boundsComponent = component;
+        if (!provider->SupportsRaycast())
+            continue;
+
+        hasExactTest = true;
+        float distance;
+        float3 normal;
+        if (provider->Raycast(component, ray, hit ? outResult.t : maxDistance, distance, normal) && distance <= maxDistance && (!hit || distance < outResult.t))
+        {
+            hit = true;
+            outResult.entity = entity;
+            outResult.component = component;
+            outResult.t = distance;
+            outResult.pos = ray.GetPoint(distance);
+            outResult.normal = normal;
+        }
+    }
+
+    // Entities without an exact test are hit at their bounds.
+    if (!hasExactTest && boundsComponent && boundsDistance <= maxDistance)
+    {
+        EntityProxyMap::const_iterator proxy = proxies_.find(entity->Id());
+        if (proxy == proxies_.end())
+            return false;
+        hit = true;
+        outResult.entity = entity;
+        outResult.component = boundsComponent;
+        outResult.t = boundsDistance;
+        outResult.pos = ray.GetPoint(boundsDistance);
+        outResult.normal = BoxFaceNormal(tree_.Bounds(proxy->second), outResult.pos);
+    }
+    return hit;
+}
+
+void SpatialWorld::RaycastInternal(const Ray &ray, u32 layerMask, float maxDistance, bool getAllResults, std::vector<RayQueryResult> &outResults)
+{
+    PROFILE(SpatialWorld_Raycast);
+
+    Update();
+    outResults.clear();
+    RayCollector collector(this, ray, layerMask, maxDistance, getAllResults, outResults);
+    tree_.Raycast(ray, maxDistance, collector);
+    if (getAllResults)
+        std::sort(outResults.begin(), outResults.end(), RayQueryResultLessThan);
+}
+
+bool SpatialWorld::Raycast(const Ray &ray, u32 layerMask, float maxDistance, RayQueryResult &outResult)
+{
+    std::vector<RayQueryResult> results;
+    RaycastInternal(ray, layerMask, maxDistance, false, results);
+    if (results.empty())
+        return false;
+    outResult = results.front();
+    return true;
+}
+
+RaycastResult *SpatialWorld::Raycast(const Ray &ray, unsigned layerMask, float maxDistance)
+{
+    ClearRaycastResults();
+    RayQueryResult hit;
+    if (!Raycast(ray, layerMask, maxDistance, hit))
+        return rayResults_[0];
+
+    RaycastResult *result = rayResults_[0];
+    result->entity = hit.entity;
+    result->component = hit.component;
+    result->pos = hit.pos;
+    result->normal = hit.normal;
+    result->t = hit.t;
+    return result;
+}
+
+QList<RaycastResult*> SpatialWorld::RaycastAll(const Ray &ray, unsigned layerMask, float maxDistance)
+{
+    ClearRaycastResults();
+    std::vector<RayQueryResult> hits;
+    RaycastInternal(ray, layerMask, maxDistance, true, hits);
+    for(size_t i = 0; i < hits.size(); ++i)
+    {
+        RaycastResult *result = GetOrCreateRaycastResult(i);
+        result->entity = hits[i].entity;
+        result->component = hits[i].component;
+        result->pos = hits[i].pos;
+        result->normal = hits[i].normal;
+        result->t = hits[i].t;
+        rayHits_.push_back(result);
+    }
+    return rayHits_;
+}
+
+RaycastResult *SpatialWorld::GetOrCreateRaycastResult(size_t index)
+{
+    while(rayResults_.size() <= index)
+        rayResults_.push_back(new RaycastResult());
+    return rayResults_[index];
+}
+
+void SpatialWorld::ClearRaycastResults()
+{
+    // In case of returning only a single result, make sure its entity & component are cleared in case of no hit
+    RaycastResult *result = GetOrCreateRaycastResult(0);
+    result->entity = 0;
+    result->component = 0;
+    result->submesh = 0;
+    result->index = 0;
+    result->u = 0.f;
+    result->v = 0.f;
+    result->t = FLOAT_INF;
+    rayHits_.clear();
+}
+
+void SpatialWorld::QueryAABB(const AABB &aabb, u32 layerMask, std::vector<Entity*> &outEntities)
+{
+    PROFILE(SpatialWorld_QueryAABB);
+    Update();
+    EntityCollector collector(this, layerMask, outEntities);
+    tree_.QueryAABB(aabb, collector);
+}
+
+void SpatialWorld::QuerySphere(const Sphere &sphere, u32 layerMask, std::vector<Entity*> &outEntities)
+{
+    PROFILE(SpatialWorld_QuerySphere);
+    Update();
+    EntityCollector collector(this, layerMask, outEntities);
+    tree_.QuerySphere(sphere, collector);
+}
+
+void SpatialWorld::QueryFrustum(const Frustum &frustum, u32 layerMask, std::vector<Entity*> &outEntities)
+{
+    PROFILE(SpatialWorld_QueryFrustum);
+    Update();
+    EntityCollector collector(this, layerMask, outEntities);
+    tree_.QueryFrustum(frustum, collector);
+}
+
+void SpatialWorld::QueryNearest(const float3 &point, int count, u32 layerMask, float maxDistance, std::vector<Entity*> &outEntities)
+{
+    PROFILE(SpatialWorld_QueryNearest);
+    if (count <= 0)
+        return;
+    Update();
+    NearestCollector collector(this, layerMask, count, outEntities);
+    tree_.QueryNearest(point, maxDistance, collector);
+}
+
+void SpatialWorld::ConvertToEntityList(const std::vector<Entity*> &entities, EntityList &outList) const
+{
+    for(size_t i = 0; i < entities.size(); ++i)
+        outList.push_back(entities[i]->shared_from_this());
+}
+
+EntityList SpatialWorld::EntitiesInAABB(const AABB &aabb, unsigned layerMask)
+{
+    std::vector<Entity*> entities;
+    QueryAABB(aabb, layerMask, entities);
+    EntityList ret;
+    ConvertToEntityList(entities, ret);
+    return ret;
+}
+
+EntityList SpatialWorld::EntitiesInSphere(const Sphere &sphere, unsigned layerMask)
+{
+    std::vector<Entity*> entities;
+    QuerySphere(sphere, layerMask, entities);
+    EntityList ret;
+    ConvertToEntityList(entities, ret);
+    return ret;
+}
+
+EntityList SpatialWorld::EntitiesInFrustum(const Frustum &frustum, unsigned layerMask)
+{
+    std::vector<Entity*> entities;
+    QueryFrustum(frustum, layerMask, entities);
+    EntityList ret;
+    ConvertToEntityList(entities, ret);
+    return ret;
+}
+
+EntityList SpatialWorld::NearestEntities(const float3 &point, int count, unsigned layerMask, float maxDistance)
+{
+    std::vector<Entity*> entities;
+    QueryNearest(point, count, layerMask, maxDistance, entities);
+    EntityList ret;
+    ConvertToEntityList(entities, ret);
+    return ret;
+}
+
+AABB SpatialWorld::EntityBounds(Entity *entity)
+{
+    Update();
+    AABB bounds;
+    bounds.SetNegativeInfinity();
+    if (entity)
+    {
+        EntityProxyMap::const_iterator proxy = proxies_.find(entity->Id());
+        if (proxy != proxies_.end())
+            bounds = tree_.Bounds(proxy->second);
+    }
+    return bounds;
+}
+
+int SpatialWorld::NumEntities()
+{
+    Update();
+    return tree_.NumProxies();
+}
+
+void SpatialWorld::MarkComponentDirty()
+{
+    IComponent *component = dynamic_cast<IComponent*>(sender());
+    if (component)
+        MarkEntityDirty(component->ParentEntity());
+}
+
+void SpatialWorld::MarkEntityDirty(Entity *entity)
+{
+    if (entity && entity->ParentScene() == scene_)
+        dirty_.insert(entity->Id());
+}
+
+void SpatialWorld::OnComponentAdded(Entity *entity, IComponent *component, AttributeChange::Type /*change*/)
+{
+    ISpatialBoundsProvider *provider = scene_->GetFramework()->Scene()->SpatialBoundsProvider(component->TypeId());
+    if (!provider)
+        return;
+    provider->ConnectChangeSignals(component, this);
+    MarkEntityDirty(entity);
+}
+
+void SpatialWorld::OnComponentRemoved(Entity *entity, IComponent *component, AttributeChange::Type /*change*/)
+{
+    // The component is still in the entity when this is signaled, so mark the entity dirty, and let Update find out the new bounds.
+    if (scene_->GetFramework()->Scene()->SpatialBoundsProvider(component->TypeId()))
+    {
+        disconnect(component, 0, this, 0);
+        MarkEntityDirty(entity);
+    }
+}
+
+void SpatialWorld::OnAttributeChanged(IComponent *component, IAttribute * /*attribute*/, AttributeChange::Type /*change*/)
+{
+    if (scene_->GetFramework()->Scene()->SpatialBoundsProvider(component->TypeId()))
+        MarkEntityDirty(component->ParentEntity());
+}
+
+void SpatialWorld::OnEntityRemoved(Entity *entity, AttributeChange::Type /*change*/)
+{
+    EntityProxyMap::iterator proxy = proxies_.find(entity->Id());
+    if (proxy != proxies_.end())
+    {
+        tree_.Remove(proxy->second);
+        proxies_.erase(proxy);
+    }
+    dirty_.erase(entity->Id());
+}
+
+void SpatialWorld::OnEntityParentChanged(Entity *entity, Entity * /*newParent*/, AttributeChange::Type /*change*/)
+{
+    // The world transforms of the whole subtree may have changed.
+    MarkEntityDirty(entity);
+    EntityList children = entity->Children(true);
+    for(EntityList::const_iterator iter = children.begin(); iter != children.end(); ++iter)
+        MarkEntityDirty(iter->get());
+}
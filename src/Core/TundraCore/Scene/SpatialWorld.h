@@ -0,0 +1,154 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "CoreDefines.h"
+#include "SceneFwd.h"
+#include "AttributeChangeType.h"
+#include "Math/MathFwd.h"
+#include "Math/MathConstants.h"
+#include "Geometry/DynamicAABBTree.h"
+
+#include <QObject>
+#include <QList>
+
+#include <map>
+#include <set>
+#include <vector>
+
+class RaycastResult;
+struct RayQueryResult;
+
+/// Renderer-independent spatial index of the entities of a scene.
+/** Maintains a dynamic AABB tree of entity bounds, and answers raycast, sphere, box, frustum and nearest neighbor queries.
+    Works the same on headless servers and on clients, as the bounds are computed from the scene data instead of the
+    renderer. The bounds of the components are computed by ISpatialBoundsProvider objects registered to SceneAPI.
+
+    Changes to the bounds are collected as they happen, and the tree is refit lazily before the next query, so moving
+    entities costs nothing until somebody asks. An entity that moves within the margin of its tree node does not cause any
+    restructuring of the tree.
+
+    Selection layers are taken from the providers, e.g. EC_Placeable::selectionLayer. An entity passes a query if
+    its layer bitmask and the query's layer mask have any bits in common. Entities that do not define a layer
+    pass all queries.
+
+    Created by SceneAPI for each scene, and accessible as a dynamic property "spatial" of the scene, or with Scene::Subsystem<SpatialWorld>().
+    @note The returned RaycastResult objects are owned by the SpatialWorld and are valid until the next raycast. */
+class TUNDRACORE_API SpatialWorld : public QObject, public enable_shared_from_this<SpatialWorld>
+{
+    Q_OBJECT
+    Q_PROPERTY(int numEntities READ NumEntities)
+    Q_PROPERTY(float margin READ Margin)
+
+public:
+    /// Called by SceneAPI upon the creation of a new scene.
+    explicit SpatialWorld(Scene *scene);
+    ~SpatialWorld();
+
+    /// Dynamic scene property name "spatial"
+    static const char* PropertyName() { return "spatial"; }
+
+    /// Does a raycast into the world and returns the closest hit.
+    /** @return True if something was hit. */
+    bool Raycast(const Ray &ray, u32 layerMask, float maxDistance, RayQueryResult &outResult);
+
+    /// Appends the entities whose bounds intersect the given box to 'outEntities'.
+    void QueryAABB(const AABB &aabb, u32 layerMask, std::vector<Entity*> &outEntities);
+
+    /// Appends the entities whose bounds intersect the given sphere to 'outEntities'.
+    void QuerySphere(const Sphere &sphere, u32 layerMask, std::vector<Entity*> &outEntities);
+
+    /// Appends the entities whose bounds intersect the given frustum to 'outEntities'.
+    /** The test is conservative: entities just outside the frustum corners may be reported. */
+    void QueryFrustum(const Frustum &frustum, u32 layerMask, std::vector<Entity*> &outEntities);
+
+    /// Appends at most 'count' entities closest to the given point to 'outEntities', sorted by distance.
+    /** The distance to an entity is the distance to its bounds, i.e. zero if the point is inside the bounds. */
+    void QueryNearest(const float3 &point, int count, u32 layerMask, float maxDistance, std::vector<Entity*> &outEntities);
+
+    /// Returns the underlying tree. The user data of each proxy is the entity id.
+    const DynamicAABBTree &Tree() const { return tree_; }
+
+public slots:
+    /// Does a raycast into the world using specific selection layer(s) and a maximum distance.
+    /** @return Raycast result structure, *never* a null pointer, use RaycastResult::entity to see if raycast hit something. */
+    RaycastResult *Raycast(const Ray &ray, unsigned layerMask, float maxDistance);
+    RaycastResult *Raycast(const Ray &ray, unsigned layerMask) { return Raycast(ray, layerMask, FLOAT_INF); } /**< @overload */
+    RaycastResult *Raycast(const Ray &ray) { return Raycast(ray, 0xFFFFFFFF, FLOAT_INF); } /**< @overload */
+
+    /// Does a raycast into the world and returns all hits, sorted by distance.
+    QList<RaycastResult*> RaycastAll(const Ray &ray, unsigned layerMask, float maxDistance);
+    QList<RaycastResult*> RaycastAll(const Ray &ray, unsigned layerMask) { return RaycastAll(ray, layerMask, FLOAT_INF); } /**< @overload */
+    QList<RaycastResult*> RaycastAll(const Ray &ray) { return RaycastAll(ray, 0xFFFFFFFF, FLOAT_INF); } /**< @overload */
+
+    /// Returns the entities whose bounds intersect the given box.
+    EntityList EntitiesInAABB(const AABB &aabb, unsigned layerMask = 0xFFFFFFFF);
+
+    /// Returns the entities whose bounds intersect the given sphere.
+    EntityList EntitiesInSphere(const Sphere &sphere, unsigned layerMask = 0xFFFFFFFF);
+
+    /// Returns the entities whose bounds intersect the given frustum.
+    EntityList EntitiesInFrustum(const Frustum &frustum, unsigned layerMask = 0xFFFFFFFF);
+
+    /// Returns at most 'count' entities closest to the given point, sorted by distance.
+    EntityList NearestEntities(const float3 &point, int count, unsigned layerMask, float maxDistance);
+    EntityList NearestEntities(const float3 &point, int count, unsigned layerMask = 0xFFFFFFFF) { return NearestEntities(point, count, layerMask, FLOAT_INF); } /**< @overload */
+
+    /// Returns the world space bounds of the entity, or a negative infinity box if the entity has no spatial extent.
+    AABB EntityBounds(Entity *entity);
+
+    /// Returns the number of entities in the index.
+    int NumEntities();
+
+    /// Returns the margin the entity bounds are enlarged by in the tree.
+    float Margin() const { return tree_.Margin(); }
+
+    /// Applies all pending bounds changes to the tree. Called automatically before each query.
+    void Update();
+
+    /// Discards the tree and recomputes the bounds of all entities.
+    void Rebuild();
+
+    /// Marks the entity of the component that emitted the signal for a refit. For ISpatialBoundsProvider::ConnectChangeSignals.
+    void MarkComponentDirty();
+
+    /// Marks the entity for a refit.
+    void MarkEntityDirty(Entity *entity);
+
+private slots:
+    void OnComponentAdded(Entity *entity, IComponent *component, AttributeChange::Type change);
+    void OnComponentRemoved(Entity *entity, IComponent *component, AttributeChange::Type change);
+    void OnAttributeChanged(IComponent *component, IAttribute *attribute, AttributeChange::Type change);
+    void OnEntityRemoved(Entity *entity, AttributeChange::Type change);
+    void OnEntityParentChanged(Entity *entity, Entity *newParent, AttributeChange::Type change);
+
+private:
+    struct EntityCollector;
+    struct NearestCollector;
+    struct RayCollector;
+
+    typedef std::map<entity_id_t, int> EntityProxyMap; ///< Maps entity ids to the proxy ids of the tree.
+
+    /// Computes the bounds and the selection layer of the entity from its components.
+    /** @return False if the entity has no spatial extent. */
+    bool ComputeEntityBounds(Entity *entity, AABB &outBounds, u32 &outLayer) const;
+
+    /// Tests the ray against the entity, using the exact tests of the providers where available.
+    bool RaycastEntity(Entity *entity, const Ray &ray, float maxDistance, float boundsDistance, RayQueryResult &outResult) const;
+
+    /// Finds all hits along the ray, sorted by distance.
+    void RaycastInternal(const Ray &ray, u32 layerMask, float maxDistance, bool getAllResults, std::vector<RayQueryResult> &outResults);
+
+    void ConvertToEntityList(const std::vector<Entity*> &entities, EntityList &outList) const;
+    RaycastResult *GetOrCreateRaycastResult(size_t index);
+    void ClearRaycastResults();
+
+    Scene *scene_;
+    DynamicAABBTree tree_;
+    EntityProxyMap proxies_;
+    std::vector<u32> proxyLayers_; ///< Selection layers of the entities, indexed by proxy id.
+    std::set<entity_id_t> dirty_;
+    std::vector<RaycastResult*> rayResults_;
+    QList<RaycastResult*> rayHits_;
+};
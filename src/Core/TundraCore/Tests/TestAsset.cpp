@@ -0,0 +1,282 @@
+
+#include "DebugOperatorNew.h"
+
+#include "TestAsset.h"
+
+#include "Framework.h"
+#include "AssetAPI.h"
+#include "IAsset.h"
+#include "IAssetTransfer.h"
+#include "AssetDependencyGraph.h"
+#include "AssetRefTable.h"
+
+#include <QtTest/QtTest>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    typedef AssetDependencyGraph::NodeId NodeId;
+
+    AssetDependencyGraph::NodeList Nodes(NodeId a, NodeId b = AssetDependencyGraph::cInvalidNode, NodeId c = AssetDependencyGraph::cInvalidNode)
+    {
+        AssetDependencyGraph::NodeList nodes(1, a);
+        if (b != AssetDependencyGraph::cInvalidNode)
+            nodes.push_back(b);
+        if (c != AssetDependencyGraph::cInvalidNode)
+            nodes.push_back(c);
+        return nodes;
+    }
+}
+
+namespace TundraTest
+{
+    Asset::Asset(const QString &config)
+    {
+        test_.SetConfig(config);
+    }
+
+    void Asset::initTestCase()
+    {
+        test_.Initialize(false);
+
+        // Create loaded in-memory assets for the request tests.
+        AssetAPI *assetAPI = test_.framework->Asset();
+        const u8 data[] = { 1, 2, 3, 4 };
+        for(int i = 0; i < 1000; ++i)
+        {
+            QString ref = QString("local://TestAsset_%1.dat").arg(i);
+            AssetPtr asset = assetAPI->CreateNewAsset("Binary", ref);
+            QVERIFY(asset);
+            QVERIFY(asset->LoadFromFileInMemory(data, sizeof(data), false));
+            QVERIFY(asset->IsLoaded());
+            refs_ << ref;
+        }
+    }
+
+    void Asset::cleanupTestCase()
+    {
+        AssetAPI *assetAPI = test_.framework->Asset();
+        foreach(const QString &ref, refs_)
+            assetAPI->ForgetAsset(ref, false);
+        refs_.clear();
+    }
+
+    void Asset::Request_LoadedAsset()
+    {
+        AssetAPI *assetAPI = test_.framework->Asset();
+        AssetPtr asset = assetAPI->FindAsset(refs_[0]);
+        QVERIFY(asset);
+
+        // Requests to a loaded asset get a virtual transfer to the same asset, regardless of the case of the ref.
+        AssetTransferPtr transfer = assetAPI->RequestAsset(refs_[0], "Binary");
+        QVERIFY(transfer);
+        QVERIFY(transfer->asset == asset);
+        AssetTransferPtr upperCaseTransfer = assetAPI->RequestAsset(refs_[0].toUpper(), "");
+        QVERIFY(upperCaseTransfer);
+        QVERIFY(upperCaseTransfer->asset == asset);
+        QVERIFY(assetAPI->FindAsset(refs_[0].toUpper()) == asset);
+
+        // The public maps are keyed by the asset names.
+        AssetMap assets = assetAPI->Assets();
+        AssetMap::const_iterator iter = assets.find(refs_[0]);
+        QVERIFY(iter != assets.end());
+        QVERIFY(iter->second == asset);
+        QCOMPARE(iter->first, asset->Name());
+
+        test_.ProcessEvents();
+    }
+
+    void Asset::DependencyGraph_Chain()
+    {
+        // The mesh depends on its material and skeleton, and the material on its texture.
+        AssetDependencyGraph graph;
+        const NodeId mesh = graph.Intern("local://Chain.mesh");
+        const NodeId material = graph.Intern("local://Chain.material");
+        const NodeId texture = graph.Intern("local://Chain.png");
+        const NodeId skeleton = graph.Intern("local://Chain.skeleton");
+        QVERIFY(graph.SetDependencies(mesh, Nodes(material, skeleton, material)));
+        QVERIFY(graph.SetDependencies(material, Nodes(texture)));
+        QVERIFY(!graph.SetDependencies(material, Nodes(texture)));
+        QCOMPARE(graph.NumEdges(), (size_t)3);
+        QCOMPARE(graph.Edges().size(), (size_t)3);
+        QCOMPARE(graph.Find("LOCAL://CHAIN.PNG"), texture);
+        QCOMPARE(graph.Dependents(texture).size(), (size_t)1);
+        QCOMPARE(graph.Dependents(texture)[0], material);
+
+        QCOMPARE(graph.NumPendingDependencies(mesh), 2);
+        QCOMPARE(graph.NumPendingDependenciesRecursive(mesh), 3);
+
+        // A dependency is complete only once its own dependencies are.
+        graph.SetLoaded(material, true);
+        QVERIFY(!graph.IsComplete(material));
+        QCOMPARE(graph.NumPendingDependencies(mesh), 2);
+        QCOMPARE(graph.NumPendingDependenciesRecursive(mesh), 2);
+        graph.SetLoaded(texture, true);
+        QVERIFY(graph.IsComplete(material));
+        QCOMPARE(graph.NumPendingDependencies(mesh), 1);
+        QCOMPARE(graph.NumPendingDependenciesRecursive(mesh), 1);
+        graph.SetLoaded(skeleton, true);
+        QCOMPARE(graph.NumPendingDependencies(mesh), 0);
+        QVERIFY(!graph.IsComplete(mesh));
+        graph.SetLoaded(mesh, true);
+        QVERIFY(graph.IsComplete(mesh));
+
+        // Unloading the end of the chain makes the whole chain incomplete again.
+        graph.SetLoaded(texture, false);
+        QVERIFY(!graph.IsComplete(material));
+        QVERIFY(!graph.IsComplete(mesh));
+        QCOMPARE(graph.NumPendingDependencies(mesh), 1);
+        QCOMPARE(graph.NumPendingDependenciesRecursive(mesh), 1);
+    }
+
+    void Asset::DependencyGraph_Cycle()
+    {
+        // Three assets depend on each other in a cycle, and a fourth one on the cycle.
+        AssetDependencyGraph graph;
+        const NodeId a = graph.Intern("local://A.material");
+        const NodeId b = graph.Intern("local://B.material");
+        const NodeId c = graph.Intern("local://C.material");
+        const NodeId d = graph.Intern("local://D.mesh");
+        graph.SetDependencies(a, Nodes(b));
+        graph.SetDependencies(b, Nodes(c));
+        graph.SetDependencies(c, Nodes(a));
+        graph.SetDependencies(d, Nodes(a));
+        graph.SetLoaded(a, true);
+        graph.SetLoaded(b, true);
+        graph.SetLoaded(c, true);
+        graph.SetLoaded(d, true);
+
+        // The assets in the cycle never become complete, but all of them are loaded, so none is counted as pending down the chain.
+        QVERIFY(!graph.IsComplete(a));
+        QVERIFY(!graph.IsComplete(b));
+        QVERIFY(!graph.IsComplete(c));
+        QVERIFY(!graph.IsComplete(d));
+        QCOMPARE(graph.NumPendingDependencies(d), 1);
+        QCOMPARE(graph.NumPendingDependenciesRecursive(d), 0);
+
+        graph.SetLoaded(b, false);
+        QCOMPARE(graph.NumPendingDependenciesRecursive(d), 1);
+        graph.SetLoaded(b, true);
+
+        // Breaking the cycle completes all of them.
+        graph.SetDependencies(c, AssetDependencyGraph::NodeList());
+        QVERIFY(graph.IsComplete(c));
+        QVERIFY(graph.IsComplete(b));
+        QVERIFY(graph.IsComplete(a));
+        QVERIFY(graph.IsComplete(d));
+        QCOMPARE(graph.NumEdges(), (size_t)3);
+    }
+
+    void Asset::DependencyGraph_Remove()
+    {
+        // A depends on B, which depends on C, which has not loaded.
+        AssetDependencyGraph graph;
+        const NodeId a = graph.Intern("local://A.mesh");
+        const NodeId b = graph.Intern("local://B.material");
+        const NodeId c = graph.Intern("local://C.png");
+        graph.SetDependencies(a, Nodes(b));
+        graph.SetDependencies(b, Nodes(c));
+        graph.SetLoaded(a, true);
+        graph.SetLoaded(b, true);
+        QVERIFY(graph.IsTracked(a));
+        QVERIFY(!graph.IsTracked(c));
+        QCOMPARE(graph.NumNodes(), (size_t)3);
+
+        // Forgetting B frees C, which nothing else refers to, but A keeps B as a pending dependency.
+        graph.Remove(b);
+        QCOMPARE(graph.Find("local://B.material"), b);
+        QVERIFY(!graph.IsTracked(b));
+        QVERIFY(!graph.IsLoaded(b));
+        QCOMPARE(graph.Find("local://C.png"), AssetDependencyGraph::cInvalidNode);
+        QCOMPARE(graph.NumNodes(), (size_t)2);
+        QCOMPARE(graph.NumEdges(), (size_t)1);
+        QCOMPARE(graph.NumPendingDependencies(a), 1);
+
+        // B loads again without dependencies and completes A.
+        graph.SetDependencies(b, AssetDependencyGraph::NodeList());
+        graph.SetLoaded(b, true);
+        QVERIFY(graph.IsComplete(a));
+
+        // Forgetting A and then B frees both, and the freed ids are reused.
+        graph.Remove(a);
+        QCOMPARE(graph.Find("local://A.mesh"), AssetDependencyGraph::cInvalidNode);
+        QCOMPARE(graph.NumNodes(), (size_t)1);
+        graph.Remove(b);
+        QCOMPARE(graph.NumNodes(), (size_t)0);
+        QCOMPARE(graph.NumEdges(), (size_t)0);
+        const NodeId e = graph.Intern("local://E.png");
+        QVERIFY(e == a || e == b || e == c);
+        QCOMPARE(graph.Name(e), QString("local://E.png"));
+        QVERIFY(!graph.IsTracked(e));
+        QVERIFY(!graph.IsLoaded(e));
+        QCOMPARE(graph.NumNodes(), (size_t)1);
+    }
+
+    void Asset::RefTable_Release()
+    {
+        // Two maps hold the same ref in different cases.
+        AssetRefTable refs;
+        AssetRefHashMap<int> assets(&refs);
+        AssetRefHashMap<int> transfers(&refs);
+        assets["local://A.png"] = 1;
+        transfers["LOCAL://a.png"] = 2;
+        QCOMPARE(refs.Size(), (size_t)1);
+        QVERIFY(transfers.find("local://a.PNG") != transfers.end());
+        QCOMPARE(refs.NumSpellings(), (size_t)3);
+
+        // The ref and its spellings are kept until the last element is erased.
+        assets.erase("local://a.png");
+        QCOMPARE(refs.Size(), (size_t)1);
+        QCOMPARE(refs.Name(refs.Find("local://a.png")), QString("local://A.png"));
+        transfers.erase(transfers.find("local://A.png"));
+        QCOMPARE(refs.Size(), (size_t)0);
+        QCOMPARE(refs.NumSpellings(), (size_t)0);
+        QVERIFY(!refs.Find("local://A.png").IsValid());
+
+        // Refs that come and go do not grow the table, their ids are reused.
+        for(int i = 0; i < 100; ++i)
+        {
+            const QString ref = "local://" + QString::number(i) + ".png";
+            assets[ref] = i;
+            assets.erase(assets.find(ref.toUpper()));
+        }
+        QCOMPARE(refs.Size(), (size_t)0);
+        QCOMPARE(refs.NumSpellings(), (size_t)0);
+        assets["local://B.png"] = 1;
+        QVERIFY(refs.Find("local://b.png").Id() <= 2);
+
+        assets.clear();
+        QCOMPARE(refs.Size(), (size_t)0);
+    }
+
+    void Asset::Benchmark_RequestLoadedAssets_data()
+    {
+        QTest::addColumn<bool>("sameCase");
+        QTest::newRow("Same case") << true;
+        QTest::newRow("Different case") << false;
+    }
+
+    void Asset::Benchmark_RequestLoadedAssets()
+    {
+        QFETCH(bool, sameCase);
+
+        AssetAPI *assetAPI = test_.framework->Asset();
+        QStringList refs = refs_;
+        if (!sameCase)
+            for(int i = 0; i < refs.size(); ++i)
+                refs[i] = refs[i].toUpper();
+
+        // Measures the throughput of repeated requests to already loaded assets, e.g. from the components
+        // that request their asset refs on each attribute change. Update completes the virtual transfers.
+        QBENCHMARK
+        {
+            for(int i = 0; i < refs.size(); ++i)
+                assetAPI->RequestAsset(refs[i], "");
+            assetAPI->Update(0.0);
+        }
+    }
+}
+
+// QTest entry point
+QTEST_APPLESS_MAIN(TundraTest::Asset);
@@ -0,0 +1,34 @@
+
+#pragma once
+
+#include "TestHelpers.h"
+
+namespace TundraTest
+{
+    class Asset : public QObject
+    {
+        Q_OBJECT
+    
+    public:
+        Asset(const QString &config = "");
+
+    private slots:
+        void initTestCase();     // QTest
+        void cleanupTestCase();  // QTest
+
+        void Request_LoadedAsset();
+
+        void DependencyGraph_Chain();
+        void DependencyGraph_Cycle();
+        void DependencyGraph_Remove();
+
+        void RefTable_Release();
+
+        void Benchmark_RequestLoadedAssets_data();
+        void Benchmark_RequestLoadedAssets();
+
+    private:
+        TestFramework test_;
+        QStringList refs_;
+    };
+}
@@ -0,0 +1,179 @@
+
+#include "DebugOperatorNew.h"
+
+#include "TestDeadReckoning.h"
+
+#include "DeadReckoning.h"
+#include "Transform.h"
+#include "Math/MathFunc.h"
+#include "Math/float3.h"
+#include "Algorithm/Random/LCG.h"
+
+#include <QtTest/QtTest>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    enum Motion
+    {
+        MotionConstantVelocity,
+        MotionCircle,
+        MotionStopAndGo,
+        MotionRandomWalk
+    };
+
+    struct SimulationResult
+    {
+        SimulationResult() : bytes(0), updates(0), meanError(0.f), maxError(0.f) {}
+
+        size_t bytes;
+        int updates;
+        float meanError;
+        float maxError;
+    };
+
+    /// Returns the velocity of the simulated entity on the given tick.
+    float3 Velocity(Motion motion, int tick, float dt, LCG &rng, const float3 &previous)
+    {
+        const float time = tick * dt;
+        switch(motion)
+        {
+        case MotionConstantVelocity:
+            return float3(3.f, 0.f, 1.f);
+        case MotionCircle:
+            return float3(-Sin(0.5f * time), 0.f, Cos(0.5f * time)) * 5.f; // Radius 10 m, 0.5 rad/s.
+        case MotionStopAndGo:
+            return (tick / 60) % 2 == 0 ? float3(4.f, 0.f, 0.f) : float3::zero; // Two seconds moving, two seconds still.
+        case MotionRandomWalk:
+        default:
+            if (tick % 30 == 0) // New heading every second.
+                return float3(rng.Float(-5.f, 5.f), 0.f, rng.Float(-5.f, 5.f));
+            return previous;
+        }
+    }
+
+    /// Runs the send policy of SyncManager::ReplicateRigidBodyChanges for one extrapolated entity, with either the
+    /// dead reckoning policy or the fixed distance threshold it replaced. The message sizes follow the rigid body update
+    /// message: 8 bits of entity id, 8 bits of send types, 57 bits of compact position and 32 bits of compact velocity.
+    /// The client-side error is measured right after each update tick, without latency or interpolation delay.
+    SimulationResult Simulate(Motion motion, bool deadReckoning)
+    {
+        const float dt = 1.f / 30.f;
+        const int numTicks = 30 * 20;
+        TundraLogic::DeadReckoning policy;
+        LCG rng(1234);
+
+        Transform current;
+        Transform sent;
+        float3 velocity = float3::zero;
+        float3 sentVelocity = float3::zero;
+        float timeSinceSend = 0.f;
+        size_t bits = 0;
+        SimulationResult result;
+
+        for(int tick = 0; tick < numTicks; ++tick)
+        {
+            velocity = Velocity(motion, tick, dt, rng, velocity);
+            current.pos += velocity * dt;
+            timeSinceSend += dt;
+
+            bool velocityDirty = velocity.DistanceSq(sentVelocity) >= 1e-2f || (velocity.IsZero(1e-4f) && !sentVelocity.IsZero(1e-4f));
+            bool sendPosition;
+            if (deadReckoning)
+            {
+                int flags = policy.Evaluate(current, sent, sentVelocity, true, timeSinceSend);
+                if (flags != TundraLogic::DeadReckoning::SendNothing || velocityDirty)
+                    flags |= policy.Evaluate(current, sent, sentVelocity, true, 0.f) & TundraLogic::DeadReckoning::SendPosition;
+                sendPosition = (flags & TundraLogic::DeadReckoning::SendPosition) != 0;
+            }
+            else
+                sendPosition = current.pos.DistanceSq(sent.pos) > 1e-3f;
+
+            if (sendPosition || velocityDirty)
+            {
+                bits += 16 + (sendPosition ? 57 : 0) + (velocityDirty ? 32 : 0);
+                if (sendPosition)
+                    sent.pos = current.pos;
+                if (velocityDirty)
+                    sentVelocity = velocity;
+                timeSinceSend = 0.f;
+                ++result.updates;
+            }
+
+            const float error = current.pos.Distance(TundraLogic::DeadReckoning::PredictPosition(sent.pos, sentVelocity, true, timeSinceSend));
+            result.meanError += error / numTicks;
+            result.maxError = Max(result.maxError, error);
+        }
+        result.bytes = (bits + 7) / 8;
+        return result;
+    }
+}
+
+namespace TundraTest
+{
+    void DeadReckoning::Prediction()
+    {
+        TundraLogic::DeadReckoning policy;
+        const TundraLogic::DeadReckoningSettings &settings = policy.Settings();
+
+        // Entities without a simulated rigid body stay where they were sent.
+        const float3 pos(1.f, 2.f, 3.f);
+        const float3 vel(2.f, 0.f, 0.f);
+        QVERIFY(TundraLogic::DeadReckoning::PredictPosition(pos, vel, false, 0.5f).Equals(pos));
+        QVERIFY(TundraLogic::DeadReckoning::PredictPosition(pos, vel, true, 0.5f).Equals(float3(2.f, 2.f, 3.f)));
+
+        QCOMPARE(policy.ToleranceScale(0.f), 1.f);
+        QVERIFY(policy.ToleranceScale(10.f) > 1.f);
+        QCOMPARE(policy.ToleranceScale(1e6f), settings.maxToleranceScale);
+
+        // An entity moving as predicted is not sent, until the keep-alive corrects the small remaining error.
+        Transform sent;
+        sent.pos = pos;
+        Transform current = sent;
+        current.pos = pos + vel * 0.5f + float3(0.5f * settings.positionTolerance, 0.f, 0.f);
+        QCOMPARE(policy.Evaluate(current, sent, vel, true, 0.5f), (int)TundraLogic::DeadReckoning::SendNothing);
+        QCOMPARE(policy.Evaluate(current, sent, vel, true, 0.5f, 100.f), (int)TundraLogic::DeadReckoning::SendNothing);
+        QVERIFY(TundraLogic::DeadReckoning::HasError(current, sent, vel, true, 0.5f));
+        current.pos = pos + vel * settings.keepAliveInterval + float3(0.5f * settings.positionTolerance, 0.f, 0.f);
+        QCOMPARE(policy.Evaluate(current, sent, vel, true, settings.keepAliveInterval), (int)TundraLogic::DeadReckoning::SendPosition);
+
+        // Errors beyond the tolerance are sent right away, unless the entity is far enough for the tolerance to cover them.
+        current = sent;
+        current.pos = pos + float3(2.f * settings.positionTolerance, 0.f, 0.f);
+        current.rot = sent.rot + float3(0.f, 2.f * settings.rotationTolerance, 0.f);
+        const int both = TundraLogic::DeadReckoning::SendPosition | TundraLogic::DeadReckoning::SendRotation;
+        QCOMPARE(policy.Evaluate(current, sent, float3::zero, false, 0.1f), both);
+        QCOMPARE(policy.Evaluate(current, sent, float3::zero, false, 0.1f, 4.f), (int)TundraLogic::DeadReckoning::SendNothing);
+    }
+
+    void DeadReckoning::Simulation_data()
+    {
+        QTest::addColumn<int>("motion");
+        QTest::newRow("Constant velocity") << (int)MotionConstantVelocity;
+        QTest::newRow("Circle") << (int)MotionCircle;
+        QTest::newRow("Stop and go") << (int)MotionStopAndGo;
+        QTest::newRow("Random walk") << (int)MotionRandomWalk;
+    }
+
+    void DeadReckoning::Simulation()
+    {
+        QFETCH(int, motion);
+
+        SimulationResult fixed = Simulate((Motion)motion, false);
+        SimulationResult reckoned = Simulate((Motion)motion, true);
+
+        qDebug() << qPrintable(QString("Fixed threshold: %1 updates, %2 bytes, mean error %3 m, max error %4 m")
+            .arg(fixed.updates).arg(fixed.bytes).arg(fixed.meanError).arg(fixed.maxError));
+        qDebug() << qPrintable(QString("Dead reckoning:  %1 updates, %2 bytes, mean error %3 m, max error %4 m (%5% bytes saved)")
+            .arg(reckoned.updates).arg(reckoned.bytes).arg(reckoned.meanError).arg(reckoned.maxError)
+            .arg(fixed.bytes > 0 ? 100.0 * (1.0 - (double)reckoned.bytes / fixed.bytes) : 0.0, 0, 'f', 1));
+
+        // The client-side error never exceeds the tolerance, and no more data is sent than with the fixed threshold.
+        QVERIFY(reckoned.maxError <= TundraLogic::DeadReckoningSettings().positionTolerance + 1e-4f);
+        QVERIFY(reckoned.bytes <= fixed.bytes);
+    }
+}
+
+// QTest entry point
+QTEST_APPLESS_MAIN(TundraTest::DeadReckoning);
@@ -0,0 +1,21 @@
+
+#pragma once
+
+#include "TestHelpers.h"
+
+namespace TundraTest
+{
+    /// Headless simulation of the transform send policies of SyncManager.
+    /** Moves an entity along synthetic trajectories at the network update rate, and compares the bytes sent and the positional
+        error seen by the client between the fixed distance threshold policy and the dead reckoning policy. */
+    class DeadReckoning : public QObject
+    {
+        Q_OBJECT
+
+    private slots:
+        void Prediction();
+
+        void Simulation_data();
+        void Simulation();
+    };
+}
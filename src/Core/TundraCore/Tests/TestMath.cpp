@@ -7,6 +7,21 @@
 #include "Math/MathFunc.h"
 #include "Math/float3.h"
 #include "Math/float4.h"
+#include "Math/float3x3.h"
+#include "Math/float3x4.h"
+#include "Math/Quat.h"
+#include "Math/BatchOps.h"
+#include "Math/float2.h"
+#include "Geometry/AABB.h"
+#include "Geometry/Sphere.h"
+#include "Geometry/Frustum.h"
+#include "Geometry/Plane.h"
+#include "Geometry/Ray.h"
+#include "Geometry/DynamicAABBTree.h"
+#include "Geometry/Triangle.h"
+#include "Geometry/TriangleBVH.h"
+#include "Geometry/KdTree.h"
+#include "Algorithm/Random/LCG.h"
 
 #include "Scene.h"
 #include "Entity.h"
@@ -14,6 +29,8 @@
 
 #include <QtTest/QtTest>
 
+#include <algorithm>
+
 #include "MemoryLeakCheck.h"
 
 namespace TundraTest
@@ -150,6 +167,563 @@ namespace TundraTest
         }
     }
 
+    namespace
+    {
+        /// Fills the arrays with 'count' random points, boxes and spheres. The seed is fixed so that every run uses the same data.
+        void RandomBatchInput(int count, PointArray &points, AABBArray &aabbs, SphereArray &spheres)
+        {
+            LCG rng(1234);
+            points.Clear();
+            aabbs.Clear();
+            spheres.Clear();
+            for(int i = 0; i < count; ++i)
+            {
+                const float3 pos(rng.Float(-100.f, 100.f), rng.Float(-100.f, 100.f), rng.Float(-100.f, 100.f));
+                const float3 halfSize(rng.Float(0.f, 5.f), rng.Float(0.f, 5.f), rng.Float(0.f, 5.f));
+                points.Add(pos);
+                aabbs.Add(AABB(pos - halfSize, pos + halfSize));
+                spheres.Add(Sphere(pos, rng.Float(0.f, 5.f)));
+            }
+        }
+
+        float3x4 BatchTestTransform()
+        {
+            return float3x4::FromTRS(float3(1.f, 2.f, 3.f), Quat::RotateAxisAngle(float3(1.f, 1.f, 0.f).Normalized(), 0.7f), float3(2.f, 1.f, 0.5f));
+        }
+
+        Frustum BatchTestFrustum()
+        {
+            Frustum frustum;
+            frustum.type = PerspectiveFrustum;
+            frustum.pos = float3::zero;
+            frustum.front = -float3::unitZ;
+            frustum.up = float3::unitY;
+            frustum.nearPlaneDistance = 0.1f;
+            frustum.farPlaneDistance = 80.f;
+            frustum.horizontalFov = 1.2f;
+            frustum.verticalFov = 1.f;
+            return frustum;
+        }
+    }
+
+    void Math::batchOpsData()
+    {
+        QTest::addColumn<int>("level");
+
+        for(int level = BatchSimdScalar; level <= DetectBatchSimdLevel(); ++level)
+            QTest::newRow(BatchSimdLevelName((BatchSimdLevel)level)) << level;
+    }
+
+    void Math::BatchOps_Correctness_data()
+    {
+        batchOpsData();
+    }
+
+    void Math::BatchOps_Correctness()
+    {
+        QFETCH(int, level);
+
+        // Use a count that is not a multiple of the SIMD width to exercise the remainder handling.
+        PointArray points;
+        AABBArray aabbs;
+        SphereArray spheres;
+        RandomBatchInput(1003, points, aabbs, spheres);
+        const float3x4 transform = BatchTestTransform();
+        const Frustum frustum = BatchTestFrustum();
+        const Sphere sphere(float3(5.f, 5.f, 5.f), 40.f);
+
+        // The scalar kernels are the reference, and are verified against the respective MathGeoLib functions.
+        PointArray refPoints;
+        AABBArray refAABBs;
+        std::vector<u8> refCulledAABBs, refCulledSpheres, refIntersectedAABBs, refIntersectedSpheres;
+        QCOMPARE(SetBatchSimdLevel(BatchSimdScalar), BatchSimdScalar);
+        BatchTransformPoints(transform, points, refPoints);
+        BatchTransformAABBs(transform, aabbs, refAABBs);
+        const AABB refBounds = BatchComputeBounds(points);
+        BatchCullAABBs(frustum, aabbs, refCulledAABBs);
+        BatchCullSpheres(frustum, spheres, refCulledSpheres);
+        BatchIntersectAABBs(sphere, aabbs, refIntersectedAABBs);
+        BatchIntersectSpheres(sphere, spheres, refIntersectedSpheres);
+
+        AABB bounds;
+        bounds.SetNegativeInfinity();
+        for(int i = 0; i < points.Size(); ++i)
+        {
+            QVERIFY(refPoints.At(i).Equals(transform.TransformPos(points.At(i)), 1e-3f));
+            const AABB transformed = refAABBs.At(i);
+            for(int corner = 0; corner < 8; ++corner)
+                QVERIFY(transformed.Distance(transform.TransformPos(aabbs.At(i).CornerPoint(corner))) < 1e-3f);
+            // The culling is conservative, so it may only report false positives.
+            if (frustum.Intersects(aabbs.At(i)))
+                QCOMPARE(refCulledAABBs[i], (u8)1);
+            if (frustum.Intersects(spheres.At(i)))
+                QCOMPARE(refCulledSpheres[i], (u8)1);
+            QCOMPARE(refIntersectedAABBs[i] != 0, sphere.Intersects(aabbs.At(i)));
+            QCOMPARE(refIntersectedSpheres[i] != 0, sphere.Intersects(spheres.At(i)));
+            bounds.Enclose(points.At(i));
+        }
+        QVERIFY(refBounds.minPoint.Equals(bounds.minPoint) && refBounds.maxPoint.Equals(bounds.maxPoint));
+
+        QCOMPARE((int)SetBatchSimdLevel((BatchSimdLevel)level), level);
+        PointArray outPoints;
+        AABBArray outAABBs;
+        std::vector<u8> culledAABBs, culledSpheres, intersectedAABBs, intersectedSpheres;
+        BatchTransformPoints(transform, points, outPoints);
+        BatchTransformAABBs(transform, aabbs, outAABBs);
+        const AABB outBounds = BatchComputeBounds(points);
+        QVERIFY(outBounds.minPoint.Equals(refBounds.minPoint) && outBounds.maxPoint.Equals(refBounds.maxPoint));
+        QCOMPARE(BatchCullAABBs(frustum, aabbs, culledAABBs), (int)std::count(refCulledAABBs.begin(), refCulledAABBs.end(), 1));
+        QCOMPARE(BatchCullSpheres(frustum, spheres, culledSpheres), (int)std::count(refCulledSpheres.begin(), refCulledSpheres.end(), 1));
+        QCOMPARE(BatchIntersectAABBs(sphere, aabbs, intersectedAABBs), (int)std::count(refIntersectedAABBs.begin(), refIntersectedAABBs.end(), 1));
+        QCOMPARE(BatchIntersectSpheres(sphere, spheres, intersectedSpheres), (int)std::count(refIntersectedSpheres.begin(), refIntersectedSpheres.end(), 1));
+        for(int i = 0; i < points.Size(); ++i)
+        {
+            QVERIFY(outPoints.At(i).Equals(refPoints.At(i), 1e-4f));
+            QVERIFY(outAABBs.At(i).minPoint.Equals(refAABBs.At(i).minPoint, 1e-4f));
+            QVERIFY(outAABBs.At(i).maxPoint.Equals(refAABBs.At(i).maxPoint, 1e-4f));
+        }
+        QVERIFY(culledAABBs == refCulledAABBs);
+        QVERIFY(culledSpheres == refCulledSpheres);
+        QVERIFY(intersectedAABBs == refIntersectedAABBs);
+        QVERIFY(intersectedSpheres == refIntersectedSpheres);
+
+        SetBatchSimdLevel(DetectBatchSimdLevel());
+    }
+
+    void Math::BatchOps_SmallCounts_data()
+    {
+        batchOpsData();
+    }
+
+    void Math::BatchOps_SmallCounts()
+    {
+        QFETCH(int, level);
+
+        // Counts below and around the SIMD widths, where the kernels have no or only one full vector of points.
+        PointArray points;
+        AABBArray aabbs;
+        SphereArray spheres;
+        for(int count = 0; count <= 9; ++count)
+        {
+            RandomBatchInput(count, points, aabbs, spheres);
+            SetBatchSimdLevel(BatchSimdScalar);
+            const AABB refBounds = BatchComputeBounds(points);
+            AABB bounds;
+            bounds.SetNegativeInfinity();
+            for(int i = 0; i < count; ++i)
+                bounds.Enclose(points.At(i));
+
+            SetBatchSimdLevel((BatchSimdLevel)level);
+            const AABB outBounds = BatchComputeBounds(points);
+            // Compared exactly, as an empty input gives infinite bounds, which QCOMPARE does not handle.
+            for(int k = 0; k < 3; ++k)
+            {
+                QVERIFY(refBounds.minPoint[k] == bounds.minPoint[k] && refBounds.maxPoint[k] == bounds.maxPoint[k]);
+                QVERIFY(outBounds.minPoint[k] == refBounds.minPoint[k] && outBounds.maxPoint[k] == refBounds.maxPoint[k]);
+            }
+        }
+
+        SetBatchSimdLevel(DetectBatchSimdLevel());
+    }
+
+    void Math::BatchOps_data()
+    {
+        QTest::addColumn<QString>("op");
+        QTest::addColumn<int>("level");
+
+        foreach(const QString &op, QStringList() << "TransformPoints" << "TransformAABBs" << "ComputeBounds" << "CullAABBs" << "CullSpheres" << "IntersectAABBs")
+            for(int level = BatchSimdScalar; level <= DetectBatchSimdLevel(); ++level)
+                QTest::newRow(qPrintable(op + " " + BatchSimdLevelName((BatchSimdLevel)level))) << op << level;
+    }
+
+    void Math::BatchOps()
+    {
+        QFETCH(QString, op);
+        QFETCH(int, level);
+
+        PointArray points, outPoints;
+        AABBArray aabbs, outAABBs;
+        SphereArray spheres;
+        std::vector<u8> result;
+        RandomBatchInput(10000, points, aabbs, spheres);
+        const float3x4 transform = BatchTestTransform();
+        const Frustum frustum = BatchTestFrustum();
+        const Sphere sphere(float3(5.f, 5.f, 5.f), 40.f);
+
+        SetBatchSimdLevel((BatchSimdLevel)level);
+        if (op == "TransformPoints")
+        {
+            QBENCHMARK { BatchTransformPoints(transform, points, outPoints); }
+        }
+        else if (op == "TransformAABBs")
+        {
+            QBENCHMARK { BatchTransformAABBs(transform, aabbs, outAABBs); }
+        }
+        else if (op == "ComputeBounds")
+        {
+            QBENCHMARK { BatchComputeBounds(points); }
+        }
+        else if (op == "CullAABBs")
+        {
+            QBENCHMARK { BatchCullAABBs(frustum, aabbs, result); }
+        }
+        else if (op == "CullSpheres")
+        {
+            QBENCHMARK { BatchCullSpheres(frustum, spheres, result); }
+        }
+        else if (op == "IntersectAABBs")
+        {
+            QBENCHMARK { BatchIntersectAABBs(sphere, aabbs, result); }
+        }
+        SetBatchSimdLevel(DetectBatchSimdLevel());
+    }
+
+    namespace
+    {
+        /// Collects the ids of the proxies reported by the tree.
+        struct ProxyCollector
+        {
+            bool operator()(int proxyId) { ids.push_back(proxyId); return true; }
+            bool operator()(int proxyId, float /*distance*/) { ids.push_back(proxyId); return ids.size() < maxCount; }
+            ProxyCollector() : maxCount(0xFFFFFFFF) {}
+            std::vector<int> ids;
+            size_t maxCount;
+        };
+
+        /// Keeps the closest hit, and clips the ray to it.
+        struct ClosestRayCollector
+        {
+            ClosestRayCollector() : proxyId(-1), distance(FLOAT_INF) {}
+            float operator()(int id, float d) { if (d < distance) { distance = d; proxyId = id; } return distance; }
+            int proxyId;
+            float distance;
+        };
+
+        float DistanceSq(const AABB &aabb, const float3 &point)
+        {
+            return aabb.ClosestPoint(point).DistanceSq(point);
+        }
+
+        /// Conservative plane test, the same one the tree uses. Frustum::Intersects(AABB) is not exact either, so it can not be the reference.
+        bool OutsideAnyPlane(const Frustum &frustum, const AABB &aabb)
+        {
+            for(int i = 0; i < 6; ++i)
+            {
+                const Plane plane = frustum.GetPlane(i);
+                if (plane.normal.Dot(aabb.CenterPoint()) - plane.d > Abs(plane.normal).Dot(aabb.HalfSize()))
+                    return true;
+            }
+            return false;
+        }
+    }
+
+    void Math::DynamicAABBTree_Correctness()
+    {
+        LCG rng(4321);
+        DynamicAABBTree tree(0.5f);
+        std::vector<int> proxies;
+        std::vector<AABB> boxes; // Indexed by the proxy id, only meaningful for ids in 'proxies'.
+
+        // Random inserts, moves and removes, checking the tree structure after each batch.
+        for(int op = 0; op < 4000; ++op)
+        {
+            const float action = rng.Float();
+            const float3 pos(rng.Float(-100.f, 100.f), rng.Float(-100.f, 100.f), rng.Float(-100.f, 100.f));
+            const float3 halfSize(rng.Float(0.f, 3.f), rng.Float(0.f, 3.f), rng.Float(0.f, 3.f));
+            const AABB aabb(pos - halfSize, pos + halfSize);
+            if (proxies.empty() || action < 0.5f)
+            {
+                const int id = tree.Insert(aabb, (u32)op);
+                if ((int)boxes.size() <= id)
+                    boxes.resize(id + 1);
+                boxes[id] = aabb;
+                proxies.push_back(id);
+            }
+            else if (action < 0.85f)
+            {
+                // Mostly small moves, which should stay within the fat boxes.
+                const int id = proxies[rng.Int(0, (int)proxies.size() - 1)];
+                const float3 delta = action < 0.75f ? float3(rng.Float(-0.3f, 0.3f), 0.f, 0.f) : pos - boxes[id].CenterPoint();
+                boxes[id].Translate(delta);
+                tree.Move(id, boxes[id]);
+            }
+            else
+            {
+                const int index = rng.Int(0, (int)proxies.size() - 1);
+                tree.Remove(proxies[index]);
+                proxies.erase(proxies.begin() + index);
+            }
+            if (op % 100 == 0)
+                QVERIFY(tree.Validate());
+        }
+        QVERIFY(tree.Validate());
+        QCOMPARE(tree.NumProxies(), (int)proxies.size());
+
+        // Compare the queries against brute force.
+        const AABB queryBox(float3(-20.f, -30.f, -10.f), float3(40.f, 10.f, 30.f));
+        const Sphere querySphere(float3(10.f, -5.f, 20.f), 35.f);
+        const Frustum frustum = BatchTestFrustum();
+        std::vector<int> expectedBox, expectedSphere, expectedFrustum;
+        for(size_t i = 0; i < proxies.size(); ++i)
+        {
+            const AABB &aabb = boxes[proxies[i]];
+            QVERIFY(tree.Bounds(proxies[i]).minPoint.Equals(aabb.minPoint) && tree.Bounds(proxies[i]).maxPoint.Equals(aabb.maxPoint));
+            QVERIFY(tree.FatAABB(proxies[i]).Contains(aabb));
+            if (aabb.Intersects(queryBox))
+                expectedBox.push_back(proxies[i]);
+            if (DistanceSq(aabb, querySphere.pos) <= querySphere.r * querySphere.r)
+                expectedSphere.push_back(proxies[i]);
+            if (!OutsideAnyPlane(frustum, aabb))
+                expectedFrustum.push_back(proxies[i]);
+        }
+        std::sort(expectedBox.begin(), expectedBox.end());
+        std::sort(expectedSphere.begin(), expectedSphere.end());
+        std::sort(expectedFrustum.begin(), expectedFrustum.end());
+
+        ProxyCollector boxHits, sphereHits, frustumHits;
+        tree.QueryAABB(queryBox, boxHits);
+        tree.QuerySphere(querySphere, sphereHits);
+        tree.QueryFrustum(frustum, frustumHits);
+        std::sort(boxHits.ids.begin(), boxHits.ids.end());
+        std::sort(sphereHits.ids.begin(), sphereHits.ids.end());
+        std::sort(frustumHits.ids.begin(), frustumHits.ids.end());
+        QVERIFY(boxHits.ids == expectedBox);
+        QVERIFY(sphereHits.ids == expectedSphere);
+        QVERIFY(frustumHits.ids == expectedFrustum);
+
+        // Closest ray hits.
+        for(int i = 0; i < 50; ++i)
+        {
+            const Ray ray(float3(rng.Float(-120.f, 120.f), rng.Float(-120.f, 120.f), rng.Float(-120.f, 120.f)),
+                float3(rng.Float(-1.f, 1.f), rng.Float(-1.f, 1.f), rng.Float(-1.f, 1.f)).Normalized());
+            float expectedDistance = FLOAT_INF;
+            for(size_t j = 0; j < proxies.size(); ++j)
+            {
+                float dNear, dFar;
+                if (boxes[proxies[j]].Intersects(ray, dNear, dFar))
+                    expectedDistance = Min(expectedDistance, Max(dNear, 0.f));
+            }
+            ClosestRayCollector hit;
+            tree.Raycast(ray, FLOAT_INF, hit);
+            QVERIFY(hit.distance == expectedDistance || Abs(hit.distance - expectedDistance) < 1e-3f);
+        }
+
+        // The nearest neighbors are reported in the order of increasing distance.
+        const float3 point(3.f, -7.f, 11.f);
+        std::vector<float> distances;
+        for(size_t i = 0; i < proxies.size(); ++i)
+            distances.push_back(DistanceSq(boxes[proxies[i]], point));
+        std::sort(distances.begin(), distances.end());
+        ProxyCollector nearest;
+        nearest.maxCount = 10;
+        tree.QueryNearest(point, FLOAT_INF, nearest);
+        QCOMPARE(nearest.ids.size(), (size_t)10);
+        for(size_t i = 0; i < nearest.ids.size(); ++i)
+            QVERIFY(Abs(DistanceSq(boxes[nearest.ids[i]], point) - distances[i]) < 1e-3f);
+    }
+
+    namespace
+    {
+        /// Fills 'triangles' with 'count' small random triangles, and 'rays' with 'numRays' rays aimed at them. The seed is fixed.
+        void RandomTriangleInput(int count, int numRays, std::vector<Triangle> &triangles, std::vector<Ray> &rays)
+        {
+            LCG rng(4321);
+            triangles.clear();
+            rays.clear();
+            for(int i = 0; i < count; ++i)
+            {
+                const float3 center(rng.Float(-50.f, 50.f), rng.Float(-50.f, 50.f), rng.Float(-50.f, 50.f));
+                triangles.push_back(Triangle(center + float3(rng.Float(-2.f, 2.f), rng.Float(-2.f, 2.f), rng.Float(-2.f, 2.f)),
+                    center + float3(rng.Float(-2.f, 2.f), rng.Float(-2.f, 2.f), rng.Float(-2.f, 2.f)),
+                    center + float3(rng.Float(-2.f, 2.f), rng.Float(-2.f, 2.f), rng.Float(-2.f, 2.f))));
+            }
+            for(int i = 0; i < numRays; ++i)
+            {
+                const float3 pos(rng.Float(-80.f, 80.f), rng.Float(-80.f, 80.f), rng.Float(-80.f, 80.f));
+                const float3 target(rng.Float(-50.f, 50.f), rng.Float(-50.f, 50.f), rng.Float(-50.f, 50.f));
+                rays.push_back(Ray(pos, (target - pos).Normalized()));
+            }
+        }
+
+        /// Returns the distance to the nearest triangle hit by the ray, or FLOAT_INF.
+        float BruteForceRaycast(const std::vector<Triangle> &triangles, int count, const Ray &ray)
+        {
+            float nearest = FLOAT_INF;
+            for(int i = 0; i < count; ++i)
+            {
+                float u, v;
+                const float t = Triangle::IntersectLineTri(ray.pos, ray.dir, triangles[i].a, triangles[i].b, triangles[i].c, u, v);
+                if (t >= 0.f && t < nearest)
+                    nearest = t;
+            }
+            return nearest;
+        }
+    }
+
+    void Math::TriangleBVH_Correctness_data()
+    {
+        batchOpsData();
+    }
+
+    void Math::TriangleBVH_Correctness()
+    {
+        QFETCH(int, level);
+
+        std::vector<Triangle> triangles;
+        std::vector<Ray> rays;
+        RandomTriangleInput(5000, 300, triangles, rays);
+        QCOMPARE((int)SetBatchSimdLevel((BatchSimdLevel)level), level);
+
+        // The parallel build must produce a tree that gives the same answers as the single-threaded one.
+        TriangleBVH serial, parallel;
+        serial.Build(&triangles[0], (int)triangles.size(), 1);
+        parallel.Build(&triangles[0], (int)triangles.size(), 4);
+        QCOMPARE(serial.NumTriangles(), (int)triangles.size());
+        QVERIFY(serial.Depth() <= TriangleBVH::cMaxDepth);
+        QVERIFY(((size_t)serial.Nodes() & 63) == 0);
+        QVERIFY(serial.BoundingAABB().Contains(triangles[0].BoundingAABB()));
+
+        int numHits = 0;
+        for(size_t i = 0; i < rays.size(); ++i)
+        {
+            const float expected = BruteForceRaycast(triangles, (int)triangles.size(), rays[i]);
+            TriangleBVHHit hit, parallelHit;
+            QCOMPARE(serial.Raycast(rays[i], FLOAT_INF, hit), expected < FLOAT_INF);
+            QCOMPARE(parallel.Raycast(rays[i], FLOAT_INF, parallelHit), expected < FLOAT_INF);
+            if (expected == FLOAT_INF)
+                continue;
+            ++numHits;
+            QVERIFY(Abs(hit.t - expected) < 1e-3f);
+            QVERIFY(Abs(parallelHit.t - expected) < 1e-3f);
+            // The reported triangle and barycentrics must reproduce the hit point.
+            const Triangle &tri = triangles[hit.triangleIndex];
+            const float3 point = (1.f - hit.u - hit.v) * tri.a + hit.u * tri.b + hit.v * tri.c;
+            QVERIFY(point.Equals(rays[i].GetPoint(hit.t), 1e-2f));
+            // Hits beyond the maximum distance are ignored.
+            TriangleBVHHit clipped;
+            QVERIFY(!serial.Raycast(rays[i], hit.t * 0.5f, clipped));
+            QCOMPARE(clipped.triangleIndex, 0xFFFFFFFF);
+        }
+        QVERIFY(numHits > 0);
+
+        // Trees smaller than one leaf, and the packet remainders.
+        for(int count = 1; count <= 2 * TriangleBVH::cMaxLeafTriangles + 1; ++count)
+        {
+            TriangleBVH subset;
+            subset.Build(&triangles[0], count);
+            QCOMPARE(subset.NumTriangles(), count);
+            for(size_t i = 0; i < rays.size(); ++i)
+            {
+                const float expected = BruteForceRaycast(triangles, count, rays[i]);
+                TriangleBVHHit hit;
+                QCOMPARE(subset.Raycast(rays[i], FLOAT_INF, hit), expected < FLOAT_INF);
+                if (expected < FLOAT_INF)
+                    QVERIFY(Abs(hit.t - expected) < 1e-3f);
+            }
+        }
+
+        // Deform the triangles non-uniformly, like a skinned mesh, and refit the tree to them.
+        std::vector<Triangle> deformed = triangles;
+        for(size_t i = 0; i < deformed.size(); ++i)
+            for(int v = 0; v < 3; ++v)
+            {
+                float3 &p = v == 0 ? deformed[i].a : (v == 1 ? deformed[i].b : deformed[i].c);
+                p = float3x3::RotateY(p.y * 0.02f).Transform(p) + float3(0.f, Sin(p.x * 0.1f) * 5.f, 0.f);
+            }
+        QVERIFY(!serial.Refit(&deformed[0], (int)deformed.size() - 1));
+        QVERIFY(serial.Refit(&deformed[0], (int)deformed.size()));
+        for(size_t i = 0; i < rays.size(); ++i)
+        {
+            const float expected = BruteForceRaycast(deformed, (int)deformed.size(), rays[i]);
+            TriangleBVHHit hit;
+            QCOMPARE(serial.Raycast(rays[i], FLOAT_INF, hit), expected < FLOAT_INF);
+            if (expected < FLOAT_INF)
+                QVERIFY(Abs(hit.t - expected) < 1e-3f);
+        }
+        for(size_t i = 0; i < deformed.size(); ++i)
+            QVERIFY(serial.BoundingAABB().Contains(deformed[i].BoundingAABB()));
+
+        TriangleBVH empty;
+        TriangleBVHHit hit;
+        QVERIFY(empty.IsEmpty());
+        QVERIFY(!empty.Raycast(rays[0], FLOAT_INF, hit));
+        serial.Clear();
+        QVERIFY(serial.IsEmpty());
+        QVERIFY(!serial.Raycast(rays[0], FLOAT_INF, hit));
+
+        SetBatchSimdLevel(DetectBatchSimdLevel());
+    }
+
+    void Math::TriangleBVH_Benchmark_data()
+    {
+        QTest::addColumn<QString>("op");
+        QTest::addColumn<int>("level");
+
+        QTest::newRow("Build KdTree") << QString("Build KdTree") << (int)BatchSimdScalar;
+        QTest::newRow("Build BVH") << QString("Build BVH") << (int)BatchSimdScalar;
+        QTest::newRow("Raycast KdTree") << QString("Raycast KdTree") << (int)BatchSimdScalar;
+        for(int level = BatchSimdScalar; level <= DetectBatchSimdLevel(); ++level)
+            QTest::newRow(qPrintable(QString("Raycast BVH ") + BatchSimdLevelName((BatchSimdLevel)level))) << QString("Raycast BVH") << level;
+    }
+
+    void Math::TriangleBVH_Benchmark()
+    {
+        QFETCH(QString, op);
+        QFETCH(int, level);
+
+        // Comparable to a detailed scene mesh. The kD-tree is what OgreMeshAsset used before the BVH.
+        std::vector<Triangle> triangles;
+        std::vector<Ray> rays;
+        RandomTriangleInput(100000, 1000, triangles, rays);
+
+        SetBatchSimdLevel((BatchSimdLevel)level);
+        if (op == "Build KdTree")
+        {
+            QBENCHMARK
+            {
+                KdTree<Triangle> kdTree;
+                kdTree.AddObjects(&triangles[0], (int)triangles.size());
+                kdTree.Build();
+            }
+        }
+        else if (op == "Build BVH")
+        {
+            QBENCHMARK
+            {
+                TriangleBVH bvh;
+                bvh.Build(&triangles[0], (int)triangles.size());
+            }
+        }
+        else if (op == "Raycast KdTree")
+        {
+            KdTree<Triangle> kdTree;
+            kdTree.AddObjects(&triangles[0], (int)triangles.size());
+            kdTree.Build();
+            QBENCHMARK
+            {
+                for(size_t i = 0; i < rays.size(); ++i)
+                {
+                    TriangleKdTreeRayQueryNearestHitVisitor visitor;
+                    kdTree.RayQuery(rays[i], visitor);
+                }
+            }
+        }
+        else if (op == "Raycast BVH")
+        {
+            TriangleBVH bvh;
+            bvh.Build(&triangles[0], (int)triangles.size());
+            QBENCHMARK
+            {
+                for(size_t i = 0; i < rays.size(); ++i)
+                {
+                    TriangleBVHHit hit;
+                    bvh.Raycast(rays[i], FLOAT_INF, hit);
+                }
+            }
+        }
+        SetBatchSimdLevel(DetectBatchSimdLevel());
+    }
+
     /* See header...
     void Math::ParentChildData()
     {
@@ -28,6 +28,23 @@ namespace TundraTest
         void MathFunc_data();
         void MathFunc();
 
+        void BatchOps_Correctness_data();
+        void BatchOps_Correctness();
+
+        void BatchOps_SmallCounts_data();
+        void BatchOps_SmallCounts();
+
+        void BatchOps_data();
+        void BatchOps();
+
+        void DynamicAABBTree_Correctness();
+
+        void TriangleBVH_Correctness_data();
+        void TriangleBVH_Correctness();
+
+        void TriangleBVH_Benchmark_data();
+        void TriangleBVH_Benchmark();
+
         /** @todo This cant be done without linking to OgreRenderingModule
             and as a executable project, this would mean that you need to
             manually copy the runtime (DLL/so/dylib) to /bin. */
@@ -37,6 +54,7 @@ namespace TundraTest
     private:
         void float3Data();
         void float4Data();
+        void batchOpsData();
         //void ParentChildData();
 
         TestFramework test_;
@@ -7,13 +7,47 @@
 #include "SceneAPI.h"
 #include "PluginAPI.h"
 #include "Scene.h"
+#include "SpatialWorld.h"
+#include "SceneXmlReader.h"
+#include "EC_DynamicComponent.h"
+#include "EC_Name.h"
+#include "IAttribute.h"
+#include "AttributeMetadata.h"
+#include "Transform.h"
+#include "Math/Quat.h"
 
 #include "kNet/DataSerializer.h"
+#include "kNet/DataDeserializer.h"
 
 #include <QtTest/QtTest>
+#include <QBuffer>
+
+#include <algorithm>
 
 #include "MemoryLeakCheck.h"
 
+namespace
+{
+    /// Creates entities with a dynamic component that has a float3 "pos" and, on all but every tenth entity, a real "speed".
+    /** Returns the ids of the entities that have both attributes, in ascending order. */
+    std::vector<entity_id_t> CreateAttributeArrayEntities(Scene *scene, int numEntities)
+    {
+        const u32 typeId = EC_DynamicComponent::ComponentTypeId;
+        std::vector<entity_id_t> ids;
+        for(int i = 0; i < numEntities; ++i)
+        {
+            EntityPtr entity = scene->CreateLocalEntity(QStringList(), AttributeChange::LocalOnly, false, false);
+            shared_ptr<EC_DynamicComponent> dc = static_pointer_cast<EC_DynamicComponent>(entity->CreateComponent(typeId, "", AttributeChange::LocalOnly, false));
+            static_cast<Attribute<float3>*>(dc->CreateAttribute("float3", "pos", AttributeChange::LocalOnly))->Set(float3((float)i, 1.f, -(float)i), AttributeChange::LocalOnly);
+            if (i % 10 == 0)
+                continue;
+            static_cast<Attribute<float>*>(dc->CreateAttribute("real", "speed", AttributeChange::LocalOnly))->Set(0.5f * i, AttributeChange::LocalOnly);
+            ids.push_back(entity->Id());
+        }
+        return ids;
+    }
+}
+
 namespace TundraTest
 {
     Scene::Scene(const QString &config)
@@ -79,6 +113,20 @@ namespace TundraTest
         }
     }
 
+    void Scene::Create_Scene_Disconnected()
+    {
+        // Scenes created silently, f.ex. for serialization, get a spatial index too.
+        SceneAPI *sceneAPI = test_.framework->Scene();
+        ScenePtr scene = sceneAPI->CreateScene("TestScene_Disconnected", false, true, AttributeChange::Disconnected);
+        QVERIFY(scene);
+        SpatialWorldPtr spatialWorld = scene->Subsystem<SpatialWorld>();
+        QVERIFY(spatialWorld);
+        QVERIFY(test_.scene->Subsystem<SpatialWorld>() != spatialWorld);
+
+        QVERIFY(sceneAPI->RemoveScene(scene->Name(), AttributeChange::Disconnected));
+        QVERIFY(!scene->Subsystem<SpatialWorld>());
+    }
+
     void Scene::Create_Attributes_Unparented_data()
     {
         QTest::addColumn<QString>("attributeTypeName");
@@ -270,6 +318,321 @@ namespace TundraTest
             test_.scene->RemoveEntity(parent->Id());
         }
     }
+
+    void Scene::Query_AttributeArrays()
+    {
+        const u32 typeId = EC_DynamicComponent::ComponentTypeId;
+        // Every tenth entity lacks the second attribute and must be skipped.
+        const std::vector<entity_id_t> expectedIds = CreateAttributeArrayEntities(test_.scene.get(), 1000);
+
+        std::vector<entity_id_t> ids;
+        std::vector<std::vector<float> > values;
+        QVERIFY(test_.scene->QueryAttributeArrays(typeId, QStringList() << "pos" << "speed", ids, values));
+        std::sort(ids.begin(), ids.end());
+        QVERIFY(ids == expectedIds);
+        QCOMPARE(values.size(), (size_t)2);
+        QCOMPARE(values[0].size(), ids.size() * 3);
+        QCOMPARE(values[1].size(), ids.size());
+
+        // Round trip: double the speeds with the bulk setter.
+        QVERIFY(test_.scene->QueryAttributeArrays(typeId, QStringList() << "speed", ids, values));
+        std::vector<float> speeds = values[0];
+        for(size_t i = 0; i < speeds.size(); ++i)
+            speeds[i] *= 2.f;
+        QCOMPARE(test_.scene->SetAttributeArrays(typeId, ids, "speed", speeds, AttributeChange::LocalOnly), (int)ids.size());
+        for(size_t i = 0; i < ids.size(); ++i)
+        {
+            EntityPtr entity = test_.scene->EntityById(ids[i]);
+            QVERIFY(entity);
+            IAttribute *speed = entity->Component(typeId)->AttributeById("speed");
+            QVERIFY(speed);
+            QCOMPARE(static_cast<Attribute<float>*>(speed)->Get(), speeds[i]);
+        }
+
+        // Attribute types that can not be packed are rejected.
+        EntityPtr stringEntity = test_.scene->CreateLocalEntity(QStringList(), AttributeChange::LocalOnly, false, false);
+        shared_ptr<EC_DynamicComponent> dc = static_pointer_cast<EC_DynamicComponent>(stringEntity->CreateComponent(typeId, "", AttributeChange::LocalOnly, false));
+        dc->CreateAttribute("string", "label", AttributeChange::LocalOnly);
+        QVERIFY(!test_.scene->QueryAttributeArrays(typeId, QStringList() << "label", ids, values));
+    }
+
+    void Scene::Benchmark_QueryAttributeArrays()
+    {
+        CreateAttributeArrayEntities(test_.scene.get(), 1000);
+
+        std::vector<entity_id_t> ids;
+        std::vector<std::vector<float> > values;
+        QBENCHMARK
+        {
+            test_.scene->QueryAttributeArrays(EC_DynamicComponent::ComponentTypeId, QStringList() << "pos" << "speed", ids, values);
+        }
+        QCOMPARE(ids.size(), (size_t)900);
+    }
+
+    void Scene::Serialize_QuantizedAttributes_data()
+    {
+        Create_Attributes_Unparented_data();
+    }
+
+    void Scene::Serialize_QuantizedAttributes()
+    {
+        QFETCH(QString, attributeTypeName);
+
+        // Without quantization metadata the compact encoding is lossless, and never larger than the full one but for marker bits.
+        IAttribute *source = SceneAPI::CreateAttribute(attributeTypeName, "Source");
+        IAttribute *target = SceneAPI::CreateAttribute(attributeTypeName, "Target");
+        QVERIFY(source && target);
+        if (attributeTypeName == "int")
+            static_cast<Attribute<int>*>(source)->Set(-12345, AttributeChange::Disconnected);
+        else if (attributeTypeName == "bool")
+            static_cast<Attribute<bool>*>(source)->Set(true, AttributeChange::Disconnected);
+        else if (attributeTypeName == "Quat")
+            static_cast<Attribute<Quat>*>(source)->Set(Quat::RotateY(1.f), AttributeChange::Disconnected);
+
+        kNet::DataSerializer full(64 * 1024);
+        kNet::DataSerializer compact(64 * 1024);
+        source->ToBinary(full);
+        source->ToQuantizedBinary(compact);
+        QVERIFY(compact.BytesFilled() <= full.BytesFilled() + 1);
+
+        kNet::DataDeserializer dd(compact.GetData(), compact.BytesFilled());
+        target->FromQuantizedBinary(dd, AttributeChange::Disconnected);
+        QCOMPARE(target->ToString(), source->ToString());
+
+        SAFE_DELETE(source);
+        SAFE_DELETE(target);
+    }
+
+    void Scene::Serialize_QuantizedTransform()
+    {
+        AttributeMetadata metadata;
+        metadata.SetQuantization(AttributeMetadata::QuantizeRange, 23, -4096.f, 4096.f);
+        Attribute<Transform> source(0, "Source");
+        Attribute<Transform> target(0, "Target");
+        source.SetMetadata(&metadata);
+        target.SetMetadata(&metadata);
+
+        Transform t(float3(123.456f, -7.5f, 1000.f), float3(10.f, -95.5f, 179.f), float3::one);
+        source.Set(t, AttributeChange::Disconnected);
+
+        kNet::DataSerializer full(1024);
+        kNet::DataSerializer compact(1024);
+        source.ToBinary(full);
+        source.ToQuantizedBinary(compact);
+        qDebug() << "Transform:" << full.BytesFilled() << "bytes in full precision," << compact.BytesFilled() << "bytes quantized";
+        QVERIFY(compact.BytesFilled() * 2 < full.BytesFilled());
+
+        kNet::DataDeserializer dd(compact.GetData(), compact.BytesFilled());
+        target.FromQuantizedBinary(dd, AttributeChange::Disconnected);
+        QVERIFY(target.Get().pos.Distance(t.pos) < 2e-3f);
+        QVERIFY(target.Get().rot.Distance(t.rot) < 1e-2f);
+        QVERIFY(target.Get().scale.Equals(float3::one, 0.f));
+
+        // Values outside the range are sent in full precision.
+        t.pos.x = 1e5f;
+        t.scale = float3(2.f, 2.f, 2.f);
+        source.Set(t, AttributeChange::Disconnected);
+        compact.ResetFill();
+        source.ToQuantizedBinary(compact);
+        kNet::DataDeserializer dd2(compact.GetData(), compact.BytesFilled());
+        target.FromQuantizedBinary(dd2, AttributeChange::Disconnected);
+        QCOMPARE(target.Get().pos.x, 1e5f);
+        QVERIFY(target.Get().scale.Distance(t.scale) < 2e-3f);
+
+        // Quaternions with the smallest three encoding.
+        AttributeMetadata quatMetadata;
+        quatMetadata.SetQuantization(AttributeMetadata::QuantizeSmallestThree, 12);
+        Attribute<Quat> quatSource(0, "QuatSource");
+        Attribute<Quat> quatTarget(0, "QuatTarget");
+        quatSource.SetMetadata(&quatMetadata);
+        quatTarget.SetMetadata(&quatMetadata);
+        quatSource.Set(Quat(float3(1.f, 2.f, -3.f).Normalized(), 2.5f), AttributeChange::Disconnected);
+        compact.ResetFill();
+        quatSource.ToQuantizedBinary(compact);
+        QCOMPARE(compact.BytesFilled(), (size_t)5);
+        kNet::DataDeserializer dd3(compact.GetData(), compact.BytesFilled());
+        quatTarget.FromQuantizedBinary(dd3, AttributeChange::Disconnected);
+        QVERIFY(Abs(quatTarget.Get().Dot(quatSource.Get())) > 0.9999f);
+    }
+
+    void Scene::Serialize_QuantizedTrailingBool_data()
+    {
+        QTest::addColumn<bool>("value");
+        QTest::addColumn<bool>("useMetadata");
+
+        QTest::newRow("true") << true << true;
+        QTest::newRow("false") << false << true;
+        QTest::newRow("true without metadata") << true << false;
+        QTest::newRow("false without metadata") << false << false;
+    }
+
+    void Scene::Serialize_QuantizedTrailingBool()
+    {
+        QFETCH(bool, value);
+        QFETCH(bool, useMetadata);
+
+        // Static attributes of a component ending in a bool, written as in a component full update of SyncManager:
+        // the number of attributes, then the compact values one after another, sent as whole bytes.
+        AttributeMetadata metadata;
+        metadata.SetQuantization(AttributeMetadata::QuantizeRange, 23, -4096.f, 4096.f);
+        Attribute<Transform> transform(0, "Transform");
+        Attribute<uint> count(0, "Count");
+        Attribute<bool> flag(0, "Flag");
+        transform.SetMetadata(&metadata);
+        transform.Set(Transform(float3(1.f, 2.f, 3.f), float3::zero, float3::one), AttributeChange::Disconnected);
+        count.Set(7, AttributeChange::Disconnected);
+        flag.Set(value, AttributeChange::Disconnected);
+        IAttribute *sources[] = { &transform, &count, &flag };
+
+        kNet::DataSerializer ds(1024);
+        ds.AddVLE<kNet::VLE8_16_32>(3);
+        for(int i = 0; i < 3; ++i)
+            sources[i]->ToQuantizedBinary(ds, useMetadata);
+        QVERIFY(ds.BitsFilled() % 8 != 0); // The bool ends up in a padded byte
+
+        // A receiver without the metadata, e.g. a placeholder component, can read the values if the metadata was not used.
+        // The receiver has a newer version of the component with one more attribute, which the padding must not be read into.
+        Attribute<Transform> transformTarget(0, "Transform");
+        Attribute<uint> countTarget(0, "Count");
+        Attribute<bool> flagTarget(0, "Flag");
+        Attribute<bool> newerFlagTarget(0, "NewerFlag");
+        if (useMetadata)
+            transformTarget.SetMetadata(&metadata);
+        flagTarget.Set(!value, AttributeChange::Disconnected);
+        newerFlagTarget.Set(true, AttributeChange::Disconnected);
+        IAttribute *targets[] = { &transformTarget, &countTarget, &flagTarget, &newerFlagTarget };
+
+        kNet::DataDeserializer dd(ds.GetData(), ds.BytesFilled());
+        const u32 numSent = dd.ReadVLE<kNet::VLE8_16_32>();
+        QCOMPARE(numSent, 3u);
+        for(u32 i = 0; i < numSent && i < 4; ++i)
+            targets[i]->FromQuantizedBinary(dd, AttributeChange::Disconnected, useMetadata);
+        QCOMPARE(flagTarget.Get(), value);
+        QCOMPARE(countTarget.Get(), 7u);
+        QCOMPARE(newerFlagTarget.Get(), true);
+        QVERIFY(transformTarget.Get().pos.Distance(transform.Get().pos) < 2e-3f);
+        QVERIFY(dd.BitsLeft() < 8);
+    }
+
+    void Scene::Serialize_XmlStream()
+    {
+        for(int i = 0; i < 5; ++i)
+        {
+            EntityPtr ent = test_.scene->CreateEntity(0, QStringList() << EC_Name::TypeNameStatic(), AttributeChange::LocalOnly);
+            ent->SetName(QString("Entity %1").arg(i));
+            shared_ptr<EC_DynamicComponent> dc = static_pointer_cast<EC_DynamicComponent>(
+                ent->CreateComponent(EC_DynamicComponent::TypeIdStatic(), "Data", AttributeChange::LocalOnly));
+            dc->CreateAttribute("string", "label", AttributeChange::LocalOnly);
+            dc->SetAttribute("label", QString("<label & \"%1\">").arg(i));
+            EntityPtr child = ent->CreateChild(0, QStringList() << EC_Name::TypeNameStatic(), AttributeChange::LocalOnly);
+            child->SetName(QString("Child %1").arg(i));
+        }
+
+        const QByteArray xml = test_.scene->SerializeToXmlString(true, true);
+        QVERIFY(!xml.isEmpty());
+
+        // Reading the XML back in small batches must produce the same scene.
+        test_.scene->RemoveAllEntities();
+        QBuffer buffer;
+        buffer.setData(xml);
+        QVERIFY(buffer.open(QIODevice::ReadOnly));
+        QList<Entity *> created = test_.scene->CreateContentFromXml(&buffer, true, AttributeChange::LocalOnly, 2);
+        QCOMPARE(created.size(), 10);
+        QCOMPARE(test_.scene->SerializeToXmlString(true, true), xml);
+
+        // The scene description sees the same entities.
+        QByteArray data = xml;
+        SceneDesc sceneDesc;
+        test_.scene->CreateSceneDescFromXml(data, sceneDesc, false);
+        QCOMPARE(sceneDesc.entities.size(), 5);
+        QCOMPARE(sceneDesc.entities.first().name, QString("Entity 0"));
+        QCOMPARE(sceneDesc.entities.first().children.size(), 1);
+
+        // On malformed XML the content preceding the error is still created.
+        test_.scene->RemoveAllEntities();
+        const int truncatedAt = xml.indexOf("<entity", xml.indexOf("Entity 3"));
+        QVERIFY(truncatedAt > 0);
+        created = test_.scene->CreateContentFromXml(QString::fromUtf8(xml.left(truncatedAt + 3)), true, AttributeChange::LocalOnly);
+        QCOMPARE(created.size(), 6);
+    }
+
+    void Scene::Serialize_XmlStreamParallel()
+    {
+        QByteArray xml = "<!DOCTYPE Scene>\n<scene>\n <!-- <entity id=\"999\"/> -->\n <storage specifier=\"src=local://;default\"/>\n";
+        for(int i = 1; i <= 50; ++i)
+        {
+            xml += QString(" <entity id=\"%1\" sync=\"%2\">\n"
+                "  <component type=\"EC_DynamicComponent\" name=\"Data\">\n"
+                "   <attribute value=\"a &gt; b / '%1'\" type=\"string\" name=\"label\"/>\n"
+                "  </component>\n").arg(i).arg(i % 2 ? "1" : "0").toUtf8();
+            if (i % 10 == 0)
+                xml += QString("  <entity id=\"%1\"/>\n").arg(1000 + i).toUtf8();
+            xml += " </entity>\n";
+            if (i == 25)
+                xml += " <storage specifier=\"src=http://www.example.com/assets/\"/>\n";
+        }
+        xml += "</scene>\n";
+
+        // The parallel reader returns the same items in the same order as the sequential one. This holds also when
+        // the document is read in many blocks, which are smaller than the document and even than one entity.
+        const int blockSizes[] = { 0, 1024, 100 };
+        EntityDesc expected, actual;
+        QString expectedStorage, actualStorage;
+        int numEntities = 0;
+        for(size_t b = 0; b < sizeof(blockSizes) / sizeof(blockSizes[0]); ++b)
+        {
+            QBuffer sequentialBuffer(&xml);
+            QBuffer parallelBuffer(&xml);
+            QVERIFY(sequentialBuffer.open(QIODevice::ReadOnly));
+            QVERIFY(parallelBuffer.open(QIODevice::ReadOnly));
+            SceneXmlReader sequential(&sequentialBuffer);
+            SceneXmlReader parallel(&parallelBuffer, 4);
+            if (blockSizes[b] > 0)
+                parallel.SetReadBlockSize(blockSizes[b]);
+            QVERIFY(sequential.ReadSceneStart());
+            QVERIFY(parallel.ReadSceneStart());
+
+            numEntities = 0;
+            int numStorages = 0;
+            for(;;)
+            {
+                const SceneXmlReader::Item item = sequential.ReadNext(expected, expectedStorage);
+                QCOMPARE((int)parallel.ReadNext(actual, actualStorage), (int)item);
+                if (item == SceneXmlReader::Storage)
+                {
+                    ++numStorages;
+                    QCOMPARE(actualStorage, expectedStorage);
+                }
+                else if (item == SceneXmlReader::RootEntity)
+                {
+                    ++numEntities;
+                    QVERIFY(actual == expected);
+                    QCOMPARE(actual.local, expected.local);
+                    QVERIFY(actual.components == expected.components);
+                    QCOMPARE(actual.children.size(), expected.children.size());
+                }
+                else
+                    break;
+            }
+            QCOMPARE(numEntities, 50);
+            QCOMPARE(numStorages, 2);
+        }
+
+        // An error is reported after the content preceding it.
+        QByteArray truncated = xml.left(xml.indexOf("<entity id=\"40\"") + 10);
+        QBuffer truncatedBuffer(&truncated);
+        QVERIFY(truncatedBuffer.open(QIODevice::ReadOnly));
+        SceneXmlReader truncatedReader(&truncatedBuffer, 4);
+        QVERIFY(truncatedReader.ReadSceneStart());
+        numEntities = 0;
+        SceneXmlReader::Item item;
+        while((item = truncatedReader.ReadNext(actual, actualStorage)) != SceneXmlReader::End && item != SceneXmlReader::Error)
+            if (item == SceneXmlReader::RootEntity)
+                ++numEntities;
+        QCOMPARE((int)item, (int)SceneXmlReader::Error);
+        QCOMPARE(numEntities, 39);
+        QVERIFY(!truncatedReader.ErrorString().isEmpty());
+    }
 }
 
 // QTest entry point
@@ -20,6 +20,8 @@ namespace TundraTest
         void Create_Entity_data();
         void Create_Entity();
 
+        void Create_Scene_Disconnected();
+
         void Create_Attributes_Unparented_data();
         void Create_Attributes_Unparented();
 
@@ -29,6 +31,18 @@ namespace TundraTest
         void Create_Components_Parented_data();
         void Create_Components_Parented();
 
+        void Query_AttributeArrays();
+        void Benchmark_QueryAttributeArrays();
+
+        void Serialize_QuantizedAttributes_data();
+        void Serialize_QuantizedAttributes();
+        void Serialize_QuantizedTransform();
+        void Serialize_QuantizedTrailingBool_data();
+        void Serialize_QuantizedTrailingBool();
+
+        void Serialize_XmlStream();
+        void Serialize_XmlStreamParallel();
+
     private:
         TestFramework test_;
     };
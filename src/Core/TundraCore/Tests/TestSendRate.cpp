@@ -0,0 +1,197 @@
+
+#include "DebugOperatorNew.h"
+
+#include "TestSendRate.h"
+
+#include "SendRate.h"
+#include "Math/MathFunc.h"
+
+#include <QtTest/QtTest>
+
+#include "MemoryLeakCheck.h"
+
+using TundraLogic::SendRateSettings;
+using TundraLogic::LinkStats;
+using TundraLogic::SendRateTickMetrics;
+
+namespace
+{
+    typedef TundraLogic::SendRate Policy;
+
+    LinkStats Link(float roundTripTime, float packetLoss = 0.f, u32 outboundQueue = 0)
+    {
+        LinkStats stats;
+        stats.roundTripTime = roundTripTime;
+        stats.packetLoss = packetLoss;
+        stats.outboundQueue = outboundQueue;
+        return stats;
+    }
+}
+
+namespace TundraTest
+{
+    void SendRate::Backoff()
+    {
+        const SendRateSettings settings;
+        Policy rate;
+        QVERIFY(!rate.Update(settings, 0.0, Link(0.05f)));
+        QCOMPARE(rate.Interval(), 1u);
+        QCOMPARE(rate.LastReason(), Policy::Steady);
+
+        // Congestion doubles the interval, but not again before the hold time has passed.
+        QVERIFY(rate.Update(settings, 1.0, Link(0.05f, 0.1f)));
+        QCOMPARE(rate.Interval(), 2u);
+        QCOMPARE(rate.LastReason(), Policy::Loss);
+        QVERIFY(!rate.Update(settings, 1.25, Link(0.05f, 0.1f)));
+        QCOMPARE(rate.Interval(), 2u);
+        QVERIFY(rate.Update(settings, 1.5, Link(0.05f, 0.f, settings.queueThreshold + 1)));
+        QCOMPARE(rate.Interval(), 4u);
+        QCOMPARE(rate.LastReason(), Policy::Queue);
+        QVERIFY(rate.Update(settings, 2.0, Link(0.05f, 0.1f)));
+        QCOMPARE(rate.Interval(), settings.maxInterval);
+        QVERIFY(!rate.Update(settings, 3.0, Link(0.05f, 0.1f)));
+        QCOMPARE(rate.Interval(), settings.maxInterval);
+
+        // The updates are due every interval ticks.
+        rate.Sent(100);
+        QVERIFY(!rate.IsDue(100 + settings.maxInterval - 1));
+        QVERIFY(rate.IsDue(100 + settings.maxInterval));
+    }
+
+    void SendRate::Recovery()
+    {
+        const SendRateSettings settings;
+        Policy rate;
+        rate.Reset(4);
+        QVERIFY(!rate.Update(settings, 0.0, Link(0.05f, 0.1f)));
+        QCOMPARE(rate.LastReason(), Policy::Loss);
+
+        // The interval is shortened by one tick per each recovery time the link stays clear.
+        f64 time = 0.0;
+        for(; time < settings.recoveryTime - 0.1; time += 0.1)
+        {
+            QVERIFY(!rate.Update(settings, time, Link(0.05f)));
+            QCOMPARE(rate.LastReason(), Policy::Loss);
+        }
+        u32 expected = 4;
+        for(; expected > settings.minInterval; time += 0.1)
+            if (rate.Update(settings, time, Link(0.05f)))
+            {
+                QCOMPARE(rate.Interval(), --expected);
+                QCOMPARE(rate.LastReason(), Policy::Recovered);
+            }
+        QVERIFY(time < 1.0 + 3 * settings.recoveryTime);
+        rate.Update(settings, time, Link(0.05f));
+        QCOMPARE(rate.LastReason(), Policy::Steady);
+
+        // The recovery time is counted from the latest congestion, even if it did not grow the interval.
+        const f64 congested = time + 1.0;
+        QVERIFY(rate.Update(settings, congested, Link(0.05f, 0.1f)));
+        QCOMPARE(rate.Interval(), 2u);
+        QVERIFY(!rate.Update(settings, congested + 0.2, Link(0.05f, 0.1f)));
+        QVERIFY(!rate.Update(settings, congested + settings.recoveryTime + 0.1, Link(0.05f)));
+        QCOMPARE(rate.Interval(), 2u);
+        QVERIFY(rate.Update(settings, congested + settings.recoveryTime + 0.3, Link(0.05f)));
+        QCOMPARE(rate.Interval(), 1u);
+    }
+
+    void SendRate::Latency()
+    {
+        const SendRateSettings settings;
+
+        // A long but steady round trip time, e.g. of a mobile link, is not congestion.
+        Policy rate;
+        for(int i = 0; i < 100; ++i)
+            rate.Update(settings, i * 0.05, Link(0.4f + (i % 3) * 0.01f));
+        QCOMPARE(rate.Interval(), 1u);
+        QCOMPARE(rate.BaseRoundTripTime(), 0.4f);
+
+        // The round trip time growing above the lowest one is.
+        QVERIFY(rate.Update(settings, 5.0, Link(0.4f + settings.latencyThreshold + 0.05f)));
+        QCOMPARE(rate.Interval(), 2u);
+        QCOMPARE(rate.LastReason(), Policy::Latency);
+
+        // An unmeasured round trip time is ignored.
+        Policy unmeasured;
+        QVERIFY(!unmeasured.Update(settings, 0.0, Link(0.f)));
+        QVERIFY(!unmeasured.Update(settings, 1.0, Link(0.f)));
+        QCOMPARE(unmeasured.BaseRoundTripTime(), 0.f);
+    }
+
+    void SendRate::SimulatedLink_data()
+    {
+        QTest::addColumn<float>("capacity");
+        QTest::addColumn<float>("latency");
+        QTest::newRow("LAN") << 1000.f << 0.005f;
+        QTest::newRow("Mobile") << 8.f << 0.15f;
+        QTest::newRow("Poor web link") << 4.f << 0.3f;
+    }
+
+    void SendRate::SimulatedLink()
+    {
+        QFETCH(float, capacity);
+        QFETCH(float, latency);
+
+        const SendRateSettings settings;
+        const float tickPeriod = 0.05f;
+        const u32 numTicks = 1200;
+        const u32 settleTicks = 400;
+        const f64 bufferSize = 40.0;
+
+        // The link carries capacity updates per second. The updates that do not fit wait in the outbound queue, which grows the round
+        // trip time, and are lost when the buffer of the link is full. The lost share is measured over the latest second.
+        Policy rate;
+        f64 queue = 0.0;
+        f64 lossRate = 0.f;
+        u32 sent = 0;
+        u32 lost = 0;
+        u32 maxInterval = 0;
+        u32 minInterval = settings.maxInterval;
+        f64 maxQueue = 0.0;
+        for(u32 tick = 1; tick <= numTicks; ++tick)
+        {
+            queue = Max(queue - capacity * tickPeriod, 0.0);
+            const LinkStats stats = Link(latency + (float)(queue / capacity), (float)lossRate, (u32)queue);
+            rate.Update(settings, tick * tickPeriod, stats);
+
+            bool dropped = false;
+            if (rate.IsDue(tick))
+            {
+                rate.Sent(tick);
+                if (queue + 1.0 > bufferSize)
+                    dropped = true;
+                else
+                    queue += 1.0;
+                if (tick > settleTicks)
+                {
+                    ++sent;
+                    if (dropped)
+                        ++lost;
+                }
+            }
+            lossRate += ((dropped ? 1.0 : 0.0) - lossRate) * tickPeriod;
+
+            if (tick > settleTicks)
+            {
+                maxInterval = Max(maxInterval, rate.Interval());
+                minInterval = Min(minInterval, rate.Interval());
+                maxQueue = Max(maxQueue, queue);
+            }
+        }
+
+        const float sendRate = sent / ((numTicks - settleTicks) * tickPeriod);
+        qDebug() << "Capacity" << capacity << "updates/s: sent" << sendRate << "updates/s, interval" << minInterval << "-" << maxInterval
+            << "ticks, lost" << lost << "of" << sent << "updates, max queue" << maxQueue;
+
+        // The send rate settles within the capacity of the link without losing updates, and does not throttle a link that has room.
+        QVERIFY(sendRate <= capacity * 1.05f);
+        QVERIFY(sendRate >= Min(capacity, 1.f / tickPeriod) * 0.5f);
+        QCOMPARE(lost, 0u);
+        QVERIFY(maxQueue < bufferSize);
+        if (capacity >= 1.f / tickPeriod)
+            QCOMPARE(maxInterval, settings.minInterval);
+    }
+}
+
+// QTest entry point
+QTEST_APPLESS_MAIN(TundraTest::SendRate);
@@ -0,0 +1,23 @@
+
+#pragma once
+
+#include "TestHelpers.h"
+
+namespace TundraTest
+{
+    /// Tests the adaptive per-connection send rate policy of SyncManager without a network.
+    /** Checks the decisions of the policy on given link states, and sends the updates of the fixed server tick over simulated links
+        of limited capacity to check that the send rate of each link settles within its capacity. */
+    class SendRate : public QObject
+    {
+        Q_OBJECT
+
+    private slots:
+        void Backoff();
+        void Recovery();
+        void Latency();
+
+        void SimulatedLink_data();
+        void SimulatedLink();
+    };
+}
@@ -0,0 +1,220 @@
+
+#include "DebugOperatorNew.h"
+
+#include "TestSnapshotDelta.h"
+
+#include "SnapshotDelta.h"
+#include "Transform.h"
+#include "Math/MathFunc.h"
+#include "Math/float3.h"
+#include "Algorithm/Random/LCG.h"
+
+#include "kNet/DataSerializer.h"
+#include "kNet/DataDeserializer.h"
+
+#include <QtTest/QtTest>
+
+#include <map>
+
+#include "MemoryLeakCheck.h"
+
+using TundraLogic::RigidBodySnapshot;
+
+namespace TundraTest
+{
+    void SnapshotDelta::Quantization()
+    {
+        const Transform t(float3(12.345f, -0.5f, 1000.f), float3(0.f, 90.25f, -45.f), float3(1.f, 2.f, 0.5f));
+        const float3 velocity(1.5f, 0.f, -3.f);
+        const float3 angularVelocity(0.f, 30.f, 0.f);
+        const RigidBodySnapshot snapshot = RigidBodySnapshot::FromState(t, velocity, angularVelocity);
+
+        QVERIFY(snapshot.ToTransform().pos.Distance(t.pos) < 1e-3f);
+        QVERIFY(snapshot.ToTransform().rot.Distance(t.rot) < 1e-2f);
+        QVERIFY(snapshot.ToTransform().scale.Distance(t.scale) < 1e-3f);
+        QVERIFY(snapshot.ToLinearVelocity().Distance(velocity) < 1e-3f);
+        QVERIFY(snapshot.ToAngularVelocity().Distance(angularVelocity) < 0.1f);
+
+        // Quantizing the dequantized state gives the same state, so both ends agree on the baselines.
+        QVERIFY(RigidBodySnapshot::FromState(snapshot.ToTransform(), snapshot.ToLinearVelocity(), snapshot.ToAngularVelocity()) == snapshot);
+
+        Transform moved = t;
+        moved.pos.x += 0.1f;
+        const RigidBodySnapshot other = RigidBodySnapshot::FromState(moved, velocity, float3::zero);
+        QCOMPARE(other.DifferingParts(snapshot), (1 << RigidBodySnapshot::Position) | (1 << RigidBodySnapshot::AngularVelocity));
+    }
+
+    void SnapshotDelta::LossyLink_data()
+    {
+        QTest::addColumn<float>("loss");
+        QTest::newRow("No loss") << 0.f;
+        QTest::newRow("20% loss") << 0.2f;
+        QTest::newRow("50% loss") << 0.5f;
+    }
+
+    void SnapshotDelta::LossyLink()
+    {
+        QFETCH(float, loss);
+
+        const int numEntities = 100;
+        const int numMovingEntities = 20;
+        const int numTicks = 300;
+        const int numSettleTicks = 60;
+        LCG rng(4321);
+
+        TundraLogic::SnapshotBaselines server;
+        TundraLogic::SnapshotReceiver client;
+        std::map<entity_id_t, RigidBodySnapshot> serverStates;
+        std::map<entity_id_t, RigidBodySnapshot> clientStates;
+        std::vector<float3> positions(numEntities);
+        std::vector<float3> velocities(numEntities);
+        for(int i = 0; i < numEntities; ++i)
+        {
+            positions[i] = float3(rng.Float(-100.f, 100.f), 0.f, rng.Float(-100.f, 100.f));
+            velocities[i] = i < numMovingEntities ? float3(rng.Float(-5.f, 5.f), 0.f, rng.Float(-5.f, 5.f)) : float3::zero;
+        }
+
+        size_t snapshotBytes = 0;
+        size_t absoluteBytes = 0;
+        kNet::DataSerializer ds(64 * 1024);
+        kNet::DataSerializer absolute(64 * 1024);
+        for(int tick = 0; tick < numTicks + numSettleTicks; ++tick)
+        {
+            // Server: move the entities, and send all that differ from what the client has acknowledged.
+            ds.ResetFill();
+            absolute.ResetFill();
+            TundraLogic::SnapshotBaselines unacknowledged; // Always sends against the zero state, for comparison.
+            server.BeginSnapshot(ds);
+            unacknowledged.BeginSnapshot(absolute);
+            for(int i = 0; i < numEntities; ++i)
+            {
+                if (tick >= numTicks)
+                    velocities[i] = float3::zero;
+                positions[i] += velocities[i] / 30.f;
+                Transform t;
+                t.pos = positions[i];
+                const RigidBodySnapshot state = RigidBodySnapshot::FromState(t, velocities[i], float3::zero);
+                const bool changed = serverStates.find(i + 1) == serverStates.end() || serverStates[i + 1] != state;
+                serverStates[i + 1] = state;
+                if (changed || server.Unacknowledged().count(i + 1))
+                    server.Write(ds, i + 1, state);
+                if (changed)
+                    unacknowledged.Write(absolute, i + 1, state);
+            }
+            const size_t numWritten = server.EndSnapshot();
+            if (numWritten > 0)
+                snapshotBytes += ds.BytesFilled();
+            if (unacknowledged.EndSnapshot() > 0)
+                absoluteBytes += absolute.BytesFilled();
+
+            // Client: apply the snapshot if it arrives, and acknowledge it.
+            if (numWritten > 0 && rng.Float() >= loss)
+            {
+                kNet::DataDeserializer dd(ds.GetData(), ds.BytesFilled());
+                const u32 sequence = client.ReadHeader(dd);
+                QVERIFY(sequence != 0);
+                while(dd.BitsLeft() >= 8)
+                {
+                    entity_id_t id;
+                    RigidBodySnapshot state;
+                    int changedParts;
+                    // The server only uses baselines that the client has acknowledged.
+                    QVERIFY(client.Read(dd, sequence, id, state, changedParts));
+                    clientStates[id] = state;
+                    client.Store(sequence, id, state);
+                }
+            }
+
+            kNet::DataSerializer acks(1024);
+            if (client.WriteAcks(acks) && rng.Float() >= loss)
+            {
+                kNet::DataDeserializer dd(acks.GetData(), acks.BytesFilled());
+                std::vector<TundraLogic::SnapshotAck> received;
+                TundraLogic::SnapshotReceiver::ReadAcks(dd, received);
+                for(size_t i = 0; i < received.size(); ++i)
+                {
+                    QVERIFY(received[i].entities.empty()); // All the entities were stored.
+                    server.Acknowledge(received[i]);
+                }
+            }
+        }
+
+        qDebug() << qPrintable(QString("%1 bytes of delta snapshots, %2 bytes of changed states against the zero state")
+            .arg(snapshotBytes).arg(absoluteBytes));
+
+        // Once the entities have stopped, the client has exactly the server-side states, and nothing is left to send.
+        QCOMPARE(clientStates.size(), serverStates.size());
+        for(std::map<entity_id_t, RigidBodySnapshot>::const_iterator i = serverStates.begin(); i != serverStates.end(); ++i)
+            QVERIFY(clientStates[i->first] == i->second);
+        QVERIFY(server.Unacknowledged().empty());
+        if (loss == 0.f)
+            QVERIFY(snapshotBytes < absoluteBytes);
+    }
+
+    void SnapshotDelta::PartialAcks()
+    {
+        // Entity 2 can not be applied by the client at first, e.g. because its creation has not arrived yet, and entity 3
+        // stops being applied for longer than the server uses baselines. The other entities must keep their deltas.
+        const int numEntities = 4;
+        const int numTicks = 60;
+
+        TundraLogic::SnapshotBaselines server;
+        TundraLogic::SnapshotReceiver client;
+        std::map<entity_id_t, RigidBodySnapshot> serverStates;
+        std::map<entity_id_t, RigidBodySnapshot> clientStates;
+        kNet::DataSerializer ds(1024);
+        for(int tick = 0; tick < numTicks; ++tick)
+        {
+            ds.ResetFill();
+            server.BeginSnapshot(ds);
+            for(entity_id_t id = 1; id <= numEntities; ++id)
+            {
+                Transform t;
+                t.pos = float3((float)id, 0.f, (float)tick);
+                serverStates[id] = RigidBodySnapshot::FromState(t, float3::zero, float3::zero);
+                QVERIFY(server.Write(ds, id, serverStates[id]));
+            }
+            QCOMPARE(server.EndSnapshot(), (size_t)numEntities);
+
+            kNet::DataDeserializer dd(ds.GetData(), ds.BytesFilled());
+            const u32 sequence = client.ReadHeader(dd);
+            QVERIFY(sequence != 0);
+            size_t numStored = 0;
+            while(dd.BitsLeft() >= 8)
+            {
+                entity_id_t id;
+                RigidBodySnapshot state;
+                int changedParts;
+                // Unacknowledged entities are sent against an acknowledged baseline or the zero state, so they can always be read.
+                QVERIFY(client.Read(dd, sequence, id, state, changedParts));
+                if ((id == 2 && tick < 40) || (id == 3 && tick >= 10 && tick < 50))
+                    continue;
+                clientStates[id] = state;
+                client.Store(sequence, id, state);
+                ++numStored;
+            }
+
+            kNet::DataSerializer acks(1024);
+            QVERIFY(client.WriteAcks(acks));
+            kNet::DataDeserializer ackDd(acks.GetData(), acks.BytesFilled());
+            std::vector<TundraLogic::SnapshotAck> received;
+            TundraLogic::SnapshotReceiver::ReadAcks(ackDd, received);
+            QCOMPARE(received.size(), (size_t)1);
+            QCOMPARE(received[0].sequence, sequence);
+            // A fully applied snapshot is acknowledged without listing its entities.
+            QCOMPARE(received[0].entities.size(), numStored == numEntities ? (size_t)0 : numStored);
+            server.Acknowledge(received[0]);
+
+            QVERIFY(server.AcknowledgedState(1) && *server.AcknowledgedState(1) == serverStates[1]);
+            QVERIFY(server.AcknowledgedState(4) && *server.AcknowledgedState(4) == serverStates[4]);
+            QCOMPARE(server.AcknowledgedState(2) != 0, tick >= 40);
+        }
+
+        for(entity_id_t id = 1; id <= numEntities; ++id)
+            QVERIFY(clientStates[id] == serverStates[id]);
+        QVERIFY(server.Unacknowledged().empty());
+    }
+}
+
+// QTest entry point
+QTEST_APPLESS_MAIN(TundraTest::SnapshotDelta);
@@ -0,0 +1,24 @@
+
+#pragma once
+
+#include "TestHelpers.h"
+
+namespace TundraTest
+{
+    /// Tests the snapshot delta encoding of SyncManager without a network.
+    /** Replicates moving entities from a server to a client over a simulated lossy link, with the snapshots and
+        the acknowledgements dropped at random, and checks that the client ends up with exactly the server-side states.
+        Also checks that the entities the client does not apply are left unacknowledged without holding back the others. */
+    class SnapshotDelta : public QObject
+    {
+        Q_OBJECT
+
+    private slots:
+        void Quantization();
+
+        void LossyLink_data();
+        void LossyLink();
+
+        void PartialAcks();
+    };
+}
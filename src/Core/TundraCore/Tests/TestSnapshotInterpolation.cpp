@@ -0,0 +1,195 @@
+
+#include "DebugOperatorNew.h"
+
+#include "TestSnapshotInterpolation.h"
+
+#include "SnapshotInterpolation.h"
+#include "Math/MathFunc.h"
+#include "Math/float3.h"
+#include "Math/Quat.h"
+#include "Algorithm/Random/LCG.h"
+
+#include <QtTest/QtTest>
+
+#include <algorithm>
+#include <vector>
+
+#include "MemoryLeakCheck.h"
+
+using TundraLogic::TickSample;
+using TundraLogic::SnapshotRing;
+using TundraLogic::ServerTickClock;
+
+namespace
+{
+    const float cRadius = 10.f;
+    const float cAngularSpeed = 0.5f;
+
+    /// Returns the state of the simulated entity, which moves on a circle of radius 10 m at 5 m/s, at the given server time.
+    TickSample CircleState(u32 tick, float time)
+    {
+        TickSample s;
+        s.tick = tick;
+        s.pos = float3(Cos(cAngularSpeed * time), 0.f, Sin(cAngularSpeed * time)) * cRadius;
+        s.vel = float3(-Sin(cAngularSpeed * time), 0.f, Cos(cAngularSpeed * time)) * cRadius * cAngularSpeed;
+        return s;
+    }
+
+    struct Message
+    {
+        f64 arrival;
+        u32 tick;
+    };
+
+    bool ArrivesBefore(const Message &lhs, const Message &rhs)
+    {
+        return lhs.arrival < rhs.arrival;
+    }
+}
+
+namespace TundraTest
+{
+    void SnapshotInterpolation::Ring()
+    {
+        SnapshotRing ring;
+        QVERIFY(ring.IsEmpty());
+
+        TickSample s;
+        s.tick = 5; QVERIFY(ring.Insert(s));
+        s.tick = 3; QVERIFY(ring.Insert(s));
+        s.tick = 4; QVERIFY(ring.Insert(s));
+        QVERIFY(!ring.Insert(s)); // Duplicate tick.
+        QCOMPARE(ring.Size(), (size_t)3);
+        QCOMPARE(ring.At(0).tick, 3u);
+        QCOMPARE(ring.At(1).tick, 4u);
+        QCOMPARE(ring.Latest().tick, 5u);
+
+        // When full, the oldest states make room for the newer ones, and states older than all kept ones are dropped.
+        for(u32 tick = 6; tick <= 20; ++tick)
+        {
+            s.tick = tick;
+            QVERIFY(ring.Insert(s));
+        }
+        QCOMPARE(ring.Size(), SnapshotRing::cCapacity);
+        QCOMPARE(ring.At(0).tick, 5u);
+        QCOMPARE(ring.Latest().tick, 20u);
+        s.tick = 2;
+        QVERIFY(!ring.Insert(s));
+        for(size_t i = 1; i < ring.Size(); ++i)
+            QVERIFY(ring.At(i - 1).tick < ring.At(i).tick);
+
+        ring.Clear();
+        QVERIFY(ring.IsEmpty());
+    }
+
+    void SnapshotInterpolation::Sampling()
+    {
+        const float period = 0.1f;
+        SnapshotRing ring;
+        TickSample a;
+        a.tick = 10;
+        a.vel = float3(10.f, 0.f, 0.f);
+        TickSample b = a;
+        b.tick = 12;
+        b.pos = float3(2.f, 0.f, 0.f);
+        b.rot = Quat::RotateY(pi / 2.f);
+        ring.Insert(b);
+        ring.Insert(a);
+
+        TickSample result;
+        QCOMPARE(ring.Sample(9.0, period, true, 2.f, result), SnapshotRing::Interpolated);
+        QVERIFY(result.pos.Equals(a.pos));
+
+        // Halfway between the states. The Hermite curve of a constant velocity is a straight line at that velocity.
+        QCOMPARE(ring.Sample(11.0, period, true, 2.f, result), SnapshotRing::Interpolated);
+        QVERIFY(result.pos.Equals(float3(1.f, 0.f, 0.f), 1e-4f));
+        QVERIFY(result.rot.Equals(Quat::RotateY(pi / 4.f), 1e-4f));
+        QCOMPARE(ring.Sample(11.5, period, false, 2.f, result), SnapshotRing::Interpolated);
+        QVERIFY(result.pos.Equals(float3(1.5f, 0.f, 0.f), 1e-4f));
+
+        // Past the latest state the position is extrapolated with the velocity, up to the limit.
+        QCOMPARE(ring.Sample(13.0, period, true, 2.f, result), SnapshotRing::Extrapolated);
+        QVERIFY(result.pos.Equals(float3(3.f, 0.f, 0.f), 1e-4f));
+        QCOMPARE(ring.Sample(13.0, period, false, 2.f, result), SnapshotRing::Extrapolated);
+        QVERIFY(result.pos.Equals(b.pos));
+        QCOMPARE(ring.Sample(16.0, period, true, 2.f, result), SnapshotRing::Expired);
+        QVERIFY(result.pos.Equals(float3(4.f, 0.f, 0.f), 1e-4f));
+        QVERIFY(result.vel.Equals(b.vel));
+    }
+
+    void SnapshotInterpolation::JitteredArrival_data()
+    {
+        QTest::addColumn<float>("jitter");
+        QTest::newRow("No jitter") << 0.f;
+        QTest::newRow("25 ms jitter") << 0.025f;
+        QTest::newRow("50 ms jitter") << 0.05f;
+    }
+
+    void SnapshotInterpolation::JitteredArrival()
+    {
+        QFETCH(float, jitter);
+
+        const float period = 0.05f;
+        const u32 numTicks = 400;
+        const f64 frameTime = 1.0 / 60.0;
+        const f64 latency = 0.05;
+        const f64 interpolationDelay = 2.0;
+        const f64 settleTime = 1.0;
+        LCG rng(1234);
+
+        // The server sends the state on every tick. The messages arrive in the order of their latency, not of their ticks.
+        std::vector<Message> messages(numTicks);
+        for(u32 i = 0; i < numTicks; ++i)
+        {
+            messages[i].tick = i + 1;
+            messages[i].arrival = messages[i].tick * period + latency + (jitter > 0.f ? rng.Float(0.f, jitter) : 0.f);
+        }
+        std::sort(messages.begin(), messages.end(), ArrivesBefore);
+
+        ServerTickClock clock;
+        clock.SetTickPeriod(period);
+        SnapshotRing ring;
+        size_t next = 0;
+        f64 previousRenderTick = 0.0;
+        float maxError = 0.f;
+        f64 maxStepError = 0.0;
+        int frames = 0;
+        int extrapolatedFrames = 0;
+        for(f64 time = 0.0; time < numTicks * period; time += frameTime)
+        {
+            // The client handles the messages on the first frame after they arrived.
+            for(; next < messages.size() && messages[next].arrival <= time; ++next)
+            {
+                ring.Insert(CircleState(messages[next].tick, messages[next].tick * period));
+                clock.Received(messages[next].tick, time);
+            }
+            if (ring.IsEmpty())
+                continue;
+
+            const f64 renderTick = clock.Tick(time) - interpolationDelay;
+            TickSample rendered;
+            if (ring.Sample(renderTick, period, true, 2.f, rendered) != SnapshotRing::Interpolated)
+                ++extrapolatedFrames;
+
+            if (time >= settleTime)
+            {
+                // The entity is rendered on its true path at the render tick, and the render tick advances with the frame time.
+                maxError = Max(maxError, rendered.pos.Distance(CircleState(0, (float)(renderTick * period)).pos));
+                maxStepError = Max(maxStepError, Abs((renderTick - previousRenderTick) * period - frameTime));
+                ++frames;
+            }
+            previousRenderTick = renderTick;
+        }
+
+        qDebug() << "Jitter" << jitter * 1000.f << "ms: max error" << maxError * 1000.f << "mm, max render time step error"
+            << maxStepError * 1000.0 << "ms, extrapolated" << extrapolatedFrames << "of" << frames << "frames";
+
+        QVERIFY(frames > 0);
+        QVERIFY(maxError < 0.01f);
+        QVERIFY(maxStepError < 0.002);
+        QVERIFY(extrapolatedFrames < frames / 50);
+    }
+}
+
+// QTest entry point
+QTEST_APPLESS_MAIN(TundraTest::SnapshotInterpolation);
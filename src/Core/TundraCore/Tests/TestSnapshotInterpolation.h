@@ -0,0 +1,22 @@
+
+#pragma once
+
+#include "TestHelpers.h"
+
+namespace TundraTest
+{
+    /// Tests the client-side rendering of the tick-stamped rigid body states of SyncManager without a network.
+    /** Sends the states of an entity moving on a circle on every server tick over a simulated link with random latency,
+        and checks that the client renders the entity smoothly and on its true path however the states arrive. */
+    class SnapshotInterpolation : public QObject
+    {
+        Q_OBJECT
+
+    private slots:
+        void Ring();
+        void Sampling();
+
+        void JitteredArrival_data();
+        void JitteredArrival();
+    };
+}
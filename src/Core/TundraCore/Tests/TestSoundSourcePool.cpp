@@ -0,0 +1,369 @@
+
+#include "DebugOperatorNew.h"
+
+#include "TestSoundSourcePool.h"
+
+#include "SoundSourcePool.h"
+#include "SoundBackend.h"
+#include "SoundChannel.h"
+#include "AudioAsset.h"
+#include "Math/float3.h"
+
+#include <QtTest/QtTest>
+
+#include <cmath>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    /// Gives the sources to the voices the pool has chosen, in the same way as AudioAPI::Update through the sound channels.
+    void AssignSources(::SoundSourcePool &pool, const std::vector<int> &voices)
+    {
+        for(size_t i = 0; i < voices.size(); ++i)
+            if (pool.Source(voices[i]) && !pool.ShouldHaveSource(voices[i]))
+                pool.ReleaseSource(voices[i]);
+        for(size_t i = 0; i < voices.size(); ++i)
+            if (pool.ShouldHaveSource(voices[i]))
+                pool.AcquireSource(voices[i]);
+    }
+
+    /// Creates playing positional voices along the x axis, one meter apart starting from x = 1.
+    std::vector<int> CreateVoiceRow(::SoundSourcePool &pool, int count)
+    {
+        std::vector<int> voices;
+        for(int i = 0; i < count; ++i)
+        {
+            int voice = pool.CreateVoice();
+            pool.SetPositional(voice, true);
+            pool.SetPosition(voice, float3(i + 1.f, 0.f, 0.f));
+            pool.SetRange(voice, 0.f, 12.f, 1.f);
+            pool.SetPlaying(voice, true);
+            voices.push_back(voice);
+        }
+        return voices;
+    }
+
+    /// Audio asset with a made-up buffer handle, which the null sound backend plays like any other buffer.
+    class NullAudioAsset : public AudioAsset
+    {
+    public:
+        NullAudioAsset(AssetAPI *owner, const QString &name, ALuint buffer, float length) :
+            AudioAsset(owner, "Audio", name)
+        {
+            handle = buffer;
+            lengthSeconds = length;
+        }
+
+        ~NullAudioAsset()
+        {
+            // The buffer does not exist in OpenAL, so AudioAsset must not delete it.
+            handle = 0;
+        }
+    };
+
+    /// Updates the pool and the channels in the same order as AudioAPI::Update, with the listener at the origin.
+    void UpdateChannels(::SoundSourcePool &pool, const std::vector<SoundChannel*> &channels, f64 frametime)
+    {
+        pool.Update(float3::zero);
+        for(size_t i = 0; i < channels.size(); ++i)
+            channels[i]->YieldSource();
+        for(size_t i = 0; i < channels.size(); ++i)
+            channels[i]->Update(frametime);
+    }
+}
+
+namespace TundraTest
+{
+    void SoundSourcePool::initTestCase()
+    {
+        // Audio assets need an asset API as their owner.
+        test_.Initialize(false);
+    }
+
+    void SoundSourcePool::Attenuation()
+    {
+        NullSoundBackend backend(8);
+        ::SoundSourcePool pool(&backend, 8);
+
+        const float distances[] = { 0.5f, 1.f, 3.5f, 6.f, 10.f, 11.f, 20.f };
+        std::vector<int> voices;
+        for(size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); ++i)
+        {
+            int voice = pool.CreateVoice();
+            pool.SetPositional(voice, true);
+            pool.SetPosition(voice, float3(0.f, distances[i], 0.f));
+            pool.SetRange(voice, 1.f, 11.f, 2.f);
+            pool.SetGain(voice, 0.5f);
+            voices.push_back(voice);
+        }
+        int nonPositional = pool.CreateVoice();
+        pool.SetPosition(nonPositional, float3(0.f, 0.f, 1000.f));
+        pool.SetRange(nonPositional, 1.f, 11.f, 2.f);
+        pool.SetGain(nonPositional, 0.5f);
+        int unlimited = pool.CreateVoice();
+        pool.SetPositional(unlimited, true);
+        pool.SetPosition(unlimited, float3(0.f, 0.f, 1000.f));
+        pool.SetRange(unlimited, 1.f, 0.f, 2.f);
+
+        pool.Update(float3::zero);
+
+        // Same as the attenuation the sound channels calculated each for itself.
+        for(size_t i = 0; i < voices.size(); ++i)
+        {
+            float expected = 1.f;
+            if (distances[i] >= 11.f)
+                expected = 0.f;
+            else if (distances[i] > 1.f)
+                expected = std::pow(1.f - (distances[i] - 1.f) / 10.f, 2.f);
+            QVERIFY(std::fabs(pool.AttenuatedGain(voices[i]) - 0.5f * expected) < 1e-5f);
+        }
+        QCOMPARE(pool.AttenuatedGain(nonPositional), 0.5f);
+        QCOMPARE(pool.AttenuatedGain(unlimited), 1.f);
+
+        // Nothing is playing, so nothing needs a source.
+        for(size_t i = 0; i < voices.size(); ++i)
+            QVERIFY(!pool.ShouldHaveSource(voices[i]));
+        QCOMPARE(pool.Stats().voices, (int)voices.size() + 2);
+        QCOMPARE(pool.Stats().virtualVoices, 0);
+    }
+
+    void SoundSourcePool::Virtualization()
+    {
+        NullSoundBackend backend(4);
+        ::SoundSourcePool pool(&backend, 4);
+        std::vector<int> voices = CreateVoiceRow(pool, 10);
+
+        // The nearest voices play through a source, the rest are virtual.
+        pool.Update(float3::zero);
+        AssignSources(pool, voices);
+        for(int i = 0; i < 10; ++i)
+            QCOMPARE(pool.Source(voices[i]) != 0, i < 4);
+        SoundVoiceStats stats = pool.Stats();
+        QCOMPARE(stats.activeVoices, 4);
+        QCOMPARE(stats.virtualVoices, 6);
+        QCOMPARE(stats.sources, 4);
+
+        // When the listener moves to the other end, the sources move over to the voices there without creating new ones.
+        pool.Update(float3(11.f, 0.f, 0.f));
+        AssignSources(pool, voices);
+        for(int i = 0; i < 10; ++i)
+            QCOMPARE(pool.Source(voices[i]) != 0, i >= 6);
+        QCOMPARE(backend.NumCreatedSources(), 4);
+        QCOMPARE(backend.NumSources(), 4);
+
+        // Voices beyond their outer radius are virtual even if there are free sources.
+        for(int i = 0; i < 10; ++i)
+            pool.SetRange(voices[i], 0.f, 3.5f, 1.f);
+        pool.Update(float3(11.f, 0.f, 0.f));
+        AssignSources(pool, voices);
+        stats = pool.Stats();
+        QCOMPARE(stats.activeVoices, 3);
+        QCOMPARE(stats.virtualVoices, 7);
+        QCOMPARE(stats.sources, 4);
+
+        // Stopped voices are neither active nor virtual, and destroyed voices free their sources for reuse.
+        pool.SetPlaying(voices[0], false);
+        for(int i = 7; i < 10; ++i)
+            pool.DestroyVoice(voices[i]);
+        stats = pool.Stats();
+        QCOMPARE(stats.voices, 7);
+        QCOMPARE(stats.activeVoices, 0);
+        QCOMPARE(stats.virtualVoices, 6);
+        QCOMPARE(pool.CreateVoice(), voices[9]);
+    }
+
+    void SoundSourcePool::Priority()
+    {
+        NullSoundBackend backend(1);
+        ::SoundSourcePool pool(&backend, 1);
+        std::vector<int> voices = CreateVoiceRow(pool, 2);
+        pool.SetPosition(voices[1], float3(1.f, 0.f, 0.f));
+
+        // Of two equally loud voices, the one with the higher priority gets the source.
+        pool.SetPriority(voices[1], 2.f);
+        pool.Update(float3::zero);
+        AssignSources(pool, voices);
+        QVERIFY(!pool.Source(voices[0]));
+        QVERIFY(pool.Source(voices[1]));
+
+        // A voice keeps its source against a slightly louder one, so that they do not trade it every update.
+        pool.SetPriority(voices[1], 1.f);
+        pool.SetGain(voices[1], 0.9f);
+        pool.Update(float3::zero);
+        AssignSources(pool, voices);
+        QVERIFY(pool.Source(voices[1]));
+        pool.SetGain(voices[1], 0.5f);
+        pool.Update(float3::zero);
+        AssignSources(pool, voices);
+        QVERIFY(pool.Source(voices[0]));
+        QVERIFY(!pool.Source(voices[1]));
+        QCOMPARE(backend.NumCreatedSources(), 1);
+    }
+
+    void SoundSourcePool::MaxSources()
+    {
+        NullSoundBackend backend(16);
+        ::SoundSourcePool pool(&backend, 8);
+        std::vector<int> voices = CreateVoiceRow(pool, 8);
+        pool.Update(float3::zero);
+        AssignSources(pool, voices);
+        QCOMPARE(pool.Stats().activeVoices, 8);
+
+        // Lowering the limit virtualizes the surplus voices on the next update, and deletes their sources.
+        pool.SetMaxSources(3);
+        QCOMPARE(backend.NumSources(), 8);
+        pool.Update(float3::zero);
+        AssignSources(pool, voices);
+        QCOMPARE(pool.Stats().activeVoices, 3);
+        QCOMPARE(pool.Stats().virtualVoices, 5);
+        QCOMPARE(backend.NumSources(), 3);
+
+        // A device with fewer sources than the limit caps the pool to the sources it could create.
+        NullSoundBackend smallBackend(2);
+        ::SoundSourcePool smallPool(&smallBackend, 8);
+        voices = CreateVoiceRow(smallPool, 4);
+        smallPool.Update(float3::zero);
+        AssignSources(smallPool, voices);
+        QCOMPARE(smallPool.MaxSources(), 2);
+        QCOMPARE(smallPool.Stats().activeVoices, 2);
+        smallPool.Update(float3::zero);
+        AssignSources(smallPool, voices);
+        QCOMPARE(smallPool.Stats().activeVoices, 2);
+        QCOMPARE(smallPool.Stats().virtualVoices, 2);
+    }
+
+    void SoundSourcePool::Channel_VirtualPlayback()
+    {
+        NullSoundBackend backend(1);
+        SoundSourcePoolPtr pool = MAKE_SHARED(::SoundSourcePool, &backend, 1);
+        AssetAPI *assetAPI = test_.framework->Asset();
+        AudioAssetPtr speech = MAKE_SHARED(NullAudioAsset, assetAPI, "speech.wav", 101, 10.f);
+        AudioAssetPtr effect = MAKE_SHARED(NullAudioAsset, assetAPI, "effect.wav", 102, 1.f);
+
+        // The voice chat takes the only source, so the two quieter effects play virtually.
+        SoundChannel voice(1, SoundChannel::Voice, pool);
+        SoundChannel once(2, SoundChannel::Triggered, pool);
+        SoundChannel looped(3, SoundChannel::Triggered, pool);
+        once.SetGain(0.5f);
+        looped.SetGain(0.5f);
+        looped.SetLooped(true);
+        voice.Play(speech);
+        once.Play(effect);
+        looped.Play(effect);
+        std::vector<SoundChannel*> channels;
+        channels.push_back(&voice);
+        channels.push_back(&once);
+        channels.push_back(&looped);
+
+        UpdateChannels(*pool, channels, 0.25);
+        QVERIFY(!voice.IsVirtual());
+        QVERIFY(once.IsVirtual());
+        QVERIFY(looped.IsVirtual());
+        QCOMPARE(once.State(), SoundChannel::Playing);
+        QCOMPARE(pool->Stats().virtualVoices, 2);
+        QCOMPARE(backend.NumCreatedSources(), 1);
+
+        // Past the end of the sound, the channel that does not loop stops and the looped one wraps around.
+        UpdateChannels(*pool, channels, 0.5);
+        QCOMPARE(once.State(), SoundChannel::Playing);
+        UpdateChannels(*pool, channels, 0.5);
+        QCOMPARE(once.State(), SoundChannel::Stopped);
+        QCOMPARE(once.SoundName(), EmptyQString);
+        QCOMPARE(looped.State(), SoundChannel::Playing);
+        QVERIFY(looped.IsVirtual());
+        QCOMPARE(looped.SoundName(), QString("effect.wav"));
+        QCOMPARE(pool->Stats().virtualVoices, 1);
+    }
+
+    void SoundSourcePool::Channel_Resume()
+    {
+        NullSoundBackend backend(1);
+        SoundSourcePoolPtr pool = MAKE_SHARED(::SoundSourcePool, &backend, 1);
+        AssetAPI *assetAPI = test_.framework->Asset();
+        AudioAssetPtr speech = MAKE_SHARED(NullAudioAsset, assetAPI, "speech.wav", 101, 10.f);
+        AudioAssetPtr music = MAKE_SHARED(NullAudioAsset, assetAPI, "music.ogg", 102, 4.f);
+
+        SoundChannel voice(1, SoundChannel::Voice, pool);
+        SoundChannel ambient(2, SoundChannel::Ambient, pool);
+        ambient.SetGain(0.5f);
+        ambient.SetPitch(2.f);
+        voice.Play(speech);
+        ambient.Play(music);
+        std::vector<SoundChannel*> channels;
+        channels.push_back(&voice);
+        channels.push_back(&ambient);
+
+        // The virtual channel keeps the playback position at its pitch.
+        UpdateChannels(*pool, channels, 0.25);
+        UpdateChannels(*pool, channels, 0.5);
+        QVERIFY(ambient.IsVirtual());
+
+        // When the source is free, the channel takes it and continues from the same position.
+        voice.Stop();
+        UpdateChannels(*pool, channels, 0.5);
+        QVERIFY(!ambient.IsVirtual());
+        QCOMPARE(backend.NumCreatedSources(), 1);
+        // The null backend numbers its sources from 1.
+        const NullSoundBackend::NullSource *source = backend.Source(1);
+        QVERIFY(source);
+        QCOMPARE(source->queue.size(), (size_t)1);
+        QCOMPARE(source->queue[0], (ALuint)102);
+        QCOMPARE(source->offset, 1.5f);
+        QVERIFY(source->playing);
+        QCOMPARE(source->pitch, 2.f);
+        QCOMPARE(source->gain, 0.5f);
+        QCOMPARE(pool->Stats().activeVoices, 1);
+        QCOMPARE(pool->Stats().virtualVoices, 0);
+    }
+
+    void SoundSourcePool::Channel_Preemption()
+    {
+        NullSoundBackend backend(1);
+        SoundSourcePoolPtr pool = MAKE_SHARED(::SoundSourcePool, &backend, 1);
+        AssetAPI *assetAPI = test_.framework->Asset();
+        AudioAssetPtr speech = MAKE_SHARED(NullAudioAsset, assetAPI, "speech.wav", 101, 10.f);
+        AudioAssetPtr music = MAKE_SHARED(NullAudioAsset, assetAPI, "music.ogg", 102, 4.f);
+
+        SoundChannel voice(1, SoundChannel::Voice, pool);
+        SoundChannel ambient(2, SoundChannel::Ambient, pool);
+        ambient.SetGain(0.5f);
+        ambient.Play(music);
+        std::vector<SoundChannel*> channels;
+        channels.push_back(&voice);
+        channels.push_back(&ambient);
+
+        UpdateChannels(*pool, channels, 0.25);
+        QVERIFY(!ambient.IsVirtual());
+        const NullSoundBackend::NullSource *source = backend.Source(1);
+        QVERIFY(source);
+        QVERIFY(source->playing);
+
+        // The null backend does not advance by itself, so move the source as if it had played for a while.
+        backend.SetOffset(1, 0.75f);
+
+        // The louder voice chat takes the source. The ambient channel gives it up first,
+        // continuing virtually from where the source was, and the source only plays the speech after that.
+        voice.Play(speech);
+        UpdateChannels(*pool, channels, 0.25);
+        QVERIFY(ambient.IsVirtual());
+        QVERIFY(!voice.IsVirtual());
+        QCOMPARE(ambient.State(), SoundChannel::Playing);
+        QCOMPARE(source->queue.size(), (size_t)1);
+        QCOMPARE(source->queue[0], (ALuint)101);
+        QCOMPARE(source->offset, 0.f);
+        QCOMPARE(backend.NumCreatedSources(), 1);
+
+        // The position advanced by the virtual update is where the channel resumes when it gets the source back.
+        voice.Stop();
+        UpdateChannels(*pool, channels, 0.25);
+        QVERIFY(!ambient.IsVirtual());
+        QCOMPARE(source->queue.size(), (size_t)1);
+        QCOMPARE(source->queue[0], (ALuint)102);
+        QCOMPARE(source->offset, 1.f);
+        QVERIFY(source->playing);
+    }
+}
+
+// QTest entry point
+QTEST_APPLESS_MAIN(TundraTest::SoundSourcePool);
@@ -0,0 +1,28 @@
+
+#pragma once
+
+#include "TestHelpers.h"
+
+namespace TundraTest
+{
+    /// Source pooling and voice virtualization of SoundSourcePool and SoundChannel, run with the null sound backend.
+    class SoundSourcePool : public QObject
+    {
+        Q_OBJECT
+
+    private slots:
+        void initTestCase();     // QTest
+
+        void Attenuation();
+        void Virtualization();
+        void Priority();
+        void MaxSources();
+
+        void Channel_VirtualPlayback();
+        void Channel_Resume();
+        void Channel_Preemption();
+
+    private:
+        TestFramework test_;
+    };
+}
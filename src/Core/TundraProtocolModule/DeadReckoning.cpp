@@ -0,0 +1,64 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "DeadReckoning.h"
+#include "Math/MathFunc.h"
+
+#include "MemoryLeakCheck.h"
+
+namespace TundraLogic
+{
+
+namespace
+{
+    /// Differences smaller than this are below the precision of the transform encoding of the rigid body update message.
+    const float cEncodingPrecision = 1e-3f;
+}
+
+float3 DeadReckoning::PredictPosition(const float3 &sentPos, const float3 &sentVelocity, bool extrapolates, float timeSinceSend)
+{
+    return extrapolates ? sentPos + sentVelocity * timeSinceSend : sentPos;
+}
+
+float DeadReckoning::ToleranceScale(float distanceToCamera) const
+{
+    return Clamp(1.f + settings_.distanceScale * distanceToCamera, 1.f, Max(1.f, settings_.maxToleranceScale));
+}
+
+int DeadReckoning::Evaluate(const Transform &current, const Transform &sent, const float3 &sentVelocity, bool extrapolates, float timeSinceSend, float toleranceScale) const
+{
+    const float3 predictedPos = PredictPosition(sent.pos, sentVelocity, extrapolates, timeSinceSend);
+    const float posError = current.pos.Distance(predictedPos);
+    const float rotError = current.rot.Distance(sent.rot);
+    const float scaleError = current.scale.Distance(sent.scale);
+
+    int flags = SendNothing;
+    if (posError > settings_.positionTolerance * toleranceScale)
+        flags |= SendPosition;
+    if (rotError > settings_.rotationTolerance * toleranceScale)
+        flags |= SendRotation;
+    if (scaleError > settings_.scaleTolerance * toleranceScale)
+        flags |= SendScale;
+
+    // Keep-alive: correct any error that has stayed within the tolerances for too long.
+    if (timeSinceSend >= settings_.keepAliveInterval)
+    {
+        if (posError > cEncodingPrecision)
+            flags |= SendPosition;
+        if (rotError > cEncodingPrecision)
+            flags |= SendRotation;
+        if (scaleError > cEncodingPrecision)
+            flags |= SendScale;
+    }
+    return flags;
+}
+
+bool DeadReckoning::HasError(const Transform &current, const Transform &sent, const float3 &sentVelocity, bool extrapolates, float timeSinceSend)
+{
+    return current.pos.Distance(PredictPosition(sent.pos, sentVelocity, extrapolates, timeSinceSend)) > cEncodingPrecision ||
+        current.rot.Distance(sent.rot) > cEncodingPrecision || current.scale.Distance(sent.scale) > cEncodingPrecision;
+}
+
+}
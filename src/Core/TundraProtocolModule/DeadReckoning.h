@@ -0,0 +1,88 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraProtocolModuleApi.h"
+#include "Transform.h"
+#include "Math/float3.h"
+
+namespace TundraLogic
+{
+
+/// Tolerances of the dead reckoning transform send policy.
+struct DeadReckoningSettings
+{
+    DeadReckoningSettings() :
+        positionTolerance(0.03f),
+        rotationTolerance(0.3f),
+        scaleTolerance(0.03f),
+        distanceScale(0.02f),
+        maxToleranceScale(10.f),
+        keepAliveInterval(1.f)
+    {
+    }
+
+    /// Largest allowed distance between the server-side position and the position predicted by the client, in meters.
+    float positionTolerance;
+    /// Largest allowed difference between the server-side and the client-side Euler rotations, in degrees.
+    float rotationTolerance;
+    /// Largest allowed difference between the server-side and the client-side scales.
+    float scaleTolerance;
+    /// The tolerances grow by this fraction per each meter between the entity and the camera of the client. 0 disables the scaling.
+    float distanceScale;
+    /// The tolerances are scaled by at most this factor, however far the entity is.
+    float maxToleranceScale;
+    /// A transform that the client has not received exactly is sent at least this often, in seconds, even if it is within the tolerances.
+    float keepAliveInterval;
+};
+
+/// Decides when the transform of a replicated entity needs to be sent to a client.
+/** The server models what each client shows for an entity: clients extrapolate the last received position linearly with the last
+    received velocity if the entity has a simulated rigid body, and keep it in place otherwise. A part of the transform is only sent
+    when the client-side prediction of it has drifted further from the server-side value than the tolerance. The tolerances can grow with
+    the distance of the entity from the camera of the client, and any remaining error is corrected by a keep-alive update.
+
+    Used by SyncManager. Does not depend on the network or the scene, so it can be evaluated on recorded or simulated motion. */
+class TUNDRAPROTOCOL_MODULE_API DeadReckoning
+{
+public:
+    /// Parts of the transform to send, returned by Evaluate.
+    enum SendFlags
+    {
+        SendNothing = 0,
+        SendPosition = 1,
+        SendRotation = 2,
+        SendScale = 4
+    };
+
+    explicit DeadReckoning(const DeadReckoningSettings &settings = DeadReckoningSettings()) : settings_(settings) {}
+
+    const DeadReckoningSettings &Settings() const { return settings_; }
+    void SetSettings(const DeadReckoningSettings &settings) { settings_ = settings; }
+
+    /// Returns the position a client predicts for an entity.
+    /** @param sentPos The position last sent to the client.
+        @param sentVelocity The linear velocity last sent to the client.
+        @param extrapolates Whether the client extrapolates the entity, i.e. whether the entity has a simulated rigid body.
+        @param timeSinceSend Seconds since the last update of the entity was sent to the client. */
+    static float3 PredictPosition(const float3 &sentPos, const float3 &sentVelocity, bool extrapolates, float timeSinceSend);
+
+    /// Returns the factor by which the tolerances are scaled for an entity at the given distance from the camera of the client.
+    float ToleranceScale(float distanceToCamera) const;
+
+    /// Returns the parts of the transform that need to be sent, as a combination of SendFlags.
+    /** @param current The current server-side transform.
+        @param sent The transform last sent to the client.
+        @param toleranceScale Factor for the tolerances, see ToleranceScale.
+        @see PredictPosition for the rest of the parameters. */
+    int Evaluate(const Transform &current, const Transform &sent, const float3 &sentVelocity, bool extrapolates, float timeSinceSend, float toleranceScale = 1.f) const;
+
+    /// Returns true if the client-side prediction of the transform differs from the current transform at all, i.e. more than the
+    /// precision of the network encoding. Such transforms are eventually sent by the keep-alive.
+    static bool HasError(const Transform &current, const Transform &sent, const float3 &sentVelocity, bool extrapolates, float timeSinceSend);
+
+private:
+    DeadReckoningSettings settings_;
+};
+
+}
@@ -0,0 +1,102 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "SendRate.h"
+#include "Math/MathFunc.h"
+
+#include "MemoryLeakCheck.h"
+
+namespace TundraLogic
+{
+
+namespace
+{
+    /// Fraction of the difference by which a round trip time above the lowest one raises the lowest one, per update.
+    /** Lets the comparison follow a lasting change of the route, so that the connection does not stay throttled for good. */
+    const float cBaseRttSlewRate = 0.002f;
+}
+
+const char *SendRate::ReasonName(Reason reason)
+{
+    switch(reason)
+    {
+    case Steady: return "steady";
+    case Loss: return "loss";
+    case Queue: return "queue";
+    case Latency: return "latency";
+    case Recovered: return "recovered";
+    default: return "unknown";
+    }
+}
+
+void SendRate::Reset(u32 interval)
+{
+    interval_ = Max(interval, 1u);
+    nextSendTick_ = 0;
+    reason_ = Steady;
+    stats_ = LinkStats();
+    baseRtt_ = 0.f;
+    lastChangeTime_ = 0.0;
+    lastCongestionTime_ = 0.0;
+    started_ = false;
+}
+
+bool SendRate::Update(const SendRateSettings &settings, f64 time, const LinkStats &stats)
+{
+    const u32 minInterval = Max(settings.minInterval, 1u);
+    const u32 maxInterval = Max(settings.maxInterval, minInterval);
+    const u32 previous = interval_;
+    interval_ = Clamp(interval_, minInterval, maxInterval);
+
+    if (!started_)
+    {
+        lastChangeTime_ = time;
+        lastCongestionTime_ = time;
+        started_ = true;
+    }
+
+    stats_ = stats;
+    if (stats.roundTripTime > 0.f)
+    {
+        if (baseRtt_ <= 0.f || stats.roundTripTime < baseRtt_)
+            baseRtt_ = stats.roundTripTime;
+        else
+            baseRtt_ += (stats.roundTripTime - baseRtt_) * cBaseRttSlewRate;
+    }
+
+    Reason congestion = Steady;
+    if (stats.packetLoss > settings.lossThreshold)
+        congestion = Loss;
+    else if (stats.outboundQueue > settings.queueThreshold)
+        congestion = Queue;
+    else if (baseRtt_ > 0.f && stats.roundTripTime - baseRtt_ > settings.latencyThreshold)
+        congestion = Latency;
+
+    if (congestion != Steady)
+    {
+        reason_ = congestion;
+        lastCongestionTime_ = time;
+        if (interval_ < maxInterval && time - lastChangeTime_ >= settings.backoffHoldTime)
+        {
+            interval_ = Min(interval_ * 2, maxInterval);
+            lastChangeTime_ = time;
+        }
+    }
+    else if (interval_ > minInterval)
+    {
+        if (time - lastCongestionTime_ >= settings.recoveryTime && time - lastChangeTime_ >= settings.recoveryTime)
+        {
+            --interval_;
+            lastChangeTime_ = time;
+            reason_ = Recovered;
+        }
+    }
+    else
+        reason_ = Steady;
+
+    return interval_ != previous;
+}
+
+}
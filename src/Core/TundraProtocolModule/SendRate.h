@@ -0,0 +1,140 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraProtocolModuleApi.h"
+#include "CoreTypes.h"
+
+namespace TundraLogic
+{
+
+/// Limits and thresholds of the per-connection send rate policy.
+struct SendRateSettings
+{
+    SendRateSettings() :
+        minInterval(1),
+        maxInterval(6),
+        lossThreshold(0.05f),
+        queueThreshold(64),
+        latencyThreshold(0.1f),
+        backoffHoldTime(0.5f),
+        recoveryTime(2.f)
+    {
+    }
+
+    /// Fewest server ticks between two updates sent to a connection.
+    u32 minInterval;
+    /// Most server ticks between two updates sent to a connection.
+    u32 maxInterval;
+    /// Packet loss rate [0,1] above which the link is considered congested.
+    float lossThreshold;
+    /// Number of messages waiting in the outbound queue of the connection above which the link is considered congested.
+    u32 queueThreshold;
+    /// Round trip time above the lowest measured one, in seconds, above which the link is considered congested.
+    float latencyThreshold;
+    /// After the interval has grown, it is not grown again for this many seconds, so that the link has time to react.
+    float backoffHoldTime;
+    /// The link has to stay clear for this many seconds before the interval is shortened by one tick.
+    float recoveryTime;
+};
+
+/// Measured state of the link to a client, as given by the networking implementation.
+struct LinkStats
+{
+    LinkStats() : roundTripTime(0.f), packetLoss(0.f), outboundQueue(0) {}
+
+    /// Round trip time in seconds, 0 if not measured yet.
+    float roundTripTime;
+    /// Rate of lost packets [0,1].
+    float packetLoss;
+    /// Number of messages queued for sending but not sent yet.
+    u32 outboundQueue;
+};
+
+/// Decides how many server ticks apart the updates are sent to a client connection.
+/** The server ticks at a fixed rate, and each connection is sent its updates only every Interval() ticks. The interval adapts to the
+    link with additive increase, multiplicative decrease of the send rate: it is doubled when the link shows congestion, i.e. packet
+    loss, a growing outbound queue or a round trip time grown above the lowest one measured, and shortened by one tick after the link
+    has stayed clear for a while. The reason of the latest decision is kept for the statistics.
+
+    Used by SyncManager. Does not depend on the network, so it can be evaluated on recorded or simulated link conditions. */
+class TUNDRAPROTOCOL_MODULE_API SendRate
+{
+public:
+    /// Why the interval has its current value, see LastReason.
+    enum Reason
+    {
+        Steady = 0, ///< The interval is at the minimum and the link is clear.
+        Loss, ///< The link was last congested because of packet loss, and the interval has not recovered yet.
+        Queue, ///< The link was last congested because of the outbound queue, and the interval has not recovered yet.
+        Latency, ///< The link was last congested because of the round trip time, and the interval has not recovered yet.
+        Recovered, ///< The interval was last shortened after the link stayed clear.
+        NumReasons
+    };
+
+    /// Returns the name of a reason, for the statistics.
+    static const char *ReasonName(Reason reason);
+
+    SendRate() { Reset(1); }
+
+    /// Starts over from the given interval, e.g. for a new connection.
+    void Reset(u32 interval);
+
+    /// Updates the interval with the link state measured at the given time in seconds.
+    /** @return True if the interval changed. */
+    bool Update(const SendRateSettings &settings, f64 time, const LinkStats &stats);
+
+    /// Returns true if an update is due to the connection on the given server tick.
+    bool IsDue(u32 tick) const { return tick >= nextSendTick_; }
+    /// Marks that an update was sent on the given server tick. The next one is due Interval() ticks later.
+    void Sent(u32 tick) { nextSendTick_ = tick + interval_; }
+
+    /// Returns the number of server ticks between the updates.
+    u32 Interval() const { return interval_; }
+    /// Returns the reason of the latest decision.
+    Reason LastReason() const { return reason_; }
+    /// Returns the link state of the latest decision.
+    const LinkStats &LastStats() const { return stats_; }
+    /// Returns the lowest round trip time measured, which the latency is compared to, or 0 if none.
+    float BaseRoundTripTime() const { return baseRtt_; }
+
+private:
+    u32 interval_;
+    u32 nextSendTick_;
+    Reason reason_;
+    LinkStats stats_;
+    float baseRtt_;
+    /// Time the interval was last grown or shortened.
+    f64 lastChangeTime_;
+    /// Time the link was last seen congested.
+    f64 lastCongestionTime_;
+    bool started_;
+};
+
+/// Send rate statistics of all the client connections on a server tick, see SyncManager::SendRateMetrics.
+struct SendRateTickMetrics
+{
+    SendRateTickMetrics() : tick(0), connections(0), sent(0), skipped(0), changed(0), minInterval(0), maxInterval(0), meanInterval(0.f)
+    {
+        for(int i = 0; i < SendRate::NumReasons; ++i)
+            reasons[i] = 0;
+    }
+
+    /// The server tick.
+    u32 tick;
+    /// Number of connections with an adaptive send rate.
+    u32 connections;
+    /// Number of connections that were sent an update on the tick.
+    u32 sent;
+    /// Number of connections whose update was not due on the tick.
+    u32 skipped;
+    /// Number of connections whose interval changed on the tick.
+    u32 changed;
+    /// Number of connections per the reason of their latest decision.
+    u32 reasons[SendRate::NumReasons];
+    u32 minInterval;
+    u32 maxInterval;
+    float meanInterval;
+};
+
+}
@@ -0,0 +1,377 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "SnapshotDelta.h"
+#include "Math/MathFunc.h"
+
+#include <kNet/DataSerializer.h>
+#include <kNet/DataDeserializer.h>
+
+#include "MemoryLeakCheck.h"
+
+namespace TundraLogic
+{
+
+namespace
+{
+    /// Quantization steps of the parts of RigidBodySnapshot: millimeters, 1/256 degrees, 1/1024 of scale, mm/s and 1/16 degrees/s.
+    const float cQuantizationSteps[RigidBodySnapshot::NumParts] = { 1.f / 1024.f, 1.f / 256.f, 1.f / 1024.f, 1.f / 1024.f, 1.f / 16.f };
+
+    /// Baselines older than this many snapshots are not used, the entity is sent against the zero state instead.
+    /** The client keeps at least this many states per entity, see cMaxStatesPerEntity. */
+    const u32 cMaxBaselineAge = 32;
+
+    /// Number of sent snapshots remembered for acknowledgements.
+    const size_t cMaxSentSnapshots = 64;
+
+    /// Number of received states the client keeps per entity.
+    const size_t cMaxStatesPerEntity = cMaxBaselineAge + 8;
+
+    /// Deltas below this are sent as variable-length integers, larger ones in full 32 bits.
+    const u32 cMaxVLEValue = 1 << 30;
+
+    s32 Quantize(float value, float step)
+    {
+        const float q = value / step;
+        if (!(q > -2147483520.f)) // Also catches NaNs.
+            return q == q ? -2147483647 : 0;
+        if (q > 2147483520.f)
+            return 2147483647;
+        return (s32)floor(q + 0.5f);
+    }
+
+    void WriteDelta(kNet::DataSerializer &ds, s32 delta)
+    {
+        // Zigzag encoding keeps small negative deltas small.
+        const u32 zigzag = ((u32)delta << 1) ^ (u32)(delta >> 31);
+        if (zigzag < cMaxVLEValue)
+        {
+            ds.Add<kNet::bit>(1);
+            ds.AddVLE<kNet::VLE8_16_32>(zigzag);
+        }
+        else
+        {
+            ds.Add<kNet::bit>(0);
+            ds.Add<u32>(zigzag);
+        }
+    }
+
+    s32 ReadDelta(kNet::DataDeserializer &dd)
+    {
+        const u32 zigzag = dd.Read<kNet::bit>() ? dd.ReadVLE<kNet::VLE8_16_32>() : dd.Read<u32>();
+        return (s32)(zigzag >> 1) ^ -(s32)(zigzag & 1);
+    }
+}
+
+RigidBodySnapshot::RigidBodySnapshot()
+{
+    for(int i = 0; i < NumParts; ++i)
+        values[i][0] = values[i][1] = values[i][2] = 0;
+}
+
+RigidBodySnapshot RigidBodySnapshot::FromState(const Transform &transform, const float3 &linearVelocity, const float3 &angularVelocity)
+{
+    const float3 parts[NumParts] = { transform.pos, transform.rot, transform.scale, linearVelocity, angularVelocity };
+    RigidBodySnapshot snapshot;
+    for(int i = 0; i < NumParts; ++i)
+        for(int j = 0; j < 3; ++j)
+            snapshot.values[i][j] = Quantize(parts[i][j], cQuantizationSteps[i]);
+    return snapshot;
+}
+
+Transform RigidBodySnapshot::ToTransform() const
+{
+    Transform t;
+    for(int j = 0; j < 3; ++j)
+    {
+        t.pos[j] = values[Position][j] * cQuantizationSteps[Position];
+        t.rot[j] = values[Rotation][j] * cQuantizationSteps[Rotation];
+        t.scale[j] = values[Scale][j] * cQuantizationSteps[Scale];
+    }
+    return t;
+}
+
+float3 RigidBodySnapshot::ToLinearVelocity() const
+{
+    return float3((float)values[LinearVelocity][0], (float)values[LinearVelocity][1], (float)values[LinearVelocity][2]) * cQuantizationSteps[LinearVelocity];
+}
+
+float3 RigidBodySnapshot::ToAngularVelocity() const
+{
+    return float3((float)values[AngularVelocity][0], (float)values[AngularVelocity][1], (float)values[AngularVelocity][2]) * cQuantizationSteps[AngularVelocity];
+}
+
+int RigidBodySnapshot::DifferingParts(const RigidBodySnapshot &other) const
+{
+    int parts = 0;
+    for(int i = 0; i < NumParts; ++i)
+        if (values[i][0] != other.values[i][0] || values[i][1] != other.values[i][1] || values[i][2] != other.values[i][2])
+            parts |= 1 << i;
+    return parts;
+}
+
+SnapshotBaselines::SnapshotBaselines() :
+    sequence_(0)
+{
+}
+
+u32 SnapshotBaselines::BeginSnapshot(kNet::DataSerializer &ds)
+{
+    SentSnapshot snapshot;
+    snapshot.sequence = ++sequence_;
+    sent_.push_back(snapshot);
+    if (sent_.size() > cMaxSentSnapshots)
+        sent_.pop_front();
+
+    ds.Add<u32>(sequence_);
+    return sequence_;
+}
+
+bool SnapshotBaselines::Write(kNet::DataSerializer &ds, entity_id_t id, const RigidBodySnapshot &state)
+{
+    // Without a usable baseline, the entity is sent against the zero state.
+    static const RigidBodySnapshot zero;
+    const RigidBodySnapshot *base = &zero;
+    u32 baseAge = 0;
+    std::map<entity_id_t, Baseline>::const_iterator baseline = acknowledged_.find(id);
+    if (baseline != acknowledged_.end())
+    {
+        if (baseline->second.state == state)
+        {
+            unacknowledged_.erase(id);
+            latestSent_.erase(id);
+            return false;
+        }
+        if (sequence_ - baseline->second.sequence <= cMaxBaselineAge)
+        {
+            base = &baseline->second.state;
+            baseAge = sequence_ - baseline->second.sequence;
+        }
+    }
+
+    const int parts = state.DifferingParts(*base);
+    ds.AddVLE<kNet::VLE8_16_32>(id);
+    ds.AddVLE<kNet::VLE8_16_32>(baseAge);
+    ds.AppendBits(parts, RigidBodySnapshot::NumParts);
+    for(int i = 0; i < RigidBodySnapshot::NumParts; ++i)
+        if (parts & (1 << i))
+            for(int j = 0; j < 3; ++j)
+                WriteDelta(ds, (s32)((u32)state.values[i][j] - (u32)base->values[i][j]));
+
+    if (!sent_.empty())
+        sent_.back().entities.push_back(std::make_pair(id, state));
+    latestSent_[id] = state;
+    unacknowledged_.insert(id);
+    return true;
+}
+
+size_t SnapshotBaselines::EndSnapshot()
+{
+    if (sent_.empty())
+        return 0;
+    const size_t numEntities = sent_.back().entities.size();
+    if (numEntities == 0)
+    {
+        // Nothing to send. Reuse the sequence number.
+        sent_.pop_back();
+        --sequence_;
+    }
+    return numEntities;
+}
+
+SnapshotBaselines::SentSnapshot *SnapshotBaselines::FindSent(u32 sequence)
+{
+    for(std::deque<SentSnapshot>::iterator snapshot = sent_.begin(); snapshot != sent_.end(); ++snapshot)
+        if (snapshot->sequence == sequence)
+            return &*snapshot;
+    return 0;
+}
+
+void SnapshotBaselines::AcknowledgeEntity(u32 sequence, entity_id_t id, const RigidBodySnapshot &state)
+{
+    std::map<entity_id_t, Baseline>::iterator existing = acknowledged_.find(id);
+    if (existing != acknowledged_.end() && existing->second.sequence >= sequence)
+        return; // A newer state has been acknowledged already.
+    Baseline &baseline = acknowledged_[id];
+    baseline.sequence = sequence;
+    baseline.state = state;
+
+    std::map<entity_id_t, RigidBodySnapshot>::iterator latest = latestSent_.find(id);
+    if (latest == latestSent_.end() || latest->second == baseline.state)
+    {
+        unacknowledged_.erase(id);
+        if (latest != latestSent_.end())
+            latestSent_.erase(latest);
+    }
+}
+
+void SnapshotBaselines::Acknowledge(u32 sequence)
+{
+    SentSnapshot *snapshot = FindSent(sequence);
+    if (!snapshot)
+        return; // Too old, or never sent.
+
+    for(size_t i = 0; i < snapshot->entities.size(); ++i)
+        AcknowledgeEntity(sequence, snapshot->entities[i].first, snapshot->entities[i].second);
+}
+
+void SnapshotBaselines::Acknowledge(const SnapshotAck &ack)
+{
+    if (ack.entities.empty())
+    {
+        Acknowledge(ack.sequence);
+        return;
+    }
+
+    SentSnapshot *snapshot = FindSent(ack.sequence);
+    if (!snapshot)
+        return; // Too old, or never sent.
+
+    // The acknowledged entities are in the order they were written, so both lists are walked only once.
+    // The entities left out keep their earlier baselines, and are sent against them, or against the zero state
+    // once they get older than cMaxBaselineAge.
+    size_t i = 0;
+    for(size_t j = 0; j < ack.entities.size(); ++j)
+    {
+        while(i < snapshot->entities.size() && snapshot->entities[i].first != ack.entities[j])
+            ++i;
+        if (i == snapshot->entities.size())
+            return; // Not in the snapshot, or out of order.
+        AcknowledgeEntity(ack.sequence, snapshot->entities[i].first, snapshot->entities[i].second);
+        ++i;
+    }
+}
+
+void SnapshotBaselines::Remove(entity_id_t id)
+{
+    acknowledged_.erase(id);
+    latestSent_.erase(id);
+    unacknowledged_.erase(id);
+}
+
+const RigidBodySnapshot *SnapshotBaselines::AcknowledgedState(entity_id_t id) const
+{
+    std::map<entity_id_t, Baseline>::const_iterator baseline = acknowledged_.find(id);
+    return baseline != acknowledged_.end() ? &baseline->second.state : 0;
+}
+
+u32 SnapshotReceiver::ReadHeader(kNet::DataDeserializer &dd)
+{
+    const u32 sequence = dd.Read<u32>();
+    if (sequence <= latestSequence_)
+        return 0;
+    latestSequence_ = sequence;
+    pendingAcks_.push_back(PendingAck());
+    pendingAcks_.back().ack.sequence = sequence;
+    return sequence;
+}
+
+bool SnapshotReceiver::Read(kNet::DataDeserializer &dd, u32 sequence, entity_id_t &id, RigidBodySnapshot &state, int &changedParts)
+{
+    id = dd.ReadVLE<kNet::VLE8_16_32>();
+    if (!pendingAcks_.empty() && pendingAcks_.back().ack.sequence == sequence)
+        ++pendingAcks_.back().numRead;
+    const u32 baseAge = dd.ReadVLE<kNet::VLE8_16_32>();
+    const int parts = (int)dd.ReadBits(RigidBodySnapshot::NumParts);
+    s32 deltas[RigidBodySnapshot::NumParts][3];
+    for(int i = 0; i < RigidBodySnapshot::NumParts; ++i)
+        for(int j = 0; j < 3; ++j)
+            deltas[i][j] = (parts & (1 << i)) ? ReadDelta(dd) : 0;
+
+    StateHistory &history = received_[id];
+    const RigidBodySnapshot *base = 0;
+    static const RigidBodySnapshot zero;
+    if (baseAge == 0)
+        base = &zero;
+    else
+    {
+        const u32 baseSequence = sequence - baseAge;
+        // The server never goes back to an older baseline, so the states before it can be dropped.
+        while(!history.empty() && history.front().first < baseSequence)
+            history.pop_front();
+        if (!history.empty() && history.front().first == baseSequence)
+            base = &history.front().second;
+    }
+    if (!base)
+        return false;
+
+    for(int i = 0; i < RigidBodySnapshot::NumParts; ++i)
+        for(int j = 0; j < 3; ++j)
+            state.values[i][j] = (s32)((u32)base->values[i][j] + (u32)deltas[i][j]);
+    changedParts = history.empty() ? (1 << RigidBodySnapshot::NumParts) - 1 : state.DifferingParts(history.back().second);
+    return true;
+}
+
+void SnapshotReceiver::Store(u32 sequence, entity_id_t id, const RigidBodySnapshot &state)
+{
+    StateHistory &history = received_[id];
+    if (!history.empty() && history.back().first >= sequence)
+        return; // Out of order, the history is kept sorted by sequence number.
+    history.push_back(std::make_pair(sequence, state));
+    if (history.size() > cMaxStatesPerEntity)
+        history.pop_front();
+
+    if (pendingAcks_.empty() || pendingAcks_.back().ack.sequence != sequence)
+    {
+        pendingAcks_.push_back(PendingAck());
+        pendingAcks_.back().ack.sequence = sequence;
+    }
+    pendingAcks_.back().ack.entities.push_back(id);
+}
+
+bool SnapshotReceiver::WriteAcks(kNet::DataSerializer &ds)
+{
+    // Snapshots none of whose entities were stored are not acknowledged at all.
+    u32 numAcks = 0;
+    for(size_t i = 0; i < pendingAcks_.size(); ++i)
+        if (!pendingAcks_[i].ack.entities.empty())
+            ++numAcks;
+    if (numAcks == 0)
+    {
+        pendingAcks_.clear();
+        return false;
+    }
+
+    // Each acknowledgement is the sequence number and the stored entities, or zero entities if all of them were stored.
+    ds.AddVLE<kNet::VLE8_16_32>(numAcks);
+    for(size_t i = 0; i < pendingAcks_.size(); ++i)
+    {
+        const PendingAck &pending = pendingAcks_[i];
+        if (pending.ack.entities.empty())
+            continue;
+        ds.Add<u32>(pending.ack.sequence);
+        if (pending.ack.entities.size() == pending.numRead)
+            ds.AddVLE<kNet::VLE8_16_32>(0);
+        else
+        {
+            ds.AddVLE<kNet::VLE8_16_32>((u32)pending.ack.entities.size());
+            for(size_t j = 0; j < pending.ack.entities.size(); ++j)
+                ds.AddVLE<kNet::VLE8_16_32>(pending.ack.entities[j]);
+        }
+    }
+    pendingAcks_.clear();
+    return true;
+}
+
+void SnapshotReceiver::ReadAcks(kNet::DataDeserializer &dd, std::vector<SnapshotAck> &acks)
+{
+    const u32 numAcks = dd.ReadVLE<kNet::VLE8_16_32>();
+    for(u32 i = 0; i < numAcks && dd.BytesLeft() >= 5; ++i)
+    {
+        SnapshotAck ack;
+        ack.sequence = dd.Read<u32>();
+        const u32 numEntities = dd.ReadVLE<kNet::VLE8_16_32>();
+        for(u32 j = 0; j < numEntities && dd.BytesLeft() > 0; ++j)
+            ack.entities.push_back(dd.ReadVLE<kNet::VLE8_16_32>());
+        acks.push_back(ack);
+    }
+}
+
+void SnapshotReceiver::Remove(entity_id_t id)
+{
+    received_.erase(id);
+}
+
+}
@@ -0,0 +1,176 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraProtocolModuleApi.h"
+#include "CoreTypes.h"
+#include "Transform.h"
+#include "Math/float3.h"
+
+#include <map>
+#include <set>
+#include <deque>
+#include <vector>
+
+namespace kNet
+{
+    class DataSerializer;
+    class DataDeserializer;
+}
+
+namespace TundraLogic
+{
+
+/// Quantized rigid body state of an entity, as replicated in snapshot mode.
+/** The state is quantized to integers so that the server and the client can compute exactly the same deltas against a baseline. */
+struct TUNDRAPROTOCOL_MODULE_API RigidBodySnapshot
+{
+    /// Parts of the state. Each part has three components.
+    enum Part
+    {
+        Position,
+        Rotation,
+        Scale,
+        LinearVelocity,
+        AngularVelocity,
+        NumParts
+    };
+
+    RigidBodySnapshot();
+
+    /// Quantizes a state. Velocities are in m/s and degrees/s, the rotation is in Euler degrees as in Transform.
+    static RigidBodySnapshot FromState(const Transform &transform, const float3 &linearVelocity, const float3 &angularVelocity);
+
+    Transform ToTransform() const;
+    float3 ToLinearVelocity() const;
+    float3 ToAngularVelocity() const;
+
+    /// Returns a bitmask of the parts (1 << Part) that differ from the other state.
+    int DifferingParts(const RigidBodySnapshot &other) const;
+
+    bool operator ==(const RigidBodySnapshot &rhs) const { return DifferingParts(rhs) == 0; }
+    bool operator !=(const RigidBodySnapshot &rhs) const { return !(*this == rhs); }
+
+    s32 values[NumParts][3];
+};
+
+/// Acknowledgement of the entities of a snapshot that the client reconstructed, see SnapshotReceiver::WriteAcks.
+struct TUNDRAPROTOCOL_MODULE_API SnapshotAck
+{
+    SnapshotAck() : sequence(0) {}
+
+    /// Sequence number of the snapshot.
+    u32 sequence;
+    /// The acknowledged entities, in the order they were in the snapshot. Empty if all of them are acknowledged.
+    std::vector<entity_id_t> entities;
+};
+
+/// Server-side snapshot state of a client: the per-entity baselines the client has acknowledged, and the snapshots sent since.
+/** Each snapshot message carries a sequence number, and each entity in it is sent as a delta against the latest state of the entity
+    that the client has acknowledged. Entities whose state equals the acknowledged one are left out, and entities that have been
+    sent but not acknowledged are sent again in the following snapshots, so snapshots can be sent unreliably. The client acknowledges
+    each entity separately, so an entity it can not reconstruct only falls back to an older baseline, or the zero state, by itself. */
+class TUNDRAPROTOCOL_MODULE_API SnapshotBaselines
+{
+public:
+    SnapshotBaselines();
+
+    /// Starts a new snapshot and writes its header. Returns the sequence number of the snapshot.
+    u32 BeginSnapshot(kNet::DataSerializer &ds);
+
+    /// Writes an entity to the current snapshot, unless its state equals the acknowledged baseline.
+    /** @return True if the entity was written. */
+    bool Write(kNet::DataSerializer &ds, entity_id_t id, const RigidBodySnapshot &state);
+
+    /// Ends the current snapshot. Returns the number of entities written to it.
+    size_t EndSnapshot();
+
+    /// Handles an acknowledgement of all the entities of a snapshot by the client.
+    void Acknowledge(u32 sequence);
+
+    /// Handles an acknowledgement of the entities of a snapshot that the client reconstructed.
+    void Acknowledge(const SnapshotAck &ack);
+
+    /// Forgets the baseline of an entity, e.g. when it is removed from the client.
+    void Remove(entity_id_t id);
+
+    /// Returns the entities sent to the client, whose latest sent state is not acknowledged yet.
+    const std::set<entity_id_t> &Unacknowledged() const { return unacknowledged_; }
+
+    /// Returns the acknowledged baseline of an entity, or null if the client has not acknowledged any state of it.
+    const RigidBodySnapshot *AcknowledgedState(entity_id_t id) const;
+
+private:
+    struct Baseline
+    {
+        u32 sequence;
+        RigidBodySnapshot state;
+    };
+
+    struct SentSnapshot
+    {
+        u32 sequence;
+        std::vector<std::pair<entity_id_t, RigidBodySnapshot> > entities;
+    };
+
+    /// Returns the sent snapshot with the sequence number, or null if it is too old or was never sent.
+    SentSnapshot *FindSent(u32 sequence);
+
+    /// Makes a state sent in a snapshot the baseline of the entity, unless a newer one has been acknowledged already.
+    void AcknowledgeEntity(u32 sequence, entity_id_t id, const RigidBodySnapshot &state);
+
+    std::map<entity_id_t, Baseline> acknowledged_;
+    std::map<entity_id_t, RigidBodySnapshot> latestSent_;
+    std::set<entity_id_t> unacknowledged_;
+    std::deque<SentSnapshot> sent_;
+    u32 sequence_;
+};
+
+/// Client-side snapshot state: the recently received states of each entity, which the server can use as baselines.
+class TUNDRAPROTOCOL_MODULE_API SnapshotReceiver
+{
+public:
+    SnapshotReceiver() : latestSequence_(0) {}
+
+    /// Reads the header of a snapshot. Returns its sequence number, or 0 if the snapshot is older than one read earlier and must be discarded.
+    u32 ReadHeader(kNet::DataDeserializer &dd);
+
+    /// Reads an entity of the snapshot.
+    /** The entity is always consumed from the stream, but its state can only be reconstructed if the baseline it was sent against is known.
+        @param sequence Sequence number of the snapshot.
+        @param id [out] Entity ID.
+        @param state [out] Reconstructed state.
+        @param changedParts [out] Bitmask of the parts that differ from the latest known state of the entity.
+        @return True if the state was reconstructed. */
+    bool Read(kNet::DataDeserializer &dd, u32 sequence, entity_id_t &id, RigidBodySnapshot &state, int &changedParts);
+
+    /// Remembers a state received in a snapshot, so that it can be used as a baseline, and queues its acknowledgement.
+    /** Call for each entity of a snapshot that was reconstructed and applied. The entities that are not stored are not
+        acknowledged, so the server keeps sending them against the earlier baselines. */
+    void Store(u32 sequence, entity_id_t id, const RigidBodySnapshot &state);
+
+    /// Writes the queued acknowledgements. Returns false if there were none.
+    /** A snapshot whose entities were all stored is acknowledged without listing them. */
+    bool WriteAcks(kNet::DataSerializer &ds);
+
+    /// Reads acknowledgements written by WriteAcks.
+    static void ReadAcks(kNet::DataDeserializer &dd, std::vector<SnapshotAck> &acks);
+
+    /// Forgets the states of an entity, e.g. when it is removed.
+    void Remove(entity_id_t id);
+
+private:
+    typedef std::deque<std::pair<u32, RigidBodySnapshot> > StateHistory;
+    std::map<entity_id_t, StateHistory> received_;
+    struct PendingAck
+    {
+        PendingAck() : numRead(0) {}
+        SnapshotAck ack;
+        /// Number of entities read from the snapshot, to tell whether all of them were stored.
+        size_t numRead;
+    };
+    std::vector<PendingAck> pendingAcks_;
+    u32 latestSequence_;
+};
+
+}
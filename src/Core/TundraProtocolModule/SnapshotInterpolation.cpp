@@ -0,0 +1,153 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "SnapshotInterpolation.h"
+#include "Math/MathFunc.h"
+
+#include <cmath>
+
+#include "MemoryLeakCheck.h"
+
+namespace TundraLogic
+{
+
+namespace
+{
+    /// Fraction of the difference by which a message that arrived earlier than expected moves the server clock forward.
+    const f64 cClockAdvanceRate = 0.1;
+
+    /// Fraction of the difference by which a message that arrived later than expected pulls the server clock back.
+    /** Lets the clock follow a lasting increase of the latency, and the drift between the clocks of the server and the client. */
+    const f64 cClockSlewRate = 0.01;
+
+    /// A message this many seconds off the estimate restarts it, e.g. when the server was restarted.
+    const f64 cClockResyncThreshold = 1.0;
+}
+
+float3 HermiteInterpolate(const float3 &pos0, const float3 &vel0, const float3 &pos1, const float3 &vel1, float t)
+{
+    float tt = t*t;
+    float ttt = tt*t;
+    float h1 = 2*ttt - 3*tt + 1;
+    float h2 = 1 - h1;
+    float h3 = ttt - 2*tt + t;
+    float h4 = ttt - tt;
+
+    return h1 * pos0 + h2 * pos1 + h3 * vel0 + h4 * vel1;
+}
+
+float3 HermiteDerivative(const float3 &pos0, const float3 &vel0, const float3 &pos1, const float3 &vel1, float t)
+{
+    float tt = t*t;
+    float h1 = 6*(tt - t);
+    float h2 = -h1;
+    float h3 = 3*tt - 4*t + 1;
+    float h4 = 3*tt - 2*t;
+
+    return h1 * pos0 + h2 * pos1 + h3 * vel0 + h4 * vel1;
+}
+
+void ServerTickClock::SetTickPeriod(float period)
+{
+    tickPeriod_ = period > 0.f ? period : 0.f;
+    offset_ = 0.0;
+    synced_ = false;
+}
+
+void ServerTickClock::Received(u32 tick, f64 localTime)
+{
+    if (tickPeriod_ <= 0.f)
+        return;
+
+    const f64 offset = tick * (f64)tickPeriod_ - localTime;
+    if (!synced_ || std::fabs(offset - offset_) > cClockResyncThreshold)
+    {
+        offset_ = offset;
+        synced_ = true;
+    }
+    else
+        offset_ += (offset - offset_) * (offset > offset_ ? cClockAdvanceRate : cClockSlewRate);
+}
+
+f64 ServerTickClock::Tick(f64 localTime) const
+{
+    if (!synced_)
+        return 0.0;
+    return (localTime + offset_) / tickPeriod_;
+}
+
+bool SnapshotRing::Insert(const TickSample &sample)
+{
+    // Find the position from the newest end, as the states mostly arrive in order.
+    size_t index = size_;
+    while(index > 0 && At(index - 1).tick > sample.tick)
+        --index;
+    if (index > 0 && At(index - 1).tick == sample.tick)
+        return false;
+
+    if (size_ == cCapacity)
+    {
+        if (index == 0)
+            return false;
+        // Drop the oldest state to make room.
+        first_ = (first_ + 1) % cCapacity;
+        --size_;
+        --index;
+    }
+
+    for(size_t i = size_; i > index; --i)
+        samples_[(first_ + i) % cCapacity] = samples_[(first_ + i - 1) % cCapacity];
+    samples_[(first_ + index) % cCapacity] = sample;
+    ++size_;
+    return true;
+}
+
+SnapshotRing::SampleResult SnapshotRing::Sample(f64 renderTick, float tickPeriod, bool extrapolate, float maxExtrapolationTicks, TickSample &result) const
+{
+    assert(size_ > 0);
+    if (size_ == 0)
+        return Expired;
+
+    const TickSample &oldest = At(0);
+    if (renderTick <= (f64)oldest.tick)
+    {
+        result = oldest;
+        return Interpolated;
+    }
+
+    const TickSample &latest = Latest();
+    if (renderTick < (f64)latest.tick)
+    {
+        size_t next = 1;
+        while(At(next).tick <= renderTick)
+            ++next;
+        const TickSample &a = At(next - 1);
+        const TickSample &b = At(next);
+        const float ticks = (float)(b.tick - a.tick);
+        const float t = (float)((renderTick - a.tick) / ticks);
+        const float interval = ticks * tickPeriod;
+
+        result.tick = a.tick;
+        if (extrapolate)
+            result.pos = HermiteInterpolate(a.pos, a.vel * interval, b.pos, b.vel * interval, t);
+        else
+            result.pos = float3::Lerp(a.pos, b.pos, t);
+        result.rot = Quat::Slerp(a.rot, b.rot, t);
+        result.scale = float3::Lerp(a.scale, b.scale, t);
+        result.vel = float3::Lerp(a.vel, b.vel, t);
+        result.angVel = float3::Lerp(a.angVel, b.angVel, t);
+        return Interpolated;
+    }
+
+    ///\todo Orientation is held at the latest state. Also extrapolate orientation.
+    const f64 ticksPastLatest = renderTick - latest.tick;
+    const bool expired = ticksPastLatest > maxExtrapolationTicks;
+    result = latest;
+    if (extrapolate)
+        result.pos = latest.pos + latest.vel * (float)(Min(ticksPastLatest, (f64)maxExtrapolationTicks) * tickPeriod);
+    return expired ? Expired : Extrapolated;
+}
+
+}
@@ -0,0 +1,112 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraProtocolModuleApi.h"
+#include "CoreTypes.h"
+#include "Math/float3.h"
+#include "Math/Quat.h"
+
+namespace TundraLogic
+{
+
+/// Interpolates from (pos0, vel0) to (pos1, vel1) with a C1 curve (continuous in position and velocity)
+TUNDRAPROTOCOL_MODULE_API float3 HermiteInterpolate(const float3 &pos0, const float3 &vel0, const float3 &pos1, const float3 &vel1, float t);
+
+/// Returns the tangent vector (derivative) of the Hermite curve. Note that the differential is w.r.t. timesteps along the curve from t=[0,1]
+/// and not in "wallclock" time.
+TUNDRAPROTOCOL_MODULE_API float3 HermiteDerivative(const float3 &pos0, const float3 &vel0, const float3 &pos1, const float3 &vel1, float t);
+
+/// Rigid body state of an entity on a network tick of the server, as received by the client.
+struct TUNDRAPROTOCOL_MODULE_API TickSample
+{
+    TickSample() : tick(0), pos(float3::zero), rot(Quat::identity), scale(float3::one), vel(float3::zero), angVel(float3::zero) {}
+
+    u32 tick;
+    float3 pos;
+    Quat rot;
+    float3 scale;
+    float3 vel;
+    float3 angVel; ///< Angular velocity in Euler ZYX degrees/s.
+};
+
+/// Client-side estimate of the network tick of the server, see ProtocolTickStamps.
+/** Every tick-stamped message gives a sample of the server time, delayed by the latency of the message. The clock follows the
+    least delayed messages: an earlier arrival than expected moves it forward quickly, while later arrivals only pull it back slowly.
+    This way the clock, and the render time derived from it, does not follow the jitter of the arrival times. */
+class TUNDRAPROTOCOL_MODULE_API ServerTickClock
+{
+public:
+    ServerTickClock() : tickPeriod_(0.f), offset_(0.0), synced_(false) {}
+
+    /// Sets the length of a server tick in seconds, and starts the estimate over.
+    void SetTickPeriod(float period);
+    /// Returns the length of a server tick in seconds, or 0 if the server has not told it.
+    float TickPeriod() const { return tickPeriod_; }
+
+    /// Returns true if the tick period is known and a tick-stamped message has been received.
+    bool IsSynced() const { return synced_; }
+
+    /// Updates the estimate with a message stamped with a server tick, received at the given local time in seconds.
+    void Received(u32 tick, f64 localTime);
+
+    /// Returns the latest server tick the client can expect to have received at the given local time, with the fraction of the tick.
+    f64 Tick(f64 localTime) const;
+
+private:
+    float tickPeriod_;
+    /// Server time minus local time in seconds, including the latency of the least delayed messages.
+    f64 offset_;
+    bool synced_;
+};
+
+/// The latest rigid body states received for an entity, in tick order, rendered at a delay behind the server.
+/** The client renders the entity at a render tick that is a fixed number of ticks behind ServerTickClock::Tick. The states on the
+    ticks on both sides of the render tick are interpolated, so the motion does not depend on when the states arrived as long as they
+    arrive within the delay. Past the latest state the entity is extrapolated with its velocity for a limited time. */
+class TUNDRAPROTOCOL_MODULE_API SnapshotRing
+{
+public:
+    /// Number of states kept per entity.
+    static const size_t cCapacity = 16;
+
+    /// Results of Sample.
+    enum SampleResult
+    {
+        Interpolated, ///< The render tick is between two states, or before the oldest state.
+        Extrapolated, ///< The render tick is after the latest state, within the extrapolation limit.
+        Expired ///< The render tick is after the extrapolation limit. The state at the limit is returned.
+    };
+
+    SnapshotRing() : first_(0), size_(0) {}
+
+    /// Adds a state in tick order. States older than all kept states are dropped when the ring is full, as are duplicate ticks.
+    /** @return True if the state was added. */
+    bool Insert(const TickSample &sample);
+
+    /// Forgets all states.
+    void Clear() { first_ = 0; size_ = 0; }
+
+    bool IsEmpty() const { return size_ == 0; }
+    size_t Size() const { return size_; }
+
+    /// Returns a state by its index, oldest first.
+    const TickSample &At(size_t index) const { return samples_[(first_ + index) % cCapacity]; }
+    const TickSample &Latest() const { return At(size_ - 1); }
+
+    /// Returns the state of the entity on a render tick. The ring must not be empty.
+    /** @param renderTick Server tick to render, with the fraction of the tick.
+        @param tickPeriod Length of a server tick in seconds.
+        @param extrapolate Whether the velocities of the entity move it, i.e. whether it has a simulated rigid body. If false,
+            positions are interpolated linearly and held past the latest state.
+        @param maxExtrapolationTicks How many ticks past the latest state the entity is extrapolated.
+        @param result [out] The state. Its tick is the latest state at or before the render tick. */
+    SampleResult Sample(f64 renderTick, float tickPeriod, bool extrapolate, float maxExtrapolationTicks, TickSample &result) const;
+
+private:
+    TickSample samples_[cCapacity];
+    size_t first_;
+    size_t size_;
+};
+
+}
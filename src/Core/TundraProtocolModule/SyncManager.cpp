@@ -14,6 +14,7 @@
 #include "Entity.h"
 #include "CoreStringUtils.h"
 #include "EC_DynamicComponent.h"
+#include "EC_PlaceholderComponent.h"
 #include "EC_Camera.h"
 #include "AssetAPI.h"
 #include "IAssetStorage.h"
@@ -36,10 +37,57 @@ static std::set<u32> mismatchingComponentTypes;
 
 static size_t oldAttrDataBufferSize = 16 * 1024;
 
+/// How many server ticks behind the latest expected tick the client renders the tick-stamped rigid body states, see ProtocolTickStamps.
+/** The states that arrive late by less than this are still interpolated. */
+static const f64 cInterpolationDelayTicks = 2.0;
+
+/// When the send interval of the server changes, the render delay eases towards the new one by this many ticks per server tick,
+/// i.e. the rendered motion runs this fraction slower or faster until the delay has been reached.
+static const f64 cRenderDelaySlewRate = 0.1;
+
+/// Attribute interpolations of ProtocolTickStamps last at most this many server ticks, or the send interval of the server if longer,
+/// however long ago the previous update was.
+static const u32 cMaxAttributeInterpolationTicks = 10;
+
+/// Writes an attribute value, with the compact encoding if the connection supports ProtocolQuantizedAttributes.
+/** @param useMetadata Whether the compact encoding uses the quantization of the metadata, see SceneSyncState::QuantizesComponentType. */
+static void WriteAttribute(kNet::DataSerializer& ds, IAttribute* attr, bool quantized, bool useMetadata)
+{
+    if (quantized)
+        attr->ToQuantizedBinary(ds, useMetadata);
+    else
+        attr->ToBinary(ds);
+}
+
+/// Reads an attribute value written by WriteAttribute.
+static void ReadAttribute(kNet::DataDeserializer& ds, IAttribute* attr, bool quantized, bool useMetadata, AttributeChange::Type change)
+{
+    if (quantized)
+        attr->FromQuantizedBinary(ds, change, useMetadata);
+    else
+        attr->FromBinary(ds, change);
+}
+
+/// Returns whether the attributes of a component are sent with the quantization of their metadata.
+/** Not if the description of a placeholder of the type has crossed the connection, see SceneSyncState::QuantizesComponentType,
+    nor from a placeholder component, whose attributes have no metadata. The choice is sent with the attribute data of each component,
+    so that the receiver reads the data as it was written even if a description of the type is in flight. */
+static bool SendsWithMetadata(const SceneSyncState* state, IComponent* comp)
+{
+    return state->QuantizesComponentType(comp->TypeId()) && !dynamic_cast<EC_PlaceholderComponent*>(comp);
+}
+
+/// Returns whether attribute data sent with or without the quantization of the metadata can be read into a component.
+/** A placeholder component has no metadata, so it can not read values that were quantized with it. */
+static bool CanReadWithMetadata(bool useMetadata, IComponent* comp)
+{
+    return !useMetadata || !dynamic_cast<EC_PlaceholderComponent*>(comp);
+}
+
 namespace TundraLogic
 {
 
-bool SyncManager::WriteComponentFullUpdate(kNet::DataSerializer& ds, ComponentPtr comp)
+bool SyncManager::WriteComponentFullUpdate(kNet::DataSerializer& ds, ComponentPtr comp, bool quantized, bool useMetadata)
 {
     // Component identification
     ds.AddVLE<kNet::VLE8_16_32>(comp->Id() & UniqueIdGenerator::LAST_REPLICATED_ID);
@@ -49,11 +97,17 @@ bool SyncManager::WriteComponentFullUpdate(kNet::DataSerializer& ds, ComponentPt
     // Create a nested dataserializer for the attributes, so we can survive unknown or incompatible components
     kNet::DataSerializer attrDs(attrDataBuffer_, NUMELEMS(attrDataBuffer_));
 
-    // Static-structured attributes
+    // Static-structured attributes. The compact encoding sends first whether the metadata is used, and the number of the
+    // attributes, as a bool written as a single bit may end the values within the padding of the last byte.
     unsigned numStaticAttrs = comp->NumStaticAttributes();
     const AttributeVector& attrs = comp->Attributes();
+    if (quantized)
+    {
+        attrDs.Add<kNet::bit>(useMetadata ? 1 : 0);
+        attrDs.AddVLE<kNet::VLE8_16_32>(numStaticAttrs);
+    }
     for (uint i = 0; i < numStaticAttrs; ++i)
-        attrs[i]->ToBinary(attrDs);
+        WriteAttribute(attrDs, attrs[i], quantized, useMetadata);
     
     // Dynamic-structured attributes (use EOF to detect so do not need to send their amount)
     for (unsigned i = numStaticAttrs; i < attrs.size(); ++i)
@@ -63,7 +117,7 @@ bool SyncManager::WriteComponentFullUpdate(kNet::DataSerializer& ds, ComponentPt
             attrDs.Add<u8>(i); // Index
             attrDs.Add<u8>(attrs[i]->TypeId());
             attrDs.AddString(attrs[i]->Name().toStdString());
-            attrs[i]->ToBinary(attrDs);
+            WriteAttribute(attrDs, attrs[i], quantized, useMetadata);
         }
     }
 
@@ -110,7 +164,9 @@ SyncManager::SyncManager(TundraLogicModule* owner) :
     framework_(owner->GetFramework()),
     updatePeriod_(1.0f / 20.0f),
     interestmanager_(0),
-    updateAcc_(0.0),
+    networkTick_(0),
+    clockStart_(kNet::Clock::Tick()),
+    nextTickTime_(updatePeriod_),
     maxLinExtrapTime_(3.0f),
     noClientPhysicsHandoff_(false),
     componentTypeSender_(0)
@@ -164,6 +220,21 @@ SyncManager::SyncManager(TundraLogicModule* owner) :
     
     GetClientExtrapolationTime();
 
+    QStringList toleranceParam = framework_->CommandLineParameters("--transformTolerance");
+    if (toleranceParam.size() > 0)
+    {
+        bool ok;
+        float tolerance = toleranceParam.first().toFloat(&ok);
+        if (ok && tolerance >= 0.0f)
+        {
+            DeadReckoningSettings settings = deadReckoning_.Settings();
+            settings.positionTolerance = tolerance;
+            deadReckoning_.SetSettings(settings);
+        }
+        else
+            LogError("TundraLogicModule: Invalid parameter for --transformTolerance.");
+    }
+
     // Connect to network messages from the server
     serverConnection_ = owner_->GetClient()->ServerUserConnection();
     connect(serverConnection_.get(), SIGNAL(NetworkMessageReceived(UserConnection*, kNet::packet_id_t, kNet::message_id_t, const char *, size_t)), this, SLOT(HandleNetworkMessage(UserConnection*, kNet::packet_id_t, kNet::message_id_t, const char *, size_t)));
@@ -268,6 +339,7 @@ void SyncManager::SetUpdatePeriod(float period)
     if (period < 0.01f)
         period = 0.01f;
     updatePeriod_ = period;
+    nextTickTime_ = kNet::Clock::SecondsSinceD(clockStart_) + updatePeriod_;
     
     GetClientExtrapolationTime();
 }
@@ -303,6 +375,46 @@ SceneSyncState* SyncManager::SceneState(const UserConnectionPtr &connection) con
     return connection->syncState.get();
 }
 
+QVariantMap SyncManager::SendRateStatistics() const
+{
+    QVariantMap stats;
+    if (!owner_->IsServer())
+        return stats;
+
+    const SendRateTickMetrics &metrics = sendRateMetrics_;
+    stats["tick"] = metrics.tick;
+    stats["connections"] = metrics.connections;
+    stats["sent"] = metrics.sent;
+    stats["skipped"] = metrics.skipped;
+    stats["changed"] = metrics.changed;
+    stats["minInterval"] = metrics.minInterval;
+    stats["maxInterval"] = metrics.maxInterval;
+    stats["meanInterval"] = metrics.meanInterval;
+    QVariantMap reasons;
+    for(int i = 0; i < SendRate::NumReasons; ++i)
+        reasons[SendRate::ReasonName((SendRate::Reason)i)] = metrics.reasons[i];
+    stats["reasons"] = reasons;
+
+    QVariantList connections;
+    UserConnectionList& users = owner_->GetServer()->UserConnections();
+    for(UserConnectionList::const_iterator i = users.begin(); i != users.end(); ++i)
+        if ((*i)->syncState)
+        {
+            const SendRate &rate = (*i)->syncState->sendRate;
+            QVariantMap connection;
+            connection["id"] = (*i)->ConnectionId();
+            connection["interval"] = rate.Interval();
+            connection["reason"] = SendRate::ReasonName(rate.LastReason());
+            connection["roundTripTime"] = rate.LastStats().roundTripTime;
+            connection["baseRoundTripTime"] = rate.BaseRoundTripTime();
+            connection["packetLoss"] = rate.LastStats().packetLoss;
+            connection["outboundQueue"] = rate.LastStats().outboundQueue;
+            connections.push_back(connection);
+        }
+    stats["connectionStates"] = connections;
+    return stats;
+}
+
 void SyncManager::RegisterToScene(ScenePtr scene)
 {
     // Disconnect from previous scene if not expired
@@ -388,6 +500,15 @@ void SyncManager::HandleNetworkMessage(UserConnection* user, kNet::packet_id_t p
         case cRigidBodyUpdateMessage:
             HandleRigidBodyChanges(user, packetId, data, numBytes);
             break;
+        case cSnapshotMessage:
+            HandleSnapshot(user, packetId, data, numBytes);
+            break;
+        case cSnapshotAckMessage:
+            HandleSnapshotAck(user, data, numBytes);
+            break;
+        case cNetworkTickMessage:
+            HandleNetworkTick(user, data, numBytes);
+            break;
         case cEditEntityPropertiesMessage:
             HandleEditEntityProperties(user, data, numBytes);
             break;
@@ -819,51 +940,49 @@ void SyncManager::ReplicateComponentType(u32 typeId, UserConnection* connection)
             for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
             {
                 if ((*i)->ProtocolVersion() >= ProtocolCustomComponents && (*i).get() != componentTypeSender_)
+                {
                     (*i)->Send(cRegisterComponentTypeMessage, true, true, ds);
+                    if ((*i)->syncState)
+                        (*i)->syncState->MarkPlaceholderComponentType(typeId);
+                }
             }
         }   
         else if (serverConnection_ && serverConnection_->ProtocolVersion() >= ProtocolCustomComponents)
+        {
             serverConnection_->Send(cRegisterComponentTypeMessage, true, true, ds);
+            if (serverConnection_->syncState)
+                serverConnection_->syncState->MarkPlaceholderComponentType(typeId);
+        }
     }
     else
     {
         if (connection->ProtocolVersion() >= ProtocolCustomComponents)
+        {
             connection->Send(cRegisterComponentTypeMessage, true, true, ds);
+            if (connection->syncState)
+                connection->syncState->MarkPlaceholderComponentType(typeId);
+        }
     }
 }
 
-/// Interpolates from (pos0, vel0) to (pos1, vel1) with a C1 curve (continuous in position and velocity)
-float3 HermiteInterpolate(const float3 &pos0, const float3 &vel0, const float3 &pos1, const float3 &vel1, float t)
-{
-    float tt = t*t;
-    float ttt = tt*t;
-    float h1 = 2*ttt - 3*tt + 1;
-    float h2 = 1 - h1;
-    float h3 = ttt - 2*tt + t;
-    float h4 = ttt - tt;
-
-    return h1 * pos0 + h2 * pos1 + h3 * vel0 + h4 * vel1;
-}
-
-/// Returns the tangent vector (derivative) of the Hermite curve. Note that the differential is w.r.t. timesteps along the curve from t=[0,1] 
-/// and not in "wallclock" time.
-float3 HermiteDerivative(const float3 &pos0, const float3 &vel0, const float3 &pos1, const float3 &vel1, float t)
-{
-    float tt = t*t;
-    float h1 = 6*(tt - t);
-    float h2 = -h1;
-    float h3 = 3*tt - 4*t + 1;
-    float h4 = 3*tt - 2*t;
-
-    return h1 * pos0 + h2 * pos1 + h3 * vel0 + h4 * vel1;
-}
-
 void SyncManager::InterpolateRigidBodies(f64 frametime, SceneSyncState* state)
 {
     ScenePtr scene = scene_.lock();
     if (!scene)
         return;
 
+    // Ease the render delay towards the one the send interval of the server needs, so that a change of the interval does not make
+    // the rendered motion jump.
+    const f64 targetDelay = cInterpolationDelayTicks * state->serverSendInterval;
+    if (state->renderDelayTicks <= 0.0 || state->serverTick.TickPeriod() <= 0.f)
+        state->renderDelayTicks = targetDelay;
+    else
+    {
+        const f64 maxStep = frametime / state->serverTick.TickPeriod() * cRenderDelaySlewRate;
+        state->renderDelayTicks += Clamp(targetDelay - state->renderDelayTicks, -maxStep, maxStep);
+    }
+
+    const f64 renderTick = RenderTick(state);
     for(std::map<entity_id_t, RigidBodyInterpolationState>::iterator iter = state->entityInterpolations.begin(); 
         iter != state->entityInterpolations.end();)
     {
@@ -885,58 +1004,88 @@ void SyncManager::InterpolateRigidBodies(f64 frametime, SceneSyncState* state)
             continue;
         }
 
-        const float interpPeriod = updatePeriod_; // Time in seconds how long interpolating the Hermite spline from [0,1] should take.
-
-        // Test: Uncomment to only interpolate.
-//        r.interpTime = std::min(1.0f, r.interpTime + (float)frametime / interpPeriod);
-        r.interpTime += (float)frametime / interpPeriod;
-
         // Objects without a rigidbody, or with mass 0 never extrapolate (objects with mass 0 are stationary for Bullet).
         const bool isNewtonian = rigidBody && rigidBody->mass.Get() > 0;
 
-        float3 pos;
-        if (r.interpTime < 1.0f) // Interpolating between two messages from server.
-        {
-            if (isNewtonian)
-                pos = HermiteInterpolate(r.interpStart.pos, r.interpStart.vel * interpPeriod, r.interpEnd.pos, r.interpEnd.vel * interpPeriod, r.interpTime);
-            else
-                pos = HermiteInterpolate(r.interpStart.pos, float3::zero, r.interpEnd.pos, float3::zero, r.interpTime);
+        Transform t;
+        float3 curVel; // Velocity of the entity at the rendered position.
+        float3 endVel; // Velocities to hand off to client-side physics with.
+        float3 endAngVel;
+        bool handOff;
+        if (!r.snapshots.IsEmpty())
+        {
+            // Tick-stamped states: render the state of the server a fixed delay ago, independent of when the states arrived.
+            // The linear extrapolation time is then counted in server ticks.
+            TickSample sample;
+            SnapshotRing::SampleResult result = r.snapshots.Sample(renderTick, state->serverTick.TickPeriod(),
+                isNewtonian && maxLinExtrapTime_ > 1.0f, maxLinExtrapTime_ - 1.0f, sample);
+            t.SetPos(sample.pos);
+            t.SetOrientation(sample.rot);
+            t.SetScale(sample.scale);
+            curVel = sample.vel;
+            endVel = sample.vel;
+            endAngVel = sample.angVel;
+            handOff = (result == SnapshotRing::Expired);
         }
-        else // Linear extrapolation if server has not sent an update.
+        else
         {
-            if (isNewtonian && maxLinExtrapTime_ > 1.0f)
-                pos = r.interpEnd.pos + r.interpEnd.vel * (r.interpTime-1.f) * interpPeriod;
-            else
-                pos = r.interpEnd.pos;
+            const float interpPeriod = updatePeriod_; // Time in seconds how long interpolating the Hermite spline from [0,1] should take.
+
+            // Test: Uncomment to only interpolate.
+//            r.interpTime = std::min(1.0f, r.interpTime + (float)frametime / interpPeriod);
+            r.interpTime += (float)frametime / interpPeriod;
+
+            float3 pos;
+            if (r.interpTime < 1.0f) // Interpolating between two messages from server.
+            {
+                if (isNewtonian)
+                    pos = HermiteInterpolate(r.interpStart.pos, r.interpStart.vel * interpPeriod, r.interpEnd.pos, r.interpEnd.vel * interpPeriod, r.interpTime);
+                else
+                    pos = HermiteInterpolate(r.interpStart.pos, float3::zero, r.interpEnd.pos, float3::zero, r.interpTime);
+            }
+            else // Linear extrapolation if server has not sent an update.
+            {
+                if (isNewtonian && maxLinExtrapTime_ > 1.0f)
+                    pos = r.interpEnd.pos + r.interpEnd.vel * (r.interpTime-1.f) * interpPeriod;
+                else
+                    pos = r.interpEnd.pos;
+            }
+            ///\todo Orientation is only interpolated, and capped to end result. Also extrapolate orientation.
+            Quat rot = Quat::Slerp(r.interpStart.rot, r.interpEnd.rot, Clamp01(r.interpTime));
+            float3 scale = float3::Lerp(r.interpStart.scale, r.interpEnd.scale, Clamp01(r.interpTime));
+
+            t.SetPos(pos);
+            t.SetOrientation(rot);
+            t.SetScale(scale);
+
+            curVel = float3::Lerp(r.interpStart.vel, r.interpEnd.vel, Clamp01(r.interpTime));
+            // Test: To set continous velocity based on the Hermite curve, use the following:
+ //           curVel = HermiteDerivative(r.interpStart.pos, r.interpStart.vel*interpPeriod, r.interpEnd.pos, r.interpEnd.vel*interpPeriod, r.interpTime);
+            endVel = r.interpEnd.vel;
+            endAngVel = r.interpEnd.angVel;
+
+            // Local simulation steps:
+            // One fixed update interval: interpolate
+            // Two subsequent update intervals: linear extrapolation
+            // All subsequente update intervals: local physics extrapolation.
+            handOff = (r.interpTime >= maxLinExtrapTime_);
         }
-        ///\todo Orientation is only interpolated, and capped to end result. Also extrapolate orientation.
-        Quat rot = Quat::Slerp(r.interpStart.rot, r.interpEnd.rot, Clamp01(r.interpTime));
-        float3 scale = float3::Lerp(r.interpStart.scale, r.interpEnd.scale, Clamp01(r.interpTime));
-        
-        Transform t;
-        t.SetPos(pos);
-        t.SetOrientation(rot);
-        t.SetScale(scale);
         placeable->transform.Set(t, AttributeChange::LocalOnly);
 
-        // Local simulation steps:
-        // One fixed update interval: interpolate
-        // Two subsequent update intervals: linear extrapolation
-        // All subsequente update intervals: local physics extrapolation.
-        if (r.interpTime >= maxLinExtrapTime_) // Hand-off to client-side physics?
+        if (handOff) // Hand-off to client-side physics?
         {
             if (rigidBody)
             {
                 if (!noClientPhysicsHandoff_)
                 {
-                    bool objectIsInRest = (r.interpEnd.vel.LengthSq() < 1e-4f && r.interpEnd.angVel.LengthSq() < 1e-4f);
+                    bool objectIsInRest = (endVel.LengthSq() < 1e-4f && endAngVel.LengthSq() < 1e-4f);
                     // Now the local client-side physics will take over the simulation of this rigid body, but only if the object
                     // is moving. This is because the client shouldn't wake up the object (locally) if it's stationary, but wait for the
                     // server-side signal for that event.
                     rigidBody->SetClientExtrapolating(objectIsInRest == false);
                     // Give starting parameters for the simulation.
-                    rigidBody->linearVelocity.Set(r.interpEnd.vel, AttributeChange::LocalOnly);
-                    rigidBody->angularVelocity.Set(r.interpEnd.angVel, AttributeChange::LocalOnly);
+                    rigidBody->linearVelocity.Set(endVel, AttributeChange::LocalOnly);
+                    rigidBody->angularVelocity.Set(endAngVel, AttributeChange::LocalOnly);
                 }
             }
             r.interpolatorActive = false;
@@ -956,10 +1105,6 @@ void SyncManager::InterpolateRigidBodies(f64 frametime, SceneSyncState* state)
                 // Setting these is rather redundant, since Bullet doesn't simulate the entity using these variables. However, other
                 // (locally simulated) objects can collide to this entity, in which case it's good to have the proper velocities for bullet,
                 // so that the collision response simulates the appropriate forces/velocities in play.
-                float3 curVel = float3::Lerp(r.interpStart.vel, r.interpEnd.vel, Clamp01(r.interpTime));
-                // Test: To set continous velocity based on the Hermite curve, use the following:
- //               float3 curVel = HermiteDerivative(r.interpStart.pos, r.interpStart.vel*interpPeriod, r.interpEnd.pos, r.interpEnd.vel*interpPeriod, r.interpTime);
-
                 rigidBody->linearVelocity.Set(curVel, AttributeChange::LocalOnly);
 
                 ///\todo Setup angular velocity.
@@ -970,6 +1115,14 @@ void SyncManager::InterpolateRigidBodies(f64 frametime, SceneSyncState* state)
     }
 }
 
+f64 SyncManager::RenderTick(const SceneSyncState* state) const
+{
+    if (!state->serverTick.IsSynced())
+        return 0.0;
+    const f64 delay = state->renderDelayTicks > 0.0 ? state->renderDelayTicks : cInterpolationDelayTicks * state->serverSendInterval;
+    return state->serverTick.Tick(kNet::Clock::SecondsSinceD(clockStart_)) - delay;
+}
+
 void SyncManager::Update(f64 frametime)
 {
     PROFILE(SyncManager_Update);
@@ -978,13 +1131,16 @@ void SyncManager::Update(f64 frametime)
     if (!owner_->IsServer())
         InterpolateRigidBodies(frametime, serverConnection_->syncState.get());
 
-    // Check if it is yet time to perform a network update tick.
-    updateAcc_ += (float)frametime;
-    if (updateAcc_ < updatePeriod_)
+    // Check if it is yet time to perform a network update tick. The ticks are scheduled on the clock at the fixed update period,
+    // so that they do not drift with the frame time, which is summed up with rounding errors and may be clamped or scaled.
+    const f64 now = kNet::Clock::SecondsSinceD(clockStart_);
+    if (now < nextTickTime_)
         return;
 
-    // If multiple updates passed, update still just once.
-    updateAcc_ = fmod(updateAcc_, updatePeriod_);
+    // If multiple updates passed, update still just once. The network tick counts all of them, so that it keeps up with the server time.
+    const u32 ticksDue = 1 + (u32)((now - nextTickTime_) / updatePeriod_);
+    networkTick_ += ticksDue;
+    nextTickTime_ += ticksDue * (f64)updatePeriod_;
     
     ScenePtr scene = scene_.lock();
     if (!scene)
@@ -994,28 +1150,76 @@ void SyncManager::Update(f64 frametime)
     {
         // If we are server, process all authenticated users
 
+        // The server ticks at the fixed update period, but clients that support tick stamps are sent their updates only on the
+        // ticks due by their send rate, which adapts to the link of each client. Older clients interpolate over a fixed period,
+        // so they are sent an update on every tick, as are the clients without link statistics.
+        SendRateTickMetrics metrics;
+        metrics.tick = networkTick_;
+        u32 intervalSum = 0;
+
         // Then send out changes to other attributes via the generic sync mechanism.
         UserConnectionList& users = owner_->GetServer()->UserConnections();
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
             if ((*i)->syncState)
             {
+                KNetUserConnection* knetUser = dynamic_cast<KNetUserConnection*>(i->get());
+                if (knetUser && knetUser->connection && knetUser->ProtocolVersion() >= ProtocolTickStamps)
+                {
+                    const SendRate &rate = knetUser->syncState->sendRate;
+                    if (UpdateSendRate(knetUser, now))
+                        ++metrics.changed;
+                    ++metrics.reasons[rate.LastReason()];
+                    metrics.minInterval = metrics.connections == 0 ? rate.Interval() : Min(metrics.minInterval, rate.Interval());
+                    metrics.maxInterval = Max(metrics.maxInterval, rate.Interval());
+                    intervalSum += rate.Interval();
+                    ++metrics.connections;
+
+                    if (!rate.IsDue(networkTick_))
+                    {
+                        ++metrics.skipped;
+                        continue;
+                    }
+                    knetUser->syncState->sendRate.Sent(networkTick_);
+                    ++metrics.sent;
+                }
+
                 // As of now only native clients understand the optimized rigid body sync message.
                 // This may change with future protocol versions
-                if (dynamic_cast<KNetUserConnection*>(i->get()))
+                if (knetUser)
                 { 
                     // First send out all changes to rigid bodies.
                     // After processing this function, the bits related to rigid body states have been cleared,
                     // so the generic sync will not double-replicate the rigid body positions and velocities.
-                    ReplicateRigidBodyChanges((*i).get());
+                    // Clients that support snapshots get them instead, sent against the state they have acknowledged.
+                    // Clients that support tick stamps are told the tick period and their send interval first, and again
+                    // whenever either changes.
+                    if ((*i)->ProtocolVersion() >= ProtocolTickStamps && ((*i)->syncState->sentTickPeriod != updatePeriod_ ||
+                        (*i)->syncState->sentSendInterval != (*i)->syncState->sendRate.Interval()))
+                        SendNetworkTick((*i).get());
+                    if ((*i)->ProtocolVersion() >= ProtocolSnapshotDeltas)
+                        ReplicateSnapshot((*i).get());
+                    else
+                        ReplicateRigidBodyChanges((*i).get());
                 }
                 ProcessSyncState((*i).get());
             }
+
+        if (metrics.connections > 0)
+            metrics.meanInterval = (float)intervalSum / metrics.connections;
+        sendRateMetrics_ = metrics;
     }
     else
     {
         // If we are client and the connection is current, process just the server sync state
         if (static_cast<KNetUserConnection*>(serverConnection_.get())->connection)
+        {
             ProcessSyncState(serverConnection_.get());
+
+            // Acknowledge the snapshots received since the last update.
+            kNet::DataSerializer ackDs(1024);
+            if (serverConnection_->syncState->snapshotReceiver.WriteAcks(ackDs))
+                serverConnection_->Send(cSnapshotAckMessage, false, true, ackDs);
+        }
     }
 }
 
@@ -1032,11 +1236,26 @@ void SyncManager::ReplicateRigidBodyChanges(UserConnection* user)
     bool msgReliable = false;
     SceneSyncState* state = user->syncState.get();
 
-    QHashIterator<entity_id_t, EntitySyncState*> iter(state->dirtyQueue);
-    while (iter.hasNext())
+    // Check the dirty entities, and the entities whose transform was left within the dead reckoning tolerances on an earlier update.
+    std::vector<EntitySyncState*> candidates;
+    candidates.reserve(state->dirtyQueue.size() + state->unsentTransforms.size());
+    for(QHash<entity_id_t, EntitySyncState*>::const_iterator i = state->dirtyQueue.begin(); i != state->dirtyQueue.end(); ++i)
+        candidates.push_back(i.value());
+    for(std::set<entity_id_t>::iterator i = state->unsentTransforms.begin(); i != state->unsentTransforms.end();)
     {
-        iter.next();
+        std::map<entity_id_t, EntitySyncState>::iterator entityState = state->entities.find(*i);
+        if (entityState == state->entities.end())
+        {
+            state->unsentTransforms.erase(i++);
+            continue;
+        }
+        if (!state->dirtyQueue.contains(*i))
+            candidates.push_back(&entityState->second);
+        ++i;
+    }
 
+    for(size_t c = 0; c < candidates.size(); ++c)
+    {
         const int maxRigidBodyMessageSizeBits = 350; // An update for a single rigid body can take at most this many bits. (conservative bound)
         // If we filled up this message, send it out and start crafting anothero one.
         if (maxMessageSizeBytes * 8 - (int)ds.BitsFilled() <= maxRigidBodyMessageSizeBits)
@@ -1046,7 +1265,7 @@ void SyncManager::ReplicateRigidBodyChanges(UserConnection* user)
             msgReliable = false;
         }
 
-        EntitySyncState &ess = *iter.value();
+        EntitySyncState &ess = *candidates[c];
 
         if (ess.isNew || ess.removed)
             continue; // Newly created and removed entities are handled through the traditional sync mechanism.
@@ -1054,7 +1273,10 @@ void SyncManager::ReplicateRigidBodyChanges(UserConnection* user)
         EntityPtr e = ess.weak.lock();
         shared_ptr<EC_Placeable> placeable = (e.get() ? e->GetComponent<EC_Placeable>() : shared_ptr<EC_Placeable>());
         if (!placeable.get())
+        {
+            state->unsentTransforms.erase(ess.id);
             continue;
+        }
 
         std::map<component_id_t, ComponentSyncState>::iterator placeableComp = ess.components.find(placeable->Id());
 
@@ -1064,7 +1286,8 @@ void SyncManager::ReplicateRigidBodyChanges(UserConnection* user)
             ComponentSyncState &pss = placeableComp->second;
             if (!pss.isNew && !pss.removed) // Newly created and deleted components are handled through the traditional sync mechanism.
             {
-                transformDirty = (pss.dirtyAttributes[0] & 1) != 0; // The Transform of an EC_Placeable is the first attibute in the component.
+                // The Transform of an EC_Placeable is the first attibute in the component.
+                transformDirty = (pss.dirtyAttributes[0] & 1) != 0 || state->unsentTransforms.count(ess.id) != 0;
                 pss.dirtyAttributes[0] &= ~1;
             }
         }
@@ -1110,15 +1333,23 @@ void SyncManager::ReplicateRigidBodyChanges(UserConnection* user)
 
         const Transform &t = placeable->transform.Get();
 
-        float timeSinceLastSend = kNet::Clock::SecondsSinceF(ess.lastNetworkSendTime);
-        const float3 predictedClientSidePosition = ess.transform.pos + timeSinceLastSend * ess.linearVelocity;
-        float error = t.pos.DistanceSq(predictedClientSidePosition);
-        UNREFERENCED_PARAM(error)
-        // TEST: To have the server estimate how far the client has simulated, use this.
-//        bool posChanged = transformDirty && (timeSinceLastSend > 0.2f || t.pos.DistanceSq(/*ess.transform.pos*/ predictedClientSidePosition) > 5e-5f);
-        bool posChanged = transformDirty && t.pos.DistanceSq(ess.transform.pos) > 1e-3f;
-        bool rotChanged = transformDirty && (t.rot.DistanceSq(ess.transform.rot) > 1e-1f);
-        bool scaleChanged = transformDirty && (t.scale.DistanceSq(ess.transform.scale) > 1e-3f);
+        // Send the parts of the transform that the client can no longer predict closely enough, see DeadReckoning.
+        // Objects without a rigidbody, or with mass 0 are not extrapolated by the client (see InterpolateRigidBodies).
+        const float timeSinceLastSend = kNet::Clock::SecondsSinceF(ess.lastNetworkSendTime);
+        const bool clientExtrapolates = rigidBody && rigidBody->mass.Get() > 0 && maxLinExtrapTime_ > 1.0f;
+        const float toleranceScale = state->locationInitialized ? deadReckoning_.ToleranceScale(t.pos.Distance(state->clientLocation)) : 1.f;
+        int sendFlags = DeadReckoning::SendNothing;
+        if (transformDirty)
+        {
+            sendFlags = deadReckoning_.Evaluate(t, ess.transform, ess.linearVelocity, clientExtrapolates, timeSinceLastSend, toleranceScale);
+            // Any update restarts the client-side extrapolation from the last received position, so if something is sent,
+            // check the position against that instead.
+            if (sendFlags != DeadReckoning::SendNothing || velocityDirty || angularVelocityDirty)
+                sendFlags |= deadReckoning_.Evaluate(t, ess.transform, ess.linearVelocity, clientExtrapolates, 0.f, toleranceScale) & DeadReckoning::SendPosition;
+        }
+        bool posChanged = (sendFlags & DeadReckoning::SendPosition) != 0;
+        bool rotChanged = (sendFlags & DeadReckoning::SendRotation) != 0;
+        bool scaleChanged = (sendFlags & DeadReckoning::SendScale) != 0;
 
         // Detect whether to send compact or full states for each variable.
         // 0 - don't send, 1 - send compact, 2 - send full.
@@ -1162,7 +1393,13 @@ void SyncManager::ReplicateRigidBodyChanges(UserConnection* user)
         angVelSendType = angularVelocityDirty ? 1 : 0;
 
         if (posSendType == 0 && rotSendType == 0 && scaleSendType == 0 && velSendType == 0 && angVelSendType == 0)
+        {
+            if (DeadReckoning::HasError(t, ess.transform, ess.linearVelocity, clientExtrapolates, timeSinceLastSend))
+                state->unsentTransforms.insert(ess.id);
+            else
+                state->unsentTransforms.erase(ess.id);
             continue;
+        }
 
         size_t bitIdx = ds.BitsFilled();
         UNREFERENCED_PARAM(bitIdx)
@@ -1266,11 +1503,209 @@ void SyncManager::ReplicateRigidBodyChanges(UserConnection* user)
         size_t bitsEnd = ds.BitsFilled();
         UNREFERENCED_PARAM(bitsEnd)
         ess.lastNetworkSendTime = kNet::Clock::Tick();
+
+        if (DeadReckoning::HasError(t, ess.transform, ess.linearVelocity, clientExtrapolates, 0.f))
+            state->unsentTransforms.insert(ess.id);
+        else
+            state->unsentTransforms.erase(ess.id);
     }
     if (ds.BytesFilled() > 0)
         user->Send(cRigidBodyUpdateMessage, msgReliable, true, ds);
 }
 
+void SyncManager::ReplicateSnapshot(UserConnection* user)
+{
+    PROFILE(SyncManager_ReplicateSnapshot);
+
+    ScenePtr scene = scene_.lock();
+    if (!scene)
+        return;
+
+    const int maxMessageSizeBytes = 1400;
+    const int maxEntitySizeBits = 8 + 32 + 32 + 5 + 15 * 33; // Worst case size of an entity in the snapshot.
+    kNet::DataSerializer ds(maxMessageSizeBytes);
+    SceneSyncState* state = user->syncState.get();
+    SnapshotBaselines &baselines = state->snapshotBaselines;
+    const bool tickStamps = user->ProtocolVersion() >= ProtocolTickStamps;
+
+    // Check the dirty entities, the entities whose transform was left within the dead reckoning tolerances,
+    // and the entities that the client has not acknowledged yet.
+    std::set<entity_id_t> candidates(baselines.Unacknowledged().begin(), baselines.Unacknowledged().end());
+    candidates.insert(state->unsentTransforms.begin(), state->unsentTransforms.end());
+    for(QHash<entity_id_t, EntitySyncState*>::const_iterator i = state->dirtyQueue.begin(); i != state->dirtyQueue.end(); ++i)
+        candidates.insert(i.key());
+
+    baselines.BeginSnapshot(ds);
+    if (tickStamps)
+        ds.Add<u32>(networkTick_);
+    for(std::set<entity_id_t>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+    {
+        std::map<entity_id_t, EntitySyncState>::iterator entityState = state->entities.find(*c);
+        if (entityState == state->entities.end())
+        {
+            state->unsentTransforms.erase(*c);
+            baselines.Remove(*c);
+            continue;
+        }
+        EntitySyncState &ess = entityState->second;
+        if (ess.isNew || ess.removed)
+            continue; // Newly created and removed entities are handled through the traditional sync mechanism.
+
+        EntityPtr e = ess.weak.lock();
+        shared_ptr<EC_Placeable> placeable = (e.get() ? e->GetComponent<EC_Placeable>() : shared_ptr<EC_Placeable>());
+        if (!placeable.get())
+        {
+            state->unsentTransforms.erase(ess.id);
+            baselines.Remove(ess.id);
+            continue;
+        }
+
+        // Clear the rigid body related dirty bits, so that the generic sync does not replicate them. See ReplicateRigidBodyChanges.
+        std::map<component_id_t, ComponentSyncState>::iterator placeableComp = ess.components.find(placeable->Id());
+        bool transformDirty = state->unsentTransforms.count(ess.id) != 0;
+        if (placeableComp != ess.components.end() && !placeableComp->second.isNew && !placeableComp->second.removed)
+        {
+            transformDirty = transformDirty || (placeableComp->second.dirtyAttributes[0] & 1) != 0;
+            placeableComp->second.dirtyAttributes[0] &= ~1;
+        }
+        shared_ptr<EC_RigidBody> rigidBody = e->GetComponent<EC_RigidBody>();
+        bool velocityDirty = false;
+        bool angularVelocityDirty = false;
+        if (rigidBody)
+        {
+            std::map<component_id_t, ComponentSyncState>::iterator rigidBodyComp = ess.components.find(rigidBody->Id());
+            if (rigidBodyComp != ess.components.end() && !rigidBodyComp->second.isNew && !rigidBodyComp->second.removed)
+            {
+                ComponentSyncState &rss = rigidBodyComp->second;
+                velocityDirty = (rss.dirtyAttributes[1] & (1 << 5)) != 0 && rigidBody->linearVelocity.Get().DistanceSq(ess.linearVelocity) >= 1e-2f;
+                angularVelocityDirty = (rss.dirtyAttributes[1] & (1 << 6)) != 0 && rigidBody->angularVelocity.Get().DistanceSq(ess.angularVelocity) >= 1e-1f;
+                rss.dirtyAttributes[1] &= ~(1 << 5);
+                rss.dirtyAttributes[1] &= ~(1 << 6);
+
+                // Entering rest is always sent, so that the client does not extrapolate the object away.
+                // No reliable message is needed, as the state is sent until the client has acknowledged it.
+                if (rigidBody->linearVelocity.Get().IsZero(1e-4f) && !ess.linearVelocity.IsZero(1e-4f))
+                    velocityDirty = true;
+                if (rigidBody->angularVelocity.Get().IsZero(1e-4f) && !ess.angularVelocity.IsZero(1e-4f))
+                    angularVelocityDirty = true;
+            }
+        }
+
+        const Transform &t = placeable->transform.Get();
+        const bool tracked = baselines.AcknowledgedState(ess.id) || baselines.Unacknowledged().count(ess.id);
+        if (!tracked)
+        {
+            if (!transformDirty && !velocityDirty && !angularVelocityDirty)
+                continue;
+            // The first snapshot of an entity carries its complete state, so start from the current one.
+            ess.transform = t;
+            ess.linearVelocity = rigidBody ? rigidBody->linearVelocity.Get() : float3::zero;
+            ess.angularVelocity = rigidBody ? rigidBody->angularVelocity.Get() : float3::zero;
+            ess.lastNetworkSendTime = kNet::Clock::Tick();
+        }
+
+        // Update the state the client should have with the dead reckoning policy, as in ReplicateRigidBodyChanges.
+        const float timeSinceLastSend = kNet::Clock::SecondsSinceF(ess.lastNetworkSendTime);
+        const bool clientExtrapolates = rigidBody && rigidBody->mass.Get() > 0 && maxLinExtrapTime_ > 1.0f;
+        const float toleranceScale = state->locationInitialized ? deadReckoning_.ToleranceScale(t.pos.Distance(state->clientLocation)) : 1.f;
+        int sendFlags = DeadReckoning::SendNothing;
+        if (transformDirty)
+        {
+            sendFlags = deadReckoning_.Evaluate(t, ess.transform, ess.linearVelocity, clientExtrapolates, timeSinceLastSend, toleranceScale);
+            if (sendFlags != DeadReckoning::SendNothing || velocityDirty || angularVelocityDirty)
+                sendFlags |= deadReckoning_.Evaluate(t, ess.transform, ess.linearVelocity, clientExtrapolates, 0.f, toleranceScale) & DeadReckoning::SendPosition;
+        }
+        if (sendFlags & DeadReckoning::SendPosition)
+            ess.transform.pos = t.pos;
+        if (sendFlags & DeadReckoning::SendRotation)
+            ess.transform.rot = t.rot;
+        if (sendFlags & DeadReckoning::SendScale)
+            ess.transform.scale = t.scale;
+        if (velocityDirty)
+            ess.linearVelocity = rigidBody->linearVelocity.Get();
+        if (angularVelocityDirty)
+            ess.angularVelocity = rigidBody->angularVelocity.Get();
+        if (sendFlags != DeadReckoning::SendNothing || velocityDirty || angularVelocityDirty)
+            ess.lastNetworkSendTime = kNet::Clock::Tick();
+
+        if (DeadReckoning::HasError(t, ess.transform, ess.linearVelocity, clientExtrapolates, kNet::Clock::SecondsSinceF(ess.lastNetworkSendTime)))
+            state->unsentTransforms.insert(ess.id);
+        else
+            state->unsentTransforms.erase(ess.id);
+
+        // If the message is full, send it out and start another snapshot.
+        if (maxMessageSizeBytes * 8 - (int)ds.BitsFilled() <= maxEntitySizeBits)
+        {
+            if (baselines.EndSnapshot() > 0)
+                user->Send(cSnapshotMessage, false, true, ds);
+            ds = kNet::DataSerializer(maxMessageSizeBytes);
+            baselines.BeginSnapshot(ds);
+            if (tickStamps)
+                ds.Add<u32>(networkTick_);
+        }
+        baselines.Write(ds, ess.id, RigidBodySnapshot::FromState(ess.transform, ess.linearVelocity, ess.angularVelocity));
+    }
+    if (baselines.EndSnapshot() > 0)
+        user->Send(cSnapshotMessage, false, true, ds);
+}
+
+void SyncManager::HandleSnapshot(UserConnection* source, kNet::packet_id_t packetId, const char* data, size_t numBytes)
+{
+    ScenePtr scene = scene_.lock();
+    SceneSyncState* state = source->syncState.get();
+    if (!scene || !state)
+        return;
+
+    kNet::DataDeserializer dd(data, numBytes);
+    SnapshotReceiver &receiver = state->snapshotReceiver;
+    const u32 sequence = receiver.ReadHeader(dd);
+    if (!sequence)
+        return; // Out of order, a newer snapshot has been applied already.
+
+    // With tick stamps the states are buffered and rendered at a fixed delay, once the tick period is known.
+    u32 tick = 0;
+    if (source->ProtocolVersion() >= ProtocolTickStamps)
+    {
+        tick = dd.Read<u32>();
+        state->serverTick.Received(tick, kNet::Clock::SecondsSinceD(clockStart_));
+    }
+    const bool buffered = tick != 0 && state->serverTick.IsSynced();
+
+    // Only the entities that could be reconstructed and applied are stored and acknowledged. The server keeps sending the others
+    // against their earlier baselines, e.g. until the entity creation that was sent reliably arrives.
+    while(dd.BitsLeft() >= 8)
+    {
+        entity_id_t entityID;
+        RigidBodySnapshot snapshot;
+        int changedParts = 0;
+        if (!receiver.Read(dd, sequence, entityID, snapshot, changedParts))
+            continue;
+        EntityPtr e = scene->EntityById(entityID);
+        if (!e || !e->GetComponent<EC_Placeable>())
+            continue;
+        receiver.Store(sequence, entityID, snapshot);
+        if (!changedParts)
+            continue;
+        if (buffered)
+            BufferRigidBodyUpdate(e, tick, snapshot.ToTransform(), snapshot.ToLinearVelocity(), snapshot.ToAngularVelocity(), changedParts);
+        else
+            ApplyRigidBodyUpdate(source, packetId, e, snapshot.ToTransform(), snapshot.ToLinearVelocity(), snapshot.ToAngularVelocity(), changedParts);
+    }
+}
+
+void SyncManager::HandleSnapshotAck(UserConnection* source, const char* data, size_t numBytes)
+{
+    SceneSyncState* state = source->syncState.get();
+    if (!state)
+        return;
+
+    kNet::DataDeserializer dd(data, numBytes);
+    std::vector<SnapshotAck> acks;
+    SnapshotReceiver::ReadAcks(dd, acks);
+    for(size_t i = 0; i < acks.size(); ++i)
+        state->snapshotBaselines.Acknowledge(acks[i]);
+}
+
 void SyncManager::HandleRigidBodyChanges(UserConnection* source, kNet::packet_id_t packetId, const char* data, size_t numBytes)
 {
     ScenePtr scene = scene_.lock();
@@ -1380,80 +1815,203 @@ void SyncManager::HandleRigidBodyChanges(UserConnection* source, kNet::packet_id
         if (!e) // Discard this message - we don't have the entity in our scene to which the message applies to.
             continue;
 
-        // Did anything change?
-        if (posSendType != 0 || rotSendType != 0 || scaleSendType != 0 || velSendType != 0 || angVelSendType != 0)
-        {
-            // Create or update the interpolation state.
-            Transform orig = placeable->transform.Get();
+        int changedParts = 0;
+        if (posSendType != 0)
+            changedParts |= 1 << RigidBodySnapshot::Position;
+        if (rotSendType != 0)
+            changedParts |= 1 << RigidBodySnapshot::Rotation;
+        if (scaleSendType != 0)
+            changedParts |= 1 << RigidBodySnapshot::Scale;
+        if (velSendType != 0)
+            changedParts |= 1 << RigidBodySnapshot::LinearVelocity;
+        if (angVelSendType != 0)
+            changedParts |= 1 << RigidBodySnapshot::AngularVelocity;
+        if (changedParts)
+            ApplyRigidBodyUpdate(source, packetId, e, t, newLinearVel, newAngVel, changedParts);
+    }
+}
 
-            std::map<entity_id_t, RigidBodyInterpolationState>::iterator iter = serverConnection_->syncState->entityInterpolations.find(entityID);
-            if (iter != serverConnection_->syncState->entityInterpolations.end())
-            {
-                RigidBodyInterpolationState &interp = iter->second;
+void SyncManager::ApplyRigidBodyUpdate(UserConnection* source, kNet::packet_id_t packetId, const EntityPtr &e, const Transform &t,
+    const float3 &newLinearVel, const float3 &newAngVel, int changedParts)
+{
+    shared_ptr<EC_Placeable> placeable = e->GetComponent<EC_Placeable>();
+    shared_ptr<EC_RigidBody> rigidBody = e->GetComponent<EC_RigidBody>();
+    if (!placeable)
+        return;
+    const entity_id_t entityID = e->Id();
+    const bool posChanged = (changedParts & (1 << RigidBodySnapshot::Position)) != 0;
+    const bool rotChanged = (changedParts & (1 << RigidBodySnapshot::Rotation)) != 0;
+    const bool scaleChanged = (changedParts & (1 << RigidBodySnapshot::Scale)) != 0;
+    const bool velChanged = (changedParts & (1 << RigidBodySnapshot::LinearVelocity)) != 0;
+    const bool angVelChanged = (changedParts & (1 << RigidBodySnapshot::AngularVelocity)) != 0;
 
-                KNetUserConnection* kNetSource = dynamic_cast<KNetUserConnection*>(source);
-                kNet::MessageConnection* conn = kNetSource ? kNetSource->connection.ptr() : (kNet::MessageConnection*)0;
-                if (conn && conn->GetSocket() && conn->GetSocket()->TransportLayer() == kNet::SocketOverUDP)
-                {
-                    if (kNet::PacketIDIsNewerThan(interp.lastReceivedPacketCounter, packetId))
-                        continue; // This is an out-of-order received packet. Ignore it. (latest-data-guarantee)
-                }
-                
-                interp.lastReceivedPacketCounter = packetId;
+    // Create or update the interpolation state.
+    Transform orig = placeable->transform.Get();
 
-                const float interpPeriod = updatePeriod_; // Time in seconds how long interpolating the Hermite spline from [0,1] should take.
-                float3 curVel;
+    std::map<entity_id_t, RigidBodyInterpolationState>::iterator iter = serverConnection_->syncState->entityInterpolations.find(entityID);
+    if (iter != serverConnection_->syncState->entityInterpolations.end())
+    {
+        RigidBodyInterpolationState &interp = iter->second;
 
-                if (interp.interpTime < 1.0f)
-                    curVel = HermiteDerivative(interp.interpStart.pos, interp.interpStart.vel*interpPeriod, interp.interpEnd.pos, interp.interpEnd.vel*interpPeriod, interp.interpTime);
-                else
-                    curVel = interp.interpEnd.vel;
-                float3 curAngVel = float3::zero; ///\todo
-                interp.interpStart.pos = orig.pos;
-                if (posSendType != 0)
-                    interp.interpEnd.pos = t.pos;
-                interp.interpStart.rot = orig.Orientation();
-                if (rotSendType != 0)
-                    interp.interpEnd.rot = t.Orientation();
-                interp.interpStart.scale = orig.scale;
-                if (scaleSendType != 0)
-                    interp.interpEnd.scale = t.scale;
-                interp.interpStart.vel = curVel;
-                if (velSendType != 0)
-                    interp.interpEnd.vel = newLinearVel;
-                interp.interpStart.angVel = curAngVel;
-                if (angVelSendType != 0)
-                    interp.interpEnd.angVel = newAngVel;
-                interp.interpTime = 0.f;
-                interp.interpolatorActive = true;
-
-                // Objects without a rigidbody, or with mass 0 never extrapolate (objects with mass 0 are stationary for Bullet).
-                const bool isNewtonian = rigidBody && rigidBody->mass.Get() > 0;
-                if (!isNewtonian)
-                    interp.interpStart.vel = interp.interpEnd.vel = float3::zero;
-            }
-            else
-            {
-                RigidBodyInterpolationState interp;
-                interp.interpStart.pos = orig.pos;
-                interp.interpEnd.pos = t.pos;
-                interp.interpStart.rot = orig.Orientation();
-                interp.interpEnd.rot = t.Orientation();
-                interp.interpStart.scale = orig.scale;
-                interp.interpEnd.scale = t.scale;
-                interp.interpStart.vel = rigidBody ? rigidBody->linearVelocity.Get() : float3::zero;
-                interp.interpEnd.vel = newLinearVel;
-                interp.interpStart.angVel = rigidBody ? rigidBody->angularVelocity.Get() : float3::zero;
-                interp.interpEnd.angVel = newAngVel;
-                interp.interpTime = 0.f;
-                interp.lastReceivedPacketCounter = packetId;
-                interp.interpolatorActive = true;
-                serverConnection_->syncState->entityInterpolations[entityID] = interp;
-            }
+        KNetUserConnection* kNetSource = dynamic_cast<KNetUserConnection*>(source);
+        kNet::MessageConnection* conn = kNetSource ? kNetSource->connection.ptr() : (kNet::MessageConnection*)0;
+        if (conn && conn->GetSocket() && conn->GetSocket()->TransportLayer() == kNet::SocketOverUDP)
+        {
+            if (kNet::PacketIDIsNewerThan(interp.lastReceivedPacketCounter, packetId))
+                return; // This is an out-of-order received packet. Ignore it. (latest-data-guarantee)
         }
+        
+        interp.lastReceivedPacketCounter = packetId;
+
+        const float interpPeriod = updatePeriod_; // Time in seconds how long interpolating the Hermite spline from [0,1] should take.
+        float3 curVel;
+
+        if (interp.interpTime < 1.0f)
+            curVel = HermiteDerivative(interp.interpStart.pos, interp.interpStart.vel*interpPeriod, interp.interpEnd.pos, interp.interpEnd.vel*interpPeriod, interp.interpTime);
+        else
+            curVel = interp.interpEnd.vel;
+        float3 curAngVel = float3::zero; ///\todo
+        interp.interpStart.pos = orig.pos;
+        if (posChanged)
+            interp.interpEnd.pos = t.pos;
+        interp.interpStart.rot = orig.Orientation();
+        if (rotChanged)
+            interp.interpEnd.rot = t.Orientation();
+        interp.interpStart.scale = orig.scale;
+        if (scaleChanged)
+            interp.interpEnd.scale = t.scale;
+        interp.interpStart.vel = curVel;
+        if (velChanged)
+            interp.interpEnd.vel = newLinearVel;
+        interp.interpStart.angVel = curAngVel;
+        if (angVelChanged)
+            interp.interpEnd.angVel = newAngVel;
+        interp.interpTime = 0.f;
+        interp.interpolatorActive = true;
+        interp.snapshots.Clear(); // Not tick-stamped, so the buffered states do not apply anymore.
+
+        // Objects without a rigidbody, or with mass 0 never extrapolate (objects with mass 0 are stationary for Bullet).
+        const bool isNewtonian = rigidBody && rigidBody->mass.Get() > 0;
+        if (!isNewtonian)
+            interp.interpStart.vel = interp.interpEnd.vel = float3::zero;
+    }
+    else
+    {
+        RigidBodyInterpolationState interp;
+        interp.interpStart.pos = orig.pos;
+        interp.interpEnd.pos = t.pos;
+        interp.interpStart.rot = orig.Orientation();
+        interp.interpEnd.rot = t.Orientation();
+        interp.interpStart.scale = orig.scale;
+        interp.interpEnd.scale = t.scale;
+        interp.interpStart.vel = rigidBody ? rigidBody->linearVelocity.Get() : float3::zero;
+        interp.interpEnd.vel = newLinearVel;
+        interp.interpStart.angVel = rigidBody ? rigidBody->angularVelocity.Get() : float3::zero;
+        interp.interpEnd.angVel = newAngVel;
+        interp.interpTime = 0.f;
+        interp.lastReceivedPacketCounter = packetId;
+        interp.interpolatorActive = true;
+        serverConnection_->syncState->entityInterpolations[entityID] = interp;
     }
 }
 
+void SyncManager::BufferRigidBodyUpdate(const EntityPtr &e, u32 tick, const Transform &t, const float3 &newLinearVel, const float3 &newAngVel, int changedParts)
+{
+    shared_ptr<EC_Placeable> placeable = e->GetComponent<EC_Placeable>();
+    shared_ptr<EC_RigidBody> rigidBody = e->GetComponent<EC_RigidBody>();
+    if (!placeable)
+        return;
+    SceneSyncState* state = serverConnection_->syncState.get();
+
+    std::map<entity_id_t, RigidBodyInterpolationState>::iterator iter = state->entityInterpolations.find(e->Id());
+    if (iter == state->entityInterpolations.end())
+    {
+        RigidBodyInterpolationState interp;
+        interp.interpTime = 0.f;
+        interp.interpolatorActive = false;
+        interp.lastReceivedPacketCounter = 0;
+        iter = state->entityInterpolations.insert(std::make_pair(e->Id(), interp)).first;
+    }
+    RigidBodyInterpolationState &interp = iter->second;
+    SnapshotRing &ring = interp.snapshots;
+
+    // If the entity is new to the ring, or client-side physics has moved it since the ring ran out, continue from where it is now.
+    if (!interp.interpolatorActive || ring.IsEmpty())
+    {
+        const Transform orig = placeable->transform.Get();
+        TickSample current;
+        current.tick = (u32)Max(RenderTick(state), 0.0);
+        current.pos = orig.pos;
+        current.rot = orig.Orientation();
+        current.scale = orig.scale;
+        current.vel = rigidBody ? rigidBody->linearVelocity.Get() : float3::zero;
+        current.angVel = rigidBody ? rigidBody->angularVelocity.Get() : float3::zero;
+        ring.Clear();
+        if (current.tick < tick)
+            ring.Insert(current);
+        interp.interpolatorActive = true;
+    }
+
+    TickSample sample;
+    sample.tick = tick;
+    sample.pos = t.pos;
+    sample.rot = t.Orientation();
+    sample.scale = t.scale;
+    sample.vel = newLinearVel;
+    sample.angVel = newAngVel;
+
+    // A position that was not sent is the one the server expects the client to predict, see DeadReckoning.
+    const bool clientExtrapolates = rigidBody && rigidBody->mass.Get() > 0 && maxLinExtrapTime_ > 1.0f;
+    if (!(changedParts & (1 << RigidBodySnapshot::Position)) && !ring.IsEmpty() && ring.Latest().tick < tick)
+    {
+        const TickSample &latest = ring.Latest();
+        sample.pos = DeadReckoning::PredictPosition(latest.pos, latest.vel, clientExtrapolates, (tick - latest.tick) * state->serverTick.TickPeriod());
+    }
+    ring.Insert(sample);
+}
+
+void SyncManager::SendNetworkTick(UserConnection* user)
+{
+    kNet::DataSerializer ds(16);
+    ds.Add<float>(updatePeriod_);
+    ds.AddVLE<kNet::VLE8_16_32>(user->syncState->sendRate.Interval());
+    user->Send(cNetworkTickMessage, true, true, ds);
+    user->syncState->sentTickPeriod = updatePeriod_;
+    user->syncState->sentSendInterval = user->syncState->sendRate.Interval();
+}
+
+void SyncManager::HandleNetworkTick(UserConnection* source, const char* data, size_t numBytes)
+{
+    SceneSyncState* state = source->syncState.get();
+    if (owner_->IsServer() || !state)
+        return;
+
+    kNet::DataDeserializer dd(data, numBytes);
+    const float period = dd.Read<float>();
+    if (period != state->serverTick.TickPeriod())
+        state->serverTick.SetTickPeriod(period);
+    // The send interval was added after the tick period, and is 1 tick if the server did not send it.
+    state->serverSendInterval = dd.BytesLeft() > 0 ? Max(dd.ReadVLE<kNet::VLE8_16_32>(), 1u) : 1;
+}
+
+bool SyncManager::UpdateSendRate(KNetUserConnection* user, f64 time)
+{
+    kNet::MessageConnection* connection = user->connection.ptr();
+    LinkStats stats;
+    stats.roundTripTime = connection->RoundTripTime() / 1000.f; // kNet measures the round trip time in milliseconds.
+    stats.packetLoss = connection->PacketLossRate();
+    stats.outboundQueue = (u32)connection->NumOutboundMessagesPending();
+
+    SendRate &rate = user->syncState->sendRate;
+    if (!rate.Update(sendRateSettings_, time, stats))
+        return false;
+
+    LogDebug(QString("[SyncManager]: Send interval of connection %1 is now %2 ticks (%3, RTT %4 ms, loss %5%, %6 queued).")
+        .arg(user->ConnectionId()).arg(rate.Interval()).arg(SendRate::ReasonName(rate.LastReason()))
+        .arg(stats.roundTripTime * 1000.f, 0, 'f', 0).arg(stats.packetLoss * 100.f, 0, 'f', 1).arg(stats.outboundQueue));
+    return true;
+}
+
 void SyncManager::HandleEditEntityProperties(UserConnection* source, const char* data, size_t numBytes)
 {
     assert(source);
@@ -1588,6 +2146,35 @@ void SyncManager::HandleRegisterComponentType(UserConnection* source, const char
     // On client, remember the component types server has sent, so that we don't unnecessarily echo them back
     if (!isServer)
         componentTypesFromServer_.insert(desc.typeId);
+    // The sender only has a placeholder of the type, so its attributes are sent both ways without the quantization of their metadata,
+    // even if we have the actual C++ component
+    SceneSyncState* state = source->syncState.get();
+    if (state && state->QuantizesComponentType(desc.typeId))
+    {
+        state->MarkPlaceholderComponentType(desc.typeId);
+
+        // The sender skips values that were quantized with the metadata, as its placeholder does not have it.
+        // Send the static attributes of the components of the type that the sender already has again, this time without the metadata.
+        ScenePtr scene = scene_.lock();
+        for(std::map<entity_id_t, EntitySyncState>::iterator i = state->entities.begin(); scene && i != state->entities.end(); ++i)
+        {
+            EntityPtr entity = scene->EntityById(i->first);
+            if (!entity || i->second.isNew)
+                continue;
+            const Entity::ComponentMap &components = entity->Components();
+            for(Entity::ComponentMap::const_iterator j = components.begin(); j != components.end(); ++j)
+            {
+                ComponentPtr comp = j->second;
+                if (comp->TypeId() != desc.typeId || !comp->IsReplicated())
+                    continue;
+                std::map<component_id_t, ComponentSyncState>::const_iterator compState = i->second.components.find(comp->Id());
+                if (compState == i->second.components.end() || compState->second.isNew)
+                    continue;
+                for(int k = 0; k < comp->NumStaticAttributes(); ++k)
+                    state->MarkAttributeDirty(entity->Id(), comp->Id(), (u8)k);
+            }
+        }
+    }
 
     // If component type already exists as actual C++ component, no action necessary
     // However, allow to update an earlier custom component description
@@ -1663,6 +2250,8 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
 
     unsigned sceneId = 0;       /// @todo Replace with proper scene ID once multiscene support is in place.
     bool removeState = false;
+    const bool quantized = user->ProtocolVersion() >= ProtocolQuantizedAttributes;
+    const bool tickStamps = isServer && user->ProtocolVersion() >= ProtocolTickStamps;
 
     EntityPtr entity = entityState->weak.lock();
     if (!entity)
@@ -1765,7 +2354,7 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
             ComponentPtr comp = i->second;
             if (!comp->IsReplicated())
                 continue;
-            if (bufferValid && !WriteComponentFullUpdate(ds, comp))
+            if (bufferValid && !WriteComponentFullUpdate(ds, comp, quantized, SendsWithMetadata(sceneState, comp.get())))
             {
                 bufferValid = false;
                 ds.ResetFill();
@@ -1847,7 +2436,7 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
                         createCompsDs.AddVLE<kNet::VLE8_16_32>(entityState->id & UniqueIdGenerator::LAST_REPLICATED_ID);
                     }
                     // Then add the component data
-                    if (!WriteComponentFullUpdate(createCompsDs, comp))
+                    if (!WriteComponentFullUpdate(createCompsDs, comp, quantized, SendsWithMetadata(sceneState, comp.get())))
                         createCompsDs.ResetFill();
                     // Mark the component undirty in the receiver's syncstate
                     sceneState->MarkComponentProcessed(entity->Id(), comp->Id());
@@ -1887,7 +2476,7 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
                                     createAttrsDs.Add<u8>(attrIndex); // Index
                                     createAttrsDs.Add<u8>(attr->TypeId());
                                     createAttrsDs.AddString(attr->Name().toStdString());
-                                    attr->ToBinary(createAttrsDs);
+                                    WriteAttribute(createAttrsDs, attr, quantized, false); // Dynamic attributes have no quantization metadata
 
                                     attrBufferValid = ValidateAttributeBuffer(false, createAttrsDs, comp);
                                 }
@@ -1969,11 +2558,16 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
                             {
                                 editAttrsDs.AddVLE<kNet::VLE8_16_32>(sceneId);
                                 editAttrsDs.AddVLE<kNet::VLE8_16_32>(entityState->id & UniqueIdGenerator::LAST_REPLICATED_ID);
+                                if (tickStamps)
+                                    editAttrsDs.Add<u32>(networkTick_);
                             }
                             editAttrsDs.AddVLE<kNet::VLE8_16_32>(compState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
                         
                             // Create a nested dataserializer for the actual attribute data, so we can skip components
                             kNet::DataSerializer attrDataDs(attrDataBuffer_, NUMELEMS(attrDataBuffer_));
+                            const bool useMetadata = SendsWithMetadata(sceneState, comp.get());
+                            if (quantized)
+                                attrDataDs.Add<kNet::bit>(useMetadata ? 1 : 0);
                         
                             // There are changed attributes. Check if it is more optimal to send attribute indices, or the whole bitmask
                             unsigned bitsMethod1 = (unsigned)changedAttributes_.size() * 8 + 8;
@@ -1986,7 +2580,7 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
                                 for (unsigned i = 0; i < changedAttributes_.size(); ++i)
                                 {
                                     attrDataDs.Add<u8>(changedAttributes_[i]);
-                                    attrs[changedAttributes_[i]]->ToBinary(attrDataDs);
+                                    WriteAttribute(attrDataDs, attrs[changedAttributes_[i]], quantized, useMetadata);
                                 }
                             }
                             // Method 2: bitmask
@@ -1998,7 +2592,7 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
                                     if (compState.dirtyAttributes[i >> 3] & (1 << (i & 7)))
                                     {
                                         attrDataDs.Add<kNet::bit>(1);
-                                        attrs[i]->ToBinary(attrDataDs);
+                                        WriteAttribute(attrDataDs, attrs[i], quantized, useMetadata);
                                     }
                                     else
                                         attrDataDs.Add<kNet::bit>(0);
@@ -2072,7 +2666,10 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
     
     // Entity removal has been sent to the client, remove it from the SceneState.
     if (removeState)
+    {
+        sceneState->snapshotBaselines.Remove(entityState->id);
         sceneState->entities.erase(entityState->id);
+    }
 }
 
 bool SyncManager::ValidateAction(UserConnection* source, unsigned /*messageID*/, entity_id_t /*entityID*/)
@@ -2144,6 +2741,7 @@ void SyncManager::HandleCreateEntity(UserConnection* source, const char* data, s
     // For clients, the change type is LocalOnly. For server, the change type is Replicate, so that it will get replicated to all clients in turn
     bool isServer = owner_->IsServer();
     AttributeChange::Type change = isServer ? AttributeChange::Replicate : AttributeChange::LocalOnly;
+    const bool quantized = source->ProtocolVersion() >= ProtocolQuantizedAttributes;
     
     kNet::DataDeserializer ds(data, numBytes);
     unsigned sceneID = ds.ReadVLE<kNet::VLE8_16_32>(); ///\todo Dummy ID. Lookup scene once multiscene is properly supported
@@ -2268,14 +2866,21 @@ void SyncManager::HandleCreateEntity(UserConnection* source, const char* data, s
             state->MarkComponentProcessed(entityID, compID);
             
             // Fill static attributes
+            const bool useMetadata = quantized && attrDs.Read<kNet::bit>() != 0;
+            if (!CanReadWithMetadata(useMetadata, comp.get()))
+            {
+                LogWarning("Attribute data of " + comp->TypeName() + " in " + entity->ToString() + " was quantized with metadata that the placeholder component does not have, skipping the attributes.");
+                continue;
+            }
             unsigned numStaticAttrs = comp->NumStaticAttributes();
+            const unsigned numSentStaticAttrs = quantized ? attrDs.ReadVLE<kNet::VLE8_16_32>() : numStaticAttrs;
             const AttributeVector& attrs = comp->Attributes();
             for (uint i = 0; i < numStaticAttrs; ++i)
             {
                 // Allow component version mismatches (adding more attributes to the end of static attributes list), break if no more data present.
-                // All attributes (including bool) are at least 8 bits.
-                if (attrDs.BitsLeft() >= 8)
-                    attrs[i]->FromBinary(attrDs, AttributeChange::Disconnected);
+                // The compact encoding tells the number of attributes sent, otherwise all attributes (including bool) are at least 8 bits.
+                if (quantized ? i < numSentStaticAttrs : attrDs.BitsLeft() >= 8)
+                    ReadAttribute(attrDs, attrs[i], quantized, useMetadata, AttributeChange::Disconnected);
                 else
                 {
                     if (mismatchingComponentTypes.find(comp->TypeId()) == mismatchingComponentTypes.end())
@@ -2301,10 +2906,10 @@ void SyncManager::HandleCreateEntity(UserConnection* source, const char* data, s
                         LogWarning("Failed to create dynamic attribute. Skipping rest of the attributes for this component.");
                         break;
                     }
-                    newAttr->FromBinary(attrDs, AttributeChange::Disconnected);
+                    ReadAttribute(attrDs, newAttr, quantized, useMetadata, AttributeChange::Disconnected);
                 }
             }
-            else if (attrDs.BitsLeft())
+            else if (quantized ? numSentStaticAttrs > numStaticAttrs : attrDs.BitsLeft() > 0)
             {
                 if (mismatchingComponentTypes.find(comp->TypeId()) == mismatchingComponentTypes.end())
                 {
@@ -2362,6 +2967,7 @@ void SyncManager::HandleCreateComponents(UserConnection* source, const char* dat
     // For clients, the change type is LocalOnly. For server, the change type is Replicate, so that it will get replicated to all clients in turn
     bool isServer = owner_->IsServer();
     AttributeChange::Type change = isServer ? AttributeChange::Replicate : AttributeChange::LocalOnly;
+    const bool quantized = source->ProtocolVersion() >= ProtocolQuantizedAttributes;
     
     std::vector<std::pair<component_id_t, component_id_t> > componentIdRewrites;
     std::vector<ComponentPtr> addedComponents;
@@ -2438,14 +3044,21 @@ void SyncManager::HandleCreateComponents(UserConnection* source, const char* dat
             addedComponents.push_back(comp);
             
             // Fill static attributes
+            const bool useMetadata = quantized && attrDs.Read<kNet::bit>() != 0;
+            if (!CanReadWithMetadata(useMetadata, comp.get()))
+            {
+                LogWarning("Attribute data of " + comp->TypeName() + " in " + entity->ToString() + " was quantized with metadata that the placeholder component does not have, skipping the attributes.");
+                continue;
+            }
             unsigned numStaticAttrs = comp->NumStaticAttributes();
+            const unsigned numSentStaticAttrs = quantized ? attrDs.ReadVLE<kNet::VLE8_16_32>() : numStaticAttrs;
             const AttributeVector& attrs = comp->Attributes();
             for (uint i = 0; i < numStaticAttrs; ++i)
             {
                 // Allow component version mismatches (adding more attributes to the end of static attributes list), break if no more data present.
-                // All attributes (including bool) are at least 8 bits.
-                if (attrDs.BitsLeft() >= 8)
-                    attrs[i]->FromBinary(attrDs, AttributeChange::Disconnected);
+                // The compact encoding tells the number of attributes sent, otherwise all attributes (including bool) are at least 8 bits.
+                if (quantized ? i < numSentStaticAttrs : attrDs.BitsLeft() >= 8)
+                    ReadAttribute(attrDs, attrs[i], quantized, useMetadata, AttributeChange::Disconnected);
                 else
                 {
                     if (mismatchingComponentTypes.find(comp->TypeId()) == mismatchingComponentTypes.end())
@@ -2471,10 +3084,10 @@ void SyncManager::HandleCreateComponents(UserConnection* source, const char* dat
                         LogWarning("Failed to create dynamic attribute. Skipping rest of the attributes for this component.");
                         break;
                     }
-                    newAttr->FromBinary(attrDs, AttributeChange::Disconnected);
+                    ReadAttribute(attrDs, newAttr, quantized, useMetadata, AttributeChange::Disconnected);
                 }
             }
-            else if (attrDs.BitsLeft())
+            else if (quantized ? numSentStaticAttrs > numStaticAttrs : attrDs.BitsLeft() > 0)
             {
                 if (mismatchingComponentTypes.find(comp->TypeId()) == mismatchingComponentTypes.end())
                 {
@@ -2550,6 +3163,7 @@ void SyncManager::HandleRemoveEntity(UserConnection* source, const char* data, s
     // Delete from the sender's syncstate so that we don't echo the delete back needlessly
     state->RemoveFromQueue(entityID); // Be sure to erase from dirty queue so that we don't invoke UDB
     state->entities.erase(entityID);
+    state->snapshotReceiver.Remove(entityID);
 }
 
 void SyncManager::HandleRemoveComponents(UserConnection* source, const char* data, size_t numBytes)
@@ -2617,6 +3231,7 @@ void SyncManager::HandleCreateAttributes(UserConnection* source, const char* dat
     bool isServer = owner_->IsServer();
     // For clients, the change type is LocalOnly. For server, the change type is Replicate, so that it will get replicated to all clients in turn
     AttributeChange::Type change = isServer ? AttributeChange::Replicate : AttributeChange::LocalOnly;
+    const bool quantized = source->ProtocolVersion() >= ProtocolQuantizedAttributes;
     
     kNet::DataDeserializer ds(data, numBytes);
     unsigned sceneID = ds.ReadVLE<kNet::VLE8_16_32>(); ///\todo Dummy ID. Lookup scene once multiscene is properly supported
@@ -2673,7 +3288,7 @@ void SyncManager::HandleCreateAttributes(UserConnection* source, const char* dat
         addedAttrs.push_back(attr);
         try
         {
-            attr->FromBinary(ds, AttributeChange::Disconnected);
+            ReadAttribute(ds, attr, quantized, false, AttributeChange::Disconnected);
         } catch (kNet::NetException &/*e*/)
         {
             LogError("Failed to deserialize the creation of a new attribute from the peer!");
@@ -2765,11 +3380,14 @@ void SyncManager::HandleEditAttributes(UserConnection* source, const char* data,
     // For clients, the change type is LocalOnly. For server, the change type is Replicate, so that it will get replicated to all clients in turn
     bool isServer = owner_->IsServer();
     AttributeChange::Type change = isServer ? AttributeChange::Replicate : AttributeChange::LocalOnly;
+    const bool quantized = source->ProtocolVersion() >= ProtocolQuantizedAttributes;
     
     kNet::DataDeserializer ds(data, numBytes);
     unsigned sceneID = ds.ReadVLE<kNet::VLE8_16_32>(); ///\todo Dummy ID. Lookup scene once multiscene is properly supported
     UNREFERENCED_PARAM(sceneID)
     entity_id_t entityID = ds.ReadVLE<kNet::VLE8_16_32>();
+    const bool tickStamped = !isServer && source->ProtocolVersion() >= ProtocolTickStamps;
+    const u32 tick = tickStamped ? ds.Read<u32>() : 0;
     
     if (!ValidateAction(source, cRemoveAttributesMessage, entityID))
         return;
@@ -2784,15 +3402,29 @@ void SyncManager::HandleEditAttributes(UserConnection* source, const char* data,
         return;
     }
     
-    // Record the update time for calculating the update interval
-    // Default update interval if state not found or interval not measured yet
     float updateInterval = updatePeriod_;
-    entityState.UpdateReceived();
-    if (entityState.avgUpdateInterval > 0.0f)
-        updateInterval = entityState.avgUpdateInterval;
+    if (tickStamped)
+    {
+        // Interpolate over the server time between this and the previous update, regardless of when they arrived.
+        state->serverTick.Received(tick, kNet::Clock::SecondsSinceD(clockStart_));
+        const float tickPeriod = state->serverTick.TickPeriod() > 0.f ? state->serverTick.TickPeriod() : updatePeriod_;
+        u32 ticks = 1;
+        if (entityState.lastReceivedTick != 0 && tick > entityState.lastReceivedTick)
+            ticks = Min(tick - entityState.lastReceivedTick, Max(cMaxAttributeInterpolationTicks, state->serverSendInterval));
+        entityState.lastReceivedTick = tick;
+        updateInterval = ticks * tickPeriod;
+    }
+    else
+    {
+        // Record the update time for calculating the update interval
+        // Default update interval if state not found or interval not measured yet
+        entityState.UpdateReceived();
+        if (entityState.avgUpdateInterval > 0.0f)
+            updateInterval = entityState.avgUpdateInterval;
 
-    // Add a fudge factor in case there is jitter in packet receipt or the server is too taxed
-    updateInterval *= 1.25f;
+        // Add a fudge factor in case there is jitter in packet receipt or the server is too taxed
+        updateInterval *= 1.25f;
+    }
 
     std::vector<IAttribute*> changedAttrs;
     while (ds.BitsLeft() >= 8)
@@ -2817,6 +3449,12 @@ void SyncManager::HandleEditAttributes(UserConnection* source, const char* data,
             continue;
         }
         const AttributeVector& attributes = comp->Attributes();
+        const bool useMetadata = quantized && attrDs.Read<kNet::bit>() != 0;
+        if (!CanReadWithMetadata(useMetadata, comp.get()))
+        {
+            LogWarning("Attribute data of " + comp->TypeName() + " in " + entity->ToString() + " for EditAttributes message was quantized with metadata that the placeholder component does not have, skipping to next component");
+            continue;
+        }
 
         int indexingMethod = attrDs.Read<kNet::bit>();
         if (!indexingMethod)
@@ -2841,13 +3479,13 @@ void SyncManager::HandleEditAttributes(UserConnection* source, const char* data,
                 bool interpolate = (!isServer && attr->Metadata() && attr->Metadata()->interpolation == AttributeMetadata::Interpolate);
                 if (!interpolate)
                 {
-                    attr->FromBinary(attrDs, AttributeChange::Disconnected);
+                    ReadAttribute(attrDs, attr, quantized, useMetadata, AttributeChange::Disconnected);
                     changedAttrs.push_back(attr);
                 }
                 else
                 {
                     IAttribute* endValue = attr->Clone();
-                    endValue->FromBinary(attrDs, AttributeChange::Disconnected);
+                    ReadAttribute(attrDs, endValue, quantized, useMetadata, AttributeChange::Disconnected);
                     scene->StartAttributeInterpolation(attr, endValue, updateInterval);
                 }
             }
@@ -2873,13 +3511,13 @@ void SyncManager::HandleEditAttributes(UserConnection* source, const char* data,
                     bool interpolate = (!isServer && attr->Metadata() && attr->Metadata()->interpolation == AttributeMetadata::Interpolate);
                     if (!interpolate)
                     {
-                        attr->FromBinary(attrDs, AttributeChange::Disconnected);
+                        ReadAttribute(attrDs, attr, quantized, useMetadata, AttributeChange::Disconnected);
                         changedAttrs.push_back(attr);
                     }
                     else
                     {
                         IAttribute* endValue = attr->Clone();
-                        endValue->FromBinary(attrDs, AttributeChange::Disconnected);
+                        ReadAttribute(attrDs, endValue, quantized, useMetadata, AttributeChange::Disconnected);
                         scene->StartAttributeInterpolation(attr, endValue, updateInterval);
                     }
                 }
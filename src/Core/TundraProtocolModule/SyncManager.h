@@ -10,12 +10,15 @@
 #include "AttributeChangeType.h"
 #include "EntityAction.h"
 #include "InterestManager.h"
+#include "DeadReckoning.h"
+#include "SendRate.h"
 #include "HighPerfClock.h"
 
 #include <kNetFwd.h>
 #include <kNet/Types.h>
 
 #include <QObject>
+#include <QVariant>
 
 class Framework;
 
@@ -46,6 +49,15 @@ public:
 
     void SetInterestManager(InterestManager* im);
 
+    /// Returns the policy that decides when the transforms of entities are sent to the clients. Server only.
+    DeadReckoning &TransformSendPolicy() { return deadReckoning_; }
+
+    /// Returns the limits and thresholds by which the send rates of the client connections adapt to their links. Server only.
+    SendRateSettings &SendRatePolicy() { return sendRateSettings_; }
+
+    /// Returns the send rate statistics of the client connections on the latest server tick. Server only.
+    const SendRateTickMetrics &SendRateMetrics() const { return sendRateMetrics_; }
+
 public slots:
     /// Set update period (seconds)
     void SetUpdatePeriod(float period);
@@ -59,6 +71,11 @@ public slots:
     SceneSyncState* SceneState(u32 connectionId) const;
     SceneSyncState* SceneState(const UserConnectionPtr &connection) const; /**< @overload @param connection Client connection.*/
 
+    /// Returns the send rate statistics of the latest server tick, and the send interval of each client connection with the link
+    /// state and the reason it was chosen by.
+    /** @note This slot is only exposed on Server, otherwise returns an empty map. */
+    QVariantMap SendRateStatistics() const;
+
     /// Upates Interest Manager settings.
     /** @param enabled If true, the IM scheme is allowed to filter traffic.
         @param bool eucl If true, the euclidean distance filter is active.
@@ -120,7 +137,10 @@ private slots:
 
 private:
     /// Craft a component full update, with all static and dynamic attributes.
-    bool WriteComponentFullUpdate(kNet::DataSerializer& ds, ComponentPtr comp);
+    /** @param quantized Whether to write the attributes with the compact encoding of ProtocolQuantizedAttributes,
+            which is preceded by the number of static attributes.
+        @param useMetadata Whether the compact encoding uses the quantization of the attribute metadata, see SceneSyncState::QuantizesComponentType. */
+    bool WriteComponentFullUpdate(kNet::DataSerializer& ds, ComponentPtr comp, bool quantized, bool useMetadata);
     /// Handle entity action message.
     void HandleEntityAction(UserConnection* source, MsgEntityAction& msg);
     /// Handle create entity message.
@@ -154,6 +174,31 @@ private:
     
     void ReplicateRigidBodyChanges(UserConnection* user);
 
+    /// Client side: applies a received rigid body state to the interpolation state of the entity.
+    /** @param changedParts Parts of the state that were received, as a bitmask of (1 << RigidBodySnapshot::Part). */
+    void ApplyRigidBodyUpdate(UserConnection* source, kNet::packet_id_t packetId, const EntityPtr &e, const Transform &t,
+        const float3 &newLinearVel, const float3 &newAngVel, int changedParts);
+
+    /// Sends the rigid body states to a client in a snapshot, delta-encoded against the states the client has acknowledged.
+    /** Used instead of ReplicateRigidBodyChanges for clients with ProtocolSnapshotDeltas. */
+    void ReplicateSnapshot(UserConnection* user);
+    /// Handle snapshot message.
+    void HandleSnapshot(UserConnection* source, kNet::packet_id_t packetId, const char* data, size_t numBytes);
+    /// Handle snapshot acknowledgement message.
+    void HandleSnapshotAck(UserConnection* source, const char* data, size_t numBytes);
+
+    /// Sends the network tick period to a client with ProtocolTickStamps.
+    void SendNetworkTick(UserConnection* user);
+    /// Handle network tick period message.
+    void HandleNetworkTick(UserConnection* source, const char* data, size_t numBytes);
+    /// Updates the send interval of a client with the statistics of its link. Returns true if the interval changed.
+    bool UpdateSendRate(KNetUserConnection* user, f64 time);
+    /// Client side: adds a received tick-stamped rigid body state to the snapshot ring of the entity. Used instead of
+    /// ApplyRigidBodyUpdate with ProtocolTickStamps. @see ApplyRigidBodyUpdate for the parameters.
+    void BufferRigidBodyUpdate(const EntityPtr &e, u32 tick, const Transform &t, const float3 &newLinearVel, const float3 &newAngVel, int changedParts);
+    /// Client side: returns the server tick the tick-stamped rigid body states are rendered at.
+    f64 RenderTick(const SceneSyncState* state) const;
+
     void InterpolateRigidBodies(f64 frametime, SceneSyncState* state);
 
     void ReplicateComponentType(u32 typeId, UserConnection* connection = 0);
@@ -190,8 +235,12 @@ private:
     
     /// Time period for update, default 1/30th of a second
     float updatePeriod_;
-    /// Time accumulator for update
-    float updateAcc_;
+    /// Number of update periods since the server started, stamped to the messages sent to clients with ProtocolTickStamps (server only)
+    u32 networkTick_;
+    /// Start time of the local clock. The client measures the server ticks against it, and the server times the send rate decisions.
+    kNet::tick_t clockStart_;
+    /// Time of the next network update tick, in seconds since clockStart_
+    f64 nextTickTime_;
     
     /// Physics client interpolation/extrapolation period length as number of network update intervals (default 3)
     float maxLinExtrapTime_;
@@ -215,6 +264,14 @@ private:
     /// Interest manager currently in use, null if none
     InterestManager *interestmanager_;
 
+    /// Send policy for the transforms in the rigid body update messages
+    DeadReckoning deadReckoning_;
+
+    /// Limits and thresholds of the adaptive send rates of the client connections
+    SendRateSettings sendRateSettings_;
+    /// Send rate statistics of the latest server tick
+    SendRateTickMetrics sendRateMetrics_;
+
     /// The sender of a component type. Used to avoid sending component description back to sender
     UserConnection* componentTypeSender_;
 
@@ -156,6 +156,15 @@ void SceneSyncState::Clear()
     changeRequest_.Reset();
     scene_.reset();
     placeholderComponentsSent_ = false;
+    placeholderComponentTypes_.clear();
+    snapshotBaselines = TundraLogic::SnapshotBaselines();
+    snapshotReceiver = TundraLogic::SnapshotReceiver();
+    serverTick = TundraLogic::ServerTickClock();
+    sentTickPeriod = 0.f;
+    sendRate.Reset(1);
+    sentSendInterval = 0;
+    serverSendInterval = 1;
+    renderDelayTicks = 0.0;
 }
 
 void SceneSyncState::RemoveFromQueue(entity_id_t id)
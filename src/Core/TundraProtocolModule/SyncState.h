@@ -12,6 +12,9 @@
 #include "Transform.h"
 #include "Math/float3.h"
 #include "MsgEntityAction.h"
+#include "SnapshotDelta.h"
+#include "SnapshotInterpolation.h"
+#include "SendRate.h"
 
 #include <QObject>
 #include <QVariant>
@@ -75,6 +78,7 @@ struct EntitySyncState
         hasParentChange(false),
         id(0),
         avgUpdateInterval(0.0f),
+        lastReceivedTick(0),
         lastNetworkSendTime(kNet::Clock::Tick())
     {
     }
@@ -173,7 +177,8 @@ struct EntitySyncState
     bool hasParentChange; ///> The entity's parent has changed
     
     kNet::PolledTimer updateTimer; ///< Last update received timer
-    float avgUpdateInterval; ///< Average network update interval in seconds
+    float avgUpdateInterval; ///< Average network update interval in seconds, for servers without ProtocolTickStamps
+    u32 lastReceivedTick; ///< Server tick of the latest attribute update received, 0 if none. Client only, see ProtocolTickStamps.
 
     // Special cases for rigid body streaming:
     // On the server side, remember the last sent rigid body parameters, so that we can perform effective pruning of redundant data.
@@ -206,6 +211,9 @@ struct RigidBodyInterpolationState
     /// Remembers the packet id of the most recently received network sync packet. Used to enforce
     /// proper ordering (generate latest-data-guarantee messaging) for the received movement packets.
     kNet::packet_id_t lastReceivedPacketCounter;
+
+    /// The tick-stamped states received from the server, rendered instead of the Hermite interpolation above with ProtocolTickStamps.
+    TundraLogic::SnapshotRing snapshots;
 };
 
 /// State change request to permit/deny changes.
@@ -291,6 +299,35 @@ public:
     /// Entity interpolations
     std::map<entity_id_t, RigidBodyInterpolationState> entityInterpolations;
 
+    /// Entities whose current transform the client has not received exactly, because the client-side prediction was within
+    /// the dead reckoning tolerances. These are checked on each network update until the keep-alive corrects them. Server only.
+    std::set<entity_id_t> unsentTransforms;
+
+    /// The rigid body states the client has acknowledged, used as baselines of the snapshots. Server only, see ProtocolSnapshotDeltas.
+    TundraLogic::SnapshotBaselines snapshotBaselines;
+
+    /// The recently received rigid body states, which the server can use as baselines of the snapshots. Client only.
+    TundraLogic::SnapshotReceiver snapshotReceiver;
+
+    /// Estimate of the server's network tick, from the tick stamps of the received messages. Client only, see ProtocolTickStamps.
+    TundraLogic::ServerTickClock serverTick;
+
+    /// The network tick period last sent to the client, 0 if none. Server only, see ProtocolTickStamps.
+    float sentTickPeriod;
+
+    /// How many server ticks apart the updates are sent to the client, adapted to the link. Server only, see SyncManager::SendRateMetrics.
+    TundraLogic::SendRate sendRate;
+
+    /// The send interval last sent to the client with the tick period, 0 if none. Server only.
+    u32 sentSendInterval;
+
+    /// How many server ticks apart the server sends the updates, as told by the server. Client only, see ProtocolTickStamps.
+    u32 serverSendInterval;
+
+    /// How many server ticks behind the server the tick-stamped states are currently rendered. Eases towards the delay the send
+    /// interval needs when the interval changes. Client only.
+    f64 renderDelayTicks;
+
     /// Maps containing the relevance factors and visibility data
     /// @remarks InterestManager functionality
     std::map<entity_id_t, bool> visibleEntities;
@@ -385,6 +422,13 @@ public:
     bool NeedSendPlaceholderComponents() const { return !placeholderComponentsSent_; }
     void MarkPlaceholderComponentsSent() { placeholderComponentsSent_ = true; }
 
+    /// Returns whether the attributes of a component type are sent with the quantization of their metadata, see IAttribute::ToQuantizedBinary.
+    /** Not for the component types whose description has been sent in either direction, as either end may only have a placeholder of them.
+        Only decides how the attributes are sent. The choice is sent along with the data, which is read accordingly. */
+    bool QuantizesComponentType(u32 typeId) const { return placeholderComponentTypes_.find(typeId) == placeholderComponentTypes_.end(); }
+    /// Marks that the description of a placeholder component type has been sent in either direction.
+    void MarkPlaceholderComponentType(u32 typeId) { placeholderComponentTypes_.insert(typeId); }
+
 private:
     // Returns if entity with id should be added to the sync state.
     bool ShouldMarkAsDirty(entity_id_t id);
@@ -403,6 +447,7 @@ private:
     StateChangeRequest changeRequest_;
     bool isServer_;
     bool placeholderComponentsSent_;
+    std::set<u32> placeholderComponentTypes_;
     u32 userConnectionID_;
 
     SceneWeakPtr scene_;
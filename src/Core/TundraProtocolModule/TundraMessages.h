@@ -41,6 +41,13 @@ const unsigned long cRegisterComponentTypeMessage = 123;
 // Entity parenting
 const unsigned long cSetEntityParentMessage = 124;
 
+// Snapshots of rigid body states, delta-encoded against the states the client has acknowledged
+const unsigned long cSnapshotMessage = 125; // Server->client only
+const unsigned long cSnapshotAckMessage = 126; // Client->server only
+
+// Length of the server's network tick, which the tick stamps of ProtocolTickStamps count
+const unsigned long cNetworkTickMessage = 127; // Server->client only
+
 // In case of network message structs are regenerated and descriptions get deleted., saving their descriptions here.
 // MsgAssetDeleted: Network message informing that asset has been deleted from storage.
 // MsgAssetDiscovery: Network message informing that new asset has been discovered in storage.
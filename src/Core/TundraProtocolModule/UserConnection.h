@@ -18,11 +18,14 @@ enum NetworkProtocolVersion
 {
     ProtocolOriginal = 0x1,         // Original
     ProtocolCustomComponents = 0x2, // Adds support for transmitting new static-structured component types without actual C++ implementation, using EC_PlaceholderComponent
-    ProtocolHierarchicScene = 0x3   // Adds support for hierarchic scene, ie. entities having child entities,
+    ProtocolHierarchicScene = 0x3,  // Adds support for hierarchic scene, ie. entities having child entities,
+    ProtocolQuantizedAttributes = 0x4, // Attribute values are sent with the compact encoding of IAttribute::ToQuantizedBinary
+    ProtocolSnapshotDeltas = 0x5,   // Rigid body states are sent in unreliable snapshots, delta-encoded against the states acknowledged by the client
+    ProtocolTickStamps = 0x6        // Snapshots and attribute edits from the server carry the server's network tick, which the client renders at a fixed delay
 };
 
 /// Highest supported protocol version in the build. Update this when a new protocol version is added
-const NetworkProtocolVersion cHighestSupportedProtocolVersion = ProtocolHierarchicScene;
+const NetworkProtocolVersion cHighestSupportedProtocolVersion = ProtocolTickStamps;
 
 /// Represents a client connection on the server side. Subclassed by networking implementations.
 class TUNDRAPROTOCOL_MODULE_API UserConnection : public QObject, public enable_shared_from_this<UserConnection>
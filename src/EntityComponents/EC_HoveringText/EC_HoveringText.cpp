@@ -21,6 +21,8 @@
 #include "OgreMaterialUtils.h"
 #include "AssetAPI.h"
 #include "TextureAsset.h"
+#include "HoveringTextRenderable.h"
+#include "Math/MathFunc.h"
 
 #include <Ogre.h>
 #include <QFile>
@@ -30,12 +32,46 @@
 
 #include "MemoryLeakCheck.h"
 
+namespace
+{
+    /// Clips a rectangle to bounds, cutting its texture coordinates in proportion. Returns false if nothing is left.
+    bool ClipToBounds(QRectF &rect, float &u0, float &v0, float &u1, float &v1, const QRectF &bounds)
+    {
+        QRectF clipped = rect & bounds;
+        if (clipped.isEmpty())
+            return false;
+        if (clipped != rect)
+        {
+            float du = (u1 - u0) / rect.width(), dv = (v1 - v0) / rect.height();
+            float newU0 = u0 + (clipped.left() - rect.left()) * du;
+            float newV0 = v0 + (clipped.top() - rect.top()) * dv;
+            u1 = u0 + (clipped.right() - rect.left()) * du;
+            v1 = v0 + (clipped.bottom() - rect.top()) * dv;
+            u0 = newU0;
+            v0 = newV0;
+            rect = clipped;
+        }
+        return true;
+    }
+
+    Ogre::ColourValue ToColourValue(const QColor &color, float alpha)
+    {
+        return Ogre::ColourValue(color.redF(), color.greenF(), color.blueF(), color.alphaF() * alpha);
+    }
+}
+
 EC_HoveringText::EC_HoveringText(Scene* scene) :
     IComponent(scene),
     font_(QFont("Arial", 100)),
     textColor_(Qt::black),
     billboardSet_(0),
     billboard_(0),
+    glyphRenderable_(0),
+    billboardSize_(1.0f, 1.0f),
+    layoutDirty_(true),
+    glyphAtlasFull_(false),
+    visible_(true),
+    materialNameRequested_(false),
     INIT_ATTRIBUTE_VALUE(usingGrad, "Use Gradient", false),
     INIT_ATTRIBUTE(text, "Text"),
     INIT_ATTRIBUTE_VALUE(font, "Font", "Arial"),
@@ -77,13 +113,30 @@ void EC_HoveringText::Destroy()
 
     if (!world_.expired())
     {
-        Ogre::SceneManager* sceneMgr = world_.lock()->OgreSceneManager();
-        
         try{
         Ogre::MaterialManager::getSingleton().remove(materialName_);
         } catch(...)
         {
         }
+        DestroyBillboard();
+    }
+    DestroyGlyphRenderable();
+
+    billboard_ = 0;
+    billboardSet_ = 0;
+    textureName_ = "";
+    materialName_ = "";
+    glyphAtlas_.reset();
+    layout_.clear();
+    layoutDirty_ = true;
+}
+
+void EC_HoveringText::DestroyBillboard()
+{
+    if (!world_.expired())
+    {
+        Ogre::SceneManager* sceneMgr = world_.lock()->OgreSceneManager();
+
         try{
         if (billboardSet_ && billboard_)
             billboardSet_->removeBillboard(billboard_);
@@ -104,8 +157,54 @@ void EC_HoveringText::Destroy()
 
     billboard_ = 0;
     billboardSet_ = 0;
-    textureName_ = "";
-    materialName_ = "";
+}
+
+void EC_HoveringText::DestroyGlyphRenderable()
+{
+    if (!glyphRenderable_)
+        return;
+
+    ReleaseGlyphs();
+    layout_.clear();
+    layoutDirty_ = true;
+
+    // If the scene has been destroyed, destroying the scene node has already detached the renderable.
+    try
+    {
+        if (glyphRenderable_->getParentSceneNode())
+            glyphRenderable_->getParentSceneNode()->detachObject(glyphRenderable_);
+    }
+    catch(...)
+    {
+    }
+    delete glyphRenderable_;
+    glyphRenderable_ = 0;
+}
+
+bool EC_HoveringText::UsesGlyphAtlas() const
+{
+    // QPainter draws the border with a pen of borderThickness, or a one pixel pen if borderThickness is 0.
+    // QPainter also shapes the text with QTextLayout, which the glyph atlas does not.
+    return !materialNameRequested_ && !glyphAtlasFull_ && borderColor.Get().a <= 0.f && HoveringTextGlyphAtlas::IsSimpleText(text.Get());
+}
+
+QString EC_HoveringText::GetMaterialName()
+{
+    // The material of the glyph atlas path shows the whole atlas, so switch to painting the text to the texture of the material.
+    if (!materialNameRequested_)
+    {
+        materialNameRequested_ = true;
+        if (glyphRenderable_)
+            ShowMessage(text.Get());
+    }
+    return QString::fromStdString(materialName_);
+}
+
+Ogre::MovableObject *EC_HoveringText::SceneObject() const
+{
+    if (glyphRenderable_)
+        return glyphRenderable_;
+    return billboardSet_;
 }
 
 void EC_HoveringText::SetPosition(const float3& position)
@@ -118,11 +217,15 @@ void EC_HoveringText::SetPosition(const float3& position)
         billboard_->setPosition(position);
         billboardSet_->_updateBounds(); // Documentation of Ogre::BillboardSet says the update is never called automatically, so now do it manually.
     }
+    if (glyphRenderable_)
+        glyphRenderable_->SetPosition(position);
 }
 
 void EC_HoveringText::SetFont(const QFont &font)
 {
     font_ = font;
+    layoutDirty_ = true;
+    glyphAtlasFull_ = false;
     Redraw();
 }
 
@@ -143,8 +246,9 @@ void EC_HoveringText::Show()
     if (!ViewEnabled())
         return;
 
-    if (billboardSet_)
-        billboardSet_->setVisible(true);
+    visible_ = true;
+    if (SceneObject())
+        SceneObject()->setVisible(true);
 }
 
 void EC_HoveringText::Hide()
@@ -152,12 +256,20 @@ void EC_HoveringText::Hide()
     if (!ViewEnabled())
         return;
 
-    if (billboardSet_)
-        billboardSet_->setVisible(false);
+    visible_ = false;
+    if (SceneObject())
+        SceneObject()->setVisible(false);
 }
 
 void EC_HoveringText::SetOverlayAlpha(float alpha)
 {
+    // The glyph quads have the alpha in their vertex colors.
+    if (glyphRenderable_)
+    {
+        RedrawGlyphs();
+        return;
+    }
+
     Ogre::MaterialManager &mgr = Ogre::MaterialManager::getSingleton();
     Ogre::MaterialPtr material = mgr.getByName(materialName_);
     if (!material.get() || material->getNumTechniques() < 1 || material->getTechnique(0)->getNumPasses() < 1 || material->getTechnique(0)->getPass(0)->getNumTextureUnitStates() < 1)
@@ -169,6 +281,9 @@ void EC_HoveringText::SetOverlayAlpha(float alpha)
 
 void EC_HoveringText::SetBillboardSize(float width, float height)
 {
+    billboardSize_ = float2(width, height);
+    if (glyphRenderable_)
+        RedrawGlyphs();
     if (billboard_)
     {
         billboard_->setDimensions(width, height);
@@ -184,8 +299,8 @@ bool EC_HoveringText::IsVisible() const
     if (!ViewEnabled())
         return false;
 
-    if (billboardSet_)
-        return billboardSet_->isVisible();
+    if (SceneObject())
+        return SceneObject()->isVisible();
     else
         return false;
 }
@@ -217,22 +332,56 @@ void EC_HoveringText::ShowMessage(const QString &text)
     if (!sceneNode)
         return;
 
-    // Create billboard if it doesn't exist.
-    if (!billboardSet_)
+    if (UsesGlyphAtlas())
     {
-        billboardSet_ = scene->createBillboardSet(world->GetUniqueObjectName("EC_HoveringText"), 1);
-        assert(billboardSet_);
-        billboardSet_->Ogre::MovableObject::setUserAny(Ogre::Any(static_cast<IComponent *>(this)));
-        billboardSet_->Ogre::Renderable::setUserAny(Ogre::Any(static_cast<IComponent *>(this)));
-        sceneNode->attachObject(billboardSet_);
-    }
+        DestroyBillboard();
 
-    if (billboardSet_ && !billboard_)
+        // Create the glyph renderable if it doesn't exist.
+        if (!glyphRenderable_)
+        {
+            glyphRenderable_ = new HoveringTextRenderable();
+            glyphRenderable_->Ogre::MovableObject::setUserAny(Ogre::Any(static_cast<IComponent *>(this)));
+            glyphRenderable_->Ogre::Renderable::setUserAny(Ogre::Any(static_cast<IComponent *>(this)));
+            glyphRenderable_->setCastShadows(false);
+            glyphRenderable_->setVisible(visible_);
+            if (!materialName_.empty())
+                glyphRenderable_->setMaterial(materialName_);
+            sceneNode->attachObject(glyphRenderable_);
+
+            layoutDirty_ = true;
+            SetBillboardSize(width.Get(), height.Get());
+            SetPosition(position.Get());
+        }
+    }
+    else
     {
-        billboard_ = billboardSet_->createBillboard(Ogre::Vector3(0, 0, 0.7f));
+        bool usedGlyphAtlas = glyphRenderable_ != 0;
+        DestroyGlyphRenderable();
 
-        SetBillboardSize(width.Get(), height.Get());
-        SetPosition(position.Get());
+        // Create billboard if it doesn't exist.
+        if (!billboardSet_)
+        {
+            billboardSet_ = scene->createBillboardSet(world->GetUniqueObjectName("EC_HoveringText"), 1);
+            assert(billboardSet_);
+            billboardSet_->setVisible(visible_);
+            billboardSet_->Ogre::MovableObject::setUserAny(Ogre::Any(static_cast<IComponent *>(this)));
+            billboardSet_->Ogre::Renderable::setUserAny(Ogre::Any(static_cast<IComponent *>(this)));
+            if (!materialName_.empty())
+                billboardSet_->setMaterialName(materialName_);
+            sceneNode->attachObject(billboardSet_);
+        }
+
+        if (billboardSet_ && !billboard_)
+        {
+            billboard_ = billboardSet_->createBillboard(Ogre::Vector3(0, 0, 0.7f));
+
+            SetBillboardSize(width.Get(), height.Get());
+            SetPosition(position.Get());
+        }
+
+        // The glyph quads left the overlay alpha out of the material.
+        if (usedGlyphAtlas)
+            SetOverlayAlpha(overlayAlpha.Get());
     }
 
     Redraw();
@@ -243,12 +392,18 @@ void EC_HoveringText::Redraw()
     if (!ViewEnabled())
         return;
 
+    if (glyphRenderable_)
+    {
+        RedrawGlyphs();
+        return;
+    }
+
     if (world_.expired() || !billboardSet_ || !billboard_ || materialName_.empty())
         return;
 
     bool textEmpty = text.Get().isEmpty();
 
-    billboardSet_->setVisible(!textEmpty);
+    billboardSet_->setVisible(!textEmpty && visible_);
     if (textEmpty)
         return;
 
@@ -308,6 +463,263 @@ void EC_HoveringText::Redraw()
     }
 }
 
+void EC_HoveringText::RedrawGlyphs()
+{
+    if (world_.expired() || !glyphRenderable_ || materialName_.empty())
+        return;
+
+    bool textEmpty = text.Get().isEmpty();
+
+    glyphRenderable_->setVisible(!textEmpty && visible_);
+    if (textEmpty)
+        return;
+
+    try
+    {
+        HoveringTextGlyphAtlasPtr atlas = HoveringTextGlyphAtlas::ForFont(font_);
+        if (atlas != glyphAtlas_)
+        {
+            if (glyphAtlas_)
+            {
+                ReleaseGlyphs();
+                disconnect(glyphAtlas_.get(), 0, this, 0);
+            }
+            glyphAtlas_ = atlas;
+            // Queued, as the atlas is rebuilt in the middle of laying out a text.
+            connect(glyphAtlas_.get(), SIGNAL(Rebuilt()), this, SLOT(OnGlyphAtlasRebuilt()), Qt::QueuedConnection);
+            layoutDirty_ = true;
+        }
+
+        if (layoutDirty_)
+        {
+            if (!LayoutGlyphs())
+            {
+                // The atlas is full of the glyphs of other texts, paint this one to a texture of its own instead.
+                LogDebug("EC_HoveringText: Glyph atlas " + glyphAtlas_->TextureName() + " is full, painting the text to a texture.");
+                glyphAtlasFull_ = true;
+                ShowMessage(text.Get());
+                return;
+            }
+            glyphAtlas_->UploadTexture();
+            layoutDirty_ = false;
+
+            // The text color and the overlay alpha come from the vertex colors.
+            Ogre::MaterialPtr material = Ogre::MaterialManager::getSingleton().getByName(materialName_);
+            OgreRenderer::SetTextureUnitOnMaterial(material, glyphAtlas_->TextureName());
+            if (material.get() && material->getNumTechniques() > 0 && material->getTechnique(0)->getNumPasses() > 0 &&
+                material->getTechnique(0)->getPass(0)->getNumTextureUnitStates() > 0)
+            {
+                Ogre::TextureUnitState *textureUnit = material->getTechnique(0)->getPass(0)->getTextureUnitState(0);
+                textureUnit->setColourOperation(Ogre::LBO_MODULATE);
+                textureUnit->setAlphaOperation(Ogre::LBX_MODULATE, Ogre::LBS_TEXTURE, Ogre::LBS_CURRENT);
+                textureUnit->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
+            }
+        }
+    }
+    catch(Ogre::Exception &e)
+    {
+        LogError("Failed to draw hovering text glyphs: " + std::string(e.what()));
+        return;
+    }
+
+    // Map the layout from texture pixels to the billboard and color it.
+    const float texW = texWidth.Get() > 0.f ? texWidth.Get() : 1.f;
+    const float texH = texHeight.Get() > 0.f ? texHeight.Get() : 1.f;
+    const float alpha = overlayAlpha.Get();
+
+    const bool hasBackground = usingGrad.Get() || backgroundColor.Get().a > 0.f;
+    QColor gradientStart = backgroundColor.Get();
+    QColor gradientEnd = gradientStart;
+    if (usingGrad.Get())
+    {
+        // Same as QPainter draws with bg_grad_, whose stops are vertically from the top to the bottom of the texture.
+        QGradientStops stops = bg_grad_.stops();
+        gradientStart = stops.front().second;
+        gradientEnd = stops.back().second;
+    }
+
+    std::vector<HoveringTextQuad> quads;
+    quads.reserve(layout_.size());
+    for(size_t i = 0; i < layout_.size(); ++i)
+    {
+        const LayoutQuad &l = layout_[i];
+        if (l.background && !hasBackground)
+            continue;
+
+        HoveringTextQuad q;
+        q.left = (l.rect.left() / texW - 0.5f) * billboardSize_.x;
+        q.right = (l.rect.right() / texW - 0.5f) * billboardSize_.x;
+        q.top = (0.5f - l.rect.top() / texH) * billboardSize_.y;
+        q.bottom = (0.5f - l.rect.bottom() / texH) * billboardSize_.y;
+        q.u0 = l.u0;
+        q.v0 = l.v0;
+        q.u1 = l.u1;
+        q.v1 = l.v1;
+        if (l.background)
+        {
+            float gradientRange = Max(texH - 1.f, 1.f);
+            float t0 = Clamp01(static_cast<float>(l.rect.top()) / gradientRange);
+            float t1 = Clamp01(static_cast<float>(l.rect.bottom()) / gradientRange);
+            Ogre::ColourValue start = ToColourValue(gradientStart, alpha), end = ToColourValue(gradientEnd, alpha);
+            q.topColor = start + (end - start) * t0;
+            q.bottomColor = start + (end - start) * t1;
+        }
+        else
+            q.topColor = q.bottomColor = ToColourValue(textColor_, alpha);
+        quads.push_back(q);
+    }
+
+    glyphRenderable_->SetQuads(quads);
+}
+
+bool EC_HoveringText::LayoutGlyphs()
+{
+    layout_.clear();
+
+    QString str = text.Get();
+    str.replace("\\n", "\n");
+
+    // Hold the glyphs of the new text before releasing those of the old one, so that the glyphs in both stay on the atlas.
+    QString glyphs(" ");
+    for(int i = 0; i < str.size(); ++i)
+        if (str[i] != '\n' && !glyphs.contains(str[i]))
+            glyphs += str[i];
+    for(int i = 0; i < glyphs.size(); ++i)
+        if (!glyphAtlas_->AcquireGlyph(glyphs[i]))
+        {
+            for(int j = 0; j < i; ++j)
+                glyphAtlas_->ReleaseGlyph(glyphs[j]);
+            return false;
+        }
+    ReleaseGlyphs();
+    heldGlyphs_ = glyphs;
+
+    const float scale = glyphAtlas_->Scale(font_);
+    const float lineSpacing = glyphAtlas_->LineSpacing() * scale;
+    const float ascent = glyphAtlas_->Ascent() * scale;
+    const float spaceWidth = glyphAtlas_->GetGlyph(' ').advance * scale;
+    const QRectF bounds(0, 0, texWidth.Get(), texHeight.Get());
+
+    // Wrap the lines as QPainter does with Qt::TextWordWrap: at spaces, and a word longer than a line overflows it.
+    QStringList lines;
+    std::vector<float> lineWidths;
+    foreach(const QString &paragraph, str.split('\n'))
+    {
+        QStringList words = paragraph.split(' ');
+        QString line;
+        float lineWidth = 0.f;
+        for(int i = 0; i < words.size(); ++i)
+        {
+            float wordWidth = 0.f;
+            for(int j = 0; j < words[i].size(); ++j)
+                wordWidth += glyphAtlas_->GetGlyph(words[i][j]).advance * scale;
+
+            if (i > 0 && !line.isEmpty() && lineWidth + spaceWidth + wordWidth > bounds.width())
+            {
+                lines << line;
+                lineWidths.push_back(lineWidth);
+                line = words[i];
+                lineWidth = wordWidth;
+            }
+            else
+            {
+                if (i > 0)
+                {
+                    line += ' ';
+                    lineWidth += spaceWidth;
+                }
+                line += words[i];
+                lineWidth += wordWidth;
+            }
+        }
+        lines << line;
+        lineWidths.push_back(lineWidth);
+    }
+
+    // The text is centered on the texture, and the background drawn around it.
+    float textWidth = 0.f;
+    for(size_t i = 0; i < lineWidths.size(); ++i)
+        textWidth = Max(textWidth, lineWidths[i]);
+    const float textHeight = lines.size() * lineSpacing;
+    const QRectF textRect((bounds.width() - textWidth) * 0.5f, (bounds.height() - textHeight) * 0.5f, textWidth, textHeight);
+
+    // The rounded rectangle as nine quads: the corners from the corner cell of the atlas, mirrored as needed, and the
+    // edges and the middle from the solid cell. The radii are relative, as with Qt::RelativeSize.
+    const float2 &corners = cornerRadius.Get();
+    float rx = Clamp(corners.x, 0.f, 100.f) / 100.f * textRect.width() * 0.5f;
+    float ry = Clamp(corners.y, 0.f, 100.f) / 100.f * textRect.height() * 0.5f;
+    if (rx < 0.5f || ry < 0.5f)
+        rx = ry = 0.f;
+    const float xs[4] = { textRect.left(), textRect.left() + rx, textRect.right() - rx, textRect.right() };
+    const float ys[4] = { textRect.top(), textRect.top() + ry, textRect.bottom() - ry, textRect.bottom() };
+    const QRectF solid = glyphAtlas_->SolidUv();
+    const QRectF corner = glyphAtlas_->CornerUv();
+    for(int row = 0; row < 3; ++row)
+        for(int col = 0; col < 3; ++col)
+        {
+            LayoutQuad q;
+            q.rect = QRectF(QPointF(xs[col], ys[row]), QPointF(xs[col + 1], ys[row + 1]));
+            q.background = true;
+            if (q.rect.isEmpty())
+                continue;
+            if (row != 1 && col != 1)
+            {
+                q.u0 = col == 0 ? corner.left() : corner.right();
+                q.u1 = col == 0 ? corner.right() : corner.left();
+                q.v0 = row == 0 ? corner.top() : corner.bottom();
+                q.v1 = row == 0 ? corner.bottom() : corner.top();
+            }
+            else
+            {
+                q.u0 = solid.left();
+                q.u1 = solid.right();
+                q.v0 = solid.top();
+                q.v1 = solid.bottom();
+            }
+            if (ClipToBounds(q.rect, q.u0, q.v0, q.u1, q.v1, bounds))
+                layout_.push_back(q);
+        }
+
+    for(int i = 0; i < lines.size(); ++i)
+    {
+        float x = textRect.left() + (textWidth - lineWidths[i]) * 0.5f;
+        float baseline = textRect.top() + i * lineSpacing + ascent;
+        for(int j = 0; j < lines[i].size(); ++j)
+        {
+            HoveringTextGlyphAtlas::Glyph glyph = glyphAtlas_->GetGlyph(lines[i][j]);
+            if (!glyph.uv.isEmpty())
+            {
+                LayoutQuad q;
+                q.rect = QRectF(x + glyph.rect.left() * scale, baseline + glyph.rect.top() * scale,
+                    glyph.rect.width() * scale, glyph.rect.height() * scale);
+                q.u0 = glyph.uv.left();
+                q.v0 = glyph.uv.top();
+                q.u1 = glyph.uv.right();
+                q.v1 = glyph.uv.bottom();
+                q.background = false;
+                if (ClipToBounds(q.rect, q.u0, q.v0, q.u1, q.v1, bounds))
+                    layout_.push_back(q);
+            }
+            x += glyph.advance * scale;
+        }
+    }
+    return true;
+}
+
+void EC_HoveringText::ReleaseGlyphs()
+{
+    if (glyphAtlas_)
+        for(int i = 0; i < heldGlyphs_.size(); ++i)
+            glyphAtlas_->ReleaseGlyph(heldGlyphs_[i]);
+    heldGlyphs_.clear();
+}
+
+void EC_HoveringText::OnGlyphAtlasRebuilt()
+{
+    layoutDirty_ = true;
+    Redraw();
+}
+
 void EC_HoveringText::AttributesChanged()
 {
     if (!ViewEnabled())
@@ -334,8 +746,8 @@ void EC_HoveringText::AttributesChanged()
     if (material.ValueChanged())
     {
         // Don't render the HoveringText if it's not using a material.
-        if (billboardSet_)
-            billboardSet_->setVisible(!material.Get().ref.isEmpty());
+        if (SceneObject())
+            SceneObject()->setVisible(!material.Get().ref.isEmpty() && visible_);
 
         // If the material was cleared, erase the material from Ogre billboard as well. (we might be deleting the material in Tundra Asset API)
         if (material.Get().ref.isEmpty() && billboardSet_)
@@ -348,6 +760,15 @@ void EC_HoveringText::AttributesChanged()
             materialAsset.HandleAssetRefChange(&material);
     }
 
+    // Changes to the following attributes lay out the glyphs again. Changes to the colors only rebuild the quads.
+    if (text.ValueChanged() || font.ValueChanged() || fontSize.ValueChanged() || texWidth.ValueChanged() || texHeight.ValueChanged()
+        || cornerRadius.ValueChanged())
+        layoutDirty_ = true;
+
+    // A new text or font may fit on the glyph atlas.
+    if (text.ValueChanged() || font.ValueChanged() || fontSize.ValueChanged())
+        glyphAtlasFull_ = false;
+
     // Changes to the following attributes require a (expensive) repaint of the texture on the CPU side.
     bool repaint = text.ValueChanged() || font.ValueChanged() || fontSize.ValueChanged() || fontColor.ValueChanged()
         || backgroundColor.ValueChanged() || borderColor.ValueChanged() || borderThickness.ValueChanged() || usingGrad.ValueChanged()
@@ -382,6 +803,8 @@ void EC_HoveringText::OnMaterialAssetFailed(IAssetTransfer* transfer, QString re
 
     if (billboardSet_)
         billboardSet_->setMaterialName(OgreRenderer::Renderer::ErrorMaterialName);
+    if (glyphRenderable_)
+        glyphRenderable_->setMaterial(OgreRenderer::Renderer::ErrorMaterialName);
 }
 
 void EC_HoveringText::RecreateMaterial()
@@ -401,6 +824,9 @@ void EC_HoveringText::RecreateMaterial()
             billboardSet_->setMaterialName(materialName_);
             billboardSet_->setCastShadows(false); ///\todo Is this good here?
         }
+        if (glyphRenderable_)
+            glyphRenderable_->setMaterial(materialName_);
+        layoutDirty_ = true; // Sets the atlas texture to the new material.
         Redraw();
     }
     catch(...)
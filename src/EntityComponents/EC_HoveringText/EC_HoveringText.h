@@ -14,11 +14,16 @@
 #include "AssetReference.h"
 #include "AssetRefListener.h"
 #include "Color.h"
+#include "HoveringTextGlyphAtlas.h"
 
 #include <QFont>
 #include <QColor>
 #include <QLinearGradient>
 
+#include <vector>
+
+class HoveringTextRenderable;
+
 /// Shows a hovering text attached to an entity.
 /** <table class="header">
     <tr>
@@ -26,6 +31,11 @@
     <h2>HoveringText</h2>
     Shows a hovering text attached to an entity.
 
+    The text is drawn as quads from a glyph atlas that is shared by all hovering texts using the same font,
+    so changing the text or its colors does not repaint a texture. A text with a visible border, or whose material
+    has been asked for with GetMaterialName, is painted to a texture of its own instead. So is a text that needs
+    shaping, e.g. Arabic, Hebrew or Indic text, as the glyph atlas lays out one character at a time.
+
     <b>Attributes</b>:
     <ul>
     <li>QString : text
@@ -226,8 +236,9 @@ public slots:
     void SetBillboardSize(float width, float height);
 
     /// Gets the name of the material that this component has created for displaying the text.
-    /** Useful for using this just to create the material, and using e.g. a mesh to display it. */
-    QString GetMaterialName() const { return QString::fromStdString(materialName_); }
+    /** Useful for using this just to create the material, and using e.g. a mesh to display it.
+        @note The text is painted to a texture of this material, instead of being drawn from the glyph atlas, from the first call on. */
+    QString GetMaterialName();
 
 private slots:
     /// Redraws the hovering text with the current text, font and color.
@@ -239,6 +250,9 @@ private slots:
     /// Called when material asset failed to load
     void OnMaterialAssetFailed(IAssetTransfer* transfer, QString reason);
 
+    /// Called when the texture coordinates of the glyph atlas have changed.
+    void OnGlyphAtlasRebuilt();
+
 private:
     void AttributesChanged();
 
@@ -249,6 +263,38 @@ private:
     /// Recreates the internal cloned material from the currently specified material asset reference (that is assumed to be loaded already).
     void RecreateMaterial();
 
+    /// Returns true if the text can be drawn from the glyph atlas. A border and text that needs shaping are only drawn by
+    /// painting the text to a texture, which is also done when the material has been asked for with GetMaterialName
+    /// and when the atlas is full.
+    bool UsesGlyphAtlas() const;
+
+    /// Returns the billboard set or the glyph renderable, whichever is in use.
+    Ogre::MovableObject *SceneObject() const;
+
+    /// Destroys the billboard set used to show the text texture.
+    void DestroyBillboard();
+
+    /// Destroys the renderable used to show the glyph quads.
+    void DestroyGlyphRenderable();
+
+    /// Redraws the text from the glyph atlas, laying it out first if it has changed.
+    void RedrawGlyphs();
+
+    /// Lays out the background and the glyphs of the text in texture pixels, holding the glyphs on the atlas.
+    /** @return False if the glyphs do not fit on the atlas. */
+    bool LayoutGlyphs();
+
+    /// Releases the glyphs held on the glyph atlas.
+    void ReleaseGlyphs();
+
+    /// A quad of the laid out text, in texture pixels.
+    struct LayoutQuad
+    {
+        QRectF rect;
+        float u0, v0, u1, v1;
+        bool background; ///< Colored with the background instead of the text color.
+    };
+
     /// Ogre world pointer.
     OgreWorldWeakPtr world_;
     
@@ -277,6 +323,32 @@ private:
     // Texture which contains hovering text
     TextureAssetPtr texture_;
 
+    /// Atlas of the glyphs of the font, while the text is drawn from it.
+    HoveringTextGlyphAtlasPtr glyphAtlas_;
+
+    /// Renders the glyph quads facing the camera, used instead of billboardSet_ when drawing from the glyph atlas.
+    HoveringTextRenderable *glyphRenderable_;
+
+    /// World space size of the glyph renderable, as set with SetBillboardSize.
+    float2 billboardSize_;
+
+    /// The text laid out in texture pixels. Only changes to the text, the font or the texture size lay it out again,
+    /// changes to the colors and the billboard size only rebuild the quads from this.
+    std::vector<LayoutQuad> layout_;
+    bool layoutDirty_;
+
+    /// Characters whose glyphs this text holds on the glyph atlas, each once.
+    QString heldGlyphs_;
+
+    /// Set when the glyphs of the text did not fit on the glyph atlas. The text is then painted to a texture until it or the font changes.
+    bool glyphAtlasFull_;
+
+    /// Cleared by Hide and set by Show. Redrawing an empty or non-empty text keeps a hidden text hidden.
+    bool visible_;
+
+    /// Set when GetMaterialName has been called. The material is then expected to show the text, so the glyph atlas is not used.
+    bool materialNameRequested_;
+
     AssetRefListener materialAsset;
 };
 COMPONENT_TYPEDEFS(HoveringText);
@@ -0,0 +1,328 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   HoveringTextGlyphAtlas.cpp
+    @brief  Glyphs of a font rasterized once to a texture that is shared by all hovering texts using the font. */
+
+#include "Math/MathNamespace.h"
+#include "DebugOperatorNew.h"
+
+#include "HoveringTextGlyphAtlas.h"
+#include "LoggingFunctions.h"
+#include "Math/MathFunc.h"
+
+#include <OgreTextureManager.h>
+#include <OgreHardwarePixelBuffer.h>
+
+#include <QPainter>
+
+#include <map>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    /// Pixel size the glyphs are rasterized at.
+    const int cGlyphPixelSize = 48;
+    /// Width of the texture, and the initial and largest height.
+    const int cTextureWidth = 1024;
+    const int cInitialTextureHeight = 256;
+    const int cMaxTextureHeight = 4096;
+    /// Empty pixels between cells, so that the glyphs do not bleed to each other when filtered.
+    const int cCellPadding = 2;
+    /// Radius of the rounded corner cell.
+    const int cCornerSize = 64;
+    /// Transparent white, so that filtering the edges of the glyphs does not darken them.
+    const QRgb cClearColor = 0x00FFFFFF;
+
+    std::map<QString, weak_ptr<HoveringTextGlyphAtlas> > atlases;
+    uint atlasCounter = 0;
+
+    QString AtlasKey(const QFont &font)
+    {
+        return font.family() + "/" + QString::number(font.weight()) + (font.italic() ? "/italic" : "");
+    }
+
+    QFont AtlasFont(const QFont &font)
+    {
+        QFont atlasFont(font);
+        atlasFont.setPixelSize(cGlyphPixelSize);
+        return atlasFont;
+    }
+}
+
+HoveringTextGlyphAtlasPtr HoveringTextGlyphAtlas::ForFont(const QFont &font)
+{
+    QString key = AtlasKey(font);
+    HoveringTextGlyphAtlasPtr atlas = atlases[key].lock();
+    if (!atlas)
+    {
+        atlas = HoveringTextGlyphAtlasPtr(new HoveringTextGlyphAtlas(font, key));
+        atlases[key] = atlas;
+    }
+    return atlas;
+}
+
+HoveringTextGlyphAtlas::HoveringTextGlyphAtlas(const QFont &font_, const QString &key_) :
+    key(key_),
+    font(AtlasFont(font_)),
+    image(cTextureWidth, cInitialTextureHeight, QImage::Format_ARGB32),
+    metrics(font, &image),
+    textureName("EC_HoveringText_atlas_" + QString::number(++atlasCounter).toStdString()),
+    acquireCounter(0),
+    shelfX(0),
+    shelfY(0),
+    shelfHeight(0),
+    textureResized(true)
+{
+    Clear();
+
+    try
+    {
+        texture = Ogre::TextureManager::getSingleton().createManual(textureName,
+            Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, Ogre::TEX_TYPE_2D, image.width(), image.height(),
+            Ogre::MIP_UNLIMITED, Ogre::PF_A8R8G8B8, Ogre::TU_DEFAULT | Ogre::TU_AUTOMIPMAP);
+    }
+    catch(Ogre::Exception &e)
+    {
+        LogError("HoveringTextGlyphAtlas: Failed to create texture " + textureName + ": " + std::string(e.what()));
+    }
+}
+
+HoveringTextGlyphAtlas::~HoveringTextGlyphAtlas()
+{
+    atlases.erase(key);
+
+    texture.setNull();
+    if (Ogre::TextureManager::getSingletonPtr())
+    {
+        try
+        {
+            Ogre::TextureManager::getSingleton().remove(textureName);
+        }
+        catch(...) {}
+    }
+}
+
+bool HoveringTextGlyphAtlas::IsSimpleText(const QString &text)
+{
+    for(int i = 0; i < text.size(); ++i)
+    {
+        const QChar c = text[i];
+        // A surrogate pair is one character in two halves, which have no glyphs of their own.
+        if (c.isHighSurrogate() || c.isLowSurrogate())
+            return false;
+
+        // Right-to-left text is reordered, and Arabic letters take a different form depending on their neighbours.
+        switch(c.direction())
+        {
+        case QChar::DirR:
+        case QChar::DirAL:
+        case QChar::DirRLE:
+        case QChar::DirRLO:
+        case QChar::DirLRE:
+        case QChar::DirLRO:
+        case QChar::DirPDF:
+            return false;
+        default:
+            break;
+        }
+
+        // Marks and joiners are positioned relative to, or merged with, the characters around them, e.g. in Indic scripts.
+        switch(c.category())
+        {
+        case QChar::Mark_NonSpacing:
+        case QChar::Mark_SpacingCombining:
+        case QChar::Mark_Enclosing:
+        case QChar::Other_Format:
+            return false;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+bool HoveringTextGlyphAtlas::AcquireGlyph(QChar c)
+{
+    QHash<ushort, CachedGlyph>::iterator iter = glyphs.find(c.unicode());
+    if (iter == glyphs.end())
+    {
+        CachedGlyph cached;
+        cached.advance = metrics.width(c);
+        cached.refCount = 0;
+
+        // Pad the bounding rect by a pixel, antialiasing may cross it.
+        QRectF bounds = metrics.boundingRect(c);
+        if (!c.isSpace() && bounds.width() > 0 && bounds.height() > 0)
+        {
+            QPoint topLeft(FloorInt(bounds.left()) - 1, FloorInt(bounds.top()) - 1);
+            QSize size(CeilInt(bounds.right()) + 1 - topLeft.x(), CeilInt(bounds.bottom()) + 1 - topLeft.y());
+            cached.slot = AllocateCell(size);
+            if (cached.slot.isEmpty())
+                cached.slot = EvictGlyph(size);
+            if (cached.slot.isEmpty())
+                return false;
+
+            cached.cell = QRect(cached.slot.topLeft(), size);
+            cached.rect = QRectF(topLeft, size);
+            QPainter painter(&image);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            painter.fillRect(cached.slot, QColor::fromRgba(cClearColor));
+            painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+            painter.setRenderHint(QPainter::TextAntialiasing);
+            painter.setClipRect(cached.cell);
+            painter.setFont(font);
+            painter.setPen(Qt::white);
+            painter.drawText(cached.cell.topLeft() - topLeft, QString(c));
+            dirtyRect |= cached.slot;
+        }
+        iter = glyphs.insert(c.unicode(), cached);
+    }
+
+    ++iter->refCount;
+    iter->lastAcquired = ++acquireCounter;
+    return true;
+}
+
+void HoveringTextGlyphAtlas::ReleaseGlyph(QChar c)
+{
+    QHash<ushort, CachedGlyph>::iterator iter = glyphs.find(c.unicode());
+    if (iter != glyphs.end() && iter->refCount > 0)
+        --iter->refCount;
+}
+
+HoveringTextGlyphAtlas::Glyph HoveringTextGlyphAtlas::GetGlyph(QChar c) const
+{
+    Glyph glyph;
+    QHash<ushort, CachedGlyph>::const_iterator iter = glyphs.find(c.unicode());
+    if (iter == glyphs.end())
+        return glyph;
+
+    glyph.rect = iter->rect;
+    glyph.advance = iter->advance;
+    if (!iter->cell.isEmpty())
+        glyph.uv = CellUv(iter->cell);
+    return glyph;
+}
+
+void HoveringTextGlyphAtlas::UploadTexture()
+{
+    if (texture.isNull() || texture->getBuffer().isNull())
+        return;
+
+    QRect rect = textureResized ? image.rect() : dirtyRect;
+    if (rect.isEmpty())
+        return;
+
+    Ogre::PixelBox imageBox(image.width(), image.height(), 1, Ogre::PF_A8R8G8B8, image.bits());
+    Ogre::Box updateBox(rect.left(), rect.top(), rect.right() + 1, rect.bottom() + 1);
+    texture->getBuffer()->blitFromMemory(imageBox.getSubVolume(updateBox), updateBox);
+
+    dirtyRect = QRect();
+    textureResized = false;
+}
+
+float HoveringTextGlyphAtlas::Scale(const QFont &textFont) const
+{
+    return QFontMetricsF(textFont, &image).height() / metrics.height();
+}
+
+QRect HoveringTextGlyphAtlas::AllocateCell(const QSize &size)
+{
+    QSize padded = size + QSize(cCellPadding, cCellPadding);
+    if (padded.width() > image.width() || padded.height() > cMaxTextureHeight)
+        return QRect();
+
+    // Start a new shelf if the cell does not fit on the current one. The shelf is kept if the cell does not fit at all.
+    int x = shelfX;
+    int y = shelfY;
+    int height = shelfHeight;
+    if (x + padded.width() > image.width())
+    {
+        x = 0;
+        y += height;
+        height = 0;
+    }
+    if (y + padded.height() > cMaxTextureHeight)
+        return QRect();
+
+    if (y + padded.height() > image.height())
+    {
+        int newHeight = image.height();
+        while(y + padded.height() > newHeight)
+            newHeight *= 2;
+        Resize(Min(newHeight, cMaxTextureHeight));
+        emit Rebuilt();
+    }
+
+    shelfX = x + padded.width();
+    shelfY = y;
+    shelfHeight = Max(height, padded.height());
+    return QRect(QPoint(x, y), size);
+}
+
+QRect HoveringTextGlyphAtlas::EvictGlyph(const QSize &size)
+{
+    QHash<ushort, CachedGlyph>::iterator oldest = glyphs.end();
+    for(QHash<ushort, CachedGlyph>::iterator iter = glyphs.begin(); iter != glyphs.end(); ++iter)
+        if (iter->refCount == 0 && iter->slot.width() >= size.width() && iter->slot.height() >= size.height() &&
+            (oldest == glyphs.end() || iter->lastAcquired < oldest->lastAcquired))
+            oldest = iter;
+    if (oldest == glyphs.end())
+        return QRect();
+
+    QRect slot = oldest->slot;
+    glyphs.erase(oldest);
+    return slot;
+}
+
+void HoveringTextGlyphAtlas::Clear()
+{
+    image.fill(cClearColor);
+    glyphs.clear();
+    shelfX = 0;
+    shelfY = 0;
+    shelfHeight = 0;
+    textureResized = true;
+
+    QPainter painter(&image);
+
+    QRect solidCell = AllocateCell(QSize(4, 4));
+    painter.fillRect(solidCell, Qt::white);
+    // Sample only the middle of the cell, the edges are filtered with the padding.
+    solidUv = CellUv(solidCell.adjusted(1, 1, -1, -1));
+
+    // One pixel wider than the corner, so that the opaque edges of the corner are not filtered with the padding.
+    QRect cell = AllocateCell(QSize(cCornerSize + 1, cCornerSize + 1));
+    cornerCell = QRect(cell.topLeft(), QSize(cCornerSize, cCornerSize));
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setClipRect(cell);
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(Qt::white);
+    painter.drawEllipse(QRectF(cell.topLeft(), QSizeF(2 * cCornerSize, 2 * cCornerSize)));
+}
+
+void HoveringTextGlyphAtlas::Resize(int height)
+{
+    QImage resized(image.width(), height, QImage::Format_ARGB32);
+    resized.fill(cClearColor);
+    for(int y = 0; y < image.height() && y < height; ++y)
+        memcpy(resized.scanLine(y), image.constScanLine(y), image.bytesPerLine());
+    image = resized;
+    textureResized = true;
+
+    if (!texture.isNull())
+    {
+        texture->freeInternalResources();
+        texture->setHeight(height);
+        texture->createInternalResources();
+    }
+}
+
+QRectF HoveringTextGlyphAtlas::CellUv(const QRect &cell) const
+{
+    const float width = static_cast<float>(image.width());
+    const float height = static_cast<float>(image.height());
+    return QRectF(cell.x() / width, cell.y() / height, cell.width() / width, cell.height() / height);
+}
@@ -0,0 +1,147 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   HoveringTextGlyphAtlas.h
+    @brief  Glyphs of a font rasterized once to a texture that is shared by all hovering texts using the font. */
+
+#pragma once
+
+#include "CoreTypes.h"
+
+#include <QObject>
+#include <QFont>
+#include <QFontMetricsF>
+#include <QImage>
+#include <QHash>
+#include <QRect>
+
+#include <OgreTexture.h>
+
+class HoveringTextGlyphAtlas;
+typedef shared_ptr<HoveringTextGlyphAtlas> HoveringTextGlyphAtlasPtr;
+
+/// @cond PRIVATE
+/// Glyphs of a font rasterized once to a texture that is shared by all hovering texts using the font.
+/** The glyphs are rasterized at a fixed pixel size on first use and scaled to the size of the text, so all sizes
+    of a font family and style share one atlas. Besides the glyphs, the atlas holds a solid and a rounded corner
+    cell for drawing the background of the text.
+
+    The glyphs are laid out one UTF-16 character at a time, without shaping or kerning. Text that needs shaping,
+    i.e. right-to-left scripts, combining marks, joiners or characters outside the Basic Multilingual Plane,
+    cannot be drawn from the atlas, see IsSimpleText.
+
+    The users of the atlas hold the glyphs of their text with AcquireGlyph until they release them. The texture
+    grows when it runs out of space, which changes the texture coordinates of the glyphs and emits Rebuilt, after
+    which the users need to lay out their text again. When the texture cannot grow anymore, the cell of the least
+    recently acquired glyph that no text holds is reused. The glyphs held stay where they are. */
+class HoveringTextGlyphAtlas : public QObject
+{
+    Q_OBJECT
+
+public:
+    /// A rasterized glyph.
+    struct Glyph
+    {
+        Glyph() : advance(0.f) {}
+
+        /// Extent of the glyph image relative to the pen position on the baseline, in atlas font pixels.
+        QRectF rect;
+        /// Texture coordinates of the glyph image. Empty if the glyph has no pixels, e.g. a space.
+        QRectF uv;
+        /// How far the pen moves after the glyph, in atlas font pixels.
+        float advance;
+    };
+
+    /// Returns the atlas for the family and style of font, creating it if no hovering text is using it yet.
+    static HoveringTextGlyphAtlasPtr ForFont(const QFont &font);
+
+    ~HoveringTextGlyphAtlas();
+
+    /// Returns true if text can be drawn from an atlas, i.e. its characters do not need to be shaped together.
+    static bool IsSimpleText(const QString &text);
+
+    /// Holds the glyph of character c on the atlas until ReleaseGlyph, rasterizing it first if needed.
+    /** A newly rasterized glyph is on the texture only after UploadTexture.
+        @return False if the glyph does not fit on the atlas, as it is full of glyphs in use. */
+    bool AcquireGlyph(QChar c);
+
+    /// Releases a glyph held with AcquireGlyph. Its cell can then be reused for another glyph.
+    void ReleaseGlyph(QChar c);
+
+    /// Returns the glyph of character c, which must be held with AcquireGlyph.
+    Glyph GetGlyph(QChar c) const;
+
+    /// Copies the glyphs rasterized since the last call to the texture.
+    void UploadTexture();
+
+    /// Returns the factor from atlas font pixels to the pixels of font when drawn to an image.
+    float Scale(const QFont &font) const;
+
+    /// Returns the distance between the baselines of two lines, in atlas font pixels.
+    float LineSpacing() const { return metrics.lineSpacing(); }
+
+    /// Returns the distance from the top of a line to its baseline, in atlas font pixels.
+    float Ascent() const { return metrics.ascent(); }
+
+    /// Returns texture coordinates within a fully opaque cell.
+    QRectF SolidUv() const { return solidUv; }
+
+    /// Returns the texture coordinates of the top left quarter of an opaque ellipse.
+    /** The center of the ellipse is at the bottom right corner. */
+    QRectF CornerUv() const { return CellUv(cornerCell); }
+
+    /// Returns the name of the Ogre texture.
+    const std::string &TextureName() const { return textureName; }
+
+    /// Returns the number of glyphs on the texture.
+    int NumGlyphs() const { return glyphs.size(); }
+
+signals:
+    /// Emitted when the texture coordinates of the glyphs have changed.
+    void Rebuilt();
+
+private:
+    HoveringTextGlyphAtlas(const QFont &font, const QString &key);
+
+    /// Reserves a size cell from the free space of the texture, growing the texture if needed.
+    QRect AllocateCell(const QSize &size);
+    /// Removes the least recently acquired glyph that is not held and whose cell fits size. Returns its cell, or an empty rect if there is none.
+    QRect EvictGlyph(const QSize &size);
+    /// Clears the image and reserves the background cells.
+    void Clear();
+    /// Changes the height of the image and the texture, keeping the contents.
+    void Resize(int height);
+    /// Returns the texture coordinates of a cell.
+    QRectF CellUv(const QRect &cell) const;
+
+    QString key; ///< Key of this atlas in the atlas registry.
+    QFont font; ///< Font that is rasterized, at the atlas pixel size.
+    QImage image; ///< CPU copy of the texture. White, with the glyph coverage in the alpha.
+    QFontMetricsF metrics;
+    std::string textureName;
+    Ogre::TexturePtr texture;
+
+    struct CachedGlyph
+    {
+        QRect slot; ///< Cell reserved for the glyph, in pixels. Can be larger than cell when reused. Empty if the glyph has no pixels.
+        QRect cell; ///< Position of the glyph image in the image, in pixels.
+        QRectF rect;
+        float advance;
+        int refCount; ///< Number of AcquireGlyph calls without a ReleaseGlyph.
+        uint lastAcquired; ///< Value of acquireCounter when last acquired.
+    };
+    QHash<ushort, CachedGlyph> glyphs;
+    uint acquireCounter;
+
+    QRect cornerCell;
+    QRectF solidUv;
+
+    /// Cells are allocated from left to right on shelves that stack downwards.
+    int shelfX;
+    int shelfY;
+    int shelfHeight;
+
+    QRect dirtyRect; ///< Part of the image that has not been uploaded yet.
+    bool textureResized; ///< The whole image needs to be uploaded.
+};
+/// @endcond
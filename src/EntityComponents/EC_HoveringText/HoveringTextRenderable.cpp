@@ -0,0 +1,181 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   HoveringTextRenderable.cpp
+    @brief  Draws the textured quads of a hovering text facing the camera. */
+
+#include "DebugOperatorNew.h"
+
+#include "HoveringTextRenderable.h"
+
+#include <OgreRoot.h>
+#include <OgreCamera.h>
+#include <OgreNode.h>
+#include <OgreHardwareBufferManager.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    /// Layout of a vertex, matching the vertex declaration.
+    struct Vertex
+    {
+        float x, y, z;
+        Ogre::RGBA color;
+        float u, v;
+    };
+
+    void SetVertex(Vertex *&v, float x, float y, Ogre::RGBA color, float u, float tv)
+    {
+        v->x = x;
+        v->y = y;
+        v->z = 0.f;
+        v->color = color;
+        v->u = u;
+        v->v = tv;
+        ++v;
+    }
+}
+
+HoveringTextRenderable::HoveringTextRenderable() :
+    position(Ogre::Vector3::ZERO),
+    radius(0),
+    rectLeft(0), rectTop(0), rectRight(0), rectBottom(0),
+    camera(0),
+    vertexCapacity(0)
+{
+    mRenderOp.vertexData = OGRE_NEW Ogre::VertexData();
+    mRenderOp.vertexData->vertexStart = 0;
+    mRenderOp.vertexData->vertexCount = 0;
+    mRenderOp.operationType = Ogre::RenderOperation::OT_TRIANGLE_LIST;
+    mRenderOp.useIndexes = false;
+
+    Ogre::VertexDeclaration *decl = mRenderOp.vertexData->vertexDeclaration;
+    size_t offset = 0;
+    decl->addElement(0, offset, Ogre::VET_FLOAT3, Ogre::VES_POSITION);
+    offset += Ogre::VertexElement::getTypeSize(Ogre::VET_FLOAT3);
+    decl->addElement(0, offset, Ogre::VET_COLOUR, Ogre::VES_DIFFUSE);
+    offset += Ogre::VertexElement::getTypeSize(Ogre::VET_COLOUR);
+    decl->addElement(0, offset, Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES, 0);
+    assert(decl->getVertexSize(0) == sizeof(Vertex));
+
+    UpdateBounds();
+}
+
+HoveringTextRenderable::~HoveringTextRenderable()
+{
+    OGRE_DELETE mRenderOp.vertexData;
+}
+
+void HoveringTextRenderable::SetPosition(const Ogre::Vector3 &pos)
+{
+    position = pos;
+    UpdateBounds();
+}
+
+void HoveringTextRenderable::SetQuads(const std::vector<HoveringTextQuad> &quads)
+{
+    const size_t vertexCount = quads.size() * 6;
+    if (vertexCount > vertexCapacity)
+    {
+        // Leave room to grow, so that a text that keeps changing does not reallocate every time.
+        vertexCapacity = std::max(vertexCount, vertexCapacity + vertexCapacity / 2);
+        Ogre::HardwareVertexBufferSharedPtr buffer = Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
+            sizeof(Vertex), vertexCapacity, Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
+        mRenderOp.vertexData->vertexBufferBinding->setBinding(0, buffer);
+    }
+    mRenderOp.vertexData->vertexCount = vertexCount;
+
+    radius = 0;
+    rectLeft = rectTop = rectRight = rectBottom = 0;
+    if (vertexCount > 0)
+    {
+        Ogre::Root &root = Ogre::Root::getSingleton();
+        Ogre::HardwareVertexBufferSharedPtr buffer = mRenderOp.vertexData->vertexBufferBinding->getBuffer(0);
+        Vertex *v = static_cast<Vertex*>(buffer->lock(0, vertexCount * sizeof(Vertex), Ogre::HardwareBuffer::HBL_DISCARD));
+        for(size_t i = 0; i < quads.size(); ++i)
+        {
+            const HoveringTextQuad &q = quads[i];
+            Ogre::RGBA top, bottom;
+            root.convertColourValue(q.topColor, &top);
+            root.convertColourValue(q.bottomColor, &bottom);
+
+            // Two counterclockwise triangles facing +Z, towards the camera.
+            SetVertex(v, q.left, q.top, top, q.u0, q.v0);
+            SetVertex(v, q.left, q.bottom, bottom, q.u0, q.v1);
+            SetVertex(v, q.right, q.bottom, bottom, q.u1, q.v1);
+            SetVertex(v, q.left, q.top, top, q.u0, q.v0);
+            SetVertex(v, q.right, q.bottom, bottom, q.u1, q.v1);
+            SetVertex(v, q.right, q.top, top, q.u1, q.v0);
+
+            radius = std::max(radius, Ogre::Vector2(std::max(fabs(q.left), fabs(q.right)), std::max(fabs(q.top), fabs(q.bottom))).length());
+            if (i == 0)
+            {
+                rectLeft = q.left;
+                rectTop = q.top;
+                rectRight = q.right;
+                rectBottom = q.bottom;
+            }
+            else
+            {
+                rectLeft = std::min(rectLeft, q.left);
+                rectTop = std::max(rectTop, q.top);
+                rectRight = std::max(rectRight, q.right);
+                rectBottom = std::min(rectBottom, q.bottom);
+            }
+        }
+        buffer->unlock();
+    }
+
+    UpdateBounds();
+}
+
+bool HoveringTextRenderable::FacingBounds(float &left, float &top, float &right, float &bottom) const
+{
+    if (mRenderOp.vertexData->vertexCount == 0)
+        return false;
+    left = rectLeft;
+    top = rectTop;
+    right = rectRight;
+    bottom = rectBottom;
+    return true;
+}
+
+void HoveringTextRenderable::UpdateBounds()
+{
+    // The quads turn with the camera, so the box needs to contain them in every orientation.
+    Ogre::Vector3 extent(std::max(radius, Ogre::Real(1e-3f)));
+    setBoundingBox(Ogre::AxisAlignedBox(position - extent, position + extent));
+    if (mParentNode)
+        mParentNode->needUpdate();
+}
+
+void HoveringTextRenderable::getWorldTransforms(Ogre::Matrix4 *xform) const
+{
+    const Ogre::Node *node = getParentNode();
+    if (!node)
+    {
+        *xform = Ogre::Matrix4::IDENTITY;
+        return;
+    }
+
+    // Oriented as the camera, in the same way as Ogre orients point billboards.
+    Ogre::Quaternion orientation = camera ? camera->getDerivedOrientation() : node->_getDerivedOrientation();
+    xform->makeTransform(node->_getFullTransform() * position, node->_getDerivedScale(), orientation);
+}
+
+Ogre::Real HoveringTextRenderable::getSquaredViewDepth(const Ogre::Camera *cam) const
+{
+    const Ogre::Node *node = getParentNode();
+    Ogre::Vector3 worldPosition = node ? node->_getFullTransform() * position : position;
+    return (worldPosition - cam->getDerivedPosition()).squaredLength();
+}
+
+void HoveringTextRenderable::_notifyCurrentCamera(Ogre::Camera *cam)
+{
+    Ogre::SimpleRenderable::_notifyCurrentCamera(cam);
+    camera = cam;
+}
@@ -0,0 +1,67 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   HoveringTextRenderable.h
+    @brief  Draws the textured quads of a hovering text facing the camera. */
+
+#pragma once
+
+#include "CameraFacingRenderable.h"
+
+#include <OgreColourValue.h>
+#include <OgreVector2.h>
+
+#include <vector>
+
+/// @cond PRIVATE
+/// A textured, vertex colored quad of a hovering text.
+struct HoveringTextQuad
+{
+    /// Corners in the plane of the text, x to the right and y up.
+    float left, top, right, bottom;
+    /// Texture coordinates of the top left and bottom right corner.
+    float u0, v0, u1, v1;
+    /// Colors of the top and bottom edge.
+    Ogre::ColourValue topColor, bottomColor;
+};
+
+/// Draws the textured quads of a hovering text, always facing the camera like a billboard.
+/** The quads are drawn in one batch from a single vertex buffer, which is reused when the quads change. */
+class HoveringTextRenderable : public CameraFacingRenderable
+{
+public:
+    HoveringTextRenderable();
+    ~HoveringTextRenderable();
+
+    /// Sets the center point of the text in the space of the parent scene node.
+    void SetPosition(const Ogre::Vector3 &position);
+
+    /// Replaces the quads that are drawn.
+    void SetQuads(const std::vector<HoveringTextQuad> &quads);
+
+    /// CameraFacingRenderable override. Returns the rectangle that contains all the quads.
+    bool FacingBounds(float &left, float &top, float &right, float &bottom) const;
+
+    /// Ogre::Renderable override. Places the quads at the position, facing the current camera.
+    void getWorldTransforms(Ogre::Matrix4 *xform) const;
+
+    /// Ogre::Renderable override.
+    Ogre::Real getSquaredViewDepth(const Ogre::Camera *cam) const;
+
+    /// Ogre::MovableObject override.
+    Ogre::Real getBoundingRadius() const { return radius; }
+
+    /// Ogre::MovableObject override. Stores the camera to face.
+    void _notifyCurrentCamera(Ogre::Camera *cam);
+
+private:
+    /// Updates the bounding box to contain the quads in any orientation.
+    void UpdateBounds();
+
+    Ogre::Vector3 position;
+    Ogre::Real radius; ///< Distance of the farthest quad corner from the position.
+    float rectLeft, rectTop, rectRight, rectBottom; ///< Rectangle that contains all the quads, empty if there are none.
+    const Ogre::Camera *camera;
+    size_t vertexCapacity;
+};
+/// @endcond